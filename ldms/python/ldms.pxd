@@ -330,6 +330,7 @@ cdef extern from "ldms.h" nogil:
     int ldms_transaction_begin(ldms_set_t s)
     int ldms_transaction_end(ldms_set_t s)
     void ldms_set_data_copy_set(ldms_set_t s, int on)
+    void ldms_set_delta_update_set(ldms_set_t s, int on)
 
     int ldms_set_info_set(ldms_set_t s, const char *key, const char *value)
     void ldms_set_info_unset(ldms_set_t s, const char *key)
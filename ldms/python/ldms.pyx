@@ -2580,6 +2580,15 @@ cdef class Set(object):
         """
         ldms_set_data_copy_set(self.rbd, on)
 
+    def delta_update_set(self, int on):
+        """S.delta_update_set( bool )
+
+        Turn delta updates on (True) or off (False) for a looked-up set. With
+        delta updates, S.update() reads only the data ranges that the peer
+        modified since the data generation held locally.
+        """
+        ldms_set_delta_update_set(self.rbd, on)
+
     def keys(self):
         """S.keys() - iterates over keys (metric names) of the set"""
         cdef int i
@@ -107,7 +107,8 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'prdcr_stream_dir' : {'req_attr':['regex'], 'opt_attr':[]},
                       ##### Updater Policy #####
                       'updtr_add': {'req_attr': ['name'],
-                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval']},
+                                    'opt_attr': ['offset', 'push', 'interval', 'auto_interval',
+                                                 'delta']},
                       'updtr_del': {'req_attr': ['name']},
                       'updtr_match_add': {'req_attr': ['name', 'regex', 'match']},
                       'updtr_match_del': {'req_attr': ['name', 'regex', 'match']},
@@ -120,7 +121,8 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'updtr_task': {'req_attr': ['name'], 'opt_attr': []},
                       ##### Storage Policy #####
                       'strgp_add': {'req_attr': ['name', 'plugin', 'container', 'schema'],
-                                    'opt_attr' : [ 'flush', 'decomposition' ] },
+                                    'opt_attr' : [ 'flush', 'decomposition',
+                                                   'queue_depth', 'queue_policy' ] },
                       'strgp_del': {'req_attr': ['name']},
                       'strgp_prdcr_add': {'req_attr': ['name', 'regex']},
                       'strgp_prdcr_del': {'req_attr': ['name', 'regex']},
@@ -146,6 +148,7 @@ LDMSD_CTRL_CMD_MAP = {'usage': {'req_attr': [], 'opt_attr': ['name']},
                       'thread_stats': {'req_attr':[], 'opt_attr': ['reset']},
                       'prdcr_stats': {'req_attr':[], 'opt_attr': []},
                       'set_stats': {'req_attr':[], 'opt_attr': []},
+                      'latency_stats': {'req_attr':[], 'opt_attr': ['type', 'name', 'reset']},
                       'listen': {'req_attr':['xprt', 'port'], 'opt_attr': ['host', 'auth']},
                       'metric_sets_default_authz': {'req_attr':[], 'opt_attr': ['uid', 'gid', 'perm']},
                       ##### Failover. #####
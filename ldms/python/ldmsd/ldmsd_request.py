@@ -105,7 +105,10 @@ class LDMSD_Req_Attr(object):
     AUTH = 35
     RESET = 36
     DECOMPOSITION = 37
-    LAST = 38
+    QUEUE_DEPTH = 38
+    QUEUE_POLICY = 39
+    DELTA = 40
+    LAST = 41
 
     NAME_ID_MAP = {'name': NAME,
                    'interval': INTERVAL,
@@ -147,6 +150,9 @@ class LDMSD_Req_Attr(object):
                    'reset': RESET,
                    'auth': AUTH,
                    'decomposition' : DECOMPOSITION,
+                   'queue_depth' : QUEUE_DEPTH,
+                   'queue_policy' : QUEUE_POLICY,
+                   'delta' : DELTA,
                    'TERMINATING': LAST
         }
 
@@ -187,6 +193,9 @@ class LDMSD_Req_Attr(object):
                    RESET : 'reset',
                    AUTH : 'auth',
                    DECOMPOSITION : 'decomposition',
+                   QUEUE_DEPTH : 'queue_depth',
+                   QUEUE_POLICY : 'queue_policy',
+                   DELTA : 'delta',
                    LAST : 'TERMINATING'
         }
 
@@ -346,6 +355,7 @@ class LDMSD_Request(object):
     SET_STATS = 0x600 + 15
     LISTEN = 0x600 + 16
     SET_DEFAULT_AUTHZ = 0x600 + 17
+    LATENCY_STATS = 0x600 + 19
 
     FAILOVER_CONFIG        = 0x700
     FAILOVER_PEERCFG_START = 0x700  +  1
@@ -441,6 +451,7 @@ class LDMSD_Request(object):
             'thread_stats'  :  {'id' : THREAD_STATS},
             'prdcr_stats'   :  {'id' : PRDCR_STATS},
             'set_stats'     :  {'id' : SET_STATS},
+            'latency_stats' :  {'id' : LATENCY_STATS},
             'setgroup_add'  :  {'id':  SETGROUP_ADD},
             'setgroup_mod'  :  {'id':  SETGROUP_MOD},
             'setgroup_del'  :  {'id':  SETGROUP_DEL},
@@ -72,12 +72,15 @@
 #include "ldms_heap.h"
 #include "ldms_private.h"
 #include "coll/rbt.h"
+#include "coll/fnv_hash.h"
 
 #define SET_DIR_PATH "/var/run/ldms"
 static char *__set_dir = SET_DIR_PATH;
 #define SET_DIR_LEN sizeof(SET_DIR_PATH)
 static char __set_path[PATH_MAX];
 static void __destroy_set(void *v);
+static void __name_idx_put(struct ldms_name_idx *nidx);
+static void __snapshot_free(struct ldms_snapshot *snap);
 
 static struct {
 	pthread_rwlock_t default_authz_lock;
@@ -115,6 +118,7 @@ void __dbg_dump_addr(unsigned long *p, size_t size)
 
 char *_create_path(const char *set_name);
 static ldms_mval_t __mval_to_get(struct ldms_set *s, int idx, ldms_mdesc_t *pd);
+size_t __ldms_value_size_get(enum ldms_value_type t, uint32_t count);
 
 static inline struct ldms_record_type *
 __rec_type(struct ldms_record_inst *rec_inst, ldms_mdesc_t *mdesc,
@@ -128,11 +132,6 @@ static int set_comparator(void *a, const void *b)
 	return strcmp(x, y);
 }
 
-static struct rbt __set_tree = {
-	.root = NULL,
-	.comparator = set_comparator
-};
-
 static int id_comparator(void *a, const void *b)
 {
 	uint64_t _a = (uint64_t)a;
@@ -145,12 +144,48 @@ static int id_comparator(void *a, const void *b)
 	return 0;
 }
 
-static struct rbt __id_tree = {
-	.root = NULL,
-	.comparator = id_comparator
+/*
+ * The set registry indexes the local sets by instance name and by
+ * set_id. Each index is split into LDMS_SET_SHARDS shards, each a
+ * red-black tree with its own reader/writer lock. Lookups from many
+ * peers proceed in parallel, and creating or deleting a set only
+ * excludes the readers of the two shards it lives in.
+ *
+ * Lock order: name shard, then id shard.
+ */
+#define LDMS_SET_SHARDS 64
+#define LDMS_SET_SHARD_SEED 0x811c9dc5 /* FNV-1a offset basis */
+struct ldms_set_shard {
+	pthread_rwlock_t lock;
+	struct rbt tree;
+} __attribute__((aligned(64)));
+
+static struct ldms_set_shard __name_shards[LDMS_SET_SHARDS] = {
+	[0 ... LDMS_SET_SHARDS - 1] = {
+		.lock = PTHREAD_RWLOCK_INITIALIZER,
+		.tree = RBT_INITIALIZER(set_comparator),
+	}
 };
 
-static pthread_mutex_t __set_tree_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ldms_set_shard __id_shards[LDMS_SET_SHARDS] = {
+	[0 ... LDMS_SET_SHARDS - 1] = {
+		.lock = PTHREAD_RWLOCK_INITIALIZER,
+		.tree = RBT_INITIALIZER(id_comparator),
+	}
+};
+
+static int __set_count;
+
+static inline struct ldms_set_shard *__name_shard(const char *name)
+{
+	uint32_t h = fnv_hash_a1_32(name, strlen(name), LDMS_SET_SHARD_SEED);
+	return &__name_shards[h % LDMS_SET_SHARDS];
+}
+
+static inline struct ldms_set_shard *__id_shard(uint64_t id)
+{
+	return &__id_shards[id % LDMS_SET_SHARDS];
+}
 
 static struct rbt __del_tree = {
 	.root = NULL,
@@ -159,7 +194,7 @@ static struct rbt __del_tree = {
 
 int ldms_set_count()
 {
-	return __set_tree.card;
+	return __atomic_load_n(&__set_count, __ATOMIC_RELAXED);
 }
 
 int ldms_set_deleting_count()
@@ -169,9 +204,48 @@ int ldms_set_deleting_count()
 
 static pthread_mutex_t __del_tree_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Mark the chunks covering [off, off + len) of the data section as dirty.
+ * `off` is relative to the data header. Offsets in the heap are ignored
+ * because the heap is always transferred as a whole by a delta update.
+ */
+void __ldms_data_dirty(struct ldms_data_hdr *data, uint32_t off, size_t len)
+{
+	struct ldms_set_hdr *meta;
+	uint32_t chunk_sz, b, e;
+
+	meta = (void *)data - __le32_to_cpu(data->set_off);
+	chunk_sz = __le32_to_cpu(meta->dirty_chunk_sz);
+	if (!chunk_sz || !len)
+		return;
+	b = off / chunk_sz;
+	if (b >= LDMS_DIRTY_MAP_BITS)
+		return;
+	e = (off + len - 1) / chunk_sz;
+	if (e >= LDMS_DIRTY_MAP_BITS)
+		e = LDMS_DIRTY_MAP_BITS - 1;
+	for (; b <= e; b++) {
+		__atomic_or_fetch(&data->dirty_map[b / 64],
+				  __cpu_to_le64(1ULL << (b % 64)),
+				  __ATOMIC_RELAXED);
+	}
+}
+
+static inline void __mval_dirty(struct ldms_data_hdr *data, void *mval,
+				ldms_mdesc_t desc)
+{
+	__ldms_data_dirty(data, ldms_off_(data, mval),
+			  __ldms_value_size_get(desc->vd_type,
+				__le32_to_cpu(desc->vd_array_count)));
+}
+
 void __ldms_gn_inc(struct ldms_set *set, ldms_mdesc_t desc)
 {
 	if (desc->vd_flags & LDMS_MDESC_F_DATA) {
+		__ldms_data_dirty(set->data,
+				  __le32_to_cpu(desc->vd_data_offset),
+				  __ldms_value_size_get(desc->vd_type,
+					__le32_to_cpu(desc->vd_array_count)));
 		LDMS_GN_INCREMENT(set->data->gn);
 	} else {
 		LDMS_GN_INCREMENT(set->meta->meta_gn);
@@ -179,58 +253,80 @@ void __ldms_gn_inc(struct ldms_set *set, ldms_mdesc_t desc)
 	}
 }
 
-/* Caller must hold the ldms set tree lock. */
+/*
+ * Find a local set by instance name. A reference is taken on the set
+ * returned; the caller drops it with ldms_set_put().
+ */
 struct ldms_set *__ldms_find_local_set(const char *set_name)
 {
+	struct ldms_set_shard *sh = __name_shard(set_name);
 	struct rbn *z;
 	struct ldms_set *s = NULL;
 
-	z = rbt_find(&__set_tree, (void *)set_name);
+	pthread_rwlock_rdlock(&sh->lock);
+	z = rbt_find(&sh->tree, (void *)set_name);
 	if (z) {
 		s = container_of(z, struct ldms_set, rb_node);
 		ref_get(&s->ref, __func__);
 	}
+	pthread_rwlock_unlock(&sh->lock);
 	return s;
 }
 
-/* Caller must hold the ldms set tree lock */
-struct ldms_set *__ldms_local_set_first()
+/*
+ * Add the set to the registry. Returns EEXIST if a set with the same
+ * instance name is already registered.
+ */
+static int __set_registry_add(struct ldms_set *set)
 {
-	struct rbn *z;
-	struct ldms_set *s = NULL;
+	const char *name = get_instance_name(set->meta)->name;
+	struct ldms_set_shard *nsh = __name_shard(name);
+	struct ldms_set_shard *ish = __id_shard(set->set_id);
 
-	z = rbt_min(&__set_tree);
-	if (z)
-		s = container_of(z, struct ldms_set, rb_node);
-	return s;
-}
-
-struct ldms_set *__ldms_local_set_next(struct ldms_set *s)
-{
-	struct rbn *z;
-	z = rbn_succ(&s->rb_node);
-	if (z)
-		return container_of(z, struct ldms_set, rb_node);
-	return NULL;
+	pthread_rwlock_wrlock(&nsh->lock);
+	if (rbt_find(&nsh->tree, (void *)name)) {
+		pthread_rwlock_unlock(&nsh->lock);
+		return EEXIST;
+	}
+	rbt_ins(&nsh->tree, &set->rb_node);
+	pthread_rwlock_wrlock(&ish->lock);
+	rbt_ins(&ish->tree, &set->id_node);
+	pthread_rwlock_unlock(&ish->lock);
+	__sync_fetch_and_add(&__set_count, 1);
+	pthread_rwlock_unlock(&nsh->lock);
+	return 0;
 }
 
-void __ldms_set_tree_lock()
+/*
+ * Remove the set from the registry. Returns ENOENT if the set is not
+ * registered, e.g. it has already been deleted.
+ */
+static int __set_registry_del(struct ldms_set *set)
 {
-	pthread_mutex_lock(&__set_tree_lock);
-}
+	struct ldms_set_shard *nsh = __name_shard(get_instance_name(set->meta)->name);
+	struct ldms_set_shard *ish = __id_shard(set->set_id);
+	struct rbn *rbn;
+	int rc = 0;
 
-void __ldms_set_tree_unlock()
-{
-	pthread_mutex_unlock(&__set_tree_lock);
+	pthread_rwlock_wrlock(&nsh->lock);
+	pthread_rwlock_wrlock(&ish->lock);
+	rbn = rbt_find(&ish->tree, (void *)set->set_id);
+	if (rbn != &set->id_node) {
+		rc = ENOENT;
+		goto out;
+	}
+	rbt_del(&nsh->tree, &set->rb_node);
+	rbt_del(&ish->tree, &set->id_node);
+	__sync_fetch_and_sub(&__set_count, 1);
+ out:
+	pthread_rwlock_unlock(&ish->lock);
+	pthread_rwlock_unlock(&nsh->lock);
+	return rc;
 }
 
 ldms_set_t ldms_set_by_name(const char *set_name)
 {
-	struct ldms_set *set;
-	__ldms_set_tree_lock();
-	set = __ldms_find_local_set(set_name);
-	__ldms_set_tree_unlock();
-	return set;
+	return __ldms_find_local_set(set_name);
 }
 
 uint64_t ldms_set_meta_gn_get(ldms_set_t s)
@@ -263,29 +359,62 @@ void ldms_set_data_copy_set(ldms_set_t s, int on)
 		s->flags &= ~LDMS_SET_F_DATA_COPY;
 }
 
+void ldms_set_delta_update_set(ldms_set_t s, int on)
+{
+	if (on)
+		s->flags |= LDMS_SET_F_DELTA_UPDATE;
+	else
+		s->flags &= ~LDMS_SET_F_DELTA_UPDATE;
+}
+
 struct cb_arg {
 	void *user_arg;
 	int (*user_cb)(struct ldms_set *, void *);
+	int published_only;
 };
 
 static int rbn_cb(struct rbn *rbn, void *arg, int level)
 {
 	struct cb_arg *cb_arg = arg;
 	struct ldms_set *set = container_of(rbn, struct ldms_set, rb_node);
-	if (set->flags & LDMS_SET_F_PUBLISHED)
+	if (!cb_arg->published_only || (set->flags & LDMS_SET_F_PUBLISHED))
 		return cb_arg->user_cb(set, cb_arg->user_arg);
 	return 0;
 }
 
-/* Caller must hold the ldms set tree lock */
-int __ldms_for_all_sets(int (*cb)(struct ldms_set *, void *), void *arg)
+static int __for_sets(struct cb_arg *cb_arg)
 {
-	struct cb_arg user_arg = { arg, cb };
-	int rc;
-	rc = rbt_traverse(&__set_tree, rbn_cb, &user_arg);
+	struct ldms_set_shard *sh;
+	int i, rc = 0;
+
+	for (i = 0; i < LDMS_SET_SHARDS && !rc; i++) {
+		sh = &__name_shards[i];
+		pthread_rwlock_rdlock(&sh->lock);
+		rc = rbt_traverse(&sh->tree, rbn_cb, cb_arg);
+		pthread_rwlock_unlock(&sh->lock);
+	}
 	return rc;
 }
 
+/*
+ * Call `cb` on every published set, stopping at the first non-zero
+ * return. The shard holding the set is read-locked during the callback,
+ * so `cb` must not look up, create or delete sets. Sets are not visited
+ * in name order.
+ */
+int __ldms_for_all_sets(int (*cb)(struct ldms_set *, void *), void *arg)
+{
+	struct cb_arg user_arg = { arg, cb, 1 };
+	return __for_sets(&user_arg);
+}
+
+/* Like __ldms_for_all_sets(), including the sets not yet published */
+int __ldms_for_each_set(int (*cb)(struct ldms_set *, void *), void *arg)
+{
+	struct cb_arg user_arg = { arg, cb, 0 };
+	return __for_sets(&user_arg);
+}
+
 
 struct get_set_names_arg {
 	struct ldms_name_list *name_list;
@@ -469,8 +598,7 @@ void __ldms_empty_name_list(struct ldms_name_list *name_list)
 /**
  * \brief Return a list of all of the local set names.
  *
- * This function is called with the set tree lock held. The
- * ldms_name_list returned must be released by the caller using the
+ * The ldms_name_list returned must be released by the caller using the
  * __ldms_empty_name_list() function.
  */
 int __ldms_get_local_set_list(struct ldms_name_list *head)
@@ -499,9 +627,7 @@ __record_set(const char *instance_name,
 	zap_err_t zerr;
 	size_t sz;
 
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(instance_name);
-	__ldms_set_tree_unlock();
 	if (set) {
 		ref_put(&set->ref, "__ldms_find_local_set");
 		errno = EEXIST;
@@ -515,6 +641,7 @@ __record_set(const char *instance_name,
 	}
 	LIST_INIT(&set->local_info);
 	LIST_INIT(&set->remote_info);
+	LIST_INIT(&set->snap_pool);
 	rbt_init(&set->push_coll, rbn_ptr_cmp);
 	rbt_init(&set->lookup_coll, rbn_ptr_cmp);
 	pthread_mutex_init(&set->lock, NULL);
@@ -536,21 +663,13 @@ __record_set(const char *instance_name,
 	rbn_init(&set->rb_node, get_instance_name(set->meta)->name);
 	rbn_init(&set->id_node, (void *)set->set_id);
 
-	__ldms_set_tree_lock();
-	/* Check if we lost a race creating this same set name */
-	struct ldms_set *nset = __ldms_find_local_set(instance_name);
-	if (nset) {
-		ref_put(&nset->ref, "__ldms_find_local_set");
+	/* Fails if we lost a race creating this same set name */
+	if (__set_registry_add(set)) {
+		zap_unmap(set->lmap);
 		errno = EEXIST;
 		free(set);
 		set = NULL;
-		goto unlock_set_tree;
 	}
-	rbt_ins(&__set_tree, &set->rb_node);
-	rbt_ins(&__id_tree, &set->id_node);
-
- unlock_set_tree:
-	__ldms_set_tree_unlock();
 	return set;
 
  free_set:
@@ -560,15 +679,19 @@ __record_set(const char *instance_name,
 }
 
 /**
- * Callers must hold the set_tree lock
+ * Find a local set by set_id. No reference is taken on the set.
  */
 extern struct ldms_set *__ldms_set_by_id(uint64_t id)
 {
+	struct ldms_set_shard *sh = __id_shard(id);
 	struct ldms_set *set = NULL;
 	struct rbn *rbn;
-	rbn = rbt_find(&__id_tree, (void *)id);
+
+	pthread_rwlock_rdlock(&sh->lock);
+	rbn = rbt_find(&sh->tree, (void *)id);
 	if (rbn)
 		set = container_of(rbn, struct ldms_set, id_node);
+	pthread_rwlock_unlock(&sh->lock);
 	return set;
 }
 
@@ -725,6 +848,54 @@ int ldms_xprt_update(struct ldms_set *set, ldms_update_cb_t cb, void *arg)
 	return rc;
 }
 
+int ldms_xprt_update_batch(ldms_t x, ldms_set_t *sets, int n,
+			   ldms_update_cb_t cb, void **cb_args, int *rcs)
+{
+	ldms_set_t *rsets;
+	void **rargs;
+	int *rrcs, *idx;
+	int i, m, rc = 0;
+
+	if (!x || !cb || n < 0)
+		return EINVAL;
+	if (!n)
+		return 0;
+	rsets = calloc(n, sizeof(*rsets) + sizeof(*rargs) +
+			  sizeof(*rrcs) + sizeof(*idx));
+	if (!rsets)
+		return ENOMEM;
+	rargs = (void **)&rsets[n];
+	rrcs = (int *)&rargs[n];
+	idx = &rrcs[n];
+
+	/* Local sets complete right away, like in ldms_xprt_update() */
+	for (i = m = 0; i < n; i++) {
+		if (rcs)
+			rcs[i] = 0;
+		if (0 == (sets[i]->flags & LDMS_SET_F_REMOTE)) {
+			cb(sets[i]->xprt, sets[i], 0, cb_args[i]);
+			continue;
+		}
+		rsets[m] = sets[i];
+		rargs[m] = cb_args[i];
+		idx[m++] = i;
+	}
+
+	if (m) {
+		x = ldms_xprt_get(x);
+		pthread_mutex_lock(&x->lock);
+		rc = __ldms_remote_update_batch(x, rsets, m, cb, rargs, rrcs);
+		pthread_mutex_unlock(&x->lock);
+		ldms_xprt_put(x);
+		if (rcs) {
+			for (i = 0; i < m; i++)
+				rcs[idx[i]] = rrcs[i];
+		}
+	}
+	free(rsets);
+	return rc;
+}
+
 void __ldms_set_on_xprt_term(ldms_set_t set, ldms_t xprt)
 {
 	struct rbn *rbn;
@@ -783,6 +954,7 @@ static void __destroy_set_no_lock(void *v)
 				break;
 			case LDMS_CONTEXT_UPDATE:
 			case LDMS_CONTEXT_UPDATE_META:
+			case LDMS_CONTEXT_UPDATE_DELTA:
 				if (ctxt->update.s == set)
 					ctxt->update.s = NULL;
 				break;
@@ -801,9 +973,20 @@ static void __destroy_set_no_lock(void *v)
 		pthread_mutex_unlock(&x->lock);
 	}
 	rbt_del(&__del_tree, &set->del_node);
-	mm_free(set->meta);
+	if (set->name_idx)
+		__name_idx_put(set->name_idx);
+	struct ldms_snapshot *snap;
+	while ((snap = LIST_FIRST(&set->snap_pool))) {
+		LIST_REMOVE(snap, entry);
+		__snapshot_free(snap);
+	}
 	__ldms_set_info_delete(&set->local_info);
 	__ldms_set_info_delete(&set->remote_info);
+	/*
+	 * A transport sending directly from the set memory holds a reference
+	 * on lmap; the memory is freed when the last one is dropped.
+	 */
+	zap_map_free_fn_set(set->lmap, mm_free);
 	zap_unmap(set->lmap);
 	if (set->rmap)
 		zap_unmap(set->rmap);
@@ -820,25 +1003,18 @@ static void __destroy_set(void *v)
 void ldms_set_delete(ldms_set_t s)
 {
 	ldms_t x;
-	struct ldms_set *__set;
 	struct rbt lookup_coll, push_coll;
 	struct rbn *rbn;
 	struct ldms_push_peer *pp;
 	struct ldms_lookup_peer *lp;
 
-	__ldms_set_tree_lock();
-	__set = __ldms_set_by_id(s->set_id);
-	if (!__set) {
-		__ldms_set_tree_unlock();
+	if (__set_registry_del(s)) {
 		/*
 		 * This is impossible since RBDs are removed.
 		 */
 		assert(0);
 		return;
 	}
-	rbt_del(&__set_tree, &s->rb_node);
-	rbt_del(&__id_tree, &s->id_node);
-	__ldms_set_tree_unlock();
 
 	/* NOTE: We can cut down the entire tree at once because the
 	 *       reader doesn't hold on to the rbn after mutex unlock.
@@ -1494,6 +1670,8 @@ ldms_set_t ldms_set_new_custom(const char *instance_name,
 	meta->data_sz = __cpu_to_le32(schema->data_sz) +
 			     __cpu_to_le32(hsz);
 	meta->heap_sz = __cpu_to_le32(hsz);
+	meta->dirty_chunk_sz = __cpu_to_le32(roundup((schema->data_sz +
+				LDMS_DIRTY_MAP_BITS - 1) / LDMS_DIRTY_MAP_BITS, 8));
 	meta->meta_gn = __cpu_to_le64(1);
 	meta->flags = LDMS_SETH_F_LCLBYTEORDER;
 	meta->uid = __cpu_to_le32(uid);
@@ -1901,11 +2079,160 @@ int ldms_metric_flags_get(ldms_set_t s, int i)
 	return 0;
 }
 
+/*
+ * Metric name index
+ *
+ * Sets with the same schema digest have the same metric names in the
+ * same order, so one open-addressed hash table of metric indices serves
+ * all of them. The tables live in __name_idx_tree keyed by digest and
+ * are reference counted by the sets that use them. A set takes its
+ * reference the first time ldms_metric_by_name() is called on it and
+ * drops it when the set is destroyed.
+ */
+#define LDMS_NAME_IDX_SEED 0xcbf29ce484222325ULL /* FNV-1a offset basis */
+struct ldms_name_idx {
+	struct rbn rbn;
+	struct ldms_digest_s digest;
+	int ref;
+	uint32_t card;
+	uint32_t mask;
+	struct ldms_name_slot {
+		uint32_t hash;
+		uint32_t idx;	/* metric index + 1, 0 if the slot is empty */
+	} slot[OVIS_FLEX];
+};
+
+static int name_idx_comparator(void *a, const void *b)
+{
+	return memcmp(a, b, LDMS_DIGEST_LENGTH);
+}
+
+static struct rbt __name_idx_tree = {
+	.root = NULL,
+	.comparator = name_idx_comparator
+};
+static pthread_mutex_t __name_idx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint32_t __name_hash(const char *name)
+{
+	uint64_t h = fnv_hash_a1_64(name, strlen(name), LDMS_NAME_IDX_SEED);
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+static struct ldms_name_idx *
+__name_idx_new(struct ldms_set *set, ldms_digest_t digest, uint32_t card)
+{
+	struct ldms_name_idx *nidx;
+	struct ldms_name_slot *slot;
+	ldms_mdesc_t desc;
+	uint32_t i, h, nslots;
+
+	/* keep the load factor at or below 1/2 */
+	for (nslots = 16; nslots < 2 * card; nslots <<= 1)
+		;
+	nidx = calloc(1, sizeof(*nidx) + nslots * sizeof(nidx->slot[0]));
+	if (!nidx)
+		return NULL;
+	memcpy(&nidx->digest, digest, sizeof(nidx->digest));
+	nidx->card = card;
+	nidx->mask = nslots - 1;
+	nidx->ref = 1;
+	for (i = 0; i < card; i++) {
+		desc = __desc_get(set, i);
+		h = __name_hash(desc->vd_name_unit);
+		slot = &nidx->slot[h & nidx->mask];
+		while (slot->idx)
+			slot = &nidx->slot[(slot - nidx->slot + 1) & nidx->mask];
+		slot->hash = h;
+		slot->idx = i + 1;
+	}
+	rbn_init(&nidx->rbn, &nidx->digest);
+	return nidx;
+}
+
+static void __name_idx_put(struct ldms_name_idx *nidx)
+{
+	pthread_mutex_lock(&__name_idx_lock);
+	if (0 == --nidx->ref) {
+		rbt_del(&__name_idx_tree, &nidx->rbn);
+		free(nidx);
+	}
+	pthread_mutex_unlock(&__name_idx_lock);
+}
+
+/*
+ * Return the name index of the set, attaching the shared index for the
+ * set's digest (building it if needed) on first use. Returns NULL if the
+ * set has no digest or the index could not be allocated; the caller
+ * falls back to a linear search.
+ */
+static struct ldms_name_idx *__name_idx_get(struct ldms_set *set)
+{
+	struct ldms_name_idx *nidx;
+	struct rbn *rbn;
+	ldms_digest_t digest;
+	uint32_t card;
+
+	nidx = __atomic_load_n(&set->name_idx, __ATOMIC_ACQUIRE);
+	if (nidx)
+		return nidx;
+
+	digest = ldms_set_digest_get(set);
+	card = __le32_to_cpu(set->meta->card);
+	if (!card || 0 == ldms_digest_cmp(digest, &null_digest))
+		return NULL;
+
+	pthread_mutex_lock(&__name_idx_lock);
+	rbn = rbt_find(&__name_idx_tree, digest);
+	if (rbn) {
+		nidx = container_of(rbn, struct ldms_name_idx, rbn);
+		if (nidx->card != card) {
+			/* not the schema it claims to be */
+			pthread_mutex_unlock(&__name_idx_lock);
+			return NULL;
+		}
+		nidx->ref++;
+	} else {
+		nidx = __name_idx_new(set, digest, card);
+		if (nidx)
+			rbt_ins(&__name_idx_tree, &nidx->rbn);
+	}
+	pthread_mutex_unlock(&__name_idx_lock);
+	if (!nidx)
+		return NULL;
+
+	if (!__sync_bool_compare_and_swap(&set->name_idx, NULL, nidx)) {
+		/* another thread attached the index first */
+		__name_idx_put(nidx);
+		nidx = set->name_idx;
+	}
+	return nidx;
+}
+
 int ldms_metric_by_name(ldms_set_t set, const char *name)
 {
-	int i;
+	struct ldms_name_idx *nidx;
+	struct ldms_name_slot *slot;
+	ldms_mdesc_t desc;
+	uint32_t h, i;
+
+	nidx = __name_idx_get(set);
+	if (!nidx)
+		goto scan;
+	h = __name_hash(name);
+	for (i = h & nidx->mask; nidx->slot[i].idx; i = (i + 1) & nidx->mask) {
+		slot = &nidx->slot[i];
+		if (slot->hash != h)
+			continue;
+		desc = __desc_get(set, slot->idx - 1);
+		if (desc && 0 == strcmp(desc->vd_name_unit, name))
+			return slot->idx - 1;
+	}
+	return -1;
+
+ scan:
 	for (i = 0; i < ldms_set_card_get(set); i++) {
-		ldms_mdesc_t desc = __desc_get(set, i);
+		desc = __desc_get(set, i);
 		if (0 == strcmp(desc->vd_name_unit, name))
 			return i;
 	}
@@ -3211,6 +3538,7 @@ ldms_mval_t ldms_list_append_item(ldms_set_t s, ldms_mval_t lh, enum ldms_value_
 	le->v_le.type = typ;
 	le->v_le.count = count;
 	__list_append(s->heap, lh, le);
+	__ldms_data_dirty(s->data, ldms_off_(s->data, lh), sizeof(lh->v_lh));
 	LDMS_GN_INCREMENT(s->data->gn);
 	return (ldms_mval_t)le->v_le.value;
 }
@@ -3265,6 +3593,7 @@ int ldms_list_remove_item(ldms_set_t s, ldms_mval_t lh, ldms_mval_t v)
 		next->v_le.prev = le->v_le.prev;
 	else /* last element */
 		lh->v_lh.tail = le->v_le.prev;
+	__ldms_data_dirty(s->data, ldms_off_(s->data, lh), sizeof(lh->v_lh));
 	if (le->v_le.type == LDMS_V_LIST) {
 		ldms_list_purge(s, v);
 	}
@@ -3324,6 +3653,9 @@ int ldms_transaction_begin(ldms_set_t s)
 		dh->curr_idx = __cpu_to_le32(s->curr_idx);
 	}
  record_time:
+	/* start a new dirty map relative to the current data generation */
+	s->data->dirty_gn = s->data->gn;
+	memset(s->data->dirty_map, 0, sizeof(s->data->dirty_map));
 	s->data->trans.flags = LDMS_TRANSACTION_BEGIN;
 	(void)gettimeofday(&tv, NULL);
 	s->data->trans.ts.sec = __cpu_to_le32(tv.tv_sec);
@@ -3403,6 +3735,173 @@ int ldms_set_is_consistent(ldms_set_t s)
 	return (dh->trans.flags == LDMS_TRANSACTION_END);
 }
 
+/*
+ * Snapshots
+ *
+ * A snapshot is a struct ldms_set whose meta and data point into a private
+ * buffer laid out like a set with a single array element: the metadata
+ * followed by the data and heap of the origin's current element. Records
+ * find their metadata through data->set_off, so the metadata must be in
+ * the same buffer. The buffers of a set are all the same size and are
+ * kept on the origin set for reuse; the metadata of a reused buffer is
+ * copied again only if the origin's meta_gn has changed.
+ */
+
+#define LDMS_SNAPSHOT_POOL_MAX	8	/* free buffers kept per set */
+#define LDMS_SNAPSHOT_RETRY	3
+
+static void __snapshot_free(struct ldms_snapshot *snap)
+{
+	if (snap->set.name_idx)
+		__name_idx_put(snap->set.name_idx);
+	free(snap);
+}
+
+static struct ldms_snapshot *__snapshot_get(struct ldms_set *s)
+{
+	struct ldms_snapshot *snap;
+	size_t meta_sz, data_sz;
+
+	pthread_mutex_lock(&s->lock);
+	snap = LIST_FIRST(&s->snap_pool);
+	if (snap) {
+		LIST_REMOVE(snap, entry);
+		s->snap_pool_count--;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if (snap)
+		return snap;
+
+	meta_sz = roundup(__le32_to_cpu(s->meta->meta_sz), sizeof(uint64_t));
+	data_sz = __le64_to_cpu(s->data->size);
+	snap = calloc(1, sizeof(*snap) + meta_sz + data_sz);
+	if (!snap)
+		return NULL;
+	snap->origin = s;
+	snap->meta_sz = meta_sz;
+	snap->data_sz = data_sz;
+	snap->set.flags = LDMS_SET_F_SNAPSHOT;
+	snap->set.set_id = s->set_id;
+	snap->set.meta = (void *)snap->buf;
+	snap->set.data = (void *)snap->buf + meta_sz;
+	snap->set.data_array = snap->set.data;
+	LIST_INIT(&snap->set.local_info);
+	LIST_INIT(&snap->set.remote_info);
+	pthread_mutex_init(&snap->set.lock, NULL);
+	return snap;
+}
+
+static void __snapshot_put(struct ldms_snapshot *snap)
+{
+	struct ldms_set *s = snap->origin;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->snap_pool_count < LDMS_SNAPSHOT_POOL_MAX) {
+		LIST_INSERT_HEAD(&s->snap_pool, snap, entry);
+		s->snap_pool_count++;
+		snap = NULL;
+	}
+	pthread_mutex_unlock(&s->lock);
+	if (snap)
+		__snapshot_free(snap);
+}
+
+/* Copy the metadata if the copy in the buffer is stale */
+static int __snapshot_meta(struct ldms_snapshot *snap)
+{
+	struct ldms_set *s = snap->origin;
+	struct ldms_set_hdr *meta = snap->set.meta;
+	uint64_t gn = __le64_to_cpu(s->meta->meta_gn);
+
+	if (snap->meta_gn == gn && gn)
+		return 0;
+	memcpy(meta, s->meta, __le32_to_cpu(s->meta->meta_sz));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (gn != __le64_to_cpu(s->meta->meta_gn))
+		return EAGAIN;
+	/* the copy has a single array element */
+	meta->array_card = __cpu_to_le32(1);
+	snap->meta_gn = gn;
+	return 0;
+}
+
+static int __snapshot_data(struct ldms_snapshot *snap)
+{
+	struct ldms_set *s = snap->origin;
+	struct ldms_data_hdr *src = s->data;
+	struct ldms_data_hdr *data = snap->set.data;
+	uint64_t gn = __le64_to_cpu(src->gn);
+
+	if (src->trans.flags != LDMS_TRANSACTION_END)
+		return EBUSY;
+	memcpy(data, src, snap->data_sz);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (src != s->data || gn != __le64_to_cpu(src->gn) ||
+	    gn != __le64_to_cpu(data->gn) ||
+	    data->trans.flags != LDMS_TRANSACTION_END)
+		return EAGAIN;
+	data->set_off = __cpu_to_le32(snap->meta_sz);
+	data->curr_idx = 0;
+	return 0;
+}
+
+ldms_set_t ldms_set_snapshot(ldms_set_t s)
+{
+	struct ldms_snapshot *snap;
+	void *base;
+	int i, rc;
+
+	if (s->flags & LDMS_SET_F_SNAPSHOT) {
+		errno = EINVAL;
+		return NULL;
+	}
+	snap = __snapshot_get(s);
+	if (!snap) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (i = 0; i < LDMS_SNAPSHOT_RETRY; i++) {
+		rc = __snapshot_meta(snap);
+		if (rc)
+			continue;
+		rc = __snapshot_data(snap);
+		if (rc != EAGAIN)
+			break;
+	}
+	if (rc) {
+		snap->meta_gn = 0;
+		__snapshot_put(snap);
+		errno = rc;
+		return NULL;
+	}
+	snap->set.heap = NULL;
+	if (snap->set.meta->heap_sz) {
+		base = (void *)snap->set.data + snap->data_sz -
+			__le32_to_cpu(snap->set.meta->heap_sz);
+		snap->set.heap = ldms_heap_get(&snap->set.heap_inst,
+					       &snap->set.data->heap, base);
+	}
+	ref_get(&s->ref, "snapshot");
+	return &snap->set;
+}
+
+void ldms_set_snapshot_release(ldms_set_t snap_set)
+{
+	struct ldms_snapshot *snap;
+	struct ldms_set *s;
+
+	assert(snap_set->flags & LDMS_SET_F_SNAPSHOT);
+	snap = container_of(snap_set, struct ldms_snapshot, set);
+	s = snap->origin;
+	__snapshot_put(snap);
+	ref_put(&s->ref, "snapshot");
+}
+
+int ldms_set_is_snapshot(ldms_set_t s)
+{
+	return 0 != (s->flags & LDMS_SET_F_SNAPSHOT);
+}
+
 void ldms_xprt_cred_get(ldms_t x, ldms_cred_t lcl, ldms_cred_t rmt)
 {
 	if (lcl) {
@@ -4084,6 +4583,7 @@ void ldms_record_metric_set(ldms_mval_t rec_inst, int metric_id,
 	if (!mval)
 		return;
 	__metric_set(vd, mval, val);
+	__mval_dirty(data, mval, vd);
 	LDMS_GN_INCREMENT(data->gn);
 }
 
@@ -4102,6 +4602,7 @@ void ldms_record_metric_array_set(ldms_mval_t rec_inst, int metric_id,
 	for (i = start; i < start+count; i++) {
 		__metric_array_set(vd, mval, i, val);
 	}
+	__mval_dirty(data, mval, vd);
 	LDMS_GN_INCREMENT(data->gn);
 }
 
@@ -4116,6 +4617,7 @@ int ldms_list_append_record(ldms_set_t set, ldms_mval_t lh, ldms_mval_t rec_inst
 		return EBUSY;
 	data = (void*)rec_inst - __le32_to_cpu(rec_inst->v_rec_inst.set_data_off);
 	__list_append(set->heap, lh, (ldms_mval_t)le);
+	__ldms_data_dirty(data, ldms_off_(data, lh), sizeof(lh->v_lh));
 	/* bump heap gn so that the change in the linked list will be propagated
 	 * to the next set buffer. */
 	data->heap.gn = __cpu_to_le32(__le32_to_cpu(data->heap.gn)+1);
@@ -4382,6 +4884,7 @@ void ldms_record_set_char(ldms_mval_t rec_inst, int i, char v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_char = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4394,6 +4897,7 @@ void ldms_record_set_u8(ldms_mval_t rec_inst, int i, uint8_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_u8 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4406,6 +4910,7 @@ void ldms_record_set_u16(ldms_mval_t rec_inst, int i, uint16_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_u16 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4418,6 +4923,7 @@ void ldms_record_set_u32(ldms_mval_t rec_inst, int i, uint32_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_u32 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4430,6 +4936,7 @@ void ldms_record_set_u64(ldms_mval_t rec_inst, int i, uint64_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_u64 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4442,6 +4949,7 @@ void ldms_record_set_s8(ldms_mval_t rec_inst, int i, int8_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_s8 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4454,6 +4962,7 @@ void ldms_record_set_s16(ldms_mval_t rec_inst, int i, int16_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_s16 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4466,6 +4975,7 @@ void ldms_record_set_s32(ldms_mval_t rec_inst, int i, int32_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_s32 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4478,6 +4988,7 @@ void ldms_record_set_s64(ldms_mval_t rec_inst, int i, int64_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_s64 = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4491,6 +5002,7 @@ void ldms_record_set_float(ldms_mval_t rec_inst, int i, float v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_f = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4503,6 +5015,7 @@ void ldms_record_set_double(ldms_mval_t rec_inst, int i, double v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		mv->v_d = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4516,6 +5029,7 @@ void ldms_record_array_set_str(ldms_mval_t rec_inst, int i, const char *v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv) {
 		strncpy(mv->a_char, v, desc->vd_array_count);
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric index");
@@ -4528,6 +5042,7 @@ void ldms_record_array_set_char(ldms_mval_t rec_inst, int i, int idx, char v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_char[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4540,6 +5055,7 @@ void ldms_record_array_set_u8(ldms_mval_t rec_inst, int i, int idx, uint8_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_u8[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4552,6 +5068,7 @@ void ldms_record_array_set_u16(ldms_mval_t rec_inst, int i, int idx, uint16_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_u16[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4564,6 +5081,7 @@ void ldms_record_array_set_u32(ldms_mval_t rec_inst, int i, int idx, uint32_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_u32[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4576,6 +5094,7 @@ void ldms_record_array_set_u64(ldms_mval_t rec_inst, int i, int idx, uint64_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_u64[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4588,6 +5107,7 @@ void ldms_record_array_set_s8(ldms_mval_t rec_inst, int i, int idx, int8_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_s8[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4600,6 +5120,7 @@ void ldms_record_array_set_s16(ldms_mval_t rec_inst, int i, int idx, int16_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_s16[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4612,6 +5133,7 @@ void ldms_record_array_set_s32(ldms_mval_t rec_inst, int i, int idx, int32_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_s32[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4624,6 +5146,7 @@ void ldms_record_array_set_s64(ldms_mval_t rec_inst, int i, int idx, int64_t v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_s64[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4636,6 +5159,7 @@ void ldms_record_array_set_float(ldms_mval_t rec_inst, int i, int idx, float v)
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_f[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -4648,6 +5172,7 @@ void ldms_record_array_set_double(ldms_mval_t rec_inst, int i, int idx, double v
 	ldms_mval_t mv = __record_metric_get(rec_inst, i, NULL, &desc, NULL, &data);
 	if (mv && 0 <= idx && idx < desc->vd_array_count) {
 		mv->a_d[idx] = v;
+		__mval_dirty(data, mv, desc);
 		LDMS_GN_INCREMENT(data->gn);
 	} else
 		assert(0 == "Invalid metric or array index");
@@ -445,8 +445,12 @@ typedef struct ldms_record *ldms_record_t;
 /**
  * \brief Initialize LDMS
  *
- *  Pre-allocate a memory region for metric sets
- *  \param max_size The maximum size of the pre-allocated memory
+ *  Pre-allocate a memory region for metric sets. When the region is
+ *  exhausted it grows in place, up to 8 times \c max_size by default. The
+ *  \c MMALLOC_MAX_SIZE environment variable sets the growth limit in
+ *  bytes; a value not larger than \c max_size disables growing.
+ *
+ *  \param max_size The size of the pre-allocated memory
  *  \retval 0     If success
  *  \retval errno If error
  */
@@ -578,6 +582,8 @@ typedef void (*ldms_lookup_cb_t)(ldms_t t, enum ldms_lookup_status status,
 #define LDMS_SET_F_REMOTE	0x0008
 #define LDMS_SET_F_PUSH_CHANGE	0x0010
 #define LDMS_SET_F_DATA_COPY	0x0020 /* set array data copy on transaction begin */
+#define LDMS_SET_F_DELTA_UPDATE	0x0040 /* update only the modified data ranges */
+#define LDMS_SET_F_SNAPSHOT	0x0080 /* a copy taken by ldms_set_snapshot() */
 #define LDMS_SET_F_PUBLISHED	0x100000 /* Set is in the set tree. */
 #define LDMS_SET_ID_DATA	0x1000000
 
@@ -1130,6 +1136,35 @@ typedef void (*ldms_update_cb_t)(ldms_t t, ldms_set_t s, int flags, void *arg);
  */
 extern int ldms_xprt_update(ldms_set_t s, ldms_update_cb_t update_cb, void *arg);
 
+/**
+ * \brief Update the contents of multiple metric sets of a transport.
+ *
+ * This is the equivalent of calling \c ldms_xprt_update() on each set in
+ * \c sets, but the data reads are batched. If the transport and the peer
+ * support vectored reads (see \c zap_readv()), many sets are served by a
+ * single request/response exchange instead of one per set. Sets that need
+ * their metadata refreshed, or that use delta updates, are updated as by
+ * \c ldms_xprt_update().
+ *
+ * \c update_cb is called for \c sets[i] with \c cb_args[i] exactly as if
+ * \c ldms_xprt_update(sets[i], update_cb, cb_args[i]) had been called. It is
+ * not called for the sets whose update request failed synchronously.
+ *
+ * \param x	  The transport the sets were looked up on.
+ * \param sets	  The array of set handles to update.
+ * \param n	  The number of elements in \c sets, \c cb_args and \c rcs.
+ * \param update_cb The function to call when the update of a set has
+ *		  completed. It must not be NULL.
+ * \param cb_args The array of callback arguments, one for each set.
+ * \param rcs	  If not NULL, receives the status of the update request of
+ *		  each set: 0, or the error that \c ldms_xprt_update() would
+ *		  have returned.
+ * \returns	  0 if all updates were requested, or the first error.
+ */
+extern int ldms_xprt_update_batch(ldms_t x, ldms_set_t *sets, int n,
+				  ldms_update_cb_t update_cb, void **cb_args,
+				  int *rcs);
+
 #define LDMS_XPRT_PUSH_F_CHANGE	1
 /**
  * \brief Register a remote set for push notifications
@@ -1632,6 +1667,57 @@ extern void ldms_set_delete(ldms_set_t s);
  */
 void ldms_set_put(ldms_set_t s);
 
+/**
+ * \brief Take a snapshot of the set
+ *
+ * Copy the current data and heap of \c s into a private buffer and return
+ * a set handle on the copy. All of the metric, list and record accessors
+ * work on the snapshot, which keeps its values however \c s changes
+ * afterwards. Deferred consumers, e.g. stores running on their own
+ * threads, use it to work on the data of a given update without holding
+ * the producer set locks.
+ *
+ * The metadata is copied too, but only when the metadata generation of
+ * \c s changes; the buffers are pooled on \c s and reused by the following
+ * snapshots, so a steady stream of snapshots does not allocate. Only the
+ * current element of a set array is copied.
+ *
+ * The copy is checked against the data generation of \c s. If a writer
+ * modifies the set while it is being copied the snapshot is retried and
+ * eventually fails with EAGAIN. A concurrent remote update that has not
+ * yet written the data header cannot be detected, so remote sets should
+ * be snapshotted from the update callback.
+ *
+ * The snapshot holds a reference on \c s.
+ *
+ * \param s The set handle.
+ * \retval snap The snapshot handle. Release it with
+ *              ldms_set_snapshot_release().
+ * \retval NULL  If failed; \c errno is set to:
+ *              - EBUSY if \c s is inside a transaction (inconsistent),
+ *              - EAGAIN if \c s kept changing while being copied,
+ *              - ENOMEM if a buffer could not be allocated.
+ */
+ldms_set_t ldms_set_snapshot(ldms_set_t s);
+
+/**
+ * \brief Release a snapshot
+ *
+ * The buffer goes back to the pool of the origin set.
+ *
+ * \param snap The snapshot handle from ldms_set_snapshot().
+ */
+void ldms_set_snapshot_release(ldms_set_t snap);
+
+/**
+ * \brief Test whether the set handle is a snapshot
+ *
+ * \param s The set handle.
+ * \retval 1 If \c s was returned by ldms_set_snapshot().
+ * \retval 0 Otherwise.
+ */
+int ldms_set_is_snapshot(ldms_set_t s);
+
 /**
  * \brief Get the schema name for the set
  *
@@ -1923,6 +2009,28 @@ uint64_t ldms_set_heap_size_get(ldms_set_t s);
  */
 void ldms_set_data_copy_set(ldms_set_t s, int on_n_off);
 
+/**
+ * \brief Enable or disable delta updates on a looked-up set.
+ *
+ * The producer records which chunks of the set data were modified by the
+ * \c ldms_metric_set_*(), \c ldms_metric_array_set_*(), \c ldms_record_set_*()
+ * and \c ldms_metric_modify() functions since the last
+ * \c ldms_transaction_begin(). When delta updates are enabled,
+ * \c ldms_xprt_update() first reads only the data header of the remote set.
+ * If the local copy holds the data generation the dirty map is relative to,
+ * only the modified ranges (and the heap) are read. Otherwise, or if the
+ * peer does not track modifications, the whole data is read as usual.
+ *
+ * Delta updates are only applied to sets with a set array cardinality of 1.
+ * Values modified through a pointer obtained from the set (e.g.
+ * \c ldms_metric_get()) must be announced with \c ldms_metric_modify(),
+ * otherwise the modification will not be transferred by a delta update.
+ *
+ * \param s  The \c ldms_set_t handle.
+ * \param on_n_off \c 1 for turning delta updates on, or \c 0 for turning them off.
+ */
+void ldms_set_delta_update_set(ldms_set_t s, int on_n_off);
+
 /** \} */
 
 /**
@@ -2256,6 +2364,9 @@ extern int ldms_schema_meta_array_add_with_unit(ldms_schema_t s, const char *nam
  * name. This index can then be used with the ldms_metric_get_type() functions
  * to return the value of the metric.
  *
+ * The lookup is a hash table probe. The table is built on the first call
+ * for a schema digest and is shared by all sets with that digest.
+ *
  * \param s	The metric set handle
  * \param name	The name of the metric.
  * \returns	The metric set handle or -1 if there is none was found.
@@ -126,6 +126,16 @@ struct ldms_transaction {
 	uint32_t flags;
 };
 
+/*
+ * The data section (excluding the heap) is divided into
+ * LDMS_DIRTY_MAP_BITS chunks of ldms_set_hdr::dirty_chunk_sz bytes. A bit is
+ * set in ldms_data_hdr::dirty_map when a value in the corresponding chunk
+ * is modified. The map is reset by ldms_transaction_begin(), so it
+ * describes all changes from data generation `dirty_gn` to `gn`.
+ */
+#define LDMS_DIRTY_MAP_BITS	256
+#define LDMS_DIRTY_MAP_WORDS	(LDMS_DIRTY_MAP_BITS / 64)
+
 struct ldms_data_hdr {
 	struct ldms_transaction trans;
 	uint32_t set_off;	/* Offset from the beginning of the set */
@@ -134,6 +144,8 @@ struct ldms_data_hdr {
 	uint64_t meta_gn;	/* Meta-data generation number */
 	uint32_t curr_idx;      /* Current set array index */
 	struct ldms_heap heap;
+	uint64_t dirty_gn;	/* Data gn at the last transaction begin */
+	uint64_t dirty_map[LDMS_DIRTY_MAP_WORDS]; /* Chunks modified since dirty_gn */
 };
 
 /**
@@ -202,7 +214,8 @@ struct ldms_set_hdr {
 	uint32_t perm;          /* permission */
 	uint32_t array_card;    /* number of sets in the set array */
 	uint32_t heap_sz;	/* size of the heap */
-	uint32_t reserved[7];	/* area reserved for compatible core updates */
+	uint32_t dirty_chunk_sz; /* bytes per dirty_map bit, 0 if not tracked */
+	uint32_t reserved[6];	/* area reserved for compatible core updates */
 	uint32_t dict[OVIS_FLEX];/* The attr/metric dictionary */
 };
 
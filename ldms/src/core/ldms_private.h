@@ -149,6 +149,20 @@ struct ldms_set {
 	struct ldms_context *notify_ctxt; /* Notify req context */
 	ldms_heap_t heap;
 	struct ldms_heap_instance heap_inst;
+	struct ldms_name_idx *name_idx; /* shared metric name index */
+	LIST_HEAD(, ldms_snapshot) snap_pool; /* free snapshot buffers */
+	int snap_pool_count;
+};
+
+/* A set handle returned by ldms_set_snapshot() */
+struct ldms_snapshot {
+	struct ldms_set set;	/* must be first */
+	struct ldms_set *origin;
+	uint64_t meta_gn;	/* metadata generation of the copy */
+	size_t meta_sz;
+	size_t data_sz;
+	LIST_ENTRY(ldms_snapshot) entry;
+	uint64_t buf[OVIS_FLEX];
 };
 
 /* Convenience macro to roundup a value to a multiple of the _s parameter */
@@ -185,6 +199,7 @@ extern size_t __ldms_format_set_meta_as_json(struct ldms_set *set,
 					     int need_comma,
 					     char *buf, size_t buf_size);
 extern int __ldms_for_all_sets(int (*cb)(struct ldms_set *, void *), void *arg);
+extern int __ldms_for_each_set(int (*cb)(struct ldms_set *, void *), void *arg);
 
 extern uint32_t __ldms_set_size_get(struct ldms_set *s);
 extern void __ldms_metric_size_get(const char *name, const char *unit,
@@ -192,12 +207,11 @@ extern void __ldms_metric_size_get(const char *name, const char *unit,
 				   uint32_t count, size_t *meta_sz, size_t *data_sz);
 
 extern struct ldms_set *__ldms_find_local_set(const char *path);
-extern struct ldms_set *__ldms_local_set_first(void);
-extern struct ldms_set *__ldms_local_set_next(struct ldms_set *);
 
 extern int __ldms_remote_update(ldms_t t, ldms_set_t s, ldms_update_cb_t cb, void *arg);
-extern void __ldms_set_tree_lock();
-extern void __ldms_set_tree_unlock();
+extern int __ldms_remote_update_batch(ldms_t x, ldms_set_t *sets, int n,
+				      ldms_update_cb_t cb, void **cb_args,
+				      int *rcs);
 
 extern int __ldms_set_info_set(struct ldms_set_info_list *info,
 				const char *key, const char *value);
@@ -273,6 +273,7 @@ struct ldms_context *__ldms_alloc_ctxt(struct ldms_xprt *x, size_t sz,
 		break;
 	case LDMS_CONTEXT_UPDATE:
 	case LDMS_CONTEXT_UPDATE_META:
+	case LDMS_CONTEXT_UPDATE_DELTA:
 		ctxt->update.s = va_arg(ap, ldms_set_t);
 		ref_get(&ctxt->update.s->ref, "__ldms_alloc_ctxt");
 		ctxt->update.cb = va_arg(ap, ldms_update_cb_t);
@@ -296,6 +297,10 @@ struct ldms_context *__ldms_alloc_ctxt(struct ldms_xprt *x, size_t sz,
 		ctxt->set_delete.cb = va_arg(ap, ldms_set_delete_cb_t);
 		ctxt->set_delete.cb_arg = ctxt;
 		break;
+	case LDMS_CONTEXT_UPDATE_BATCH:
+		/* The per-set contexts follow the batch context */
+		ctxt->batch.ctxts = (void *)(ctxt + 1);
+		break;
 	case LDMS_CONTEXT_PUSH:
 	case LDMS_CONTEXT_DIR_CANCEL:
 	case LDMS_CONTEXT_SEND:
@@ -327,6 +332,7 @@ void __ldms_free_ctxt(struct ldms_xprt *x, struct ldms_context *ctxt)
 		break;
 	case LDMS_CONTEXT_UPDATE:
 	case LDMS_CONTEXT_UPDATE_META:
+	case LDMS_CONTEXT_UPDATE_DELTA:
 		e = &x->stats.ops[LDMS_XPRT_OP_UPDATE];
 		if (ctxt->update.s)
 			ref_put(&ctxt->update.s->ref, "__ldms_alloc_ctxt");
@@ -347,6 +353,7 @@ void __ldms_free_ctxt(struct ldms_xprt *x, struct ldms_context *ctxt)
 		break;
 	case LDMS_CONTEXT_PUSH:
 	case LDMS_CONTEXT_DIR_CANCEL:
+	case LDMS_CONTEXT_UPDATE_BATCH:
 		break;
 	}
 	(void)clock_gettime(CLOCK_REALTIME, &x->stats.last_op);
@@ -650,9 +657,7 @@ static void process_set_delete_request(struct ldms_xprt *x, struct ldms_request
 	 * Always notify the application about peer set delete. If we happened
 	 * not to have the set yet, `event.set_delete.set` will be NULL.
 	 */
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(req->set_delete.inst_name);
-	__ldms_set_tree_unlock();
 	if (set) {
 		if (set->xprt != x) {
 			assert(set->xprt != x);
@@ -727,9 +732,7 @@ static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 	hdrlen = sizeof(struct ldms_reply_hdr)
 		+ sizeof(struct ldms_dir_reply);
 
-	__ldms_set_tree_lock();
 	rc = __ldms_get_local_set_list(&name_list);
-	__ldms_set_tree_unlock();
 	if (rc)
 		goto out;
 
@@ -776,9 +779,7 @@ static void process_dir_request(struct ldms_xprt *x, struct ldms_request *req)
 	}
 	struct ldms_set *set;
 	LIST_FOREACH(name, &name_list, entry) {
-		__ldms_set_tree_lock();
 		set = __ldms_find_local_set(name->name);
-		__ldms_set_tree_unlock();
 		if (!set)
 			continue;
 		uid = __le32_to_cpu(set->meta->uid);
@@ -1314,14 +1315,33 @@ static int __re_match(struct ldms_set *set, regex_t *regex, const char *regex_st
 	return (rc == 0);
 }
 
-static struct ldms_set *__next_re_match(struct ldms_set *set,
-					regex_t *regex, const char *regex_str, int flags)
+struct re_match_arg {
+	regex_t *regex;
+	const char *regex_str;
+	int flags;
+	int count;		/* matching sets */
+	int alloc;		/* entries allocated in sets */
+	struct ldms_set **sets;
+};
+
+/* Collect the matching sets, taking a reference on each */
+static int __re_match_cb(struct ldms_set *set, void *arg)
 {
-	for (; set; set = __ldms_local_set_next(set)) {
-		if (__re_match(set, regex, regex_str, flags))
-			break;
-	}
-	return set;
+	struct re_match_arg *a = arg;
+	struct ldms_set **sets;
+
+	if (!__re_match(set, a->regex, a->regex_str, a->flags))
+		return 0;
+	if (a->count == a->alloc) {
+		a->alloc = a->alloc ? 2 * a->alloc : 64;
+		sets = realloc(a->sets, a->alloc * sizeof(*sets));
+		if (!sets)
+			return ENOMEM;
+		a->sets = sets;
+	}
+	ref_get(&set->ref, "__re_match_cb");
+	a->sets[a->count++] = set;
+	return 0;
 }
 
 int __xprt_set_access_check(struct ldms_xprt *x, struct ldms_set *set,
@@ -1337,8 +1357,9 @@ static void process_lookup_request_re(struct ldms_xprt *x, struct ldms_request *
 {
 	regex_t regex;
 	struct ldms_reply_hdr hdr;
-	struct ldms_set *set, *nxt_set;
-	int rc, more;
+	struct ldms_set *set;
+	struct re_match_arg match = {0};
+	int i, rc;
 	int matched = 0;
 
 	if (flags & LDMS_LOOKUP_RE) {
@@ -1351,13 +1372,11 @@ static void process_lookup_request_re(struct ldms_xprt *x, struct ldms_request *
 			goto err_0;
 		}
 	} else if (0 == (flags & LDMS_LOOKUP_BY_SCHEMA)) {
-		__ldms_set_tree_lock();
 		set = __ldms_find_local_set(req->lookup.path);
 		if (!set) {
 			rc = ENOENT;
 			goto err_1;
 		}
-		__ldms_set_tree_unlock();
 		rc = __send_lookup_reply(x, set, req->hdr.xid, 0);
 		ref_put(&set->ref, "__ldms_find_local_set");
 		if (rc)
@@ -1365,33 +1384,37 @@ static void process_lookup_request_re(struct ldms_xprt *x, struct ldms_request *
 		return;
 	}
 
-	/* Get the first match */
-	__ldms_set_tree_lock();
-	set = __ldms_local_set_first();
-	set = __next_re_match(set, &regex, req->lookup.path, flags);
-	if (!set) {
+	/*
+	 * Collect the matches first so that the replies are not sent with
+	 * the set registry locked.
+	 */
+	match.regex = &regex;
+	match.regex_str = req->lookup.path;
+	match.flags = flags;
+	rc = __ldms_for_each_set(__re_match_cb, &match);
+	if (rc)
+		goto err_2;
+	if (!match.count) {
 		rc = ENOENT;
-		goto err_1;
+		goto err_2;
 	}
-	while (set) {
-		/* Get the next match if any */
-		nxt_set = __next_re_match(__ldms_local_set_next(set),
-					  &regex, req->lookup.path, flags);
-		rc = __xprt_set_access_check(x, set, LDMS_ACCESS_READ);
-		if (rc)
-			goto skip;
-		if (nxt_set)
-			more = 1;
-		else
-			more = 0;
-		rc = __send_lookup_reply(x, set, req->hdr.xid, more);
+	for (i = 0; i < match.count; i++) {
+		set = match.sets[i];
 		if (rc)
-			goto err_1;
-		matched = 1;
-	skip:
-		set = nxt_set;
+			goto put;
+		if (__xprt_set_access_check(x, set, LDMS_ACCESS_READ))
+			goto put;
+		rc = __send_lookup_reply(x, set, req->hdr.xid,
+					 i < match.count - 1);
+		if (!rc)
+			matched = 1;
+	put:
+		ref_put(&set->ref, "__re_match_cb");
 	}
-	__ldms_set_tree_unlock();
+	free(match.sets);
+	match.sets = NULL;
+	if (rc)
+		goto err_1;
 	if (!matched) {
 		rc = ENOENT;
 		goto err_1;
@@ -1399,8 +1422,11 @@ static void process_lookup_request_re(struct ldms_xprt *x, struct ldms_request *
 	if (flags & LDMS_LOOKUP_RE)
 		regfree(&regex);
 	return;
+ err_2:
+	for (i = 0; i < match.count; i++)
+		ref_put(&match.sets[i]->ref, "__re_match_cb");
+	free(match.sets);
  err_1:
-	__ldms_set_tree_unlock();
 	if (flags & LDMS_LOOKUP_RE)
 		regfree(&regex);
  err_0:
@@ -1482,15 +1508,38 @@ out:
 	return zap_zerr2errno(rc);
 }
 
+/*
+ * Offset and length of the set array elements `idx_from` to `idx_to`
+ * (inclusive) in the set memory.
+ */
+static void __update_data_range(ldms_set_t s, int idx_from, int idx_to,
+				size_t *doff, size_t *dlen)
+{
+	uint32_t data_sz = __le32_to_cpu(s->meta->data_sz);
+	*doff = (uint8_t *)s->data_array - (uint8_t *)s->meta
+							+ idx_from * data_sz;
+	*dlen = (idx_to - idx_from + 1) * data_sz;
+}
+
+/* Post the data read of the LDMS_CONTEXT_UPDATE context `ctxt` */
+static zap_err_t __update_data_read(ldms_t x, struct ldms_context *ctxt)
+{
+	ldms_set_t s = ctxt->update.s;
+	size_t doff, dlen;
+
+	__update_data_range(s, ctxt->update.idx_from, ctxt->update.idx_to,
+			    &doff, &dlen);
+	return zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + doff,
+			s->lmap, zap_map_addr(s->lmap) + doff, dlen, ctxt);
+}
+
 static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
 			ldms_update_cb_t cb, void*arg)
 {
 	/* Read multiple set data in the set array from `idx_from` to `idx_to`
 	 * (inclusive) in 1 RDMA read. */
 	int rc;
-	uint32_t data_sz;
 	struct ldms_context *ctxt;
-	size_t doff, dlen;
 	TF();
 
 	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE,
@@ -1500,14 +1549,45 @@ static int do_read_data(ldms_t x, ldms_set_t s, int idx_from, int idx_to,
 		rc = ENOMEM;
 		goto out;
 	}
-	data_sz = __le32_to_cpu(s->meta->data_sz);
-	doff = (uint8_t *)s->data_array - (uint8_t *)s->meta
-							+ idx_from * data_sz;
-	dlen = (idx_to - idx_from + 1) * data_sz;
+	assert(x == ctxt->x);
+	rc = __update_data_read(x, ctxt);
+	if (rc) {
+		x->zerrno = rc;
+		rc = zap_zerr2errno(rc);
+		__ldms_free_ctxt(x, ctxt);
+	}
+out:
+	return rc;
+}
+
+/* Read the data header of a delta updated set into the set */
+static zap_err_t __update_delta_hdr_read(ldms_t x, struct ldms_context *ctxt)
+{
+	ldms_set_t s = ctxt->update.s;
+	size_t doff = (uint8_t *)s->data_array - (uint8_t *)s->meta;
+	return zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + doff,
+			s->lmap, zap_map_addr(s->lmap) + doff,
+			sizeof(struct ldms_data_hdr), ctxt);
+}
+
+static int do_read_delta(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
+{
+	/* Read only the data header. The modified ranges described by its
+	 * dirty map are read when this read completes. */
+	int rc;
+	struct ldms_context *ctxt;
+	TF();
+
+	ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE_DELTA,
+						s, cb, arg, 0, 0);
+	if (!ctxt) {
+		rc = ENOMEM;
+		goto out;
+	}
+	ctxt->update.delta_gn = __le64_to_cpu(s->data->gn);
 
 	assert(x == ctxt->x);
-	rc = zap_read(x->zap_ep, s->rmap, zap_map_addr(s->rmap) + doff,
-		      s->lmap, zap_map_addr(s->lmap) + doff, dlen, ctxt);
+	rc = __update_delta_hdr_read(x, ctxt);
 	if (rc) {
 		x->zerrno = rc;
 		rc = zap_zerr2errno(rc);
@@ -1517,6 +1597,24 @@ out:
 	return rc;
 }
 
+/*
+ * The set array elements to read in a data-only update, i.e. from the
+ * element after our current one up to the peer's current element without
+ * wrapping around.
+ */
+static void __update_idx_get(ldms_set_t s, uint32_t n,
+			     int *idx_from, int *idx_to)
+{
+	int idx_next, idx_curr;
+	*idx_from = (s->curr_idx + 1) % n;
+	idx_curr = __le32_to_cpu(s->data->curr_idx);
+	idx_next = (idx_curr + 1) % n;
+	if (idx_next == *idx_from)
+		*idx_to = idx_next;
+	else
+		*idx_to = (idx_curr < *idx_from)?(n - 1):(idx_curr);
+}
+
 /*
  * The meta data and the data are updated separately. The assumption
  * is that the meta data rarely (if ever) changes. The GN (generation
@@ -1526,6 +1624,10 @@ out:
  * against the GN returned in the data. If it matches, we're done. If
  * they don't match, then the meta data is fetched and then the data
  * is fetched again.
+ *
+ * If delta updates are enabled on the set, the peer tracks modifications
+ * and the local copy is consistent, only the data header is fetched first
+ * and then the modified ranges of the data (see __handle_update_delta()).
  */
 int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 {
@@ -1546,7 +1648,7 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 		x->log("%s: Set %s has 0 cardinality\n", __func__, ldms_set_instance_name_get(s));
 		return EINVAL;
 	}
-	int idx_from, idx_to, idx_next, idx_curr;
+	int idx_from, idx_to;
 	zap_get_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);		/* Released in handle_zap_read_complete() */
 	if (meta_meta_gn == 0 || meta_meta_gn != data_meta_gn) {
 		if (s->curr_idx == (n-1)) {
@@ -1557,14 +1659,11 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 			 * separately */
 			rc = do_read_meta(x, s, cb, arg);
 		}
+	} else if ((s->flags & LDMS_SET_F_DELTA_UPDATE) && n == 1 &&
+		   s->meta->dirty_chunk_sz && ldms_set_is_consistent(s)) {
+		rc = do_read_delta(x, s, cb, arg);
 	} else {
-		idx_from = (s->curr_idx + 1) % n;
-		idx_curr = __le32_to_cpu(s->data->curr_idx);
-		idx_next = (idx_curr + 1) % n;
-		if (idx_next == idx_from)
-			idx_to = idx_next;
-		else
-			idx_to = (idx_curr < idx_from)?(n - 1):(idx_curr);
+		__update_idx_get(s, n, &idx_from, &idx_to);
 		rc = do_read_data(x, s, idx_from, idx_to, cb, arg);
 	}
 	if (rc) {
@@ -1573,6 +1672,150 @@ int __ldms_remote_update(ldms_t x, ldms_set_t s, ldms_update_cb_t cb, void *arg)
 	return rc;
 }
 
+/*
+ * Number of sets served by one vectored read. It bounds the size of the
+ * transport request, not the number of sets given to
+ * __ldms_remote_update_batch().
+ */
+#define LDMS_UPDATE_BATCH_MAX 256
+
+/*
+ * Whether a set update is a plain data read, i.e. what a batch can carry.
+ * Metadata and delta updates go through __ldms_remote_update().
+ */
+static int __update_is_batchable(ldms_t x, ldms_set_t s)
+{
+	uint32_t meta_meta_gn, n;
+	if (!s->lmap || !s->rmap)
+		return 0;
+	n = __le32_to_cpu(s->meta->array_card);
+	if (n == 0)
+		return 0;
+	meta_meta_gn = __le32_to_cpu(s->meta->meta_gn);
+	if (meta_meta_gn == 0 ||
+	    meta_meta_gn != __le32_to_cpu(s->data->meta_gn))
+		return 0;
+	if ((s->flags & LDMS_SET_F_DELTA_UPDATE) && n == 1 &&
+	    s->meta->dirty_chunk_sz && ldms_set_is_consistent(s))
+		return 0;
+	return 1;
+}
+
+/* Update up to LDMS_UPDATE_BATCH_MAX sets with one vectored read */
+static int __update_batch(ldms_t x, ldms_set_t *sets, int n,
+			  ldms_update_cb_t cb, void **cb_args, int *rcs)
+{
+	struct zap_read_iov iov[LDMS_UPDATE_BATCH_MAX];
+	int idx[LDMS_UPDATE_BATCH_MAX];
+	struct ldms_context *bctxt, *ctxt;
+	int i, cnt, idx_from, idx_to, ret = 0;
+	size_t doff, dlen;
+	ldms_set_t s;
+	zap_err_t zerr;
+
+	assert(n <= LDMS_UPDATE_BATCH_MAX);
+	bctxt = __ldms_alloc_ctxt(x, sizeof(*bctxt) + n * sizeof(ctxt),
+				  LDMS_CONTEXT_UPDATE_BATCH);
+	if (!bctxt) {
+		for (i = 0; i < n; i++)
+			rcs[i] = ENOMEM;
+		return ENOMEM;
+	}
+	cnt = 0;
+	for (i = 0; i < n; i++) {
+		s = sets[i];
+		if (s->xprt != x) {
+			rcs[i] = EINVAL;
+			goto next;
+		}
+		if (!__update_is_batchable(x, s)) {
+			rcs[i] = __ldms_remote_update(x, s, cb, cb_args[i]);
+			goto next;
+		}
+		__update_idx_get(s, __le32_to_cpu(s->meta->array_card),
+				 &idx_from, &idx_to);
+		ctxt = __ldms_alloc_ctxt(x, sizeof(*ctxt), LDMS_CONTEXT_UPDATE,
+					 s, cb, cb_args[i], idx_from, idx_to);
+		if (!ctxt) {
+			rcs[i] = ENOMEM;
+			goto next;
+		}
+		/* Released in __handle_update_data() */
+		zap_get_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
+		__update_data_range(s, idx_from, idx_to, &doff, &dlen);
+		iov[cnt].src_map = s->rmap;
+		iov[cnt].src = zap_map_addr(s->rmap) + doff;
+		iov[cnt].dst_map = s->lmap;
+		iov[cnt].dst = zap_map_addr(s->lmap) + doff;
+		iov[cnt].sz = dlen;
+		idx[cnt] = i;
+		bctxt->batch.ctxts[cnt++] = ctxt;
+		rcs[i] = 0;
+	next:
+		if (rcs[i] && !ret)
+			ret = rcs[i];
+	}
+	bctxt->batch.count = cnt;
+
+	zerr = ZAP_ERR_NOT_SUPPORTED;
+	if (cnt > 1)
+		zerr = zap_readv(x->zap_ep, iov, cnt, bctxt);
+	if (zerr == ZAP_ERR_OK)
+		return ret;
+
+	/* Read one by one; each context completes on its own */
+	for (i = 0; i < cnt; i++) {
+		ctxt = bctxt->batch.ctxts[i];
+		if (zerr == ZAP_ERR_NOT_SUPPORTED)
+			rcs[idx[i]] = __update_data_read(x, ctxt);
+		else
+			rcs[idx[i]] = zerr;
+		if (!rcs[idx[i]])
+			continue;
+		x->zerrno = rcs[idx[i]];
+		rcs[idx[i]] = zap_zerr2errno(rcs[idx[i]]);
+		if (!ret)
+			ret = rcs[idx[i]];
+		zap_put_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
+		__ldms_free_ctxt(x, ctxt);
+	}
+	__ldms_free_ctxt(x, bctxt);
+	return ret;
+}
+
+/*
+ * Update `n` sets of the transport `x`. The data-only updates are batched
+ * into vectored reads (see zap_readv()) so that a transport that supports
+ * it serves LDMS_UPDATE_BATCH_MAX sets per request/response. The status of
+ * each update request is returned in `rcs`.
+ *
+ * Must be called with the xprt lock held.
+ */
+int __ldms_remote_update_batch(ldms_t x, ldms_set_t *sets, int n,
+			       ldms_update_cb_t cb, void **cb_args, int *rcs)
+{
+	int i, cnt, rc, ret = 0;
+
+	if (!ldms_xprt_connected(x))
+		ret = ENOTCONN;
+	else if (LDMS_XPRT_AUTH_GUARD(x))
+		ret = EPERM;
+	if (ret) {
+		for (i = 0; i < n; i++)
+			rcs[i] = ret;
+		return ret;
+	}
+	for (i = 0; i < n; i += cnt) {
+		cnt = n - i;
+		if (cnt > LDMS_UPDATE_BATCH_MAX)
+			cnt = LDMS_UPDATE_BATCH_MAX;
+		rc = __update_batch(x, &sets[i], cnt, cb, &cb_args[i], &rcs[i]);
+		if (rc && !ret)
+			ret = rc;
+	}
+	return ret;
+}
+
 static
 int ldms_xprt_recv_request(struct ldms_xprt *x, struct ldms_request *req)
 {
@@ -1870,13 +2113,11 @@ void __process_dir_reply(struct ldms_xprt *x, struct ldms_reply *reply,
 		}
 
 		/* If this set is in our local set tree, update it's set info */
-		__ldms_set_tree_lock();
 		dir->set_data[i].info_count = info_count;
 		lset = __ldms_find_local_set(dir->set_data[i].inst_name);
 		rc = __process_dir_set_info(lset, type, &dir->set_data[i], info_list);
 		if (lset)
 			ref_put(&lset->ref, "__ldms_find_local_set");
-		__ldms_set_tree_unlock();
 		if (rc)
 			break;
 	}
@@ -2082,6 +2323,25 @@ zap_mem_info_t ldms_zap_mem_info()
 	mm_get_info(&mmi);
 	zmmi.start = mmi.start;
 	zmmi.len = mmi.size;
+	zmmi.max_len = mmi.max_size;
+	zmmi.fd = mmi.fd;
+	return &zmmi;
+}
+
+/*
+ * zap_shm maps the heap through its memfd and follows it as it grows, so
+ * unlike the transports that register [start, start + len) it does not
+ * need the heap to stop growing.
+ */
+static zap_mem_info_t ldms_zap_shm_mem_info()
+{
+	static struct mm_info mmi;
+	static struct zap_mem_info zmmi;
+	mm_peek_info(&mmi);
+	zmmi.start = mmi.start;
+	zmmi.len = mmi.size;
+	zmmi.max_len = mmi.max_size;
+	zmmi.fd = mmi.fd;
 	return &zmmi;
 }
 
@@ -2344,6 +2604,202 @@ static void __handle_update_meta(ldms_t x, struct ldms_context *ctxt,
 	pthread_mutex_unlock(&x->lock);
 }
 
+/*
+ * Drop `count` outstanding delta range reads. After the last one, the data
+ * header is read again to check that the peer did not modify the set while
+ * the ranges were read (see __handle_update_delta()).
+ */
+static void __update_delta_put(ldms_t x, struct ldms_context *ctxt,
+			       zap_err_t status, int count)
+{
+	struct zap_event ev = {
+		.type = ZAP_EVENT_READ_COMPLETE,
+		.context = ctxt,
+	};
+	if (status)
+		__sync_bool_compare_and_swap(&ctxt->update.status, 0, status);
+	if (__sync_sub_and_fetch(&ctxt->update.pending, count))
+		return;
+	if (!ctxt->update.status && ctxt->update.s) {
+		ctxt->update.delta_verify = 1;
+		status = __update_delta_hdr_read(x, ctxt);
+		if (!status)
+			return;
+		x->zerrno = status;
+		ctxt->update.status = status;
+	}
+	ev.status = ctxt->update.status;
+	if (ev.status && ctxt->update.s) {
+		/* The local data is now partially updated; force a full
+		 * read on the next update. */
+		ctxt->update.s->data->gn = 0;
+	}
+	__handle_update_data(x, ctxt, &ev);
+}
+
+#define LDMS_UPDATE_DELTA_RANGES 16
+
+static void __handle_update_delta(ldms_t x, struct ldms_context *ctxt,
+				  zap_event_t ev)
+{
+	ldms_set_t set = ctxt->update.s;
+	struct ldms_data_hdr *data;
+	struct {
+		uint32_t off;
+		uint32_t len;
+	} r[LDMS_UPDATE_DELTA_RANGES + 1];
+	uint32_t chunk_sz, data_sz, heap_sz, static_sz, off, len, total;
+	size_t doff;
+	int b, i, n, rc;
+
+	if (ctxt->update.pending) {
+		/* A modified range has been read */
+		__update_delta_put(x, ctxt, ev->status, 1);
+		return;
+	}
+
+	if (!set) {
+		/* The set has been deleted */
+		__handle_update_data(x, ctxt, ev);
+		return;
+	}
+	data = set->data;
+	if (ev->status != ZAP_ERR_OK) {
+		data->gn = 0;
+		__handle_update_data(x, ctxt, ev);
+		return;
+	}
+
+	if (ctxt->update.delta_verify) {
+		/*
+		 * The header read again after the ranges. If the peer has
+		 * begun a transaction or modified the set since the first
+		 * header, the ranges may mix two generations of the data.
+		 */
+		if (!ldms_set_is_consistent(set) ||
+		    __le64_to_cpu(data->gn) != ctxt->update.delta_remote_gn ||
+		    __le64_to_cpu(data->dirty_gn) != ctxt->update.delta_gn)
+			goto full;
+		__handle_update_data(x, ctxt, ev);
+		return;
+	}
+
+	if (__le64_to_cpu(data->gn) == ctxt->update.delta_gn) {
+		/* Nothing has changed since our last update */
+		__handle_update_data(x, ctxt, ev);
+		return;
+	}
+
+	if (!ldms_set_is_consistent(set) ||
+	    __le64_to_cpu(data->dirty_gn) != ctxt->update.delta_gn)
+		goto full;
+
+	chunk_sz = __le32_to_cpu(set->meta->dirty_chunk_sz);
+	data_sz = __le32_to_cpu(set->meta->data_sz);
+	heap_sz = __le32_to_cpu(set->meta->heap_sz);
+	static_sz = data_sz - heap_sz;
+	n = total = 0;
+	for (b = 0; b < LDMS_DIRTY_MAP_BITS; b++) {
+		if (!(__le64_to_cpu(data->dirty_map[b / 64]) & (1ULL << (b % 64))))
+			continue;
+		off = b * chunk_sz;
+		if (off >= static_sz)
+			break;
+		len = chunk_sz;
+		if (off + len > static_sz)
+			len = static_sz - off;
+		total += len;
+		/* Reading a one-chunk gap is cheaper than another request */
+		if (n && r[n-1].off + r[n-1].len + chunk_sz >= off) {
+			total += off - (r[n-1].off + r[n-1].len);
+			r[n-1].len = off + len - r[n-1].off;
+			continue;
+		}
+		if (n == LDMS_UPDATE_DELTA_RANGES)
+			goto full;
+		r[n].off = off;
+		r[n].len = len;
+		n++;
+	}
+	if (heap_sz) {
+		/* The heap is always read as a whole */
+		if (n && r[n-1].off + r[n-1].len == static_sz) {
+			r[n-1].len += heap_sz;
+		} else {
+			r[n].off = static_sz;
+			r[n].len = heap_sz;
+			n++;
+		}
+		total += heap_sz;
+	}
+	if (!n) {
+		/* Only the header has changed */
+		__handle_update_data(x, ctxt, ev);
+		return;
+	}
+	if (total >= data_sz - (data_sz >> 2))
+		goto full;
+
+	doff = (uint8_t *)set->data_array - (uint8_t *)set->meta;
+	ctxt->update.delta_remote_gn = __le64_to_cpu(data->gn);
+	/* One extra count for the submission loop below */
+	ctxt->update.pending = n + 1;
+	for (i = 0; i < n; i++) {
+		rc = zap_read(x->zap_ep, set->rmap,
+			      zap_map_addr(set->rmap) + doff + r[i].off,
+			      set->lmap, zap_map_addr(set->lmap) + doff + r[i].off,
+			      r[i].len, ctxt);
+		if (rc) {
+			x->zerrno = rc;
+			__update_delta_put(x, ctxt, rc, n - i + 1);
+			return;
+		}
+	}
+	__update_delta_put(x, ctxt, ZAP_ERR_OK, 1);
+	return;
+
+ full:
+	rc = do_read_data(x, set, 0, 0, ctxt->update.cb, ctxt->update.cb_arg);
+	if (rc) {
+		data->gn = 0;
+		ctxt->update.cb(x, set, LDMS_UPD_ERROR(rc), ctxt->update.cb_arg);
+		zap_put_ep(x->zap_ep, "ldms_xprt:set_update", __func__, __LINE__);
+	}
+	/* do_read_data has its own context */
+	pthread_mutex_lock(&x->lock);
+	__ldms_free_ctxt(x, ctxt);
+	pthread_mutex_unlock(&x->lock);
+}
+
+/*
+ * Complete the updates served by a vectored read. The transport reports
+ * only the first error of the read, so on error each set is read again on
+ * its own to find which of them actually failed.
+ */
+static void __handle_update_batch(ldms_t x, struct ldms_context *bctxt,
+				  zap_event_t ev)
+{
+	struct ldms_context *ctxt;
+	struct zap_event sev = *ev;
+	int i;
+
+	for (i = 0; i < bctxt->batch.count; i++) {
+		ctxt = bctxt->batch.ctxts[i];
+		sev.context = ctxt;
+		sev.status = ev->status;
+		if (ev->status != ZAP_ERR_OK && ev->status != ZAP_ERR_FLUSH &&
+		    ctxt->update.s) {
+			sev.status = __update_data_read(x, ctxt);
+			if (sev.status == ZAP_ERR_OK)
+				continue;
+		}
+		__handle_update_data(x, ctxt, &sev);
+	}
+	pthread_mutex_lock(&x->lock);
+	__ldms_free_ctxt(x, bctxt);
+	pthread_mutex_unlock(&x->lock);
+}
+
 static void __handle_lookup(ldms_t x, struct ldms_context *ctxt,
 			    zap_event_t ev)
 {
@@ -2398,6 +2854,12 @@ static void handle_zap_read_complete(zap_ep_t zep, zap_event_t ev)
 	case LDMS_CONTEXT_UPDATE_META:
 		__handle_update_meta(x, ctxt, ev);
 		break;
+	case LDMS_CONTEXT_UPDATE_DELTA:
+		__handle_update_delta(x, ctxt, ev);
+		break;
+	case LDMS_CONTEXT_UPDATE_BATCH:
+		__handle_update_batch(x, ctxt, ev);
+		break;
 	case LDMS_CONTEXT_LOOKUP_READ:
 		__handle_lookup(x, ctxt, ev);
 		break;
@@ -2525,9 +2987,7 @@ static void handle_rendezvous_lookup(zap_ep_t zep, zap_event_t ev,
 	schema_name = (ldms_name_t)lu->set_info;
 	inst_name = (ldms_name_t)&(schema_name->name[schema_name->len]);
 
-	__ldms_set_tree_lock();
 	lset = __ldms_find_local_set(inst_name->name);
-	__ldms_set_tree_unlock();
 
 	if (lset) {
 		rc = EEXIST;
@@ -2955,7 +3415,8 @@ zap_t __ldms_zap_get(const char *xprt, ldms_log_fn_t log_fn)
 		errno = ENOMEM;
 		goto out;
 	}
-	zap = zap_get(xprt, log_fn, ldms_zap_mem_info);
+	zap = zap_get(xprt, log_fn, 0 == strcmp(xprt, "shm") ?
+			ldms_zap_shm_mem_info : ldms_zap_mem_info);
 	if (!zap) {
 		log_fn("ldms: Cannot get zap plugin: %s\n", xprt);
 		errno = ENOENT;
@@ -3343,9 +3804,7 @@ int __ldms_remote_lookup(ldms_t _x, const char *path,
 	if (LDMS_XPRT_AUTH_GUARD(x))
 		return EPERM;
 
-	__ldms_set_tree_lock();
 	struct ldms_set *set = __ldms_find_local_set(path);
-	__ldms_set_tree_unlock();
 	if (set) {
 		ldms_set_put(set);
 		return EEXIST;
@@ -3842,9 +4301,7 @@ extern ldms_set_t ldms_xprt_set_by_name(ldms_t x, const char *set_name)
 	struct ldms_set *set;
 	struct rbn *rbn;
 
-	__ldms_set_tree_lock();
 	set = __ldms_find_local_set(set_name);
-	__ldms_set_tree_unlock();
 	if (!set)
 		return NULL;
 	pthread_mutex_lock(&x->lock);
@@ -282,6 +282,8 @@ typedef enum ldms_context_type {
 	LDMS_CONTEXT_PUSH,
 	LDMS_CONTEXT_UPDATE_META,
 	LDMS_CONTEXT_SET_DELETE,
+	LDMS_CONTEXT_UPDATE_DELTA,
+	LDMS_CONTEXT_UPDATE_BATCH,
 } ldms_context_type_t;
 
 struct ldms_context {
@@ -314,7 +316,17 @@ struct ldms_context {
 			void *cb_arg;
 			int idx_from;
 			int idx_to;
+			uint64_t delta_gn; /* local data gn before a delta update */
+			int pending; /* outstanding delta range reads */
+			zap_err_t status; /* first delta range read error */
+			uint64_t delta_remote_gn; /* peer data gn of the ranges */
+			int delta_verify; /* the data header is read again */
 		} update;
+		struct {
+			int count;
+			/* LDMS_CONTEXT_UPDATE contexts served by the read */
+			struct ldms_context **ctxts;
+		} batch;
 		struct {
 			ldms_set_t s;
 			ldms_notify_cb_t cb;
@@ -340,26 +340,151 @@ typedef struct __decomp_static_row_cfg_s {
 	struct ldms_digest_s schema_digest;
 	size_t row_sz;
 	struct rbt mid_rbt; /* collection of metric IDs mapping */
+	struct __decomp_static_col_mval_s *col_mvals; /* scratch for decompose */
 } *__decomp_static_row_cfg_t;
 
+/* The state of a source column while the rows are being expanded */
+struct __decomp_static_col_mval_s {
+	ldms_mval_t mval;
+	ldms_mval_t rec_array;
+	union {
+		ldms_mval_t le;
+		ldms_mval_t rec;
+	};
+	enum ldms_value_type mtype;
+	size_t array_len;
+	int metric_id;
+	int rec_metric_id;
+	int rec_array_len;
+	int rec_array_idx;
+};
+
+/*
+ * The rows of an update are carved out of a per-strgp arena of chunks.
+ * `release_rows` resets the arena rather than freeing the rows, so once the
+ * arena has grown to fit the largest update, decomposing allocates nothing.
+ */
+typedef struct __decomp_static_chunk_s {
+	struct __decomp_static_chunk_s *next;
+	size_t sz;  /* size of buf */
+	size_t off; /* next free byte in buf */
+	uint64_t buf[OVIS_FLEX];
+} *__decomp_static_chunk_t;
+
+#define DECOMP_STATIC_CHUNK_SZ (64 * 1024)
+
+struct __decomp_static_arena_s {
+	__decomp_static_chunk_t head;
+	__decomp_static_chunk_t tail;
+	__decomp_static_chunk_t cur; /* the chunk being allocated from */
+	size_t total_sz; /* sum of the chunk sizes */
+};
+
 typedef struct __decomp_static_cfg_s {
 	struct ldmsd_decomp_s decomp;
+	struct __decomp_static_arena_s arena;
 	int row_count;
 	struct __decomp_static_row_cfg_s rows[OVIS_FLEX];
 } *__decomp_static_cfg_t;
 
+/*
+ * The per-column "decomposition program" compiled when the metric IDs of an
+ * LDMS schema (digest) are resolved. `decompose` dispatches on the op
+ * instead of re-deriving the metric types on every update.
+ */
+typedef enum __decomp_static_op_e {
+	DECOMP_STATIC_OP_FILL,      /* missing or unsupported metric */
+	DECOMP_STATIC_OP_TIMESTAMP, /* the set timestamp */
+	DECOMP_STATIC_OP_PRODUCER,  /* the set producer name */
+	DECOMP_STATIC_OP_INSTANCE,  /* the set instance name */
+	DECOMP_STATIC_OP_PRIM,      /* primitive or array of primitives */
+	DECOMP_STATIC_OP_LIST,      /* list of primitives or of records */
+	DECOMP_STATIC_OP_REC_ARRAY, /* member of the records in a record array */
+} __decomp_static_op_t;
+
 typedef struct __decomp_static_mid_rbn_s {
 	struct rbn rbn;
 	struct ldms_digest_s ldms_digest;
 	int col_count;
 	struct {
+		__decomp_static_op_t op;
 		int mid;
 		int rec_mid;
 		enum ldms_value_type mtype;
 		enum ldms_value_type rec_mtype;
+		size_t array_len; /* DECOMP_STATIC_OP_PRIM array length */
 	} col_mids[OVIS_FLEX];
 } *__decomp_static_mid_rbn_t;
 
+static void *__arena_alloc(struct __decomp_static_arena_s *a, size_t sz)
+{
+	__decomp_static_chunk_t c;
+	size_t c_sz;
+	void *p;
+
+	sz = (sz + 7) & ~7;
+	/* chunks past `cur` are empty */
+	for (; a->cur; a->cur = a->cur->next) {
+		if (a->cur->off + sz <= a->cur->sz)
+			goto out;
+	}
+	c_sz = a->total_sz > DECOMP_STATIC_CHUNK_SZ ?
+			a->total_sz : DECOMP_STATIC_CHUNK_SZ;
+	if (c_sz < sz)
+		c_sz = sz;
+	c = malloc(sizeof(*c) + c_sz);
+	if (!c)
+		return NULL;
+	c->next = NULL;
+	c->sz = c_sz;
+	c->off = 0;
+	if (a->tail)
+		a->tail->next = c;
+	else
+		a->head = c;
+	a->tail = c;
+	a->total_sz += c_sz;
+	a->cur = c;
+ out:
+	p = (char *)a->cur->buf + a->cur->off;
+	a->cur->off += sz;
+	return p;
+}
+
+static void __arena_free(struct __decomp_static_arena_s *a)
+{
+	__decomp_static_chunk_t c;
+	while ((c = a->head)) {
+		a->head = c->next;
+		free(c);
+	}
+	a->tail = a->cur = NULL;
+	a->total_sz = 0;
+}
+
+static void __arena_reset(struct __decomp_static_arena_s *a)
+{
+	__decomp_static_chunk_t c;
+	size_t sz;
+
+	if (a->head && a->head->next) {
+		/* The last update spilled over several chunks. Replace them
+		 * with a single chunk that fits it. */
+		sz = a->total_sz;
+		__arena_free(a);
+		c = malloc(sizeof(*c) + sz);
+		if (!c)
+			return; /* the next __arena_alloc() grows it again */
+		c->next = NULL;
+		c->sz = sz;
+		a->head = a->tail = c;
+		a->total_sz = sz;
+	}
+	for (c = a->head; c; c = c->next)
+		c->off = 0;
+	a->cur = a->head;
+}
+
 int __mid_rbn_cmp(void *tree_key, const void *key)
 {
 	return memcmp(tree_key, key, sizeof(struct ldms_digest_s));
@@ -387,8 +512,15 @@ static void __decomp_static_cfg_free(__decomp_static_cfg_t dcfg)
 	int i, j;
 	struct __decomp_static_row_cfg_s *drow;
 	struct __decomp_static_col_cfg_s *dcol;
+	struct rbn *rbn;
 	for (i = 0; i < dcfg->row_count; i++) {
 		drow = &dcfg->rows[i];
+		/* compiled metric ID programs */
+		while ((rbn = rbt_min(&drow->mid_rbt))) {
+			rbt_del(&drow->mid_rbt, rbn);
+			free(rbn);
+		}
+		free(drow->col_mvals);
 		/* cols */
 		for (j = 0; j < drow->col_count; j++) {
 			dcol = &drow->cols[j];
@@ -408,6 +540,7 @@ static void __decomp_static_cfg_free(__decomp_static_cfg_t dcfg)
 		/* schema */
 		free(drow->schema_name);
 	}
+	__arena_free(&dcfg->arena);
 	free(dcfg);
 }
 
@@ -490,6 +623,9 @@ __decomp_static_config( ldmsd_strgp_t strgp, json_entity_t jcfg,
 		if (!drow->cols)
 			goto err_enomem;
 		drow->row_sz += drow->col_count * sizeof(struct ldmsd_col_s);
+		drow->col_mvals = calloc(drow->col_count, sizeof(drow->col_mvals[0]));
+		if (!drow->col_mvals)
+			goto err_enomem;
 		/* for each column */
 		j = 0;
 		TAILQ_FOREACH(jcol, &jcols->item_list, item_entry) {
@@ -743,24 +879,28 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 	const char *src;
 	enum ldms_value_type mtype;
 	for (i = 0; i < mid_rbn->col_count; i++) {
+		mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_FILL;
 		mid_rbn->col_mids[i].mid = -1;
 		mid_rbn->col_mids[i].rec_mid = -1;
 
 		src = drow->cols[i].src;
 
 		if (0 == strcmp(src, "timestamp")) {
+			mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_TIMESTAMP;
 			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_TIMESTAMP;
 			mid_rbn->col_mids[i].rec_mtype = LDMS_V_TIMESTAMP;
 			continue;
 		}
 
 		if (0 == strcmp(src, "producer")) {
+			mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_PRODUCER;
 			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_PRODUCER;
 			mid_rbn->col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
 			continue;
 		}
 
 		if (0 == strcmp(src, "instance")) {
+			mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_INSTANCE;
 			mid_rbn->col_mids[i].mid = LDMSD_PHONY_METRIC_ID_INSTANCE;
 			mid_rbn->col_mids[i].rec_mtype = LDMS_V_CHAR_ARRAY;
 			continue;
@@ -784,10 +924,16 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 		}
 		mid_rbn->col_mids[i].rec_mid = -EINVAL;
 		mid_rbn->col_mids[i].rec_mtype = LDMS_V_NONE;
+		mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_PRIM;
+		if (ldms_type_is_array(mtype))
+			mid_rbn->col_mids[i].array_len = ldms_metric_array_get_len(set, mid);
+		else
+			mid_rbn->col_mids[i].array_len = 1;
 		continue;
 
 	list_routine:
-		/* handling LIST */
+		/* handling LIST; the element types are checked in decompose */
+		mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_LIST;
 		lh = ldms_metric_get(set, mid);
 		le = ldms_list_first(set, lh, &mtype, &mlen);
 		if (!le) {
@@ -817,6 +963,7 @@ static int __decomp_static_resolve_mid(__decomp_static_mid_rbn_t mid_rbn,
 		continue;
 
 	rec_array_routine:
+		mid_rbn->col_mids[i].op = DECOMP_STATIC_OP_REC_ARRAY;
 		rec_array = ldms_metric_get(set, mid);
 		rec = ldms_record_array_get_inst(rec_array, 0);
 		if (!drow->cols[i].rec_member) {
@@ -847,27 +994,13 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 	ldmsd_row_t row;
 	ldmsd_col_t col;
 	ldmsd_row_index_t idx;
-	ldms_mval_t mval, lh, le, rec_array;
+	ldms_mval_t mval = NULL, lh, le, rec_array;
 	enum ldms_value_type mtype;
 	size_t mlen;
 	int i, j, k, c, mid, rc, rec_mid;
-	struct _col_mval_s {
-		ldms_mval_t mval;
-		ldms_mval_t rec_array;
-		union {
-			ldms_mval_t le;
-			ldms_mval_t rec;
-		};
-		enum ldms_value_type mtype;
-		size_t array_len;
-		int metric_id;
-		int rec_metric_id;
-		int rec_array_len;
-		int rec_array_idx;
-	} *col_mvals = NULL, *mcol;
+	struct __decomp_static_col_mval_s *col_mvals, *mcol;
 	__decomp_static_mid_rbn_t mid_rbn;
 	ldms_digest_t ldms_digest;
-	TAILQ_HEAD(, _list_entry) list_cols;
 	int row_more_le;
 	struct ldms_timestamp ts;
 	const char *producer;
@@ -885,7 +1018,6 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 	instance = ldms_set_instance_name_get(set);
 	instance_len = strlen(instance) + 1;
 
-	TAILQ_INIT(&list_cols);
 	ldms_digest = ldms_set_digest_get(set);
 
 	*row_count = 0;
@@ -911,76 +1043,52 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 		if (rc)
 			goto err_0;
 	make_col_mvals:
-		/* col_mvals is a temporary scratch paper to create rows from
-		 * a set with records. col_mvals is freed at the end of
-		 * `make_row`. */
-		col_mvals = calloc(1, drow->col_count * sizeof(*col_mvals));
-		if (!col_mvals) {
-			rc = ENOMEM;
-			goto err_0;
-		}
+		/* Run the compiled program to set up the source columns in the
+		 * per-row scratch `col_mvals`. */
+		col_mvals = drow->col_mvals;
 		for (j = 0; j < drow->col_count; j++) {
-			mid = mid_rbn->col_mids[j].mid;
 			mcol = &col_mvals[j];
-			if (mid < 0) /* metric not existed in the set */
-				goto col_mvals_fill;
+			mid = mid_rbn->col_mids[j].mid;
 			mcol->metric_id = mid;
 			mcol->rec_metric_id = -1;
 			mcol->rec_array_idx = -1;
 			mcol->rec_array_len = -1;
-			switch (mid) {
-			case LDMSD_PHONY_METRIC_ID_TIMESTAMP:
+			mcol->le = NULL;
+			switch (mid_rbn->col_mids[j].op) {
+			case DECOMP_STATIC_OP_FILL:
+				/* metric not existed in the set */
+				mcol->metric_id = 0;
+				mcol->rec_metric_id = 0;
+				goto col_mvals_fill;
+			case DECOMP_STATIC_OP_TIMESTAMP:
 				/* mcol->mval will be assigned in `make_row` */
 				mcol->mtype = LDMS_V_TIMESTAMP;
 				mcol->array_len = 1;
-				mcol->le = NULL;
 				continue;
-			case LDMSD_PHONY_METRIC_ID_PRODUCER:
+			case DECOMP_STATIC_OP_PRODUCER:
 				mcol->mval = (ldms_mval_t)producer;
 				/* mcol->mval->a_char is producer */
 				mcol->mtype = LDMS_V_CHAR_ARRAY;
 				mcol->array_len = producer_len;
-				mcol->le = NULL;
 				continue;
-			case LDMSD_PHONY_METRIC_ID_INSTANCE:
+			case DECOMP_STATIC_OP_INSTANCE:
 				mcol->mval = (ldms_mval_t)instance;
 				/* mcol->mval->a_char is instance */
 				mcol->mtype = LDMS_V_CHAR_ARRAY;
 				mcol->array_len = instance_len;
-				mcol->le = NULL;
 				continue;
-			}
-			mval = ldms_metric_get(set, mid);
-			mtype = ldms_metric_type_get(set, mid);
-			if (mtype != mid_rbn->col_mids[j].mtype) {
-				ldmsd_lerror("strgp '%s': row '%d' col[dst] '%s': "
-					     "the value type (%s) is not "
-					     "compatible with the source metric type (%s). "
-					     "Please check the decomposition configuration.\n",
-					     strgp->obj.name, i, dcol->dst,
-					     ldms_metric_type_to_str(dcol->type),
-					     ldms_metric_type_to_str(mcol->mtype));
-				rc = EINVAL;
-				goto err_0;
-			}
-
-			if (mtype == LDMS_V_LIST)
+			case DECOMP_STATIC_OP_PRIM:
+				mcol->mval = ldms_metric_get(set, mid);
+				mcol->mtype = mid_rbn->col_mids[j].mtype;
+				mcol->array_len = mid_rbn->col_mids[j].array_len;
+				continue;
+			case DECOMP_STATIC_OP_LIST:
+				mval = ldms_metric_get(set, mid);
 				goto col_mvals_list;
-			if (mtype == LDMS_V_RECORD_ARRAY)
+			case DECOMP_STATIC_OP_REC_ARRAY:
+				mval = ldms_metric_get(set, mid);
 				goto col_mvals_rec_array;
-			if (mtype > LDMS_V_D64_ARRAY)
-				goto col_mvals_fill;
-			/* primitives */
-			if (ldms_type_is_array(mtype)) {
-				mlen = ldms_metric_array_get_len(set, mid);
-			} else {
-				mlen = 1;
 			}
-			mcol->mval = mval;
-			mcol->mtype = mtype;
-			mcol->array_len = mlen;
-			mcol->le = NULL;
-			continue;
 
 		col_mvals_list:
 			/* list */
@@ -1042,11 +1150,12 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 		}
 
 	make_row: /* make/expand rows according to col_mvals */
-		row = calloc(1, drow->row_sz);
+		row = __arena_alloc(&dcfg->arena, drow->row_sz);
 		if (!row) {
 			rc = errno;
 			goto err_0;
 		}
+		memset(row, 0, drow->row_sz);
 		row->schema_name = drow->schema_name;
 		row->schema_digest = &drow->schema_digest;
 		row->idx_count = drow->idx_count;
@@ -1156,14 +1265,9 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 		row = NULL;
 		if (row_more_le)
 			goto make_row;
-		free(col_mvals);
-		col_mvals = NULL;
 	}
 	return 0;
  err_0:
-	/* clean up stuff here */
-	if (col_mvals)
-		free(col_mvals);
 	__decomp_static_release_rows(strgp, row_list);
 	return rc;
 }
@@ -1171,9 +1275,8 @@ static int __decomp_static_decompose(ldmsd_strgp_t strgp, ldms_set_t set,
 static void __decomp_static_release_rows(ldmsd_strgp_t strgp,
 					 ldmsd_row_list_t row_list)
 {
-	ldmsd_row_t row;
-	while ((row = TAILQ_FIRST(row_list))) {
-		TAILQ_REMOVE(row_list, row, entry);
-		free(row);
-	}
+	__decomp_static_cfg_t dcfg = (void*)strgp->decomp;
+	/* The rows live in the arena; reset it for the next update. */
+	TAILQ_INIT(row_list);
+	__arena_reset(&dcfg->arena);
 }
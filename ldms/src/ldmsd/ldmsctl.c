@@ -903,13 +903,19 @@ static void help_updtr_add()
 		"                 Updater will get an update whenever the set source ends a\n"
 		"                 transaction or pushes the update. 'true' means the Updater\n"
 		"                 will receive an update only when the set source explicitly pushes the\n"
-		"                 update. If `push` is used, `auto_interval` cannot be `true`.\n"
-		"    [auto_interval=]   [true|false] If true, the updater will schedule\n"
+		"                 update. If `push` is used, `auto_interval` must be `false`.\n"
+		"    [auto_interval=]   [true|false|adaptive] If true, the updater will schedule\n"
 		"                       set updates according to the update hint. The sets\n"
 		"                       with no hints will not be updated. If false, the\n"
 		"                       updater will schedule the set updates according to\n"
-		"                       the given interval and offset values. If not\n"
+		"                       the given interval and offset values. If adaptive,\n"
+		"                       the updater pulls each set shortly after its next\n"
+		"                       sample is expected, learning the sample period and\n"
+		"                       the lateness from the previous updates. If not\n"
 		"                       specified, the value is `false`.\n"
+		"     [delta=]     [true|false] If true, each update reads only the data\n"
+		"                  ranges that changed since the previous update, if the\n"
+		"                  set producer tracks them. The default is `false`.\n"
 		"     [perm=]      The permission to modify the updater in the future.\n"
 		);
 
@@ -973,10 +979,12 @@ static void help_updtr_start()
 		"     [offset=]   Offset for synchronization\n"
 		"                 If 'interval' is given but not 'offset',\n"
 		"                 the updater will update sets asynchronously.\n"
-		"     [auto_interval=]   [true|false] If true, the updater will schedule\n"
+		"     [auto_interval=]   [true|false|adaptive] If true, the updater will schedule\n"
 		"                        set updates according to the update hint. If false,\n"
 		"                        the updater will schedule the set updates according\n"
-		"                        to the default schedule, i.e., the given interval and offset values.\n");
+		"                        to the default schedule, i.e., the given interval and offset values.\n"
+		"                        If adaptive, each set is pulled shortly after its\n"
+		"                        next sample is expected.\n");
 }
 
 static void help_updtr_stop()
@@ -1008,6 +1016,23 @@ void __print_updtr_status(json_entity_t updtr)
 			json_value_str(mode)->str,
 			json_value_str(state)->str);
 
+	json_entity_t lateness, l_count, l_mean, l_max, l_over, l_missed;
+	lateness = json_value_find(updtr, "lateness");
+	if (lateness && lateness->type == JSON_DICT_VALUE) {
+		l_count = json_value_find(lateness, "count");
+		l_mean = json_value_find(lateness, "mean_us");
+		l_max = json_value_find(lateness, "max_us");
+		l_over = json_value_find(lateness, "oversampled");
+		l_missed = json_value_find(lateness, "missed");
+		if (l_count && l_mean && l_max && l_over && l_missed)
+			printf("    lateness: count %" PRId64 " mean %" PRId64 "us"
+				" max %" PRId64 "us oversampled %" PRId64
+				" missed %" PRId64 "\n",
+				json_value_int(l_count), json_value_int(l_mean),
+				json_value_int(l_max), json_value_int(l_over),
+				json_value_int(l_missed));
+	}
+
 	json_entity_t prdcrs;
 	prdcrs = json_value_find(updtr, "producers");
 	if (!prdcrs)
@@ -1183,7 +1208,10 @@ static void help_strgp_add()
 		"     [flush=]     The interval between calls to the storage plugin flush method.\n"
 		"                  By default, the flush method is not called.\n"
 		"     [perm=]      The permission to modify the storage policy in the future.\n"
-		"     [decomposition=]   The path to the decomposition configuration file.\n");
+		"     [decomposition=]   The path to the decomposition configuration file.\n"
+		"     [queue_depth=]     The maximum number of updates waiting for the\n"
+		"                        store thread. 0 stores on the transport thread.\n"
+		"     [queue_policy=]    coalesce (default) or drop.\n");
 }
 
 static void help_strgp_del()
@@ -1296,6 +1324,37 @@ void __print_strgp_status(json_entity_t strgp)
 		printf(" %s", json_value_str(metric)->str);
 	}
 	printf("\n");
+
+	json_entity_t q = json_value_find(strgp, "queue");
+	if (!q)
+		return;
+	if (q->type != JSON_DICT_VALUE)
+		goto invalid_result_format;
+	json_entity_t policy, depth, max_depth, hwm;
+	json_entity_t enqueued, stored, coalesced, dropped;
+	policy = json_value_find(q, "policy");
+	depth = json_value_find(q, "depth");
+	max_depth = json_value_find(q, "max_depth");
+	hwm = json_value_find(q, "depth_hwm");
+	enqueued = json_value_find(q, "enqueued");
+	stored = json_value_find(q, "stored");
+	coalesced = json_value_find(q, "coalesced");
+	dropped = json_value_find(q, "dropped");
+	if (!policy || !depth || !max_depth || !hwm || !enqueued ||
+			!stored || !coalesced || !dropped)
+		goto invalid_result_format;
+	printf("       queue: policy %s depth %" PRId64 "/%" PRId64
+			" (max seen %" PRId64 ") enqueued %" PRId64
+			" stored %" PRId64 " coalesced %" PRId64
+			" dropped %" PRId64 "\n",
+			json_value_str(policy)->str,
+			json_value_int(depth),
+			json_value_int(max_depth),
+			json_value_int(hwm),
+			json_value_int(enqueued),
+			json_value_int(stored),
+			json_value_int(coalesced),
+			json_value_int(dropped));
 	return;
 
 invalid_result_format:
@@ -2076,6 +2135,101 @@ static void resp_prdcr_stats(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
  	return;
 }
 
+static void help_latency_stats()
+{
+	printf( "\nQuery the daemon's latency histograms (us)\n\n"
+		"Parameters:\n"
+		"     [type=]   Only report the objects of this type:\n"
+		"               updtr, prdcr, strgp or sampler\n"
+		"     [name=]   Only report the object with this name\n"
+		"     [reset=]  true to clear the histograms after the query\n");
+}
+
+static void __print_latency_hist(const char *name, const char *what,
+				 json_entity_t hist)
+{
+	static const char *keys[] = { "count", "mean", "p50", "p90",
+				      "p99", "p999", "max" };
+	json_entity_t v;
+	int i;
+
+	if (!hist)
+		return;
+	printf("%-20s %-10s", name, what);
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		v = json_value_find(hist, (char *)keys[i]);
+		printf(" %10ld", v ? json_value_int(v) : 0);
+	}
+	printf("\n");
+}
+
+static void resp_latency_stats(ldmsd_req_hdr_t resp, size_t len, uint32_t rsp_err)
+{
+	static const char *types[] = { "updtr", "prdcr", "strgp", "sampler" };
+	static const char *whats[] = { "update_us", "store_us", "sample_us" };
+	int rc, i, j;
+	json_parser_t parser;
+	json_entity_t stats, list, obj, a;
+	char *name;
+
+	if (rsp_err) {
+		resp_generic(resp, len, rsp_err);
+		return;
+	}
+
+	ldmsd_req_attr_t attr = ldmsd_first_attr(resp);
+	if (!attr->discrim || (attr->attr_id != LDMSD_ATTR_JSON))
+		return;
+
+	parser = json_parser_new(0);
+	if (!parser) {
+		printf("Error creating a JSON parser.\n");
+		return;
+	}
+	rc = json_parse_buffer(parser, (char *)attr->attr_value, len, &stats);
+	json_parser_free(parser);
+	if (rc) {
+		printf("Syntax error parsing JSON string\n");
+		return;
+	}
+
+	if (stats->type != JSON_DICT_VALUE) {
+		printf("Unrecognized latency stats format\n");
+		goto free_entity;
+	}
+
+	a = json_value_find(stats, "compute_time");
+	if (a)
+		printf("Latency Stats - %ld us\n", json_value_int(a));
+	else
+		printf("Latency Stats - N/A\n");
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		list = json_value_find(stats, (char *)types[i]);
+		if (!list || list->type != JSON_LIST_VALUE)
+			continue;
+		printf("\n%-20s %-10s %10s %10s %10s %10s %10s %10s %10s\n",
+		       types[i], "Latency", "Count", "Mean", "p50", "p90",
+		       "p99", "p999", "Max");
+		printf("-------------------- ---------- ---------- ---------- "
+		       "---------- ---------- ---------- ---------- ----------\n");
+		for (obj = json_item_first(list); obj; obj = json_item_next(obj)) {
+			a = json_value_find(obj, "name");
+			if (!a)
+				continue;
+			name = json_value_str(a)->str;
+			for (j = 0; j < sizeof(whats) / sizeof(whats[0]); j++) {
+				__print_latency_hist(name, whats[j],
+					json_value_find(obj, (char *)whats[j]));
+			}
+		}
+	}
+
+ free_entity:
+ 	json_entity_free(stats);
+ 	return;
+}
+
 static void help_set_stats()
 {
 	printf("\nQuery the daemon's set statistics\n\n");
@@ -2250,6 +2404,7 @@ static struct command command_tbl[] = {
 			     help_failover_stop, resp_generic },
 	{ "greeting", LDMSD_GREETING_REQ, NULL, help_greeting, resp_greeting },
 	{ "help", LDMSCTL_HELP, handle_help, NULL, NULL },
+	{ "latency_stats", LDMSD_LATENCY_STATS_REQ, NULL, help_latency_stats, resp_latency_stats },
 	{ "listen", LDMSD_LISTEN_REQ, NULL, help_listen, resp_generic },
 	{ "load", LDMSD_PLUGN_LOAD_REQ, NULL, help_load, resp_generic },
 	{ "loglevel", LDMSD_VERBOSE_REQ, NULL, help_loglevel, resp_generic },
@@ -63,6 +63,7 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <pthread.h>
 #include <netinet/in.h>
 #include <signal.h>
@@ -96,7 +97,7 @@
 #define LDMSD_LOGFILE "/var/log/ldmsd.log"
 #define LDMSD_PIDFILE_FMT "/var/run/%s.pid"
 
-const char *short_opts = "B:l:s:x:P:m:Fkr:v:Vc:u:a:A:n:t";
+const char *short_opts = "B:l:s:x:P:S:m:Fkr:v:Vc:u:a:A:n:t";
 
 struct option long_opts[] = {
 	{ "default_auth_args",     required_argument, 0,  'A' },
@@ -109,6 +110,7 @@ struct option long_opts[] = {
 	{ "worker_threads",        required_argument, 0,  'P' },
 	{ "pid_file",              required_argument, 0,  'r' },
 	{ "kernel_file",           required_argument, 0,  's' },
+	{ "store_threads",         required_argument, 0,  'S' },
 	{ "log_level",             required_argument, 0,  'v' },
 	{ 0,                       0,                 0,  0 }
 };
@@ -118,6 +120,7 @@ struct option long_opts[] = {
 #define LDMSD_MEM_SIZE_ENV "LDMSD_MEM_SZ"
 #define LDMSD_MEM_SIZE_STR "512kB"
 #define LDMSD_MEM_SIZE_DEFAULT 512L * 1024L
+#define STORE_THREAD_COUNT_DEFAULT 1
 
 char *progname;
 char myname[512]; /* name to identify ldmsd */
@@ -288,59 +291,307 @@ err:
 	return rc;
 }
 
-int __log(enum ldmsd_loglevel level, char *msg, struct timeval *tv, struct tm *tm)
+/*
+ * Log records
+ *
+ * Each thread formats its messages into its own ring of fixed-size records,
+ * so logging takes no lock and allocates nothing unless a message does not
+ * fit in a record. The logger worker merges the rings in timestamp order and
+ * writes them with writev(). When a ring is full its messages are dropped and
+ * counted; the logger reports the count.
+ */
+#define LDMSD_LOG_REC_SZ	256
+#define LDMSD_LOG_MSG_SZ	(LDMSD_LOG_REC_SZ - 32)
+#define LDMSD_LOG_BATCH		256	/* records per writev() */
+
+struct ldmsd_log_rec {
+	uint32_t len;
+	int level;
+	struct timespec ts;
+	char *ext;		/* the message if it does not fit in msg */
+	char msg[LDMSD_LOG_MSG_SZ];
+};
+
+struct ldmsd_log_ring {
+	uint64_t head;		/* next record to write, owner thread */
+	uint64_t tail;		/* next record to write out, logger */
+	uint64_t c_head;	/* logger's snapshot of head */
+	uint64_t c_tail;	/* logger's merge cursor */
+	uint64_t dropped;
+	int busy;		/* the owner is writing a record */
+	int dead;		/* the owner has exited */
+	uint32_t mask;
+	LIST_ENTRY(ldmsd_log_ring) entry;
+	struct ldmsd_log_rec rec[OVIS_FLEX];
+};
+
+static LIST_HEAD(, ldmsd_log_ring) log_ring_list;
+static pthread_mutex_t log_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_ring_key;
+static __thread struct ldmsd_log_ring *log_ring;
+static uint32_t log_ring_len;
+static uint64_t log_lost; /* dropped messages of the threads without a ring */
+static char log_level_pfx[LDMSD_LLASTLEVEL][16];
+
+static void log_ring_exit(void *arg)
 {
-	if (log_fp == LDMSD_LOG_SYSLOG) {
-		syslog(ldmsd_loglevel_to_syslog(level), "%s", msg);
-		return 0;
+	struct ldmsd_log_ring *r = arg;
+	/* the logger frees the ring once it is empty */
+	__atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void log_ring_init(void)
+{
+	char *s;
+	uint32_t len = LDMSD_LOG_RING_LEN_DEFAULT;
+	int i;
+
+	s = getenv(LDMSD_LOG_RING_LEN_VAR);
+	if (s && atoi(s) > 0)
+		len = atoi(s);
+	/* a power of two, so that the record index is a mask */
+	log_ring_len = 16;
+	while (log_ring_len < len && log_ring_len < (1 << 20))
+		log_ring_len <<= 1;
+	for (i = 0; i < LDMSD_LLASTLEVEL; i++) {
+		snprintf(log_level_pfx[i], sizeof(log_level_pfx[i]),
+			 "%-10s: ", ldmsd_loglevel_names[i]);
+	}
+	(void)pthread_key_create(&log_ring_key, log_ring_exit);
+}
+
+static inline int timespec_lt(struct timespec *a, struct timespec *b)
+{
+	if (a->tv_sec == b->tv_sec)
+		return a->tv_nsec < b->tv_nsec;
+	return a->tv_sec < b->tv_sec;
+}
+
+static struct ldmsd_log_ring *log_ring_get()
+{
+	struct ldmsd_log_ring *r;
+
+	if (log_ring)
+		return log_ring;
+	pthread_once(&log_ring_once, log_ring_init);
+	r = calloc(1, sizeof(*r) + log_ring_len * sizeof(r->rec[0]));
+	if (!r)
+		return NULL;
+	r->mask = log_ring_len - 1;
+	pthread_mutex_lock(&log_ring_lock);
+	LIST_INSERT_HEAD(&log_ring_list, r, entry);
+	pthread_mutex_unlock(&log_ring_lock);
+	(void)pthread_setspecific(log_ring_key, r);
+	log_ring = r;
+	return r;
+}
+
+static void log_rec_fill(struct ldmsd_log_rec *rec, enum ldmsd_loglevel level,
+			 const char *fmt, va_list ap)
+{
+	va_list aq;
+	int len;
+
+	clock_gettime(CLOCK_REALTIME, &rec->ts);
+	rec->level = level;
+	rec->ext = NULL;
+	va_copy(aq, ap);
+	len = vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+	if (len < 0) {
+		rec->msg[0] = '\0';
+		len = 0;
+	} else if (len >= sizeof(rec->msg)) {
+		rec->ext = malloc(len + 1);
+		if (rec->ext)
+			vsnprintf(rec->ext, len + 1, fmt, aq);
+		else
+			len = sizeof(rec->msg) - 1; /* truncated */
 	}
+	va_end(aq);
+	rec->len = len;
+}
+
+/* The time prefix of a record; the date string is formatted once a second */
+static int log_rec_time(struct ldmsd_log_rec *rec, char *buf, size_t sz)
+{
+	static time_t dt_sec = -1;
+	static char dt[64];
+	static int dt_len;
+	struct tm tm;
 
 	if (log_time_sec) {
-		fprintf(log_fp, "%lu.%06lu: ", tv->tv_sec, tv->tv_usec);
-	} else {
-		char dtsz[200];
-		if (strftime(dtsz, sizeof(dtsz), "%a %b %d %H:%M:%S %Y", tm))
-			fprintf(log_fp, "%s: ", dtsz);
+		return snprintf(buf, sz, "%lu.%06lu: ", rec->ts.tv_sec,
+				rec->ts.tv_nsec / 1000);
 	}
+	if (rec->ts.tv_sec != dt_sec) {
+		localtime_r(&rec->ts.tv_sec, &tm);
+		dt_len = strftime(dt, sizeof(dt) - 2, "%a %b %d %H:%M:%S %Y", &tm);
+		dt[dt_len++] = ':';
+		dt[dt_len++] = ' ';
+		dt_sec = rec->ts.tv_sec;
+	}
+	memcpy(buf, dt, dt_len);
+	return dt_len;
+}
+
+static void log_writev(int fd, struct iovec *iov, int cnt)
+{
+	ssize_t wb;
 
-	if (level < LDMSD_LALL) {
-		fprintf(log_fp, "%-10s: ", ldmsd_loglevel_names[level]);
+	while (cnt) {
+		wb = writev(fd, iov, cnt < IOV_MAX ? cnt : IOV_MAX);
+		if (wb < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		while (cnt && wb >= iov->iov_len) {
+			wb -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (char *)iov->iov_base + wb;
+			iov->iov_len -= wb;
+		}
 	}
+}
 
-	fprintf(log_fp, "%s", msg);
+/* Write out \c n records; the caller holds log_flush_lock */
+static void log_rec_write(struct ldmsd_log_rec **rec, int n)
+{
+	static struct iovec iov[3 * LDMSD_LOG_BATCH];
+	static char tbuf[LDMSD_LOG_BATCH][64];
+	int i, cnt;
 
+	if (log_fp == LDMSD_LOG_SYSLOG) {
+		for (i = 0; i < n; i++) {
+			syslog(ldmsd_loglevel_to_syslog(rec[i]->level), "%s",
+			       rec[i]->ext ? rec[i]->ext : rec[i]->msg);
+		}
+		return;
+	}
+	for (i = cnt = 0; i < n; i++) {
+		iov[cnt].iov_base = tbuf[i];
+		iov[cnt++].iov_len = log_rec_time(rec[i], tbuf[i], sizeof(tbuf[i]));
+		if (rec[i]->level >= 0 && rec[i]->level < LDMSD_LALL) {
+			iov[cnt].iov_base = log_level_pfx[rec[i]->level];
+			iov[cnt++].iov_len = strlen(log_level_pfx[rec[i]->level]);
+		}
+		iov[cnt].iov_base = rec[i]->ext ? rec[i]->ext : rec[i]->msg;
+		iov[cnt++].iov_len = rec[i]->len;
+	}
+	/* stdio users of the log file are written first */
+	fflush(log_fp);
+	log_writev(fileno(log_fp), iov, cnt);
+}
+
+static int __log_flush(int wait)
+{
+	static struct ldmsd_log_rec *batch[LDMSD_LOG_BATCH];
+	static struct ldmsd_log_rec drop_rec;
+	struct ldmsd_log_ring *r, *min, *next;
+	struct ldmsd_log_rec *rec;
+	uint64_t dropped;
+	int n;
+
+	if (wait)
+		pthread_mutex_lock(&log_flush_lock);
+	else if (pthread_mutex_trylock(&log_flush_lock))
+		return EBUSY;
+	pthread_once(&log_ring_once, log_ring_init);
+	pthread_mutex_lock(&log_ring_lock);
+	dropped = __atomic_exchange_n(&log_lost, 0, __ATOMIC_SEQ_CST);
+	LIST_FOREACH(r, &log_ring_list, entry) {
+		dropped += __atomic_exchange_n(&r->dropped, 0, __ATOMIC_SEQ_CST);
+		r->c_tail = r->tail;
+	}
+	n = 0;
+	if (dropped) {
+		clock_gettime(CLOCK_REALTIME, &drop_rec.ts);
+		drop_rec.level = LDMSD_LWARNING;
+		drop_rec.ext = NULL;
+		drop_rec.len = snprintf(drop_rec.msg, sizeof(drop_rec.msg),
+				"%" PRIu64 " log messages were dropped\n", dropped);
+		batch[n++] = &drop_rec;
+	}
+ again:
+	LIST_FOREACH(r, &log_ring_list, entry)
+		r->c_head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	while (n < LDMSD_LOG_BATCH) {
+		/* the oldest record at the tails of the rings */
+		min = NULL;
+		LIST_FOREACH(r, &log_ring_list, entry) {
+			if (r->c_tail == r->c_head)
+				continue;
+			if (!min) {
+				min = r;
+				continue;
+			}
+			rec = &r->rec[r->c_tail & r->mask];
+			if (timespec_lt(&rec->ts, &min->rec[min->c_tail & min->mask].ts))
+				min = r;
+		}
+		if (!min)
+			break;
+		batch[n++] = &min->rec[min->c_tail & min->mask];
+		min->c_tail++;
+	}
+	if (n)
+		log_rec_write(batch, n);
+	LIST_FOREACH(r, &log_ring_list, entry) {
+		for (; r->tail != r->c_tail; r->tail++) {
+			rec = &r->rec[r->tail & r->mask];
+			free(rec->ext);
+			rec->ext = NULL;
+		}
+		__atomic_store_n(&r->tail, r->c_tail, __ATOMIC_RELEASE);
+	}
+	if (n == LDMSD_LOG_BATCH) {
+		n = 0;
+		goto again;
+	}
+	/* free the empty rings of the threads that have exited */
+	r = LIST_FIRST(&log_ring_list);
+	while (r) {
+		next = LIST_NEXT(r, entry);
+		if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) &&
+		    r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+			LIST_REMOVE(r, entry);
+			free(r);
+		}
+		r = next;
+	}
+	pthread_mutex_unlock(&log_ring_lock);
+	pthread_mutex_unlock(&log_flush_lock);
 	return 0;
 }
 
+void ldmsd_log_flush()
+{
+	(void)__log_flush(1);
+}
+
 int log_actor(ev_worker_t src, ev_worker_t dst, ev_status_t status, ev_t ev)
 {
-	enum ldmsd_loglevel level = EV_DATA(ev, struct log_data)->level;
-	char *msg = EV_DATA(ev, struct log_data)->msg;
-	uint8_t is_rotate = EV_DATA(ev, struct log_data)->is_rotate;
-	struct timeval *tv = &EV_DATA(ev, struct log_data)->tv;
-	struct tm *tm = &EV_DATA(ev, struct log_data)->tm;
-	int rc;
+	int rc = 0;
 
-	if (is_rotate) {
+	ldmsd_log_flush();
+	if (ev != log_flush_ev) {
+		/* a logrotate request */
 		rc = __logrotate();
-	} else {
-		rc = __log(level, msg, tv, tm);
-		if (0 == ev_pending(logger_w))
-			fflush(log_fp);
-		free(msg);
+		ev_put(ev);
 	}
-	ev_put(ev);
 	return rc;
 }
 
 void __ldmsd_log(enum ldmsd_loglevel level, const char *fmt, va_list ap)
 {
-	ev_t log_ev;
-	char *msg;
-	int rc;
-	struct timeval tv;
-	struct tm tm;
-	time_t t;
+	struct ldmsd_log_ring *r;
+	struct ldmsd_log_rec rec;
+	uint64_t head;
 
 	if ((level != LDMSD_LALL) &&
 			(quiet || ((0 <= level) && (level < log_level_thr))))
@@ -353,36 +604,40 @@ void __ldmsd_log(enum ldmsd_loglevel level, const char *fmt, va_list ap)
 		else
 			log_time_sec = 0;
 	}
-	if (log_time_sec) {
-		gettimeofday(&tv, NULL);
-
-	} else {
-		t = time(NULL);
-		localtime_r(&t, &tm);
-	}
-
-	rc = vasprintf(&msg, fmt, ap);
-	if (rc < 0)
-		return;
 
 	if (!ldmsd_is_initialized()) {
 		/* No workers, so directly log to the file */
-		(void) __log(level, msg, &tv, &tm);
+		struct ldmsd_log_rec *recp = &rec;
+		log_rec_fill(&rec, level, fmt, ap);
+		pthread_once(&log_ring_once, log_ring_init);
+		pthread_mutex_lock(&log_flush_lock);
+		log_rec_write(&recp, 1);
+		pthread_mutex_unlock(&log_flush_lock);
+		free(rec.ext);
 		return;
 	}
 
-	log_ev = ev_new(log_type);
-	if (!log_ev)
+	r = log_ring_get();
+	if (!r) {
+		__atomic_add_fetch(&log_lost, 1, __ATOMIC_SEQ_CST);
 		return;
-	EV_DATA(log_ev, struct log_data)->msg = msg;
-	EV_DATA(log_ev, struct log_data)->level = level;
-	EV_DATA(log_ev, struct log_data)->is_rotate = 0;
-
-	if (log_time_sec)
-		EV_DATA(log_ev, struct log_data)->tv = tv;
-	else
-		EV_DATA(log_ev, struct log_data)->tm = tm;
-	ev_post(NULL, logger_w, log_ev, NULL);
+	}
+	if (r->busy) {
+		/* a signal handler interrupted this thread's logging */
+		__atomic_add_fetch(&r->dropped, 1, __ATOMIC_SEQ_CST);
+		return;
+	}
+	r->busy = 1;
+	head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask) {
+		__atomic_add_fetch(&r->dropped, 1, __ATOMIC_SEQ_CST);
+	} else {
+		log_rec_fill(&r->rec[head & r->mask], level, fmt, ap);
+		__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	}
+	r->busy = 0;
+	/* EBUSY if the logger has yet to run */
+	(void)ev_post(NULL, logger_w, log_flush_ev, NULL);
 }
 
 void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
@@ -526,6 +781,8 @@ void cleanup(int x, const char *reason)
 	av_free(auth_opt);
 	auth_opt = NULL;
 	cleaned = 1;
+	/* cleanup() may interrupt the logger in a signal handler */
+	(void)__log_flush(0);
 	pthread_mutex_unlock(&cleanup_lock);
 	exit(x);
 }
@@ -581,7 +838,6 @@ int ldmsd_logrotate() {
 	if (!ev)
 		return ENOMEM;
 	EV_DATA(ev, struct log_data)->is_rotate = 1;
-	EV_DATA(ev, struct log_data)->msg = NULL;
 	ev_post(NULL, logger_w, ev, NULL);
 	return 0;
 }
@@ -640,6 +896,9 @@ void usage_hint(char *argv[],char *hint)
 	       "                                                  [" LDMSD_SETFILE "]\n");
 	printf("  Thread Options\n");
 	printf("    -P COUNT,     --worker_threads COUNT          Count of event threads to start.\n");
+	printf("    -S COUNT,     --store_threads COUNT           Count of store threads to start [%d].\n"
+	       "                                                  With 0, updates are stored on the transport thread.\n",
+	                                                          STORE_THREAD_COUNT_DEFAULT);
 	printf("  Configuration Options\n");
 	printf("    -c PATH                                       The path to configuration file (optional, default: <none>).\n");
 	printf("    -V                                            Print LDMS version and exit.\n");
@@ -657,6 +916,7 @@ void usage(char *argv[]) {
 
 #define EVTH_MAX 1024
 int ev_thread_count = 0;
+int store_thread_count = -1;
 ovis_scheduler_t *ovis_scheduler;
 pthread_t *ev_thread;		/* sampler threads */
 int *ev_count;			/* number of hosts/samplers assigned to each thread */
@@ -797,9 +1057,12 @@ static void stop_sampler(struct ldmsd_plugin_cfg *pi)
 void plugin_sampler_cb(ovis_event_t oev)
 {
 	struct ldmsd_plugin_cfg *pi = oev->param.ctxt;
+	struct timespec start;
 	pthread_mutex_lock(&pi->lock);
 	assert(pi->plugin->type == LDMSD_PLUGIN_SAMPLER);
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	int rc = pi->sampler->sample(pi->sampler);
+	ldmsd_hist_record_since(&pi->sample_hist, &start);
 	if (rc) {
 		/*
 		 * If the sampler reports an error don't reschedule
@@ -1423,10 +1686,13 @@ void oneshot_sample_cb(ovis_event_t ev)
 {
 	struct oneshot *os = ev->param.ctxt;
 	struct ldmsd_plugin_cfg *pi = os->pi;
+	struct timespec start;
 	ovis_scheduler_event_del(os->os, ev);
 	pthread_mutex_lock(&pi->lock);
 	assert(pi->plugin->type == LDMSD_PLUGIN_SAMPLER);
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	pi->sampler->sample(pi->sampler);
+	ldmsd_hist_record_since(&pi->sample_hist, &start);
 	pi->ref_count--;
 	release_ovis_scheduler(pi->thread_id);
 	free(os);
@@ -1924,6 +2190,19 @@ int ldmsd_process_cmd_line_arg(char opt, char *value)
 				ev_thread_count = EVTH_MAX;
 		}
 		break;
+	case 'S':
+		if (check_arg("S", value, LO_UINT))
+			return EINVAL;
+		if (store_thread_count >= 0) {
+			ldmsd_log(LDMSD_LERROR, "LDMSD number of store threads "
+					"was already set to %d. Ignore the new value %s\n",
+					store_thread_count, value);
+		} else {
+			store_thread_count = atoi(value);
+			if (store_thread_count > EVTH_MAX)
+				store_thread_count = EVTH_MAX;
+		}
+		break;
 	case 'm':
 		if (max_mem_sz_str) {
 			ldmsd_log(LDMSD_LERROR, "The memory limit was already "
@@ -2201,6 +2480,8 @@ int main(int argc, char *argv[])
 		banner = DEFAULT_BANNER;
 	if (0 == ev_thread_count)
 		ev_thread_count = 1;
+	if (store_thread_count < 0)
+		store_thread_count = STORE_THREAD_COUNT_DEFAULT;
 	if (!max_mem_sz_str) {
 		max_mem_sz_str = getenv(LDMSD_MEM_SIZE_ENV);
 		if (!max_mem_sz_str)
@@ -2211,6 +2492,16 @@ int main(int argc, char *argv[])
 				"See the -m option.\n", max_mem_sz_str);
 		usage(argv);
 	}
+	/*
+	 * A shm peer reads our sets through our heap; back the heap with a
+	 * memfd it can map, unless MMALLOC_SHARED says otherwise.
+	 */
+	ldmsd_listen_t listen;
+	for (listen = (ldmsd_listen_t)ldmsd_cfgobj_first(LDMSD_CFGOBJ_LISTEN);
+		listen; listen = (ldmsd_listen_t)ldmsd_cfgobj_next(&listen->obj)) {
+		if (0 == strcmp(listen->xprt, "shm"))
+			setenv("MMALLOC_SHARED", "1", 0);
+	}
 	if (ldms_init(max_mem_size)) {
 		ldmsd_log(LDMSD_LCRITICAL, "LDMS could not pre-allocate "
 				"the memory of size %s.\n", max_mem_sz_str);
@@ -2328,6 +2619,13 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	ret = ldmsd_store_workers_start(store_thread_count);
+	if (ret) {
+		ldmsd_log(LDMSD_LERROR, "Error %d creating the store "
+				"threads.\n", ret);
+		cleanup(7, "store thread create fail");
+	}
+
 	if (!setfile)
 		setfile = LDMSD_SETFILE;
 
@@ -2340,7 +2638,6 @@ int main(int argc, char *argv[])
 	is_ldmsd_initialized = 1;
 
 	/* Start listening on ports */
-	ldmsd_listen_t listen;
 	for (listen = (ldmsd_listen_t)ldmsd_cfgobj_first(LDMSD_CFGOBJ_LISTEN);
 		listen; listen = (ldmsd_listen_t)ldmsd_cfgobj_next(&listen->obj)) {
 		ret = ldmsd_listen_start(listen);
@@ -189,6 +189,32 @@ typedef struct ldmsd_cfgobj {
 	int perm;
 } *ldmsd_cfgobj_t;
 
+/**
+ * Log-linear latency histogram (ldmsd_hist.c)
+ *
+ * Values below 2 * LDMSD_HIST_SUB have their own bucket. Above that,
+ * each power of two is split into LDMSD_HIST_SUB equal buckets, so a
+ * quantile is reported within 1/LDMSD_HIST_SUB (6.25%) of its value.
+ * Values with more than LDMSD_HIST_MAX_MSB + 1 bits go to the last
+ * bucket. Recording is a few atomic adds and takes no lock.
+ *
+ * A histogram is about 4.7kB, so the objects hold a pointer that stays
+ * NULL until the first value is recorded. Producers, updaters, storage
+ * policies and samplers that never see a latency do not pay for one.
+ */
+#define LDMSD_HIST_SUB_BITS	4
+#define LDMSD_HIST_SUB		(1 << LDMSD_HIST_SUB_BITS)
+#define LDMSD_HIST_MAX_MSB	39	/* 2^40 us is about 12 days */
+#define LDMSD_HIST_LEN \
+	((LDMSD_HIST_MAX_MSB - LDMSD_HIST_SUB_BITS + 2) * LDMSD_HIST_SUB)
+
+typedef struct ldmsd_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[LDMSD_HIST_LEN];
+} *ldmsd_hist_t;
+
 typedef struct ldmsd_prdcr_stream_s {
 	const char *name;
 	LIST_ENTRY(ldmsd_prdcr_stream_s) entry;
@@ -209,6 +235,8 @@ typedef struct ldmsd_prdcr {
 	char *xprt_name;	/* Transport name */
 	ldms_t xprt;
 	long conn_intrvl_us;	/* connect interval */
+	int conn_fails;		/* connect attempts since the last connect */
+	int resolving;		/* waiting for ldmsd_resolve() */
 	char *conn_auth;			/* auth method for the connection */
 	struct attr_value_list *conn_auth_args;  /* auth options of the connection auth */
 
@@ -254,6 +282,10 @@ typedef struct ldmsd_prdcr {
 	 * quick lookup by the logic that handles update schedule.
 	 */
 	struct rbt hint_set_tree;
+	/** Update request to completion of the producer's sets (us) */
+	ldmsd_hist_t update_hist;
+	/** Update completion to store completion of the producer's sets (us) */
+	ldmsd_hist_t store_hist;
 #ifdef LDMSD_UPDATE_TIME
 	double sched_update_time;
 #endif /* LDMSD_UPDATE_TIME */
@@ -316,6 +348,19 @@ typedef struct ldmsd_prdcr_set {
 
 	int ref_count;
 	struct timespec lookup_complete_ts;
+
+	/* The updater of the outstanding pull update (a reference is held) */
+	ldmsd_updtr_ptr updt_updtr;
+	/* Adaptive update scheduling state (auto_interval=adaptive) */
+	struct ldmsd_updt_adapt {
+		int64_t next_us;   /* the next pull is due at this time */
+		int64_t ts_us;     /* transaction timestamp of the last sample */
+		long period_us;    /* learned sample period */
+		long guard_us;     /* slack added after the expected sample */
+		long rtt_us;       /* update round-trip time (moving average) */
+		long spread_us;    /* per-set delay spreading the pulls */
+		int retries;       /* pulls since the last new sample */
+	} adapt;
 } *ldmsd_prdcr_set_t;
 
 #ifdef LDMSD_UPDATE_TIME
@@ -350,6 +395,13 @@ struct ldmsd_updt_time {
 #define LDMSD_UPDTR_F_PUSH_CHANGE	2
 #define LDMSD_UPDTR_OFFSET_INCR_DEFAULT	100000
 #define LDMSD_UPDTR_OFFSET_INCR_VAR	"LDMSD_UPDTR_OFFSET_INCR"
+/* The scheduling tick of an adaptive updater is interval / ticks */
+#define LDMSD_UPDTR_ADAPTIVE_TICKS_DEFAULT	20
+#define LDMSD_UPDTR_ADAPTIVE_TICKS_VAR	"LDMSD_UPDTR_ADAPTIVE_TICKS"
+
+/* Values of the `is_auto_task` argument of ldmsd_updtr_new_with_auth() */
+#define LDMSD_UPDTR_AUTO_INTERVAL	1 /* follow the set update hints */
+#define LDMSD_UPDTR_ADAPTIVE		2 /* learn the set sample times */
 
 struct ldmsd_updtr;
 typedef struct ldmsd_updtr_task {
@@ -392,6 +444,38 @@ typedef struct ldmsd_updtr {
 	 */
 	uint8_t is_auto_task;
 
+	/*
+	 * Adaptive scheduling. The default task ticks several times per
+	 * interval, and each set is pulled only when its next sample is
+	 * expected to be complete, as learned from the set transaction
+	 * timestamps and the update round-trip time.
+	 */
+	uint8_t is_adaptive;
+
+	/*
+	 * Delta updates. Each set update reads only the data ranges the
+	 * producer marked modified, see ldms_set_delta_update_set().
+	 */
+	uint8_t is_delta;
+
+	/*
+	 * Lateness of the pulled samples: the time from the transaction
+	 * timestamp of a new sample to the completion of the update that
+	 * brought it in.
+	 */
+	struct ldmsd_updtr_lateness {
+		pthread_mutex_t lock;
+		uint64_t count;       /* updates with a new sample */
+		uint64_t sum_us;
+		uint64_t min_us;
+		uint64_t max_us;
+		uint64_t oversampled; /* updates without a new sample */
+		uint64_t missed;      /* samples skipped between updates */
+	} lateness;
+
+	/** Update request to update completion of the updater's sets (us) */
+	ldmsd_hist_t update_hist;
+
 	/* The default schedule specified from configuration */
 	struct ldmsd_updtr_task default_task;
 	/*
@@ -444,7 +528,29 @@ typedef struct ldmsd_strgp_metric {
 
 typedef struct ldmsd_row_s *ldmsd_row_t;
 typedef struct ldmsd_row_list_s *ldmsd_row_list_t;
-typedef void (*strgp_update_fn_t)(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set);
+typedef void (*strgp_update_fn_t)(ldmsd_strgp_t strgp, ldms_set_t set);
+
+/** A producer set update waiting in a storage policy queue */
+typedef struct ldmsd_strgp_qent {
+	ldmsd_prdcr_set_t prd_set;	/* holds a prd_set reference */
+	ldms_set_t snap;		/* the data to store, see ldms_set_snapshot() */
+	uint64_t gn;			/* data generation of snap */
+	ldmsd_prdcr_t prdcr;		/* holds a prdcr reference */
+	struct timespec ready;		/* when the update completed (CLOCK_MONOTONIC) */
+	struct rbn rbn;			/* coalesce tree node, keyed by prd_set */
+	TAILQ_ENTRY(ldmsd_strgp_qent) entry;
+} *ldmsd_strgp_qent_t;
+
+typedef enum ldmsd_strgp_qpolicy {
+	/** Keep at most one pending update per producer set */
+	LDMSD_STRGP_QPOLICY_COALESCE,
+	/** Queue every update, drop the new one when the queue is full */
+	LDMSD_STRGP_QPOLICY_DROP,
+} ldmsd_strgp_qpolicy_t;
+
+#define LDMSD_STRGP_QDEPTH_DEFAULT 1024
+
+struct ldmsd_store_worker;
 struct ldmsd_strgp {
 	struct ldmsd_cfgobj obj;
 
@@ -486,6 +592,34 @@ struct ldmsd_strgp {
 	/** Decomposer resource handle */
 	struct ldmsd_decomp_s *decomp;
 	char *decomp_name;
+
+	/**
+	 * Store queue. Updates are handed to a store worker thread instead
+	 * of being stored on the transport thread that completed them. The
+	 * queue has its own lock so that enqueueing never waits for a store
+	 * in progress, which holds the strgp lock.
+	 */
+	struct ldmsd_strgp_queue {
+		pthread_mutex_t lock;
+		int running;		/* accepting updates */
+		int scheduled;		/* on the worker's strgp list */
+		int max_depth;		/* 0 stores inline */
+		ldmsd_strgp_qpolicy_t policy;
+		int depth;
+		int depth_hwm;		/* high-water mark of depth */
+		TAILQ_HEAD(ldmsd_strgp_qlist, ldmsd_strgp_qent) head;
+		struct ldmsd_strgp_qlist free;
+		struct rbt tree;	/* pending entries by prd_set */
+		struct ldmsd_store_worker *worker;
+		TAILQ_ENTRY(ldmsd_strgp) worker_entry;
+		uint64_t enqueued;
+		uint64_t stored;
+		uint64_t coalesced;
+		uint64_t dropped;
+	} q;
+
+	/** Update completion to store completion (us) */
+	ldmsd_hist_t store_hist;
 };
 
 
@@ -645,6 +779,113 @@ int ldmsd_row_to_json_array(ldmsd_row_t row, char **str, int *len);
  */
 int ldmsd_row_to_json_object(ldmsd_row_t row, char **str, int *len);
 
+/**
+ * Row serialization formats.
+ */
+typedef enum ldmsd_row_fmt {
+	LDMSD_ROW_FMT_JSON_ARRAY,  /* [ COL_1_VAL, ..., COL_N_VAL ] */
+	LDMSD_ROW_FMT_JSON_OBJECT, /* { "COL_1_NAME":COL_1_VAL, ... } */
+	LDMSD_ROW_FMT_CSV,         /* COL_1_VAL,...,COL_N_VAL\n */
+	LDMSD_ROW_FMT_INFLUX,      /* InfluxDB line protocol */
+} ldmsd_row_fmt_t;
+
+typedef struct ldmsd_row_serializer_s *ldmsd_row_serializer_t;
+
+/**
+ * Create a row serializer.
+ *
+ * A serializer appends rows to an output buffer that is reused after
+ * ldmsd_row_serializer_reset(), and caches the column keys of each row
+ * schema (by \c row->schema_digest). It is not thread-safe; a store
+ * typically keeps one per store handle.
+ *
+ * In \c LDMSD_ROW_FMT_CSV and \c LDMSD_ROW_FMT_INFLUX, each row is
+ * terminated by a newline and array elements are expanded (CSV columns, or
+ * \c NAME.<i> Influx fields). In \c LDMSD_ROW_FMT_INFLUX, the row schema
+ * name is the measurement, the first timestamp column is the line timestamp
+ * (in nanoseconds), the other columns are fields, and integer fields carry
+ * the \c i (signed) or \c u (unsigned) suffix.
+ *
+ * \param fmt The output format.
+ *
+ * \retval s    The serializer handle.
+ * \retval NULL If there is an error. \c errno is set to describe the error.
+ */
+ldmsd_row_serializer_t ldmsd_row_serializer_new(ldmsd_row_fmt_t fmt);
+
+/**
+ * Free the serializer and its buffer.
+ */
+void ldmsd_row_serializer_free(ldmsd_row_serializer_t s);
+
+/**
+ * Empty the output buffer of the serializer.
+ */
+void ldmsd_row_serializer_reset(ldmsd_row_serializer_t s);
+
+/**
+ * Append \c row to the output buffer.
+ *
+ * \retval 0      If succeeded.
+ * \retval EINVAL If a column type cannot be serialized.
+ * \retval ENOMEM If the buffer cannot grow. The partial row is dropped.
+ */
+int ldmsd_row_serialize(ldmsd_row_serializer_t s, ldmsd_row_t row);
+
+/**
+ * Append the CSV header (column names) of \c row to the output buffer.
+ *
+ * This is a no-op for the formats other than \c LDMSD_ROW_FMT_CSV.
+ */
+int ldmsd_row_serialize_header(ldmsd_row_serializer_t s, ldmsd_row_t row);
+
+/**
+ * The output buffer of the serializer.
+ *
+ * The string remains valid until the next call on \c s.
+ *
+ * \param      s   The serializer handle.
+ * \param [out] len The strlen() of the output. Can be NULL.
+ */
+const char *ldmsd_row_serializer_str(ldmsd_row_serializer_t s, int *len);
+
+/** The most bytes written by ldmsd_fmt_u64() and ldmsd_fmt_s64() */
+#define LDMSD_FMT_INT_MAX 20
+
+/**
+ * Format \c v in decimal at \c p, without a terminating '\\0'.
+ *
+ * These are the integer formatters of the row serializers, for the stores
+ * that format their own output. \c p must have room for
+ * \c LDMSD_FMT_INT_MAX bytes.
+ *
+ * \retval p The end of the output.
+ */
+char *ldmsd_fmt_u64(char *p, uint64_t v);
+char *ldmsd_fmt_s64(char *p, int64_t v);
+
+/**
+ * Format the \c n lowest decimal digits of \c v at \c p, zero padded.
+ *
+ * \retval p The end of the output, \c p + \c n.
+ */
+char *ldmsd_fmt_u64_pad(char *p, uint64_t v, int n);
+
+/** The most bytes written by ldmsd_fmt_real() */
+#define LDMSD_FMT_REAL_MAX 32
+
+/**
+ * Format \c v like printf("%.<prec>g") does, without a terminating '\\0':
+ * \c prec significant digits, trailing zeros removed, exponent notation
+ * when the exponent is less than -4 or not less than \c prec. NaN is
+ * "nan" whatever its sign.
+ *
+ * \param prec At most 17.
+ *
+ * \retval p The end of the output.
+ */
+char *ldmsd_fmt_real(char *p, double v, int prec);
+
 /**
  * Configure strgp decomposer.
  *
@@ -739,6 +980,7 @@ struct ldmsd_plugin_cfg {
 	pthread_mutex_t lock;
 	ovis_scheduler_t os;
 	struct ovis_event_s oev;
+	ldmsd_hist_t sample_hist;	/* duration of sample() (us) */
 	LIST_ENTRY(ldmsd_plugin_cfg) entry;
 };
 LIST_HEAD(plugin_list, ldmsd_plugin_cfg);
@@ -947,6 +1189,11 @@ extern ldmsctl_cmd_fn_t cmd_table[LDMSCTL_LAST_COMMAND + 1];
 
 #define ldmsd_msg_logger ldmsd_log /* ldmsd_msg_logger is deprecated */
 int ldmsd_logrotate();
+/** Write out the log messages of all threads */
+void ldmsd_log_flush();
+/* Log records in each thread's log ring */
+#define LDMSD_LOG_RING_LEN_DEFAULT	1024
+#define LDMSD_LOG_RING_LEN_VAR		"LDMSD_LOG_RING_LEN"
 int ldmsd_plugins_usage(const char *plugin_name);
 void ldmsd_mm_status(enum ldmsd_loglevel level, const char *prefix);
 
@@ -1055,6 +1302,106 @@ int ldmsd_prdcr_unsubscribe_regex(const char *prdcr_regex, char *stream_name,
 				ldmsd_sec_ctxt_t ctxt);
 
 int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt);
+
+/*
+ * Active producers connect at most LDMSD_PRDCR_CONNECT_RATE times per second
+ * in total (0 is unlimited). After a failed attempt, a producer waits
+ * conn_intrvl_us times 1, 2, 4, ... up to LDMSD_PRDCR_BACKOFF_MAX, jittered
+ * by +/- 50%, before the next attempt.
+ */
+#define LDMSD_PRDCR_CONNECT_RATE_DEFAULT	1000
+#define LDMSD_PRDCR_CONNECT_RATE_VAR	"LDMSD_PRDCR_CONNECT_RATE"
+#define LDMSD_PRDCR_BACKOFF_MAX_DEFAULT	8
+#define LDMSD_PRDCR_BACKOFF_MAX_VAR	"LDMSD_PRDCR_BACKOFF_MAX"
+
+/** Cached host name resolution (ldmsd_resolve.c) */
+#define LDMSD_RESOLVE_TTL_DEFAULT	300	/* seconds */
+#define LDMSD_RESOLVE_TTL_VAR		"LDMSD_RESOLVE_TTL"
+#define LDMSD_RESOLVE_NEG_TTL_DEFAULT	30	/* seconds */
+#define LDMSD_RESOLVE_NEG_TTL_VAR	"LDMSD_RESOLVE_NEG_TTL"
+#define LDMSD_RESOLVE_THREADS_DEFAULT	2
+#define LDMSD_RESOLVE_THREADS_VAR	"LDMSD_RESOLVE_THREADS"
+
+/**
+ * \brief Called from a resolver thread when a name is resolved.
+ *
+ * \param rc  0 if the name resolved, or an errno. Call ldmsd_resolve()
+ *            again to get the address.
+ */
+typedef void (*ldmsd_resolve_cb_t)(int rc, void *arg);
+
+/**
+ * \brief Resolve \c host without blocking.
+ *
+ * \param family AF_INET, AF_INET6 or AF_UNSPEC.
+ * \param idx    Selects one of the addresses of a multi-homed host
+ *               (modulo the number of addresses).
+ *
+ * \retval 0           \c ss and \c ss_len are set from the cache.
+ * \retval EINPROGRESS \c cb will be called when the name is resolved.
+ * \retval errno       The cached resolution error.
+ */
+int ldmsd_resolve(const char *host, int family, unsigned short port, int idx,
+		  struct sockaddr_storage *ss, socklen_t *ss_len,
+		  ldmsd_resolve_cb_t cb, void *arg);
+
+/**
+ * \brief Like ldmsd_resolve(), but resolve a cache miss on the calling thread.
+ */
+int ldmsd_resolve_sync(const char *host, int family, unsigned short port,
+		       int idx, struct sockaddr_storage *ss, socklen_t *ss_len);
+
+/** A snapshot of the statistics of a histogram */
+struct ldmsd_hist_summary {
+	uint64_t count;
+	uint64_t mean;
+	uint64_t min;
+	uint64_t max;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+};
+
+/**
+ * \brief Record \c v in the histogram \c *hp.
+ *
+ * The histogram is allocated on the first call if \c *hp is NULL; the
+ * value is dropped if that fails. This may be called concurrently from
+ * any number of threads.
+ */
+void ldmsd_hist_record(ldmsd_hist_t *hp, uint64_t v);
+
+/**
+ * \brief Record the time from \c start to now in microseconds.
+ *
+ * \c start must have been taken with CLOCK_MONOTONIC.
+ */
+void ldmsd_hist_record_since(ldmsd_hist_t *hp, struct timespec *start);
+
+/**
+ * \brief Return the value at quantile \c q (0.0 to 1.0).
+ *
+ * The value is the upper bound of the bucket holding the quantile, capped
+ * at the largest value recorded. 0 is returned if the histogram is empty
+ * or \c h is NULL.
+ */
+uint64_t ldmsd_hist_value_at(ldmsd_hist_t h, double q);
+
+/**
+ * \brief Fill \c sum with the statistics of \c h; all zero if \c h is NULL.
+ */
+void ldmsd_hist_summary(ldmsd_hist_t h, struct ldmsd_hist_summary *sum);
+
+/**
+ * \brief Clear the histogram.
+ *
+ * Values recorded while the histogram is being cleared may be partly lost.
+ * The memory is kept; use ldmsd_hist_free() when the owner is destroyed.
+ */
+void ldmsd_hist_reset(ldmsd_hist_t h);
+
+void ldmsd_hist_free(ldmsd_hist_t h);
 int __ldmsd_prdcr_stop(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt);
 
 /* updtr */
@@ -1155,6 +1502,32 @@ int ldmsd_strgp_start(const char *name, ldmsd_sec_ctxt_t ctxt);
 
 int __ldmsd_strgp_start(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt);
 int __ldmsd_strgp_stop(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt);
+static inline const char *ldmsd_strgp_qpolicy_str(ldmsd_strgp_qpolicy_t policy) {
+	switch (policy) {
+	case LDMSD_STRGP_QPOLICY_COALESCE:
+		return "coalesce";
+	case LDMSD_STRGP_QPOLICY_DROP:
+		return "drop";
+	}
+	return "BAD POLICY";
+}
+int ldmsd_strgp_qpolicy_from_str(const char *str, ldmsd_strgp_qpolicy_t *policy);
+
+/**
+ * \brief Start the store worker threads
+ *
+ * \param count The number of store workers. If it is 0, storage policies
+ *              store on the thread that completes the update.
+ */
+int ldmsd_store_workers_start(int count);
+
+/**
+ * \brief Hand a completed producer set update to the storage policy
+ *
+ * The update is queued for the strgp's store worker, or stored inline if
+ * the strgp has no queue. Called with the producer set lock held.
+ */
+void ldmsd_strgp_enqueue(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set);
 
 
 /* Function to update inter-dependent configuration objects */
@@ -207,6 +207,7 @@ void destroy_plugin(struct ldmsd_plugin_cfg *p)
 	free(p->name);
 	LIST_REMOVE(p, entry);
 	dlclose(p->handle);
+	ldmsd_hist_free(p->sample_hist);
 	free(p);
 }
 
@@ -1042,6 +1043,16 @@ int listen_on_ldms_xprt(ldmsd_listen_t listen)
 		  "`%s` authentication\n",
 		  listen->xprt, listen->port_no, listen->xprt,
 		  listen->auth_name);
+	if (0 == strcmp(listen->xprt, "shm")) {
+		/* shm peers read the sets only through our shared heap */
+		struct mm_info mmi;
+		mm_peek_info(&mmi);
+		if (mmi.fd < 0)
+			ldmsd_log(LDMSD_LWARNING, "The set memory is not "
+				  "shared, peers on shm:%d cannot update sets. "
+				  "Start ldmsd with MMALLOC_SHARED=1.\n",
+				  listen->port_no);
+	}
 	return 0;
 }
 
@@ -56,7 +56,6 @@
 #include <dlfcn.h>
 #include <assert.h>
 #include <errno.h>
-#include <stdarg.h>
 
 #include <openssl/sha.h>
 
@@ -297,442 +296,3 @@ int ldmsd_decomp_config(ldmsd_strgp_t strgp, const char *json_path, ldmsd_req_ct
  err_0:
 	return rc;
 }
-
-typedef struct strbuf_s {
-	TAILQ_ENTRY(strbuf_s) entry;
-	int off; /* current write offset */
-	int remain; /* remaining bytes */
-	char buf[];
-} *strbuf_t;
-TAILQ_HEAD(strbuf_tailq_s, strbuf_s);
-typedef struct strbuf_tailq_s *strbuf_tailq_t;
-
-void strbuf_purge(strbuf_tailq_t h)
-{
-	strbuf_t b;
-	while ((b = TAILQ_FIRST(h))) {
-		TAILQ_REMOVE(h, b, entry);
-		free(b);
-	}
-}
-
-__attribute__(( format(printf, 2, 3) ))
-int strbuf_printf(strbuf_tailq_t h, const char *fmt, ...)
-{
-	va_list ap;
-	int len;
-	strbuf_t b = TAILQ_LAST(h, strbuf_tailq_s);
-
-	if (b)
-		goto print;
-
-	/* no buffer, allocate one */
-	len = BUFSIZ;
-
- alloc:
-	len = (len + BUFSIZ - 1) & ~(BUFSIZ-1);
-	b = malloc(sizeof(*b) + len);
-	if (!b)
-		return ENOMEM;
-	b->remain = len;
-	b->off = 0;
-	TAILQ_INSERT_TAIL(h, b, entry);
-
- print:
-	va_start(ap, fmt);
-	len = vsnprintf(b->buf + b->off, b->remain, fmt, ap);
-	va_end(ap);
-	if (len >= b->remain) {
-		b->buf[b->off] = '\0'; /* recover */
-		goto alloc;
-	}
-	b->remain -= len;
-	b->off += len;
-	return 0;
-}
-
-static int strbuf_str(strbuf_tailq_t h, char **out_str, int *out_len)
-{
-	int len = 0, off = 0;
-	char *str;
-	strbuf_t b;
-	TAILQ_FOREACH(b, h, entry) {
-		len += b->off;
-	}
-	str = malloc(len + 1);
-	if (!str)
-		return ENOMEM;
-	TAILQ_FOREACH(b, h, entry) {
-		memcpy(str + off, b->buf, b->off);
-		off += b->off;
-	}
-	str[len] = '\0';
-	*out_str = str;
-	*out_len = len;
-	return 0;
-}
-
-static int strbuf_printcol_s8(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%hhd", col->mval->v_s8);
-}
-
-static int strbuf_printcol_u8(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%hhu", col->mval->v_u8);
-}
-
-static int strbuf_printcol_s16(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%hd", col->mval->v_s16);
-}
-
-static int strbuf_printcol_u16(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%hu", col->mval->v_u16);
-}
-
-static int strbuf_printcol_s32(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%d", col->mval->v_s32);
-}
-
-static int strbuf_printcol_u32(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%u", col->mval->v_u32);
-}
-
-static int strbuf_printcol_s64(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%ld", col->mval->v_s64);
-}
-
-static int strbuf_printcol_u64(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%lu", col->mval->v_u64);
-}
-
-static int strbuf_printcol_f(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%.9g", col->mval->v_f);
-}
-
-static int strbuf_printcol_d(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "%.17g", col->mval->v_d);
-}
-
-static int strbuf_printcol_char(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "\"%c\"", col->mval->v_char);
-}
-
-static int strbuf_printcol_str(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	return strbuf_printf(h, "\"%s\"", col->mval->a_char);
-}
-
-static int strbuf_printcol_ts(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	/* print TS as float */
-	return strbuf_printf(h, "%u.%06u", col->mval->v_ts.sec,
-					   col->mval->v_ts.usec);
-}
-
-static int strbuf_printcol_s8_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%hhd", col->mval->a_s8[i]);
-		else
-			rc = strbuf_printf(h, "%hhd", col->mval->a_s8[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_u8_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%hhu", col->mval->a_u8[i]);
-		else
-			rc = strbuf_printf(h, "%hhu", col->mval->a_u8[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_s16_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%hd", col->mval->a_s16[i]);
-		else
-			rc = strbuf_printf(h, "%hd", col->mval->a_s16[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_u16_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%hu", col->mval->a_u16[i]);
-		else
-			rc = strbuf_printf(h, "%hu", col->mval->a_u16[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_s32_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%d", col->mval->a_s32[i]);
-		else
-			rc = strbuf_printf(h, "%d", col->mval->a_s32[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_u32_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%u", col->mval->a_u32[i]);
-		else
-			rc = strbuf_printf(h, "%u", col->mval->a_u32[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_s64_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%ld", col->mval->a_s64[i]);
-		else
-			rc = strbuf_printf(h, "%ld", col->mval->a_s64[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_u64_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%lu", col->mval->a_u64[i]);
-		else
-			rc = strbuf_printf(h, "%lu", col->mval->a_u64[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_f_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%.9g", col->mval->a_f[i]);
-		else
-			rc = strbuf_printf(h, "%.9g", col->mval->a_f[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-static int strbuf_printcol_d_array(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	int rc;
-	int i;
-	rc = strbuf_printf(h, "[");
-	if (rc)
-		return rc;
-	for (i = 0; i < col->array_len; i++) {
-		if (i)
-			rc = strbuf_printf(h, ",%.17g", col->mval->a_d[i]);
-		else
-			rc = strbuf_printf(h, "%.17g", col->mval->a_d[i]);
-		if (rc)
-			return rc;
-	}
-	rc = strbuf_printf(h, "]");
-	return rc;
-}
-
-typedef int (*printcol_fn)(strbuf_tailq_t h, ldmsd_col_t col);
-printcol_fn printcol_tbl[] = {
-	[LDMS_V_S8] = strbuf_printcol_s8,
-	[LDMS_V_U8] = strbuf_printcol_u8,
-	[LDMS_V_S16] = strbuf_printcol_s16,
-	[LDMS_V_U16] = strbuf_printcol_u16,
-	[LDMS_V_S32] = strbuf_printcol_s32,
-	[LDMS_V_U32] = strbuf_printcol_u32,
-	[LDMS_V_S64] = strbuf_printcol_s64,
-	[LDMS_V_U64] = strbuf_printcol_u64,
-	[LDMS_V_F32] = strbuf_printcol_f,
-	[LDMS_V_D64] = strbuf_printcol_d,
-	[LDMS_V_CHAR] = strbuf_printcol_char,
-	[LDMS_V_CHAR_ARRAY] = strbuf_printcol_str,
-	[LDMS_V_S8_ARRAY] = strbuf_printcol_s8_array,
-	[LDMS_V_U8_ARRAY] = strbuf_printcol_u8_array,
-	[LDMS_V_S16_ARRAY] = strbuf_printcol_s16_array,
-	[LDMS_V_U16_ARRAY] = strbuf_printcol_u16_array,
-	[LDMS_V_S32_ARRAY] = strbuf_printcol_s32_array,
-	[LDMS_V_U32_ARRAY] = strbuf_printcol_u32_array,
-	[LDMS_V_S64_ARRAY] = strbuf_printcol_s64_array,
-	[LDMS_V_U64_ARRAY] = strbuf_printcol_u64_array,
-	[LDMS_V_F32_ARRAY] = strbuf_printcol_f_array,
-	[LDMS_V_D64_ARRAY] = strbuf_printcol_d_array,
-	[LDMS_V_TIMESTAMP] = strbuf_printcol_ts,
-	[LDMS_V_LAST+1] = NULL,
-};
-
-static int strbuf_printcol(strbuf_tailq_t h, ldmsd_col_t col)
-{
-	printcol_fn fn;
-	if (col->type > LDMS_V_LAST)
-		return EINVAL;
-	fn = printcol_tbl[col->type];
-	if (!fn)
-		return EINVAL;
-	return fn(h, col);
-}
-
-int ldmsd_row_to_json_array(ldmsd_row_t row, char **str, int *len)
-{
-	struct strbuf_tailq_s h = TAILQ_HEAD_INITIALIZER(h);
-	ldmsd_col_t col;
-	int i, rc;
-
-	rc = strbuf_printf(&h, "[");
-	if (rc)
-		goto err_0;
-	for (i = 0; i < row->col_count; i++) {
-		col = &row->cols[i];
-		if (i) { /* comma */
-			rc = strbuf_printf(&h, ",");
-			if (rc)
-				goto err_0;
-		}
-		rc = strbuf_printcol(&h, col);
-		if (rc)
-			goto err_0;
-	}
-	rc = strbuf_printf(&h, "]");
-	if (rc)
-		goto err_0;
-
-	rc = strbuf_str(&h, str, len);
-	strbuf_purge(&h);
-	return rc;
-
- err_0:
-	strbuf_purge(&h);
-	return rc;
-}
-
-int ldmsd_row_to_json_object(ldmsd_row_t row, char **str, int *len)
-{
-	struct strbuf_tailq_s h = TAILQ_HEAD_INITIALIZER(h);
-	ldmsd_col_t col;
-	int i, rc;
-
-	rc = strbuf_printf(&h, "{");
-	if (rc)
-		goto err_0;
-	for (i = 0; i < row->col_count; i++) {
-		col = &row->cols[i];
-		if (i) { /* comma */
-			rc = strbuf_printf(&h, ",");
-			if (rc)
-				goto err_0;
-		}
-		rc = strbuf_printf(&h, "\"%s\":", col->name);
-		if (rc)
-			goto err_0;
-		rc = strbuf_printcol(&h, col);
-		if (rc)
-			goto err_0;
-	}
-	rc = strbuf_printf(&h, "}");
-	if (rc)
-		goto err_0;
-
-	rc = strbuf_str(&h, str, len);
-	strbuf_purge(&h);
-	return rc;
-
- err_0:
-	strbuf_purge(&h);
-	return rc;
-}
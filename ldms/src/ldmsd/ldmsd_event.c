@@ -52,6 +52,7 @@
 
 ev_worker_t logger_w;
 ev_type_t log_type;
+ev_t log_flush_ev;
 
 extern int log_actor(ev_worker_t src, ev_worker_t dst, ev_status_t status, ev_t ev);
 int ldmsd_worker_init(void)
@@ -67,5 +68,9 @@ int ldmsd_ev_init(void)
 	log_type = ev_type_new("ldmsd:log", sizeof(struct log_data));
 	if (!log_type)
 		return ENOMEM;
+	log_flush_ev = ev_new(log_type);
+	if (!log_flush_ev)
+		return ENOMEM;
+	EV_DATA(log_flush_ev, struct log_data)->is_rotate = 0;
 	return 0;
 }
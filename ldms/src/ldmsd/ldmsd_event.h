@@ -62,12 +62,9 @@ extern ev_worker_t logger_w;
 /* LDMSD log */
 extern ev_type_t log_type;
 
+extern ev_t log_flush_ev; /* the logger writes out the log rings */
 struct log_data {
 	uint8_t is_rotate;
-	enum ldmsd_loglevel level;
-	char *msg;
-	struct timeval tv;
-	struct tm tm;
 };
 
 int ldmsd_ev_init(void);
@@ -537,9 +537,19 @@ int __failover_send_updtr(ldmsd_failover_t f, ldms_t x, ldmsd_updtr_t u)
 	}
 
 	/* AUTO INTERVAL */
-	if (!u->is_auto_task)
-	snprintf(buff, sizeof(buff), "false");
-	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_AUTO_INTERVAL, buff);
+	if (u->is_adaptive)
+		cstr = "adaptive";
+	else if (u->is_auto_task)
+		cstr = "true";
+	else
+		cstr = "false";
+	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_AUTO_INTERVAL, cstr);
+	if (rc)
+		goto cleanup;
+
+	/* DELTA */
+	rc = ldmsd_req_cmd_attr_append_str(rcmd, LDMSD_ATTR_DELTA,
+					   u->is_delta ? "true" : "false");
 	if (rc)
 		goto cleanup;
 
@@ -2142,6 +2152,7 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 	char *push = __req_attr_gets(req, LDMSD_ATTR_PUSH);
 	char *producer = __req_attr_gets(req, LDMSD_ATTR_PRODUCER);
 	char *auto_interval = __req_attr_gets(req, LDMSD_ATTR_AUTO_INTERVAL);
+	char *delta = __req_attr_gets(req, LDMSD_ATTR_DELTA);
 	char *uid = __req_attr_gets(req, LDMSD_ATTR_UID);
 	char *gid = __req_attr_gets(req, LDMSD_ATTR_GID);
 	char *perm = __req_attr_gets(req, LDMSD_ATTR_PERM);
@@ -2155,7 +2166,7 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 	struct str_rbn *srbn;
 	struct ldmsd_sec_ctxt sctxt = __get_sec_ctxt(req);
 	int rc = 0;
-	uint8_t is_auto_interval = (auto_interval)?0:1;
+	int is_auto_interval = 0;
 
 	__failover_lock(f);
 
@@ -2180,6 +2191,13 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 		}
 	}
 
+	if (auto_interval) {
+		if (0 == strcasecmp("adaptive", auto_interval))
+			is_auto_interval = LDMSD_UPDTR_ADAPTIVE;
+		else if (0 != strcasecmp("false", auto_interval))
+			is_auto_interval = LDMSD_UPDTR_AUTO_INTERVAL;
+	}
+
 	u = ldmsd_updtr_find(name);
 	if (!u) {
 		/* create */
@@ -2209,6 +2227,7 @@ int failover_cfgupdtr_handler(ldmsd_req_ctxt_t req)
 		if (push_flags)
 			u->default_task.task_flags = LDMSD_TASK_F_IMMEDIATE;
 	}
+	u->is_delta = (delta && 0 == strcasecmp("true", delta));
 	if (producer) {
 		/* add producer */
 		p = ldmsd_prdcr_find(producer);
@@ -2240,6 +2259,8 @@ out:
 		free(match);
 	if (push)
 		free(push);
+	if (delta)
+		free(delta);
 	if (producer)
 		free(producer);
 	if (uid)
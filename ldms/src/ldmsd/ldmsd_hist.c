@@ -0,0 +1,237 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Log-linear latency histograms.
+ *
+ * Bucket i holds the value i for i < 2 * SUB. Above that, bucket
+ * (k + 1) * SUB + j holds the values [(SUB + j) << k, (SUB + j + 1) << k),
+ * i.e. the top LDMSD_HIST_SUB_BITS bits below the most significant bit
+ * select the bucket within the power of two. This is the layout of
+ * HdrHistogram with a fixed precision and no auto-resize.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ldmsd.h"
+
+static inline int hist_index(uint64_t v)
+{
+	int msb, shift;
+
+	if (v < 2 * LDMSD_HIST_SUB)
+		return v;
+	msb = 63 - __builtin_clzll(v);
+	if (msb > LDMSD_HIST_MAX_MSB)
+		return LDMSD_HIST_LEN - 1;
+	shift = msb - LDMSD_HIST_SUB_BITS;
+	return (shift + 1) * LDMSD_HIST_SUB + ((v >> shift) - LDMSD_HIST_SUB);
+}
+
+static inline uint64_t hist_lower(int idx)
+{
+	int k;
+
+	if (idx < 2 * LDMSD_HIST_SUB)
+		return idx;
+	k = idx / LDMSD_HIST_SUB - 1;
+	return (uint64_t)(idx % LDMSD_HIST_SUB + LDMSD_HIST_SUB) << k;
+}
+
+static inline uint64_t hist_upper(int idx)
+{
+	if (idx < 2 * LDMSD_HIST_SUB)
+		return idx;
+	return hist_lower(idx + 1) - 1;
+}
+
+/* Return the histogram of *hp, allocating it if this is the first value */
+static ldmsd_hist_t hist_get(ldmsd_hist_t *hp)
+{
+	ldmsd_hist_t h, cur = NULL;
+
+	h = __atomic_load_n(hp, __ATOMIC_ACQUIRE);
+	if (h)
+		return h;
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+	if (__atomic_compare_exchange_n(hp, &cur, h, 0, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE))
+		return h;
+	/* another thread got there first */
+	free(h);
+	return cur;
+}
+
+void ldmsd_hist_record(ldmsd_hist_t *hp, uint64_t v)
+{
+	ldmsd_hist_t h = hist_get(hp);
+	uint64_t max;
+
+	if (!h)
+		return;
+
+	__atomic_add_fetch(&h->bucket[hist_index(v)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum, v, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while (v > max) {
+		if (__atomic_compare_exchange_n(&h->max, &max, v, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+void ldmsd_hist_record_since(ldmsd_hist_t *hp, struct timespec *start)
+{
+	struct timespec now;
+	int64_t us;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - start->tv_sec) * 1000000 +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+	ldmsd_hist_record(hp, us < 0 ? 0 : us);
+}
+
+/*
+ * Return the values at the quantiles in \c q[], which must be in
+ * ascending order, and the total count of the buckets. The bucket counts
+ * are read once so that the quantiles are consistent with each other even
+ * if values are recorded concurrently.
+ */
+static uint64_t hist_quantiles(ldmsd_hist_t h, const double *q, uint64_t *v,
+			       int n, uint64_t *min)
+{
+	uint64_t cnt[LDMSD_HIST_LEN];
+	uint64_t total, acc, rank, max;
+	int i, j, first;
+
+	total = 0;
+	first = -1;
+	for (i = 0; i < LDMSD_HIST_LEN; i++) {
+		cnt[i] = __atomic_load_n(&h->bucket[i], __ATOMIC_RELAXED);
+		if (cnt[i] && first < 0)
+			first = i;
+		total += cnt[i];
+	}
+	max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	if (min)
+		*min = first < 0 ? 0 : hist_lower(first);
+	acc = 0;
+	i = 0;
+	for (j = 0; j < n; j++) {
+		if (!total) {
+			v[j] = 0;
+			continue;
+		}
+		/* the smallest value with at least q * total values <= it */
+		rank = (uint64_t)(q[j] * total + 0.5);
+		if (rank < 1)
+			rank = 1;
+		if (rank > total)
+			rank = total;
+		while (acc + cnt[i] < rank)
+			acc += cnt[i++];
+		v[j] = hist_upper(i);
+		if (v[j] > max)
+			v[j] = max;
+	}
+	return total;
+}
+
+uint64_t ldmsd_hist_value_at(ldmsd_hist_t h, double q)
+{
+	uint64_t v;
+
+	if (!h)
+		return 0;
+	hist_quantiles(h, &q, &v, 1, NULL);
+	return v;
+}
+
+void ldmsd_hist_summary(ldmsd_hist_t h, struct ldmsd_hist_summary *sum)
+{
+	static const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t v[4];
+	uint64_t total;
+
+	if (!h) {
+		memset(sum, 0, sizeof(*sum));
+		return;
+	}
+	total = hist_quantiles(h, q, v, 4, &sum->min);
+	sum->count = total;
+	sum->max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	sum->mean = total ?
+		__atomic_load_n(&h->sum, __ATOMIC_RELAXED) / total : 0;
+	sum->p50 = v[0];
+	sum->p90 = v[1];
+	sum->p99 = v[2];
+	sum->p999 = v[3];
+}
+
+void ldmsd_hist_reset(ldmsd_hist_t h)
+{
+	int i;
+
+	if (!h)
+		return;
+	for (i = 0; i < LDMSD_HIST_LEN; i++)
+		__atomic_store_n(&h->bucket[i], 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+}
+
+void ldmsd_hist_free(ldmsd_hist_t h)
+{
+	free(h);
+}
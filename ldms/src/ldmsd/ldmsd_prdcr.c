@@ -67,25 +67,104 @@
 
 static void prdcr_task_cb(ldmsd_task_t task, void *arg);
 
-int prdcr_resolve(const char *hostname, unsigned short port_no,
-		  struct sockaddr_storage *ss, socklen_t *ss_len)
+/* Passive producers are matched with ldms_xprt_by_remote_sin() */
+static inline int prdcr_addr_family(ldmsd_prdcr_t prdcr)
 {
-	struct hostent *h;
+	return (prdcr->type == LDMSD_PRDCR_TYPE_PASSIVE) ? AF_INET : AF_UNSPEC;
+}
 
-	h = gethostbyname(hostname);
-	if (!h)
-		return -1;
+static long prdcr_env_get(const char *name, long dflt)
+{
+	char *str = getenv(name);
+	if (!str || !*str)
+		return dflt;
+	return strtol(str, NULL, 0);
+}
 
-	if (h->h_addrtype != AF_INET)
-		return -1;
+/*
+ * Connect rate limiter shared by all producers: a token bucket refilled at
+ * LDMSD_PRDCR_CONNECT_RATE tokens per second, holding up to one second of
+ * tokens.
+ */
+static struct {
+	pthread_mutex_t lock;
+	long rate;
+	double tokens;
+	struct timespec last;
+} connect_bucket = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.rate = -1,
+};
 
-	memset(ss, 0, sizeof *ss);
-	struct sockaddr_in *sin = (struct sockaddr_in *)ss;
-	sin->sin_addr.s_addr = *(unsigned int *)(h->h_addr_list[0]);
-	sin->sin_family = h->h_addrtype;
-	sin->sin_port = htons(port_no);
-	*ss_len = sizeof(*sin);
-	return 0;
+static long prdcr_backoff_max = -1;
+
+/* Returns 0 if the caller may connect now, or the microseconds to wait */
+static long prdcr_connect_token_get()
+{
+	struct timespec now;
+	double elapsed;
+	long wait_us = 0;
+
+	pthread_mutex_lock(&connect_bucket.lock);
+	if (connect_bucket.rate < 0) {
+		connect_bucket.rate = prdcr_env_get(LDMSD_PRDCR_CONNECT_RATE_VAR,
+					LDMSD_PRDCR_CONNECT_RATE_DEFAULT);
+		connect_bucket.tokens = connect_bucket.rate;
+		clock_gettime(CLOCK_MONOTONIC, &connect_bucket.last);
+	}
+	if (connect_bucket.rate <= 0)
+		goto out;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - connect_bucket.last.tv_sec) +
+		  (now.tv_nsec - connect_bucket.last.tv_nsec) / 1e9;
+	connect_bucket.last = now;
+	connect_bucket.tokens += elapsed * connect_bucket.rate;
+	if (connect_bucket.tokens > connect_bucket.rate)
+		connect_bucket.tokens = connect_bucket.rate;
+	if (connect_bucket.tokens >= 1) {
+		connect_bucket.tokens -= 1;
+		goto out;
+	}
+	wait_us = (1 - connect_bucket.tokens) * 1000000 / connect_bucket.rate;
+	if (!wait_us)
+		wait_us = 1;
+ out:
+	pthread_mutex_unlock(&connect_bucket.lock);
+	return wait_us;
+}
+
+/* A random delay in [us/2, 3us/2) */
+static inline long prdcr_jitter(long us)
+{
+	if (us < 2)
+		return 1;
+	return us / 2 + random() % us;
+}
+
+/*
+ * The delay before the next connect attempt: the connect interval, doubled
+ * for each failed attempt up to LDMSD_PRDCR_BACKOFF_MAX times, and jittered
+ * so that producers disconnected at the same time do not reconnect in step.
+ */
+static long prdcr_backoff_us(ldmsd_prdcr_t prdcr)
+{
+	long mult = 1;
+	if (prdcr_backoff_max < 0) {
+		prdcr_backoff_max = prdcr_env_get(LDMSD_PRDCR_BACKOFF_MAX_VAR,
+					LDMSD_PRDCR_BACKOFF_MAX_DEFAULT);
+		if (prdcr_backoff_max < 1)
+			prdcr_backoff_max = 1;
+	}
+	if (prdcr->conn_fails < 31)
+		mult = 1L << prdcr->conn_fails;
+	if (mult > prdcr_backoff_max)
+		mult = prdcr_backoff_max;
+	return prdcr_jitter(prdcr->conn_intrvl_us * mult);
+}
+
+static inline void prdcr_task_resched(ldmsd_prdcr_t prdcr, long delay_us)
+{
+	ldmsd_task_resched(&prdcr->task, 0, delay_us, 0);
 }
 
 void ldmsd_prdcr___del(ldmsd_cfgobj_t obj)
@@ -99,6 +178,8 @@ void ldmsd_prdcr___del(ldmsd_cfgobj_t obj)
 		free(prdcr->conn_auth);
 	if (prdcr->conn_auth_args)
 		av_free(prdcr->conn_auth_args);
+	ldmsd_hist_free(prdcr->update_hist);
+	ldmsd_hist_free(prdcr->store_hist);
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -605,6 +686,7 @@ static void prdcr_connect_cb(ldms_t x, ldms_xprt_event_t e, void *cb_arg)
 		}
 		ldms_xprt_ctxt_set(x, ctxt, __ldmsd_xprt_ctxt_free);
 		prdcr->conn_state = LDMSD_PRDCR_STATE_CONNECTED;
+		prdcr->conn_fails = 0;
 		if (__prdcr_subscribe(prdcr)) {
 			ldmsd_log(LDMSD_LERROR,
 				  "Could not subscribe to stream data on producer %s\n",
@@ -657,7 +739,7 @@ reset_prdcr:
 	case LDMSD_PRDCR_STATE_CONNECTED:
 		prdcr->conn_state = LDMSD_PRDCR_STATE_DISCONNECTED;
 		ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
-				 0, prdcr->conn_intrvl_us, 0);
+				 0, prdcr_backoff_us(prdcr), 0);
 		break;
 	case LDMSD_PRDCR_STATE_STOPPED:
 		assert(0 == "STOPPED shouldn't have xprt event");
@@ -683,13 +765,52 @@ reset_prdcr:
 extern const char *auth_name;
 extern struct attr_value_list *auth_opt;
 
+static void prdcr_resolve_cb(int rc, void *arg)
+{
+	ldmsd_prdcr_t prdcr = arg;
+	ldmsd_prdcr_lock(prdcr);
+	prdcr->resolving = 0;
+	/* Retry the connect right away; the name is in the cache now */
+	if (prdcr->conn_state == LDMSD_PRDCR_STATE_DISCONNECTED)
+		prdcr_task_resched(prdcr, prdcr_jitter(1000));
+	ldmsd_prdcr_unlock(prdcr);
+	ldmsd_prdcr_put(prdcr); /* from prdcr_connect() */
+}
+
 static void prdcr_connect(ldmsd_prdcr_t prdcr)
 {
 	int ret;
+	long wait_us;
 
 	assert(prdcr->xprt == NULL);
 	switch (prdcr->type) {
 	case LDMSD_PRDCR_TYPE_ACTIVE:
+		if (prdcr->resolving)
+			break;
+		wait_us = prdcr_connect_token_get();
+		if (wait_us) {
+			prdcr_task_resched(prdcr, prdcr_jitter(wait_us));
+			break;
+		}
+		/* If this attempt fails, the next one is after the backoff */
+		prdcr_task_resched(prdcr, prdcr_backoff_us(prdcr));
+		ldmsd_prdcr_get(prdcr); /* for prdcr_resolve_cb() */
+		ret = ldmsd_resolve(prdcr->host_name, AF_UNSPEC,
+				    prdcr->port_no, prdcr->conn_fails,
+				    &prdcr->ss, &prdcr->ss_len,
+				    prdcr_resolve_cb, prdcr);
+		if (ret == EINPROGRESS) {
+			prdcr->resolving = 1;
+			break;
+		}
+		ldmsd_prdcr_put(prdcr);
+		prdcr->conn_fails++;
+		if (ret) {
+			ldmsd_log(LDMSD_LINFO, "Producer %s: %s:%u not resolved, "
+				  "error %d.\n", prdcr->obj.name, prdcr->host_name,
+				  (unsigned)prdcr->port_no, ret);
+			break;
+		}
 		prdcr->conn_state = LDMSD_PRDCR_STATE_CONNECTING;
 		prdcr->xprt = ldms_xprt_new_with_auth(prdcr->xprt_name,
 					ldmsd_linfo, prdcr->conn_auth,
@@ -807,7 +928,8 @@ ldmsd_prdcr_new_with_auth(const char *name, const char *xprt_name,
 	if (!prdcr->port_no)
 		goto out;
 
-	if (prdcr_resolve(host_name, port_no, &prdcr->ss, &prdcr->ss_len)) {
+	if (ldmsd_resolve_sync(host_name, prdcr_addr_family(prdcr), port_no, 0,
+			       &prdcr->ss, &prdcr->ss_len)) {
 		errno = EAFNOSUPPORT;
 		ldmsd_log(LDMSD_LERROR, "ldmsd_prdcr_new: %s:%u not resolved.\n",
 			host_name,(unsigned) port_no);
@@ -920,6 +1042,7 @@ int __ldmsd_prdcr_start(ldmsd_prdcr_t prdcr, ldmsd_sec_ctxt_t ctxt)
 	}
 
 	prdcr->conn_state = LDMSD_PRDCR_STATE_DISCONNECTED;
+	prdcr->conn_fails = 0;
 
 	prdcr->obj.perm |= LDMSD_PERM_DSTART;
 	ldmsd_task_start(&prdcr->task, prdcr_task_cb, prdcr,
@@ -220,6 +220,7 @@ static int xprt_stats_handler(ldmsd_req_ctxt_t req_ctxt);
 static int prdcr_stats_handler(ldmsd_req_ctxt_t req_ctxt);
 static int thread_stats_handler(ldmsd_req_ctxt_t req_ctxt);
 static int set_stats_handler(ldmsd_req_ctxt_t req_ctxt);
+static int latency_stats_handler(ldmsd_req_ctxt_t req_ctxt);
 static int unimplemented_handler(ldmsd_req_ctxt_t req_ctxt);
 static int eperm_handler(ldmsd_req_ctxt_t req_ctxt);
 static int ebusy_handler(ldmsd_req_ctxt_t reqc);
@@ -465,6 +466,9 @@ static struct request_handler_entry request_handler[] = {
 	[LDMSD_SET_STATS_REQ] = {
 		LDMSD_SET_STATS_REQ, set_stats_handler, XALL
 	},
+	[LDMSD_LATENCY_STATS_REQ] = {
+		LDMSD_LATENCY_STATS_REQ, latency_stats_handler, XALL
+	},
 
 	[LDMSD_SET_DEFAULT_AUTHZ_REQ] = {
 		LDMSD_SET_DEFAULT_AUTHZ_REQ, set_default_authz_handler, XUG
@@ -2302,8 +2306,8 @@ int strgp_decomp_init(ldmsd_strgp_t strgp, ldmsd_req_ctxt_t req);
 static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *attr_name, *name, *plugin, *container, *schema, *interval;
-	char *decomp;
-	name = plugin = container = schema = NULL;
+	char *decomp, *qdepth_s, *qpolicy_s;
+	name = plugin = container = schema = qdepth_s = qpolicy_s = NULL;
 	size_t cnt = 0;
 	uid_t uid;
 	gid_t gid;
@@ -2311,6 +2315,8 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	char *perm_s = NULL;
 	struct timespec flush_interval = {0, 0};
 	struct ldmsd_sec_ctxt sec_ctxt = {};
+	int qdepth = LDMSD_STRGP_QDEPTH_DEFAULT;
+	ldmsd_strgp_qpolicy_t qpolicy = LDMSD_STRGP_QPOLICY_COALESCE;
 
 	reqc->errcode = 0;
 
@@ -2349,6 +2355,28 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 	attr_name = "decomposition";
 	decomp = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DECOMP);
 
+	qdepth_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_QUEUE_DEPTH);
+	if (qdepth_s) {
+		char *endp;
+		qdepth = strtol(qdepth_s, &endp, 0);
+		if (*endp != '\0' || qdepth < 0) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+					"The specified queue_depth, \"%s\", is invalid.",
+					qdepth_s);
+			goto send_reply;
+		}
+	}
+
+	qpolicy_s = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_QUEUE_POLICY);
+	if (qpolicy_s && ldmsd_strgp_qpolicy_from_str(qpolicy_s, &qpolicy)) {
+		reqc->errcode = EINVAL;
+		cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+				"The specified queue_policy, \"%s\", is invalid. "
+				"It must be 'coalesce' or 'drop'.", qpolicy_s);
+		goto send_reply;
+	}
+
 	struct ldmsd_plugin_cfg *store;
 	store = ldmsd_get_plugin(plugin);
 	if (!store) {
@@ -2390,6 +2418,8 @@ static int strgp_add_handler(ldmsd_req_ctxt_t reqc)
 		goto enomem_3;
 
 	strgp->flush_interval = flush_interval;
+	strgp->q.max_depth = qdepth;
+	strgp->q.policy = qpolicy;
 
 	if (decomp) {
 		strgp->decomp_name = strdup(decomp);
@@ -2429,6 +2459,8 @@ send_reply:
 	free(container);
 	free(schema);
 	free(perm_s);
+	free(qdepth_s);
+	free(qpolicy_s);
 	return 0;
 }
 
@@ -2884,7 +2916,25 @@ int __strgp_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_strgp_t strgp,
 		if (rc)
 			goto out;
 	}
-	rc = linebuf_printf(reqc, "]}");
+	pthread_mutex_lock(&strgp->q.lock);
+	rc = linebuf_printf(reqc, "],\"queue\":{"
+		       "\"max_depth\":%d,"
+		       "\"policy\":\"%s\","
+		       "\"depth\":%d,"
+		       "\"depth_hwm\":%d,"
+		       "\"enqueued\":%" PRIu64 ","
+		       "\"stored\":%" PRIu64 ","
+		       "\"coalesced\":%" PRIu64 ","
+		       "\"dropped\":%" PRIu64 "}}",
+		       strgp->q.max_depth,
+		       ldmsd_strgp_qpolicy_str(strgp->q.policy),
+		       strgp->q.depth,
+		       strgp->q.depth_hwm,
+		       strgp->q.enqueued,
+		       strgp->q.stored,
+		       strgp->q.coalesced,
+		       strgp->q.dropped);
+	pthread_mutex_unlock(&strgp->q.lock);
 out:
 	ldmsd_strgp_unlock(strgp);
 	return rc;
@@ -2967,7 +3017,8 @@ out:
 static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 {
 	char *name, *offset_str, *interval_str, *push, *auto_interval, *attr_name;
-	name = offset_str = interval_str = push = auto_interval = NULL;
+	char *delta;
+	name = offset_str = interval_str = push = auto_interval = delta = NULL;
 	size_t cnt = 0;
 	uid_t uid;
 	gid_t gid;
@@ -3063,6 +3114,13 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 
 	push = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_PUSH);
 	auto_interval = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_AUTO_INTERVAL);
+	delta = ldmsd_req_attr_str_value_get_by_id(reqc, LDMSD_ATTR_DELTA);
+	if (delta && strcasecmp(delta, "true") && strcasecmp(delta, "false")) {
+		reqc->errcode = EINVAL;
+		cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+			       "The delta option requires 'true' or 'false'");
+		goto send_reply;
+	}
 
 	struct ldmsd_sec_ctxt sctxt;
 	ldmsd_req_ctxt_sec_get(reqc, &sctxt);
@@ -3076,21 +3134,23 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 
 	if (auto_interval) {
 		if (0 == strcasecmp(auto_interval, "true")) {
-			if (push) {
-				reqc->errcode = EINVAL;
-				cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
-						"auto_interval and push are "
-						"incompatible options");
-				goto send_reply;
-			}
-			is_auto_task = 1;
+			is_auto_task = LDMSD_UPDTR_AUTO_INTERVAL;
+		} else if (0 == strcasecmp(auto_interval, "adaptive")) {
+			is_auto_task = LDMSD_UPDTR_ADAPTIVE;
 		} else if (0 == strcasecmp(auto_interval, "false")) {
 			is_auto_task = 0;
 		} else {
 			reqc->errcode = EINVAL;
 			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
 				       "The auto_interval option requires "
-				       "either 'true', or 'false'\n");
+				       "'true', 'false', or 'adaptive'\n");
+			goto send_reply;
+		}
+		if (is_auto_task && push) {
+			reqc->errcode = EINVAL;
+			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
+					"auto_interval and push are "
+					"incompatible options");
 			goto send_reply;
 		}
 	} else {
@@ -3130,6 +3190,8 @@ static int updtr_add_handler(ldmsd_req_ctxt_t reqc)
 			cnt = Snprintf(&reqc->line_buf, &reqc->line_len,
 				       "The updtr could not be created.");
 		}
+	} else if (delta) {
+		updtr->is_delta = (0 == strcasecmp(delta, "true"));
 	}
 
 send_reply:
@@ -3137,6 +3199,7 @@ send_reply:
 	free(name);
 	free(interval_str);
 	free(auto_interval);
+	free(delta);
 	free(offset_str);
 	free(push);
 	free(perm_s);
@@ -3750,6 +3813,7 @@ int __updtr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_updtr_t updtr,
 	ldmsd_prdcr_t prdcr;
 	int prdcr_count;
 	long default_offset = 0;
+	uint64_t lateness_mean, lateness_min;
 
 	if (updtr_cnt) {
 		rc = linebuf_printf(reqc, ",\n");
@@ -3767,18 +3831,41 @@ int __updtr_status_json_obj(ldmsd_req_ctxt_t reqc, ldmsd_updtr_t updtr,
 		"\"sync\":\"%s\","
 		"\"mode\":\"%s\","
 		"\"auto\":\"%s\","
-		"\"state\":\"%s\","
-		"\"producers\":[",
+		"\"delta\":\"%s\","
+		"\"state\":\"%s\",",
 		updtr->obj.name,
-		updtr->default_task.sched.intrvl_us,
+		updtr->default_task.hint.intrvl_us,
 		default_offset,
 		((updtr->default_task.task_flags==LDMSD_TASK_F_SYNCHRONOUS)?"true":"false"),
 		update_mode(updtr->push_flags),
-		(updtr->is_auto_task ? "true" : "false"),
+		(updtr->is_adaptive ? "adaptive" :
+			(updtr->is_auto_task ? "true" : "false")),
+		(updtr->is_delta ? "true" : "false"),
 		ldmsd_updtr_state_str(updtr->state));
 	if (rc)
 		goto out;
 
+	pthread_mutex_lock(&updtr->lateness.lock);
+	lateness_mean = lateness_min = 0;
+	if (updtr->lateness.count) {
+		lateness_mean = updtr->lateness.sum_us / updtr->lateness.count;
+		lateness_min = updtr->lateness.min_us;
+	}
+	rc = linebuf_printf(reqc,
+		"\"lateness\":{\"count\":%"PRIu64","
+		"\"mean_us\":%"PRIu64","
+		"\"min_us\":%"PRIu64","
+		"\"max_us\":%"PRIu64","
+		"\"oversampled\":%"PRIu64","
+		"\"missed\":%"PRIu64"},"
+		"\"producers\":[",
+		updtr->lateness.count, lateness_mean, lateness_min,
+		updtr->lateness.max_us, updtr->lateness.oversampled,
+		updtr->lateness.missed);
+	pthread_mutex_unlock(&updtr->lateness.lock);
+	if (rc)
+		goto out;
+
 	prdcr_count = 0;
 	for (ref = ldmsd_updtr_prdcr_first(updtr); ref;
 	     ref = ldmsd_updtr_prdcr_next(ref)) {
@@ -6482,6 +6569,207 @@ err:
 	return ENOMEM;
 }
 
+/*
+ * Sends a JSON formatted summary of the latency histograms as follows:
+ *
+ * {
+ *   "updtr" : [ { "name" : <str>, "update_us" : <hist> }, ... ],
+ *   "prdcr" : [ { "name" : <str>, "update_us" : <hist>,
+ *                 "store_us" : <hist> }, ... ],
+ *   "strgp" : [ { "name" : <str>, "store_us" : <hist> }, ... ],
+ *   "sampler" : [ { "name" : <str>, "sample_us" : <hist> }, ... ],
+ *   "compute_time" : <int>
+ * }
+ *
+ * where <hist> is
+ *
+ * { "count" : <int>, "mean" : <int>, "min" : <int>, "max" : <int>,
+ *   "p50" : <int>, "p90" : <int>, "p99" : <int>, "p999" : <int> }
+ *
+ * "update_us" is the time from an update request to its completion,
+ * "store_us" from the update completion to the completion of the store,
+ * and "sample_us" the duration of the sampler's sample(). Only the
+ * objects of \c type are reported if it is given, and only the object
+ * named \c name if it is given.
+ */
+#define __APPEND_HIST(_key_, _h_) do {					\
+	struct ldmsd_hist_summary __sum;				\
+	ldmsd_hist_summary(_h_, &__sum);				\
+	__APPEND("\"%s\":{\"count\":%lu,\"mean\":%lu,\"min\":%lu,"	\
+		 "\"max\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,"	\
+		 "\"p999\":%lu}", _key_, __sum.count, __sum.mean,	\
+		 __sum.min, __sum.max, __sum.p50, __sum.p90,		\
+		 __sum.p99, __sum.p999);				\
+	if (reset)							\
+		ldmsd_hist_reset(_h_);					\
+} while (0)
+
+static char *__latency_stats_as_json(const char *type, const char *name,
+				     int reset, size_t *json_sz)
+{
+	extern struct plugin_list plugin_list;
+	struct ldmsd_plugin_cfg *pi;
+	ldmsd_updtr_t updtr;
+	ldmsd_prdcr_t prdcr;
+	ldmsd_strgp_t strgp;
+	struct timespec start, end;
+	char *buff, *s;
+	size_t sz = __APPEND_SZ;
+	ldmsd_cfgobj_type_t locked = 0;
+	int cnt;
+
+	(void)clock_gettime(CLOCK_REALTIME, &start);
+	buff = malloc(sz);
+	if (!buff)
+		return NULL;
+	s = buff;
+	__APPEND("{");
+
+	if (!type || 0 == strcmp(type, "updtr")) {
+		__APPEND("\"updtr\":[");
+		cnt = 0;
+		locked = LDMSD_CFGOBJ_UPDTR;
+		ldmsd_cfg_lock(locked);
+		for (updtr = ldmsd_updtr_first(); updtr;
+				updtr = ldmsd_updtr_next(updtr)) {
+			if (name && strcmp(name, updtr->obj.name))
+				continue;
+			__APPEND("%s{\"name\":\"%s\",", cnt++ ? "," : "",
+				 updtr->obj.name);
+			__APPEND_HIST("update_us", updtr->update_hist);
+			__APPEND("}");
+		}
+		ldmsd_cfg_unlock(LDMSD_CFGOBJ_UPDTR);
+		locked = 0;
+		__APPEND("],");
+	}
+
+	if (!type || 0 == strcmp(type, "prdcr")) {
+		__APPEND("\"prdcr\":[");
+		cnt = 0;
+		locked = LDMSD_CFGOBJ_PRDCR;
+		ldmsd_cfg_lock(locked);
+		for (prdcr = ldmsd_prdcr_first(); prdcr;
+				prdcr = ldmsd_prdcr_next(prdcr)) {
+			if (name && strcmp(name, prdcr->obj.name))
+				continue;
+			__APPEND("%s{\"name\":\"%s\",", cnt++ ? "," : "",
+				 prdcr->obj.name);
+			__APPEND_HIST("update_us", prdcr->update_hist);
+			__APPEND(",");
+			__APPEND_HIST("store_us", prdcr->store_hist);
+			__APPEND("}");
+		}
+		ldmsd_cfg_unlock(LDMSD_CFGOBJ_PRDCR);
+		locked = 0;
+		__APPEND("],");
+	}
+
+	if (!type || 0 == strcmp(type, "strgp")) {
+		__APPEND("\"strgp\":[");
+		cnt = 0;
+		locked = LDMSD_CFGOBJ_STRGP;
+		ldmsd_cfg_lock(locked);
+		for (strgp = ldmsd_strgp_first(); strgp;
+				strgp = ldmsd_strgp_next(strgp)) {
+			if (name && strcmp(name, strgp->obj.name))
+				continue;
+			__APPEND("%s{\"name\":\"%s\",", cnt++ ? "," : "",
+				 strgp->obj.name);
+			__APPEND_HIST("store_us", strgp->store_hist);
+			__APPEND("}");
+		}
+		ldmsd_cfg_unlock(LDMSD_CFGOBJ_STRGP);
+		locked = 0;
+		__APPEND("],");
+	}
+
+	if (!type || 0 == strcmp(type, "sampler")) {
+		__APPEND("\"sampler\":[");
+		cnt = 0;
+		LIST_FOREACH(pi, &plugin_list, entry) {
+			if (pi->plugin->type != LDMSD_PLUGIN_SAMPLER)
+				continue;
+			if (name && strcmp(name, pi->name))
+				continue;
+			__APPEND("%s{\"name\":\"%s\",", cnt++ ? "," : "",
+				 pi->name);
+			__APPEND_HIST("sample_us", pi->sample_hist);
+			__APPEND("}");
+		}
+		__APPEND("],");
+	}
+
+	(void)clock_gettime(CLOCK_REALTIME, &end);
+	uint64_t compute_time = ldms_timespec_diff_us(&start, &end);
+	__APPEND("\"compute_time\":%ld", compute_time);
+	__APPEND("}");
+
+	*json_sz = s - buff + 1;
+	return buff;
+
+__APPEND_ERR:
+	if (locked)
+		ldmsd_cfg_unlock(locked);
+	free(buff);
+	return NULL;
+}
+
+static int latency_stats_handler(ldmsd_req_ctxt_t req)
+{
+	char *json_s = NULL, *type, *name, *s;
+	size_t json_sz;
+	int reset = 0;
+	struct ldmsd_req_attr_s attr;
+
+	type = ldmsd_req_attr_str_value_get_by_id(req, LDMSD_ATTR_TYPE);
+	name = ldmsd_req_attr_str_value_get_by_id(req, LDMSD_ATTR_NAME);
+	s = ldmsd_req_attr_str_value_get_by_id(req, LDMSD_ATTR_RESET);
+	if (s) {
+		if (0 != strcasecmp(s, "false"))
+			reset = 1;
+		free(s);
+	}
+	if (type && strcmp(type, "updtr") && strcmp(type, "prdcr") &&
+	    strcmp(type, "strgp") && strcmp(type, "sampler")) {
+		req->errcode = EINVAL;
+		snprintf(req->line_buf, req->line_len, "Invalid type '%s'. "
+			 "Expecting updtr, prdcr, strgp or sampler.", type);
+		ldmsd_send_req_response(req, req->line_buf);
+		free(type);
+		free(name);
+		return 0;
+	}
+
+	json_s = __latency_stats_as_json(type, name, reset, &json_sz);
+	if (!json_s)
+		goto err;
+
+	attr.discrim = 1;
+	attr.attr_id = LDMSD_ATTR_JSON;
+	attr.attr_len = json_sz;
+	ldmsd_hton_req_attr(&attr);
+	if (ldmsd_append_reply(req, (const char *)&attr, sizeof(attr), LDMSD_REQ_SOM_F))
+		goto err;
+	if (ldmsd_append_reply(req, json_s, json_sz, 0))
+		goto err;
+	attr.discrim = 0;
+	if (ldmsd_append_reply(req, (const char *)&attr, sizeof(attr.discrim), LDMSD_REQ_EOM_F))
+		goto err;
+
+	free(json_s);
+	free(type);
+	free(name);
+	return 0;
+err:
+	free(json_s);
+	free(type);
+	free(name);
+	req->errcode = ENOMEM;
+	ldmsd_send_req_response(req, "Memory allocation failure.");
+	return ENOMEM;
+}
+
 static const char *__xprt_prdcr_name_get(ldms_t x)
 {
 	ldmsd_xprt_ctxt_t ctxt = x->app_ctxt;
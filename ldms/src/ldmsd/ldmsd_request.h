@@ -125,6 +125,7 @@ enum ldmsd_request {
 	LDMSD_LISTEN_REQ,
 	LDMSD_SET_DEFAULT_AUTHZ_REQ,
 	LDMSD_CMDLINE_OPTIONS_SET_REQ,
+	LDMSD_LATENCY_STATS_REQ,
 
 	/* failover requests by user */
 	LDMSD_FAILOVER_CONFIG_REQ = 0x700, /* "failover_config" user command */
@@ -207,6 +208,9 @@ enum ldmsd_request_attr {
 	LDMSD_ATTR_AUTH,
 	LDMSD_ATTR_RESET,
 	LDMSD_ATTR_DECOMP,
+	LDMSD_ATTR_QUEUE_DEPTH,
+	LDMSD_ATTR_QUEUE_POLICY,
+	LDMSD_ATTR_DELTA,
 	LDMSD_ATTR_LAST,
 };
 
@@ -79,6 +79,7 @@ const struct req_str_id req_str_id_table[] = {
 	{  "failover_stop",      LDMSD_FAILOVER_STOP_REQ  },
 	{  "greeting",           LDMSD_GREETING_REQ  },
 	{  "include",            LDMSD_INCLUDE_REQ  },
+	{  "latency_stats",      LDMSD_LATENCY_STATS_REQ  },
 	{  "listen",             LDMSD_LISTEN_REQ },
 	{  "load",               LDMSD_PLUGN_LOAD_REQ  },
 	{  "loglevel",           LDMSD_VERBOSE_REQ  },
@@ -149,6 +150,7 @@ const struct req_str_id attr_str_id_table[] = {
 	{  "base",              LDMSD_ATTR_BASE  },
 	{  "container",         LDMSD_ATTR_CONTAINER  },
 	{  "decomposition",     LDMSD_ATTR_DECOMP  },
+	{  "delta",             LDMSD_ATTR_DELTA  },
 	{  "flush",		LDMSD_ATTR_INTERVAL },
 	{  "gid",               LDMSD_ATTR_GID  },
 	{  "host",              LDMSD_ATTR_HOST  },
@@ -168,7 +170,10 @@ const struct req_str_id attr_str_id_table[] = {
 	{  "port",              LDMSD_ATTR_PORT  },
 	{  "producer",          LDMSD_ATTR_PRODUCER  },
 	{  "push",              LDMSD_ATTR_PUSH  },
+	{  "queue_depth",       LDMSD_ATTR_QUEUE_DEPTH  },
+	{  "queue_policy",      LDMSD_ATTR_QUEUE_POLICY  },
 	{  "regex",             LDMSD_ATTR_REGEX  },
+	{  "reset",             LDMSD_ATTR_RESET  },
 	{  "schema",            LDMSD_ATTR_SCHEMA  },
 	{  "stream",            LDMSD_ATTR_STREAM  },
 	{  "string",            LDMSD_ATTR_STRING  },
@@ -0,0 +1,415 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host name resolution for producers.
+ *
+ * Resolved addresses are cached per (host name, address family) for
+ * LDMSD_RESOLVE_TTL seconds, and resolution failures for
+ * LDMSD_RESOLVE_NEG_TTL seconds. ldmsd_resolve() never blocks: on a cache
+ * miss it queues the name to a small pool of resolver threads and the
+ * caller is notified when the result is in the cache. An expired entry is
+ * still returned while it is being refreshed in the background, so a DNS
+ * outage does not disconnect producers that are already known.
+ *
+ * Cache entries are never removed; there is one per producer host name.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include "coll/rbt.h"
+#include "ldmsd.h"
+
+#define RESOLVE_ADDR_MAX 8
+
+typedef struct resolve_waiter {
+	ldmsd_resolve_cb_t cb;
+	void *arg;
+	LIST_ENTRY(resolve_waiter) entry;
+} *resolve_waiter_t;
+
+typedef struct resolve_ent {
+	struct rbn rbn;
+	int family;
+	int rc;			/* 0 or the errno of the last resolution */
+	int naddr;
+	struct sockaddr_storage addr[RESOLVE_ADDR_MAX];
+	socklen_t addr_len[RESOLVE_ADDR_MAX];
+	time_t expire;		/* CLOCK_MONOTONIC seconds */
+	int pending;		/* queued or being resolved */
+	TAILQ_ENTRY(resolve_ent) q_entry;
+	LIST_HEAD(, resolve_waiter) waiters;
+	char key[OVIS_FLEX];	/* "<family>/<host>" */
+} *resolve_ent_t;
+
+static int resolve_ent_cmp(void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+static pthread_mutex_t resolve_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolve_cond = PTHREAD_COND_INITIALIZER;
+static struct rbt resolve_tree = RBT_INITIALIZER(resolve_ent_cmp);
+static TAILQ_HEAD(, resolve_ent) resolve_q = TAILQ_HEAD_INITIALIZER(resolve_q);
+static pthread_once_t resolve_once = PTHREAD_ONCE_INIT;
+static int resolve_thread_count;
+static long resolve_ttl = LDMSD_RESOLVE_TTL_DEFAULT;
+static long resolve_neg_ttl = LDMSD_RESOLVE_NEG_TTL_DEFAULT;
+
+static time_t resolve_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static long resolve_env_get(const char *name, long dflt)
+{
+	char *str = getenv(name);
+	char *endptr;
+	long v;
+	if (!str || !*str)
+		return dflt;
+	v = strtol(str, &endptr, 0);
+	if (*endptr || v < 0) {
+		ldmsd_log(LDMSD_LERROR, "Ignoring the invalid value of %s '%s'\n",
+			  name, str);
+		return dflt;
+	}
+	return v;
+}
+
+static int resolve_eai_errno(int eai)
+{
+	switch (eai) {
+	case 0:
+		return 0;
+	case EAI_AGAIN:
+		return EAGAIN;
+	case EAI_MEMORY:
+		return ENOMEM;
+	case EAI_FAMILY:
+	case EAI_ADDRFAMILY:
+		return EAFNOSUPPORT;
+	case EAI_SYSTEM:
+		return errno ? errno : EIO;
+	default:
+		return ENOENT;
+	}
+}
+
+/*
+ * Blocking resolution of \c host. The IPv4 addresses are listed first
+ * because the LDMS socket listeners are IPv4 by default.
+ */
+static int resolve_ent_lookup(const char *host, int family,
+			      struct sockaddr_storage *addr,
+			      socklen_t *addr_len, int *naddr)
+{
+	static const int families[] = { AF_INET, AF_INET6 };
+	struct addrinfo hints, *ai, *p;
+	int i, rc, n = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	rc = getaddrinfo(host, NULL, &hints, &ai);
+	if (rc)
+		return resolve_eai_errno(rc);
+	for (i = 0; i < 2; i++) {
+		for (p = ai; p && n < RESOLVE_ADDR_MAX; p = p->ai_next) {
+			if (p->ai_family != families[i])
+				continue;
+			if (p->ai_addrlen > sizeof(addr[n]))
+				continue;
+			memcpy(&addr[n], p->ai_addr, p->ai_addrlen);
+			addr_len[n] = p->ai_addrlen;
+			n++;
+		}
+	}
+	freeaddrinfo(ai);
+	*naddr = n;
+	return n ? 0 : ENOENT;
+}
+
+static const char *resolve_ent_host(resolve_ent_t e)
+{
+	return strchr(e->key, '/') + 1;
+}
+
+/* Caller must hold resolve_lock */
+static void resolve_ent_update(resolve_ent_t e, int rc,
+			       struct sockaddr_storage *addr,
+			       socklen_t *addr_len, int naddr)
+{
+	time_t now = resolve_now();
+	if (!rc) {
+		memcpy(e->addr, addr, naddr * sizeof(*addr));
+		memcpy(e->addr_len, addr_len, naddr * sizeof(*addr_len));
+		e->naddr = naddr;
+		e->rc = 0;
+		e->expire = now + resolve_ttl;
+		return;
+	}
+	if (rc == EAGAIN && e->naddr) {
+		/* Temporary failure; keep the addresses we have for now */
+		ldmsd_log(LDMSD_LINFO, "Temporary failure resolving '%s', "
+			  "using the cached addresses.\n", resolve_ent_host(e));
+		e->expire = now + resolve_neg_ttl;
+		return;
+	}
+	ldmsd_log(LDMSD_LERROR, "Error %d resolving '%s'.\n", rc,
+		  resolve_ent_host(e));
+	e->naddr = 0;
+	e->rc = rc;
+	e->expire = now + resolve_neg_ttl;
+}
+
+static void *resolve_proc(void *arg)
+{
+	resolve_ent_t e;
+	resolve_waiter_t w;
+	LIST_HEAD(, resolve_waiter) waiters;
+	struct sockaddr_storage addr[RESOLVE_ADDR_MAX];
+	socklen_t addr_len[RESOLVE_ADDR_MAX];
+	int rc, naddr = 0;
+
+	pthread_mutex_lock(&resolve_lock);
+	while (1) {
+		e = TAILQ_FIRST(&resolve_q);
+		if (!e) {
+			pthread_cond_wait(&resolve_cond, &resolve_lock);
+			continue;
+		}
+		TAILQ_REMOVE(&resolve_q, e, q_entry);
+		pthread_mutex_unlock(&resolve_lock);
+
+		rc = resolve_ent_lookup(resolve_ent_host(e), e->family,
+					addr, addr_len, &naddr);
+
+		pthread_mutex_lock(&resolve_lock);
+		resolve_ent_update(e, rc, addr, addr_len, naddr);
+		e->pending = 0;
+		LIST_INIT(&waiters);
+		while ((w = LIST_FIRST(&e->waiters))) {
+			LIST_REMOVE(w, entry);
+			LIST_INSERT_HEAD(&waiters, w, entry);
+		}
+		rc = e->naddr ? 0 : e->rc;
+		pthread_mutex_unlock(&resolve_lock);
+
+		while ((w = LIST_FIRST(&waiters))) {
+			LIST_REMOVE(w, entry);
+			w->cb(rc, w->arg);
+			free(w);
+		}
+		pthread_mutex_lock(&resolve_lock);
+	}
+	return NULL;
+}
+
+static void resolve_init()
+{
+	pthread_t t;
+	int i, count;
+
+	resolve_ttl = resolve_env_get(LDMSD_RESOLVE_TTL_VAR,
+				      LDMSD_RESOLVE_TTL_DEFAULT);
+	resolve_neg_ttl = resolve_env_get(LDMSD_RESOLVE_NEG_TTL_VAR,
+					  LDMSD_RESOLVE_NEG_TTL_DEFAULT);
+	count = resolve_env_get(LDMSD_RESOLVE_THREADS_VAR,
+				LDMSD_RESOLVE_THREADS_DEFAULT);
+	if (count < 1)
+		count = 1;
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&t, NULL, resolve_proc, NULL)) {
+			ldmsd_log(LDMSD_LCRITICAL, "Error %d creating a "
+				  "resolver thread.\n", errno);
+			break;
+		}
+		pthread_setname_np(t, "ldmsd:resolve");
+		pthread_detach(t);
+		resolve_thread_count++;
+	}
+}
+
+/* Caller must hold resolve_lock */
+static resolve_ent_t resolve_ent_get(const char *host, int family)
+{
+	char key[NI_MAXHOST + 16];
+	resolve_ent_t e;
+	struct rbn *rbn;
+	size_t len;
+
+	len = snprintf(key, sizeof(key), "%d/%s", family, host);
+	if (len >= sizeof(key)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	rbn = rbt_find(&resolve_tree, key);
+	if (rbn)
+		return container_of(rbn, struct resolve_ent, rbn);
+	e = calloc(1, sizeof(*e) + len + 1);
+	if (!e)
+		return NULL;
+	memcpy(e->key, key, len + 1);
+	e->family = family;
+	LIST_INIT(&e->waiters);
+	rbn_init(&e->rbn, e->key);
+	rbt_ins(&resolve_tree, &e->rbn);
+	return e;
+}
+
+/* Caller must hold resolve_lock */
+static int resolve_ent_addr(resolve_ent_t e, unsigned short port, int idx,
+			    struct sockaddr_storage *ss, socklen_t *ss_len)
+{
+	if (!e->naddr)
+		return e->rc;
+	idx %= e->naddr;
+	memcpy(ss, &e->addr[idx], e->addr_len[idx]);
+	*ss_len = e->addr_len[idx];
+	if (ss->ss_family == AF_INET6)
+		((struct sockaddr_in6 *)ss)->sin6_port = htons(port);
+	else
+		((struct sockaddr_in *)ss)->sin_port = htons(port);
+	return 0;
+}
+
+/* Caller must hold resolve_lock */
+static void resolve_ent_queue(resolve_ent_t e)
+{
+	if (e->pending)
+		return;
+	e->pending = 1;
+	TAILQ_INSERT_TAIL(&resolve_q, e, q_entry);
+	pthread_cond_signal(&resolve_cond);
+}
+
+int ldmsd_resolve(const char *host, int family, unsigned short port, int idx,
+		  struct sockaddr_storage *ss, socklen_t *ss_len,
+		  ldmsd_resolve_cb_t cb, void *arg)
+{
+	resolve_ent_t e;
+	resolve_waiter_t w;
+	int rc;
+
+	pthread_once(&resolve_once, resolve_init);
+	if (!resolve_thread_count)
+		return ldmsd_resolve_sync(host, family, port, idx, ss, ss_len);
+
+	pthread_mutex_lock(&resolve_lock);
+	e = resolve_ent_get(host, family);
+	if (!e) {
+		rc = errno;
+		goto out;
+	}
+	if (e->expire && e->expire > resolve_now()) {
+		rc = resolve_ent_addr(e, port, idx, ss, ss_len);
+		goto out;
+	}
+	if (e->naddr) {
+		/* Stale; use it while it is being refreshed */
+		resolve_ent_queue(e);
+		rc = resolve_ent_addr(e, port, idx, ss, ss_len);
+		goto out;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		rc = ENOMEM;
+		goto out;
+	}
+	w->cb = cb;
+	w->arg = arg;
+	LIST_INSERT_HEAD(&e->waiters, w, entry);
+	resolve_ent_queue(e);
+	rc = EINPROGRESS;
+out:
+	pthread_mutex_unlock(&resolve_lock);
+	return rc;
+}
+
+int ldmsd_resolve_sync(const char *host, int family, unsigned short port,
+		       int idx, struct sockaddr_storage *ss, socklen_t *ss_len)
+{
+	struct sockaddr_storage addr[RESOLVE_ADDR_MAX];
+	socklen_t addr_len[RESOLVE_ADDR_MAX];
+	resolve_ent_t e;
+	int rc, naddr = 0;
+
+	pthread_once(&resolve_once, resolve_init);
+	pthread_mutex_lock(&resolve_lock);
+	e = resolve_ent_get(host, family);
+	if (!e) {
+		rc = errno;
+		goto out;
+	}
+	if (e->expire && e->expire > resolve_now()) {
+		rc = resolve_ent_addr(e, port, idx, ss, ss_len);
+		goto out;
+	}
+	pthread_mutex_unlock(&resolve_lock);
+
+	rc = resolve_ent_lookup(host, family, addr, addr_len, &naddr);
+
+	pthread_mutex_lock(&resolve_lock);
+	resolve_ent_update(e, rc, addr, addr_len, naddr);
+	rc = resolve_ent_addr(e, port, idx, ss, ss_len);
+out:
+	pthread_mutex_unlock(&resolve_lock);
+	return rc;
+}
@@ -0,0 +1,848 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Row serializers.
+ *
+ * A serializer formats decomposed rows (JSON array, JSON object, CSV or
+ * InfluxDB line protocol) into a single growable buffer that is reused across
+ * rows. Numbers are formatted without printf(), and the per-column keys
+ * (escaped column names) are built once per row schema digest.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include "coll/rbt.h"
+#include "ldmsd.h"
+
+struct __fmt_buf {
+	char *str;
+	size_t len;   /* strlen(str) */
+	size_t alloc; /* allocated size of str */
+};
+
+/* keys of a row schema */
+typedef struct __fmt_sch_s {
+	struct rbn rbn;
+	struct ldms_digest_s digest;
+	int col_count;
+	int ts_col; /* LDMSD_ROW_FMT_INFLUX: the column holding line timestamp */
+	int name_off; /* the escaped schema name */
+	int name_len;
+	struct {
+		int off; /* offset of the key in keys[] */
+		int len;
+	} key[OVIS_FLEX];
+	/* followed by char keys[] */
+} *__fmt_sch_t;
+
+struct ldmsd_row_serializer_s {
+	ldmsd_row_fmt_t fmt;
+	struct __fmt_buf buf;
+	struct rbt sch_rbt; /* __fmt_sch_t by row schema digest */
+};
+
+static int __fmt_sch_cmp(void *tree_key, const void *key)
+{
+	return memcmp(tree_key, key, sizeof(struct ldms_digest_s));
+}
+
+/* Make room for `n` more bytes and the terminating '\0' */
+static int __reserve(struct __fmt_buf *b, size_t n)
+{
+	size_t sz;
+	char *s;
+	if (b->len + n < b->alloc)
+		return 0;
+	sz = b->alloc ? b->alloc : 1024;
+	while (sz <= b->len + n)
+		sz *= 2;
+	s = realloc(b->str, sz);
+	if (!s)
+		return ENOMEM;
+	b->str = s;
+	b->alloc = sz;
+	return 0;
+}
+
+#define __END(b) ((b)->str + (b)->len)
+
+static int __put(struct __fmt_buf *b, const char *s, size_t len)
+{
+	if (__reserve(b, len))
+		return ENOMEM;
+	memcpy(__END(b), s, len);
+	b->len += len;
+	b->str[b->len] = '\0';
+	return 0;
+}
+
+static inline int __putc(struct __fmt_buf *b, char c)
+{
+	if (__reserve(b, 1))
+		return ENOMEM;
+	b->str[b->len++] = c;
+	b->str[b->len] = '\0';
+	return 0;
+}
+
+static const char __digits2[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+char *ldmsd_fmt_u64(char *p, uint64_t v)
+{
+	char tmp[20], *q = tmp + sizeof(tmp);
+	int i;
+	while (v >= 100) {
+		i = (v % 100) * 2;
+		v /= 100;
+		*--q = __digits2[i + 1];
+		*--q = __digits2[i];
+	}
+	if (v >= 10) {
+		*--q = __digits2[v * 2 + 1];
+		*--q = __digits2[v * 2];
+	} else {
+		*--q = '0' + v;
+	}
+	i = tmp + sizeof(tmp) - q;
+	memcpy(p, q, i);
+	return p + i;
+}
+
+char *ldmsd_fmt_s64(char *p, int64_t v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return ldmsd_fmt_u64(p, -(uint64_t)v);
+	}
+	return ldmsd_fmt_u64(p, v);
+}
+
+char *ldmsd_fmt_u64_pad(char *p, uint64_t v, int n)
+{
+	int i;
+	for (i = n - 1; i >= 0; i--) {
+		p[i] = '0' + v % 10;
+		v /= 10;
+	}
+	return p + n;
+}
+
+static const uint64_t __p10u[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+};
+
+/* powers of ten that are exact in long double */
+static const long double __p10l[] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+	1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L,
+	1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L,
+};
+#define __P10L_MAX 27
+
+static long double __scale10(long double v, int k)
+{
+	for (; k > __P10L_MAX; k -= __P10L_MAX)
+		v *= __p10l[__P10L_MAX];
+	for (; k < -__P10L_MAX; k += __P10L_MAX)
+		v /= __p10l[__P10L_MAX];
+	return k >= 0 ? v * __p10l[k] : v / __p10l[-k];
+}
+
+/*
+ * The digits are computed in long double, so the last digit may differ from
+ * printf() by one when the value is very close to a rounding tie; the
+ * output still converts back to the same double.
+ */
+char *ldmsd_fmt_real(char *p, double v, int prec)
+{
+	char d[20];
+	long double x;
+	uint64_t m;
+	int e10, nd, i;
+
+	if (isnan(v)) {
+		memcpy(p, "nan", 3);
+		return p + 3;
+	}
+	if (signbit(v)) {
+		*p++ = '-';
+		v = -v;
+	}
+	if (isinf(v)) {
+		memcpy(p, "inf", 3);
+		return p + 3;
+	}
+	if (v == 0) {
+		*p++ = '0';
+		return p;
+	}
+	if (v < 1e15 && v == (double)(uint64_t)v && v < (double)__p10u[prec])
+		return ldmsd_fmt_u64(p, (uint64_t)v);
+
+	e10 = (int)floor(log10(v));
+ again:
+	/* log10() may be off by one near a power of 10 */
+	x = __scale10(v, prec - 1 - e10);
+	if (x >= __p10l[prec]) {
+		e10++;
+		goto again;
+	}
+	if (x < __p10l[prec - 1]) {
+		e10--;
+		goto again;
+	}
+	m = (uint64_t)x;
+	x -= m;
+	if (x > 0.5L || (x == 0.5L && (m & 1))) /* round half to even */
+		m++;
+	if (m == __p10u[prec]) {
+		/* rounded up to the next power of 10 */
+		m = __p10u[prec - 1];
+		e10++;
+	}
+	ldmsd_fmt_u64_pad(d, m, prec);
+	for (nd = prec; nd > 1 && d[nd - 1] == '0'; nd--)
+		;
+
+	if (e10 < -4 || e10 >= prec) {
+		*p++ = d[0];
+		if (nd > 1) {
+			*p++ = '.';
+			memcpy(p, d + 1, nd - 1);
+			p += nd - 1;
+		}
+		*p++ = 'e';
+		if (e10 < 0) {
+			*p++ = '-';
+			e10 = -e10;
+		} else {
+			*p++ = '+';
+		}
+		if (e10 < 10)
+			*p++ = '0';
+		return ldmsd_fmt_u64(p, e10);
+	}
+	if (e10 < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (i = e10 + 1; i < 0; i++)
+			*p++ = '0';
+		memcpy(p, d, nd);
+		return p + nd;
+	}
+	for (i = 0; i <= e10; i++)
+		*p++ = i < nd ? d[i] : '0';
+	if (nd > e10 + 1) {
+		*p++ = '.';
+		memcpy(p, d + e10 + 1, nd - e10 - 1);
+		p += nd - e10 - 1;
+	}
+	return p;
+}
+
+/* the longest formatted number: "-1.2345678901234567e-308" */
+#define __NUM_MAX 32
+
+static int __is_int_type(enum ldms_value_type t)
+{
+	switch (t) {
+	case LDMS_V_S8: case LDMS_V_S8_ARRAY:
+	case LDMS_V_U8: case LDMS_V_U8_ARRAY:
+	case LDMS_V_S16: case LDMS_V_S16_ARRAY:
+	case LDMS_V_U16: case LDMS_V_U16_ARRAY:
+	case LDMS_V_S32: case LDMS_V_S32_ARRAY:
+	case LDMS_V_U32: case LDMS_V_U32_ARRAY:
+	case LDMS_V_S64: case LDMS_V_S64_ARRAY:
+	case LDMS_V_U64: case LDMS_V_U64_ARRAY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int __is_signed_type(enum ldms_value_type t)
+{
+	switch (t) {
+	case LDMS_V_S8: case LDMS_V_S8_ARRAY:
+	case LDMS_V_S16: case LDMS_V_S16_ARRAY:
+	case LDMS_V_S32: case LDMS_V_S32_ARRAY:
+	case LDMS_V_S64: case LDMS_V_S64_ARRAY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Append element `i` of a numeric column; `i` is 0 for non-array values. */
+static int __put_num(struct __fmt_buf *b, enum ldms_value_type t,
+		     ldms_mval_t v, int i)
+{
+	char *p;
+	if (__reserve(b, __NUM_MAX))
+		return ENOMEM;
+	p = __END(b);
+	switch (t) {
+	case LDMS_V_S8: case LDMS_V_S8_ARRAY:
+		p = ldmsd_fmt_s64(p, v->a_s8[i]);
+		break;
+	case LDMS_V_U8: case LDMS_V_U8_ARRAY:
+		p = ldmsd_fmt_u64(p, v->a_u8[i]);
+		break;
+	case LDMS_V_S16: case LDMS_V_S16_ARRAY:
+		p = ldmsd_fmt_s64(p, v->a_s16[i]);
+		break;
+	case LDMS_V_U16: case LDMS_V_U16_ARRAY:
+		p = ldmsd_fmt_u64(p, v->a_u16[i]);
+		break;
+	case LDMS_V_S32: case LDMS_V_S32_ARRAY:
+		p = ldmsd_fmt_s64(p, v->a_s32[i]);
+		break;
+	case LDMS_V_U32: case LDMS_V_U32_ARRAY:
+		p = ldmsd_fmt_u64(p, v->a_u32[i]);
+		break;
+	case LDMS_V_S64: case LDMS_V_S64_ARRAY:
+		p = ldmsd_fmt_s64(p, v->a_s64[i]);
+		break;
+	case LDMS_V_U64: case LDMS_V_U64_ARRAY:
+		p = ldmsd_fmt_u64(p, v->a_u64[i]);
+		break;
+	case LDMS_V_F32: case LDMS_V_F32_ARRAY:
+		p = ldmsd_fmt_real(p, v->a_f[i], 9);
+		break;
+	case LDMS_V_D64: case LDMS_V_D64_ARRAY:
+		p = ldmsd_fmt_real(p, v->a_d[i], 17);
+		break;
+	case LDMS_V_TIMESTAMP:
+		p = ldmsd_fmt_u64(p, v->v_ts.sec);
+		*p++ = '.';
+		p = ldmsd_fmt_u64_pad(p, v->v_ts.usec, 6);
+		break;
+	default:
+		return EINVAL;
+	}
+	b->len = p - b->str;
+	b->str[b->len] = '\0';
+	return 0;
+}
+
+/* Append a JSON string. `len` bounds the length of `s`. */
+static int __put_json_str(struct __fmt_buf *b, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *p;
+	size_t i;
+	unsigned char c;
+
+	len = strnlen(s, len);
+	if (__reserve(b, len * 6 + 2))
+		return ENOMEM;
+	p = __END(b);
+	*p++ = '"';
+	for (i = 0; i < len; i++) {
+		c = s[i];
+		if (c == '"' || c == '\\') {
+			*p++ = '\\';
+			*p++ = c;
+		} else if (c < 0x20) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[c >> 4];
+			p[5] = hex[c & 0xf];
+			p += 6;
+		} else {
+			*p++ = c;
+		}
+	}
+	*p++ = '"';
+	b->len = p - b->str;
+	b->str[b->len] = '\0';
+	return 0;
+}
+
+/* Append `s` with the characters in `esc` escaped by a backslash */
+static int __put_escaped(struct __fmt_buf *b, const char *s, size_t len,
+			 const char *esc)
+{
+	char *p;
+	size_t i;
+
+	len = strnlen(s, len);
+	if (__reserve(b, len * 2))
+		return ENOMEM;
+	p = __END(b);
+	for (i = 0; i < len; i++) {
+		if (strchr(esc, s[i]))
+			*p++ = '\\';
+		*p++ = s[i];
+	}
+	b->len = p - b->str;
+	b->str[b->len] = '\0';
+	return 0;
+}
+
+static __fmt_sch_t __sch_build(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	struct __fmt_buf keys = {0};
+	__fmt_sch_t sch = NULL;
+	ldmsd_col_t col;
+	size_t sz;
+	int i, rc = 0, nfield = 0;
+
+	sz = sizeof(*sch) + row->col_count * sizeof(sch->key[0]);
+	sch = calloc(1, sz);
+	if (!sch)
+		return NULL;
+	sch->col_count = row->col_count;
+	sch->ts_col = -1;
+	if (row->schema_digest)
+		memcpy(&sch->digest, row->schema_digest, sizeof(sch->digest));
+
+	if (s->fmt == LDMSD_ROW_FMT_INFLUX) {
+		sch->name_off = 0;
+		rc = __put_escaped(&keys, row->schema_name, strlen(row->schema_name), ", ");
+		sch->name_len = keys.len;
+	}
+	for (i = 0; !rc && i < row->col_count; i++) {
+		col = &row->cols[i];
+		sch->key[i].off = keys.len;
+		switch (s->fmt) {
+		case LDMSD_ROW_FMT_JSON_OBJECT:
+			/* [,]"NAME": */
+			if (i)
+				rc = __putc(&keys, ',');
+			rc = rc ? rc : __put_json_str(&keys, col->name, strlen(col->name));
+			rc = rc ? rc : __putc(&keys, ':');
+			break;
+		case LDMSD_ROW_FMT_INFLUX:
+			/* ' ' or ',' followed by the escaped NAME */
+			if (col->type == LDMS_V_TIMESTAMP && sch->ts_col < 0) {
+				sch->ts_col = i;
+				break;
+			}
+			rc = __putc(&keys, nfield++ ? ',' : ' ');
+			rc = rc ? rc : __put_escaped(&keys, col->name, strlen(col->name), ",= ");
+			break;
+		default:
+			break;
+		}
+		sch->key[i].len = keys.len - sch->key[i].off;
+	}
+	if (rc)
+		goto err;
+	sch = realloc(sch, sz + keys.len + 1);
+	if (!sch)
+		goto err;
+	if (keys.len)
+		memcpy((char *)sch + sz, keys.str, keys.len);
+	free(keys.str);
+	return sch;
+ err:
+	free(keys.str);
+	free(sch);
+	return NULL;
+}
+
+static __fmt_sch_t __sch_get(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	__fmt_sch_t sch = NULL;
+	struct rbn *rbn;
+
+	if (row->schema_digest) {
+		rbn = rbt_find(&s->sch_rbt, row->schema_digest);
+		if (rbn) {
+			sch = container_of(rbn, struct __fmt_sch_s, rbn);
+			if (sch->col_count == row->col_count)
+				return sch;
+			rbt_del(&s->sch_rbt, rbn);
+			free(sch);
+		}
+	}
+	sch = __sch_build(s, row);
+	if (!sch)
+		return NULL;
+	rbn_init(&sch->rbn, &sch->digest);
+	if (row->schema_digest)
+		rbt_ins(&s->sch_rbt, &sch->rbn);
+	return sch;
+}
+
+#define __KEYS(sch) ((char *)&(sch)->key[(sch)->col_count])
+#define __KEY(sch, i) (__KEYS(sch) + (sch)->key[i].off)
+
+/* [ V, ... ] for arrays, V otherwise */
+static int __put_json_val(struct __fmt_buf *b, ldmsd_col_t col)
+{
+	int i, rc;
+	switch (col->type) {
+	case LDMS_V_CHAR:
+		return __put_json_str(b, &col->mval->v_char, 1);
+	case LDMS_V_CHAR_ARRAY:
+		return __put_json_str(b, col->mval->a_char, col->array_len);
+	default:
+		break;
+	}
+	if (!ldms_type_is_array(col->type))
+		return __put_num(b, col->type, col->mval, 0);
+	if (col->type > LDMS_V_D64_ARRAY)
+		return EINVAL;
+	rc = __putc(b, '[');
+	for (i = 0; !rc && i < col->array_len; i++) {
+		if (i)
+			rc = __putc(b, ',');
+		rc = rc ? rc : __put_num(b, col->type, col->mval, i);
+	}
+	return rc ? rc : __putc(b, ']');
+}
+
+static int __serialize_json(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	__fmt_sch_t sch = NULL;
+	int i, rc;
+
+	if (s->fmt == LDMSD_ROW_FMT_JSON_OBJECT) {
+		sch = __sch_get(s, row);
+		if (!sch)
+			return ENOMEM;
+	}
+	rc = __putc(&s->buf, sch ? '{' : '[');
+	for (i = 0; !rc && i < row->col_count; i++) {
+		if (sch)
+			rc = __put(&s->buf, __KEY(sch, i), sch->key[i].len);
+		else if (i)
+			rc = __putc(&s->buf, ',');
+		rc = rc ? rc : __put_json_val(&s->buf, &row->cols[i]);
+	}
+	rc = rc ? rc : __putc(&s->buf, sch ? '}' : ']');
+	if (sch && !row->schema_digest)
+		free(sch); /* not cached */
+	return rc;
+}
+
+static int __serialize_csv(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	ldmsd_col_t col;
+	int i, j, rc = 0;
+
+	for (i = 0; !rc && i < row->col_count; i++) {
+		col = &row->cols[i];
+		if (i)
+			rc = __putc(&s->buf, ',');
+		if (rc)
+			break;
+		switch (col->type) {
+		case LDMS_V_CHAR:
+			rc = __putc(&s->buf, col->mval->v_char);
+			continue;
+		case LDMS_V_CHAR_ARRAY:
+			rc = __put(&s->buf, col->mval->a_char,
+				   strnlen(col->mval->a_char, col->array_len));
+			continue;
+		default:
+			break;
+		}
+		if (!ldms_type_is_array(col->type)) {
+			rc = __put_num(&s->buf, col->type, col->mval, 0);
+			continue;
+		}
+		if (col->type > LDMS_V_D64_ARRAY)
+			return EINVAL;
+		for (j = 0; !rc && j < col->array_len; j++) {
+			if (j)
+				rc = __putc(&s->buf, ',');
+			rc = rc ? rc : __put_num(&s->buf, col->type, col->mval, j);
+		}
+	}
+	return rc ? rc : __putc(&s->buf, '\n');
+}
+
+/* FIELD=VALUE for the column, FIELD.<i>=VALUE for each array element */
+static int __put_influx_field(struct __fmt_buf *b, __fmt_sch_t sch, int i,
+			      ldmsd_col_t col)
+{
+	const char *key = __KEY(sch, i);
+	int len = sch->key[i].len;
+	char *p;
+	int j, rc;
+
+	switch (col->type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_CHAR_ARRAY:
+		rc = __put(b, key, len);
+		rc = rc ? rc : __put(b, "=\"", 2);
+		rc = rc ? rc : __put_escaped(b, col->mval->a_char,
+				col->type == LDMS_V_CHAR ? 1 : col->array_len,
+				"\"\\");
+		return rc ? rc : __putc(b, '"');
+	default:
+		break;
+	}
+	if (ldms_type_is_array(col->type) && col->type > LDMS_V_D64_ARRAY)
+		return EINVAL;
+	for (j = 0; j < (ldms_type_is_array(col->type) ? col->array_len : 1); j++) {
+		/* the key has a leading ' ' or ','; array elements after
+		 * the first one are always separated by ',' */
+		if (j) {
+			rc = __putc(b, ',');
+			rc = rc ? rc : __put(b, key + 1, len - 1);
+		} else {
+			rc = __put(b, key, len);
+		}
+		if (!rc && ldms_type_is_array(col->type)) {
+			rc = __reserve(b, __NUM_MAX);
+			if (!rc) {
+				p = __END(b);
+				*p++ = '.';
+				p = ldmsd_fmt_u64(p, j);
+				b->len = p - b->str;
+			}
+		}
+		rc = rc ? rc : __putc(b, '=');
+		rc = rc ? rc : __put_num(b, col->type, col->mval, j);
+		if (!rc && __is_int_type(col->type))
+			rc = __putc(b, __is_signed_type(col->type) ? 'i' : 'u');
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+static int __serialize_influx(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	__fmt_sch_t sch;
+	struct ldms_timestamp *ts;
+	char *p;
+	int i, rc;
+
+	sch = __sch_get(s, row);
+	if (!sch)
+		return ENOMEM;
+	rc = __put(&s->buf, __KEYS(sch) + sch->name_off, sch->name_len);
+	for (i = 0; !rc && i < row->col_count; i++) {
+		if (i == sch->ts_col)
+			continue;
+		rc = __put_influx_field(&s->buf, sch, i, &row->cols[i]);
+	}
+	if (!rc && sch->ts_col >= 0) {
+		/* line timestamp in nanoseconds */
+		ts = &row->cols[sch->ts_col].mval->v_ts;
+		rc = __reserve(&s->buf, __NUM_MAX);
+		if (!rc) {
+			p = __END(&s->buf);
+			*p++ = ' ';
+			p = ldmsd_fmt_u64(p, ts->sec * 1000000000ULL + ts->usec * 1000ULL);
+			s->buf.len = p - s->buf.str;
+		}
+	}
+	rc = rc ? rc : __putc(&s->buf, '\n');
+	if (!row->schema_digest)
+		free(sch); /* not cached */
+	return rc;
+}
+
+static void __serializer_init(ldmsd_row_serializer_t s, ldmsd_row_fmt_t fmt)
+{
+	s->fmt = fmt;
+	s->buf.str = NULL;
+	s->buf.len = s->buf.alloc = 0;
+	rbt_init(&s->sch_rbt, __fmt_sch_cmp);
+}
+
+static void __serializer_purge(ldmsd_row_serializer_t s)
+{
+	struct rbn *rbn;
+	while ((rbn = rbt_min(&s->sch_rbt))) {
+		rbt_del(&s->sch_rbt, rbn);
+		free(container_of(rbn, struct __fmt_sch_s, rbn));
+	}
+	free(s->buf.str);
+	s->buf.str = NULL;
+	s->buf.len = s->buf.alloc = 0;
+}
+
+ldmsd_row_serializer_t ldmsd_row_serializer_new(ldmsd_row_fmt_t fmt)
+{
+	ldmsd_row_serializer_t s;
+	if (fmt < LDMSD_ROW_FMT_JSON_ARRAY || fmt > LDMSD_ROW_FMT_INFLUX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+	__serializer_init(s, fmt);
+	return s;
+}
+
+void ldmsd_row_serializer_free(ldmsd_row_serializer_t s)
+{
+	__serializer_purge(s);
+	free(s);
+}
+
+void ldmsd_row_serializer_reset(ldmsd_row_serializer_t s)
+{
+	s->buf.len = 0;
+	if (s->buf.str)
+		s->buf.str[0] = '\0';
+}
+
+const char *ldmsd_row_serializer_str(ldmsd_row_serializer_t s, int *len)
+{
+	if (len)
+		*len = s->buf.len;
+	return s->buf.str ? s->buf.str : "";
+}
+
+int ldmsd_row_serialize(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	size_t len = s->buf.len;
+	int rc;
+
+	switch (s->fmt) {
+	case LDMSD_ROW_FMT_JSON_ARRAY:
+	case LDMSD_ROW_FMT_JSON_OBJECT:
+		rc = __serialize_json(s, row);
+		break;
+	case LDMSD_ROW_FMT_CSV:
+		rc = __serialize_csv(s, row);
+		break;
+	case LDMSD_ROW_FMT_INFLUX:
+		rc = __serialize_influx(s, row);
+		break;
+	default:
+		rc = EINVAL;
+	}
+	if (rc && s->buf.str) {
+		/* drop the partial row */
+		s->buf.len = len;
+		s->buf.str[len] = '\0';
+	}
+	return rc;
+}
+
+int ldmsd_row_serialize_header(ldmsd_row_serializer_t s, ldmsd_row_t row)
+{
+	ldmsd_col_t col;
+	char *p;
+	int i, j, rc = 0;
+
+	if (s->fmt != LDMSD_ROW_FMT_CSV)
+		return 0;
+	for (i = 0; !rc && i < row->col_count; i++) {
+		col = &row->cols[i];
+		if (i)
+			rc = __putc(&s->buf, ',');
+		if (rc)
+			break;
+		if (!ldms_type_is_array(col->type) ||
+		    col->type == LDMS_V_CHAR_ARRAY) {
+			rc = __put(&s->buf, col->name, strlen(col->name));
+			continue;
+		}
+		/* NAME0,NAME1,... */
+		for (j = 0; !rc && j < col->array_len; j++) {
+			if (j)
+				rc = __putc(&s->buf, ',');
+			rc = rc ? rc : __put(&s->buf, col->name, strlen(col->name));
+			rc = rc ? rc : __reserve(&s->buf, __NUM_MAX);
+			if (rc)
+				break;
+			p = ldmsd_fmt_u64(__END(&s->buf), j);
+			s->buf.len = p - s->buf.str;
+		}
+	}
+	return rc ? rc : __putc(&s->buf, '\n');
+}
+
+static int __row_to_str(ldmsd_row_fmt_t fmt, ldmsd_row_t row,
+			char **str, int *len)
+{
+	struct ldmsd_row_serializer_s s;
+	int rc;
+
+	__serializer_init(&s, fmt);
+	rc = ldmsd_row_serialize(&s, row);
+	if (rc)
+		goto out;
+	/* hand the buffer over to the caller */
+	*str = s.buf.str;
+	*len = s.buf.len;
+	s.buf.str = NULL;
+ out:
+	__serializer_purge(&s);
+	return rc;
+}
+
+int ldmsd_row_to_json_array(ldmsd_row_t row, char **str, int *len)
+{
+	return __row_to_str(LDMSD_ROW_FMT_JSON_ARRAY, row, str, len);
+}
+
+int ldmsd_row_to_json_object(ldmsd_row_t row, char **str, int *len)
+{
+	return __row_to_str(LDMSD_ROW_FMT_JSON_OBJECT, row, str, len);
+}
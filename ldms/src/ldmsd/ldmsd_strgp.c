@@ -72,6 +72,7 @@ void ldmsd_strgp___del(ldmsd_cfgobj_t obj)
 		free(strgp->container);
 	if (strgp->metric_arry)
 		free(strgp->metric_arry);
+	ldmsd_hist_free(strgp->store_hist);
 
 	struct ldmsd_strgp_metric *metric;
 	while (!TAILQ_EMPTY(&strgp->metric_list) ) {
@@ -94,6 +95,11 @@ void ldmsd_strgp___del(ldmsd_cfgobj_t obj)
 		free(strgp->plugin_name);
 	if (strgp->decomp_name)
 		free(strgp->decomp_name);
+	ldmsd_strgp_qent_t ent;
+	while ((ent = TAILQ_FIRST(&strgp->q.free))) {
+		TAILQ_REMOVE(&strgp->q.free, ent, entry);
+		free(ent);
+	}
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -174,16 +180,16 @@ out:
 	return rc;
 }
 
-static void strgp_decompose(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
+static void strgp_decompose(ldmsd_strgp_t strgp, ldms_set_t set)
 {
 	struct ldmsd_row_list_s row_list = TAILQ_HEAD_INITIALIZER(row_list);
 	int row_count, rc;
-	rc = strgp->decomp->decompose(strgp, prd_set->set, &row_list, &row_count);
+	rc = strgp->decomp->decompose(strgp, set, &row_list, &row_count);
 	if (rc) {
 		ldmsd_log(LDMSD_LERROR, "strgp decompose error: %d\n", rc);
 		return;
 	}
-	rc = strgp->store->commit(strgp, prd_set->set, &row_list, row_count);
+	rc = strgp->store->commit(strgp, set, &row_list, row_count);
 	if (rc) {
 		ldmsd_log(LDMSD_LERROR, "strgp row commit error: %d\n", rc);
 	}
@@ -191,7 +197,7 @@ static void strgp_decompose(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 }
 
 /* protected by strgp lock */
-static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
+static void strgp_update_fn(ldmsd_strgp_t strgp, ldms_set_t set)
 {
 	if (strgp->state != LDMSD_STRGP_STATE_RUNNING)
 		return;
@@ -203,7 +209,7 @@ static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		return;
 	}
-	strgp_decompose(strgp, prd_set);
+	strgp_decompose(strgp, set);
 	goto out;
 
 	/* store() interface routine */
@@ -212,7 +218,7 @@ static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		return;
 	}
-	strgp->store->store(strgp->store_handle, prd_set->set,
+	strgp->store->store(strgp->store_handle, set,
 			    strgp->metric_arry, strgp->metric_count);
  out:
 	if (strgp->flush_interval.tv_sec || strgp->flush_interval.tv_nsec) {
@@ -227,6 +233,320 @@ static void strgp_update_fn(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
 	}
 }
 
+int ldmsd_strgp_qpolicy_from_str(const char *str, ldmsd_strgp_qpolicy_t *policy)
+{
+	if (0 == strcasecmp(str, "coalesce"))
+		*policy = LDMSD_STRGP_QPOLICY_COALESCE;
+	else if (0 == strcasecmp(str, "drop"))
+		*policy = LDMSD_STRGP_QPOLICY_DROP;
+	else
+		return EINVAL;
+	return 0;
+}
+
+/*
+ * Store workers
+ *
+ * Each running strgp is assigned to one worker so that its updates are
+ * stored in the order they completed. A strgp with pending updates sits
+ * on its worker's strgp list until the worker drains its queue.
+ */
+struct ldmsd_store_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int strgp_count;	/* number of strgps assigned */
+	TAILQ_HEAD(, ldmsd_strgp) strgp_list;
+};
+
+static struct ldmsd_store_worker *store_workers;
+static int store_worker_count;
+static pthread_mutex_t store_worker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int qent_cmp(void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(ldmsd_prdcr_set_t *)a;
+	uintptr_t y = (uintptr_t)*(ldmsd_prdcr_set_t *)b;
+	if (x < y)
+		return -1;
+	if (x > y)
+		return 1;
+	return 0;
+}
+
+/* caller must hold q.lock */
+static void strgp_qent_free(ldmsd_strgp_t strgp, ldmsd_strgp_qent_t ent)
+{
+	TAILQ_INSERT_HEAD(&strgp->q.free, ent, entry);
+}
+
+/* caller must hold q.lock */
+static ldmsd_strgp_qent_t strgp_qent_alloc(ldmsd_strgp_t strgp)
+{
+	ldmsd_strgp_qent_t ent = TAILQ_FIRST(&strgp->q.free);
+	if (ent) {
+		TAILQ_REMOVE(&strgp->q.free, ent, entry);
+		return ent;
+	}
+	return malloc(sizeof(*ent));
+}
+
+/* caller must hold q.lock */
+static void strgp_queue_remove(ldmsd_strgp_t strgp, ldmsd_strgp_qent_t ent)
+{
+	TAILQ_REMOVE(&strgp->q.head, ent, entry);
+	if (strgp->q.policy == LDMSD_STRGP_QPOLICY_COALESCE)
+		rbt_del(&strgp->q.tree, &ent->rbn);
+	strgp->q.depth--;
+}
+
+/*
+ * Drop all pending updates. The entries are returned to the caller in
+ * \c list because putting the prd_set references may delete the producer
+ * set, which must not be done with q.lock held.
+ */
+static void strgp_queue_purge(ldmsd_strgp_t strgp,
+			      struct ldmsd_strgp_qlist *list)
+{
+	ldmsd_strgp_qent_t ent;
+	while ((ent = TAILQ_FIRST(&strgp->q.head))) {
+		strgp_queue_remove(strgp, ent);
+		TAILQ_INSERT_TAIL(list, ent, entry);
+	}
+}
+
+static void strgp_qlist_release(ldmsd_strgp_t strgp,
+				struct ldmsd_strgp_qlist *list)
+{
+	ldmsd_strgp_qent_t ent;
+	TAILQ_FOREACH(ent, list, entry) {
+		ldms_set_snapshot_release(ent->snap);
+		ldmsd_prdcr_put(ent->prdcr);
+		ldmsd_prdcr_set_ref_put(ent->prd_set);
+	}
+	pthread_mutex_lock(&strgp->q.lock);
+	while ((ent = TAILQ_FIRST(list))) {
+		TAILQ_REMOVE(list, ent, entry);
+		strgp_qent_free(strgp, ent);
+	}
+	pthread_mutex_unlock(&strgp->q.lock);
+}
+
+static void strgp_store(ldmsd_strgp_t strgp, ldms_set_t set)
+{
+	ldmsd_strgp_lock(strgp);
+	strgp->update_fn(strgp, set);
+	ldmsd_strgp_unlock(strgp);
+}
+
+static void *store_worker_proc(void *arg)
+{
+	struct ldmsd_store_worker *w = arg;
+	ldmsd_strgp_t strgp;
+	ldmsd_strgp_qent_t ent;
+	ldmsd_prdcr_set_t prd_set;
+	ldmsd_prdcr_t prdcr;
+	ldms_set_t snap;
+	struct timespec ready;
+
+	pthread_mutex_lock(&w->lock);
+	while (1) {
+		strgp = TAILQ_FIRST(&w->strgp_list);
+		if (!strgp) {
+			pthread_cond_wait(&w->cond, &w->lock);
+			continue;
+		}
+		TAILQ_REMOVE(&w->strgp_list, strgp, q.worker_entry);
+		pthread_mutex_unlock(&w->lock);
+
+		pthread_mutex_lock(&strgp->q.lock);
+		while ((ent = TAILQ_FIRST(&strgp->q.head))) {
+			strgp_queue_remove(strgp, ent);
+			prd_set = ent->prd_set;
+			snap = ent->snap;
+			prdcr = ent->prdcr;
+			ready = ent->ready;
+			strgp_qent_free(strgp, ent);
+			pthread_mutex_unlock(&strgp->q.lock);
+
+			strgp_store(strgp, snap);
+			ldmsd_hist_record_since(&strgp->store_hist, &ready);
+			ldmsd_hist_record_since(&prdcr->store_hist, &ready);
+			ldms_set_snapshot_release(snap);
+			ldmsd_prdcr_put(prdcr);
+			ldmsd_prdcr_set_ref_put(prd_set);
+
+			pthread_mutex_lock(&strgp->q.lock);
+			strgp->q.stored++;
+		}
+		strgp->q.scheduled = 0;
+		pthread_mutex_unlock(&strgp->q.lock);
+		ldmsd_strgp_put(strgp); /* scheduled reference */
+
+		pthread_mutex_lock(&w->lock);
+	}
+	return NULL;
+}
+
+int ldmsd_store_workers_start(int count)
+{
+	int i, rc;
+	if (count <= 0)
+		return 0;
+	store_workers = calloc(count, sizeof(*store_workers));
+	if (!store_workers)
+		return ENOMEM;
+	for (i = 0; i < count; i++) {
+		struct ldmsd_store_worker *w = &store_workers[i];
+		pthread_mutex_init(&w->lock, NULL);
+		pthread_cond_init(&w->cond, NULL);
+		TAILQ_INIT(&w->strgp_list);
+		rc = pthread_create(&w->thread, NULL, store_worker_proc, w);
+		if (rc)
+			return rc;
+		pthread_setname_np(w->thread, "ldmsd:store");
+		store_worker_count++;
+	}
+	return 0;
+}
+
+static struct ldmsd_store_worker *store_worker_get()
+{
+	struct ldmsd_store_worker *w = NULL;
+	int i;
+	pthread_mutex_lock(&store_worker_lock);
+	for (i = 0; i < store_worker_count; i++) {
+		if (!w || store_workers[i].strgp_count < w->strgp_count)
+			w = &store_workers[i];
+	}
+	if (w)
+		w->strgp_count++;
+	pthread_mutex_unlock(&store_worker_lock);
+	return w;
+}
+
+static void store_worker_put(struct ldmsd_store_worker *w)
+{
+	pthread_mutex_lock(&store_worker_lock);
+	w->strgp_count--;
+	pthread_mutex_unlock(&store_worker_lock);
+}
+
+/* Called with the producer set lock held */
+void ldmsd_strgp_enqueue(ldmsd_strgp_t strgp, ldmsd_prdcr_set_t prd_set)
+{
+	ldmsd_strgp_qent_t ent;
+	struct rbn *rbn;
+	struct ldmsd_store_worker *w;
+	ldms_set_t snap;
+	struct timespec ready;
+
+	clock_gettime(CLOCK_MONOTONIC, &ready);
+	pthread_mutex_lock(&strgp->q.lock);
+	if (!strgp->q.running) {
+		pthread_mutex_unlock(&strgp->q.lock);
+		return;
+	}
+	if (!strgp->q.worker) {
+		/* no store workers or no queue; store inline */
+		pthread_mutex_unlock(&strgp->q.lock);
+		strgp_store(strgp, prd_set->set);
+		ldmsd_hist_record_since(&strgp->store_hist, &ready);
+		ldmsd_hist_record_since(&prd_set->prdcr->store_hist, &ready);
+		return;
+	}
+	strgp->q.enqueued++;
+	rbn = NULL;
+	if (strgp->q.policy == LDMSD_STRGP_QPOLICY_COALESCE)
+		rbn = rbt_find(&strgp->q.tree, &prd_set);
+	if (!rbn && strgp->q.depth >= strgp->q.max_depth)
+		goto drop;
+	/*
+	 * The update callback is the one place where nothing writes the
+	 * set, so the copy is consistent. The stores work on the copy.
+	 */
+	snap = ldms_set_snapshot(prd_set->set);
+	if (!snap) {
+		ldmsd_log(LDMSD_LDEBUG, "strgp '%s': set '%s' snapshot "
+			  "error %d\n", strgp->obj.name, prd_set->inst_name,
+			  errno);
+		goto drop;
+	}
+	if (rbn) {
+		/* The pending entry takes the newer data */
+		ent = container_of(rbn, struct ldmsd_strgp_qent, rbn);
+		ldms_set_snapshot_release(ent->snap);
+		ent->snap = snap;
+		ent->gn = ldms_set_data_gn_get(snap);
+		strgp->q.coalesced++;
+		goto out;
+	}
+	ent = strgp_qent_alloc(strgp);
+	if (!ent) {
+		ldms_set_snapshot_release(snap);
+		goto drop;
+	}
+	ldmsd_prdcr_set_ref_get(prd_set);
+	ent->prd_set = prd_set;
+	ent->prdcr = ldmsd_prdcr_get(prd_set->prdcr);
+	ent->snap = snap;
+	ent->gn = ldms_set_data_gn_get(snap);
+	/* A coalesced update keeps the time of the oldest pending one */
+	ent->ready = ready;
+	if (strgp->q.policy == LDMSD_STRGP_QPOLICY_COALESCE) {
+		rbn_init(&ent->rbn, &ent->prd_set);
+		rbt_ins(&strgp->q.tree, &ent->rbn);
+	}
+	TAILQ_INSERT_TAIL(&strgp->q.head, ent, entry);
+	strgp->q.depth++;
+	if (strgp->q.depth > strgp->q.depth_hwm)
+		strgp->q.depth_hwm = strgp->q.depth;
+	if (!strgp->q.scheduled) {
+		strgp->q.scheduled = 1;
+		w = strgp->q.worker;
+		ldmsd_strgp_get(strgp); /* scheduled reference */
+		pthread_mutex_lock(&w->lock);
+		TAILQ_INSERT_TAIL(&w->strgp_list, strgp, q.worker_entry);
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+	goto out;
+drop:
+	strgp->q.dropped++;
+	if (0 == (strgp->q.dropped % 1000) || 1 == strgp->q.dropped) {
+		ldmsd_log(LDMSD_LINFO, "strgp '%s': store queue full, "
+			  "%" PRIu64 " updates dropped so far.\n",
+			  strgp->obj.name, strgp->q.dropped);
+	}
+out:
+	pthread_mutex_unlock(&strgp->q.lock);
+}
+
+/* Called with the strgp lock held */
+static void strgp_queue_start(ldmsd_strgp_t strgp)
+{
+	pthread_mutex_lock(&strgp->q.lock);
+	if (strgp->q.max_depth)
+		strgp->q.worker = store_worker_get();
+	strgp->q.running = 1;
+	pthread_mutex_unlock(&strgp->q.lock);
+}
+
+/* Called with the strgp lock held */
+static void strgp_queue_stop(ldmsd_strgp_t strgp)
+{
+	struct ldmsd_strgp_qlist list = TAILQ_HEAD_INITIALIZER(list);
+	pthread_mutex_lock(&strgp->q.lock);
+	strgp->q.running = 0;
+	strgp_queue_purge(strgp, &list);
+	if (strgp->q.worker) {
+		store_worker_put(strgp->q.worker);
+		strgp->q.worker = NULL;
+	}
+	pthread_mutex_unlock(&strgp->q.lock);
+	strgp_qlist_release(strgp, &list);
+}
+
 ldmsd_strgp_t
 ldmsd_strgp_new_with_auth(const char *name, uid_t uid, gid_t gid, int perm)
 {
@@ -245,6 +565,12 @@ ldmsd_strgp_new_with_auth(const char *name, uid_t uid, gid_t gid, int perm)
 	strgp->last_flush.tv_sec = 0;
 	strgp->last_flush.tv_nsec = 0;
 	strgp->update_fn = strgp_update_fn;
+	pthread_mutex_init(&strgp->q.lock, NULL);
+	strgp->q.max_depth = LDMSD_STRGP_QDEPTH_DEFAULT;
+	strgp->q.policy = LDMSD_STRGP_QPOLICY_COALESCE;
+	TAILQ_INIT(&strgp->q.head);
+	TAILQ_INIT(&strgp->q.free);
+	rbt_init(&strgp->q.tree, qent_cmp);
 	LIST_INIT(&strgp->prdcr_list);
 	TAILQ_INIT(&strgp->metric_list);
 	ldmsd_task_init(&strgp->task);
@@ -673,6 +999,7 @@ int __ldmsd_strgp_start(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt)
 		goto out;
 	}
 	strgp->state = LDMSD_STRGP_STATE_RUNNING;
+	strgp_queue_start(strgp);
 	clock_gettime(CLOCK_REALTIME, &strgp->last_flush);
 	strgp->obj.perm |= LDMSD_PERM_DSTART;
 	/* Update all the producers of our changed state */
@@ -707,6 +1034,7 @@ int __ldmsd_strgp_stop(ldmsd_strgp_t strgp, ldmsd_sec_ctxt_t ctxt)
 		goto out;
 	}
 	ldmsd_task_stop(&strgp->task);
+	strgp_queue_stop(strgp);
 	strgp_close(strgp);
 	strgp->state = LDMSD_STRGP_STATE_STOPPED;
 	strgp->obj.perm &= ~LDMSD_PERM_DSTART;
@@ -782,6 +1110,7 @@ void ldmsd_strgp_close()
 			goto next;
 		}
 		ldmsd_task_stop(&strgp->task);
+		strgp_queue_stop(strgp);
 		strgp_close(strgp);
 		strgp->state = LDMSD_STRGP_STATE_STOPPED;
 		ldmsd_strgp_unlock(strgp);
@@ -81,6 +81,8 @@ void ldmsd_updtr___del(ldmsd_cfgobj_t obj)
 		ldmsd_cfgobj_put(&prdcr_ref->prdcr->obj);
 		free(prdcr_ref);
 	}
+	pthread_mutex_destroy(&updtr->lateness.lock);
+	ldmsd_hist_free(updtr->update_hist);
 	ldmsd_cfgobj___del(obj);
 }
 
@@ -94,6 +96,144 @@ static int updtr_sched_offset_skew_get()
 	return skew;
 }
 
+static long updtr_adaptive_tick_get(long interval_us)
+{
+	int ticks = LDMSD_UPDTR_ADAPTIVE_TICKS_DEFAULT;
+	long tick;
+	char *str = getenv(LDMSD_UPDTR_ADAPTIVE_TICKS_VAR);
+	if (str)
+		ticks = strtol(str, NULL, 0);
+	if (ticks < 1)
+		ticks = 1;
+	tick = interval_us / ticks;
+	return (tick < 1000) ? 1000 : tick;
+}
+
+static inline int64_t timeval_usec(struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void updtr_lateness_reset(ldmsd_updtr_t updtr)
+{
+	pthread_mutex_lock(&updtr->lateness.lock);
+	updtr->lateness.count = 0;
+	updtr->lateness.sum_us = 0;
+	updtr->lateness.min_us = UINT64_MAX;
+	updtr->lateness.max_us = 0;
+	updtr->lateness.oversampled = 0;
+	updtr->lateness.missed = 0;
+	pthread_mutex_unlock(&updtr->lateness.lock);
+}
+
+/* FNV-1a; spreads the sets that sample at the same time over a window */
+static long updtr_adaptive_spread(const char *name, long window_us)
+{
+	uint64_t h = 14695981039346656037ULL;
+	if (window_us <= 0)
+		return 0;
+	for (; *name; name++) {
+		h ^= (unsigned char)*name;
+		h *= 1099511628211ULL;
+	}
+	return h % window_us;
+}
+
+/*
+ * Account a completed pull update of \c prd_set to the lateness statistics
+ * of its updater and to the update latency histograms. For adaptive updaters, also schedule the next pull of the
+ * set: just after its next sample is expected to be complete.
+ *
+ * \c fresh is 1 if the update brought a new sample, 0 otherwise.
+ *
+ * Caller must hold prd_set->lock.
+ */
+static void updtr_update_account(ldmsd_prdcr_set_t prd_set, ldms_set_t set,
+				 int fresh)
+{
+	ldmsd_updtr_t updtr = prd_set->updt_updtr;
+	struct ldmsd_updt_adapt *a = &prd_set->adapt;
+	struct ldms_timestamp ts;
+	int64_t end_us, t_us, next_us;
+	long interval, tick, rtt, delta, n;
+	uint64_t lateness, missed = 0;
+
+	if (!updtr)
+		return;
+	interval = updtr->default_task.hint.intrvl_us;
+	tick = updtr->default_task.sched.intrvl_us;
+	end_us = timeval_usec(&prd_set->updt_end);
+	rtt = end_us - timeval_usec(&prd_set->updt_start);
+	if (rtt < 0)
+		rtt = 0;
+	a->rtt_us = a->rtt_us ? (7 * a->rtt_us + rtt) / 8 : rtt;
+	ldmsd_hist_record(&updtr->update_hist, rtt);
+	ldmsd_hist_record(&prd_set->prdcr->update_hist, rtt);
+
+	if (!fresh) {
+		pthread_mutex_lock(&updtr->lateness.lock);
+		updtr->lateness.oversampled++;
+		pthread_mutex_unlock(&updtr->lateness.lock);
+		if (!updtr->is_adaptive)
+			return;
+		/*
+		 * The sample is late. Give the next samples more slack and
+		 * try again on the next tick, but not for the whole period.
+		 */
+		a->retries++;
+		if (a->guard_us < interval / 2)
+			a->guard_us += tick;
+		if (a->period_us && a->retries * tick > a->period_us / 2)
+			a->next_us = end_us + a->period_us - a->retries * tick;
+		else
+			a->next_us = end_us + tick;
+		return;
+	}
+
+	ts = ldms_transaction_timestamp_get(set);
+	t_us = (int64_t)ts.sec * 1000000 + ts.usec;
+	if (!a->period_us) {
+		/* the first sample; start from the hint or our interval */
+		if (prd_set->updt_hint.intrvl_us)
+			a->period_us = prd_set->updt_hint.intrvl_us;
+		else
+			a->period_us = interval;
+		a->spread_us = updtr_adaptive_spread(prd_set->inst_name,
+						     interval / 8);
+	} else if ((delta = t_us - a->ts_us) > 0) {
+		n = (delta + a->period_us / 2) / a->period_us;
+		if (n < 1)
+			n = 1;
+		missed = n - 1;
+		a->period_us = (7 * a->period_us + delta / n) / 8;
+	}
+	a->ts_us = t_us;
+	lateness = (end_us > t_us) ? end_us - t_us : 0;
+
+	pthread_mutex_lock(&updtr->lateness.lock);
+	updtr->lateness.count++;
+	updtr->lateness.sum_us += lateness;
+	if (lateness < updtr->lateness.min_us)
+		updtr->lateness.min_us = lateness;
+	if (lateness > updtr->lateness.max_us)
+		updtr->lateness.max_us = lateness;
+	updtr->lateness.missed += missed;
+	pthread_mutex_unlock(&updtr->lateness.lock);
+
+	if (!updtr->is_adaptive)
+		return;
+	/* Probe for less slack while the samples keep arriving in time */
+	if (!a->retries)
+		a->guard_us -= a->guard_us / 16;
+	a->retries = 0;
+	next_us = t_us + a->period_us + a->rtt_us / 2 + a->guard_us + a->spread_us;
+	if (next_us <= end_us) {
+		/* behind (or clock skew); keep the phase of the samples */
+		next_us += ((end_us - next_us) / a->period_us + 1) * a->period_us;
+	}
+	a->next_us = next_us;
+}
+
 static ldmsd_prdcr_ref_t updtr_prdcr_ref_first(ldmsd_updtr_t updtr)
 {
 	struct rbn *rbn = rbt_min(&updtr->prdcr_tree);
@@ -235,6 +375,7 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 {
 	uint64_t gn;
 	ldmsd_prdcr_set_t prd_set = arg;
+	ldmsd_updtr_t updtr = NULL;
 	int errcode;
 
 	pthread_mutex_lock(&prd_set->lock);
@@ -268,23 +409,28 @@ static void updtr_update_cb(ldms_t t, ldms_set_t set, int status, void *arg)
 	if (prd_set->last_gn == gn) {
 		ldmsd_log(LDMSD_LINFO, "Set %s oversampled %"PRIu64" == %"PRIu64".\n",
 			  prd_set->inst_name, prd_set->last_gn, gn);
+		if ((status & LDMS_UPD_F_MORE) == 0)
+			updtr_update_account(prd_set, set, 0);
 		goto set_ready;
 	}
 	prd_set->last_gn = gn;
+	if ((status & LDMS_UPD_F_MORE) == 0)
+		updtr_update_account(prd_set, set, 1);
 
 	ldmsd_strgp_ref_t str_ref;
 	LIST_FOREACH(str_ref, &prd_set->strgp_list, entry) {
-		ldmsd_strgp_t strgp = str_ref->strgp;
-
-		ldmsd_strgp_lock(strgp);
-		strgp->update_fn(strgp, prd_set);
-		ldmsd_strgp_unlock(strgp);
+		ldmsd_strgp_enqueue(str_ref->strgp, prd_set);
 	}
 set_ready:
 	if ((status & LDMS_UPD_F_MORE) == 0)
 		/* No more data pending move prdcr_set state UPDATING --> READY */
 		prd_set->state = LDMSD_PRDCR_SET_STATE_READY;
 out:
+	if (0 == (status & (LDMS_UPD_F_PUSH|LDMS_UPD_F_MORE))) {
+		/* The pull update is done; put its updater reference below */
+		updtr = prd_set->updt_updtr;
+		prd_set->updt_updtr = NULL;
+	}
 	pthread_mutex_unlock(&prd_set->lock);
 	if (0 == errcode) {
 		ldmsd_log(LDMSD_LDEBUG, "Pushing set %p %s\n",
@@ -295,12 +441,24 @@ out:
 						prd_set->inst_name);
 		}
 	}
-	if (0 == (status & (LDMS_UPD_F_PUSH|LDMS_UPD_F_MORE)))
+	if (0 == (status & (LDMS_UPD_F_PUSH|LDMS_UPD_F_MORE))) {
 		/* Put reference taken before calling ldms_xprt_update. */
+		if (updtr)
+			ldmsd_updtr_put(updtr);
 		ldmsd_prdcr_set_ref_put(prd_set);
+	}
 	return;
 }
 
+/* Forget the updater of a pull update that failed to start */
+static void updtr_update_abort(ldmsd_prdcr_set_t prd_set)
+{
+	ldmsd_updtr_t updtr = prd_set->updt_updtr;
+	prd_set->updt_updtr = NULL;
+	if (updtr)
+		ldmsd_updtr_put(updtr);
+}
+
 struct str_list_ent_s {
 	LIST_ENTRY(str_list_ent_s) entry;
 	char str[]; /* '\0' terminated string */
@@ -330,9 +488,83 @@ __grp_iter_cb(ldms_set_t grp, const char *name, void *arg)
 	return 0;
 }
 
+/*
+ * The pull updates of a producer's sets collected by schedule_prdcr_updates()
+ * to be requested with a single ldms_xprt_update_batch().
+ */
+struct updtr_batch {
+	int count;
+	int alloc;
+	ldms_set_t *sets;
+	void **args; /* the prdcr_sets */
+	int *rcs;
+};
+
+static int updtr_batch_add(struct updtr_batch *batch, ldmsd_prdcr_set_t prd_set)
+{
+	int alloc;
+	void *p;
+	if (batch->count == batch->alloc) {
+		alloc = batch->alloc ? batch->alloc * 2 : 64;
+		p = realloc(batch->sets, alloc * sizeof(*batch->sets));
+		if (!p)
+			return ENOMEM;
+		batch->sets = p;
+		p = realloc(batch->args, alloc * sizeof(*batch->args));
+		if (!p)
+			return ENOMEM;
+		batch->args = p;
+		p = realloc(batch->rcs, alloc * sizeof(*batch->rcs));
+		if (!p)
+			return ENOMEM;
+		batch->rcs = p;
+		batch->alloc = alloc;
+	}
+	batch->sets[batch->count] = prd_set->set;
+	batch->args[batch->count] = prd_set;
+	batch->count++;
+	return 0;
+}
+
+static void updtr_batch_free(struct updtr_batch *batch)
+{
+	free(batch->sets);
+	free(batch->args);
+	free(batch->rcs);
+}
+
+static void updtr_batch_flush(ldmsd_prdcr_t prdcr, struct updtr_batch *batch)
+{
+	ldmsd_prdcr_set_t prd_set;
+	int i, rc;
+
+	if (!batch->count)
+		return;
+	rc = ldms_xprt_update_batch(prdcr->xprt, batch->sets, batch->count,
+				    updtr_update_cb, batch->args, batch->rcs);
+	for (i = 0; rc && i < batch->count; i++) {
+		if (!batch->rcs[i])
+			continue;
+		prd_set = batch->args[i];
+#ifdef LDMSD_UPDATE_TIME
+		__updt_time_put(prd_set->updt_time);
+#endif
+		ldmsd_log(LDMSD_LINFO, "Synchronous error %d: Updating Set %s\n",
+					batch->rcs[i], prd_set->inst_name);
+		updtr_update_abort(prd_set);
+		ldmsd_prdcr_set_ref_put(prd_set);
+	}
+	batch->count = 0;
+}
+
 void __ldmsd_prdset_lookup_cb(ldms_t xprt, enum ldms_lookup_status status,
 			      int more, ldms_set_t set, void *arg);
-static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t task)
+/*
+ * If `batch` is not NULL, a pull update of a set that is not a set group is
+ * added to it instead of being requested right away.
+ */
+static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t task,
+				struct updtr_batch *batch)
 {
 	int rc = 0;
 	int flags;
@@ -388,7 +620,7 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 				}
 				if (pset->state != LDMSD_PRDCR_SET_STATE_READY)
 					continue; /* It is OK. The set might not be ready */
-				rc = schedule_set_updates(pset, task);
+				rc = schedule_set_updates(pset, task, NULL);
 				if (rc)
 					goto out;
 			}
@@ -398,7 +630,13 @@ static int schedule_set_updates(ldmsd_prdcr_set_t prd_set, ldmsd_updtr_task_t ta
 			 * do not update the setgroup.
 			 */
 		} else {
-			rc = ldms_xprt_update(prd_set->set, updtr_update_cb, prd_set);
+			/* for the lateness statistics in updtr_update_cb() */
+			prd_set->updt_updtr = ldmsd_updtr_get(updtr);
+			ldms_set_delta_update_set(prd_set->set, updtr->is_delta);
+			if (batch && 0 == updtr_batch_add(batch, prd_set))
+				rc = 0;
+			else
+				rc = ldms_xprt_update(prd_set->set, updtr_update_cb, prd_set);
 		}
 	} else if (0 == (prd_set->push_flags & LDMSD_PRDCR_SET_F_PUSH_REG)) {
 		op_s = "Registering push for";
@@ -426,8 +664,10 @@ out:
 #endif
 		ldmsd_log(LDMSD_LINFO, "Synchronous error %d: %s Set %s\n",
 						rc, op_s, prd_set->inst_name);
-		if (!updtr->push_flags)
+		if (!updtr->push_flags) {
+			updtr_update_abort(prd_set);
 			ldmsd_prdcr_set_ref_put(prd_set);
+		}
 	}
 	return rc;
 }
@@ -599,7 +839,10 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 				   ldmsd_prdcr_t prdcr, ldmsd_name_match_t match)
 {
 	ldmsd_updtr_t updtr = task->updtr;
+	struct updtr_batch batch = {0};
 	struct timespec ts;
+	struct timeval now;
+	int64_t now_us = 0;
 #ifdef LDMSD_UPDATE_TIME
 	struct timeval start, end;
 	gettimeofday(&start, NULL);
@@ -607,6 +850,10 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 	ldmsd_prdcr_lock(prdcr);
 	if (prdcr->conn_state != LDMSD_PRDCR_STATE_CONNECTED || prdcr->xprt->disconnected)
 		goto out;
+	if (updtr->is_adaptive) {
+		gettimeofday(&now, NULL);
+		now_us = timeval_usec(&now);
+	}
 
 	ldmsd_prdcr_set_t prd_set;
 	if (updtr->is_auto_task)
@@ -618,6 +865,12 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 		int rc;
 		const char *str;
 
+		/* Adaptive: skip the sets whose next sample is not due yet */
+		if (updtr->is_adaptive &&
+		    prd_set->state == LDMSD_PRDCR_SET_STATE_READY &&
+		    prd_set->adapt.next_us > now_us)
+			goto next_prd_set;
+
 		if (match) {
 			if (match->selector == LDMSD_NAME_MATCH_INST_NAME)
 				str = prd_set->inst_name;
@@ -680,7 +933,7 @@ static void schedule_prdcr_updates(ldmsd_updtr_task_t task,
 			goto next_prd_set;
 		}
 
-		schedule_set_updates(prd_set, task);
+		schedule_set_updates(prd_set, task, &batch);
 
 next_prd_set:
 		if (updtr->is_auto_task)
@@ -688,8 +941,11 @@ next_prd_set:
 		else
 			prd_set = ldmsd_prdcr_set_next(prd_set);
 	}
+	/* All the pulled sets of the producer in one request */
+	updtr_batch_flush(prdcr, &batch);
 out:
 	ldmsd_prdcr_unlock(prdcr);
+	updtr_batch_free(&batch);
 
 #ifdef LDMSD_UPDATE_TIME
 	gettimeofday(&end, NULL);
@@ -846,7 +1102,7 @@ static void updtr_tree_task_cb(ldmsd_task_t task, void *arg)
 void __prdcr_set_update_sched(ldmsd_prdcr_set_t prd_set,
 				  ldmsd_updtr_task_t updt_task)
 {
-	prd_set->updt_interval = updt_task->sched.intrvl_us;
+	prd_set->updt_interval = updt_task->hint.intrvl_us;
 	prd_set->updt_offset = updt_task->sched.offset_us;
 	prd_set->updt_sync = (updt_task->task_flags & LDMSD_TASK_F_SYNCHRONOUS)?1:0;
 }
@@ -968,7 +1224,14 @@ ldmsd_updtr_new_with_auth(const char *name, char *interval_str, char *offset_str
 
 	updtr->state = LDMSD_UPDTR_STATE_STOPPED;
 	updtr->default_task.is_default = 1;
-	updtr->is_auto_task = is_auto_task;
+	if (is_auto_task == LDMSD_UPDTR_ADAPTIVE) {
+		updtr->is_adaptive = 1;
+		updtr->is_auto_task = 0;
+	} else {
+		updtr->is_auto_task = !!is_auto_task;
+	}
+	pthread_mutex_init(&updtr->lateness.lock, NULL);
+	updtr->lateness.min_us = UINT64_MAX;
 	if (interval_str) {
 		interval_us = strtol(interval_str, &endptr, 0);
 		if (('\0' == interval_str[0]) || ('\0' != endptr[0]))
@@ -1071,7 +1334,19 @@ int __ldmsd_updtr_start(ldmsd_updtr_t updtr, ldmsd_sec_ctxt_t ctxt)
 	}
 	updtr->state = LDMSD_UPDTR_STATE_RUNNING;
 	updtr->obj.perm |= LDMSD_PERM_DSTART;
+	updtr_lateness_reset(updtr);
 
+	if (updtr->is_adaptive && !updtr->push_flags) {
+		/*
+		 * The default task only ticks; each set is pulled
+		 * when its own next sample is due (see updtr_update_account()).
+		 * The hint keeps the configured interval.
+		 */
+		updtr->default_task.task_flags = 0;
+		updtr->default_task.sched.offset_us = LDMSD_UPDT_HINT_OFFSET_NONE;
+		updtr->default_task.sched.intrvl_us =
+			updtr_adaptive_tick_get(updtr->default_task.hint.intrvl_us);
+	}
 	updtr_update_task_start(&updtr->default_task);
 
 	if (updtr->is_auto_task) {
@@ -1118,12 +1393,19 @@ int ldmsd_updtr_start(const char *updtr_name, const char *interval_str,
 	}
 
 	if (auto_interval) {
-		if(0 == strcasecmp(auto_interval, "false"))
-			updtr->is_auto_task = 0;
-		else
+		updtr->is_adaptive = 0;
+		updtr->is_auto_task = 0;
+		if (0 == strcasecmp(auto_interval, "adaptive")) {
+			if (updtr->push_flags) {
+				rc = EINVAL;
+				goto err;
+			}
+			updtr->is_adaptive = 1;
+		} else if (0 != strcasecmp(auto_interval, "false")) {
 			updtr->is_auto_task = 1;
+		}
 	}
-	interval_us = updtr->default_task.sched.intrvl_us;
+	interval_us = updtr->default_task.hint.intrvl_us;
 	offset_us = updtr->default_task.hint.offset_us;
 	if (interval_str) {
 		/* A new interval is given. */
@@ -78,7 +78,7 @@ static ldmsd_msg_log_f msglog __attribute__(( format(printf, 2, 3) ));
 #define LOG_WARN(FMT, ...) LOG(LDMSD_LWARNING, FMT, ## __VA_ARGS__)
 
 static const char *_help_str =
-"    config name=store_kafka [path=JSON_FILE]\n"
+"    config name=store_kafka [path=JSON_FILE] [format=json|csv|influx]\n"
 "        path=JSON_FILE is an optional JSON file containing a dictionary with\n"
 "                       KEYS being Kafka configuration properties and\n"
 "                       VALUES being their corresponding values.\n"
@@ -86,6 +86,9 @@ static const char *_help_str =
 "                       Kafka connections from store_kafka.\n"
 "                       Please see https://github.com/edenhill/librdkafka/blob/master/CONFIGURATION.md\n"
 "                       for a list of supported properties.\n"
+"        format=FMT     is the format of the row messages: `json` (a JSON\n"
+"                       object, the default), `csv` or `influx` (InfluxDB\n"
+"                       line protocol).\n"
 "\n"
 "    STRGP WITH STORE_KAFKA\n"
 "    ----------------------\n"
@@ -103,12 +106,13 @@ static const char *usage(struct ldmsd_plugin *self)
 
 pthread_mutex_t sk_lock = PTHREAD_MUTEX_INITIALIZER;
 static rd_kafka_conf_t *common_rconf = NULL;
+static ldmsd_row_fmt_t row_fmt = LDMSD_ROW_FMT_JSON_OBJECT;
 
 static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 		  struct attr_value_list *avl)
 {
 	int rc = 0;
-	const char *path;
+	const char *path, *fmt;
 	json_entity_t jdoc = NULL, jent, jval;
 	json_str_t jkey;
 	json_parser_t jp = NULL;
@@ -134,6 +138,19 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 		goto out;
 	}
 
+	fmt = av_value(avl, "format");
+	if (!fmt || 0 == strcasecmp(fmt, "json")) {
+		row_fmt = LDMSD_ROW_FMT_JSON_OBJECT;
+	} else if (0 == strcasecmp(fmt, "csv")) {
+		row_fmt = LDMSD_ROW_FMT_CSV;
+	} else if (0 == strcasecmp(fmt, "influx")) {
+		row_fmt = LDMSD_ROW_FMT_INFLUX;
+	} else {
+		rc = EINVAL;
+		LOG_ERROR("Unknown format: %s\n", fmt);
+		goto out;
+	}
+
 	path = av_value(avl, "path");
 	if (!path)
 		goto out; /* nothing more to do */
@@ -303,6 +320,7 @@ static int flush_store(ldmsd_store_handle_t _sh)
 typedef struct store_kafka_handle_s {
 	rd_kafka_t *rk; /* The Kafka handle */
 	rd_kafka_conf_t *rconf; /* The Kafka configuration */
+	ldmsd_row_serializer_t ser; /* formats the row messages */
 } *store_kafka_handle_t;
 
 static int
@@ -327,6 +345,8 @@ static void close_store(ldmsd_store_handle_t _sh)
 	if (sh->rconf) {
 		rd_kafka_conf_destroy(sh->rconf);
 	}
+	if (sh->ser)
+		ldmsd_row_serializer_free(sh->ser);
 	free(sh);
 }
 
@@ -338,6 +358,9 @@ static store_kafka_handle_t __handle_new(ldmsd_strgp_t strgp)
 	store_kafka_handle_t sh = calloc(1, sizeof(*sh));
 	if (!sh)
 		goto err_0;
+	sh->ser = ldmsd_row_serializer_new(row_fmt);
+	if (!sh->ser)
+		goto err_1;
 	sh->rconf = rd_kafka_conf_dup(common_rconf);
 	if (!sh->rconf)
 		goto err_1;
@@ -364,6 +387,8 @@ static store_kafka_handle_t __handle_new(ldmsd_strgp_t strgp)
  err_2:
 	rd_kafka_conf_destroy(sh->rconf);
  err_1:
+	if (sh->ser)
+		ldmsd_row_serializer_free(sh->ser);
 	free(sh);
  err_0:
 	return NULL;
@@ -377,7 +402,7 @@ commit_rows(ldmsd_strgp_t strgp, ldms_set_t set, ldmsd_row_list_t row_list,
 	store_kafka_handle_t sh;
 	rd_kafka_topic_t *rkt;
 	ldmsd_row_t row;
-	char *buf;
+	const char *buf;
 	int rc, len;
 
 	sh = strgp->store_handle;
@@ -389,27 +414,28 @@ commit_rows(ldmsd_strgp_t strgp, ldms_set_t set, ldmsd_row_list_t row_list,
 	}
 
 	TAILQ_FOREACH(row, row_list, entry) {
-		rc = ldmsd_row_to_json_object(row, &buf, &len);
+		ldmsd_row_serializer_reset(sh->ser);
+		rc = ldmsd_row_serialize(sh->ser, row);
 		if (rc) {
-			LOG_ERROR("ldmsd_row_to_json_object() error: %d\n", rc);
+			LOG_ERROR("ldmsd_row_serialize() error: %d\n", rc);
 			continue;
 		}
+		buf = ldmsd_row_serializer_str(sh->ser, &len);
 
 		/* row schema is the "topic" */
 		rkt = rd_kafka_topic_new(sh->rk, row->schema_name, NULL);
 		if (!rkt) {
 			LOG_ERROR("rd_kafka_topic_new(\"%s\") failed, "
 				  "errno: %d\n", row->schema_name, errno);
-			free(buf);
 			continue;
 		}
 
 		rc = rd_kafka_produce(rkt, RD_KAFKA_PARTITION_UA,
-				RD_KAFKA_MSG_F_FREE, buf, len, NULL, 0, NULL);
+				RD_KAFKA_MSG_F_COPY, (void *)buf, len,
+				NULL, 0, NULL);
 		if (rc) {
 			LOG_ERROR("rd_kafka_produce(\"%s\") failed, "
 				  "errno: %d\n", row->schema_name, rc);
-			free(buf);
 		}
 		rd_kafka_topic_destroy(rkt);
 	}
@@ -0,0 +1,1525 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * store_arrow writes the rows of a decomposition into Arrow IPC files.
+ *
+ * There is a file per row schema, "<path>/<container>/<schema>.<time>.arrow".
+ * The rows are accumulated into typed column buffers. Every batch_rows rows,
+ * and on a strgp flush, the columns are encoded as a RecordBatch message
+ * and handed to a csv_writer (store_csv_common), whose flusher thread does
+ * the file I/O. The column buffers are then reset and reused for the next
+ * batch. The producer and instance columns are dictionary encoded; the new
+ * dictionary entries of a batch are written in a (delta) DictionaryBatch
+ * before it. The footer is written when the file is closed or rolled.
+ *
+ * The Arrow metadata is FlatBuffers. The few tables that are needed are
+ * built with the minimal builder below, see Schema.fbs, Message.fbs and
+ * File.fbs of the Arrow format specification.
+ */
+#define _GNU_SOURCE
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <endian.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <coll/rbt.h>
+#include <coll/idx.h>
+#include <ovis_util/util.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "store_csv_common.h"
+
+static ldmsd_msg_log_f msglog __attribute__(( format(printf, 2, 3) ));
+
+#define PNAME "store_arrow"
+#define LOG(LVL, FMT, ...) msglog(LVL, PNAME ": " FMT, ## __VA_ARGS__)
+
+#define LOG_ERROR(FMT, ...) LOG(LDMSD_LERROR, FMT, ## __VA_ARGS__)
+#define LOG_INFO(FMT, ...) LOG(LDMSD_LINFO, FMT, ## __VA_ARGS__)
+#define LOG_WARN(FMT, ...) LOG(LDMSD_LWARNING, FMT, ## __VA_ARGS__)
+
+/* ---- FlatBuffers builder ---- */
+
+/*
+ * The buffer is built back to front: the data is at the end of buf and
+ * grows toward the front. An object is referred to by its offset from the
+ * end of the buffer, as in the reference implementation. The children of
+ * a table must be built before the table is started.
+ */
+#define FBB_MAX_FIELDS 8
+
+struct fbb {
+	uint8_t *buf;
+	size_t cap;
+	size_t len;
+	size_t minalign;
+	int err;
+	size_t vt[FBB_MAX_FIELDS]; /* the fields of the open table */
+	int vt_n;
+	size_t obj_end; /* len at fbb_start() */
+};
+
+static inline uint8_t *fbb_data(struct fbb *b)
+{
+	return b->buf + b->cap - b->len;
+}
+
+static void fbb_reset(struct fbb *b)
+{
+	b->len = 0;
+	b->minalign = 1;
+	b->err = 0;
+}
+
+static void fbb_free(struct fbb *b)
+{
+	free(b->buf);
+	memset(b, 0, sizeof(*b));
+}
+
+static int fbb_reserve(struct fbb *b, size_t n)
+{
+	size_t cap;
+	uint8_t *buf;
+
+	if (b->err)
+		return b->err;
+	if (b->len + n <= b->cap)
+		return 0;
+	cap = b->cap ? b->cap : 1024;
+	while (cap < b->len + n)
+		cap *= 2;
+	buf = malloc(cap);
+	if (!buf) {
+		b->err = ENOMEM;
+		return ENOMEM;
+	}
+	if (b->len)
+		memcpy(buf + cap - b->len, fbb_data(b), b->len);
+	free(b->buf);
+	b->buf = buf;
+	b->cap = cap;
+	return 0;
+}
+
+static void fbb_put(struct fbb *b, const void *p, size_t n)
+{
+	if (fbb_reserve(b, n))
+		return;
+	b->len += n;
+	if (p)
+		memcpy(fbb_data(b), p, n);
+	else
+		memset(fbb_data(b), 0, n);
+}
+
+/* Pad so that \c align divides len after \c extra more bytes. */
+static void fbb_prep(struct fbb *b, size_t align, size_t extra)
+{
+	if (align > b->minalign)
+		b->minalign = align;
+	fbb_put(b, NULL, (~(b->len + extra) + 1) & (align - 1));
+}
+
+static void fbb_u8(struct fbb *b, uint8_t v)
+{
+	fbb_put(b, &v, 1);
+}
+
+static void fbb_u16(struct fbb *b, uint16_t v)
+{
+	v = htole16(v);
+	fbb_prep(b, 2, 0);
+	fbb_put(b, &v, 2);
+}
+
+static void fbb_u32(struct fbb *b, uint32_t v)
+{
+	v = htole32(v);
+	fbb_prep(b, 4, 0);
+	fbb_put(b, &v, 4);
+}
+
+static void fbb_u64(struct fbb *b, uint64_t v)
+{
+	v = htole64(v);
+	fbb_prep(b, 8, 0);
+	fbb_put(b, &v, 8);
+}
+
+/* A reference to the object at \c off */
+static void fbb_uoff(struct fbb *b, size_t off)
+{
+	fbb_prep(b, 4, 0);
+	fbb_u32(b, b->len - off + 4);
+}
+
+static size_t fbb_string(struct fbb *b, const char *s)
+{
+	size_t n = strlen(s);
+	fbb_prep(b, 4, n + 1);
+	fbb_put(b, NULL, 1);
+	fbb_put(b, s, n);
+	fbb_u32(b, n);
+	return b->len;
+}
+
+/* Start a vector of \c n elements of \c esz bytes; push them last first. */
+static void fbb_vec_start(struct fbb *b, size_t esz, size_t n, size_t align)
+{
+	fbb_prep(b, 4, esz * n);
+	fbb_prep(b, align, esz * n);
+}
+
+static size_t fbb_vec_end(struct fbb *b, size_t n)
+{
+	fbb_u32(b, n);
+	return b->len;
+}
+
+static size_t fbb_vec_offs(struct fbb *b, const size_t *offs, size_t n)
+{
+	size_t i;
+	fbb_vec_start(b, 4, n, 4);
+	for (i = n; i > 0; i--)
+		fbb_uoff(b, offs[i - 1]);
+	return fbb_vec_end(b, n);
+}
+
+/* A vector of structs of two longs (FieldNode, Buffer) */
+static size_t fbb_vec_long2(struct fbb *b, const int64_t (*v)[2], size_t n)
+{
+	size_t i;
+	fbb_vec_start(b, 16, n, 8);
+	for (i = n; i > 0; i--) {
+		fbb_u64(b, v[i - 1][1]);
+		fbb_u64(b, v[i - 1][0]);
+	}
+	return fbb_vec_end(b, n);
+}
+
+static void fbb_start(struct fbb *b, int nfields)
+{
+	assert(nfields <= FBB_MAX_FIELDS);
+	memset(b->vt, 0, sizeof(b->vt));
+	b->vt_n = nfields;
+	b->obj_end = b->len;
+}
+
+#define FBB_ADD(_n_, _t_, _put_) \
+static void fbb_add_##_n_(struct fbb *b, int field, _t_ v) \
+{ \
+	_put_(b, v); \
+	b->vt[field] = b->len; \
+}
+FBB_ADD(u8, uint8_t, fbb_u8)
+FBB_ADD(u16, uint16_t, fbb_u16)
+FBB_ADD(u32, uint32_t, fbb_u32)
+FBB_ADD(u64, uint64_t, fbb_u64)
+FBB_ADD(off, size_t, fbb_uoff)
+
+/* End the table; its vtable is written right before it. */
+static size_t fbb_end(struct fbb *b)
+{
+	size_t obj;
+	uint32_t soff;
+	int i, n;
+
+	fbb_u32(b, 0); /* the vtable offset, set below */
+	obj = b->len;
+	for (n = b->vt_n; n > 0 && !b->vt[n - 1]; n--)
+		;
+	for (i = n - 1; i >= 0; i--)
+		fbb_u16(b, b->vt[i] ? obj - b->vt[i] : 0);
+	fbb_u16(b, obj - b->obj_end);
+	fbb_u16(b, (n + 2) * 2);
+	if (b->err)
+		return 0;
+	/* the vtable is at a lower address than the table */
+	soff = htole32(b->len - obj);
+	memcpy(b->buf + b->cap - obj, &soff, 4);
+	return obj;
+}
+
+static void fbb_finish(struct fbb *b, size_t root)
+{
+	fbb_prep(b, b->minalign, 4);
+	fbb_uoff(b, root);
+}
+
+/* ---- Arrow format ---- */
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_ALIGN 8
+#define ARROW_PAD(n) ((ARROW_ALIGN - ((n) % ARROW_ALIGN)) % ARROW_ALIGN)
+
+#define ARROW_V5 4 /* MetadataVersion */
+
+/* union MessageHeader */
+#define ARROW_H_SCHEMA 1
+#define ARROW_H_DICTIONARY_BATCH 2
+#define ARROW_H_RECORD_BATCH 3
+
+/* union Type */
+#define ARROW_T_INT 2
+#define ARROW_T_FLOAT 3
+#define ARROW_T_UTF8 5
+#define ARROW_T_TIMESTAMP 10
+#define ARROW_T_FIXED_SIZE_LIST 16
+
+#define ARROW_FP_SINGLE 1
+#define ARROW_FP_DOUBLE 2
+#define ARROW_TS_MICROSECOND 2
+
+enum arrow_kind {
+	ARROW_K_PRIM,	/* fixed-width scalar */
+	ARROW_K_TS,	/* LDMS_V_TIMESTAMP as Timestamp(us, UTC) */
+	ARROW_K_UTF8,	/* LDMS_V_CHAR(_ARRAY) */
+	ARROW_K_DICT,	/* LDMS_V_CHAR_ARRAY, dictionary encoded */
+	ARROW_K_LIST,	/* numeric array as FixedSizeList */
+};
+
+struct arrow_dict_ent {
+	struct rbn rbn;
+	int32_t idx;
+	char str[OVIS_FLEX];
+};
+
+/* The dictionary of a column; it lives as long as the file handle. */
+struct arrow_dict {
+	struct rbt rbt;
+	int32_t count;
+	int32_t written; /* entries already in the current file */
+	struct csv_buf off; /* int32 offsets of the entries into data */
+	struct csv_buf data;
+};
+
+struct arrow_col {
+	char *name;
+	enum ldms_value_type type; /* the element type for arrays */
+	enum arrow_kind kind;
+	int width; /* bytes of a value, or of an element for ARROW_K_LIST */
+	int array_len; /* ARROW_K_LIST */
+	int len_warned;
+	struct arrow_dict *dict; /* ARROW_K_DICT */
+	struct csv_buf val; /* values, indices or utf8 data */
+	struct csv_buf off; /* ARROW_K_UTF8 int32 offsets */
+};
+
+/* A file Block */
+struct arrow_block {
+	int64_t offset;
+	int32_t meta_len;
+	int64_t body_len;
+};
+
+struct arrow_blocks {
+	struct arrow_block *b;
+	int n, alloc;
+};
+
+/* A body buffer */
+struct arrow_buf {
+	const void *data;
+	int64_t len;
+};
+
+/*
+ * The output of a row schema, shared by the strgps that store to the same
+ * container/schema.
+ */
+struct arrow_file {
+	char *key; /* container/schema */
+	int ref_count; /* protected by cfg_lock */
+	pthread_mutex_t lock;
+	struct ldms_digest_s digest; /* the row schema digest */
+	char *base; /* <path>/<container>/<schema> */
+	char *filename; /* base.<time>.arrow */
+	struct csv_writer *writer;
+	time_t otime;
+	int64_t off; /* bytes written to the file */
+	int err; /* the first write error of the file */
+	struct arrow_blocks dblocks; /* DictionaryBatch messages */
+	struct arrow_blocks rblocks; /* RecordBatch messages */
+	int rows; /* rows in the column buffers */
+	struct fbb fbb; /* reused for the metadata */
+	int64_t (*nodes)[2]; /* FieldNode scratch */
+	int64_t (*bufs)[2]; /* Buffer scratch */
+	struct arrow_buf *body; /* body scratch */
+	size_t *foffs; /* field offsets scratch */
+	int col_count;
+	struct arrow_col cols[OVIS_FLEX];
+};
+
+/* A row schema of a strgp */
+struct arrow_schema_key {
+	const struct ldms_digest_s *digest;
+	const char *name;
+};
+
+struct arrow_schema_rbn {
+	struct rbn rbn;
+	struct arrow_schema_key key;
+	struct ldms_digest_s digest;
+	char name[128];
+	struct arrow_file *af; /* NULL if the rows cannot be stored */
+};
+
+/* strgp->store_handle */
+struct arrow_strgp {
+	struct rbt schema_rbt;
+};
+
+static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static idx_t file_idx; /* container/schema -> struct arrow_file */
+static char *root_path;
+static int rolltype;
+static long rollover;
+static int batch_rows = 4096;
+static size_t write_hwm = 1024 * 1024;
+
+#define ROLLTYPE_SECONDS 1
+#define ROLLTYPE_BYTES 4
+
+static const char *_help_str =
+"    config name=store_arrow path=<path> [batch_rows=<N>]\n"
+"           [rolltype=<1/4> rollover=<N>] [write_hwm=<size>]\n"
+"        path=PATH      The root directory of the output files,\n"
+"                       PATH/CONTAINER/ROW_SCHEMA.EPOCH.arrow.\n"
+"        batch_rows=N   Rows of a row schema per Arrow record batch\n"
+"                       (default 4096). A strgp flush also ends the batch.\n"
+"        rolltype=1     Close the files and start new ones every\n"
+"                       `rollover` seconds.\n"
+"        rolltype=4     Start a new file after `rollover` bytes.\n"
+"        write_hwm=SIZE Output buffered before it is handed to the\n"
+"                       writer thread (default 1M).\n"
+"\n"
+"    store_arrow only supports strgps with a decomposition.\n"
+"";
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return _help_str;
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	const char *value;
+	char *path;
+	int rt = 0, br = 4096, rc;
+	long ro = 0;
+	size_t hwm = 1024 * 1024;
+
+	value = av_value(avl, "path");
+	if (!value) {
+		LOG_ERROR("The 'path' configuration option is required.\n");
+		return EINVAL;
+	}
+	value = av_value(avl, "rolltype");
+	if (value) {
+		rt = atoi(value);
+		if (rt != ROLLTYPE_SECONDS && rt != ROLLTYPE_BYTES) {
+			LOG_ERROR("unsupported rolltype=%s\n", value);
+			return EINVAL;
+		}
+		value = av_value(avl, "rollover");
+		ro = value ? strtol(value, NULL, 0) : 0;
+		if (ro <= 0) {
+			LOG_ERROR("rolltype needs rollover > 0\n");
+			return EINVAL;
+		}
+	}
+	value = av_value(avl, "batch_rows");
+	if (value) {
+		br = atoi(value);
+		if (br <= 0) {
+			LOG_ERROR("bad batch_rows=%s\n", value);
+			return EINVAL;
+		}
+	}
+	value = av_value(avl, "write_hwm");
+	rc = csv_writer_hwm_parse(value, &hwm);
+	if (rc) {
+		LOG_ERROR("bad write_hwm=%s\n", value);
+		return rc;
+	}
+	path = strdup(av_value(avl, "path"));
+	if (!path)
+		return ENOMEM;
+
+	/* the new settings apply to the files opened from now on */
+	pthread_mutex_lock(&cfg_lock);
+	free(root_path);
+	root_path = path;
+	rolltype = rt;
+	rollover = ro;
+	batch_rows = br;
+	write_hwm = hwm;
+	pthread_mutex_unlock(&cfg_lock);
+	return 0;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	pthread_mutex_lock(&cfg_lock);
+	free(root_path);
+	root_path = NULL;
+	pthread_mutex_unlock(&cfg_lock);
+}
+
+/* ---- columns ---- */
+
+static int arrow_str_cmp(void *tree_key, const void *key)
+{
+	return strcmp(tree_key, key);
+}
+
+static void arrow_off_put(struct csv_buf *b, int32_t v)
+{
+	v = htole32(v);
+	csv_buf_putn(b, (char *)&v, 4);
+}
+
+static struct arrow_dict *arrow_dict_new(void)
+{
+	struct arrow_dict *d = calloc(1, sizeof(*d));
+	if (!d)
+		return NULL;
+	rbt_init(&d->rbt, arrow_str_cmp);
+	arrow_off_put(&d->off, 0);
+	return d;
+}
+
+static void arrow_dict_free(struct arrow_dict *d)
+{
+	struct rbn *rbn;
+	while ((rbn = rbt_min(&d->rbt))) {
+		rbt_del(&d->rbt, rbn);
+		free(rbn);
+	}
+	csv_buf_free(&d->off);
+	csv_buf_free(&d->data);
+	free(d);
+}
+
+/* \return the index of \c s, or -1 if out of memory */
+static int32_t arrow_dict_idx(struct arrow_dict *d, const char *s, size_t n)
+{
+	struct arrow_dict_ent *ent;
+	char key[n + 1];
+
+	memcpy(key, s, n);
+	key[n] = 0;
+	ent = (void *)rbt_find(&d->rbt, key);
+	if (ent)
+		return ent->idx;
+	ent = malloc(sizeof(*ent) + n + 1);
+	if (!ent)
+		return -1;
+	memcpy(ent->str, key, n + 1);
+	ent->idx = d->count++;
+	rbn_init(&ent->rbn, ent->str);
+	rbt_ins(&d->rbt, &ent->rbn);
+	csv_buf_putn(&d->data, s, n);
+	arrow_off_put(&d->off, d->data.len);
+	return ent->idx;
+}
+
+static int arrow_type_width(enum ldms_value_type type)
+{
+	switch (type) {
+	case LDMS_V_U8:
+	case LDMS_V_S8:
+		return 1;
+	case LDMS_V_U16:
+	case LDMS_V_S16:
+		return 2;
+	case LDMS_V_U32:
+	case LDMS_V_S32:
+	case LDMS_V_F32:
+		return 4;
+	case LDMS_V_U64:
+	case LDMS_V_S64:
+	case LDMS_V_D64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static void arrow_col_reset(struct arrow_col *c)
+{
+	csv_buf_reset(&c->val);
+	if (c->kind == ARROW_K_UTF8) {
+		csv_buf_reset(&c->off);
+		arrow_off_put(&c->off, 0);
+	}
+}
+
+static int arrow_col_init(struct arrow_col *c, ldmsd_col_t col)
+{
+	c->name = strdup(col->name);
+	if (!c->name)
+		return ENOMEM;
+	c->type = col->type;
+	switch (col->type) {
+	case LDMS_V_CHAR:
+		c->kind = ARROW_K_UTF8;
+		break;
+	case LDMS_V_CHAR_ARRAY:
+		if (col->metric_id == LDMSD_PHONY_METRIC_ID_PRODUCER ||
+		    col->metric_id == LDMSD_PHONY_METRIC_ID_INSTANCE) {
+			c->kind = ARROW_K_DICT;
+			c->dict = arrow_dict_new();
+			if (!c->dict)
+				return ENOMEM;
+		} else {
+			c->kind = ARROW_K_UTF8;
+		}
+		break;
+	case LDMS_V_TIMESTAMP:
+		c->kind = ARROW_K_TS;
+		c->width = 8;
+		break;
+	case LDMS_V_U8_ARRAY:
+	case LDMS_V_S8_ARRAY:
+	case LDMS_V_U16_ARRAY:
+	case LDMS_V_S16_ARRAY:
+	case LDMS_V_U32_ARRAY:
+	case LDMS_V_S32_ARRAY:
+	case LDMS_V_U64_ARRAY:
+	case LDMS_V_S64_ARRAY:
+	case LDMS_V_F32_ARRAY:
+	case LDMS_V_D64_ARRAY:
+		c->kind = ARROW_K_LIST;
+		/* the scalar types are in the same order as the arrays */
+		c->type = col->type - LDMS_V_U8_ARRAY + LDMS_V_U8;
+		c->width = arrow_type_width(c->type);
+		c->array_len = col->array_len;
+		break;
+	default:
+		c->kind = ARROW_K_PRIM;
+		c->width = arrow_type_width(col->type);
+		if (!c->width) {
+			LOG_ERROR("column '%s': %s is not supported\n",
+				  col->name, ldms_metric_type_to_str(col->type));
+			return ENOTSUP;
+		}
+		break;
+	}
+	arrow_col_reset(c);
+	return 0;
+}
+
+static void arrow_col_fini(struct arrow_col *c)
+{
+	free(c->name);
+	csv_buf_free(&c->val);
+	csv_buf_free(&c->off);
+	if (c->dict)
+		arrow_dict_free(c->dict);
+}
+
+static int arrow_col_put(struct arrow_col *c, ldmsd_col_t col)
+{
+	ldms_mval_t v = col->mval;
+	const char *s;
+	size_t n, sz;
+	int64_t ts;
+	int32_t idx;
+
+	switch (c->kind) {
+	case ARROW_K_PRIM:
+		csv_buf_putn(&c->val, (char *)v, c->width);
+		break;
+	case ARROW_K_TS:
+		ts = (int64_t)v->v_ts.sec * 1000000 + v->v_ts.usec;
+		ts = htole64(ts);
+		csv_buf_putn(&c->val, (char *)&ts, 8);
+		break;
+	case ARROW_K_UTF8:
+	case ARROW_K_DICT:
+		if (col->type == LDMS_V_CHAR) {
+			s = &v->v_char;
+			n = v->v_char ? 1 : 0;
+		} else {
+			s = v->a_char;
+			n = strnlen(s, col->array_len);
+		}
+		if (c->kind == ARROW_K_UTF8) {
+			csv_buf_putn(&c->val, s, n);
+			arrow_off_put(&c->off, c->val.len);
+			break;
+		}
+		idx = arrow_dict_idx(c->dict, s, n);
+		if (idx < 0)
+			return ENOMEM;
+		arrow_off_put(&c->val, idx);
+		break;
+	case ARROW_K_LIST:
+		/* list columns may change length; truncate or zero fill */
+		sz = (size_t)c->width * c->array_len;
+		n = (size_t)c->width * col->array_len;
+		if (n != sz && !c->len_warned) {
+			c->len_warned = 1;
+			LOG_WARN("column '%s' has %d elements instead of %d\n",
+				 c->name, col->array_len, c->array_len);
+		}
+		if (csv_buf_reserve(&c->val, sz))
+			break;
+		memcpy(&c->val.buf[c->val.len], v, n < sz ? n : sz);
+		if (n < sz)
+			memset(&c->val.buf[c->val.len + n], 0, sz - n);
+		c->val.len += sz;
+		break;
+	}
+	return c->val.err ? c->val.err : c->off.err;
+}
+
+/* ---- metadata ---- */
+
+static size_t arrow_fb_int(struct fbb *b, int bits, int is_signed)
+{
+	fbb_start(b, 2);
+	fbb_add_u32(b, 0, bits);
+	fbb_add_u8(b, 1, is_signed);
+	return fbb_end(b);
+}
+
+/* The Type table of a scalar \c type, \return the Type union type */
+static int arrow_fb_scalar_type(struct fbb *b, enum ldms_value_type type,
+				size_t *off)
+{
+	switch (type) {
+	case LDMS_V_F32:
+	case LDMS_V_D64:
+		fbb_start(b, 1);
+		fbb_add_u16(b, 0, type == LDMS_V_F32 ?
+				  ARROW_FP_SINGLE : ARROW_FP_DOUBLE);
+		*off = fbb_end(b);
+		return ARROW_T_FLOAT;
+	default:
+		*off = arrow_fb_int(b, arrow_type_width(type) * 8,
+				    type == LDMS_V_S8 || type == LDMS_V_S16 ||
+				    type == LDMS_V_S32 || type == LDMS_V_S64);
+		return ARROW_T_INT;
+	}
+}
+
+static size_t arrow_fb_field(struct fbb *b, int id, struct arrow_col *c)
+{
+	size_t name, children, type, dict = 0, tz, child[1];
+	int type_type;
+
+	name = fbb_string(b, c->name);
+	switch (c->kind) {
+	case ARROW_K_PRIM:
+		type_type = arrow_fb_scalar_type(b, c->type, &type);
+		break;
+	case ARROW_K_TS:
+		tz = fbb_string(b, "UTC");
+		fbb_start(b, 2);
+		fbb_add_u16(b, 0, ARROW_TS_MICROSECOND);
+		fbb_add_off(b, 1, tz);
+		type = fbb_end(b);
+		type_type = ARROW_T_TIMESTAMP;
+		break;
+	case ARROW_K_DICT:
+		type = arrow_fb_int(b, 32, 1);
+		/* DictionaryEncoding { id, indexType } */
+		fbb_start(b, 4);
+		fbb_add_u64(b, 0, id);
+		fbb_add_off(b, 1, type);
+		dict = fbb_end(b);
+		/* fall through */
+	case ARROW_K_UTF8:
+		fbb_start(b, 0);
+		type = fbb_end(b);
+		type_type = ARROW_T_UTF8;
+		break;
+	case ARROW_K_LIST:
+	default:
+		/* the child field "item" */
+		children = fbb_vec_offs(b, NULL, 0);
+		type_type = arrow_fb_scalar_type(b, c->type, &type);
+		name = fbb_string(b, "item");
+		fbb_start(b, 7);
+		fbb_add_off(b, 0, name);
+		fbb_add_u8(b, 1, 0);
+		fbb_add_u8(b, 2, type_type);
+		fbb_add_off(b, 3, type);
+		fbb_add_off(b, 5, children);
+		child[0] = fbb_end(b);
+		children = fbb_vec_offs(b, child, 1);
+		fbb_start(b, 1);
+		fbb_add_u32(b, 0, c->array_len);
+		type = fbb_end(b);
+		name = fbb_string(b, c->name);
+		/* Field */
+		fbb_start(b, 7);
+		fbb_add_off(b, 0, name);
+		fbb_add_u8(b, 1, 0);
+		fbb_add_u8(b, 2, ARROW_T_FIXED_SIZE_LIST);
+		fbb_add_off(b, 3, type);
+		fbb_add_off(b, 5, children);
+		return fbb_end(b);
+	}
+	children = fbb_vec_offs(b, NULL, 0);
+	/* Field */
+	fbb_start(b, 7);
+	fbb_add_off(b, 0, name);
+	fbb_add_u8(b, 1, 0); /* nullable */
+	fbb_add_u8(b, 2, type_type);
+	fbb_add_off(b, 3, type);
+	if (dict)
+		fbb_add_off(b, 4, dict);
+	fbb_add_off(b, 5, children);
+	return fbb_end(b);
+}
+
+static size_t arrow_fb_schema(struct fbb *b, struct arrow_file *af)
+{
+	size_t fields;
+	int i;
+
+	for (i = 0; i < af->col_count; i++)
+		af->foffs[i] = arrow_fb_field(b, i, &af->cols[i]);
+	fields = fbb_vec_offs(b, af->foffs, af->col_count);
+	fbb_start(b, 2);
+	fbb_add_off(b, 1, fields); /* endianness: Little (default) */
+	return fbb_end(b);
+}
+
+static size_t arrow_fb_record_batch(struct fbb *b, int64_t length,
+				    int nn, int nb, int64_t (*nodes)[2],
+				    int64_t (*bufs)[2])
+{
+	size_t vn, vb;
+
+	vb = fbb_vec_long2(b, (const int64_t (*)[2])bufs, nb);
+	vn = fbb_vec_long2(b, (const int64_t (*)[2])nodes, nn);
+	fbb_start(b, 3);
+	fbb_add_u64(b, 0, length);
+	fbb_add_off(b, 1, vn);
+	fbb_add_off(b, 2, vb);
+	return fbb_end(b);
+}
+
+static void arrow_fb_message(struct fbb *b, int type, size_t header,
+			     int64_t body_len)
+{
+	size_t msg;
+
+	fbb_start(b, 4);
+	fbb_add_u64(b, 3, body_len);
+	fbb_add_off(b, 2, header);
+	fbb_add_u16(b, 0, ARROW_V5);
+	fbb_add_u8(b, 1, type);
+	msg = fbb_end(b);
+	fbb_finish(b, msg);
+}
+
+static size_t arrow_fb_blocks(struct fbb *b, struct arrow_blocks *bl)
+{
+	int i;
+
+	fbb_vec_start(b, 24, bl->n, 8);
+	for (i = bl->n - 1; i >= 0; i--) {
+		fbb_u64(b, bl->b[i].body_len);
+		fbb_u32(b, 0); /* padding */
+		fbb_u32(b, bl->b[i].meta_len);
+		fbb_u64(b, bl->b[i].offset);
+	}
+	return fbb_vec_end(b, bl->n);
+}
+
+/* ---- file output ---- */
+
+static void arrow_out(struct arrow_file *af, const void *data, size_t len)
+{
+	int rc;
+
+	if (!len)
+		return;
+	rc = csv_writer_write(af->writer, data, len);
+	if (rc && !af->err) {
+		af->err = rc;
+		LOG_ERROR("error %d writing '%s'\n", rc, af->filename);
+	}
+	af->off += len;
+}
+
+static void arrow_pad(struct arrow_file *af, size_t n)
+{
+	static const char zero[ARROW_ALIGN];
+	arrow_out(af, zero, n);
+}
+
+static struct arrow_block *arrow_block_add(struct arrow_blocks *bl)
+{
+	struct arrow_block *b;
+
+	if (bl->n == bl->alloc) {
+		b = realloc(bl->b, (bl->alloc + 64) * sizeof(*b));
+		if (!b)
+			return NULL;
+		bl->b = b;
+		bl->alloc += 64;
+	}
+	return &bl->b[bl->n++];
+}
+
+/*
+ * Lay out the body buffers af->body[0..nb) 8-byte aligned into the
+ * Buffer structs af->bufs. \return the body length.
+ */
+static int64_t arrow_body_layout(struct arrow_file *af, int nb)
+{
+	int64_t pos = 0;
+	int i;
+
+	for (i = 0; i < nb; i++) {
+		af->bufs[i][0] = pos;
+		af->bufs[i][1] = af->body[i].len;
+		pos += af->body[i].len + ARROW_PAD(af->body[i].len);
+	}
+	return pos;
+}
+
+/*
+ * Write an encapsulated message: the metadata in af->fbb and the body
+ * buffers af->body[0..nb). \c bl is NULL for the schema message.
+ */
+static int arrow_msg_out(struct arrow_file *af, int nb, int64_t body_len,
+			 struct arrow_blocks *bl)
+{
+	struct arrow_block *blk;
+	uint32_t hdr[2];
+	size_t mlen, mpad;
+	int i;
+
+	if (af->fbb.err)
+		return af->fbb.err;
+	mlen = af->fbb.len;
+	mpad = ARROW_PAD(mlen);
+	if (bl) {
+		blk = arrow_block_add(bl);
+		if (!blk)
+			return ENOMEM;
+		blk->offset = af->off;
+		blk->meta_len = 8 + mlen + mpad;
+		blk->body_len = body_len;
+	}
+	hdr[0] = 0xFFFFFFFF; /* continuation */
+	hdr[1] = htole32(mlen + mpad);
+	arrow_out(af, hdr, 8);
+	arrow_out(af, fbb_data(&af->fbb), mlen);
+	arrow_pad(af, mpad);
+	for (i = 0; i < nb; i++) {
+		arrow_out(af, af->body[i].data, af->body[i].len);
+		arrow_pad(af, ARROW_PAD(af->body[i].len));
+	}
+	return 0;
+}
+
+/* Write the dictionary entries of column \c id added since the last one. */
+static int arrow_dict_out(struct arrow_file *af, int id)
+{
+	struct arrow_dict *d = af->cols[id].dict;
+	int32_t *off = (int32_t *)d->off.buf;
+	int32_t i, n = d->count - d->written, base;
+	struct csv_buf *ob = &af->cols[id].off; /* free while ARROW_K_DICT */
+	int64_t body_len, node[1][2] = {{n, 0}};
+	size_t rb, db;
+
+	/* the offsets of the new entries from 0 */
+	base = le32toh(off[d->written]);
+	csv_buf_reset(ob);
+	for (i = d->written; i <= d->count; i++)
+		arrow_off_put(ob, le32toh(off[i]) - base);
+	if (ob->err)
+		return ob->err;
+	af->body[0] = (struct arrow_buf){ NULL, 0 };
+	af->body[1] = (struct arrow_buf){ ob->buf, ob->len };
+	af->body[2] = (struct arrow_buf){ d->data.buf + base,
+					  le32toh(off[d->count]) - base };
+	body_len = arrow_body_layout(af, 3);
+
+	fbb_reset(&af->fbb);
+	rb = arrow_fb_record_batch(&af->fbb, n, 1, 3, node, af->bufs);
+	fbb_start(&af->fbb, 3);
+	fbb_add_u64(&af->fbb, 0, id);
+	fbb_add_off(&af->fbb, 1, rb);
+	fbb_add_u8(&af->fbb, 2, d->written != 0); /* isDelta */
+	db = fbb_end(&af->fbb);
+	arrow_fb_message(&af->fbb, ARROW_H_DICTIONARY_BATCH, db, body_len);
+	d->written = d->count;
+	return arrow_msg_out(af, 3, body_len, &af->dblocks);
+}
+
+/* Write the rows in the column buffers as a record batch and reset them. */
+static int arrow_batch_out(struct arrow_file *af)
+{
+	struct arrow_col *c;
+	int i, nn = 0, nb = 0, rc;
+	int64_t body_len;
+	size_t rb;
+
+	if (!af->rows)
+		return 0;
+	for (i = 0; i < af->col_count; i++) {
+		c = &af->cols[i];
+		if (c->kind != ARROW_K_DICT || c->dict->written == c->dict->count)
+			continue;
+		rc = arrow_dict_out(af, i);
+		if (rc)
+			goto out;
+	}
+	for (i = 0; i < af->col_count; i++) {
+		c = &af->cols[i];
+		af->nodes[nn][0] = af->rows;
+		af->nodes[nn++][1] = 0;
+		af->body[nb++] = (struct arrow_buf){ NULL, 0 }; /* validity */
+		switch (c->kind) {
+		case ARROW_K_UTF8:
+			af->body[nb++] = (struct arrow_buf){ c->off.buf, c->off.len };
+			break;
+		case ARROW_K_LIST:
+			af->nodes[nn][0] = (int64_t)af->rows * c->array_len;
+			af->nodes[nn++][1] = 0;
+			af->body[nb++] = (struct arrow_buf){ NULL, 0 };
+			break;
+		default:
+			break;
+		}
+		af->body[nb++] = (struct arrow_buf){ c->val.buf, c->val.len };
+	}
+	body_len = arrow_body_layout(af, nb);
+	fbb_reset(&af->fbb);
+	rb = arrow_fb_record_batch(&af->fbb, af->rows, nn, nb,
+				   af->nodes, af->bufs);
+	arrow_fb_message(&af->fbb, ARROW_H_RECORD_BATCH, rb, body_len);
+	rc = arrow_msg_out(af, nb, body_len, &af->rblocks);
+ out:
+	if (rc)
+		LOG_ERROR("error %d encoding a batch of '%s', %d rows dropped\n",
+			  rc, af->filename, af->rows);
+	for (i = 0; i < af->col_count; i++)
+		arrow_col_reset(&af->cols[i]);
+	af->rows = 0;
+	return rc;
+}
+
+/* Open a new file and write the magic and the schema. */
+static int arrow_file_open(struct arrow_file *af, size_t hwm)
+{
+	static const char magic[8] = ARROW_MAGIC;
+	FILE *f;
+	int i, rc;
+
+	af->otime = time(NULL);
+	free(af->filename);
+	if (asprintf(&af->filename, "%s.%ld.arrow", af->base,
+		     (long)af->otime) < 0) {
+		af->filename = NULL;
+		return ENOMEM;
+	}
+	f = fopen_perm(af->filename, "w", LDMSD_DEFAULT_FILE_PERM);
+	if (!f) {
+		rc = errno;
+		LOG_ERROR("cannot open '%s', errno: %d\n", af->filename, rc);
+		return rc;
+	}
+	af->writer = csv_writer_new(f, af->filename, hwm, &PG);
+	if (!af->writer) {
+		rc = errno;
+		fclose(f);
+		return rc;
+	}
+	af->off = 0;
+	af->err = 0;
+	af->dblocks.n = 0;
+	af->rblocks.n = 0;
+	for (i = 0; i < af->col_count; i++) {
+		if (af->cols[i].dict)
+			af->cols[i].dict->written = 0;
+	}
+	arrow_out(af, magic, sizeof(magic));
+	fbb_reset(&af->fbb);
+	arrow_fb_message(&af->fbb, ARROW_H_SCHEMA,
+			 arrow_fb_schema(&af->fbb, af), 0);
+	return arrow_msg_out(af, 0, 0, NULL);
+}
+
+/*
+ * Write the pending rows and the footer. \return the writer, to be closed
+ * with csv_writer_close() after af->lock is released.
+ */
+static struct csv_writer *arrow_file_finish(struct arrow_file *af)
+{
+	static const uint32_t eos[2] = { 0xFFFFFFFF, 0 };
+	struct csv_writer *w = af->writer;
+	size_t schema, dv, rv, footer;
+	int32_t flen;
+
+	if (!w)
+		return NULL;
+	arrow_batch_out(af);
+	arrow_out(af, eos, sizeof(eos));
+	fbb_reset(&af->fbb);
+	schema = arrow_fb_schema(&af->fbb, af);
+	dv = arrow_fb_blocks(&af->fbb, &af->dblocks);
+	rv = arrow_fb_blocks(&af->fbb, &af->rblocks);
+	fbb_start(&af->fbb, 4);
+	fbb_add_off(&af->fbb, 1, schema);
+	fbb_add_off(&af->fbb, 2, dv);
+	fbb_add_off(&af->fbb, 3, rv);
+	fbb_add_u16(&af->fbb, 0, ARROW_V5);
+	footer = fbb_end(&af->fbb);
+	fbb_finish(&af->fbb, footer);
+	if (af->fbb.err) {
+		LOG_ERROR("cannot encode the footer of '%s', error %d\n",
+			  af->filename, af->fbb.err);
+	} else {
+		flen = htole32(af->fbb.len);
+		arrow_out(af, fbb_data(&af->fbb), af->fbb.len);
+		arrow_out(af, &flen, 4);
+		arrow_out(af, ARROW_MAGIC, 6);
+	}
+	af->writer = NULL;
+	return w;
+}
+
+static void arrow_writer_close(struct arrow_file *af, struct csv_writer *w)
+{
+	int rc;
+
+	if (!w)
+		return;
+	rc = csv_writer_close(w);
+	if (rc)
+		LOG_ERROR("error %d closing an output of '%s'\n", rc, af->key);
+}
+
+static void arrow_file_free(struct arrow_file *af)
+{
+	int i;
+
+	for (i = 0; i < af->col_count; i++)
+		arrow_col_fini(&af->cols[i]);
+	fbb_free(&af->fbb);
+	free(af->dblocks.b);
+	free(af->rblocks.b);
+	free(af->nodes);
+	free(af->bufs);
+	free(af->body);
+	free(af->foffs);
+	free(af->filename);
+	free(af->base);
+	free(af->key);
+	pthread_mutex_destroy(&af->lock);
+	free(af);
+}
+
+/* caller must hold cfg_lock */
+static struct arrow_file *arrow_file_new(const char *container, ldmsd_row_t row)
+{
+	struct arrow_file *af;
+	char *dir = NULL;
+	int i, rc;
+
+	af = calloc(1, sizeof(*af) + row->col_count * sizeof(af->cols[0]));
+	if (!af)
+		goto enomem;
+	pthread_mutex_init(&af->lock, NULL);
+	af->col_count = row->col_count;
+	memcpy(&af->digest, row->schema_digest, sizeof(af->digest));
+	if (asprintf(&af->key, "%s/%s", container, row->schema_name) < 0) {
+		af->key = NULL;
+		goto enomem;
+	}
+	if (asprintf(&af->base, "%s/%s", root_path, af->key) < 0) {
+		af->base = NULL;
+		goto enomem;
+	}
+	/* at most two nodes and three buffers per column */
+	af->nodes = calloc(2 * af->col_count, sizeof(*af->nodes));
+	af->bufs = calloc(3 * af->col_count + 3, sizeof(*af->bufs));
+	af->body = calloc(3 * af->col_count + 3, sizeof(*af->body));
+	af->foffs = calloc(af->col_count, sizeof(*af->foffs));
+	if (!af->nodes || !af->bufs || !af->body || !af->foffs)
+		goto enomem;
+	for (i = 0; i < af->col_count; i++) {
+		rc = arrow_col_init(&af->cols[i], &row->cols[i]);
+		if (rc)
+			goto err;
+	}
+	if (asprintf(&dir, "%s/%s", root_path, container) < 0) {
+		dir = NULL;
+		goto enomem;
+	}
+	rc = f_mkdir_p(dir, 0755);
+	if (rc && rc != EEXIST) {
+		LOG_ERROR("cannot create the directory '%s', error %d\n",
+			  dir, rc);
+		goto err;
+	}
+	free(dir);
+	dir = NULL;
+	rc = arrow_file_open(af, write_hwm);
+	if (rc)
+		goto err;
+	af->ref_count = 1;
+	idx_add(file_idx, af->key, strlen(af->key), af);
+	return af;
+
+ enomem:
+	rc = ENOMEM;
+	LOG_ERROR("Not enough memory (%s:%s():%d)\n", __FILE__, __func__, __LINE__);
+ err:
+	free(dir);
+	if (af) {
+		if (af->writer)
+			csv_writer_close(af->writer);
+		arrow_file_free(af);
+	}
+	errno = rc;
+	return NULL;
+}
+
+/* caller must hold cfg_lock */
+static void arrow_file_put(struct arrow_file *af)
+{
+	struct csv_writer *w;
+
+	if (--af->ref_count)
+		return;
+	idx_delete(file_idx, af->key, strlen(af->key));
+	pthread_mutex_lock(&af->lock);
+	w = arrow_file_finish(af);
+	pthread_mutex_unlock(&af->lock);
+	arrow_writer_close(af, w);
+	arrow_file_free(af);
+}
+
+/* caller must hold af->lock; \return the old writer to close */
+static struct csv_writer *arrow_file_roll_check(struct arrow_file *af)
+{
+	struct csv_writer *w;
+	size_t hwm;
+	int rt;
+	long ro;
+
+	pthread_mutex_lock(&cfg_lock);
+	rt = rolltype;
+	ro = rollover;
+	hwm = write_hwm;
+	pthread_mutex_unlock(&cfg_lock);
+	switch (rt) {
+	case ROLLTYPE_SECONDS:
+		if (time(NULL) - af->otime < ro)
+			return NULL;
+		break;
+	case ROLLTYPE_BYTES:
+		if (af->off < ro)
+			return NULL;
+		break;
+	default:
+		return NULL;
+	}
+	if (af->otime == time(NULL))
+		return NULL; /* the new file would have the same name */
+	w = arrow_file_finish(af);
+	if (arrow_file_open(af, hwm))
+		LOG_ERROR("cannot roll '%s', its rows are dropped until "
+			  "the next roll\n", af->key);
+	return w;
+}
+
+/* ---- store interface ---- */
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	errno = ENOSYS;
+	LOG_ERROR("store_arrow does not support `open_store()` interface (non-decomposition strgp)\n");
+	return NULL;
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	/* ucontext is for deprecated `open_store()` API */
+	return NULL;
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set,
+      int *metric_arry, size_t metric_count)
+{
+	errno = ENOSYS;
+	LOG_ERROR("store_arrow does not support `store()` interface (non-decomposition strgp)\n");
+	return ENOSYS;
+}
+
+/* protected by strgp->lock */
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	struct arrow_strgp *sh = _sh;
+	struct arrow_schema_rbn *rrbn;
+	struct csv_writer *w;
+	struct rbn *rbn;
+
+	if (!sh)
+		return 0;
+	RBT_FOREACH(rbn, &sh->schema_rbt) {
+		rrbn = container_of(rbn, struct arrow_schema_rbn, rbn);
+		if (!rrbn->af)
+			continue;
+		pthread_mutex_lock(&rrbn->af->lock);
+		w = NULL;
+		if (rrbn->af->writer) {
+			arrow_batch_out(rrbn->af);
+			csv_writer_flush(rrbn->af->writer, 0);
+			w = arrow_file_roll_check(rrbn->af);
+		}
+		pthread_mutex_unlock(&rrbn->af->lock);
+		arrow_writer_close(rrbn->af, w);
+	}
+	return 0;
+}
+
+/* protected by strgp->lock */
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct arrow_strgp *sh = _sh;
+	struct arrow_schema_rbn *rrbn;
+
+	if (!sh)
+		return;
+	pthread_mutex_lock(&cfg_lock);
+	while ((rrbn = (void *)rbt_min(&sh->schema_rbt))) {
+		rbt_del(&sh->schema_rbt, &rrbn->rbn);
+		if (rrbn->af)
+			arrow_file_put(rrbn->af);
+		free(rrbn);
+	}
+	pthread_mutex_unlock(&cfg_lock);
+	free(sh);
+}
+
+static int arrow_schema_key_cmp(void *tree_key, const void *key)
+{
+	const struct arrow_schema_key *tk = tree_key, *k = key;
+	int rc;
+
+	rc = memcmp(tk->digest, k->digest, sizeof(*tk->digest));
+	if (rc)
+		return rc;
+	return strcmp(tk->name, k->name);
+}
+
+/* protected by strgp->lock */
+static struct arrow_schema_rbn *
+arrow_schema_get(ldmsd_strgp_t strgp, struct arrow_strgp *sh, ldmsd_row_t row)
+{
+	struct arrow_schema_key key = { row->schema_digest, row->schema_name };
+	struct arrow_schema_rbn *rrbn;
+	struct arrow_file *af;
+	char *k;
+
+	rrbn = (void *)rbt_find(&sh->schema_rbt, &key);
+	if (rrbn)
+		return rrbn;
+	rrbn = calloc(1, sizeof(*rrbn));
+	if (!rrbn) {
+		LOG_ERROR("Not enough memory (%s:%s():%d)\n", __FILE__, __func__, __LINE__);
+		return NULL;
+	}
+	snprintf(rrbn->name, sizeof(rrbn->name), "%s", row->schema_name);
+	memcpy(&rrbn->digest, row->schema_digest, sizeof(rrbn->digest));
+	rrbn->key.name = rrbn->name;
+	rrbn->key.digest = &rrbn->digest;
+	rbn_init(&rrbn->rbn, &rrbn->key);
+
+	pthread_mutex_lock(&cfg_lock);
+	if (!root_path) {
+		LOG_ERROR("config not called, the rows of '%s' are dropped\n",
+			  rrbn->name);
+		goto out;
+	}
+	if (asprintf(&k, "%s/%s", strgp->container, row->schema_name) < 0)
+		goto out;
+	af = idx_find(file_idx, k, strlen(k));
+	free(k);
+	if (af) {
+		if (memcmp(&af->digest, row->schema_digest, sizeof(af->digest))) {
+			/* an Arrow file has one schema */
+			LOG_ERROR("row schema '%s' of strgp '%s' differs from "
+				  "the one in '%s', its rows are dropped\n",
+				  rrbn->name, strgp->obj.name, af->key);
+			goto out;
+		}
+		af->ref_count++;
+		rrbn->af = af;
+	} else {
+		/* errors are logged; rows of this schema are dropped */
+		rrbn->af = arrow_file_new(strgp->container, row);
+	}
+ out:
+	pthread_mutex_unlock(&cfg_lock);
+	rbt_ins(&sh->schema_rbt, &rrbn->rbn);
+	return rrbn;
+}
+
+/* protected by strgp->lock */
+static int
+commit_rows(ldmsd_strgp_t strgp, ldms_set_t set, ldmsd_row_list_t row_list,
+	    int row_count)
+{
+	struct arrow_strgp *sh;
+	struct arrow_schema_rbn *rrbn;
+	struct arrow_file *af;
+	struct csv_writer *w;
+	ldmsd_row_t row;
+	int i, rc, br;
+
+	sh = strgp->store_handle;
+	if (!sh) {
+		sh = calloc(1, sizeof(*sh));
+		if (!sh)
+			return ENOMEM;
+		rbt_init(&sh->schema_rbt, arrow_schema_key_cmp);
+		strgp->store_handle = sh;
+	}
+	pthread_mutex_lock(&cfg_lock);
+	br = batch_rows;
+	pthread_mutex_unlock(&cfg_lock);
+
+	TAILQ_FOREACH(row, row_list, entry) {
+		rrbn = arrow_schema_get(strgp, sh, row);
+		if (!rrbn || !rrbn->af)
+			continue;
+		af = rrbn->af;
+		pthread_mutex_lock(&af->lock);
+		if (!af->writer) {
+			pthread_mutex_unlock(&af->lock);
+			continue;
+		}
+		rc = 0;
+		for (i = 0; i < row->col_count; i++) {
+			rc = arrow_col_put(&af->cols[i], &row->cols[i]);
+			if (rc)
+				break;
+		}
+		if (rc) {
+			/* the row is partially in the columns */
+			LOG_ERROR("error %d adding a row of '%s', the batch is "
+				  "dropped\n", rc, af->key);
+			for (i = 0; i < af->col_count; i++)
+				arrow_col_reset(&af->cols[i]);
+			af->rows = 0;
+		} else {
+			af->rows++;
+		}
+		w = NULL;
+		if (af->rows >= br) {
+			arrow_batch_out(af);
+			w = arrow_file_roll_check(af);
+		}
+		pthread_mutex_unlock(&af->lock);
+		arrow_writer_close(af, w);
+	}
+	return 0;
+}
+
+static struct ldmsd_store store_arrow = {
+	.base = {
+		.name = "arrow",
+		.term = term,
+		.config = config,
+		.usage = usage,
+		.type = LDMSD_PLUGIN_STORE,
+	},
+	.open = open_store,
+	.get_context = get_ucontext,
+	.store = store,
+	.flush = flush_store,
+	.close = close_store,
+	.commit = commit_rows,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	PG.msglog = pf;
+	PG.pname = PNAME;
+	return &store_arrow.base;
+}
+
+static void __attribute__ ((constructor)) store_arrow_init(void)
+{
+	file_idx = idx_create();
+}
+
+static void __attribute__ ((destructor)) store_arrow_fini(void)
+{
+	idx_destroy(file_idx);
+	free(root_path);
+	root_path = NULL;
+}
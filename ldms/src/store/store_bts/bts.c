@@ -0,0 +1,1207 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bts.c
+ * \brief The segment writer and reader of the LDMS binary time-series
+ * store, see bts.h for the file layout.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <coll/rbt.h>
+#include "bts.h"
+
+#define BTS_HDR_ALIGN 4096
+#define BTS_ALIGN(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+size_t bts_type_size(enum ldms_value_type type)
+{
+	switch (type) {
+	case LDMS_V_CHAR:
+	case LDMS_V_U8:
+	case LDMS_V_S8:
+	case LDMS_V_CHAR_ARRAY:
+	case LDMS_V_U8_ARRAY:
+	case LDMS_V_S8_ARRAY:
+		return 1;
+	case LDMS_V_U16:
+	case LDMS_V_S16:
+	case LDMS_V_U16_ARRAY:
+	case LDMS_V_S16_ARRAY:
+		return 2;
+	case LDMS_V_U32:
+	case LDMS_V_S32:
+	case LDMS_V_F32:
+	case LDMS_V_U32_ARRAY:
+	case LDMS_V_S32_ARRAY:
+	case LDMS_V_F32_ARRAY:
+		return 4;
+	case LDMS_V_U64:
+	case LDMS_V_S64:
+	case LDMS_V_D64:
+	case LDMS_V_U64_ARRAY:
+	case LDMS_V_S64_ARRAY:
+	case LDMS_V_D64_ARRAY:
+	case LDMS_V_TIMESTAMP:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/* ---- segment files of a directory ---- */
+
+struct bts_seg_ent {
+	char *name; /* the file name */
+	size_t schema_len;
+	unsigned long seq;
+};
+
+static int bts_seg_ent_cmp(const void *a, const void *b)
+{
+	const struct bts_seg_ent *x = a, *y = b;
+	size_t n = x->schema_len < y->schema_len ? x->schema_len : y->schema_len;
+	int rc;
+
+	rc = memcmp(x->name, y->name, n);
+	if (rc)
+		return rc;
+	if (x->schema_len != y->schema_len)
+		return x->schema_len < y->schema_len ? -1 : 1;
+	if (x->seq != y->seq)
+		return x->seq < y->seq ? -1 : 1;
+	return 0;
+}
+
+/* Parse "SCHEMA.SEQ.bts"; \return 0 if \c name is a segment file. */
+static int bts_seg_name_parse(const char *name, size_t *schema_len,
+			      unsigned long *seq)
+{
+	size_t len = strlen(name), sfx = strlen(BTS_SUFFIX);
+	const char *p, *end;
+
+	if (len <= sfx || strcmp(name + len - sfx, BTS_SUFFIX))
+		return -1;
+	end = name + len - sfx;
+	for (p = end; p > name && isdigit(p[-1]); p--)
+		;
+	if (p == end || p - 1 <= name || p[-1] != '.')
+		return -1;
+	*seq = strtoul(p, NULL, 10);
+	*schema_len = p - 1 - name;
+	return 0;
+}
+
+/* \return the number of entries, or -errno */
+static int bts_seg_ents(const char *dir, const char *schema,
+			struct bts_seg_ent **pents)
+{
+	struct bts_seg_ent *ents = NULL, *e;
+	struct dirent *de;
+	int n = 0, alloc = 0, rc;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return -errno;
+	while ((de = readdir(d))) {
+		struct bts_seg_ent ent;
+		if (bts_seg_name_parse(de->d_name, &ent.schema_len, &ent.seq))
+			continue;
+		if (schema && (strlen(schema) != ent.schema_len ||
+			       strncmp(schema, de->d_name, ent.schema_len)))
+			continue;
+		if (n == alloc) {
+			alloc = alloc ? alloc * 2 : 16;
+			e = realloc(ents, alloc * sizeof(*ents));
+			if (!e)
+				goto enomem;
+			ents = e;
+		}
+		ent.name = strdup(de->d_name);
+		if (!ent.name)
+			goto enomem;
+		ents[n++] = ent;
+	}
+	closedir(d);
+	qsort(ents, n, sizeof(*ents), bts_seg_ent_cmp);
+	*pents = ents;
+	return n;
+ enomem:
+	rc = -ENOMEM;
+	closedir(d);
+	while (n)
+		free(ents[--n].name);
+	free(ents);
+	return rc;
+}
+
+int bts_seg_list(const char *dir, const char *schema, char ***paths)
+{
+	struct bts_seg_ent *ents = NULL;
+	char **p;
+	int i, n;
+
+	n = bts_seg_ents(dir, schema, &ents);
+	if (n < 0)
+		return n;
+	p = calloc(n + 1, sizeof(*p));
+	for (i = 0; p && i < n; i++) {
+		if (asprintf(&p[i], "%s/%s", dir, ents[i].name) < 0) {
+			p[i] = NULL;
+			bts_seg_list_free(p, i);
+			p = NULL;
+		}
+	}
+	for (i = 0; i < n; i++)
+		free(ents[i].name);
+	free(ents);
+	if (!p)
+		return -ENOMEM;
+	*paths = p;
+	return n;
+}
+
+void bts_seg_list_free(char **paths, int count)
+{
+	int i;
+	for (i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+}
+
+/* ---- writer ---- */
+
+/* The record numbers of a component in the open segment */
+struct bts_comp {
+	struct rbn rbn;
+	uint64_t comp_id;
+	uint32_t *recs; /* little-endian, as in the .cidx file */
+	uint32_t n, alloc;
+};
+
+struct bts_writer_s {
+	char *dir;
+	char *schema;
+	void *tmpl; /* the header of a new segment */
+	uint32_t hdr_size;
+	uint32_t rec_size;
+	uint64_t capacity;
+	int stride;
+	mode_t perm;
+
+	unsigned long seq;
+	char *base; /* DIR/SCHEMA.SEQ */
+	int fd;
+	int tfd; /* the .tidx file */
+	int cfd; /* the .cidx file */
+	uint8_t *map;
+	size_t map_len;
+	struct bts_hdr_s *hdr;
+	uint64_t count;
+	uint8_t *rec; /* from bts_writer_rec_begin() */
+	uint64_t rec_ts;
+	uint64_t rec_comp_id;
+
+	/* the block of the time index being filled */
+	uint64_t blk_first;
+	uint64_t blk_ts_min;
+	uint64_t blk_ts_max;
+	uint64_t ts_min;
+	uint64_t ts_max;
+
+	/* the postings of the records from cidx_first, not yet in the .cidx */
+	struct rbt comp_rbt;
+	struct bts_comp *last_comp;
+	uint64_t cidx_first;
+	int cidx_err; /* no more component index for the segment */
+};
+
+static int bts_comp_cmp(void *tree_key, const void *key)
+{
+	uint64_t a = *(uint64_t *)tree_key, b = *(const uint64_t *)key;
+	return a < b ? -1 : a > b;
+}
+
+static void bts_comps_free(bts_writer_t w)
+{
+	struct bts_comp *c;
+
+	while ((c = (void *)rbt_min(&w->comp_rbt))) {
+		rbt_del(&w->comp_rbt, &c->rbn);
+		free(c->recs);
+		free(c);
+	}
+	w->last_comp = NULL;
+	w->cidx_err = 0;
+}
+
+static void bts_comp_add(bts_writer_t w, uint64_t comp_id, uint64_t rec)
+{
+	struct bts_comp *c = w->last_comp;
+	uint32_t *recs;
+
+	if (w->cidx_err)
+		return;
+	if (!c || c->comp_id != comp_id) {
+		c = (void *)rbt_find(&w->comp_rbt, &comp_id);
+		if (!c) {
+			c = calloc(1, sizeof(*c));
+			if (!c)
+				goto enomem;
+			c->comp_id = comp_id;
+			rbn_init(&c->rbn, &c->comp_id);
+			rbt_ins(&w->comp_rbt, &c->rbn);
+		}
+		w->last_comp = c;
+	}
+	if (c->n == c->alloc) {
+		recs = realloc(c->recs, (c->alloc ? c->alloc * 2 : 64) *
+				sizeof(*recs));
+		if (!recs)
+			goto enomem;
+		c->recs = recs;
+		c->alloc = c->alloc ? c->alloc * 2 : 64;
+	}
+	c->recs[c->n++] = htole32(rec);
+	return;
+ enomem:
+	/* the readers scan the records instead */
+	w->cidx_err = ENOMEM;
+}
+
+/*
+ * Append the postings of the records since the last chunk to the .cidx.
+ * The postings are reset, so a flush writes only the new records.
+ */
+static int bts_cidx_append(bts_writer_t w)
+{
+	struct bts_cidx_chunk_s *chunk;
+	struct bts_cidx_ent_s *ent;
+	struct bts_comp *c;
+	uint32_t *recs;
+	uint64_t comps = 0, posts = 0;
+	size_t len;
+	ssize_t n;
+	int rc;
+
+	if (w->cidx_err)
+		return w->cidx_err;
+	if (w->count == w->cidx_first)
+		return 0;
+	for (c = (void *)rbt_min(&w->comp_rbt); c; c = (void *)rbn_succ(&c->rbn)) {
+		if (!c->n)
+			continue;
+		comps++;
+		posts += c->n;
+	}
+	/* the next chunk is 8-byte aligned */
+	len = BTS_ALIGN(sizeof(*chunk) + comps * sizeof(*ent) +
+			posts * sizeof(*recs), 8);
+	chunk = calloc(1, len);
+	if (!chunk) {
+		rc = ENOMEM;
+		goto err;
+	}
+	chunk->rec_first = htole64(w->cidx_first);
+	chunk->rec_count = htole64(w->count - w->cidx_first);
+	chunk->comp_count = htole64(comps);
+	chunk->post_count = htole64(posts);
+	ent = (void *)(chunk + 1);
+	recs = (void *)(ent + comps);
+	posts = 0;
+	for (c = (void *)rbt_min(&w->comp_rbt); c; c = (void *)rbn_succ(&c->rbn)) {
+		if (!c->n)
+			continue;
+		ent->comp_id = htole64(c->comp_id);
+		ent->first = htole64(posts);
+		ent->count = htole64(c->n);
+		ent++;
+		memcpy(recs + posts, c->recs, c->n * sizeof(*recs));
+		posts += c->n;
+		c->n = 0;
+	}
+	n = write(w->cfd, chunk, len);
+	free(chunk);
+	if (n != len) {
+		rc = n < 0 ? errno : EIO;
+		goto err;
+	}
+	w->cidx_first = w->count;
+	return 0;
+ err:
+	/*
+	 * The chunks must cover the records without a gap; the readers
+	 * scan the records after the last complete chunk.
+	 */
+	w->cidx_err = rc;
+	return rc;
+}
+
+/* Add the block being filled to the time index. */
+static int bts_block_end(bts_writer_t w)
+{
+	struct bts_block_s b;
+	ssize_t n;
+
+	if (w->count == w->blk_first)
+		return 0;
+	b.ts_min = htole64(w->blk_ts_min);
+	b.ts_max = htole64(w->blk_ts_max);
+	b.first = htole64(w->blk_first);
+	b.count = htole64(w->count - w->blk_first);
+	n = write(w->tfd, &b, sizeof(b));
+	if (n != sizeof(b))
+		return n < 0 ? errno : EIO;
+	if (w->blk_ts_min < w->ts_min)
+		w->ts_min = w->blk_ts_min;
+	if (w->blk_ts_max > w->ts_max)
+		w->ts_max = w->blk_ts_max;
+	w->hdr->ts_min = htole64(w->ts_min);
+	w->hdr->ts_max = htole64(w->ts_max);
+	w->blk_first = w->count;
+	w->blk_ts_min = UINT64_MAX;
+	w->blk_ts_max = 0;
+	return 0;
+}
+
+/* Create the next segment file and map it. */
+static int bts_seg_create(bts_writer_t w)
+{
+	char *path;
+	int rc;
+
+	w->map_len = w->hdr_size + w->capacity * w->rec_size;
+	while (1) {
+		free(w->base);
+		if (asprintf(&w->base, "%s/%s.%lu", w->dir, w->schema,
+			     w->seq) < 0) {
+			w->base = NULL;
+			return ENOMEM;
+		}
+		if (asprintf(&path, "%s" BTS_SUFFIX, w->base) < 0)
+			return ENOMEM;
+		w->fd = open(path, O_RDWR | O_CREAT | O_EXCL, w->perm);
+		rc = errno;
+		free(path);
+		if (w->fd >= 0)
+			break;
+		if (rc != EEXIST)
+			return rc;
+		/* e.g. another strgp storing the same schema */
+		w->seq++;
+	}
+	/*
+	 * Reserve the blocks now. The records are written through the
+	 * mapping, where a full file system raises SIGBUS instead of
+	 * returning an error.
+	 */
+	rc = posix_fallocate(w->fd, 0, w->map_len);
+	if (rc) {
+		errno = rc;
+		goto err;
+	}
+	w->map = mmap(NULL, w->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		      w->fd, 0);
+	if (w->map == MAP_FAILED) {
+		w->map = NULL;
+		goto err;
+	}
+	if (asprintf(&path, "%s" BTS_TIDX_SUFFIX, w->base) < 0) {
+		errno = ENOMEM;
+		goto err;
+	}
+	w->tfd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, w->perm);
+	free(path);
+	if (w->tfd < 0)
+		goto err;
+	/* the segment is stored without a component index on error */
+	w->cidx_first = 0;
+	if (asprintf(&path, "%s" BTS_CIDX_SUFFIX, w->base) < 0) {
+		w->cidx_err = ENOMEM;
+	} else {
+		w->cfd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+			      w->perm);
+		w->cidx_err = w->cfd < 0 ? errno : 0;
+		free(path);
+	}
+	if (!w->cidx_err &&
+	    write(w->cfd, BTS_CIDX_MAGIC, sizeof(BTS_CIDX_MAGIC) - 1) !=
+	    sizeof(BTS_CIDX_MAGIC) - 1)
+		w->cidx_err = EIO;
+	memcpy(w->map, w->tmpl, w->hdr_size);
+	w->hdr = (void *)w->map;
+	w->count = 0;
+	w->blk_first = 0;
+	w->blk_ts_min = w->ts_min = UINT64_MAX;
+	w->blk_ts_max = w->ts_max = 0;
+	return 0;
+ err:
+	rc = errno;
+	if (w->map)
+		munmap(w->map, w->map_len);
+	w->map = NULL;
+	close(w->fd);
+	w->fd = -1;
+	if (asprintf(&path, "%s" BTS_SUFFIX, w->base) >= 0) {
+		unlink(path);
+		free(path);
+	}
+	return rc;
+}
+
+/* Index the rest of the records, mark the segment closed and unmap it. */
+static int bts_seg_finish(bts_writer_t w)
+{
+	int rc, rc2;
+
+	rc = bts_block_end(w);
+	rc2 = bts_cidx_append(w);
+	if (!rc)
+		rc = rc2;
+	w->hdr->flags |= htole32(BTS_F_CLOSED);
+	if (msync(w->map, w->map_len, MS_ASYNC) && !rc)
+		rc = errno;
+	munmap(w->map, w->map_len);
+	w->map = NULL;
+	w->hdr = NULL;
+	/* give back the unused records */
+	if (ftruncate(w->fd, w->hdr_size + w->count * w->rec_size) && !rc)
+		rc = errno;
+	close(w->fd);
+	close(w->tfd);
+	if (w->cfd >= 0)
+		close(w->cfd);
+	w->fd = w->tfd = w->cfd = -1;
+	bts_comps_free(w);
+	w->seq++;
+	return rc;
+}
+
+bts_writer_t bts_writer_open(const char *dir, const char *schema,
+			     const struct bts_col_def *cols, int col_count,
+			     size_t seg_size, int stride, mode_t perm)
+{
+	struct bts_seg_ent *ents = NULL;
+	struct bts_hdr_s *hdr;
+	bts_writer_t w;
+	size_t off, esz, names, str;
+	int i, n, rc;
+
+	if (!col_count || stride <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+	w->fd = w->tfd = w->cfd = -1;
+	w->stride = stride;
+	w->perm = perm;
+	rbt_init(&w->comp_rbt, bts_comp_cmp);
+	w->dir = strdup(dir);
+	w->schema = strdup(schema);
+	if (!w->dir || !w->schema)
+		goto enomem;
+
+	/* the values at their natural alignment after the record header */
+	off = BTS_REC_HDR_SIZE;
+	names = strlen(schema) + 1;
+	for (i = 0; i < col_count; i++) {
+		esz = bts_type_size(cols[i].type);
+		if (!esz || !cols[i].array_len) {
+			rc = EINVAL;
+			goto err;
+		}
+		off = BTS_ALIGN(off, esz);
+		off += esz * cols[i].array_len;
+		names += strlen(cols[i].name) + 1;
+	}
+	w->rec_size = BTS_ALIGN(off, 8);
+	str = sizeof(*hdr) + col_count * sizeof(hdr->cols[0]);
+	w->hdr_size = BTS_ALIGN(str + names, BTS_HDR_ALIGN);
+	w->capacity = seg_size > w->hdr_size ?
+			(seg_size - w->hdr_size) / w->rec_size : 0;
+	if (!w->capacity)
+		w->capacity = 1;
+	if (w->capacity > UINT32_MAX) /* the .cidx record numbers */
+		w->capacity = UINT32_MAX;
+
+	w->tmpl = calloc(1, w->hdr_size);
+	if (!w->tmpl)
+		goto enomem;
+	hdr = w->tmpl;
+	memcpy(hdr->magic, BTS_MAGIC, sizeof(hdr->magic));
+	hdr->version = htole32(BTS_VERSION);
+	hdr->hdr_size = htole32(w->hdr_size);
+	hdr->rec_size = htole32(w->rec_size);
+	hdr->col_count = htole32(col_count);
+	hdr->capacity = htole64(w->capacity);
+	hdr->ts_min = htole64(UINT64_MAX);
+	hdr->schema_off = htole32(str);
+	strcpy((char *)w->tmpl + str, schema);
+	str += strlen(schema) + 1;
+	off = BTS_REC_HDR_SIZE;
+	for (i = 0; i < col_count; i++) {
+		esz = bts_type_size(cols[i].type);
+		off = BTS_ALIGN(off, esz);
+		hdr->cols[i].name_off = htole32(str);
+		hdr->cols[i].type = htole16(cols[i].type);
+		hdr->cols[i].array_len = htole32(cols[i].array_len);
+		hdr->cols[i].offset = htole32(off);
+		off += esz * cols[i].array_len;
+		strcpy((char *)w->tmpl + str, cols[i].name);
+		str += strlen(cols[i].name) + 1;
+	}
+
+	/* follow the existing segments of the schema */
+	n = bts_seg_ents(dir, schema, &ents);
+	if (n < 0) {
+		rc = -n;
+		goto err;
+	}
+	if (n)
+		w->seq = ents[n - 1].seq + 1;
+	for (i = 0; i < n; i++)
+		free(ents[i].name);
+	free(ents);
+
+	rc = bts_seg_create(w);
+	/* out of space: bts_writer_rec_begin() retries and reports it */
+	if (rc && rc != ENOSPC)
+		goto err;
+	return w;
+ enomem:
+	rc = ENOMEM;
+ err:
+	free(w->tmpl);
+	free(w->base);
+	free(w->schema);
+	free(w->dir);
+	free(w);
+	errno = rc;
+	return NULL;
+}
+
+uint32_t bts_writer_col_offset(bts_writer_t w, int col)
+{
+	return le32toh(((struct bts_hdr_s *)w->tmpl)->cols[col].offset);
+}
+
+void *bts_writer_rec_begin(bts_writer_t w, uint64_t ts, uint64_t comp_id)
+{
+	uint64_t *rec;
+	int rc;
+
+	if (w->map && w->count == w->capacity) {
+		rc = bts_seg_finish(w);
+		if (rc) {
+			errno = rc;
+			return NULL;
+		}
+	}
+	if (!w->map) {
+		/* a new segment, or a retry after a failure */
+		rc = bts_seg_create(w);
+		if (rc) {
+			errno = rc;
+			return NULL;
+		}
+	}
+	rec = (void *)(w->map + w->hdr_size + w->count * w->rec_size);
+	rec[0] = htole64(ts);
+	rec[1] = htole64(comp_id);
+	w->rec = (void *)rec;
+	w->rec_ts = ts;
+	w->rec_comp_id = comp_id;
+	return rec;
+}
+
+void bts_writer_rec_end(bts_writer_t w)
+{
+	if (!w->rec)
+		return;
+	w->rec = NULL;
+	bts_comp_add(w, w->rec_comp_id, w->count);
+	if (w->rec_ts < w->blk_ts_min)
+		w->blk_ts_min = w->rec_ts;
+	if (w->rec_ts > w->blk_ts_max)
+		w->blk_ts_max = w->rec_ts;
+	w->count++;
+	/* the readers see the record when they see the count */
+	__atomic_store_n(&w->hdr->count, htole64(w->count), __ATOMIC_RELEASE);
+	if (w->count - w->blk_first >= w->stride)
+		bts_block_end(w);
+}
+
+int bts_writer_flush(bts_writer_t w)
+{
+	int rc, rc2;
+
+	if (!w->map)
+		return 0;
+	rc = bts_block_end(w);
+	rc2 = bts_cidx_append(w);
+	if (!rc)
+		rc = rc2;
+	if (msync(w->map, w->hdr_size + w->count * w->rec_size, MS_ASYNC) &&
+	    !rc)
+		rc = errno;
+	return rc;
+}
+
+int bts_writer_close(bts_writer_t w)
+{
+	int rc = 0;
+
+	if (w->map)
+		rc = bts_seg_finish(w);
+	free(w->tmpl);
+	free(w->base);
+	free(w->schema);
+	free(w->dir);
+	free(w);
+	return rc;
+}
+
+/* ---- reader ---- */
+
+struct bts_seg_s {
+	char *base; /* the path without the suffix */
+	uint8_t *map;
+	size_t map_len;
+	struct bts_hdr_s *hdr;
+	uint32_t hdr_size;
+	uint32_t rec_size;
+	int col_count;
+};
+
+bts_seg_t bts_seg_open(const char *path)
+{
+	size_t len = strlen(path), sfx = strlen(BTS_SUFFIX), end;
+	struct bts_hdr_s *hdr;
+	struct stat st;
+	bts_seg_t seg;
+	int fd, i, rc;
+
+	if (len <= sfx || strcmp(path + len - sfx, BTS_SUFFIX)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	seg = calloc(1, sizeof(*seg));
+	if (!seg)
+		return NULL;
+	seg->base = strndup(path, len - sfx);
+	if (!seg->base) {
+		rc = ENOMEM;
+		goto err;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		rc = errno;
+		goto err;
+	}
+	if (fstat(fd, &st)) {
+		rc = errno;
+		close(fd);
+		goto err;
+	}
+	if (st.st_size < sizeof(*hdr)) {
+		close(fd);
+		rc = EINVAL;
+		goto err;
+	}
+	seg->map_len = st.st_size;
+	seg->map = mmap(NULL, seg->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	rc = errno;
+	close(fd);
+	if (seg->map == MAP_FAILED) {
+		seg->map = NULL;
+		goto err;
+	}
+	rc = EINVAL;
+	hdr = seg->hdr = (void *)seg->map;
+	if (memcmp(hdr->magic, BTS_MAGIC, sizeof(hdr->magic)) ||
+	    le32toh(hdr->version) != BTS_VERSION)
+		goto err;
+	seg->hdr_size = le32toh(hdr->hdr_size);
+	seg->rec_size = le32toh(hdr->rec_size);
+	seg->col_count = le32toh(hdr->col_count);
+	if (seg->hdr_size > seg->map_len || seg->rec_size < BTS_REC_HDR_SIZE ||
+	    sizeof(*hdr) + seg->col_count * sizeof(hdr->cols[0]) > seg->hdr_size)
+		goto err;
+	/* the strings and the values must be in bounds */
+	if (le32toh(hdr->schema_off) >= seg->hdr_size ||
+	    !memchr(seg->map + le32toh(hdr->schema_off), 0,
+		    seg->hdr_size - le32toh(hdr->schema_off)))
+		goto err;
+	for (i = 0; i < seg->col_count; i++) {
+		struct bts_col_s *c = &hdr->cols[i];
+		uint32_t name = le32toh(c->name_off);
+		size_t esz = bts_type_size(le16toh(c->type));
+		if (name >= seg->hdr_size ||
+		    !memchr(seg->map + name, 0, seg->hdr_size - name))
+			goto err;
+		end = le32toh(c->offset) + esz * le32toh(c->array_len);
+		if (!esz || end > seg->rec_size)
+			goto err;
+	}
+	return seg;
+ err:
+	bts_seg_close(seg);
+	errno = rc;
+	return NULL;
+}
+
+void bts_seg_close(bts_seg_t seg)
+{
+	if (seg->map)
+		munmap(seg->map, seg->map_len);
+	free(seg->base);
+	free(seg);
+}
+
+const char *bts_seg_schema(bts_seg_t seg)
+{
+	return (char *)seg->map + le32toh(seg->hdr->schema_off);
+}
+
+uint64_t bts_seg_count(bts_seg_t seg)
+{
+	uint64_t n, max;
+
+	n = le64toh(__atomic_load_n(&seg->hdr->count, __ATOMIC_ACQUIRE));
+	/* the file may have been truncated after the map */
+	max = (seg->map_len - seg->hdr_size) / seg->rec_size;
+	return n < max ? n : max;
+}
+
+int bts_seg_closed(bts_seg_t seg)
+{
+	return !!(le32toh(seg->hdr->flags) & BTS_F_CLOSED);
+}
+
+int bts_seg_ts_range(bts_seg_t seg, uint64_t *min, uint64_t *max)
+{
+	*min = le64toh(seg->hdr->ts_min);
+	*max = le64toh(seg->hdr->ts_max);
+	return *min > *max ? ENOENT : 0;
+}
+
+int bts_seg_col_count(bts_seg_t seg)
+{
+	return seg->col_count;
+}
+
+const char *bts_seg_col_name(bts_seg_t seg, int col)
+{
+	return (char *)seg->map + le32toh(seg->hdr->cols[col].name_off);
+}
+
+enum ldms_value_type bts_seg_col_type(bts_seg_t seg, int col)
+{
+	return le16toh(seg->hdr->cols[col].type);
+}
+
+uint32_t bts_seg_col_len(bts_seg_t seg, int col)
+{
+	return le32toh(seg->hdr->cols[col].array_len);
+}
+
+int bts_seg_col_find(bts_seg_t seg, const char *name)
+{
+	int i;
+	for (i = 0; i < seg->col_count; i++) {
+		if (0 == strcmp(bts_seg_col_name(seg, i), name))
+			return i;
+	}
+	return -1;
+}
+
+const void *bts_rec_val(bts_seg_t seg, const void *rec, int col)
+{
+	return (const uint8_t *)rec + le32toh(seg->hdr->cols[col].offset);
+}
+
+/* Read the index file \c base + \c sfx; \return NULL if there is none. */
+static void *bts_index_read(bts_seg_t seg, const char *sfx, size_t *len)
+{
+	struct stat st;
+	char *path;
+	void *buf = NULL;
+	ssize_t n;
+	size_t off = 0;
+	int fd;
+
+	*len = 0;
+	if (asprintf(&path, "%s%s", seg->base, sfx) < 0)
+		return NULL;
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || !st.st_size)
+		goto out;
+	buf = malloc(st.st_size);
+	if (!buf)
+		goto out;
+	while (off < st.st_size) {
+		n = read(fd, (char *)buf + off, st.st_size - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	*len = off;
+ out:
+	close(fd);
+	return buf;
+}
+
+struct bts_range {
+	uint64_t lo, hi;
+};
+
+struct bts_scan {
+	bts_seg_t seg;
+	uint64_t begin, end;
+	const uint64_t *comps; /* sorted, unique */
+	int comp_count;
+	bts_rec_cb_t cb;
+	void *arg;
+};
+
+static int bts_u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static inline const void *bts_rec(bts_seg_t seg, uint64_t r)
+{
+	return seg->map + seg->hdr_size + r * seg->rec_size;
+}
+
+static int bts_scan_rec(struct bts_scan *s, uint64_t r)
+{
+	const void *rec = bts_rec(s->seg, r);
+	uint64_t ts = bts_rec_ts(rec), comp;
+
+	if (ts < s->begin || ts >= s->end)
+		return 0;
+	if (s->comps) {
+		comp = bts_rec_comp_id(rec);
+		if (!bsearch(&comp, s->comps, s->comp_count,
+			     sizeof(comp), bts_u64_cmp))
+			return 0;
+	}
+	return s->cb(s->seg, rec, s->arg);
+}
+
+static int bts_scan_range(struct bts_scan *s, uint64_t lo, uint64_t hi)
+{
+	int rc;
+
+	for (; lo < hi; lo++) {
+		rc = bts_scan_rec(s, lo);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+/* The index of the first element of \c recs not less than \c r */
+static uint64_t bts_lower_bound(const uint32_t *recs, uint64_t n, uint64_t r)
+{
+	uint64_t lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (le32toh(recs[mid]) < r)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static const struct bts_cidx_ent_s *
+bts_cidx_ent_find(const struct bts_cidx_ent_s *ents, uint64_t cnt,
+		  uint64_t comp_id)
+{
+	uint64_t l = 0, u = cnt, m;
+
+	/* ents are ordered by comp_id */
+	while (l < u) {
+		m = (l + u) / 2;
+		if (le64toh(ents[m].comp_id) < comp_id)
+			l = m + 1;
+		else if (le64toh(ents[m].comp_id) > comp_id)
+			u = m;
+		else
+			return &ents[m];
+	}
+	return NULL;
+}
+
+/* The records of the components in [lo, hi) from the component index */
+static int bts_scan_cidx(struct bts_scan *s,
+			 const struct bts_cidx_chunk_s **chunks, int nchunks,
+			 uint64_t lo, uint64_t hi, uint64_t **buf,
+			 uint64_t *buf_len)
+{
+	const struct bts_cidx_chunk_s *ch;
+	const struct bts_cidx_ent_s *ents, *e;
+	const uint32_t *recs;
+	uint64_t i, j, n = 0, cnt, first, count, rec_first;
+	uint64_t *p;
+	int c, k, rc;
+
+	for (k = 0; k < nchunks; k++) {
+		ch = chunks[k];
+		rec_first = le64toh(ch->rec_first);
+		if (rec_first >= hi)
+			break;
+		if (rec_first + le64toh(ch->rec_count) <= lo)
+			continue;
+		cnt = le64toh(ch->comp_count);
+		ents = (const void *)(ch + 1);
+		recs = (const void *)(ents + cnt);
+		for (c = 0; c < s->comp_count; c++) {
+			e = bts_cidx_ent_find(ents, cnt, s->comps[c]);
+			if (!e)
+				continue;
+			first = le64toh(e->first);
+			count = le64toh(e->count);
+			for (i = bts_lower_bound(recs + first, count, lo);
+			     i < count; i++) {
+				j = le32toh(recs[first + i]);
+				if (j >= hi)
+					break;
+				if (n == *buf_len) {
+					p = realloc(*buf, (n ? n * 2 : 256) *
+						    sizeof(*p));
+					if (!p)
+						return ENOMEM;
+					*buf = p;
+					*buf_len = n ? n * 2 : 256;
+				}
+				(*buf)[n++] = j;
+			}
+		}
+	}
+	/* back to record order */
+	qsort(*buf, n, sizeof(**buf), bts_u64_cmp);
+	for (i = 0; i < n; i++) {
+		rc = bts_scan_rec(s, (*buf)[i]);
+		if (rc)
+			return rc;
+	}
+	return 0;
+}
+
+/*
+ * Collect the chunks of the component index that cover the first records
+ * of the segment without a gap, stopping at the first one that is
+ * incomplete or inconsistent.
+ * \return the records covered, 0 if the index is unusable.
+ */
+static uint64_t bts_cidx_check(const void *cidx, size_t len, uint64_t count,
+			       const struct bts_cidx_chunk_s ***pchunks,
+			       int *pnchunks)
+{
+	const struct bts_cidx_hdr_s *h = cidx;
+	const struct bts_cidx_chunk_s *ch, **chunks = NULL, **p;
+	const struct bts_cidx_ent_s *e;
+	uint64_t covered = 0, nc, np, i, first, cnt;
+	size_t off, rem;
+	int n = 0, alloc = 0;
+
+	*pchunks = NULL;
+	*pnchunks = 0;
+	if (!cidx || len < sizeof(*h) ||
+	    memcmp(h->magic, BTS_CIDX_MAGIC, sizeof(h->magic)))
+		return 0;
+	off = sizeof(*h);
+	while (len - off >= sizeof(*ch)) {
+		ch = (const void *)((const char *)cidx + off);
+		rem = len - off - sizeof(*ch);
+		nc = le64toh(ch->comp_count);
+		np = le64toh(ch->post_count);
+		cnt = le64toh(ch->rec_count);
+		if (le64toh(ch->rec_first) != covered || cnt > count - covered)
+			break;
+		if (nc > rem / sizeof(*e))
+			break;
+		rem -= nc * sizeof(*e);
+		if (np > rem / sizeof(uint32_t))
+			break;
+		/* the record numbers of each entry must be in the chunk */
+		e = (const void *)(ch + 1);
+		for (i = 0; i < nc; i++) {
+			first = le64toh(e[i].first);
+			if (first > np || le64toh(e[i].count) > np - first)
+				break;
+		}
+		if (i < nc)
+			break;
+		if (n == alloc) {
+			p = realloc(chunks, (alloc ? alloc * 2 : 16) *
+				    sizeof(*chunks));
+			if (!p)
+				break;
+			chunks = p;
+			alloc = alloc ? alloc * 2 : 16;
+		}
+		chunks[n++] = ch;
+		covered += cnt;
+		off += BTS_ALIGN(sizeof(*ch) + nc * sizeof(*e) +
+				 np * sizeof(uint32_t), 8);
+		if (off > len)
+			break; /* the padding of the last chunk */
+	}
+	*pchunks = chunks;
+	*pnchunks = n;
+	return covered;
+}
+
+int bts_seg_query(bts_seg_t seg, const struct bts_query *q,
+		  bts_rec_cb_t cb, void *arg)
+{
+	struct bts_scan s = { .seg = seg, .cb = cb, .arg = arg };
+	struct bts_block_s *blks = NULL;
+	struct bts_range *ranges = NULL;
+	uint64_t *comps = NULL, *buf = NULL, buf_len = 0;
+	uint64_t count, indexed = 0, covered = 0, first, n, lo, hi;
+	const struct bts_cidx_chunk_s **chunks = NULL;
+	void *cidx = NULL;
+	size_t len, cidx_len = 0;
+	int i, nb, nr = 0, nchunks = 0, rc = 0;
+
+	s.begin = q->begin;
+	s.end = q->end ? q->end : UINT64_MAX;
+	count = bts_seg_count(seg);
+	if (bts_seg_closed(seg) &&
+	    (le64toh(seg->hdr->ts_max) < s.begin ||
+	     le64toh(seg->hdr->ts_min) >= s.end))
+		return 0;
+	if (q->comp_ids && q->comp_count) {
+		comps = malloc(q->comp_count * sizeof(*comps));
+		if (!comps)
+			return ENOMEM;
+		memcpy(comps, q->comp_ids, q->comp_count * sizeof(*comps));
+		qsort(comps, q->comp_count, sizeof(*comps), bts_u64_cmp);
+		for (i = 1, s.comp_count = 1; i < q->comp_count; i++) {
+			if (comps[i] != comps[s.comp_count - 1])
+				comps[s.comp_count++] = comps[i];
+		}
+		s.comps = comps;
+		cidx = bts_index_read(seg, BTS_CIDX_SUFFIX, &cidx_len);
+		covered = bts_cidx_check(cidx, cidx_len, count,
+					 &chunks, &nchunks);
+	}
+
+	/* the blocks that overlap [begin, end), then the unindexed records */
+	blks = bts_index_read(seg, BTS_TIDX_SUFFIX, &len);
+	nb = len / sizeof(*blks);
+	ranges = malloc((nb + 1) * sizeof(*ranges));
+	if (!ranges) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < nb; i++) {
+		first = le64toh(blks[i].first);
+		n = le64toh(blks[i].count);
+		if (first != indexed || first + n > count)
+			break;
+		indexed = first + n;
+		if (le64toh(blks[i].ts_max) < s.begin ||
+		    le64toh(blks[i].ts_min) >= s.end)
+			continue;
+		if (nr && ranges[nr - 1].hi == first)
+			ranges[nr - 1].hi = first + n;
+		else
+			ranges[nr++] = (struct bts_range){ first, first + n };
+	}
+	if (indexed < count) {
+		if (nr && ranges[nr - 1].hi == indexed)
+			ranges[nr - 1].hi = count;
+		else
+			ranges[nr++] = (struct bts_range){ indexed, count };
+	}
+
+	for (i = 0; i < nr && !rc; i++) {
+		lo = ranges[i].lo;
+		hi = ranges[i].hi;
+		if (covered > lo) {
+			rc = bts_scan_cidx(&s, chunks, nchunks, lo,
+					   hi < covered ? hi : covered,
+					   &buf, &buf_len);
+			lo = covered;
+		}
+		if (!rc && lo < hi)
+			rc = bts_scan_range(&s, lo, hi);
+	}
+ out:
+	free(buf);
+	free(ranges);
+	free(blks);
+	free(chunks);
+	free(cidx);
+	free(comps);
+	return rc;
+}
@@ -0,0 +1,276 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file bts.h
+ * \brief LDMS binary time-series segment files.
+ *
+ * store_bts appends the samples of a schema as fixed-width binary records
+ * to memory-mapped segment files in a directory:
+ *
+ *   DIR/SCHEMA.SEQ.bts   the header, the column table and the records
+ *   DIR/SCHEMA.SEQ.tidx  the sparse time index: a bts_block_s per block of
+ *                        records, appended as the blocks are completed
+ *   DIR/SCHEMA.SEQ.cidx  the component index: the record numbers of each
+ *                        component_id, a chunk of the records since the
+ *                        last one appended on flush and on close
+ *
+ * A record is the sample time in microseconds (u64), the component_id
+ * (u64), then the values of the columns at the offsets in the column
+ * table. All integers, in the files and in the records, are little-endian
+ * (the LDMS set encoding). The records of a segment are published by
+ * bts_hdr_s::count, so the segments can be read while they are written.
+ *
+ * The writer functions are used by the store_bts plugin; the reader
+ * functions by ldms_bts(8) and by other post-processing tools.
+ */
+#ifndef __BTS_H__
+#define __BTS_H__
+
+#include <stdint.h>
+#include <endian.h>
+#include <sys/types.h>
+#include "ldms_core.h"
+
+#define BTS_MAGIC "LDMSBTS1"
+#define BTS_CIDX_MAGIC "LDMSBTC2"
+#define BTS_VERSION 1
+
+#define BTS_SUFFIX ".bts"
+#define BTS_TIDX_SUFFIX ".tidx"
+#define BTS_CIDX_SUFFIX ".cidx"
+
+/** bts_hdr_s::flags: the segment is complete */
+#define BTS_F_CLOSED 1
+
+/** The size of the record header (time and component_id) */
+#define BTS_REC_HDR_SIZE 16
+
+struct bts_col_s {
+	uint32_t name_off; /**< offset of the name in the segment */
+	uint16_t type; /**< enum ldms_value_type */
+	uint16_t pad;
+	uint32_t array_len; /**< 1 for scalars */
+	uint32_t offset; /**< offset of the value in the record */
+};
+
+struct bts_hdr_s {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t hdr_size; /**< offset of the first record */
+	uint32_t rec_size;
+	uint32_t col_count;
+	uint32_t schema_off; /**< offset of the schema name */
+	uint64_t capacity; /**< records */
+	uint64_t count; /**< records written */
+	uint64_t ts_min; /**< usec, of the records in the time index */
+	uint64_t ts_max;
+	struct bts_col_s cols[];
+};
+
+/** A time index entry */
+struct bts_block_s {
+	uint64_t ts_min; /**< usec */
+	uint64_t ts_max;
+	uint64_t first; /**< the first record */
+	uint64_t count;
+};
+
+struct bts_cidx_hdr_s {
+	char magic[8];
+	/* followed by the chunks, in record order */
+};
+
+/** The component index of the records [rec_first, rec_first + rec_count) */
+struct bts_cidx_chunk_s {
+	uint64_t rec_first;
+	uint64_t rec_count;
+	uint64_t comp_count;
+	uint64_t post_count; /**< the record numbers in the chunk */
+	/* followed by comp_count bts_cidx_ent_s ordered by comp_id,
+	 * then the post_count uint32_t record numbers, padded to 8 bytes */
+};
+
+struct bts_cidx_ent_s {
+	uint64_t comp_id;
+	uint64_t first; /**< the first of its record numbers in the chunk */
+	uint64_t count;
+};
+
+/* ---- writer ---- */
+
+typedef struct bts_writer_s *bts_writer_t;
+
+struct bts_col_def {
+	const char *name;
+	enum ldms_value_type type;
+	uint32_t array_len; /**< 1 for scalars */
+};
+
+/**
+ * \brief Bytes of an element of \c type, 0 if the type is not supported.
+ */
+size_t bts_type_size(enum ldms_value_type type);
+
+/**
+ * \brief Start a new segment of \c schema in \c dir.
+ *
+ * The segment sequence number follows those of the existing segments of
+ * the schema; a writer never appends to an existing file.
+ *
+ * \param seg_size the size of a segment file; a new segment is started
+ *                 when it is full.
+ * \param stride   the records in a block of the time index.
+ * \param perm     the permission of the files.
+ * \return the writer, or NULL with errno set.
+ */
+bts_writer_t bts_writer_open(const char *dir, const char *schema,
+			     const struct bts_col_def *cols, int col_count,
+			     size_t seg_size, int stride, mode_t perm);
+
+/** \brief The offset of the value of column \c col in a record */
+uint32_t bts_writer_col_offset(bts_writer_t w, int col);
+
+/**
+ * \brief Get the next record.
+ *
+ * The time and component_id of the record are set; the caller sets the
+ * values in place and calls bts_writer_rec_end().
+ * \return the record, or NULL with errno set. errno is ENOSPC if there is
+ *         no room for a new segment file; the next call tries again.
+ */
+void *bts_writer_rec_begin(bts_writer_t w, uint64_t ts, uint64_t comp_id);
+
+/** \brief Publish the record from bts_writer_rec_begin(). */
+void bts_writer_rec_end(bts_writer_t w);
+
+/**
+ * \brief Index the records written so far and start writing the segment
+ * back to the file.
+ * \return 0 or an errno value.
+ */
+int bts_writer_flush(bts_writer_t w);
+
+/**
+ * \brief Complete the segment and free \c w.
+ * \return 0 or an errno value.
+ */
+int bts_writer_close(bts_writer_t w);
+
+/* ---- reader ---- */
+
+typedef struct bts_seg_s *bts_seg_t;
+
+/**
+ * \brief List the segment files in \c dir.
+ *
+ * \param schema the schema, or NULL for all of them.
+ * \param[out] paths the paths ordered by schema and sequence number; free
+ *                   with bts_seg_list_free().
+ * \return the number of segments, or -errno.
+ */
+int bts_seg_list(const char *dir, const char *schema, char ***paths);
+void bts_seg_list_free(char **paths, int count);
+
+/** \brief Map the segment file \c path, NULL with errno set on error. */
+bts_seg_t bts_seg_open(const char *path);
+void bts_seg_close(bts_seg_t seg);
+
+const char *bts_seg_schema(bts_seg_t seg);
+/** \brief The records published so far */
+uint64_t bts_seg_count(bts_seg_t seg);
+int bts_seg_closed(bts_seg_t seg);
+/**
+ * \brief The time range of the indexed records, all of them if the
+ * segment is closed.
+ * \return 0, or ENOENT if there are none.
+ */
+int bts_seg_ts_range(bts_seg_t seg, uint64_t *min, uint64_t *max);
+int bts_seg_col_count(bts_seg_t seg);
+const char *bts_seg_col_name(bts_seg_t seg, int col);
+enum ldms_value_type bts_seg_col_type(bts_seg_t seg, int col);
+uint32_t bts_seg_col_len(bts_seg_t seg, int col);
+/** \return the column index of \c name, or -1 */
+int bts_seg_col_find(bts_seg_t seg, const char *name);
+
+static inline uint64_t bts_rec_ts(const void *rec)
+{
+	return le64toh(((const uint64_t *)rec)[0]);
+}
+
+static inline uint64_t bts_rec_comp_id(const void *rec)
+{
+	return le64toh(((const uint64_t *)rec)[1]);
+}
+
+/** \brief The value of \c col in \c rec, in the LDMS set encoding */
+const void *bts_rec_val(bts_seg_t seg, const void *rec, int col);
+
+struct bts_query {
+	uint64_t begin; /**< usec, the records at or after begin */
+	uint64_t end; /**< usec, and before end; 0 for no bound */
+	const uint64_t *comp_ids; /**< NULL for all components */
+	int comp_count;
+};
+
+/** \return 0 to continue the scan */
+typedef int (*bts_rec_cb_t)(bts_seg_t seg, const void *rec, void *arg);
+
+/**
+ * \brief Call \c cb for the records of \c seg that match \c q, in record
+ * order.
+ *
+ * The time index limits the scan to the blocks that overlap the time
+ * range, and the component index to the records of the components.
+ * \return 0, the non-zero value from \c cb, or an errno value.
+ */
+int bts_seg_query(bts_seg_t seg, const struct bts_query *q,
+		  bts_rec_cb_t cb, void *arg);
+
+#endif
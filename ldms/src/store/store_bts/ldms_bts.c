@@ -0,0 +1,470 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * ldms_bts lists and queries the segment files of store_bts.
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include "ldms.h"
+#include "bts.h"
+
+#define FMT "p:s:b:e:c:m:lnvh"
+void usage(char *argv[])
+{
+	printf("%s -p <path> [-s <schema>] [-b <time>] [-e <time>] [-c <comp_id>,...]\n"
+	       "        [-m <metric>,...] [-n]\n"
+	       "%s -p <path> -l [-v] [-s <schema>]\n"
+	       "\n    -p <path>        The directory of the segment files, i.e. PATH/CONTAINER\n"
+	       "                     of store_bts.\n"
+	       "\n    -s <schema>      The schema to query. It is required if there are\n"
+	       "                     segments of more than one schema in <path>.\n"
+	       "\n    -b <time>        Print the records at or after <time>, in seconds since\n"
+	       "                     the Epoch with an optional fraction, e.g. 1700000000.25.\n"
+	       "\n    -e <time>        Print the records before <time>.\n"
+	       "\n    -c <comp_id>     Print the records of the component_ids. The option\n"
+	       "                     takes a comma-separated list and may be repeated.\n"
+	       "\n    -m <metric>      Print only these metrics (comma-separated, repeatable).\n"
+	       "\n    -n               Print the number of matching records instead.\n"
+	       "\n    -l               List the segments: schema, records, time range.\n"
+	       "\n    -v               With -l, show the columns of the segments too.\n",
+		argv[0], argv[0]);
+	exit(1);
+}
+
+struct query_ctxt {
+	int *cols; /* the columns to print, -1 if not in the segment */
+	int col_count;
+	char **names; /* the -m metrics, NULL for all the columns */
+	int *found; /* the -m metrics found in a segment */
+	uint64_t count;
+	int count_only;
+};
+
+/* "SEC[.FRAC]" to microseconds */
+static int parse_time(const char *s, uint64_t *usec)
+{
+	char *end;
+	uint64_t sec, frac = 0;
+	int digits = 0;
+
+	if (!isdigit(*s))
+		return EINVAL;
+	sec = strtoull(s, &end, 10);
+	if (*end == '.') {
+		for (end++; isdigit(*end); end++, digits++) {
+			if (digits < 6)
+				frac = frac * 10 + (*end - '0');
+		}
+		for (; digits < 6; digits++)
+			frac *= 10;
+	}
+	if (*end)
+		return EINVAL;
+	*usec = sec * 1000000 + frac;
+	return 0;
+}
+
+static int add_list(const char *arg, char ***names, int *count)
+{
+	char *s, *tok, *ptr, **p;
+
+	s = strdup(arg);
+	if (!s)
+		return ENOMEM;
+	for (tok = strtok_r(s, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr)) {
+		p = realloc(*names, (*count + 1) * sizeof(*p));
+		if (!p)
+			return ENOMEM;
+		*names = p;
+		p[*count] = strdup(tok);
+		if (!p[*count])
+			return ENOMEM;
+		(*count)++;
+	}
+	free(s);
+	return 0;
+}
+
+static void print_val(enum ldms_value_type type, const void *v, uint32_t len)
+{
+	union {
+		uint32_t u32;
+		uint64_t u64;
+		float f;
+		double d;
+	} x;
+	const uint8_t *p = v;
+	uint32_t i;
+
+	if (type == LDMS_V_CHAR_ARRAY) {
+		printf(",%.*s", (int)strnlen(v, len), (const char *)v);
+		return;
+	}
+	for (i = 0; i < len; i++, p += bts_type_size(type)) {
+		switch (type) {
+		case LDMS_V_CHAR:
+			printf(",%c", *p ? *p : ' ');
+			break;
+		case LDMS_V_U8:
+		case LDMS_V_U8_ARRAY:
+			printf(",%" PRIu8, *p);
+			break;
+		case LDMS_V_S8:
+		case LDMS_V_S8_ARRAY:
+			printf(",%" PRId8, (int8_t)*p);
+			break;
+		case LDMS_V_U16:
+		case LDMS_V_U16_ARRAY:
+			printf(",%" PRIu16, le16toh(*(uint16_t *)p));
+			break;
+		case LDMS_V_S16:
+		case LDMS_V_S16_ARRAY:
+			printf(",%" PRId16, (int16_t)le16toh(*(uint16_t *)p));
+			break;
+		case LDMS_V_U32:
+		case LDMS_V_U32_ARRAY:
+			printf(",%" PRIu32, le32toh(*(uint32_t *)p));
+			break;
+		case LDMS_V_S32:
+		case LDMS_V_S32_ARRAY:
+			printf(",%" PRId32, (int32_t)le32toh(*(uint32_t *)p));
+			break;
+		case LDMS_V_U64:
+		case LDMS_V_U64_ARRAY:
+			printf(",%" PRIu64, le64toh(*(uint64_t *)p));
+			break;
+		case LDMS_V_S64:
+		case LDMS_V_S64_ARRAY:
+			printf(",%" PRId64, (int64_t)le64toh(*(uint64_t *)p));
+			break;
+		case LDMS_V_F32:
+		case LDMS_V_F32_ARRAY:
+			x.u32 = le32toh(*(uint32_t *)p);
+			printf(",%.9g", x.f);
+			break;
+		case LDMS_V_D64:
+		case LDMS_V_D64_ARRAY:
+			x.u64 = le64toh(*(uint64_t *)p);
+			printf(",%.17g", x.d);
+			break;
+		case LDMS_V_TIMESTAMP:
+			printf(",%" PRIu32 ".%06" PRIu32,
+			       le32toh(((uint32_t *)p)[0]),
+			       le32toh(((uint32_t *)p)[1]));
+			break;
+		default:
+			printf(",");
+			break;
+		}
+	}
+}
+
+static int print_rec(bts_seg_t seg, const void *rec, void *arg)
+{
+	struct query_ctxt *q = arg;
+	uint64_t ts = bts_rec_ts(rec);
+	int i, c;
+
+	q->count++;
+	if (q->count_only)
+		return 0;
+	printf("%" PRIu64 ".%06" PRIu64 ",%" PRIu64, ts / 1000000,
+	       ts % 1000000, bts_rec_comp_id(rec));
+	for (i = 0; i < q->col_count; i++) {
+		c = q->cols[i];
+		if (c < 0) {
+			printf(",");
+			continue;
+		}
+		print_val(bts_seg_col_type(seg, c), bts_rec_val(seg, rec, c),
+			  bts_seg_col_len(seg, c));
+	}
+	printf("\n");
+	return 0;
+}
+
+/* Print the header of the columns in \c q if it differs from \c last */
+static void print_header(bts_seg_t seg, struct query_ctxt *q, char **last)
+{
+	char *hdr = NULL;
+	size_t sz = 0;
+	FILE *f;
+	uint32_t j, len;
+	int i, c;
+
+	f = open_memstream(&hdr, &sz);
+	if (!f)
+		return;
+	fprintf(f, "#Time,component_id");
+	for (i = 0; i < q->col_count; i++) {
+		c = q->cols[i];
+		if (c < 0) {
+			/* print_rec() prints an empty value */
+			fprintf(f, ",%s", q->names[i]);
+			continue;
+		}
+		len = bts_seg_col_len(seg, c);
+		if (!ldms_type_is_array(bts_seg_col_type(seg, c)) ||
+		    bts_seg_col_type(seg, c) == LDMS_V_CHAR_ARRAY) {
+			fprintf(f, ",%s", bts_seg_col_name(seg, c));
+			continue;
+		}
+		for (j = 0; j < len; j++)
+			fprintf(f, ",%s%u", bts_seg_col_name(seg, c), j);
+	}
+	fclose(f);
+	if (*last && 0 == strcmp(*last, hdr)) {
+		free(hdr);
+		return;
+	}
+	printf("%s\n", hdr);
+	free(*last);
+	*last = hdr;
+}
+
+static void list_seg(const char *path, bts_seg_t seg, int verbose)
+{
+	uint64_t n = bts_seg_count(seg), min, max;
+	int i;
+
+	printf("%s %s records %" PRIu64 " %s", path, bts_seg_schema(seg), n,
+	       bts_seg_closed(seg) ? "closed" : "open");
+	if (0 == bts_seg_ts_range(seg, &min, &max))
+		printf(" %" PRIu64 ".%06" PRIu64 " %" PRIu64 ".%06" PRIu64,
+		       min / 1000000, min % 1000000, max / 1000000, max % 1000000);
+	printf("\n");
+	if (!verbose)
+		return;
+	for (i = 0; i < bts_seg_col_count(seg); i++) {
+		printf("    %-32s %s", bts_seg_col_name(seg, i),
+		       ldms_metric_type_to_str(bts_seg_col_type(seg, i)));
+		if (ldms_type_is_array(bts_seg_col_type(seg, i)))
+			printf("[%u]", bts_seg_col_len(seg, i));
+		printf("\n");
+	}
+}
+
+/* The file names are SCHEMA.SEQ.bts */
+static int same_schema(const char *a, const char *b)
+{
+	const char *x = strrchr(a, '/'), *y = strrchr(b, '/');
+	size_t lx, ly;
+
+	x = x ? x + 1 : a;
+	y = y ? y + 1 : b;
+	lx = strrchr(x, '.') - x;
+	ly = strrchr(y, '.') - y;
+	lx = memrchr(x, '.', lx) - (void *)x;
+	ly = memrchr(y, '.', ly) - (void *)y;
+	return lx == ly && 0 == strncmp(x, y, lx);
+}
+
+static int query_seg(const char *path, bts_seg_t seg, struct bts_query *bq,
+		     int metric_count, struct query_ctxt *q, char **last_hdr)
+{
+	int i, rc;
+
+	free(q->cols);
+	q->col_count = metric_count ? metric_count : bts_seg_col_count(seg);
+	q->cols = calloc(q->col_count, sizeof(*q->cols));
+	if (!q->cols)
+		return ENOMEM;
+	for (i = 0; i < q->col_count; i++) {
+		if (!metric_count) {
+			q->cols[i] = i;
+			continue;
+		}
+		q->cols[i] = bts_seg_col_find(seg, q->names[i]);
+		if (q->cols[i] < 0)
+			fprintf(stderr, "%s: metric '%s' not found\n",
+				path, q->names[i]);
+		else
+			q->found[i] = 1;
+	}
+	if (!q->count_only)
+		print_header(seg, q, last_hdr);
+	rc = bts_seg_query(seg, bq, print_rec, q);
+	if (rc)
+		fprintf(stderr, "%s: query error %d\n", path, rc);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct query_ctxt q = {0};
+	struct bts_query bq = {0};
+	char *dir = NULL, *schema = NULL, *last_hdr = NULL;
+	char **metrics = NULL, **comps = NULL, **paths = NULL;
+	int metric_count = 0, comp_count = 0, list = 0, verbose = 0;
+	uint64_t *comp_ids = NULL;
+	bts_seg_t seg;
+	int op, i, n, rc = 0;
+	char *end;
+
+	if (argc == 1)
+		usage(argv);
+	opterr = 0;
+	while ((op = getopt(argc, argv, FMT)) != -1) {
+		switch (op) {
+		case 'p':
+			dir = optarg;
+			break;
+		case 's':
+			schema = optarg;
+			break;
+		case 'b':
+			if (parse_time(optarg, &bq.begin)) {
+				printf("Invalid time '%s'\n", optarg);
+				usage(argv);
+			}
+			break;
+		case 'e':
+			if (parse_time(optarg, &bq.end)) {
+				printf("Invalid time '%s'\n", optarg);
+				usage(argv);
+			}
+			break;
+		case 'c':
+			if (add_list(optarg, &comps, &comp_count))
+				goto enomem;
+			break;
+		case 'm':
+			if (add_list(optarg, &metrics, &metric_count))
+				goto enomem;
+			break;
+		case 'l':
+			list = 1;
+			break;
+		case 'n':
+			q.count_only = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv);
+		}
+	}
+	if (!dir)
+		usage(argv);
+	if (comp_count) {
+		comp_ids = calloc(comp_count, sizeof(*comp_ids));
+		if (!comp_ids)
+			goto enomem;
+		for (i = 0; i < comp_count; i++) {
+			comp_ids[i] = strtoull(comps[i], &end, 0);
+			if (*end || !*comps[i]) {
+				printf("Invalid component_id '%s'\n", comps[i]);
+				usage(argv);
+			}
+		}
+		bq.comp_ids = comp_ids;
+		bq.comp_count = comp_count;
+	}
+
+	if (metric_count) {
+		q.names = metrics;
+		q.found = calloc(metric_count, sizeof(*q.found));
+		if (!q.found)
+			goto enomem;
+	}
+
+	n = bts_seg_list(dir, schema, &paths);
+	if (n < 0) {
+		printf("Cannot read '%s': %s\n", dir, strerror(-n));
+		exit(1);
+	}
+	/* the list is ordered by schema */
+	if (!list && !schema && n > 1 &&
+	    !same_schema(paths[0], paths[n - 1])) {
+		printf("There are segments of more than one schema in '%s', "
+		       "use -s.\n", dir);
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		seg = bts_seg_open(paths[i]);
+		if (!seg) {
+			fprintf(stderr, "%s: %s\n", paths[i], strerror(errno));
+			rc = errno;
+			continue;
+		}
+		if (list)
+			list_seg(paths[i], seg, verbose);
+		else if (query_seg(paths[i], seg, &bq, metric_count, &q,
+				   &last_hdr))
+			rc = 1;
+		bts_seg_close(seg);
+	}
+	for (i = 0; !list && i < metric_count; i++) {
+		if (q.found[i])
+			continue;
+		fprintf(stderr, "metric '%s' is not in any segment\n",
+			metrics[i]);
+		rc = 1;
+	}
+	if (!list && q.count_only)
+		printf("%" PRIu64 "\n", q.count);
+	bts_seg_list_free(paths, n);
+	free(last_hdr);
+	free(q.cols);
+	free(q.found);
+	free(comp_ids);
+	return rc ? 1 : 0;
+ enomem:
+	printf("ERROR: Not enough memory\n");
+	exit(1);
+}
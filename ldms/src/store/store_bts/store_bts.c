@@ -0,0 +1,416 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2022 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2022 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * store_bts appends the samples of a strgp as fixed-width binary records to
+ * memory-mapped segment files, PATH/CONTAINER/SCHEMA.SEQ.bts, with a sparse
+ * time index and a component_id index alongside. See bts.h for the format
+ * and ldms_bts(8) for the reader.
+ *
+ * The record layout is taken from the first set stored: the metric types
+ * and array lengths. A store is a memcpy() of each metric into the mapped
+ * record, so there is no formatting on the storage path.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <ovis_util/util.h>
+#include "ldms.h"
+#include "ldmsd.h"
+#include "bts.h"
+
+static ldmsd_msg_log_f msglog __attribute__(( format(printf, 2, 3) ));
+
+#define PNAME "store_bts"
+#define LOG(LVL, FMT, ...) msglog(LVL, PNAME ": " FMT, ## __VA_ARGS__)
+
+#define LOG_ERROR(FMT, ...) LOG(LDMSD_LERROR, FMT, ## __VA_ARGS__)
+#define LOG_INFO(FMT, ...) LOG(LDMSD_LINFO, FMT, ## __VA_ARGS__)
+#define LOG_WARN(FMT, ...) LOG(LDMSD_LWARNING, FMT, ## __VA_ARGS__)
+
+#define BTS_SEG_SIZE_DEFAULT "64M"
+#define BTS_STRIDE_DEFAULT 256
+
+static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *root_path;
+static size_t seg_size;
+static int stride = BTS_STRIDE_DEFAULT;
+
+struct bts_store_col {
+	int mi; /* index into the metric array */
+	enum ldms_value_type type;
+	uint32_t array_len;
+	uint32_t esz;
+	uint32_t offset;
+};
+
+struct bts_store {
+	pthread_mutex_t lock;
+	char *dir; /* root_path/container */
+	char *schema;
+	void *ucontext;
+	size_t seg_size;
+	int stride;
+	bts_writer_t w; /* opened by the first store() */
+	int err; /* the last error logged */
+	int type_warned;
+	int col_count;
+	struct bts_store_col *cols;
+	int comp_id_idx; /* the component_id metric, -1 if none */
+};
+
+static const char *usage(struct ldmsd_plugin *self)
+{
+	return
+"    config name=store_bts path=<path> [seg_size=<size>] [index_stride=<N>]\n"
+"        path=PATH        The root directory of the segment files,\n"
+"                         PATH/CONTAINER/SCHEMA.SEQ.bts.\n"
+"        seg_size=SIZE    The size of a segment file (default "
+				BTS_SEG_SIZE_DEFAULT ").\n"
+"        index_stride=N   Records per time index entry (default 256).\n";
+}
+
+static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
+		  struct attr_value_list *avl)
+{
+	const char *value;
+	size_t sz = ovis_get_mem_size(BTS_SEG_SIZE_DEFAULT);
+	int n = BTS_STRIDE_DEFAULT;
+	char *path;
+
+	value = av_value(avl, "path");
+	if (!value) {
+		LOG_ERROR("The 'path' configuration option is required.\n");
+		return EINVAL;
+	}
+	value = av_value(avl, "seg_size");
+	if (value) {
+		sz = ovis_get_mem_size(value);
+		if (!sz) {
+			LOG_ERROR("bad seg_size=%s\n", value);
+			return EINVAL;
+		}
+	}
+	value = av_value(avl, "index_stride");
+	if (value) {
+		n = atoi(value);
+		if (n <= 0) {
+			LOG_ERROR("bad index_stride=%s\n", value);
+			return EINVAL;
+		}
+	}
+	path = strdup(av_value(avl, "path"));
+	if (!path)
+		return ENOMEM;
+	pthread_mutex_lock(&cfg_lock);
+	free(root_path);
+	root_path = path;
+	seg_size = sz;
+	stride = n;
+	pthread_mutex_unlock(&cfg_lock);
+	return 0;
+}
+
+static void term(struct ldmsd_plugin *self)
+{
+	pthread_mutex_lock(&cfg_lock);
+	free(root_path);
+	root_path = NULL;
+	pthread_mutex_unlock(&cfg_lock);
+}
+
+static void *get_ucontext(ldmsd_store_handle_t _sh)
+{
+	struct bts_store *sh = _sh;
+	return sh->ucontext;
+}
+
+static void bts_store_free(struct bts_store *sh)
+{
+	free(sh->cols);
+	free(sh->schema);
+	free(sh->dir);
+	pthread_mutex_destroy(&sh->lock);
+	free(sh);
+}
+
+static ldmsd_store_handle_t
+open_store(struct ldmsd_store *s, const char *container, const char *schema,
+	   struct ldmsd_strgp_metric_list *metric_list, void *ucontext)
+{
+	struct bts_store *sh;
+	int rc;
+
+	sh = calloc(1, sizeof(*sh));
+	if (!sh)
+		goto enomem;
+	pthread_mutex_init(&sh->lock, NULL);
+	sh->ucontext = ucontext;
+	sh->schema = strdup(schema);
+	if (!sh->schema)
+		goto enomem;
+	pthread_mutex_lock(&cfg_lock);
+	if (!root_path) {
+		pthread_mutex_unlock(&cfg_lock);
+		LOG_ERROR("config not called\n");
+		rc = EINVAL;
+		goto err;
+	}
+	rc = asprintf(&sh->dir, "%s/%s", root_path, container);
+	sh->seg_size = seg_size;
+	sh->stride = stride;
+	pthread_mutex_unlock(&cfg_lock);
+	if (rc < 0) {
+		sh->dir = NULL;
+		goto enomem;
+	}
+	rc = f_mkdir_p(sh->dir, 0755);
+	if (rc && rc != EEXIST) {
+		LOG_ERROR("cannot create the directory '%s', error %d\n",
+			  sh->dir, rc);
+		goto err;
+	}
+	return sh;
+
+ enomem:
+	rc = ENOMEM;
+	LOG_ERROR("Not enough memory (%s:%s():%d)\n", __FILE__, __func__, __LINE__);
+ err:
+	if (sh)
+		bts_store_free(sh);
+	errno = rc;
+	return NULL;
+}
+
+/* Lay out the records after the metrics of \c set; caller holds sh->lock */
+static int bts_store_layout(struct bts_store *sh, ldms_set_t set,
+			    int *metric_arry, size_t metric_count)
+{
+	struct bts_col_def *defs;
+	struct bts_store_col *c;
+	enum ldms_value_type type;
+	int i, n = 0, rc = 0;
+
+	sh->cols = calloc(metric_count, sizeof(*sh->cols));
+	defs = calloc(metric_count, sizeof(*defs));
+	if (!sh->cols || !defs) {
+		rc = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < metric_count; i++) {
+		type = ldms_metric_type_get(set, metric_arry[i]);
+		if (!bts_type_size(type)) {
+			LOG_WARN("%s: metric '%s' of type %s is not stored\n",
+				 sh->schema, ldms_metric_name_get(set, metric_arry[i]),
+				 ldms_metric_type_to_str(type));
+			continue;
+		}
+		c = &sh->cols[n];
+		c->mi = i;
+		c->type = type;
+		c->esz = bts_type_size(type);
+		c->array_len = ldms_type_is_array(type) ?
+			ldms_metric_array_get_len(set, metric_arry[i]) : 1;
+		defs[n].name = ldms_metric_name_get(set, metric_arry[i]);
+		defs[n].type = type;
+		defs[n].array_len = c->array_len;
+		n++;
+	}
+	if (!n) {
+		LOG_ERROR("%s: no metrics to store\n", sh->schema);
+		rc = EINVAL;
+		goto out;
+	}
+	sh->col_count = n;
+	sh->w = bts_writer_open(sh->dir, sh->schema, defs, n, sh->seg_size,
+				sh->stride, LDMSD_DEFAULT_FILE_PERM);
+	if (!sh->w) {
+		rc = errno;
+		LOG_ERROR("cannot open a segment of '%s/%s', error %d\n",
+			  sh->dir, sh->schema, rc);
+		goto out;
+	}
+	for (i = 0; i < n; i++)
+		sh->cols[i].offset = bts_writer_col_offset(sh->w, i);
+	sh->comp_id_idx = ldms_metric_by_name(set, LDMSD_COMPID);
+ out:
+	if (rc) {
+		free(sh->cols);
+		sh->cols = NULL;
+	}
+	free(defs);
+	return rc;
+}
+
+static int
+store(ldmsd_store_handle_t _sh, ldms_set_t set,
+      int *metric_arry, size_t metric_count)
+{
+	struct bts_store *sh = _sh;
+	struct ldms_timestamp ts;
+	struct bts_store_col *c;
+	uint64_t comp_id = 0;
+	uint32_t len;
+	uint8_t *rec;
+	int i, rc = 0;
+
+	if (!sh)
+		return EINVAL;
+	pthread_mutex_lock(&sh->lock);
+	if (!sh->w) {
+		rc = bts_store_layout(sh, set, metric_arry, metric_count);
+		if (rc)
+			goto out;
+	}
+	/* the sets of a schema have the same metric indexes */
+	if (sh->comp_id_idx >= 0)
+		comp_id = ldms_metric_get_u64(set, sh->comp_id_idx);
+	ts = ldms_transaction_timestamp_get(set);
+	rec = bts_writer_rec_begin(sh->w, (uint64_t)ts.sec * 1000000 + ts.usec,
+				   comp_id);
+	if (!rec) {
+		rc = errno;
+		if (rc != sh->err)
+			LOG_ERROR("cannot store to '%s/%s', error %d\n",
+				  sh->dir, sh->schema, rc);
+		sh->err = rc;
+		goto out;
+	}
+	sh->err = 0;
+	/* the record is in a new segment file, so unset values are zero */
+	for (i = 0; i < sh->col_count; i++) {
+		c = &sh->cols[i];
+		if (c->mi >= metric_count ||
+		    ldms_metric_type_get(set, metric_arry[c->mi]) != c->type) {
+			if (!sh->type_warned)
+				LOG_WARN("set '%s' does not match the record "
+					 "layout of '%s'\n",
+					 ldms_set_instance_name_get(set),
+					 sh->schema);
+			sh->type_warned = 1;
+			continue;
+		}
+		len = 1;
+		if (ldms_type_is_array(c->type)) {
+			len = ldms_metric_array_get_len(set, metric_arry[c->mi]);
+			if (len > c->array_len)
+				len = c->array_len;
+		}
+		memcpy(rec + c->offset, ldms_metric_get(set, metric_arry[c->mi]),
+		       len * c->esz);
+	}
+	bts_writer_rec_end(sh->w);
+ out:
+	pthread_mutex_unlock(&sh->lock);
+	return rc;
+}
+
+static int flush_store(ldmsd_store_handle_t _sh)
+{
+	struct bts_store *sh = _sh;
+	int rc = 0;
+
+	if (!sh)
+		return EINVAL;
+	pthread_mutex_lock(&sh->lock);
+	if (sh->w)
+		rc = bts_writer_flush(sh->w);
+	pthread_mutex_unlock(&sh->lock);
+	if (rc)
+		LOG_ERROR("error %d flushing '%s/%s'\n", rc, sh->dir, sh->schema);
+	return rc;
+}
+
+static void close_store(ldmsd_store_handle_t _sh)
+{
+	struct bts_store *sh = _sh;
+	int rc;
+
+	if (!sh)
+		return;
+	if (sh->w) {
+		rc = bts_writer_close(sh->w);
+		if (rc)
+			LOG_ERROR("error %d closing '%s/%s'\n",
+				  rc, sh->dir, sh->schema);
+	}
+	bts_store_free(sh);
+}
+
+static struct ldmsd_store store_bts = {
+	.base = {
+		.name = "bts",
+		.term = term,
+		.config = config,
+		.usage = usage,
+		.type = LDMSD_PLUGIN_STORE,
+	},
+	.open = open_store,
+	.get_context = get_ucontext,
+	.store = store,
+	.flush = flush_store,
+	.close = close_store,
+};
+
+struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
+{
+	msglog = pf;
+	return &store_bts.base;
+}
+
+static void __attribute__ ((destructor)) store_bts_fini(void)
+{
+	free(root_path);
+	root_path = NULL;
+}
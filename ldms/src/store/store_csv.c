@@ -146,6 +146,17 @@ struct csv_lent {
 	int idx; /* list entry's index */
 };
 
+struct csv_store_handle;
+
+/* A metric column of the store() path */
+struct csv_col {
+	int mid;
+	enum ldms_value_type type;
+	size_t count; /* array length */
+	void (*fmt)(struct csv_store_handle *sh, uint64_t udata,
+		    size_t count, ldms_mval_t mval);
+};
+
 typedef enum csv_store_handle_type {
 	CSV_STORE_HANDLE,     /* for `struct csv_store_handle`     */
 	CSV_ROW_STORE_HANDLE, /* for `struct csv_row_store_handle` */
@@ -158,9 +169,13 @@ typedef enum csv_store_handle_type {
 struct csv_store_handle {
 	csv_store_handle_type_t type;
 	char *path;
-	FILE *file;
-	FILE *headerfile;
+	struct csv_writer *writer; /* the data file */
+	FILE *headerfile; /* altheader only */
 	printheader_t printheader;
+	char *header; /* the header text, for the next roll */
+	size_t header_len;
+	char *kind; /* the types header text */
+	size_t kind_len;
 	int udata;
 	pthread_mutex_t lock;
 	void *ucontext;
@@ -170,6 +185,9 @@ struct csv_store_handle {
 	int64_t byte_count;
 	int num_lists; /* Number of list metrics */
 	struct csv_lent *lents;
+	int col_count;
+	struct csv_col *cols; /* see csv_cols_init() */
+	struct csv_buf buf; /* the rows being formatted */
 	int ref_count; /* number of strgp using the csv file; protected by cfg_lock */
 	CSV_STORE_HANDLE_COMMON;
 };
@@ -229,6 +247,35 @@ struct roll_cb_arg {
 	time_t appx;
 };
 
+/* Write \c len bytes of header text to \c f and sync it. */
+static int csv_text_out(FILE *f, const char *text, size_t len)
+{
+	if (len && fwrite(text, 1, len, f) != len)
+		return errno ? errno : EIO;
+	if (fflush(f) || fsync(fileno(f)))
+		return errno;
+	return 0;
+}
+
+/* Write the types header text to a new \c typefilename. */
+static void csv_kind_out(struct csv_store_handle *s_handle,
+			 const char *typefilename, struct csv_plugin_static *cps)
+{
+	FILE *fp;
+
+	fp = fopen_perm(typefilename, "w", LDMSD_DEFAULT_FILE_PERM);
+	if (!fp) {
+		int rc = errno;
+		cps->msglog(LDMSD_LERROR, PNAME ": print_header: %s "
+			"failed to open types file (%d).\n",
+			typefilename, rc);
+		return;
+	}
+	ch_output(fp, typefilename, CSHC(s_handle), cps);
+	fwrite(s_handle->kind, 1, s_handle->kind_len, fp);
+	fclose(fp);
+}
+
 static void roll_cb(void *obj, void *cb_arg)
 {
 	if (!obj || !cb_arg)
@@ -240,12 +287,23 @@ static void roll_cb(void *obj, void *cb_arg)
 
 	FILE* nhfp = NULL;
 	FILE* nfp = NULL;
+	FILE *ohfp;
+	struct csv_writer *nw, *ow;
 
 	char *new_filename = NULL;
 	char *new_headerfilename = NULL;
 	char *new_typefilename = NULL;
-	int len;
+	char *ofilename, *oheaderfilename, *otypefilename = NULL;
+	const char *header, *kind;
+	size_t header_len;
+	int len, rc;
 
+	/*
+	 * Only the switch to the new files is done under s_handle->lock.
+	 * They are opened and given the header before, and the old ones are
+	 * closed after, so that a slow file system does not stall store().
+	 * cfg_lock keeps s_handle from being closed meanwhile.
+	 */
 	//if we've got here then we've called new_store, but it might be closed
 	pthread_mutex_lock(&s_handle->lock);
 	switch (rolltype) {
@@ -255,7 +313,8 @@ static void roll_cb(void *obj, void *cb_arg)
 		break;
 	case 3:
 		if (s_handle->store_count < rollover)  {
-			goto out;
+			pthread_mutex_unlock(&s_handle->lock);
+			return;
 		} else {
 			s_handle->store_count = 0;
 			s_handle->lastflush = 0;
@@ -263,7 +322,8 @@ static void roll_cb(void *obj, void *cb_arg)
 		break;
 	case 4:
 		if (s_handle->byte_count < rollover) {
-			goto out;
+			pthread_mutex_unlock(&s_handle->lock);
+			return;
 		} else {
 			s_handle->byte_count = 0;
 			s_handle->lastflush = 0;
@@ -274,20 +334,20 @@ static void roll_cb(void *obj, void *cb_arg)
 		       rolltype);
 		break;
 	}
-
-
-	if (s_handle->file)
-		fflush(s_handle->file);
-	if (s_handle->headerfile)
-		fflush(s_handle->headerfile);
+	/* Once set, the header text does not change until the handle closes */
+	header = s_handle->header;
+	header_len = s_handle->header_len;
+	kind = s_handle->kind;
+	pthread_mutex_unlock(&s_handle->lock);
 
 	/* == preparing new filenames == */
 
 	/* new filename */
-	len = asprintf(&new_filename, "%s.%ld", s_handle->path, appx);
+	len = asprintf(&new_filename, "%s.%ld%s", s_handle->path, appx,
+		       csv_compress_suffix(s_handle->compress));
 	if (len < 0) {
 		ERR_LOG("out of memory: %s:%s():%d\n", __FILE__, __func__, __LINE__);
-		goto out;
+		return;
 	}
 
 	/* new headerfilename */
@@ -311,7 +371,7 @@ static void roll_cb(void *obj, void *cb_arg)
 		}
 	}
 
-	/* open files */
+	/* open files and write the headers */
 
 	//re name: if got here, then rollover requested
 	nfp = fopen_perm(new_filename, "a+", LDMSD_DEFAULT_FILE_PERM);
@@ -321,61 +381,95 @@ static void roll_cb(void *obj, void *cb_arg)
 		goto err_3;
 	}
 	ch_output(nfp, new_filename, CSHC(s_handle), cps);
+	nw = csv_writer_new(nfp, new_filename, s_handle->write_hwm, cps);
+	if (!nw) {
+		fclose(nfp);
+		ERR_LOG("cannot create the writer of <%s>, errno %d\n",
+			new_filename, errno);
+		goto err_3;
+	}
+	rc = csv_writer_compress(nw, s_handle->compress,
+				 s_handle->compress_level);
+	if (rc) {
+		csv_writer_close(nw);
+		ERR_LOG("cannot compress <%s>, error %d\n", new_filename, rc);
+		goto err_3;
+	}
+	if (header && !s_handle->altheader) {
+		/* through the writer, it may be compressing */
+		rc = csv_writer_write(nw, header, header_len);
+		csv_writer_flush(nw, 1);
+		if (rc)
+			msglog(LDMSD_LERROR, PNAME ": Error %d writing the "
+			       "header to '%s'\n", rc, new_filename);
+	}
 
 	if (s_handle->altheader){
 		/* truncate a separate headerfile if it exists.
 		 * FIXME: do we still want to do this? */
 		nhfp = fopen_perm(new_headerfilename, "w", LDMSD_DEFAULT_FILE_PERM);
 		if (!nhfp){
-			fclose(nfp);
+			csv_writer_close(nw);
 			ERR_LOG("cannot open file <%s>\n", new_headerfilename);
-			goto err_4;
+			goto err_3;
 		}
 		ch_output(nhfp, new_headerfilename, CSHC(s_handle), cps);
-	} else {
-		nhfp = nfp;
+		if (header) {
+			rc = csv_text_out(nhfp, header, header_len);
+			if (rc)
+				msglog(LDMSD_LERROR, PNAME ": Error %d writing "
+				       "'%s'\n", rc, new_headerfilename);
+			fclose(nhfp);
+			nhfp = NULL;
+		}
 	}
+	if (kind && new_typefilename)
+		csv_kind_out(s_handle, new_typefilename, cps);
 
-	//close and swap
-	if (s_handle->headerfile && s_handle->altheader) {
-		/* if s_handle->altheader == 0, headerfile is file */
-		fclose(s_handle->headerfile);
+	/* swap */
+	pthread_mutex_lock(&s_handle->lock);
+	ow = s_handle->writer;
+	ohfp = s_handle->headerfile;
+	ofilename = s_handle->filename;
+	oheaderfilename = s_handle->headerfilename;
+	s_handle->writer = nw;
+	s_handle->headerfile = nhfp;
+	s_handle->filename = new_filename;
+	s_handle->headerfilename = new_headerfilename;
+	if (s_handle->typeheader != 0) {
+		otypefilename = s_handle->typefilename;
+		s_handle->typefilename = new_typefilename;
 	}
-	if (s_handle->file) {
-		fclose(s_handle->file);
-		rename_output(s_handle->filename, FTYPE_DATA,
-			CSHC(s_handle), cps);
+	s_handle->otime = appx;
+	s_handle->printheader = header ? DONT_PRINT_HEADER : DO_PRINT_HEADER;
+	pthread_mutex_unlock(&s_handle->lock);
+
+	/* close the old files */
+	if (ohfp)
+		fclose(ohfp);
+	if (ow) {
+		csv_writer_close(ow);
+		rename_output(ofilename, FTYPE_DATA, CSHC(s_handle), cps);
 	}
-	if (s_handle->altheader != 0 && s_handle->headerfilename) {
-		rename_output(s_handle->headerfilename, FTYPE_HDR,
+	if (s_handle->altheader != 0 && oheaderfilename) {
+		rename_output(oheaderfilename, FTYPE_HDR,
 			      CSHC(s_handle), cps);
 	}
-	if (s_handle->typeheader != 0 && s_handle->typefilename) {
-		rename_output(s_handle->typefilename, FTYPE_KIND,
+	if (otypefilename) {
+		rename_output(otypefilename, FTYPE_KIND,
 			CSHC(s_handle), cps);
-		free(s_handle->typefilename);
-		s_handle->typefilename = new_typefilename;
 	}
-	s_handle->file = nfp;
-	free(s_handle->filename);
-	s_handle->filename = new_filename;
-	s_handle->headerfile = nhfp;
-	free(s_handle->headerfilename);
-	s_handle->headerfilename = new_headerfilename;
-	s_handle->otime = appx;
-	s_handle->printheader = DO_PRINT_HEADER;
-	goto out;
+	free(ofilename);
+	free(oheaderfilename);
+	free(otypefilename);
+	return;
 
-err_4:
-	fclose(nfp);
 err_3:
 	free(new_typefilename); /* may be NULL, but it is OK */
 err_2:
 	free(new_headerfilename);
 err_1:
 	free(new_filename);
-out:
-	pthread_mutex_unlock(&s_handle->lock);
 }
 
 /* Time-based rolltypes will always roll the files when this
@@ -804,7 +898,8 @@ static const char *usage(struct ldmsd_plugin *self)
 {
 	return  "    config name=store_csv path=<path> rollover=<num> rolltype=<num>\n"
 		"           [altheader=<0/!0> userdata=<0/!0>]\n"
-		"           [buffer=<0/1/N> buffertype=<3/4>]\n"
+		"           [buffer=<0/1/N> buffertype=<3/4>] [write_hwm=<size>]\n"
+		"           [compress=<none/gzip/zstd> [compress_level=<int>]]\n"
 		"           [rename_template=<metapath> [rename_uid=<int-uid> [rename_gid=<int-gid]\n"
 		"               rename_perm=<octal-mode>]]\n"
 		"           [create_uid=<int-uid> [create_gid=<int-gid] create_perm=<octal-mode>]\n"
@@ -828,6 +923,11 @@ static const char *usage(struct ldmsd_plugin *self)
 		"                     N > 1 to flush after that many kb (> 4) or that many lines (>=1)\n"
 		"         - buffertype [3,4] Defines the policy used to schedule buffer flush.\n"
 		"                      Only applies for N > 1. Same as rolltypes.\n"
+		"         - write_hwm Bytes of output held per file before it is handed to\n"
+		"                     the writer thread (default 64k).\n"
+		"         - compress  Write the data files as gzip (.gz) or zstd (.zst)\n"
+		"                     streams; each flush ends a member/frame (default none).\n"
+		"         - compress_level Level of the compressor (default: library default).\n"
 		"\n"
 		;
 }
@@ -838,12 +938,50 @@ static void *get_ucontext(ldmsd_store_handle_t _s_handle)
 	return s_handle->ucontext;
 }
 
+/*
+ * Keep the header texts for roll_cb() and write them out.
+ * caller MUST hold the s_handle->lock
+ */
+static int csv_header_put(struct csv_store_handle *s_handle,
+			  char *header, size_t header_len,
+			  char *kind, size_t kind_len)
+{
+	int rc;
+
+	free(s_handle->header);
+	s_handle->header = header;
+	s_handle->header_len = header_len;
+	free(s_handle->kind);
+	s_handle->kind = kind;
+	s_handle->kind_len = kind_len;
+
+	if (s_handle->altheader) {
+		rc = csv_text_out(s_handle->headerfile, header, header_len);
+		fclose(s_handle->headerfile);
+		s_handle->headerfile = NULL;
+	} else {
+		/* Flush for the header */
+		rc = csv_writer_write(s_handle->writer, header, header_len);
+		csv_writer_flush(s_handle->writer, 1);
+	}
+	if (rc)
+		msglog(LDMSD_LERROR, PNAME ": Error %d writing the header "
+		       "to '%s'\n", rc, s_handle->headerfilename);
+
+	/* dump data types header, or whine and continue to other headers. */
+	if (kind)
+		csv_kind_out(s_handle, s_handle->typefilename, &PG);
+	return 0;
+}
+
 /* caller MUST hold the s_handle->lock */
 static int print_header_from_row(struct csv_store_handle *s_handle,
 				 ldms_set_t set, struct ldmsd_row_s *row)
 {
 	/* Only called from Store which already has the lock */
 	FILE* fp;
+	char *header = NULL, *kind = NULL;
+	size_t header_len = 0, kind_len = 0;
 
 	if (s_handle == NULL){
 		msglog(LDMSD_LERROR, PNAME ": Null store handle. Cannot print header\n");
@@ -851,34 +989,21 @@ static int print_header_from_row(struct csv_store_handle *s_handle,
 	}
 	s_handle->printheader = DONT_PRINT_HEADER;
 
-	fp = s_handle->headerfile;
-	if (!fp){
+	if (s_handle->altheader && !s_handle->headerfile){
 		msglog(LDMSD_LERROR, PNAME ": Cannot print header. No headerfile\n");
 		return EINVAL;
 	}
+	fp = open_memstream(&header, &header_len);
+	if (!fp)
+		return ENOMEM;
 	csv_row_format_header(fp, s_handle->headerfilename, CCSHC(s_handle), s_handle->udata,
                                  &PG, set, row,
                                  s_handle->time_format);
+	fclose(fp);
 
-	/* Flush for the header, whether or not it is the data file as well */
-	fflush(fp);
-	fsync(fileno(fp));
-
-	if (s_handle->headerfile && s_handle->altheader)
-		fclose(s_handle->headerfile);
-	s_handle->headerfile = 0;
-	fp = NULL;
-
-	/* dump data types header, or whine and continue to other headers. */
 	if (s_handle->typeheader > 0 && s_handle->typeheader <= TH_MAX) {
-		fp = fopen_perm(s_handle->typefilename, "w", LDMSD_DEFAULT_FILE_PERM);
-		if (!fp) {
-			int rc = errno;
-			PG.msglog(LDMSD_LERROR, PNAME ": print_header: %s "
-				"failed to open types file (%d).\n",
-				s_handle->typefilename, rc);
-		} else {
-			ch_output(fp, s_handle->typefilename, CSHC(s_handle), &PG);
+		fp = open_memstream(&kind, &kind_len);
+		if (fp) {
 			csv_row_format_types_common(s_handle->typeheader, fp,
 				s_handle->typefilename, CCSHC(s_handle),
 				s_handle->udata, &PG, set,
@@ -887,7 +1012,7 @@ static int print_header_from_row(struct csv_store_handle *s_handle,
 		}
 	}
 
-	return 0;
+	return csv_header_put(s_handle, header, header_len, kind, kind_len);
 }
 
 /*
@@ -902,6 +1027,8 @@ static int print_header_from_store(struct csv_store_handle *s_handle, ldms_set_t
 	/* Only called from Store which already has the lock */
 	FILE* fp;
 	char tmp_path[PATH_MAX];
+	char *header = NULL, *kind = NULL;
+	size_t header_len = 0, kind_len = 0;
 
 	if (s_handle == NULL){
 		msglog(LDMSD_LERROR, PNAME ": Null store handle. Cannot print header\n");
@@ -909,8 +1036,7 @@ static int print_header_from_store(struct csv_store_handle *s_handle, ldms_set_t
 	}
 	s_handle->printheader = DONT_PRINT_HEADER;
 
-	fp = s_handle->headerfile;
-	if (!fp){
+	if (s_handle->altheader && !s_handle->headerfile){
 		msglog(LDMSD_LERROR, PNAME ": Cannot print header. No headerfile\n");
 		return EINVAL;
 	}
@@ -924,35 +1050,25 @@ static int print_header_from_store(struct csv_store_handle *s_handle, ldms_set_t
 				s_handle->path);
 	} else {
 		if (rolltype >= MINROLLTYPE)
-			ec = snprintf(tmp_path, PATH_MAX, "%s.%d",
-				s_handle->path, (int)s_handle->otime);
+			ec = snprintf(tmp_path, PATH_MAX, "%s.%d%s",
+				s_handle->path, (int)s_handle->otime,
+				csv_compress_suffix(s_handle->compress));
 		else
-			ec = snprintf(tmp_path, PATH_MAX, "%s", s_handle->path);
+			ec = snprintf(tmp_path, PATH_MAX, "%s%s", s_handle->path,
+				csv_compress_suffix(s_handle->compress));
 	}
 	(void)ec;
+	fp = open_memstream(&header, &header_len);
+	if (!fp)
+		return ENOMEM;
 	csv_format_header_common(fp, tmp_path, CCSHC(s_handle), s_handle->udata,
                                  &PG, set, metric_array, metric_count,
                                  s_handle->time_format);
+	fclose(fp);
 
-	/* Flush for the header, whether or not it is the data file as well */
-	fflush(fp);
-	fsync(fileno(fp));
-
-	if (s_handle->headerfile && s_handle->altheader)
-		fclose(s_handle->headerfile);
-	s_handle->headerfile = 0;
-	fp = NULL;
-
-	/* dump data types header, or whine and continue to other headers. */
 	if (s_handle->typeheader > 0 && s_handle->typeheader <= TH_MAX) {
-		fp = fopen_perm(s_handle->typefilename, "w", LDMSD_DEFAULT_FILE_PERM);
-		if (!fp) {
-			int rc = errno;
-			PG.msglog(LDMSD_LERROR, PNAME ": print_header: %s "
-				"failed to open types file (%d).\n",
-				s_handle->typefilename, rc);
-		} else {
-			ch_output(fp, s_handle->typefilename, CSHC(s_handle), &PG);
+		fp = open_memstream(&kind, &kind_len);
+		if (fp) {
 			csv_format_types_common(s_handle->typeheader, fp,
 				s_handle->typefilename, CCSHC(s_handle),
 				s_handle->udata, &PG, set,
@@ -961,7 +1077,7 @@ static int print_header_from_store(struct csv_store_handle *s_handle, ldms_set_t
 		}
 	}
 
-	return 0;
+	return csv_header_put(s_handle, header, header_len, kind, kind_len);
 }
 
 /*
@@ -996,444 +1112,236 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	return s_handle;
 }
 
-static inline void __print_check(struct csv_store_handle *sh, int rc)
+/*
+ * Value formatting. The rows of a store() are formatted into sh->buf and
+ * written to the file with one fwrite(). The formatting function of each
+ * metric column is chosen once per handle, see csv_cols_init().
+ */
+typedef void (*csv_fmt_fn_t)(struct csv_store_handle *sh, uint64_t udata,
+			     size_t count, ldms_mval_t mval);
+
+static inline void csv_put_udata(struct csv_store_handle *sh, uint64_t udata)
 {
-	if (rc < 0) {
-		msglog(LDMSD_LERROR, PNAME ": Error %d writing to '%s'\n",
-		       rc, sh->path);
-	} else {
-		sh->byte_count += rc;
+	if (sh->udata) {
+		csv_buf_putc(&sh->buf, ',');
+		csv_buf_u64(&sh->buf, udata);
 	}
 }
 
+static inline void csv_put_f32(struct csv_buf *b, float v)
+{
+	csv_buf_g(b, v, 9);
+}
+
+static inline void csv_put_d64(struct csv_buf *b, double v)
+{
+	csv_buf_g(b, v, 17);
+}
+
+/*
+ * Define the formatting functions of a numeric type: the scalar and the
+ * array with an element per column (expand_array). CSV_FMT_NUM_ARRAY adds
+ * the array in a quoted column with array_sep between the elements.
+ */
+#define CSV_FMT_NUM(_t_, _v_, _a_, _put_)					\
+static void fmt_##_t_(struct csv_store_handle *sh, uint64_t udata,		\
+		      size_t count, ldms_mval_t mval)				\
+{										\
+	csv_put_udata(sh, udata);						\
+	csv_buf_putc(&sh->buf, ',');						\
+	_put_(&sh->buf, mval->_v_);						\
+}										\
+static void fmt_##_t_##_array_expand(struct csv_store_handle *sh,		\
+			uint64_t udata, size_t count, ldms_mval_t mval)		\
+{										\
+	int i;									\
+	for (i = 0; i < count; i++) {						\
+		csv_put_udata(sh, udata);					\
+		csv_buf_putc(&sh->buf, ',');					\
+		_put_(&sh->buf, mval->_a_[i]);					\
+	}									\
+}
+
+#define CSV_FMT_NUM_ARRAY(_t_, _v_, _a_, _put_)				\
+CSV_FMT_NUM(_t_, _v_, _a_, _put_)						\
+static void fmt_##_t_##_array(struct csv_store_handle *sh, uint64_t udata,	\
+			      size_t count, ldms_mval_t mval)			\
+{										\
+	int i;									\
+	csv_put_udata(sh, udata);						\
+	csv_buf_putc(&sh->buf, ',');						\
+	csv_buf_putc(&sh->buf, sh->array_lquote);				\
+	for (i = 0; i < count; i++) {						\
+		if (i)								\
+			csv_buf_putc(&sh->buf, sh->array_sep);			\
+		_put_(&sh->buf, mval->_a_[i]);					\
+	}									\
+	csv_buf_putc(&sh->buf, sh->array_rquote);				\
+}
+
+CSV_FMT_NUM_ARRAY(u8, v_u8, a_u8, csv_buf_u64)
+CSV_FMT_NUM_ARRAY(s8, v_s8, a_s8, csv_buf_s64)
+CSV_FMT_NUM_ARRAY(u16, v_u16, a_u16, csv_buf_u64)
+CSV_FMT_NUM_ARRAY(s16, v_s16, a_s16, csv_buf_s64)
+CSV_FMT_NUM_ARRAY(u32, v_u32, a_u32, csv_buf_u64)
+CSV_FMT_NUM_ARRAY(s32, v_s32, a_s32, csv_buf_s64)
+CSV_FMT_NUM_ARRAY(u64, v_u64, a_u64, csv_buf_u64)
+CSV_FMT_NUM(s64, v_s64, a_s64, csv_buf_s64)
+CSV_FMT_NUM_ARRAY(f32, v_f, a_f, csv_put_f32)
+CSV_FMT_NUM_ARRAY(d64, v_d, a_d, csv_put_d64)
+
+/*
+ * The s64 arrays have always been written as "v0,v1,...", ignoring
+ * array_sep and the array quotes. Existing files and their readers rely
+ * on that, so it is kept.
+ */
+static void fmt_s64_array(struct csv_store_handle *sh, uint64_t udata,
+			  size_t count, ldms_mval_t mval)
+{
+	int i;
+	csv_put_udata(sh, udata);
+	csv_buf_putc(&sh->buf, ',');
+	csv_buf_putc(&sh->buf, '"');
+	for (i = 0; i < count; i++) {
+		if (i)
+			csv_buf_putc(&sh->buf, ',');
+		csv_buf_s64(&sh->buf, mval->a_s64[i]);
+	}
+	csv_buf_putc(&sh->buf, '"');
+}
+
+static void fmt_char(struct csv_store_handle *sh, uint64_t udata,
+		     size_t count, ldms_mval_t mval)
+{
+	csv_put_udata(sh, udata);
+	csv_buf_putc(&sh->buf, ',');
+	csv_buf_putc(&sh->buf, mval->v_char);
+}
+
+static void fmt_char_array(struct csv_store_handle *sh, uint64_t udata,
+			   size_t count, ldms_mval_t mval)
+{
+	csv_put_udata(sh, udata);
+	csv_buf_putc(&sh->buf, ',');
+	/* our csv does not included embedded nuls */
+	if (sh->ietfcsv)
+		csv_buf_putc(&sh->buf, '"');
+	csv_buf_puts(&sh->buf, mval->a_char);
+	if (sh->ietfcsv)
+		csv_buf_putc(&sh->buf, '"');
+}
+
+static void fmt_record(struct csv_store_handle *sh, uint64_t udata,
+		       size_t count, ldms_mval_t mval);
+
+static const csv_fmt_fn_t csv_fmt_tbl[LDMS_V_LAST + 1] = {
+	[LDMS_V_CHAR]       = fmt_char,
+	[LDMS_V_U8]         = fmt_u8,
+	[LDMS_V_S8]         = fmt_s8,
+	[LDMS_V_U16]        = fmt_u16,
+	[LDMS_V_S16]        = fmt_s16,
+	[LDMS_V_U32]        = fmt_u32,
+	[LDMS_V_S32]        = fmt_s32,
+	[LDMS_V_U64]        = fmt_u64,
+	[LDMS_V_S64]        = fmt_s64,
+	[LDMS_V_F32]        = fmt_f32,
+	[LDMS_V_D64]        = fmt_d64,
+	[LDMS_V_CHAR_ARRAY] = fmt_char_array,
+	[LDMS_V_U8_ARRAY]   = fmt_u8_array,
+	[LDMS_V_S8_ARRAY]   = fmt_s8_array,
+	[LDMS_V_U16_ARRAY]  = fmt_u16_array,
+	[LDMS_V_S16_ARRAY]  = fmt_s16_array,
+	[LDMS_V_U32_ARRAY]  = fmt_u32_array,
+	[LDMS_V_S32_ARRAY]  = fmt_s32_array,
+	[LDMS_V_U64_ARRAY]  = fmt_u64_array,
+	[LDMS_V_S64_ARRAY]  = fmt_s64_array,
+	[LDMS_V_F32_ARRAY]  = fmt_f32_array,
+	[LDMS_V_D64_ARRAY]  = fmt_d64_array,
+	[LDMS_V_RECORD_INST] = fmt_record,
+};
+
+/* The numeric arrays formatted with expand_array */
+static const csv_fmt_fn_t csv_fmt_expand_tbl[LDMS_V_LAST + 1] = {
+	[LDMS_V_U8_ARRAY]   = fmt_u8_array_expand,
+	[LDMS_V_S8_ARRAY]   = fmt_s8_array_expand,
+	[LDMS_V_U16_ARRAY]  = fmt_u16_array_expand,
+	[LDMS_V_S16_ARRAY]  = fmt_s16_array_expand,
+	[LDMS_V_U32_ARRAY]  = fmt_u32_array_expand,
+	[LDMS_V_S32_ARRAY]  = fmt_s32_array_expand,
+	[LDMS_V_U64_ARRAY]  = fmt_u64_array_expand,
+	[LDMS_V_S64_ARRAY]  = fmt_s64_array_expand,
+	[LDMS_V_F32_ARRAY]  = fmt_f32_array_expand,
+	[LDMS_V_D64_ARRAY]  = fmt_d64_array_expand,
+};
+
+static csv_fmt_fn_t csv_fmt_fn(struct csv_store_handle *sh,
+			       enum ldms_value_type mtype)
+{
+	if (mtype > LDMS_V_LAST)
+		return NULL;
+	if (sh->expand_array && csv_fmt_expand_tbl[mtype])
+		return csv_fmt_expand_tbl[mtype];
+	return csv_fmt_tbl[mtype];
+}
+
 static void
-store_metric(struct csv_store_handle *sh, const char *wsqt, uint64_t udata,
+store_metric(struct csv_store_handle *sh, uint64_t udata,
 		enum ldms_value_type mtype, size_t count, ldms_mval_t mval)
 {
-	int rc, i;
-	ldms_mval_t v;
-	switch (mtype) {
-	case LDMS_V_CHAR_ARRAY:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		/* our csv does not included embedded nuls */
-		rc = fprintf(sh->file, ",%s%s%s", wsqt, mval->a_char, wsqt);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_CHAR:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%c", mval->v_char);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_U8_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++){
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hhu", mval->a_u8[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hhu",
-							sh->array_lquote,
-							mval->a_u8[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hhu",
-							sh->array_sep,
-							mval->a_u8[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_U8:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hhu", mval->v_u8);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_S8_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hhd", mval->a_s8[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hhd",
-							sh->array_lquote,
-							mval->a_s8[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hhd",
-							sh->array_sep,
-							mval->a_s8[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_S8:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hhd", mval->v_s8);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_U16_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hu", mval->a_u16[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hu",
-							sh->array_lquote,
-							mval->a_u16[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hu",
-							sh->array_sep,
-							mval->a_u16[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_U16:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hu", mval->v_u16);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_S16_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%hd", mval->a_s16[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%hd",
-							sh->array_lquote,
-							mval->a_s16[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%hd",
-							sh->array_sep,
-							mval->a_s16[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_S16:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%hd", mval->v_s16);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_U32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRIu32, mval->a_u32[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRIu32,
-							sh->array_lquote,
-							mval->a_u32[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRIu32,
-							sh->array_sep,
-							mval->a_u32[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_U32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRIu32, mval->v_u32);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_S32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRId32, mval->a_s32[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRId32,
-							sh->array_lquote,
-							mval->a_s32[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRId32,
-							sh->array_sep,
-							mval->a_s32[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_S32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRId32, mval->v_s32);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_U64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRIu64, mval->a_u64[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%" PRIu64,
-							sh->array_lquote,
-							mval->a_u64[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%" PRIu64,
-							sh->array_sep,
-							mval->a_u64[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_U64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%"PRIu64, mval->v_u64);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_S64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%" PRId64, mval->a_s64[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",\"%" PRId64, mval->a_s64[i]);
-				} else {
-					rc = fprintf(sh->file, ",%" PRId64, mval->a_s64[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "\"");
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_S64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%" PRId64, mval->v_s64);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_F32_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%.9g", mval->a_f[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%.9g",
-							sh->array_lquote,
-							mval->a_f[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%.9g",
-							sh->array_sep,
-							mval->a_f[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_F32:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%.9g", mval->v_f);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_D64_ARRAY:
-		if (sh->expand_array) {
-			for (i = 0; i < count; i++) {
-				if (sh->udata) {
-					rc = fprintf(sh->file, ",%"PRIu64, udata);
-					__print_check(sh, rc);
-				}
-				rc = fprintf(sh->file, ",%.17g", mval->a_d[i]);
-				__print_check(sh, rc);
-			}
-		} else {
-			if (sh->udata) {
-				rc = fprintf(sh->file, ",%"PRIu64, udata);
-				__print_check(sh, rc);
-			}
-			for (i = 0; i < count; i++) {
-				if (i == 0) {
-					rc = fprintf(sh->file, ",%c%.17g",
-							sh->array_lquote,
-							mval->a_d[i]);
-				} else {
-					rc = fprintf(sh->file, "%c%.17g",
-							sh->array_sep,
-							mval->a_d[i]);
-				}
-				__print_check(sh, rc);
-			}
-			rc = fprintf(sh->file, "%c", sh->array_rquote);
-			__print_check(sh, rc);
-		}
-		break;
-	case LDMS_V_D64:
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",%"PRIu64, udata);
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",%.17g", mval->v_d);
-		__print_check(sh, rc);
-		break;
-	case LDMS_V_RECORD_INST:
-		for (i = 0; i < ldms_record_card(mval); i++) {
-			mtype = ldms_record_metric_type_get(mval, i, &count);
-			v = ldms_record_metric_get(mval, i);
-			store_metric(sh, wsqt, udata, mtype, count, v);
-		}
-		break;
-	default:
-		msglog(LDMSD_LERROR, PNAME ": Received unrecognized metric value type %d\n", mtype);
-		/* print no value */
-		if (sh->udata) {
-			rc = fprintf(sh->file, ",");
-			__print_check(sh, rc);
-		}
-		rc = fprintf(sh->file, ",");
-		__print_check(sh, rc);
-		break;
+	csv_fmt_fn_t fmt = csv_fmt_fn(sh, mtype);
+	if (fmt) {
+		fmt(sh, udata, count, mval);
+		return;
 	}
+	msglog(LDMSD_LERROR, PNAME ": Received unrecognized metric value type %d\n", mtype);
+	/* print no value */
+	if (sh->udata)
+		csv_buf_putc(&sh->buf, ',');
+	csv_buf_putc(&sh->buf, ',');
+}
+
+static void fmt_record(struct csv_store_handle *sh, uint64_t udata,
+		       size_t count, ldms_mval_t mval)
+{
+	enum ldms_value_type mtype;
+	int i;
+
+	for (i = 0; i < ldms_record_card(mval); i++) {
+		mtype = ldms_record_metric_type_get(mval, i, &count);
+		store_metric(sh, udata, mtype, count,
+			     ldms_record_metric_get(mval, i));
+	}
+}
+
+/*
+ * Choose the formatting of the metric columns. The list columns are
+ * formatted by the types of their entries in store().
+ */
+static int csv_cols_init(struct csv_store_handle *sh, ldms_set_t set,
+			 int *metric_array, size_t metric_count)
+{
+	struct csv_col *col;
+	enum ldms_value_type mtype;
+	int i;
+
+	sh->cols = calloc(metric_count, sizeof(*sh->cols));
+	if (!sh->cols)
+		return ENOMEM;
+	sh->col_count = 0;
+	for (i = 0; i < metric_count; i++) {
+		mtype = ldms_metric_type_get(set, metric_array[i]);
+		if (LDMS_V_RECORD_TYPE == mtype)
+			continue;
+		col = &sh->cols[sh->col_count++];
+		col->mid = metric_array[i];
+		col->type = mtype;
+		col->count = 1;
+		if (ldms_type_is_array(mtype))
+			col->count = ldms_metric_array_get_len(set, col->mid);
+		if (LDMS_V_LIST != mtype)
+			col->fmt = csv_fmt_fn(sh, mtype);
+	}
+	return 0;
 }
 
 static void
@@ -1444,22 +1352,44 @@ store_time_job_app(struct csv_store_handle *sh, const struct ldms_timestamp *ts,
 	if (sh->time_format == TF_MILLISEC) {
 		/* Alternate time format. First field is milliseconds-since-epoch,
 		   and the second field is the left-over microseconds */
-		fprintf(sh->file, "%"PRIu64",%"PRIu32,
-			((uint64_t)ts->sec * 1000) + (ts->usec / 1000),
-			ts->usec % 1000);
+		csv_buf_u64(&sh->buf, ((uint64_t)ts->sec * 1000) + (ts->usec / 1000));
+		csv_buf_putc(&sh->buf, ',');
+		csv_buf_u64(&sh->buf, ts->usec % 1000);
 	} else {
 		/* Traditional time format, where the first field is
 		   <seconds>.<microseconds>, second is microseconds repeated */
-		fprintf(sh->file, "%"PRIu32".%06"PRIu32 ",%"PRIu32,
-			ts->sec, ts->usec, ts->usec);
+		csv_buf_u64(&sh->buf, ts->sec);
+		csv_buf_putc(&sh->buf, '.');
+		csv_buf_u64_pad(&sh->buf, ts->usec, 6);
+		csv_buf_putc(&sh->buf, ',');
+		csv_buf_u64(&sh->buf, ts->usec);
 	}
+	csv_buf_putc(&sh->buf, ',');
 	pname = ldms_set_producer_name_get(set);
-	if (pname != NULL){
-		fprintf(sh->file, ",%s", pname);
-		sh->byte_count += strlen(pname);
-	} else {
-		fprintf(sh->file, ",");
+	if (pname != NULL)
+		csv_buf_puts(&sh->buf, pname);
+}
+
+/* Hand the formatted rows to the writer. Caller must hold sh->lock. */
+static int csv_rows_write(struct csv_store_handle *sh)
+{
+	int rc = 0;
+
+	if (sh->buf.err) {
+		rc = sh->buf.err;
+		msglog(LDMSD_LERROR, PNAME ": Error %d formatting a row "
+		       "for '%s'\n", rc, sh->path);
+	} else if (sh->buf.len) {
+		rc = csv_writer_write(sh->writer, sh->buf.buf, sh->buf.len);
+		if (rc) {
+			msglog(LDMSD_LERROR, PNAME ": Error %d writing to "
+			       "'%s'\n", rc, sh->path);
+		} else {
+			sh->byte_count += sh->buf.len;
+		}
 	}
+	csv_buf_reset(&sh->buf);
+	return rc;
 }
 
 static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_array, size_t metric_count)
@@ -1472,7 +1402,6 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 	int doflush = 0;
 	int rc;
 	ldms_mval_t mval;
-	enum ldms_value_type metric_type;
 
 	s_handle = _s_handle;
 	if (!s_handle)
@@ -1492,13 +1421,18 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 					 * We cannot determine the number of columns.
 					 * Do nothing.
 					 */
+					s_handle->num_lists = -1;
 					return 0;
 				}
 			}
 		}
 		s_handle->lents = malloc(s_handle->num_lists * sizeof(*s_handle->lents));
-		if (!s_handle->lents) {
+		if (!s_handle->lents ||
+		    csv_cols_init(s_handle, set, metric_array, metric_count)) {
 			msglog(LDMSD_LCRITICAL, PNAME ": Out of memory\n");
+			free(s_handle->lents);
+			s_handle->lents = NULL;
+			s_handle->num_lists = -1;
 			return ENOMEM;
 		}
 	}
@@ -1508,7 +1442,7 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 	}
 
 	pthread_mutex_lock(&s_handle->lock);
-	if (!s_handle->file){
+	if (!s_handle->writer){
 		msglog(LDMSD_LERROR, PNAME ": Cannot insert values for <%s>: file is NULL\n",
 		       s_handle->path);
 		pthread_mutex_unlock(&s_handle->lock);
@@ -1541,35 +1475,31 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 		break;
 	}
 
-	/* FIXME: will we want to throw an error if we cannot write? */
-	char *wsqt = ""; /* ietf quotation wrapping strings */
-	if (s_handle->ietfcsv) {
-		wsqt = "\"";
-	}
-
 	int done = 0;
 	const char *name;
-	size_t count;
+	size_t row_start;
 	union ldms_value v;
 	struct csv_lent *lents = s_handle->lents;
+	struct csv_col *col;
 	do {
 		int lidx = 0;
+		row_start = s_handle->buf.len;
 		store_time_job_app(s_handle, ts, set);
-		for (i = 0; i < metric_count; i++) {
-			mval = ldms_metric_get(set, metric_array[i]);
-			udata = ldms_metric_user_data_get(set, metric_array[i]);
-			metric_type = ldms_metric_type_get(set, metric_array[i]);
-			if (LDMS_V_RECORD_TYPE == metric_type) {
-				continue;
-			} else if (LDMS_V_LIST ==  metric_type) {
+		for (i = 0; i < s_handle->col_count; i++) {
+			col = &s_handle->cols[i];
+			mval = ldms_metric_get(set, col->mid);
+			udata = ldms_metric_user_data_get(set, col->mid);
+			if (LDMS_V_LIST == col->type) {
 				/* List entry */
 				if (0 == ldms_list_len(set, mval)) {
-					name = ldms_metric_name_get(set, metric_array[i]);
+					name = ldms_metric_name_get(set, col->mid);
 					msglog(LDMSD_LERROR, PNAME " : set '%s' "
 						"containing an empty list '%s', "
 						"which is not supported. \n",
 						ldms_set_instance_name_get(set), name);
-					break;
+					/* drop the row and the rest of the set */
+					s_handle->buf.len = row_start;
+					goto write;
 				}
 				if (lents[lidx].idx + 1 == ldms_list_len(set, mval)) {
 					/* done, do nothing */
@@ -1594,27 +1524,26 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 
 				/* Store list entry index */
 				v.v_u64 = lents[lidx].idx;
-				store_metric(s_handle, wsqt, udata, LDMS_V_U64, 1, &v);
+				fmt_u64(s_handle, udata, 1, &v);
 
 				assert(lents[lidx].mval);
 				/* Store list entry */
-				store_metric(s_handle, wsqt, udata,
+				store_metric(s_handle, udata,
 						lents[lidx].mtype,
 						lents[lidx].count,
 						lents[lidx].mval);
 				lidx++;
+			} else if (col->fmt) {
+				col->fmt(s_handle, udata, col->count, mval);
 			} else {
-				if (ldms_type_is_array(metric_type)) {
-					count = ldms_metric_array_get_len(set, metric_array[i]);
-				} else {
-					count = 1;
-				}
-				store_metric(s_handle, wsqt, udata,
-					     metric_type, count, mval);
+				store_metric(s_handle, udata, col->type,
+					     col->count, mval);
 			}
 		}
-		fprintf(s_handle->file,"\n");
+		csv_buf_putc(&s_handle->buf, '\n');
 	} while (done < s_handle->num_lists);
+ write:
+	csv_rows_write(s_handle);
 
 	s_handle->store_count++;
 
@@ -1629,10 +1558,8 @@ static int store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arr
 		s_handle->lastflush = s_handle->byte_count;
 		doflush = 1;
 	}
-	if ((s_handle->buffer_sz == 0) || doflush){
-		fflush(s_handle->file);
-		fsync(fileno(s_handle->file));
-	}
+	if ((s_handle->buffer_sz == 0) || doflush)
+		csv_writer_flush(s_handle->writer, 1);
 	pthread_mutex_unlock(&s_handle->lock);
 
 	return 0;
@@ -1646,7 +1573,8 @@ static int flush_store(ldmsd_store_handle_t _s_handle)
 		return -1;
 	}
 	pthread_mutex_lock(&s_handle->lock);
-	fflush(s_handle->file);
+	if (s_handle->writer)
+		csv_writer_flush(s_handle->writer, 0);
 	pthread_mutex_unlock(&s_handle->lock);
 	return 0;
 }
@@ -1656,14 +1584,18 @@ static void __csv_handle_close(struct csv_store_handle *s_handle)
 	pthread_mutex_lock(&s_handle->lock);
 	msglog(LDMSD_LDEBUG, PNAME ": Closing with path <%s>\n",
 	       s_handle->path);
-	fflush(s_handle->file);
 	if (s_handle->path)
 		free(s_handle->path);
 	s_handle->path = NULL;
 	s_handle->ucontext = NULL;
-	if (s_handle->file)
-		fclose(s_handle->file);
-	s_handle->file = NULL;
+	if (s_handle->writer)
+		csv_writer_close(s_handle->writer);
+	s_handle->writer = NULL;
+	free(s_handle->header);
+	free(s_handle->kind);
+	csv_buf_free(&s_handle->buf);
+	free(s_handle->cols);
+	free(s_handle->lents);
 	if (s_handle->headerfile && s_handle->altheader)
 		fclose(s_handle->headerfile);
 	s_handle->headerfile = NULL;
@@ -1756,6 +1688,7 @@ csv_store_handle_get(const char *container, const char *schema)
 	int len, rc;
 	char *store_key;
 	char path[PATH_MAX];
+	FILE *fp;
 
 	store_key = allocStoreKey(container, schema);
 	if (!store_key)
@@ -1817,9 +1750,11 @@ csv_store_handle_get(const char *container, const char *schema)
 	/* csv filename */
 	if (rolltype >= MINROLLTYPE){
 		//append the files with epoch. assume wont collide to the sec.
-		len = asprintf(&s_handle->filename, "%s.%ld", s_handle->path, appx);
+		len = asprintf(&s_handle->filename, "%s.%ld%s", s_handle->path,
+			       appx, csv_compress_suffix(s_handle->compress));
 	} else {
-		len = asprintf(&s_handle->filename, "%s", s_handle->path);
+		len = asprintf(&s_handle->filename, "%s%s", s_handle->path,
+			       csv_compress_suffix(s_handle->compress));
 	}
 	if (len < 0) {
 		ERR_LOG("Not enough memory (%s:%s():%d)", __FILE__, __func__, __LINE__);
@@ -1827,13 +1762,27 @@ csv_store_handle_get(const char *container, const char *schema)
 	}
 
 	/* the CSV FILE */
-	s_handle->file = fopen_perm(s_handle->filename, "a+", LDMSD_DEFAULT_FILE_PERM);
+	fp = fopen_perm(s_handle->filename, "a+", LDMSD_DEFAULT_FILE_PERM);
 	s_handle->otime = appx;
-	if (!s_handle->file) {
+	if (!fp) {
 		ERR_LOG("Error %d opening the file %s.\n", errno, s_handle->path);
 		goto err_6;
 	}
-	ch_output(s_handle->file, s_handle->filename, CSHC(s_handle), &PG);
+	ch_output(fp, s_handle->filename, CSHC(s_handle), &PG);
+	s_handle->writer = csv_writer_new(fp, s_handle->filename,
+					  s_handle->write_hwm, &PG);
+	if (!s_handle->writer) {
+		ERR_LOG("Error %d creating the writer of %s.\n", errno, s_handle->path);
+		fclose(fp);
+		goto err_6;
+	}
+	rc = csv_writer_compress(s_handle->writer, s_handle->compress,
+				 s_handle->compress_level);
+	if (rc) {
+		ERR_LOG("Error %d setting up the compression of %s.\n", rc,
+			s_handle->filename);
+		goto err_7;
+	}
 
 	/* header file name */
 	if (s_handle->altheader) {
@@ -1866,8 +1815,6 @@ csv_store_handle_get(const char *container, const char *schema)
 			goto err_8;
 		}
 		ch_output(s_handle->headerfile, s_handle->headerfilename, CSHC(s_handle), &PG);
-	} else {
-		s_handle->headerfile = s_handle->file;
 	}
 
 	if (s_handle->typeheader > 0) {
@@ -1895,7 +1842,7 @@ csv_store_handle_get(const char *container, const char *schema)
  err_8:
 	free(s_handle->headerfilename);
  err_7:
-	fclose(s_handle->file);
+	csv_writer_close(s_handle->writer);
  err_6:
 	free(s_handle->filename);
  err_5:
@@ -1947,144 +1894,140 @@ csv_row_schema_get(ldmsd_strgp_t strgp, struct csv_row_store_handle *rs_handle,
 	return NULL;
 }
 
-typedef struct csv_store_col_info_s {
-	struct csv_store_handle *s_handle;
-	ldms_mval_t v;
-	const char *ustr;
-	const char *sep;
-	const char *wsqt;
-	int i;
-} *csv_store_col_info_t;
+typedef void (*csv_store_col_fn)(struct csv_store_handle *sh, ldms_mval_t v, int i);
 
-typedef int (*csv_store_col_fn)(csv_store_col_info_t ci);
-
-static int store_col_char(csv_store_col_info_t ci)
+static void store_col_char(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%c", ci->ustr, ci->sep, ci->v->v_char);
+	csv_buf_putc(&sh->buf, v->v_char);
 }
 
-static int store_col_u8(csv_store_col_info_t ci)
+static void store_col_u8(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hhu", ci->ustr, ci->sep, ci->v->v_u8);
+	csv_buf_u64(&sh->buf, v->v_u8);
 }
 
-static int store_col_s8(csv_store_col_info_t ci)
+static void store_col_s8(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hhd", ci->ustr, ci->sep, ci->v->v_s8);
+	csv_buf_s64(&sh->buf, v->v_s8);
 }
 
-static int store_col_u16(csv_store_col_info_t ci)
+static void store_col_u16(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hu", ci->ustr, ci->sep, ci->v->v_u16);
+	csv_buf_u64(&sh->buf, v->v_u16);
 }
 
-static int store_col_s16(csv_store_col_info_t ci)
+static void store_col_s16(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hd", ci->ustr, ci->sep, ci->v->v_s16);
+	csv_buf_s64(&sh->buf, v->v_s16);
 }
 
-static int store_col_u32(csv_store_col_info_t ci)
+static void store_col_u32(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%u", ci->ustr, ci->sep, ci->v->v_u32);
+	csv_buf_u64(&sh->buf, v->v_u32);
 }
 
-static int store_col_s32(csv_store_col_info_t ci)
+static void store_col_s32(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%d", ci->ustr, ci->sep, ci->v->v_s32);
+	csv_buf_s64(&sh->buf, v->v_s32);
 }
 
-static int store_col_u64(csv_store_col_info_t ci)
+static void store_col_u64(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%lu", ci->ustr, ci->sep, ci->v->v_u64);
+	csv_buf_u64(&sh->buf, v->v_u64);
 }
 
-static int store_col_s64(csv_store_col_info_t ci)
+static void store_col_s64(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%ld", ci->ustr, ci->sep, ci->v->v_s64);
+	csv_buf_s64(&sh->buf, v->v_s64);
 }
 
-static int store_col_f(csv_store_col_info_t ci)
+static void store_col_f(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%f", ci->ustr, ci->sep, ci->v->v_f);
+	csv_buf_fixed(&sh->buf, v->v_f);
 }
 
-static int store_col_d(csv_store_col_info_t ci)
+static void store_col_d(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%f", ci->ustr, ci->sep, ci->v->v_d);
+	csv_buf_fixed(&sh->buf, v->v_d);
 }
 
-static int store_col_ts(csv_store_col_info_t ci)
+static void store_col_ts(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	if (ci->s_handle->time_format == TF_MILLISEC) {
+	if (sh->time_format == TF_MILLISEC) {
 		/* Alternate time format. First field is milliseconds-since-epoch,
 		   and the second field is the left-over microseconds */
-		return fprintf(ci->s_handle->file, "%s%s%lu,%u",
-				ci->ustr, ci->sep,
-				((uint64_t)ci->v->v_ts.sec * 1000) + (ci->v->v_ts.usec / 1000),
-				ci->v->v_ts.usec % 1000);
+		csv_buf_u64(&sh->buf, ((uint64_t)v->v_ts.sec * 1000) + (v->v_ts.usec / 1000));
+		csv_buf_putc(&sh->buf, ',');
+		csv_buf_u64(&sh->buf, v->v_ts.usec % 1000);
 	} else {
 		/* Traditional time format, where the first field is
 		   <seconds>.<microseconds>, second is microseconds repeated */
-		return fprintf(ci->s_handle->file, "%s%s%u.%06u,%u",
-				ci->ustr, ci->sep, ci->v->v_ts.sec,
-				ci->v->v_ts.usec, ci->v->v_ts.usec);
+		csv_buf_u64(&sh->buf, v->v_ts.sec);
+		csv_buf_putc(&sh->buf, '.');
+		csv_buf_u64_pad(&sh->buf, v->v_ts.usec, 6);
+		csv_buf_putc(&sh->buf, ',');
+		csv_buf_u64(&sh->buf, v->v_ts.usec);
 	}
 }
 
-static int store_col_char_array(csv_store_col_info_t ci)
+static void store_col_char_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%s%s%s",
-			ci->ustr, ci->sep, ci->wsqt, ci->v->a_char, ci->wsqt);
+	/* ietf quotation wrapping strings */
+	if (sh->ietfcsv)
+		csv_buf_putc(&sh->buf, '"');
+	csv_buf_puts(&sh->buf, v->a_char);
+	if (sh->ietfcsv)
+		csv_buf_putc(&sh->buf, '"');
 }
 
-static int store_col_u8_array(csv_store_col_info_t ci)
+static void store_col_u8_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hhu", ci->ustr, ci->sep, ci->v->a_u8[ci->i]);
+	csv_buf_u64(&sh->buf, v->a_u8[i]);
 }
 
-static int store_col_s8_array(csv_store_col_info_t ci)
+static void store_col_s8_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hhd", ci->ustr, ci->sep, ci->v->a_s8[ci->i]);
+	csv_buf_s64(&sh->buf, v->a_s8[i]);
 }
 
-static int store_col_u16_array(csv_store_col_info_t ci)
+static void store_col_u16_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hu", ci->ustr, ci->sep, ci->v->a_u16[ci->i]);
+	csv_buf_u64(&sh->buf, v->a_u16[i]);
 }
 
-static int store_col_s16_array(csv_store_col_info_t ci)
+static void store_col_s16_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%hd", ci->ustr, ci->sep, ci->v->a_s16[ci->i]);
+	csv_buf_s64(&sh->buf, v->a_s16[i]);
 }
 
-static int store_col_u32_array(csv_store_col_info_t ci)
+static void store_col_u32_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%u", ci->ustr, ci->sep, ci->v->a_u32[ci->i]);
+	csv_buf_u64(&sh->buf, v->a_u32[i]);
 }
 
-static int store_col_s32_array(csv_store_col_info_t ci)
+static void store_col_s32_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%d", ci->ustr, ci->sep, ci->v->a_s32[ci->i]);
+	csv_buf_s64(&sh->buf, v->a_s32[i]);
 }
 
-static int store_col_u64_array(csv_store_col_info_t ci)
+static void store_col_u64_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%lu", ci->ustr, ci->sep, ci->v->a_u64[ci->i]);
+	csv_buf_u64(&sh->buf, v->a_u64[i]);
 }
 
-static int store_col_s64_array(csv_store_col_info_t ci)
+static void store_col_s64_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%ld", ci->ustr, ci->sep, ci->v->a_s64[ci->i]);
+	csv_buf_s64(&sh->buf, v->a_s64[i]);
 }
 
-static int store_col_f_array(csv_store_col_info_t ci)
+static void store_col_f_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%.9g", ci->ustr, ci->sep, ci->v->a_f[ci->i]);
+	csv_put_f32(&sh->buf, v->a_f[i]);
 }
 
-static int store_col_d_array(csv_store_col_info_t ci)
+static void store_col_d_array(struct csv_store_handle *sh, ldms_mval_t v, int i)
 {
-	return fprintf(ci->s_handle->file, "%s%s%.17g", ci->ustr, ci->sep, ci->v->a_d[ci->i]);
+	csv_put_d64(&sh->buf, v->a_d[i]);
 }
 
 csv_store_col_fn __store_col_fn_tbl[] = {
@@ -2118,13 +2061,8 @@ csv_store_col_fn __store_col_fn_tbl[] = {
 static int store_col(ldms_set_t set, struct csv_store_handle *s_handle,
 		     ldmsd_col_t col, int is_first)
 {
-	uint64_t udata;
-	int rc = 0, i, len;
-	const char *ustr = "";
-	char udata_str[64] = "";
-	char udata_str_arr[64] = ""; /* for array elements */
-	const char *sep = is_first?"":",";
-	struct csv_store_col_info_s ci;
+	uint64_t udata = 0;
+	int i, n, has_udata;
 	csv_store_col_fn col_fn;
 
 	col_fn = col->type > LDMS_V_LAST ? NULL : __store_col_fn_tbl[col->type];
@@ -2133,50 +2071,24 @@ static int store_col(ldms_set_t set, struct csv_store_handle *s_handle,
 		return EINVAL;
 	}
 
-	if (s_handle->udata && !is_phony_metric_id(col->metric_id)) {
-		/* NOTE: Phony metrics do NOT have udata. */
+	/* NOTE: Phony metrics do NOT have udata. */
+	has_udata = s_handle->udata && !is_phony_metric_id(col->metric_id);
+	if (has_udata)
 		udata = ldms_metric_user_data_get(set, col->metric_id);
-		snprintf(udata_str, sizeof(udata_str), "%s%lu", sep, udata);
-		sep = ",";
-		snprintf(udata_str_arr, sizeof(udata_str_arr), "%s%lu", sep, udata);
-		ustr = udata_str;
-	}
-
-	ci.ustr = ustr;
-	ci.sep = sep;
-	ci.s_handle = s_handle;
-	ci.v = col->mval;
-	ci.wsqt = s_handle->ietfcsv?"\"":""; /* ietf quotation wrapping strings */
-
-	if (ldms_type_is_array(col->type) && col->type != LDMS_V_CHAR_ARRAY) {
-		/* array */
-		for (i = 0; i < col->array_len; i++) {
-			ci.i = i;
-			len = col_fn(&ci);
-			if (len < 0) {
-				rc = errno;
-				ERR_LOG("Error %d writing to '%s'\n", errno, s_handle->filename);
-			} else {
-				s_handle->byte_count += len;
-			}
-			if (i == 0) {
-				/* make sure to have "," for the rest */
-				ci.ustr = udata_str_arr;
-				ci.sep = ",";
-			}
-		}
-	} else {
-		/* single value */
-		len = col_fn(&ci);
-		if (len < 0) {
-			rc = errno;
-			ERR_LOG("Error %d writing to '%s'\n", errno, s_handle->filename);
-		} else {
-			s_handle->byte_count += len;
+
+	n = 1;
+	if (ldms_type_is_array(col->type) && col->type != LDMS_V_CHAR_ARRAY)
+		n = col->array_len; /* a column per element */
+	for (i = 0; i < n; i++) {
+		if (!is_first || i)
+			csv_buf_putc(&s_handle->buf, ',');
+		if (has_udata) {
+			csv_buf_u64(&s_handle->buf, udata);
+			csv_buf_putc(&s_handle->buf, ',');
 		}
+		col_fn(s_handle, col->mval, i);
 	}
-
-	return rc;
+	return 0;
 }
 
 static int
@@ -2217,7 +2129,10 @@ store_row(ldmsd_strgp_t strgp, ldms_set_t set, struct csv_store_handle *s_handle
 		if (col_rc)
 			rc = col_rc;
 	}
-	fprintf(s_handle->file, "\n");
+	csv_buf_putc(&s_handle->buf, '\n');
+	col_rc = csv_rows_write(s_handle);
+	if (col_rc)
+		rc = col_rc;
 	int doflush = 0;
 	if ((s_handle->buffer_type == 3) &&
 	    ((s_handle->store_count - s_handle->lastflush) >=
@@ -2230,10 +2145,8 @@ store_row(ldmsd_strgp_t strgp, ldms_set_t set, struct csv_store_handle *s_handle
 		s_handle->lastflush = s_handle->byte_count;
 		doflush = 1;
 	}
-	if ((s_handle->buffer_sz == 0) || doflush){
-		fflush(s_handle->file);
-		fsync(fileno(s_handle->file));
-	}
+	if ((s_handle->buffer_sz == 0) || doflush)
+		csv_writer_flush(s_handle->writer, 1);
  out:
 	pthread_mutex_unlock(&s_handle->lock);
 	return rc;
@@ -56,7 +56,19 @@
 #include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
 #include "config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
 #include "store_csv_common.h"
 #define DSTRING_USE_SHORT
 #include "ovis_util/dstring.h"
@@ -1138,6 +1150,37 @@ int open_store_common(struct plugattr *pa, struct csv_store_handle_common *s_han
 	}
 	s_handle->buffer_sz = buf;
 	s_handle->buffer_type = buft;
+
+	s_handle->write_hwm = CSV_WRITER_HWM_DEFAULT;
+	value = ldmsd_plugattr_value(pa, "write_hwm", k);
+	rc = csv_writer_hwm_parse(value, &s_handle->write_hwm);
+	if (rc) {
+		cps->msglog(LDMSD_LERROR,
+			"%s %s: open_store_common bad write_hwm=%s\n",
+			cps->pname, k, value);
+		return rc;
+	}
+
+	value = ldmsd_plugattr_value(pa, "compress", k);
+	rc = csv_compress_parse(value, &s_handle->compress);
+	if (rc) {
+		cps->msglog(LDMSD_LERROR,
+			"%s %s: open_store_common %s compress=%s\n",
+			cps->pname, k, rc == ENOTSUP ?
+			"this build does not support" : "bad", value);
+		return rc;
+	}
+	s_handle->compress_level = CSV_COMPRESS_LEVEL_DEFAULT;
+	rc = ldmsd_plugattr_s32(pa, "compress_level", k,
+				&s_handle->compress_level);
+	if (rc == ENOKEY) {
+		rc = 0;
+	} else if (rc) {
+		cps->msglog(LDMSD_LERROR,
+			"%s %s: open_store_common bad compress_level\n",
+			cps->pname, k);
+		return rc;
+	}
 	s_handle->otime = time(NULL);
 
 	return rc;
@@ -1186,6 +1229,9 @@ void print_csv_store_handle_common(struct csv_store_handle_common *h, struct csv
 	p->msglog(LDMSD_LALL, "%s: time_format:%d\n", p->pname, h->time_format);
 	p->msglog(LDMSD_LALL, "%s: buffertype: %d\n", p->pname, h->buffer_type);
 	p->msglog(LDMSD_LALL, "%s: buffer: %d\n", p->pname, h->buffer_sz);
+	p->msglog(LDMSD_LALL, "%s: write_hwm: %zu\n", p->pname, h->write_hwm);
+	p->msglog(LDMSD_LALL, "%s: compress: %d level %d\n", p->pname,
+		  h->compress, h->compress_level);
 	p->msglog(LDMSD_LALL, "%s: rename_template:%s\n", p->pname, h->rename_template);
 	p->msglog(LDMSD_LALL, "%s: rename_uid: %" PRIu32 "\n", p->pname, h->rename_uid);
 	p->msglog(LDMSD_LALL, "%s: rename_gid: %" PRIu32 "\n", p->pname, h->rename_gid);
@@ -1194,3 +1240,687 @@ void print_csv_store_handle_common(struct csv_store_handle_common *h, struct csv
 	p->msglog(LDMSD_LALL, "%s: create_gid: %" PRIu32 "\n", p->pname, h->create_gid);
 	p->msglog(LDMSD_LALL, "%s: create_perm: %o\n", p->pname, h->create_perm);
 }
+
+#define CSV_BUF_MIN 4096
+
+int csv_buf_grow(struct csv_buf *b, size_t n)
+{
+	size_t alloc;
+	char *buf;
+
+	if (b->err)
+		return b->err;
+	alloc = b->alloc ? b->alloc : CSV_BUF_MIN;
+	while (alloc - b->len < n)
+		alloc *= 2;
+	buf = realloc(b->buf, alloc);
+	if (!buf) {
+		b->err = ENOMEM;
+		return ENOMEM;
+	}
+	b->buf = buf;
+	b->alloc = alloc;
+	return 0;
+}
+
+void csv_buf_free(struct csv_buf *b)
+{
+	free(b->buf);
+	b->buf = NULL;
+	b->len = b->alloc = 0;
+	b->err = 0;
+}
+
+void csv_buf_printf(struct csv_buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (b->err)
+		return;
+	if (b->alloc == b->len && csv_buf_grow(b, 64))
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(&b->buf[b->len], b->alloc - b->len, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if (n >= b->alloc - b->len) {
+		if (csv_buf_grow(b, n + 1))
+			return;
+		va_start(ap, fmt);
+		vsnprintf(&b->buf[b->len], b->alloc - b->len, fmt, ap);
+		va_end(ap);
+	}
+	b->len += n;
+}
+
+/*
+ * Return 1 if v is integral and has at most 15 digits, so that it can be
+ * formatted as an integer. -0.0 prints as "-0" and is left to printf.
+ */
+static inline int csv_is_int(double v, int64_t *i)
+{
+	if (!(v > -1e15 && v < 1e15))
+		return 0;	/* also NaN */
+	*i = (int64_t)v;
+	if ((double)*i != v)
+		return 0;
+	if (*i == 0 && signbit(v))
+		return 0;
+	return 1;
+}
+
+static const int64_t csv_pow10[] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	1000000000, 10000000000, 100000000000, 1000000000000,
+	10000000000000, 100000000000000, 1000000000000000
+};
+
+void csv_buf_g(struct csv_buf *b, double v, int prec)
+{
+	int64_t i;
+
+	/*
+	 * %g uses the exponent form when the exponent is at least the
+	 * precision, so integers with up to prec digits print as they are.
+	 */
+	if (csv_is_int(v, &i) && (prec >= ARRAY_SIZE(csv_pow10) ||
+	    (i < csv_pow10[prec] && i > -csv_pow10[prec]))) {
+		csv_buf_s64(b, i);
+		return;
+	}
+	csv_buf_printf(b, "%.*g", prec, v);
+}
+
+void csv_buf_fixed(struct csv_buf *b, double v)
+{
+	int64_t i;
+
+	if (csv_is_int(v, &i)) {
+		csv_buf_s64(b, i);
+		csv_buf_putn(b, ".000000", 7);
+		return;
+	}
+	csv_buf_printf(b, "%f", v);
+}
+
+#define CSV_WRITER_F_FLUSH 1
+#define CSV_WRITER_F_SYNC 2
+
+/*
+ * A flusher thread and the writers that have work for it. The writers of
+ * the files on one file system share a flusher, so a file system that
+ * stalls only holds up the files on it.
+ */
+struct csv_flusher {
+	dev_t dev;
+	int ref; /* protected by csv_flusher_lock */
+	int exit;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	TAILQ_HEAD(, csv_writer) wq;
+	LIST_ENTRY(csv_flusher) entry;
+};
+
+static LIST_HEAD(, csv_flusher) csv_flusher_list =
+	LIST_HEAD_INITIALIZER(csv_flusher_list);
+static pthread_mutex_t csv_flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct csv_writer {
+	FILE *file;
+	char *name;
+	struct csv_plugin_static *cps;
+	size_t hwm;
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+	struct csv_buf buf[2];
+	struct csv_buf *front; /* appended to by csv_writer_write() */
+	struct csv_buf *back; /* written out by the flusher */
+	int busy; /* the flusher has not written the back buffer yet */
+	int req; /* CSV_WRITER_F_* requested of the flusher */
+	int closing;
+	int done; /* closing and the file is closed */
+	int err; /* the first I/O error */
+	struct csv_flusher *fl;
+	int queued; /* protected by fl->lock */
+	TAILQ_ENTRY(csv_writer) entry;
+	/* compression, used by the flusher only */
+	enum csv_compress ztype;
+	int zopen; /* a gzip member or zstd frame is in progress */
+	unsigned char *zout;
+#ifdef HAVE_LIBZ
+	z_stream gz;
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_CCtx *zs;
+#endif
+};
+
+/* size of the compressed output chunks */
+#define CSV_ZOUT_SZ (64 * 1024)
+
+/* caller must hold w->lock */
+static void csv_writer_queue(struct csv_writer *w)
+{
+	struct csv_flusher *fl = w->fl;
+
+	pthread_mutex_lock(&fl->lock);
+	if (!w->queued) {
+		w->queued = 1;
+		TAILQ_INSERT_TAIL(&fl->wq, w, entry);
+		pthread_cond_signal(&fl->cond);
+	}
+	pthread_mutex_unlock(&fl->lock);
+}
+
+static inline void csv_writer_swap(struct csv_writer *w)
+{
+	struct csv_buf *b = w->front;
+	w->front = w->back;
+	w->back = b;
+	w->busy = 1;
+}
+
+static void csv_writer_error(struct csv_writer *w, int rc, const char *op)
+{
+	if (w->err)
+		return;
+	w->err = rc;
+	w->cps->msglog(LDMSD_LERROR, "%s: %s '%s' failed, error %d\n",
+		       w->cps->pname, op, w->name, rc);
+}
+
+static int csv_writer_fwrite(struct csv_writer *w, const void *data, size_t len)
+{
+	if (len && fwrite(data, 1, len, w->file) != len)
+		return errno ? errno : EIO;
+	return 0;
+}
+
+#ifdef HAVE_LIBZ
+static int csv_writer_gz_out(struct csv_writer *w, const void *data,
+			     size_t len, int end)
+{
+	z_stream *z = &w->gz;
+	int zrc, rc;
+
+	z->next_in = (Bytef *)data;
+	z->avail_in = len;
+	do {
+		z->next_out = w->zout;
+		z->avail_out = CSV_ZOUT_SZ;
+		zrc = deflate(z, end ? Z_FINISH : Z_NO_FLUSH);
+		if (zrc == Z_STREAM_ERROR)
+			return EIO;
+		rc = csv_writer_fwrite(w, w->zout, CSV_ZOUT_SZ - z->avail_out);
+		if (rc)
+			return rc;
+	} while (z->avail_out == 0 || (end && zrc != Z_STREAM_END));
+	if (end && deflateReset(z) != Z_OK)
+		return EIO;
+	return 0;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+static int csv_writer_zstd_out(struct csv_writer *w, const void *data,
+			       size_t len, int end)
+{
+	ZSTD_inBuffer in = { data, len, 0 };
+	ZSTD_outBuffer out;
+	size_t left;
+	int rc;
+
+	do {
+		out.dst = w->zout;
+		out.size = CSV_ZOUT_SZ;
+		out.pos = 0;
+		left = ZSTD_compressStream2(w->zs, &out, &in,
+					    end ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(left))
+			return EIO;
+		rc = csv_writer_fwrite(w, w->zout, out.pos);
+		if (rc)
+			return rc;
+	} while (end ? left != 0 : in.pos < in.size);
+	return 0;
+}
+#endif
+
+/*
+ * Write \c len bytes to the file, through the compressor if any.
+ * \c end finishes the current gzip member or zstd frame.
+ */
+static int csv_writer_out(struct csv_writer *w, const void *data, size_t len,
+			  int end)
+{
+	int rc;
+
+	if (w->ztype == CSV_COMPRESS_NONE)
+		return csv_writer_fwrite(w, data, len);
+	if (!len && !(end && w->zopen))
+		return 0; /* no empty members/frames */
+	switch (w->ztype) {
+#ifdef HAVE_LIBZ
+	case CSV_COMPRESS_GZIP:
+		rc = csv_writer_gz_out(w, data, len, end);
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case CSV_COMPRESS_ZSTD:
+		rc = csv_writer_zstd_out(w, data, len, end);
+		break;
+#endif
+	default:
+		rc = ENOTSUP;
+		break;
+	}
+	w->zopen = !end;
+	return rc;
+}
+
+static void csv_writer_service(struct csv_writer *w)
+{
+	struct csv_buf *b;
+	const char *op;
+	int req, rc, last;
+
+	pthread_mutex_lock(&w->lock);
+	while (w->busy || w->req) {
+		req = 0;
+		if (!w->busy) {
+			/* the requests cover everything appended so far */
+			req = w->req;
+			w->req = 0;
+			if (w->front->len)
+				csv_writer_swap(w);
+		}
+		b = w->busy ? w->back : NULL;
+		pthread_mutex_unlock(&w->lock);
+
+		rc = 0;
+		op = "write";
+		rc = csv_writer_out(w, b ? b->buf : NULL, b ? b->len : 0,
+				    req & CSV_WRITER_F_FLUSH);
+		if (!rc && (req & CSV_WRITER_F_FLUSH) && fflush(w->file)) {
+			rc = errno;
+			op = "fflush";
+		}
+		if (!rc && (req & CSV_WRITER_F_SYNC) && fsync(fileno(w->file))) {
+			rc = errno;
+			op = "fsync";
+		}
+
+		pthread_mutex_lock(&w->lock);
+		if (rc)
+			csv_writer_error(w, rc, op);
+		if (b) {
+			csv_buf_reset(b);
+			w->busy = 0;
+			pthread_cond_broadcast(&w->cv);
+		}
+	}
+	if (w->closing && !w->done) {
+		/* w is freed once done is set; it must not be in the queue */
+		pthread_mutex_lock(&w->fl->lock);
+		last = !w->queued;
+		pthread_mutex_unlock(&w->fl->lock);
+		if (last) {
+			pthread_mutex_unlock(&w->lock);
+			rc = fclose(w->file) ? errno : 0;
+			pthread_mutex_lock(&w->lock);
+			w->file = NULL;
+			if (rc)
+				csv_writer_error(w, rc, "fclose");
+			w->done = 1;
+			pthread_cond_broadcast(&w->cv);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+}
+
+static void *csv_flusher_proc(void *arg)
+{
+	struct csv_flusher *fl = arg;
+	struct csv_writer *w;
+
+	pthread_mutex_lock(&fl->lock);
+	for (;;) {
+		w = TAILQ_FIRST(&fl->wq);
+		if (!w) {
+			if (fl->exit)
+				break;
+			pthread_cond_wait(&fl->cond, &fl->lock);
+			continue;
+		}
+		TAILQ_REMOVE(&fl->wq, w, entry);
+		w->queued = 0;
+		pthread_mutex_unlock(&fl->lock);
+		csv_writer_service(w);
+		pthread_mutex_lock(&fl->lock);
+	}
+	pthread_mutex_unlock(&fl->lock);
+	return NULL;
+}
+
+/* The flusher of the file system \c dev, started on first use */
+static struct csv_flusher *csv_flusher_get(dev_t dev)
+{
+	struct csv_flusher *fl;
+	int rc;
+
+	pthread_mutex_lock(&csv_flusher_lock);
+	LIST_FOREACH(fl, &csv_flusher_list, entry) {
+		if (fl->dev == dev) {
+			fl->ref++;
+			goto out;
+		}
+	}
+	fl = calloc(1, sizeof(*fl));
+	if (!fl)
+		goto out;
+	fl->dev = dev;
+	fl->ref = 1;
+	TAILQ_INIT(&fl->wq);
+	pthread_mutex_init(&fl->lock, NULL);
+	pthread_cond_init(&fl->cond, NULL);
+	rc = pthread_create(&fl->thread, NULL, csv_flusher_proc, fl);
+	if (rc) {
+		pthread_mutex_destroy(&fl->lock);
+		pthread_cond_destroy(&fl->cond);
+		free(fl);
+		fl = NULL;
+		errno = rc;
+		goto out;
+	}
+	pthread_setname_np(fl->thread, "csv_writer");
+	LIST_INSERT_HEAD(&csv_flusher_list, fl, entry);
+ out:
+	pthread_mutex_unlock(&csv_flusher_lock);
+	return fl;
+}
+
+/* Drop a reference; the last one stops the thread */
+static void csv_flusher_put(struct csv_flusher *fl)
+{
+	pthread_mutex_lock(&csv_flusher_lock);
+	if (--fl->ref) {
+		pthread_mutex_unlock(&csv_flusher_lock);
+		return;
+	}
+	LIST_REMOVE(fl, entry);
+	pthread_mutex_unlock(&csv_flusher_lock);
+
+	pthread_mutex_lock(&fl->lock);
+	fl->exit = 1;
+	pthread_cond_signal(&fl->cond);
+	pthread_mutex_unlock(&fl->lock);
+	pthread_join(fl->thread, NULL);
+	pthread_mutex_destroy(&fl->lock);
+	pthread_cond_destroy(&fl->cond);
+	free(fl);
+}
+
+struct csv_writer *csv_writer_new(FILE *f, const char *name, size_t hwm,
+				  struct csv_plugin_static *cps)
+{
+	struct csv_writer *w;
+	struct stat st;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+	w->name = strdup(name);
+	if (!w->name) {
+		free(w);
+		return NULL;
+	}
+	if (fstat(fileno(f), &st))
+		st.st_dev = 0;
+	w->fl = csv_flusher_get(st.st_dev);
+	if (!w->fl) {
+		free(w->name);
+		free(w);
+		return NULL;
+	}
+	w->file = f;
+	w->cps = cps;
+	w->hwm = hwm ? hwm : CSV_WRITER_HWM_DEFAULT;
+	w->front = &w->buf[0];
+	w->back = &w->buf[1];
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cv, NULL);
+	return w;
+}
+
+int csv_writer_write(struct csv_writer *w, const void *data, size_t len)
+{
+	int rc;
+
+	pthread_mutex_lock(&w->lock);
+	assert(!w->closing);
+	if (w->front->len && w->front->len + len > w->hwm) {
+		/* Both buffers full; wait for the file system to catch up. */
+		while (w->busy)
+			pthread_cond_wait(&w->cv, &w->lock);
+		csv_writer_swap(w);
+		csv_writer_queue(w);
+	}
+	csv_buf_putn(w->front, data, len);
+	rc = w->front->err;
+	w->front->err = 0;
+	pthread_mutex_unlock(&w->lock);
+	return rc;
+}
+
+void csv_writer_flush(struct csv_writer *w, int sync)
+{
+	pthread_mutex_lock(&w->lock);
+	w->req |= CSV_WRITER_F_FLUSH | (sync ? CSV_WRITER_F_SYNC : 0);
+	csv_writer_queue(w);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int csv_writer_close(struct csv_writer *w)
+{
+	int rc;
+
+	pthread_mutex_lock(&w->lock);
+	w->closing = 1;
+	w->req |= CSV_WRITER_F_FLUSH;
+	csv_writer_queue(w);
+	while (!w->done)
+		pthread_cond_wait(&w->cv, &w->lock);
+	rc = w->err;
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cv);
+	csv_buf_free(&w->buf[0]);
+	csv_buf_free(&w->buf[1]);
+#ifdef HAVE_LIBZ
+	if (w->ztype == CSV_COMPRESS_GZIP)
+		deflateEnd(&w->gz);
+#endif
+#ifdef HAVE_LIBZSTD
+	ZSTD_freeCCtx(w->zs);
+#endif
+	free(w->zout);
+	free(w->name);
+	csv_flusher_put(w->fl);
+	free(w);
+	return rc;
+}
+
+int csv_writer_compress(struct csv_writer *w, enum csv_compress type,
+			int level)
+{
+	if (type == CSV_COMPRESS_NONE)
+		return 0;
+	w->zout = malloc(CSV_ZOUT_SZ);
+	if (!w->zout)
+		return ENOMEM;
+	switch (type) {
+#ifdef HAVE_LIBZ
+	case CSV_COMPRESS_GZIP:
+		if (level == CSV_COMPRESS_LEVEL_DEFAULT)
+			level = Z_DEFAULT_COMPRESSION;
+		/* windowBits 15 + 16 for the gzip wrapper */
+		if (deflateInit2(&w->gz, level, Z_DEFLATED, 15 + 16, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK)
+			goto einval;
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case CSV_COMPRESS_ZSTD:
+		if (level == CSV_COMPRESS_LEVEL_DEFAULT)
+			level = ZSTD_CLEVEL_DEFAULT;
+		w->zs = ZSTD_createCCtx();
+		if (!w->zs)
+			goto enomem;
+		if (ZSTD_isError(ZSTD_CCtx_setParameter(w->zs,
+				ZSTD_c_compressionLevel, level))) {
+			ZSTD_freeCCtx(w->zs);
+			w->zs = NULL;
+			goto einval;
+		}
+		break;
+#endif
+	default:
+		free(w->zout);
+		w->zout = NULL;
+		return ENOTSUP;
+	}
+	w->ztype = type;
+	return 0;
+#ifdef HAVE_LIBZSTD
+ enomem:
+	free(w->zout);
+	w->zout = NULL;
+	return ENOMEM;
+#endif
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+ einval:
+	free(w->zout);
+	w->zout = NULL;
+	return EINVAL;
+#endif
+}
+
+int csv_compress_parse(const char *value, int *type)
+{
+	if (!value || 0 == strcmp(value, "none")) {
+		*type = CSV_COMPRESS_NONE;
+		return 0;
+	}
+	if (0 == strcmp(value, "gzip")) {
+#ifdef HAVE_LIBZ
+		*type = CSV_COMPRESS_GZIP;
+		return 0;
+#else
+		return ENOTSUP;
+#endif
+	}
+	if (0 == strcmp(value, "zstd")) {
+#ifdef HAVE_LIBZSTD
+		*type = CSV_COMPRESS_ZSTD;
+		return 0;
+#else
+		return ENOTSUP;
+#endif
+	}
+	return EINVAL;
+}
+
+const char *csv_compress_suffix(int type)
+{
+	switch (type) {
+	case CSV_COMPRESS_GZIP:
+		return ".gz";
+	case CSV_COMPRESS_ZSTD:
+		return ".zst";
+	default:
+		return "";
+	}
+}
+
+static ssize_t csv_writer_cookie_write(void *cookie, const char *buf, size_t size)
+{
+	int rc = csv_writer_write(cookie, buf, size);
+	if (rc) {
+		errno = rc;
+		return 0;
+	}
+	return size;
+}
+
+static int csv_writer_cookie_close(void *cookie)
+{
+	int rc = csv_writer_close(cookie);
+	if (rc) {
+		errno = rc;
+		return EOF;
+	}
+	return 0;
+}
+
+FILE *csv_writer_fopen(struct csv_writer *w)
+{
+	cookie_io_functions_t io = {
+		.write = csv_writer_cookie_write,
+		.close = csv_writer_cookie_close,
+	};
+	return fopencookie(w, "w", io);
+}
+
+FILE *csv_writer_fopen_path(const char *path, const char *header,
+			    size_t header_len, size_t hwm,
+			    struct csv_plugin_static *cps,
+			    struct csv_writer **pw)
+{
+	struct csv_writer *w;
+	FILE *f, *wf;
+	int rc;
+
+	f = fopen_perm(path, "a+", LDMSD_DEFAULT_FILE_PERM);
+	if (!f)
+		return NULL;
+	if (header_len && (fwrite(header, 1, header_len, f) != header_len ||
+			   fflush(f) || fsync(fileno(f)))) {
+		cps->msglog(LDMSD_LERROR, "%s: writing the header to '%s' "
+			    "failed, error %d\n", cps->pname, path, errno);
+	}
+	w = csv_writer_new(f, path, hwm, cps);
+	if (!w) {
+		rc = errno;
+		fclose(f);
+		errno = rc;
+		return NULL;
+	}
+	wf = csv_writer_fopen(w);
+	if (!wf) {
+		rc = errno;
+		csv_writer_close(w);
+		errno = rc;
+		return NULL;
+	}
+	*pw = w;
+	return wf;
+}
+
+int csv_writer_hwm_parse(const char *value, size_t *hwm)
+{
+	size_t sz;
+
+	if (!value)
+		return 0;
+	if (!isdigit(value[0]))
+		return EINVAL;
+	sz = ovis_get_mem_size(value);
+	if (!sz)
+		return EINVAL;
+	*hwm = sz;
+	return 0;
+}
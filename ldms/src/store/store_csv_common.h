@@ -55,6 +55,8 @@
 
 #include <libgen.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 #include <ovis_util/util.h>
 #include "ldmsd.h"
 #include "ldmsd_plugattr.h"
@@ -80,6 +82,9 @@
 	int time_format; \
 	int buffer_type; \
 	int buffer_sz; \
+	size_t write_hwm; \
+	int compress; \
+	int compress_level; \
 	char *store_key; /* this is the container/schema */
 
 struct storek_common {
@@ -293,6 +298,9 @@ void print_csv_store_handle_common(struct csv_store_handle_common *s_handle, str
 	"time_format", \
 	"buffer", \
 	"buffertype", \
+	"write_hwm", \
+	"compress", \
+	"compress_level", \
 	"rename_template", \
 	"rename_uid", \
 	"rename_gid", \
@@ -330,4 +338,224 @@ void print_csv_store_handle_common(struct csv_store_handle_common *s_handle, str
 
 #define LIB_DTOR_COMMON(cps)
 
+/**
+ * A row formatting buffer.
+ *
+ * The csv stores format a row (or a batch of rows) into a csv_buf with the
+ * csv_buf_*() functions and write it out with a single fwrite(), instead of
+ * calling fprintf() for each value. The buffer grows as needed. If it
+ * cannot grow, \c err is set to ENOMEM and further appends are ignored
+ * until csv_buf_reset().
+ */
+struct csv_buf {
+	char *buf;
+	size_t len;
+	size_t alloc;
+	int err;
+};
+
+/* Longest text of an integer value with the sign */
+#define CSV_BUF_INT_MAX LDMSD_FMT_INT_MAX
+
+/** \brief Make room for \c n more bytes; the slow path of csv_buf_reserve() */
+int csv_buf_grow(struct csv_buf *b, size_t n);
+
+/** \brief Free the memory of the buffer */
+void csv_buf_free(struct csv_buf *b);
+
+static inline int csv_buf_reserve(struct csv_buf *b, size_t n)
+{
+	if (b->alloc - b->len >= n)
+		return 0;
+	return csv_buf_grow(b, n);
+}
+
+static inline void csv_buf_reset(struct csv_buf *b)
+{
+	b->len = 0;
+	b->err = 0;
+}
+
+static inline void csv_buf_putc(struct csv_buf *b, char c)
+{
+	if (csv_buf_reserve(b, 1))
+		return;
+	b->buf[b->len++] = c;
+}
+
+static inline void csv_buf_putn(struct csv_buf *b, const char *s, size_t n)
+{
+	if (csv_buf_reserve(b, n))
+		return;
+	memcpy(&b->buf[b->len], s, n);
+	b->len += n;
+}
+
+static inline void csv_buf_puts(struct csv_buf *b, const char *s)
+{
+	csv_buf_putn(b, s, strlen(s));
+}
+
+/** \brief Append \c v as "%" PRIu64 */
+static inline void csv_buf_u64(struct csv_buf *b, uint64_t v)
+{
+	if (csv_buf_reserve(b, CSV_BUF_INT_MAX))
+		return;
+	b->len = ldmsd_fmt_u64(&b->buf[b->len], v) - b->buf;
+}
+
+/** \brief Append \c v as "%0<width>" PRIu64 */
+static inline void csv_buf_u64_pad(struct csv_buf *b, uint64_t v, int width)
+{
+	char tmp[CSV_BUF_INT_MAX];
+	int n = ldmsd_fmt_u64(tmp, v) - tmp;
+
+	if (csv_buf_reserve(b, width > n ? width : n))
+		return;
+	while (n < width--)
+		b->buf[b->len++] = '0';
+	memcpy(&b->buf[b->len], tmp, n);
+	b->len += n;
+}
+
+/** \brief Append \c v as "%" PRId64 */
+static inline void csv_buf_s64(struct csv_buf *b, int64_t v)
+{
+	if (csv_buf_reserve(b, CSV_BUF_INT_MAX))
+		return;
+	b->len = ldmsd_fmt_s64(&b->buf[b->len], v) - b->buf;
+}
+
+/**
+ * \brief Append \c v as "%.<prec>g".
+ *
+ * Integral values are formatted without printf; the output is the same.
+ */
+void csv_buf_g(struct csv_buf *b, double v, int prec);
+
+/**
+ * \brief Append \c v as "%f".
+ *
+ * Integral values are formatted without printf; the output is the same.
+ */
+void csv_buf_fixed(struct csv_buf *b, double v);
+
+/** \brief Append printf() formatted text */
+void csv_buf_printf(struct csv_buf *b, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+/**
+ * A write-behind output file.
+ *
+ * csv_writer_write() copies the data into the front buffer of the writer
+ * and returns. When the front buffer reaches the high-water mark, it is
+ * swapped with the back buffer and handed to the flusher thread, which
+ * does the fwrite(), fflush() and fsync() calls. There is one flusher
+ * thread per file system (st_dev) with open writers, so a slow file system
+ * does not hold up the files on the others; the files on one file system
+ * are written one at a time. The caller only blocks if the front buffer
+ * is full while the flusher still has the back buffer, i.e. the file
+ * system is not keeping up with the data rate.
+ */
+struct csv_writer;
+
+/* Default high-water mark of the writer buffers (bytes) */
+#define CSV_WRITER_HWM_DEFAULT (64 * 1024)
+
+/**
+ * \brief Create a writer for the file \c f.
+ *
+ * The writer owns \c f; it is closed by csv_writer_close().
+ * \param name the file path for error messages.
+ * \param hwm the high-water mark in bytes, 0 for CSV_WRITER_HWM_DEFAULT.
+ * \return the writer, or NULL with errno set.
+ */
+struct csv_writer *csv_writer_new(FILE *f, const char *name, size_t hwm,
+				  struct csv_plugin_static *cps);
+
+/**
+ * \brief Append \c len bytes to the writer.
+ * \return 0 or ENOMEM.
+ */
+int csv_writer_write(struct csv_writer *w, const void *data, size_t len);
+
+/**
+ * \brief Ask the flusher to write out everything appended so far and
+ * fflush() the file, and fsync() it as well if \c sync is not 0.
+ *
+ * This does not wait for the I/O.
+ */
+void csv_writer_flush(struct csv_writer *w, int sync);
+
+/**
+ * \brief Write out the remaining data, close the file and free \c w.
+ *
+ * This waits for the flusher, so do not call it while holding a lock
+ * that the store path needs.
+ * \return 0, or the first I/O error of the writer.
+ */
+int csv_writer_close(struct csv_writer *w);
+
+/**
+ * \brief A stdio stream writing into \c w, for the stores that format
+ * with fprintf().
+ *
+ * fflush() on the stream only moves the data into the writer; use
+ * csv_writer_flush() to get it to the file. fclose() on the stream
+ * calls csv_writer_close().
+ */
+FILE *csv_writer_fopen(struct csv_writer *w);
+
+/**
+ * \brief Open \c path for appending with a new writer, as a stdio stream.
+ *
+ * \c header, if \c header_len is not 0, is written to the file and synced
+ * before the writer takes the file over.
+ * \param[out] w the writer of the stream, for csv_writer_flush().
+ * \return the stream from csv_writer_fopen(), or NULL with errno set.
+ */
+FILE *csv_writer_fopen_path(const char *path, const char *header,
+			    size_t header_len, size_t hwm,
+			    struct csv_plugin_static *cps,
+			    struct csv_writer **w);
+
+/**
+ * \brief Parse the write_hwm= plugin attribute.
+ * \return 0 or errno value; \c hwm is not changed if not set.
+ */
+int csv_writer_hwm_parse(const char *value, size_t *hwm);
+
+/** Output compression of a writer */
+enum csv_compress {
+	CSV_COMPRESS_NONE = 0,
+	CSV_COMPRESS_GZIP, /**< gzip members, needs zlib */
+	CSV_COMPRESS_ZSTD, /**< zstd frames, needs libzstd */
+};
+
+/* compress_level of the library default */
+#define CSV_COMPRESS_LEVEL_DEFAULT -1
+
+/**
+ * \brief Compress the output of \c w.
+ *
+ * Must be called before the first csv_writer_write(). The compression
+ * runs on the flusher thread. Every csv_writer_flush() and the close end
+ * the current gzip member or zstd frame, so the file can be read up to
+ * the last flush while it is still being written.
+ * \return 0, ENOTSUP if the library was not available at build time,
+ *         or an errno value.
+ */
+int csv_writer_compress(struct csv_writer *w, enum csv_compress type,
+			int level);
+
+/**
+ * \brief Parse the compress= plugin attribute (none, gzip or zstd).
+ * \return 0, EINVAL for an unknown value, or ENOTSUP if the library of
+ *         the value was not available at build time.
+ */
+int csv_compress_parse(const char *value, int *type);
+
+/** \brief The file name suffix of \c type: "", ".gz" or ".zst". */
+const char *csv_compress_suffix(int type);
+
 #endif /* store_csv_common_h_seen */
@@ -66,6 +66,7 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "store_common.h"
+#include "store_csv_common.h"
 
 #define TV_SEC_COL    0
 #define TV_USEC_COL    1
@@ -75,6 +76,7 @@
 
 static int buffer_type = 1; /* autobuffering */
 static int buffer_sz = 0;
+static size_t write_hwm = CSV_WRITER_HWM_DEFAULT;
 #define MAX_ROLLOVER_STORE_KEYS 20
 #define STORE_DERIVED_NAME_MAX 256
 #define STORE_DERIVED_LINE_MAX 4096
@@ -302,8 +304,9 @@ struct derived_data{ //the generic information about the derived metric
 struct function_store_handle { //these are per-schema
 	struct ldmsd_store *store;
 	char *path;
-	FILE *file;
-	FILE *headerfile;
+	FILE *file; /* stdio stream of writer */
+	struct csv_writer *writer;
+	FILE *headerfile; /* altheader only */
 	struct derived_data* der[STORE_DERIVED_METRIC_MAX]; /* these are about the derived metrics (independent of instance)
 							      TODO: dynamic. */
 	int numder; /* there are numder actual items in the der array */
@@ -331,6 +334,7 @@ struct function_store_handle { //these are per-schema
 static pthread_mutex_t cfg_lock;
 
 static void printStructs(struct function_store_handle *s_handle);
+static void print_header_text(struct function_store_handle *s_handle, FILE *fp);
 
 static func_t enumFct(const char* fct){
 	int i;
@@ -382,14 +386,23 @@ static int handleRollover(){
 
 	time_t appx = time(NULL);
 
+	/*
+	 * Only the switch to the new files is done under s_handle->lock.
+	 * They are opened and given the header before, and the old ones are
+	 * closed after, so that a slow file system does not stall store().
+	 */
 	for (i = 0; i < nstorekeys; i++){
 		if (storekeys[i] != NULL){
 			s_handle = idx_find(store_idx, (void *)storekeys[i], strlen(storekeys[i]));
 			if (s_handle){
 				FILE* nhfp = NULL;
 				FILE* nfp = NULL;
+				FILE *ofp, *ohfp;
+				struct csv_writer *nw;
 				char tmp_path[PATH_MAX];
 				char tmp_headerpath[PATH_MAX];
+				char *header = NULL;
+				size_t header_len = 0;
 
 				//if we've got here then we've called new_store, but it might be closed
 				pthread_mutex_lock(&s_handle->lock);
@@ -422,20 +435,27 @@ static int handleRollover(){
 					break;
 				}
 
-				if (s_handle->file)
-					fflush(s_handle->file);
-				if (s_handle->headerfile)
-					fflush(s_handle->headerfile);
+				/* the header of the current files, if printed */
+				if (s_handle->printheader == DONT_PRINT_HEADER) {
+					nhfp = open_memstream(&header, &header_len);
+					if (nhfp) {
+						print_header_text(s_handle, nhfp);
+						fclose(nhfp);
+						nhfp = NULL;
+					}
+				}
+				pthread_mutex_unlock(&s_handle->lock);
 
 				//re name: if got here then rollover requested
 				snprintf(tmp_path, PATH_MAX, "%s.%d",
 					 s_handle->path, (int) appx);
-				nfp = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+				nfp = csv_writer_fopen_path(tmp_path, altheader ? NULL : header,
+						header_len, write_hwm, &PG, &nw);
 				if (!nfp){
 					//we cant open the new file, skip
 					msglog(LDMSD_LERROR, "%s: Error: cannot open file <%s>\n",
 					       __FILE__, tmp_path);
-					pthread_mutex_unlock(&s_handle->lock);
+					free(header);
 					continue;
 				}
 
@@ -451,29 +471,32 @@ static int handleRollover(){
 						fclose(nfp);
 						msglog(LDMSD_LERROR, "%s: Error: cannot open file <%s>\n",
 						       __FILE__, tmp_headerpath);
+						free(header);
+						continue;
 					}
-				} else {
-					nhfp = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
-					if (!nhfp){
-						fclose(nfp);
-						msglog(LDMSD_LDEBUG, "%s: Error: cannot open file <%s>\n",
-						       __FILE__, tmp_path);
+					if (header) {
+						fwrite(header, 1, header_len, nhfp);
+						fflush(nhfp);
+						fsync(fileno(nhfp));
+						fclose(nhfp);
+						nhfp = NULL;
 					}
 				}
-				if (!nhfp) {
-					pthread_mutex_unlock(&s_handle->lock);
-					continue;
-				}
 
-				//close and swap
-				if (s_handle->file)
-					fclose(s_handle->file);
-				if (s_handle->headerfile)
-					fclose(s_handle->headerfile);
+				//swap and close
+				pthread_mutex_lock(&s_handle->lock);
+				ofp = s_handle->file;
+				ohfp = s_handle->headerfile;
 				s_handle->file = nfp;
+				s_handle->writer = nw;
 				s_handle->headerfile = nhfp;
-				s_handle->printheader = DO_PRINT_HEADER;
+				s_handle->printheader = header ? DONT_PRINT_HEADER : DO_PRINT_HEADER;
 				pthread_mutex_unlock(&s_handle->lock);
+				if (ofp)
+					fclose(ofp);
+				if (ohfp)
+					fclose(ohfp);
+				free(header);
 			}
 		}
 	}
@@ -1078,6 +1101,15 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl, struct
 	buffer_sz = buf;
 	buffer_type = buft;
 
+	value = av_value(avl, "write_hwm");
+	rc = csv_writer_hwm_parse(value, &write_hwm);
+	if (rc) {
+		msglog(LDMSD_LERROR, "%s: Invalid write_hwm %s\n",
+		       __FILE__, value);
+		pthread_mutex_unlock(&cfg_lock);
+		return rc;
+	}
+
 	value = av_value(avl, "path");
 	if (!value){
 		msglog(LDMSD_LERROR, "store_function missing path\n");
@@ -1198,7 +1230,7 @@ static const char *usage(struct ldmsd_plugin *self)
 {
 	return  "    config name=store_function_csv [path=<path> altheader=<0|1>]\n"
 		"                rollover=<num> rolltype=<num>\n"
-		"                [buffer=<0/1/N> buffertype=<3/4>]\n"
+		"                [buffer=<0/1/N> buffertype=<3/4>] [write_hwm=<size>]\n"
                 "                 derivedconf=<fullpath> [ageusec=<sec>]\n"
 		"         - Set the root path for the storage of csvs and some parameters.\n"
 		"           path       The path to the root of the csv directory\n"
@@ -1207,6 +1239,8 @@ static const char *usage(struct ldmsd_plugin *self)
 		"                     N > 1 to flush after that many kb (> 4) or that many lines (>=1)\n"
 		"         - buffertype [3,4] Defines the policy used to schedule buffer flush.\n"
 		"                      Only applies for N > 1. Same as rolltypes.\n"
+		"         - write_hwm Bytes of output held per file before it is handed to\n"
+		"                     the writer thread (default 64k).\n"
 		"         - rollover   Greater than zero; enables file rollover and sets interval\n"
 		"         - rolltype   [1-n] Defines the policy used to schedule rollover events.\n"
 		ROLLTYPES
@@ -1222,12 +1256,37 @@ static void *get_ucontext(ldmsd_store_handle_t _s_handle)
 	return s_handle->ucontext;
 }
 
+/* caller must hold s_handle->lock */
+static void print_header_text(struct function_store_handle *s_handle, FILE *fp)
+{
+	int i, j;
+
+	/* This allows optional loading a float (Time) into an int field and retaining usec as
+	   a separate field */
+	fprintf(fp, "#Time,Time_usec,DT,DT_usec");
+	fprintf(fp, ",ProducerName");
+	fprintf(fp, ",component_id,job_id");
+
+	//Print the header using the metrics associated with this set
+	for (i = 0; i < s_handle->numder; i++){
+		if (s_handle->der[i]->writeout) {
+			if (s_handle->der[i]->dim == 1) {
+				fprintf(fp, ",%s,%s.Flag", s_handle->der[i]->name, s_handle->der[i]->name);
+			} else {
+				for (j = 0; j < s_handle->der[i]->dim; j++)
+					fprintf(fp, ",%s.%d", s_handle->der[i]->name, j);
+				fprintf(fp, ",%s.Flag", s_handle->der[i]->name);
+			}
+		}
+	}
+	fprintf(fp, ",TimeFlag\n");
+}
+
 static int print_header_from_store(struct function_store_handle *s_handle,
 				   ldms_set_t set, int* metric_arry, size_t metric_count)
 {
 
 	int rc = 0;
-	int i, j;
 
 	/* Only called from Store which already has the lock */
 	if (s_handle == NULL){
@@ -1237,7 +1296,7 @@ static int print_header_from_store(struct function_store_handle *s_handle,
 	}
 	s_handle->printheader = DONT_PRINT_HEADER;
 
-	FILE* fp = s_handle->headerfile;
+	FILE* fp = altheader ? s_handle->headerfile : s_handle->file;
 	if (!fp){
 		msglog(LDMSD_LERROR, "%s: Cannot print header for store_function_csv. No headerfile\n",
 			__FILE__);
@@ -1254,32 +1313,17 @@ static int print_header_from_store(struct function_store_handle *s_handle,
 	}
 
 
-	/* This allows optional loading a float (Time) into an int field and retaining usec as
-	   a separate field */
-	fprintf(fp, "#Time,Time_usec,DT,DT_usec");
-	fprintf(fp, ",ProducerName");
-	fprintf(fp, ",component_id,job_id");
-
-	//Print the header using the metrics associated with this set
-	for (i = 0; i < s_handle->numder; i++){
-		if (s_handle->der[i]->writeout) {
-			if (s_handle->der[i]->dim == 1) {
-				fprintf(fp, ",%s,%s.Flag", s_handle->der[i]->name, s_handle->der[i]->name);
-			} else {
-				for (j = 0; j < s_handle->der[i]->dim; j++)
-					fprintf(fp, ",%s.%d", s_handle->der[i]->name, j);
-				fprintf(fp, ",%s.Flag", s_handle->der[i]->name);
-			}
-		}
-	}
-	fprintf(fp, ",TimeFlag\n");
+	print_header_text(s_handle, fp);
 
 	/* Flush for the header, whether or not it is the data file as well */
 	fflush(fp);
-	fsync(fileno(fp));
-
-	fclose(s_handle->headerfile);
-	s_handle->headerfile = 0;
+	if (altheader) {
+		fsync(fileno(fp));
+		fclose(s_handle->headerfile);
+		s_handle->headerfile = 0;
+	} else {
+		csv_writer_flush(s_handle->writer, 1);
+	}
 
 	return 0;
 }
@@ -1391,7 +1435,8 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	}
 
 	if (!s_handle->file)  { /* theoretically, we should never already have this file */
-		s_handle->file = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+		s_handle->file = csv_writer_fopen_path(tmp_path, NULL, 0,
+				write_hwm, &PG, &s_handle->writer);
 	}
 	if (!s_handle->file) {
 		msglog(LDMSD_LERROR, "%s: Error %d opening the file %s.\n",
@@ -1405,25 +1450,22 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	 * New in v3: since it may be a new set of metrics, possibly append to the header.
 	 */
 
-	if (!s_handle->headerfile){ /* theoretically, we should never already have this file */
-		if (altheader) {
-			char tmp_headerpath[PATH_MAX];
-			if (rolltype >= MINROLLTYPE){
-				snprintf(tmp_headerpath, PATH_MAX,
-					 "%s.HEADER.%d", s_handle->path, (int)appx);
-			} else {
-				snprintf(tmp_headerpath, PATH_MAX,
-					 "%s.HEADER", s_handle->path);
-			}
-
-			/* truncate a separate headerfile if its the first time */
-			if (s_handle->printheader == FIRST_PRINT_HEADER){
-				s_handle->headerfile = fopen_perm(tmp_headerpath, "w", LDMSD_DEFAULT_FILE_PERM);
-			} else if (s_handle->printheader == DO_PRINT_HEADER){
-				s_handle->headerfile = fopen_perm(tmp_headerpath, "a+", LDMSD_DEFAULT_FILE_PERM);
-			}
+	/* without altheader, the header goes through the writer with the data */
+	if (altheader && !s_handle->headerfile){ /* theoretically, we should never already have this file */
+		char tmp_headerpath[PATH_MAX];
+		if (rolltype >= MINROLLTYPE){
+			snprintf(tmp_headerpath, PATH_MAX,
+				 "%s.HEADER.%d", s_handle->path, (int)appx);
 		} else {
-			s_handle->headerfile = fopen_perm(tmp_path, "a+", LDMSD_DEFAULT_FILE_PERM);
+			snprintf(tmp_headerpath, PATH_MAX,
+				 "%s.HEADER", s_handle->path);
+		}
+
+		/* truncate a separate headerfile if its the first time */
+		if (s_handle->printheader == FIRST_PRINT_HEADER){
+			s_handle->headerfile = fopen_perm(tmp_headerpath, "w", LDMSD_DEFAULT_FILE_PERM);
+		} else if (s_handle->printheader == DO_PRINT_HEADER){
+			s_handle->headerfile = fopen_perm(tmp_headerpath, "a+", LDMSD_DEFAULT_FILE_PERM);
 		}
 
 		if (!s_handle->headerfile){
@@ -1471,6 +1513,7 @@ open_store(struct ldmsd_store *s, const char *container, const char* schema,
 	if (s_handle->file)
 		fclose(s_handle->file);
 	s_handle->file = NULL;
+	s_handle->writer = NULL;
 
  err2a:
 	if (s_handle->schema)
@@ -2937,7 +2980,7 @@ store(ldmsd_store_handle_t _s_handle, ldms_set_t set, int *metric_arry, size_t m
 		}
 		if ((s_handle->buffer_sz == 0) || doflush){
 			fflush(s_handle->file);
-			fsync(fileno(s_handle->file));
+			csv_writer_flush(s_handle->writer, 1);
 		}
 	}
 
@@ -2954,7 +2997,10 @@ static int flush_store(ldmsd_store_handle_t _s_handle)
 		return -1;
 	}
 	pthread_mutex_lock(&s_handle->lock);
-	fflush(s_handle->file);
+	if (s_handle->file) {
+		fflush(s_handle->file);
+		csv_writer_flush(s_handle->writer, 0);
+	}
 	pthread_mutex_unlock(&s_handle->lock);
 
 	return 0;
@@ -2976,15 +3022,15 @@ static void close_store(ldmsd_store_handle_t _s_handle)
 	pthread_mutex_lock(&s_handle->lock);
 	msglog(LDMSD_LDEBUG,"%s: Closing store_csv with path <%s>\n",
 	       __FILE__, s_handle->path);
-	fflush(s_handle->file);
 	s_handle->store = NULL;
 	if (s_handle->path)
 		free(s_handle->path);
 	s_handle->path = NULL;
 	s_handle->ucontext = NULL;
 	if (s_handle->file)
-		fclose(s_handle->file);
+		fclose(s_handle->file); /* closes the writer */
 	s_handle->file = NULL;
+	s_handle->writer = NULL;
 	if (s_handle->headerfile)
 		fclose(s_handle->headerfile);
 	s_handle->headerfile = NULL;
@@ -3044,6 +3090,8 @@ static struct ldmsd_store store_function_csv = {
 struct ldmsd_plugin *get_plugin(ldmsd_msg_log_f pf)
 {
 	msglog = pf;
+	PG.msglog = pf;
+	PG.pname = "store_function_csv";
 	return &store_function_csv.base;
 }
 
@@ -68,6 +68,7 @@
 #include "ldms.h"
 #include "ldmsd.h"
 #include "ldmsd_stream.h"
+#include "../store_csv_common.h"
 
 /*
  * CURRENT GROUND RULES:
@@ -153,6 +154,7 @@ static int flthread_used = 0;
 static char *root_path = NULL;
 static char *container = NULL;
 static int buffer;
+static size_t write_hwm = CSV_WRITER_HWM_DEFAULT;
 static pthread_mutex_t cfg_lock = PTHREAD_MUTEX_INITIALIZER;
 
 ; /* seralizes config args and stream_idx */
@@ -193,7 +195,8 @@ struct csv_stream_handle {
 	 * (root_path + container + stream)
 	 */
 	char *basename;
-	FILE *file;
+	FILE *file; /* stdio stream of writer */
+	struct csv_writer *writer;
 
 	int64_t store_count; /* for the roll. Cumulative since last roll */
 	int64_t byte_count; /* for the roll. Cumulative since last roll */
@@ -261,10 +264,11 @@ static void close_streamstore(void *obj, void *cb_arg)
 
 	if (stream_handle->file) {
 		fflush(stream_handle->file);
-		fsync(fileno(stream_handle->file));
-		fclose(stream_handle->file);
+		csv_writer_flush(stream_handle->writer, 1);
+		fclose(stream_handle->file); /* closes the writer */
 	}
 	stream_handle->file = NULL;
+	stream_handle->writer = NULL;
 
 	_clear_key_info(&stream_handle->dataline);
 	stream_handle->store_count = 0;
@@ -548,7 +552,7 @@ static int _print_header(struct csv_stream_handle *stream_handle)
 		fprintf(stream_handle->file, "#%s\n",
 				stream_handle->dataline.header);
 		fflush(stream_handle->file);
-		fsync(fileno(stream_handle->file));
+		csv_writer_flush(stream_handle->writer, 1);
 		return 0;
 	}
 
@@ -740,7 +744,8 @@ out:
 	return 0;
 }
 
-static void _roll_innards(struct csv_stream_handle *stream_handle);
+static void _roll_innards(struct csv_stream_handle *stream_handle,
+			  const char *header, size_t header_len);
 static int stream_cb(ldmsd_stream_client_t c, void *ctxt,
 			ldmsd_stream_type_t stream_type, const char *msg,
 			size_t msg_len, json_entity_t e)
@@ -839,7 +844,7 @@ static int stream_cb(ldmsd_stream_client_t c, void *ctxt,
 			 * this is going on.
 			 */
 			fflush(stream_handle->file);
-			fsync(fileno(stream_handle->file));
+			csv_writer_flush(stream_handle->writer, 1);
 		}
 	} else if (stream_type == LDMSD_STREAM_JSON) {
 		if (!e) {
@@ -873,7 +878,7 @@ static int stream_cb(ldmsd_stream_client_t c, void *ctxt,
 
 		if (!buffer) {
 			fflush(stream_handle->file);
-			fsync(fileno(stream_handle->file));
+			csv_writer_flush(stream_handle->writer, 1);
 		}
 	} else {
 		msglog(LDMSD_LERROR, PNAME ": unknown stream type\n");
@@ -893,6 +898,7 @@ static int open_streamstore(char *stream)
 	char *tmp_basename;
 	char *dpath;
 	FILE *tmp_file;
+	struct csv_writer *tmp_writer;
 	unsigned long tspath;
 	int rc = 0;
 
@@ -939,7 +945,8 @@ static int open_streamstore(char *stream)
 	}
 	rc = 0;
 
-	tmp_file = fopen_perm(tmp_filename, "a+", LDMSD_DEFAULT_FILE_PERM);
+	tmp_file = csv_writer_fopen_path(tmp_filename, NULL, 0, write_hwm,
+					 &PG, &tmp_writer);
 	if (!tmp_file) {
 		msglog(LDMSD_LERROR, PNAME ": Error %d opening the file %s.\n",
 							errno, tmp_filename);
@@ -958,6 +965,7 @@ static int open_streamstore(char *stream)
 
 	/* swap */
 	stream_handle->file = tmp_file;
+	stream_handle->writer = tmp_writer;
 	stream_handle->basename = tmp_basename;
 	stream_handle->stream = strdup(stream);
 	if (!stream_handle->stream) {
@@ -977,7 +985,7 @@ static int open_streamstore(char *stream)
 err1:
 	free(tmp_basename);
 	if (stream_handle) {
-		free(stream_handle->file);
+		fclose(stream_handle->file);
 		free(stream_handle->basename);
 		free(stream_handle->stream);
 		pthread_mutex_unlock(&stream_handle->lock);
@@ -991,25 +999,27 @@ out:
 	return rc;
 }
 
-static void _roll_innards(struct csv_stream_handle *stream_handle)
+static void _roll_innards(struct csv_stream_handle *stream_handle,
+			  const char *header, size_t header_len)
 {
 	FILE *nfp = NULL;
+	FILE *ofp;
+	struct csv_writer *nw;
 	char *tmp_filename = NULL;
 	size_t pathlen;
 	unsigned long tmp_tspath;
 
 	/* this fct enables roll on demand (e.g., reset the headers)*/
 
-	/* stream_handle->lock should be held coming into this */
+	/*
+	 * stream_handle->lock should NOT be held coming into this. The new
+	 * file is opened and given the header before the switch, and the
+	 * old one is closed after, so that the stream_cb is not stalled.
+	 */
 
 	if (!stream_handle)
 		return;
 
-	if (stream_handle->file) { /* this should always be true */
-		fflush(stream_handle->file);
-		fsync(fileno(stream_handle->file));
-	}
-
 	pathlen = strlen(stream_handle->basename) + 12;
 	tmp_filename = malloc(pathlen);
 	if (!tmp_filename) {
@@ -1021,18 +1031,26 @@ static void _roll_innards(struct csv_stream_handle *stream_handle)
 	msglog(LDMSD_LDEBUG, PNAME ": stream '%s' will have file '%s'\n",
 					stream_handle->stream, tmp_filename);
 
-	nfp = fopen_perm(tmp_filename, "a+", LDMSD_DEFAULT_FILE_PERM);
+	nfp = csv_writer_fopen_path(tmp_filename, header, header_len,
+				    write_hwm, &PG, &nw);
 	if (!nfp) {
 		msglog(LDMSD_LERROR, PNAME ": Error %d opening the file %s.\n",
 							errno, tmp_filename);
 		goto out;
 	}
 
-	/* close and swap */
-	if (stream_handle->file) { /* this should always be true */
-		fclose(stream_handle->file);
-	}
+	/* swap and close */
+	pthread_mutex_lock(&stream_handle->lock);
+	ofp = stream_handle->file;
 	stream_handle->file = nfp;
+	stream_handle->writer = nw;
+	/* the header showed up after the roll began */
+	if (!header)
+		_print_header(stream_handle);
+	pthread_mutex_unlock(&stream_handle->lock);
+	if (ofp) { /* this should always be true */
+		fclose(ofp);
+	}
 
 out:
 	free(tmp_filename);
@@ -1041,6 +1059,8 @@ out:
 
 static void roll_cb(void *obj, void *cb_arg)
 {
+	char *header = NULL;
+	size_t header_len = 0;
 
 	/* if we've got here then we've called a stream_store */
 	if (!obj)
@@ -1057,12 +1077,14 @@ static void roll_cb(void *obj, void *cb_arg)
 		break;
 	case ROLL_BY_RECORDS:
 		if (stream_handle->store_count < rollover) {
-			goto out;
+			pthread_mutex_unlock(&stream_handle->lock);
+			return;
 		}
 		break;
 	case ROLL_BY_BYTES:
 		if (stream_handle->byte_count < rollover) {
-			goto out;
+			pthread_mutex_unlock(&stream_handle->lock);
+			return;
 		}
 		break;
 	default:
@@ -1075,12 +1097,19 @@ static void roll_cb(void *obj, void *cb_arg)
 	stream_handle->store_count = 0;
 	stream_handle->byte_count = 0;
 
-	_roll_innards(stream_handle);
 	/* only print the header if its on a roll */
-	_print_header(stream_handle);
-
-out:
+	if (stream_handle->dataline.header) {
+		header_len = strlen(stream_handle->dataline.header) + 2;
+		header = malloc(header_len + 1);
+		if (header)
+			sprintf(header, "#%s\n", stream_handle->dataline.header);
+		else
+			header_len = 0;
+	}
 	pthread_mutex_unlock(&stream_handle->lock);
+
+	_roll_innards(stream_handle, header, header_len);
+	free(header);
 }
 
 struct flush_cb_arg {
@@ -1110,7 +1139,7 @@ static void flush_cb(void *obj, void *cb_arg)
 					stream_handle->stream, timex,
 					stream_handle->tlastrcv.tv_sec);
 			fflush(stream_handle->file);
-			fsync(fileno(stream_handle->file));
+			csv_writer_flush(stream_handle->writer, 1);
 		}
 	}
 
@@ -1274,6 +1303,13 @@ static int config(struct ldmsd_plugin *self, struct attr_value_list *kwl,
 		msglog(LDMSD_LDEBUG, PNAME ": setting buffer to '%d'\n", buffer);
 	}
 
+	s = av_value(avl, "write_hwm");
+	rc = csv_writer_hwm_parse(s, &write_hwm);
+	if (rc) {
+		msglog(LDMSD_LERROR, PNAME ": invalid write_hwm '%s'\n", s);
+		goto out;
+	}
+
 	s = av_value(avl, "stream");
 	if (!s) {
 		msglog(LDMSD_LDEBUG, PNAME ": missing stream in config\n");
@@ -1458,6 +1494,7 @@ static void term(struct ldmsd_plugin *self)
 	free(container);
 	container = NULL;
 	buffer = 1;
+	write_hwm = CSV_WRITER_HWM_DEFAULT;
 	rolltype = DEFAULT_ROLLTYPE;
 	rollover = 0;
 	rollagain = 0;
@@ -1472,13 +1509,14 @@ static void term(struct ldmsd_plugin *self)
 static const char* usage(struct ldmsd_plugin *self)
 {
 	return "    config name=stream_csv_store path=<path> container=<container> stream=<stream> \n"
-			"          [flushtime=<N>] [buffer=<0/1>] [rollover=<N> rolltype=<N>]\n"
+			"          [flushtime=<N>] [buffer=<0/1>] [write_hwm=<size>] [rollover=<N> rolltype=<N>]\n"
 			"         - Set the root path for the storage of csvs and some default parameters\n"
 			"         - path          The path to the root of the csv directory\n"
 			"         - container     The directory under the path\n"
 			"         - stream        a comma separated list of streams, each of which will also be its file name\n"
 			"         - flushtime     Time in sec for a regular flush (independent of any other rollover or flush directives)\n"
 			" 	  - buffer        0 to disable buffering, 1 to enable it with autosize (default)\n"
+			"         - write_hwm     Bytes of output held per file before it is handed to the writer thread (default 64k)\n"
 			"         - rollover      Greater than or equal to zero; enables file rollover and sets interval\n"
 			"         - rolltype      [1-n] Defines the policy used to schedule rollover events.\n"
 	ROLLTYPES
@@ -1498,5 +1536,7 @@ static struct ldmsd_store stream_csv_store = {
 struct ldmsd_plugin* get_plugin(ldmsd_msg_log_f pf)
 {
 	msglog = pf;
+	PG.msglog = pf;
+	PG.pname = PNAME;
 	return &stream_csv_store.base;
 }
@@ -0,0 +1,272 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+#include "store_csv_common.h"
+
+/*
+ * Writes the same rows through a plain, a gzip and a zstd csv_writer with
+ * a small high-water mark, so the double buffer is swapped many times,
+ * flushes at random points and rolls over to a new file every ROLL_ROWS
+ * rows the way store_csv does (close the writer, open a new file). Then
+ * checks that every plain file holds exactly the rows written to it and
+ * that the compressed files decompress to the plain files.
+ */
+
+#define ROWS 20000
+#define ROLL_ROWS 7000
+#define FILES ((ROWS + ROLL_ROWS - 1) / ROLL_ROWS)
+#define HWM 4096
+
+static const char *cps_name[] = { "none", "gzip", "zstd" };
+
+/* provided by ldmsd to the store plugins */
+void ldmsd_log(enum ldmsd_loglevel level, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static struct csv_plugin_static cps = {
+	.pname = "test_csv_writer",
+	.msglog = ldmsd_log,
+};
+
+static char dir[] = "/tmp/test_csv_writer.XXXXXX";
+static int errors;
+
+void verify(int exp)
+{
+	if (exp)
+		printf("passed\n");
+	else
+		printf("failed\n");
+}
+
+static void path(char *buf, size_t sz, int type, int i)
+{
+	snprintf(buf, sz, "%s/data.%d.%s", dir, i, cps_name[type]);
+}
+
+static struct csv_writer *writer_open(int type, int i)
+{
+	struct csv_writer *w;
+	char p[PATH_MAX];
+	FILE *f;
+	int rc;
+
+	path(p, sizeof(p), type, i);
+	f = fopen(p, "w");
+	if (!f) {
+		printf("fopen(%s) failed, errno %d\n", p, errno);
+		exit(1);
+	}
+	w = csv_writer_new(f, p, HWM, &cps);
+	if (!w) {
+		printf("csv_writer_new(%s) failed, errno %d\n", p, errno);
+		exit(1);
+	}
+	rc = csv_writer_compress(w, type, CSV_COMPRESS_LEVEL_DEFAULT);
+	if (rc) {
+		printf("csv_writer_compress(%s) failed, error %d\n", p, rc);
+		exit(1);
+	}
+	return w;
+}
+
+static char *read_file(const char *p, size_t *len)
+{
+	char *buf;
+	long sz;
+	FILE *f;
+
+	f = fopen(p, "r");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	sz = ftell(f);
+	rewind(f);
+	buf = malloc(sz + 1);
+	if (!buf || fread(buf, 1, sz, f) != sz) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*len = sz;
+	return buf;
+}
+
+#ifdef HAVE_LIBZ
+/* Inflate the concatenated gzip members of in */
+static int gunzip(const char *in, size_t in_len, struct csv_buf *out)
+{
+	char obuf[16384];
+	z_stream z = { 0 };
+	int zrc;
+
+	if (inflateInit2(&z, 15 + 16) != Z_OK)
+		return EIO;
+	z.next_in = (Bytef *)in;
+	z.avail_in = in_len;
+	while (z.avail_in) {
+		z.next_out = (Bytef *)obuf;
+		z.avail_out = sizeof(obuf);
+		zrc = inflate(&z, Z_NO_FLUSH);
+		if (zrc != Z_OK && zrc != Z_STREAM_END)
+			break;
+		csv_buf_putn(out, obuf, sizeof(obuf) - z.avail_out);
+		if (zrc == Z_STREAM_END)
+			inflateReset(&z);
+	}
+	inflateEnd(&z);
+	return z.avail_in ? EIO : 0;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+/* Decompress the concatenated zstd frames of in */
+static int unzstd(const char *in, size_t in_len, struct csv_buf *out)
+{
+	char obuf[16384];
+	ZSTD_inBuffer zin = { in, in_len, 0 };
+	ZSTD_outBuffer zout;
+	ZSTD_DCtx *zs;
+	size_t rc = 0;
+
+	zs = ZSTD_createDCtx();
+	if (!zs)
+		return ENOMEM;
+	while (zin.pos < zin.size) {
+		zout.dst = obuf;
+		zout.size = sizeof(obuf);
+		zout.pos = 0;
+		rc = ZSTD_decompressStream(zs, &zout, &zin);
+		if (ZSTD_isError(rc))
+			break;
+		csv_buf_putn(out, obuf, zout.pos);
+	}
+	ZSTD_freeDCtx(zs);
+	return ZSTD_isError(rc) || rc ? EIO : 0;
+}
+#endif
+
+static void check_file(int type, int i, struct csv_buf *exp)
+{
+	struct csv_buf out = { 0 };
+	char p[PATH_MAX], *data;
+	size_t len;
+	int rc;
+
+	path(p, sizeof(p), type, i);
+	data = read_file(p, &len);
+	if (!data) {
+		printf("reading %s failed, errno %d\n", p, errno);
+		errors++;
+		return;
+	}
+	switch (type) {
+#ifdef HAVE_LIBZ
+	case CSV_COMPRESS_GZIP:
+		rc = gunzip(data, len, &out);
+		break;
+#endif
+#ifdef HAVE_LIBZSTD
+	case CSV_COMPRESS_ZSTD:
+		rc = unzstd(data, len, &out);
+		break;
+#endif
+	default:
+		csv_buf_putn(&out, data, len);
+		rc = 0;
+		break;
+	}
+	if (rc) {
+		printf("%s: decompression failed\n", p);
+		errors++;
+	} else if (out.len != exp->len || memcmp(out.buf, exp->buf, out.len)) {
+		printf("%s: %zu bytes differ from the %zu bytes expected\n",
+		       p, out.len, exp->len);
+		errors++;
+	}
+	csv_buf_free(&out);
+	free(data);
+	unlink(p);
+}
+
+int main(int argc, char **argv)
+{
+	struct csv_writer *w[3] = { 0 };
+	struct csv_buf exp[FILES] = { 0 }, row = { 0 };
+	int types[3], ntypes = 0;
+	int i, j, t, f, rc;
+
+	srandom(1);
+	if (!mkdtemp(dir)) {
+		printf("mkdtemp failed, errno %d\n", errno);
+		return 1;
+	}
+	for (t = 0; t < 3; t++) {
+		if (0 == csv_compress_parse(cps_name[t], &types[ntypes]))
+			ntypes++;
+		else
+			printf("%s is not available, skipped\n", cps_name[t]);
+	}
+
+	for (f = i = 0; i < ROWS; i++) {
+		if (i % ROLL_ROWS == 0) {
+			/* rollover, the first file is opened here as well */
+			for (t = 0; t < ntypes; t++) {
+				if (w[t] && csv_writer_close(w[t]))
+					errors++;
+				w[t] = writer_open(types[t], f);
+			}
+			f++;
+		}
+		csv_buf_reset(&row);
+		csv_buf_printf(&row, "%d,%ld", i, random());
+		/* rows from a few bytes to more than the hwm */
+		for (j = random() % (i % 100 ? 20 : 2000); j; j--)
+			csv_buf_printf(&row, ",%ld", random() % 1000);
+		csv_buf_putn(&row, "\n", 1);
+		csv_buf_putn(&exp[f - 1], row.buf, row.len);
+		for (t = 0; t < ntypes; t++) {
+			rc = csv_writer_write(w[t], row.buf, row.len);
+			if (rc)
+				errors++;
+		}
+		if (random() % 500 == 0) {
+			for (t = 0; t < ntypes; t++)
+				csv_writer_flush(w[t], random() % 2);
+		}
+	}
+	for (t = 0; t < ntypes; t++) {
+		if (csv_writer_close(w[t]))
+			errors++;
+	}
+
+	for (f = 0; f < FILES; f++) {
+		for (t = 0; t < ntypes; t++)
+			check_file(types[t], f, &exp[f]);
+		csv_buf_free(&exp[f]);
+	}
+	csv_buf_free(&row);
+	rmdir(dir);
+
+	printf("csv_writer output of %d rows in %d files matches the input, "
+	       "compressed output decompresses to the plain output : ",
+	       ROWS, FILES);
+	verify(errors == 0);
+	return errors != 0;
+}
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bts.h"
+
+#define SCHEMA_NAME "my_schema"
+#define COMP_COUNT 3
+#define REC_COUNT 1000
+#define STRIDE 16
+#define T0 1700000000000000ULL /* usec */
+#define DT 1000000ULL
+
+void verify(int exp)
+{
+	if (exp)
+		printf("passed\n");
+	else
+		printf("failed\n");
+}
+
+static struct bts_col_def cols[] = {
+	{ "u64", LDMS_V_U64, 1 },
+	{ "array", LDMS_V_U32_ARRAY, 3 },
+	{ "name", LDMS_V_CHAR_ARRAY, 8 },
+	{ "d64", LDMS_V_D64, 1 },
+};
+
+/* record i is component i % COMP_COUNT at T0 + (i / COMP_COUNT) * DT */
+static void append(bts_writer_t w, int i)
+{
+	uint8_t *rec;
+	uint32_t *a;
+	double d = i / 2.0;
+	uint64_t v = htole64(i);
+
+	rec = bts_writer_rec_begin(w, T0 + (i / COMP_COUNT) * DT, i % COMP_COUNT);
+	assert(rec);
+	memcpy(rec + bts_writer_col_offset(w, 0), &v, 8);
+	a = (uint32_t *)(rec + bts_writer_col_offset(w, 1));
+	a[0] = htole32(i);
+	a[1] = htole32(i + 1);
+	a[2] = htole32(i + 2);
+	snprintf((char *)rec + bts_writer_col_offset(w, 2), 8, "n%d", i % 100);
+	memcpy(rec + bts_writer_col_offset(w, 3), &d, 8);
+	bts_writer_rec_end(w);
+}
+
+struct result {
+	int count;
+	int bad;
+	uint64_t last_ts;
+};
+
+static int check_rec(bts_seg_t seg, const void *rec, void *arg)
+{
+	struct result *r = arg;
+	uint64_t i = le64toh(*(uint64_t *)bts_rec_val(seg, rec, 0));
+	const uint32_t *a = bts_rec_val(seg, rec, 1);
+	char name[16];
+
+	snprintf(name, sizeof(name), "n%d", (int)(i % 100));
+	if (bts_rec_ts(rec) != T0 + (i / COMP_COUNT) * DT ||
+	    bts_rec_comp_id(rec) != i % COMP_COUNT ||
+	    le32toh(a[2]) != i + 2 ||
+	    strcmp(bts_rec_val(seg, rec, 2), name) ||
+	    *(double *)bts_rec_val(seg, rec, 3) != i / 2.0 ||
+	    bts_rec_ts(rec) < r->last_ts)
+		r->bad++;
+	r->last_ts = bts_rec_ts(rec);
+	r->count++;
+	return 0;
+}
+
+static struct result query(const char *dir, uint64_t begin, uint64_t end,
+			   const uint64_t *comps, int comp_count)
+{
+	struct bts_query q = { begin, end, comps, comp_count };
+	struct result r = {0};
+	bts_seg_t seg;
+	char **paths;
+	int i, n;
+
+	n = bts_seg_list(dir, SCHEMA_NAME, &paths);
+	assert(n >= 0);
+	for (i = 0; i < n; i++) {
+		seg = bts_seg_open(paths[i]);
+		assert(seg);
+		bts_seg_query(seg, &q, check_rec, &r);
+		bts_seg_close(seg);
+	}
+	bts_seg_list_free(paths, n);
+	return r;
+}
+
+/* the records of the components in [begin, end) */
+static int expected(int rec_count, uint64_t begin, uint64_t end,
+		    const uint64_t *comps, int comp_count)
+{
+	int i, c, n = 0;
+	uint64_t ts;
+
+	for (i = 0; i < rec_count; i++) {
+		ts = T0 + (i / COMP_COUNT) * DT;
+		if (ts < begin || (end && ts >= end))
+			continue;
+		for (c = 0; c < comp_count; c++) {
+			if (comps[c] == i % COMP_COUNT)
+				break;
+		}
+		if (comp_count && c == comp_count)
+			continue;
+		n++;
+	}
+	return n;
+}
+
+static int rec_count; /* records written */
+
+/* The .cidx path of the segment \c path */
+static char *cidx_path(const char *path)
+{
+	char *p;
+	int rc = asprintf(&p, "%.*s" BTS_CIDX_SUFFIX,
+			  (int)(strlen(path) - strlen(BTS_SUFFIX)), path);
+	assert(rc > 0);
+	return p;
+}
+
+/* Make the last entry of the first chunk point past the record numbers */
+static void cidx_corrupt(const char *path)
+{
+	struct bts_cidx_chunk_s ch;
+	struct bts_cidx_ent_s e;
+	char *p = cidx_path(path);
+	off_t off;
+	FILE *f = fopen(p, "r+");
+
+	assert(f);
+	off = sizeof(struct bts_cidx_hdr_s);
+	assert(0 == fseek(f, off, SEEK_SET));
+	assert(1 == fread(&ch, sizeof(ch), 1, f));
+	assert(le64toh(ch.comp_count) > 0);
+	off += sizeof(ch) + (le64toh(ch.comp_count) - 1) * sizeof(e);
+	assert(0 == fseek(f, off, SEEK_SET));
+	assert(1 == fread(&e, sizeof(e), 1, f));
+	e.count = htole64(le64toh(e.count) + 1);
+	assert(0 == fseek(f, off, SEEK_SET));
+	assert(1 == fwrite(&e, sizeof(e), 1, f));
+	fclose(f);
+	free(p);
+}
+
+static void test_query(const char *dir, const char *what, uint64_t begin,
+		       uint64_t end, const uint64_t *comps, int comp_count)
+{
+	struct result r = query(dir, begin, end, comps, comp_count);
+	printf("%s : ", what);
+	verify(r.count == expected(rec_count, begin, end, comps, comp_count) &&
+	       !r.bad);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/test_ldms_bts.XXXXXX";
+	uint64_t c1[] = { 1 }, c02[] = { 2, 0, 2 }, c9[] = { 9 };
+	bts_writer_t w;
+	bts_seg_t seg;
+	char **paths;
+	char cmd[64];
+	int i, n;
+	char *tmp;
+
+	tmp = mkdtemp(dir);
+	assert(tmp);
+	/* about 100 records per segment */
+	w = bts_writer_open(dir, SCHEMA_NAME, cols, 4, 4096 + 100 * 64,
+			    STRIDE, 0600);
+	assert(w);
+	/* several component index chunks per segment */
+	for (i = 0; i < REC_COUNT / 2; i++) {
+		append(w, i);
+		if (i % 30 == 29)
+			bts_writer_flush(w);
+	}
+	bts_writer_flush(w);
+	for (; i < REC_COUNT - 5; i++)
+		append(w, i);
+	rec_count = i;
+
+	/* the last segment is open and has unindexed records */
+	test_query(dir, "query all (open segment)", 0, 0, NULL, 0);
+	test_query(dir, "query comp (open segment)", 0, 0, c1, 1);
+
+	for (; i < REC_COUNT; i++)
+		append(w, i);
+	rec_count = i;
+	printf("bts_writer_close() : ");
+	verify(0 == bts_writer_close(w));
+
+	n = bts_seg_list(dir, SCHEMA_NAME, &paths);
+	printf("segments rolled over : ");
+	verify(n > 5);
+	seg = bts_seg_open(paths[0]);
+	printf("segment header : ");
+	verify(seg && bts_seg_closed(seg) && bts_seg_col_count(seg) == 4 &&
+	       0 == strcmp(bts_seg_schema(seg), SCHEMA_NAME) &&
+	       bts_seg_col_find(seg, "name") == 2 &&
+	       bts_seg_col_type(seg, 1) == LDMS_V_U32_ARRAY &&
+	       bts_seg_col_len(seg, 1) == 3);
+	bts_seg_close(seg);
+
+	test_query(dir, "query all", 0, 0, NULL, 0);
+	test_query(dir, "query time range", T0 + 50 * DT, T0 + 120 * DT, NULL, 0);
+	test_query(dir, "query one comp", 0, 0, c1, 1);
+	test_query(dir, "query comps and time range", T0 + 7 * DT,
+		   T0 + 300 * DT, c02, 3);
+	test_query(dir, "query unknown comp", 0, 0, c9, 1);
+	test_query(dir, "query empty time range", T0 + 10000 * DT, 0, NULL, 0);
+
+	/* an inconsistent chunk is not used, the records are scanned */
+	cidx_corrupt(paths[0]);
+	test_query(dir, "query comps with a bad component index", T0 + 7 * DT,
+		   T0 + 300 * DT, c02, 3);
+
+	/* without the indexes the records are scanned */
+	for (i = 0; i < n; i++) {
+		char *p = cidx_path(paths[i]);
+		unlink(p);
+		free(p);
+	}
+	test_query(dir, "query comps without the component index", T0 + 7 * DT,
+		   T0 + 300 * DT, c02, 3);
+
+	printf("a new writer starts a new segment : ");
+	w = bts_writer_open(dir, SCHEMA_NAME, cols, 4, 1 << 20, STRIDE, 0600);
+	assert(w);
+	append(w, 0);
+	bts_writer_close(w);
+	bts_seg_list_free(paths, n);
+	i = bts_seg_list(dir, SCHEMA_NAME, &paths);
+	verify(i == n + 1);
+	bts_seg_list_free(paths, i);
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	if (system(cmd))
+		printf("cannot remove %s\n", dir);
+	return 0;
+}
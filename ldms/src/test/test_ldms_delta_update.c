@@ -0,0 +1,467 @@
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ldms.h"
+
+/*
+ * The server process publishes two sets with the same schema and applies
+ * the same modifications to both. The client looks both up, turns delta
+ * updates on for one of them, and checks after each round that the delta
+ * updated set matches the fully read one.
+ *
+ * Then the server modifies the delta set slowly and continuously while
+ * the client keeps updating it, so that transactions begin between the
+ * client's data header and range reads. Every transaction writes the
+ * same value to two far apart clusters of metrics, so a consistent copy
+ * has the same value in both.
+ */
+
+#define SCHEMA_NAME "delta_schema"
+#define DELTA_SET_NAME "delta_set"
+#define FULL_SET_NAME "full_set"
+#define NUM_METRICS 4096
+#define ARRAY_IDX NUM_METRICS
+#define ARRAY_LEN 256
+#define STATIC_METRICS 128	/* never modified after the set is created */
+#define POISON_METRIC 64	/* see client_round() */
+#define WINDOW 32
+#define ROUNDS 200
+#define CONC_CMD -2		/* client -> server: start the concurrent phase */
+#define CONC_TRANSACTIONS 2000
+#define CONC_GAP_US 500		/* between the two clusters of a transaction */
+#define CONC_STEP_US 20		/* between two transactions */
+#define CLUSTER 8		/* metrics at STATIC_METRICS and at the end */
+
+static char *host = "localhost";
+static char *port = "10401";
+static char *xprt = "sock";
+
+static int srv_cmd[2];	/* client -> server: round number */
+static int srv_ack[2];	/* server -> client: round done */
+
+static sem_t sem;
+static int cb_rc;
+static ldms_set_t delta_set, full_set;
+
+void verify(int exp)
+{
+	if (exp)
+		printf("passed\n");
+	else
+		printf("failed\n");
+}
+
+static ldms_schema_t schema_new()
+{
+	ldms_schema_t schema;
+	char name[16];
+	int i, rc;
+
+	schema = ldms_schema_new(SCHEMA_NAME);
+	assert(schema);
+	for (i = 0; i < NUM_METRICS; i++) {
+		snprintf(name, sizeof(name), "m%d", i);
+		rc = ldms_schema_metric_add(schema, name, LDMS_V_U64);
+		assert(rc == i);
+	}
+	rc = ldms_schema_metric_array_add(schema, "array", LDMS_V_U64_ARRAY,
+					  ARRAY_LEN);
+	assert(rc == ARRAY_IDX);
+	return schema;
+}
+
+/* The modification kinds of the rounds */
+static int round_is_wide(int r)
+{
+	/* too many ranges; the client falls back to a full data read */
+	return (r % 10) == 7;
+}
+
+static int round_transactions(int r)
+{
+	/* transactions missed by the client; the same fall back */
+	return ((r % 10) == 9) ? 3 : 1;
+}
+
+static void modify(ldms_set_t *sets, unsigned int *seed, int r)
+{
+	int i, j, k, w, idx;
+	uint64_t v;
+
+	for (j = 0; j < 2; j++)
+		ldms_transaction_begin(sets[j]);
+	if (round_is_wide(r)) {
+		for (k = 0; k < NUM_METRICS / 2; k++) {
+			idx = STATIC_METRICS +
+			      rand_r(seed) % (NUM_METRICS - STATIC_METRICS);
+			v = rand_r(seed);
+			for (j = 0; j < 2; j++)
+				ldms_metric_set_u64(sets[j], idx, v);
+		}
+	} else {
+		/* a few clusters of changes */
+		for (w = 0; w < 3; w++) {
+			i = STATIC_METRICS +
+			    rand_r(seed) % (NUM_METRICS - STATIC_METRICS - WINDOW);
+			for (k = 0; k < 8; k++) {
+				idx = i + rand_r(seed) % WINDOW;
+				v = rand_r(seed);
+				for (j = 0; j < 2; j++)
+					ldms_metric_set_u64(sets[j], idx, v);
+			}
+		}
+		if (r % 3 == 0) {
+			idx = rand_r(seed) % ARRAY_LEN;
+			v = rand_r(seed);
+			for (j = 0; j < 2; j++)
+				ldms_metric_array_set_u64(sets[j], ARRAY_IDX,
+							  idx, v);
+		}
+	}
+	for (j = 0; j < 2; j++)
+		ldms_transaction_end(sets[j]);
+}
+
+static int cluster_idx(int i)
+{
+	return i < CLUSTER ? STATIC_METRICS + i : NUM_METRICS - 2 * CLUSTER + i;
+}
+
+static void cluster_set(ldms_set_t set, int from, int to, uint64_t v)
+{
+	int i;
+	for (i = from; i < to; i++)
+		ldms_metric_set_u64(set, cluster_idx(i), v);
+}
+
+/*
+ * The first cluster is near the data header and is written first, so a
+ * single read of the whole data does not see a transaction begun after it
+ * copied the header.
+ */
+static void concurrent_modify(ldms_set_t set)
+{
+	uint64_t g;
+
+	ldms_transaction_begin(set);
+	cluster_set(set, 0, 2 * CLUSTER, 0);
+	ldms_transaction_end(set);
+	for (g = 1; g <= CONC_TRANSACTIONS; g += 2) {
+		if (g == 3) {
+			char c = 0;
+			if (write(srv_ack[1], &c, 1) != 1)
+				exit(1);
+		}
+		/*
+		 * The client catches up during the pause at the end. A delta
+		 * update begun after the first transaction then reads its
+		 * ranges while the second one is in progress if the first
+		 * pause falls between its header and range reads.
+		 */
+		ldms_transaction_begin(set);
+		cluster_set(set, 0, 2 * CLUSTER, g);
+		ldms_transaction_end(set);
+		usleep((g / 2 % 8) * CONC_STEP_US);
+		ldms_transaction_begin(set);
+		cluster_set(set, 0, CLUSTER, g + 1);
+		usleep(CONC_GAP_US);
+		cluster_set(set, CLUSTER, 2 * CLUSTER, g + 1);
+		ldms_transaction_end(set);
+		usleep(CONC_GAP_US);
+	}
+}
+
+static void do_server()
+{
+	ldms_schema_t schema;
+	ldms_set_t sets[2];
+	ldms_t x;
+	unsigned int seed = 1;
+	int i, j, r, t, rc;
+	char c = 0;
+
+	ldms_init(16 * 1024 * 1024);
+	schema = schema_new();
+	sets[0] = ldms_set_new(DELTA_SET_NAME, schema);
+	sets[1] = ldms_set_new(FULL_SET_NAME, schema);
+	assert(sets[0] && sets[1]);
+	for (j = 0; j < 2; j++) {
+		ldms_transaction_begin(sets[j]);
+		for (i = 0; i < NUM_METRICS; i++)
+			ldms_metric_set_u64(sets[j], i, i);
+		ldms_transaction_end(sets[j]);
+		ldms_set_publish(sets[j]);
+	}
+	x = ldms_xprt_new(xprt, NULL);
+	assert(x);
+	rc = ldms_xprt_listen_by_name(x, host, port, NULL, NULL);
+	if (rc) {
+		printf("ldms_xprt_listen_by_name error %d\n", rc);
+		exit(1);
+	}
+	if (write(srv_ack[1], &c, 1) != 1)
+		exit(1);
+	while (read(srv_cmd[0], &r, sizeof(r)) == sizeof(r)) {
+		if (r == CONC_CMD) {
+			concurrent_modify(sets[0]);
+			if (write(srv_ack[1], &c, 1) != 1)
+				exit(1);
+			continue;
+		}
+		if (r < 0)
+			break;
+		for (t = 0; t < round_transactions(r); t++)
+			modify(sets, &seed, r);
+		if (write(srv_ack[1], &c, 1) != 1)
+			exit(1);
+	}
+	exit(0);
+}
+
+static void connect_cb(ldms_t x, ldms_xprt_event_t e, void *arg)
+{
+	switch (e->type) {
+	case LDMS_XPRT_EVENT_CONNECTED:
+		cb_rc = 0;
+		break;
+	case LDMS_XPRT_EVENT_REJECTED:
+	case LDMS_XPRT_EVENT_ERROR:
+		cb_rc = ECONNREFUSED;
+		break;
+	default:
+		return;
+	}
+	sem_post(&sem);
+}
+
+static void lookup_cb(ldms_t x, enum ldms_lookup_status status, int more,
+		      ldms_set_t s, void *arg)
+{
+	*(ldms_set_t *)arg = status ? NULL : s;
+	sem_post(&sem);
+}
+
+static void update_cb(ldms_t x, ldms_set_t s, int flags, void *arg)
+{
+	if (LDMS_UPD_ERROR(flags))
+		cb_rc = LDMS_UPD_ERROR(flags);
+	sem_post(&sem);
+}
+
+static int server_round(int r)
+{
+	char c;
+	if (write(srv_cmd[1], &r, sizeof(r)) != sizeof(r))
+		return EIO;
+	if (read(srv_ack[0], &c, 1) != 1)
+		return EIO;
+	return 0;
+}
+
+static int sets_match()
+{
+	int i;
+
+	if (ldms_set_data_gn_get(delta_set) != ldms_set_data_gn_get(full_set))
+		return 0;
+	for (i = 0; i < NUM_METRICS; i++) {
+		if (ldms_metric_get_u64(delta_set, i) !=
+		    ldms_metric_get_u64(full_set, i))
+			return 0;
+	}
+	for (i = 0; i < ARRAY_LEN; i++) {
+		if (ldms_metric_array_get_u64(delta_set, ARRAY_IDX, i) !=
+		    ldms_metric_array_get_u64(full_set, ARRAY_IDX, i))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Returns 1 if the round was verified, 0 if not, and sets *delta_used if a
+ * delta update was detected: before the update, the local copy of a metric
+ * that the server never modifies is overwritten behind the back of the
+ * set. A delta update leaves it alone; a full read restores it.
+ */
+static int client_round(int r, int *delta_used)
+{
+	ldms_mval_t mv;
+	uint64_t orig = 0;
+	int rc, poison;
+
+	/* the first update reads the data the lookup did not */
+	poison = r > 0 && !round_is_wide(r) && round_transactions(r) == 1;
+	if (server_round(r))
+		return 0;
+	if (poison) {
+		mv = ldms_metric_get(delta_set, POISON_METRIC);
+		orig = mv->v_u64;
+		mv->v_u64 = ~orig;
+	}
+	cb_rc = 0;
+	rc = ldms_xprt_update(delta_set, update_cb, NULL);
+	if (rc)
+		return 0;
+	sem_wait(&sem);
+	rc = ldms_xprt_update(full_set, update_cb, NULL);
+	if (rc)
+		return 0;
+	sem_wait(&sem);
+	if (cb_rc)
+		return 0;
+	*delta_used = 0;
+	if (poison) {
+		mv = ldms_metric_get(delta_set, POISON_METRIC);
+		*delta_used = (mv->v_u64 == ~orig);
+		if (*delta_used)
+			mv->v_u64 = orig;
+	}
+	return sets_match();
+}
+
+/*
+ * Update the delta set until the server is done modifying it. \return the
+ * number of consistent updates, or -1 if one of them mixed two
+ * transactions.
+ */
+static int client_concurrent()
+{
+	struct pollfd pfd = { .fd = srv_ack[0], .events = POLLIN };
+	int r = CONC_CMD, i, n = 0;
+	uint64_t v;
+	char c;
+
+	if (write(srv_cmd[1], &r, sizeof(r)) != sizeof(r))
+		return -1;
+	/* the clusters have been reset */
+	if (read(srv_ack[0], &c, 1) != 1)
+		return -1;
+	while (0 == poll(&pfd, 1, 0)) {
+		cb_rc = 0;
+		if (ldms_xprt_update(delta_set, update_cb, NULL))
+			return -1;
+		sem_wait(&sem);
+		if (cb_rc)
+			return -1;
+		if (!ldms_set_is_consistent(delta_set))
+			continue;
+		v = ldms_metric_get_u64(delta_set, cluster_idx(0));
+		for (i = 1; i < 2 * CLUSTER; i++) {
+			if (ldms_metric_get_u64(delta_set, cluster_idx(i)) != v) {
+				printf("transaction %" PRIu64 " mixed with %" PRIu64 "\n",
+				       v, ldms_metric_get_u64(delta_set,
+							     cluster_idx(i)));
+				return -1;
+			}
+		}
+		n++;
+	}
+	if (read(srv_ack[0], &c, 1) != 1)
+		return -1;
+	return n;
+}
+
+static int do_client()
+{
+	ldms_t x;
+	int r, rc, ok, delta_used, delta_count, expected;
+
+	ldms_init(16 * 1024 * 1024);
+	sem_init(&sem, 0, 0);
+	x = ldms_xprt_new(xprt, NULL);
+	assert(x);
+	printf("connect : ");
+	rc = ldms_xprt_connect_by_name(x, host, port, connect_cb, NULL);
+	if (!rc) {
+		sem_wait(&sem);
+		rc = cb_rc;
+	}
+	verify(rc == 0);
+	if (rc)
+		return 1;
+
+	printf("lookup : ");
+	rc = ldms_xprt_lookup(x, DELTA_SET_NAME, LDMS_LOOKUP_BY_INSTANCE,
+			      lookup_cb, &delta_set);
+	if (!rc) {
+		sem_wait(&sem);
+		rc = ldms_xprt_lookup(x, FULL_SET_NAME, LDMS_LOOKUP_BY_INSTANCE,
+				      lookup_cb, &full_set);
+	}
+	if (!rc)
+		sem_wait(&sem);
+	verify(!rc && delta_set && full_set);
+	if (rc || !delta_set || !full_set)
+		return 1;
+	ldms_set_delta_update_set(delta_set, 1);
+
+	ok = 1;
+	delta_count = expected = 0;
+	for (r = 0; r < ROUNDS; r++) {
+		if (!client_round(r, &delta_used)) {
+			printf("round %d: the delta updated set does not match\n", r);
+			ok = 0;
+			break;
+		}
+		if (r > 0 && !round_is_wide(r) && round_transactions(r) == 1)
+			expected++;
+		delta_count += delta_used;
+	}
+	printf("%d rounds, delta updated set matches the full read : ", r);
+	verify(ok);
+	printf("delta updates used (%d of %d rounds) : ", delta_count, expected);
+	verify(ok && delta_count == expected);
+	if (delta_count != expected)
+		ok = 0;
+
+	rc = client_concurrent();
+	printf("%d updates while the set is modified are consistent : ", rc);
+	verify(rc > 0);
+	if (rc <= 0)
+		ok = 0;
+
+	r = -1;
+	if (write(srv_cmd[1], &r, sizeof(r)) != sizeof(r))
+		return 1;
+	ldms_xprt_close(x);
+	return !ok;
+}
+
+int main(int argc, char **argv)
+{
+	pid_t pid;
+	char c;
+	int rc, status;
+
+	if (argc > 1)
+		port = argv[1];
+	if (pipe(srv_cmd) || pipe(srv_ack)) {
+		perror("pipe");
+		return 1;
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (pid == 0)
+		do_server();
+	/* wait for the server to listen */
+	if (read(srv_ack[0], &c, 1) != 1) {
+		printf("The server failed to start\n");
+		return 1;
+	}
+	rc = do_client();
+	if (rc)
+		kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+	return rc;
+}
@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "ldms.h"
+
+#define SCHEMA_NAME "my_schema"
+#define SET_NAME "my_set"
+#define ARRAY_SET_NAME "my_array_set"
+#define REC_TYPE_NAME "my_rec_def"
+#define ARRAY_LEN 5
+#define UNIT "unit"
+
+void verify(int exp)
+{
+	if (exp)
+		printf("passed\n");
+	else
+		printf("failed\n");
+}
+
+static ldms_schema_t schema_new(int array_card)
+{
+	ldms_schema_t schema;
+	ldms_record_t rec_def;
+	int rc;
+
+	schema = ldms_schema_new(SCHEMA_NAME);
+	assert(schema);
+	rc = ldms_schema_meta_add(schema, "component_id", LDMS_V_U64);
+	assert(rc == 0);
+	rc = ldms_schema_metric_add(schema, "u64", LDMS_V_U64);
+	assert(rc == 1);
+	rc = ldms_schema_metric_array_add(schema, "array", LDMS_V_U64_ARRAY, ARRAY_LEN);
+	assert(rc == 2);
+	rec_def = ldms_record_create(REC_TYPE_NAME);
+	assert(rec_def);
+	rc = ldms_record_metric_add(rec_def, "singleton", UNIT, LDMS_V_U64, 1);
+	assert(rc >= 0);
+	rc = ldms_schema_record_add(schema, rec_def);
+	assert(rc == 3);
+	rc = ldms_schema_metric_list_add(schema, "list", UNIT,
+			2 * ldms_record_heap_size_get(rec_def));
+	assert(rc == 4);
+	if (array_card > 1)
+		ldms_schema_array_card_set(schema, array_card);
+	return schema;
+}
+
+static void sample(ldms_set_t set, uint64_t v)
+{
+	ldms_mval_t lh, rec_inst;
+	int i;
+
+	ldms_transaction_begin(set);
+	ldms_metric_set_u64(set, 1, v);
+	for (i = 0; i < ARRAY_LEN; i++)
+		ldms_metric_array_set_u64(set, 2, i, v + i);
+	lh = ldms_metric_get(set, 4);
+	ldms_list_purge(set, lh);
+	rec_inst = ldms_record_alloc(set, 3);
+	assert(rec_inst);
+	ldms_record_set_u64(rec_inst, 0, v);
+	ldms_list_append_record(set, lh, rec_inst);
+	ldms_transaction_end(set);
+}
+
+static int snap_check(ldms_set_t snap, uint64_t v)
+{
+	ldms_mval_t lh, rec_inst;
+	enum ldms_value_type type;
+	size_t cnt;
+	int i;
+
+	if (ldms_metric_get_u64(snap, 0) != 1234)
+		return 0;
+	if (ldms_metric_get_u64(snap, 1) != v)
+		return 0;
+	for (i = 0; i < ARRAY_LEN; i++) {
+		if (ldms_metric_array_get_u64(snap, 2, i) != v + i)
+			return 0;
+	}
+	lh = ldms_metric_get(snap, 4);
+	rec_inst = ldms_list_first(snap, lh, &type, &cnt);
+	if (!rec_inst || type != LDMS_V_RECORD_INST)
+		return 0;
+	if (ldms_record_get_u64(rec_inst, 0) != v)
+		return 0;
+	return ldms_list_next(snap, rec_inst, &type, &cnt) == NULL;
+}
+
+static void test_set(const char *name, int array_card)
+{
+	ldms_set_t set, snap, snap2;
+	void *first;
+
+	printf("--- %s (array_card %d) ---\n", name, array_card);
+	set = ldms_set_new(name, schema_new(array_card));
+	assert(set);
+	ldms_metric_set_u64(set, 0, 1234);
+	sample(set, 10);
+
+	printf("ldms_set_snapshot(<set>) : ");
+	snap = ldms_set_snapshot(set);
+	verify(snap && ldms_set_is_snapshot(snap) && !ldms_set_is_snapshot(set));
+
+	printf("snapshot values : ");
+	verify(snap_check(snap, 10));
+
+	printf("snapshot names : ");
+	verify(0 == strcmp(ldms_set_instance_name_get(snap), name) &&
+	       0 == strcmp(ldms_metric_name_get(snap, 1), "u64") &&
+	       ldms_metric_by_name(snap, "array") == 2);
+
+	printf("snapshot data_gn : ");
+	verify(ldms_set_data_gn_get(snap) == ldms_set_data_gn_get(set));
+
+	sample(set, 20);
+	printf("snapshot is unchanged by a new sample : ");
+	verify(snap_check(snap, 10));
+
+	printf("second snapshot has the new sample : ");
+	snap2 = ldms_set_snapshot(set);
+	verify(snap2 && snap_check(snap2, 20));
+
+	first = snap;
+	ldms_set_snapshot_release(snap);
+	ldms_set_snapshot_release(snap2);
+
+	printf("released buffers are reused : ");
+	snap = ldms_set_snapshot(set);
+	verify(snap == snap2 || snap == first);
+
+	printf("reused buffer has the current values : ");
+	verify(snap_check(snap, 20));
+	ldms_set_snapshot_release(snap);
+
+	printf("metadata change is picked up : ");
+	ldms_metric_set_u64(set, 0, 4321);
+	snap = ldms_set_snapshot(set);
+	verify(snap && ldms_metric_get_u64(snap, 0) == 4321);
+	ldms_metric_set_u64(set, 0, 1234);
+	ldms_set_snapshot_release(snap);
+
+	printf("snapshot inside a transaction fails with EBUSY : ");
+	ldms_transaction_begin(set);
+	snap = ldms_set_snapshot(set);
+	verify(!snap && errno == EBUSY);
+	ldms_transaction_end(set);
+
+	ldms_set_delete(set);
+}
+
+int main(int argc, char **argv)
+{
+	ldms_init(1024 * 1024L);
+	test_set(SET_NAME, 1);
+	test_set(ARRAY_SET_NAME, 3);
+	return 0;
+}
@@ -0,0 +1,262 @@
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ldmsd.h"
+
+/*
+ * Compares the number formatters of the row serializers with snprintf():
+ * ldmsd_fmt_u64()/ldmsd_fmt_s64() with PRIu64/PRId64, ldmsd_fmt_u64_pad()
+ * with "%020" PRIu64, and ldmsd_fmt_real() with "%.<prec>g" for the
+ * precisions used for float (9) and double (17) columns and the "%g"
+ * default (6).
+ *
+ * ldmsd_fmt_real() computes its digits in long double. Its last digit may
+ * differ from snprintf() when the value is very close to a rounding tie;
+ * such outputs are accepted if they convert back to the same value, and
+ * are counted.
+ */
+
+#define RANDOM_COUNT 200000
+
+static uint64_t seed = 88172645463325252ULL;
+static int errors;
+static int ties;
+
+void verify(int exp)
+{
+	if (exp)
+		printf("passed\n");
+	else
+		printf("failed\n");
+}
+
+/* xorshift64 */
+static uint64_t rnd()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static void check_str(const char *what, const char *exp, const char *p,
+		      const char *end)
+{
+	if (strlen(exp) == end - p && 0 == memcmp(exp, p, end - p))
+		return;
+	if (errors++ < 20)
+		printf("%s: expected '%s', got '%.*s'\n", what, exp,
+		       (int)(end - p), p);
+}
+
+static void check_u64(uint64_t v)
+{
+	char exp[32], buf[LDMSD_FMT_INT_MAX];
+	snprintf(exp, sizeof(exp), "%" PRIu64, v);
+	check_str("ldmsd_fmt_u64", exp, buf, ldmsd_fmt_u64(buf, v));
+}
+
+static void check_s64(int64_t v)
+{
+	char exp[32], buf[LDMSD_FMT_INT_MAX];
+	snprintf(exp, sizeof(exp), "%" PRId64, v);
+	check_str("ldmsd_fmt_s64", exp, buf, ldmsd_fmt_s64(buf, v));
+}
+
+static void check_pad(uint64_t v, int n)
+{
+	char exp[32], buf[32], *end;
+	snprintf(exp, sizeof(exp), "%020" PRIu64, v);
+	end = ldmsd_fmt_u64_pad(buf, v, n);
+	if (end != buf + n) {
+		errors++;
+		printf("ldmsd_fmt_u64_pad(%" PRIu64 ", %d) wrote %d bytes\n",
+		       v, n, (int)(end - buf));
+		return;
+	}
+	check_str("ldmsd_fmt_u64_pad", exp + 20 - n, buf, end);
+}
+
+/* Split the "%.<prec-1>Le" form of `s` into its digits and exponent */
+static void digits(const char *s, int prec, int64_t *m, int *e)
+{
+	char buf[64], *p;
+	snprintf(buf, sizeof(buf), "%.*Le", prec - 1, fabsl(strtold(s, NULL)));
+	*m = 0;
+	for (p = buf; *p != 'e'; p++) {
+		if (*p != '.')
+			*m = *m * 10 + (*p - '0');
+	}
+	*e = atoi(p + 1);
+}
+
+/* The outputs differ by at most one in the last digit */
+static int last_digit_off(const char *a, const char *b, int prec)
+{
+	int64_t ma, mb;
+	int ea, eb;
+
+	if ((a[0] == '-') != (b[0] == '-'))
+		return 0;
+	digits(a, prec, &ma, &ea);
+	digits(b, prec, &mb, &eb);
+	if (ea == eb)
+		return llabs(ma - mb) <= 1;
+	/* e.g. 9.99...9e+1 and 1.00...0e+2 */
+	if (ea == eb + 1)
+		return llabs(ma * 10 - mb) <= 10;
+	if (eb == ea + 1)
+		return llabs(mb * 10 - ma) <= 10;
+	return 0;
+}
+
+static void check_real(double v, int prec)
+{
+	char exp[64], buf[LDMSD_FMT_REAL_MAX + 1], *end;
+	double back;
+
+	snprintf(exp, sizeof(exp), "%.*g", prec, v);
+	end = ldmsd_fmt_real(buf, v, prec);
+	*end = '\0';
+	if (0 == strcmp(exp, buf))
+		return;
+	if (isnan(v)) {
+		/* the sign of NaN is not printed */
+		if (0 == strcmp(buf, "nan"))
+			return;
+	} else if (last_digit_off(buf, exp, prec)) {
+		back = strtod(buf, NULL);
+		if (prec == 9 && v == (float)v && (float)back == (float)v) {
+			ties++;
+			return;
+		}
+		if (prec == 17 && back == v && signbit(back) == signbit(v)) {
+			ties++;
+			return;
+		}
+	}
+	if (errors++ < 20)
+		printf("ldmsd_fmt_real(%a, %d): expected '%s', got '%s'\n",
+		       v, prec, exp, buf);
+}
+
+static void check_reals(double v)
+{
+	check_real(v, 6);
+	check_real(v, 17);
+	check_real((float)v, 9);
+}
+
+static void test_int()
+{
+	uint64_t p;
+	int i, n;
+
+	errors = 0;
+	check_u64(0);
+	check_u64(UINT64_MAX);
+	check_s64(0);
+	check_s64(INT64_MIN);
+	check_s64(INT64_MAX);
+	check_s64(-1);
+	for (p = 1, i = 0; i < 20; i++, p *= 10) {
+		check_u64(p - 1);
+		check_u64(p);
+		check_u64(p + 1);
+		check_s64(-(int64_t)(p - 1));
+		if (p <= INT64_MAX) {
+			check_s64(p);
+			check_s64(-(int64_t)p);
+		}
+	}
+	for (i = 0; i < RANDOM_COUNT; i++) {
+		p = rnd() >> (rnd() % 64);
+		check_u64(p);
+		check_s64(p);
+		check_s64(-p);
+	}
+	printf("ldmsd_fmt_u64() and ldmsd_fmt_s64() match snprintf() : ");
+	verify(errors == 0);
+
+	errors = 0;
+	for (n = 1; n <= 20; n++) {
+		check_pad(0, n);
+		check_pad(UINT64_MAX, n);
+		for (p = 1, i = 0; i < 20; i++, p *= 10) {
+			check_pad(p - 1, n);
+			check_pad(p, n);
+		}
+		for (i = 0; i < RANDOM_COUNT / 20; i++)
+			check_pad(rnd() >> (rnd() % 64), n);
+	}
+	printf("ldmsd_fmt_u64_pad() matches snprintf() : ");
+	verify(errors == 0);
+}
+
+static void test_real()
+{
+	static const char *near[] = {
+		"1e%d", "9.9999999999999999e%d", "9.99999999999999995e%d",
+		"9.9999999500000001e%d", "9.9999995e%d", "9.999995e%d",
+		"1.0000005e%d", "5e%d", "1.5e%d", "2.5e%d", "1.2345678901234567e%d",
+	};
+	static const double special[] = {
+		0.0, -0.0, 1.0, -1.0, 0.1, 0.5, 1.0 / 3, 2.0 / 3, 123456.0,
+		1e15 - 1, 1e15, 1e15 + 1, 1e16, 1e17, 9007199254740992.0,
+		9007199254740994.0, 18446744073709551616.0, 4294967296.0,
+		DBL_MIN, DBL_MIN / 3, -DBL_MIN / 3, DBL_MAX, -DBL_MAX,
+		DBL_EPSILON, FLT_MIN, FLT_MIN / 3, FLT_MAX, FLT_EPSILON,
+		INFINITY, -INFINITY, NAN, -NAN,
+	};
+	char s[64];
+	double v;
+	uint64_t u;
+	int i, k;
+
+	errors = ties = 0;
+	for (i = 0; i < sizeof(special) / sizeof(special[0]); i++)
+		check_reals(special[i]);
+	/* the smallest denormals */
+	for (v = nextafter(0, 1), i = 0; i < 64; i++, v = nextafter(v, 1)) {
+		check_reals(v);
+		check_reals(-v);
+	}
+	for (k = -324; k <= 308; k++) {
+		for (i = 0; i < sizeof(near) / sizeof(near[0]); i++) {
+			snprintf(s, sizeof(s), near[i], k);
+			v = strtod(s, NULL);
+			if (v == 0 || isinf(v))
+				continue;
+			check_reals(v);
+			check_reals(nextafter(v, 0));
+			check_reals(nextafter(v, INFINITY));
+			check_reals(-v);
+		}
+	}
+	for (i = 0; i < RANDOM_COUNT; i++) {
+		/* random bits, then random integers */
+		u = rnd();
+		memcpy(&v, &u, sizeof(v));
+		if (!isnan(v))
+			check_reals(v);
+		check_reals((double)(rnd() >> (rnd() % 64)));
+	}
+	printf("ldmsd_fmt_real() matches snprintf(\"%%.<prec>g\") "
+	       "(%d off by one in the last digit) : ", ties);
+	verify(errors == 0);
+}
+
+int main(int argc, char **argv)
+{
+	int failed;
+
+	test_int();
+	failed = errors;
+	test_real();
+	failed += errors;
+	return failed != 0;
+}
@@ -46,6 +46,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -60,27 +61,86 @@
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <assert.h>
+#include <sys/queue.h>
 #include "mmalloc.h"
 #include "../coll/rbt.h"
 #include "ovis-test/test.h"
 
 static int mm_is_disable_mm_free = 0;
 
+/*
+ * The tag immediately precedes every pointer returned by mm_alloc(). It
+ * tells mm_free() whether the memory belongs to a size-class slab or was
+ * carved from the first-fit heap. A free slab object is linked through its
+ * tag, so that the smallest objects (one grain, all tag) can be linked too.
+ */
+struct mm_tag {
+	uint32_t cls;		/* size class, or MM_CLS_LARGE */
+	uint32_t magic;
+	union {
+		void *next;	/* free-list link of a free slab object */
+		uint64_t reserved;
+	};
+};
+
+#define MM_CLS_LARGE	((uint32_t)-1)
+#define MM_MAGIC	0x4d4d5447	/* 'MMTG' */
+
 struct mm_prefix {
 	struct rbn addr_node;
 	struct rbn size_node;
 	size_t count;
 	struct mm_prefix *pfx;
+	struct mm_tag tag;
+};
+
+/*
+ * Size classes, in grains: 1, 2, 3, 4, then four classes per power of two
+ * (5, 6, 7, 8, 10, 12, 14, 16, 20, ...) up to MM_SLAB_MAX_GRAINS. Rounding
+ * up to a class wastes less than 25% of an object.
+ */
+#define MM_SLAB_MAX_GRAINS	64
+#define MM_NCLASS		20
+#define MM_SLAB_OBJS		16	/* objects per slab */
+#define MM_TCACHE_BYTES		(128 * 1024)
+#define MM_TCACHE_MAX		16	/* objects per thread cache bin */
+
+/* The default growth limit as a multiple of the initial heap size */
+#define MM_GROW_FACTOR		8
+
+struct mm_class {
+	pthread_mutex_t lock;
+	size_t size;		/* object size in bytes, tag included */
+	int tc_max;		/* thread cache bin capacity */
+	void *free;		/* free objects, linked through the user data */
+	size_t free_count;
+	char *bump;		/* unused part of the newest slab */
+	char *bump_end;
+	size_t slabs;
+};
+
+struct mm_tcache {
+	struct {
+		void *head;
+		int count;
+	} bin[MM_NCLASS];
+	LIST_ENTRY(mm_tcache) entry;
 };
 
 typedef struct mm_region {
 	size_t grain;		/* minimum allocation size and alignment */
 	size_t grain_bits;
-	size_t size;
+	size_t size;		/* current size of the heap */
+	size_t max_size;	/* size of the reserved address range */
+	size_t grows;
+	int no_grow;
+	int fd;			/* memfd backing the heap, or -1 */
 	void *start;
 	pthread_mutex_t lock;
 	struct rbt size_tree;
 	struct rbt addr_tree;
+	struct mm_class cls[MM_NCLASS];
 } *mm_region_t;
 
 static int compare_count(void *node_key, const void *val_key)
@@ -104,12 +164,50 @@ static int compare_addr(void *node_key, const void *val_key)
 
 static mm_region_t mmr;
 
-void mm_get_info(struct mm_info *mmi)
+static __thread struct mm_tcache *mm_tcache;
+static pthread_key_t mm_tcache_key;
+/* All thread caches, for mm_stats() */
+static LIST_HEAD(, mm_tcache) mm_tcache_list;
+static pthread_mutex_t mm_tcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The free-list link of a free slab object */
+#define MM_OBJ_NEXT(obj)	(((struct mm_tag *)(obj))->next)
+
+/* Must be called with mmr->lock held */
+static void __mm_info(struct mm_info *mmi)
 {
 	mmi->grain = mmr->grain;
 	mmi->grain_bits = mmr->grain_bits;
 	mmi->size = mmr->size;
 	mmi->start = mmr->start;
+	mmi->max_size = mmr->no_grow ? mmr->size : mmr->max_size;
+	mmi->fd = mmr->fd;
+}
+
+void mm_get_info(struct mm_info *mmi)
+{
+	if (!mmr) {
+		/* mm_init() has not been called */
+		memset(mmi, 0, sizeof(*mmi));
+		mmi->fd = -1;
+		return;
+	}
+	pthread_mutex_lock(&mmr->lock);
+	mmr->no_grow = 1;
+	__mm_info(mmi);
+	pthread_mutex_unlock(&mmr->lock);
+}
+
+void mm_peek_info(struct mm_info *mmi)
+{
+	if (!mmr) {
+		memset(mmi, 0, sizeof(*mmi));
+		mmi->fd = -1;
+		return;
+	}
+	pthread_mutex_lock(&mmr->lock);
+	__mm_info(mmi);
+	pthread_mutex_unlock(&mmr->lock);
 }
 
 static void get_pow2(size_t n, size_t *pow2, size_t *bits)
@@ -121,66 +219,139 @@ static void get_pow2(size_t n, size_t *pow2, size_t *bits)
 	*bits = _bits;
 }
 
-int mm_init(size_t size, size_t grain)
+/* The size class of an allocation of `count` grains */
+static inline int mm_class_of(size_t count)
 {
-	mmr = calloc(1, sizeof (*mmr));
-	if (!mmr)
-		return ENOMEM;
-	pthread_mutex_init(&mmr->lock, NULL);
-	size = MMR_ROUNDUP(size, 4096);
-	mmr->start = mmap(NULL, size, PROT_READ | PROT_WRITE,
-			  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-	if (MAP_FAILED == mmr->start)
-		goto out;
+	int b;
+	if (count <= 4)
+		return count - 1;
+	b = 63 - __builtin_clzl(count - 1);
+	return 4 * (b - 2) + ((count - 1) >> (b - 2));
+}
 
-#ifdef DEBUG
-	memset(mmr->start, 0XAA, size);
-#endif
+/* The number of grains of the size class `cls` */
+static size_t mm_class_grains(int cls)
+{
+	int b;
+	if (cls < 4)
+		return cls + 1;
+	b = (cls - 4) / 4 + 2;
+	return (size_t)(5 + (cls - 4) % 4) << (b - 2);
+}
 
-	get_pow2(grain, &mmr->grain, &mmr->grain_bits);
-	mmr->size = size;
+/* Put the free chunk `p` in the trees, coalescing it with its siblings */
+static void __mm_chunk_insert(struct mm_prefix *p)
+{
+	struct mm_prefix *q, *r;
+	struct rbn *rbn;
 
-	/* Inialize the size and address r-b trees */
-	rbt_init(&mmr->size_tree, compare_count);
-	rbt_init(&mmr->addr_tree, compare_addr);
+	/* See if we can coalesce with our lesser sibling */
+	rbn = rbt_find_glb(&mmr->addr_tree, &p->pfx);
+	if (rbn) {
+		q = container_of(rbn, struct mm_prefix, addr_node);
 
-	/* Initialize the prefix */
-	struct mm_prefix *pfx = mmr->start;
-	pfx->count = size / mmr->grain;
-	pfx->pfx = pfx;
-	rbn_init(&pfx->size_node, &pfx->count);
-	rbn_init(&pfx->addr_node, &pfx->pfx);
+		/* See if q is contiguous with us */
+		r = (struct mm_prefix *)
+			((unsigned char *)q + (q->count << mmr->grain_bits));
+		if (r == p) {
+			/* Remove the sibling from the tree and coelesce */
+			rbt_del(&mmr->size_tree, &q->size_node);
+			rbt_del(&mmr->addr_tree, &q->addr_node);
 
-	/* Insert the chunk into the r-b trees */
-	rbt_ins(&mmr->size_tree, &pfx->size_node);
-	rbt_ins(&mmr->addr_tree, &pfx->addr_node);
+			q->count += p->count;
+			p = q;
+		}
+	}
 
-	const char *tmp = getenv("MMALLOC_DISABLE_MM_FREE");
-	if (tmp)
-		mm_is_disable_mm_free = atoi(tmp);
+	/* See if we can coalesce with our greater sibling */
+	rbn = rbt_find_lub(&mmr->addr_tree, &p->pfx);
+	if (rbn) {
+		q = container_of(rbn, struct mm_prefix, addr_node);
+
+		/* See if q is contiguous with us */
+		r = (struct mm_prefix *)
+			((unsigned char *)p + (p->count << mmr->grain_bits));
+		if (r == q) {
+			/* Remove the sibling from the tree and coelesce */
+			rbt_del(&mmr->size_tree, &q->size_node);
+			rbt_del(&mmr->addr_tree, &q->addr_node);
+
+			p->count += q->count;
+		}
+	}
+	/* Fix-up our nodes' key in case we coelesced */
+	p->pfx = p;
+	rbn_init(&p->size_node, &p->count);
+	rbn_init(&p->addr_node, &p->pfx);
 
+#ifdef DEBUG
+	memset(p+1, 0xFF, (p->count << mmr->grain_bits) - sizeof(*p));
+#endif
+
+	/* Put 'p' back in the trees */
+	rbt_ins(&mmr->size_tree, &p->size_node);
+	rbt_ins(&mmr->addr_tree, &p->addr_node);
+}
+
+/*
+ * Extend the heap by at least `count` grains. The heap doubles in size each
+ * time, within the address range reserved by mm_init().
+ *
+ * Must be called with mmr->lock held.
+ */
+static int __mm_grow(size_t count)
+{
+	struct mm_prefix *p;
+	size_t sz, min_sz;
+	void *addr;
+
+	if (mmr->no_grow)
+		return ENOMEM;
+	min_sz = count << mmr->grain_bits;
+	min_sz = MMR_ROUNDUP(min_sz, 4096);
+	sz = mmr->size;
+	if (sz < min_sz)
+		sz = min_sz;
+	if (sz > mmr->max_size - mmr->size)
+		sz = mmr->max_size - mmr->size;
+	if (sz < min_sz)
+		return ENOMEM;
+	addr = (char *)mmr->start + mmr->size;
+	if (mmr->fd >= 0 && ftruncate(mmr->fd, mmr->size + sz))
+		return errno;
+	if (mprotect(addr, sz, PROT_READ | PROT_WRITE))
+		return errno;
+#ifdef DEBUG
+	memset(addr, 0XAA, sz);
+#endif
+	mmr->size += sz;
+	mmr->grows++;
+	p = addr;
+	p->count = sz >> mmr->grain_bits;
+	p->pfx = p;
+	__mm_chunk_insert(p);
 	return 0;
- out:
-	free(mmr);
-	return errno;
 }
 
-void *mm_alloc(size_t size)
+/* Allocate `count` grains from the first-fit heap */
+static struct mm_prefix *__mm_chunk_alloc(size_t count)
 {
 	struct mm_prefix *p, *n;
 	struct rbn *rbn;
-	uint64_t count;
 	uint64_t remainder;
 
-	size += sizeof(*p);
-	size = MMR_ROUNDUP(size, mmr->grain);
-	count = size >> mmr->grain_bits;
-
 	pthread_mutex_lock(&mmr->lock);
 	rbn = rbt_find_lub(&mmr->size_tree, &count);
 	if (!rbn) {
-		pthread_mutex_unlock(&mmr->lock);
-		return NULL;
+		if (__mm_grow(count)) {
+			pthread_mutex_unlock(&mmr->lock);
+			return NULL;
+		}
+		rbn = rbt_find_lub(&mmr->size_tree, &count);
+		if (!rbn) {
+			pthread_mutex_unlock(&mmr->lock);
+			return NULL;
+		}
 	}
 
 	p = container_of(rbn, struct mm_prefix, size_node);
@@ -204,84 +375,358 @@ void *mm_alloc(size_t size)
 	}
 	p->count = count;
 	p->pfx = p;
+	p->tag.cls = MM_CLS_LARGE;
+	p->tag.magic = MM_MAGIC;
 	pthread_mutex_unlock(&mmr->lock);
-	return ++p;
+	return p;
 }
 
-void mm_free(void *d)
+/*
+ * Take up to `n` objects from the size class `c` into the list `*head`.
+ * Returns the number of objects taken.
+ *
+ * Must be called with c->lock held.
+ */
+static int __mm_class_take(struct mm_class *c, int cls, void **head, int n)
 {
-	if (mm_is_disable_mm_free)
-		return;
-	if (!d)
-		return;
+	struct mm_prefix *slab;
+	struct mm_tag *obj;
+	size_t slab_grains;
+	int i;
 
-	struct mm_prefix *p = d;
-	struct mm_prefix *q, *r;
-	struct rbn *rbn;
+	for (i = 0; i < n; i++) {
+		if (c->free) {
+			obj = c->free;
+			c->free = MM_OBJ_NEXT(obj);
+			c->free_count--;
+		} else {
+			if (c->bump + c->size > c->bump_end) {
+				/* The slab is a chunk of the first-fit heap */
+				slab_grains = (sizeof(*slab) +
+					       MM_SLAB_OBJS * c->size +
+					       mmr->grain - 1) >> mmr->grain_bits;
+				slab = __mm_chunk_alloc(slab_grains);
+				if (!slab)
+					break;
+				c->bump = (char *)(slab + 1);
+				c->bump_end = (char *)slab +
+					(slab_grains << mmr->grain_bits);
+				c->slabs++;
+			}
+			obj = (struct mm_tag *)c->bump;
+			c->bump += c->size;
+			obj->cls = cls;
+			obj->magic = MM_MAGIC;
+		}
+		MM_OBJ_NEXT(obj) = *head;
+		*head = obj;
+	}
+	return i;
+}
 
-	p --;
+/* Return the list of `n` objects `head` to the size class `c` */
+static void __mm_class_give(struct mm_class *c, void *head, int n)
+{
+	void *obj;
+	while (head) {
+		obj = head;
+		head = MM_OBJ_NEXT(obj);
+		MM_OBJ_NEXT(obj) = c->free;
+		c->free = obj;
+	}
+	c->free_count += n;
+}
 
-	pthread_mutex_lock(&mmr->lock);
-	/* See if we can coalesce with our lesser sibling */
-	rbn = rbt_find_glb(&mmr->addr_tree, &p->pfx);
-	if (rbn) {
-		q = container_of(rbn, struct mm_prefix, addr_node);
+/* Thread exit: give the cached objects back to their size classes */
+static void mm_tcache_flush(void *arg)
+{
+	struct mm_tcache *tc = arg;
+	struct mm_class *c;
+	int i;
 
-		/* See if q is contiguous with us */
-		r = (struct mm_prefix *)
-			((unsigned char *)q + (q->count << mmr->grain_bits));
-		if (r == p) {
-			/* Remove the sibling from the tree and coelesce */
-			rbt_del(&mmr->size_tree, &q->size_node);
-			rbt_del(&mmr->addr_tree, &q->addr_node);
+	for (i = 0; i < MM_NCLASS; i++) {
+		if (!tc->bin[i].count)
+			continue;
+		c = &mmr->cls[i];
+		pthread_mutex_lock(&c->lock);
+		__mm_class_give(c, tc->bin[i].head, tc->bin[i].count);
+		pthread_mutex_unlock(&c->lock);
+	}
+	pthread_mutex_lock(&mm_tcache_lock);
+	LIST_REMOVE(tc, entry);
+	pthread_mutex_unlock(&mm_tcache_lock);
+	if (tc == mm_tcache)
+		mm_tcache = NULL;
+	free(tc);
+}
 
-			q->count += p->count;
-			p = q;
-		}
+static struct mm_tcache *mm_tcache_get(void)
+{
+	if (__builtin_expect(mm_tcache != NULL, 1))
+		return mm_tcache;
+	mm_tcache = calloc(1, sizeof(*mm_tcache));
+	if (!mm_tcache)
+		return NULL;
+	if (pthread_setspecific(mm_tcache_key, mm_tcache)) {
+		free(mm_tcache);
+		mm_tcache = NULL;
+		return NULL;
 	}
+	pthread_mutex_lock(&mm_tcache_lock);
+	LIST_INSERT_HEAD(&mm_tcache_list, mm_tcache, entry);
+	pthread_mutex_unlock(&mm_tcache_lock);
+	return mm_tcache;
+}
 
-	/* See if we can coalesce with our greater sibling */
-	rbn = rbt_find_lub(&mmr->addr_tree, &p->pfx);
-	if (rbn) {
-		q = container_of(rbn, struct mm_prefix, addr_node);
+static void *mm_slab_alloc(int cls)
+{
+	struct mm_class *c = &mmr->cls[cls];
+	struct mm_tcache *tc = mm_tcache_get();
+	struct mm_tag *obj = NULL;
+	int n;
+
+	if (tc && tc->bin[cls].head) {
+		obj = tc->bin[cls].head;
+		tc->bin[cls].head = MM_OBJ_NEXT(obj);
+		tc->bin[cls].count--;
+		return obj + 1;
+	}
 
-		/* See if q is contiguous with us */
-		r = (struct mm_prefix *)
-			((unsigned char *)p + (p->count << mmr->grain_bits));
-		if (r == q) {
-			/* Remove the sibling from the tree and coelesce */
-			rbt_del(&mmr->size_tree, &q->size_node);
-			rbt_del(&mmr->addr_tree, &q->addr_node);
+	pthread_mutex_lock(&c->lock);
+	if (!tc) {
+		/* No thread cache, take from the class directly */
+		n = __mm_class_take(c, cls, (void **)&obj, 1);
+		pthread_mutex_unlock(&c->lock);
+		return n ? obj + 1 : NULL;
+	}
+	/* Refill half of the bin and keep one object for this call */
+	n = __mm_class_take(c, cls, &tc->bin[cls].head, (c->tc_max + 1) / 2);
+	pthread_mutex_unlock(&c->lock);
+	if (!n)
+		return NULL;
+	obj = tc->bin[cls].head;
+	tc->bin[cls].head = MM_OBJ_NEXT(obj);
+	tc->bin[cls].count = n - 1;
+	return obj + 1;
+}
 
-			p->count += q->count;
+static void mm_slab_free(struct mm_tag *obj)
+{
+	struct mm_class *c = &mmr->cls[obj->cls];
+	struct mm_tcache *tc = mm_tcache_get();
+	void *head, *p;
+	int i, n;
+
+#ifdef DEBUG
+	memset(obj + 1, 0xFF, c->size - sizeof(*obj));
+#endif
+	if (!tc) {
+		MM_OBJ_NEXT(obj) = NULL;
+		pthread_mutex_lock(&c->lock);
+		__mm_class_give(c, obj, 1);
+		pthread_mutex_unlock(&c->lock);
+		return;
+	}
+	MM_OBJ_NEXT(obj) = tc->bin[obj->cls].head;
+	tc->bin[obj->cls].head = obj;
+	if (++tc->bin[obj->cls].count <= c->tc_max)
+		return;
+
+	/* The bin is full, give half of it back to the class */
+	n = tc->bin[obj->cls].count / 2;
+	head = tc->bin[obj->cls].head;
+	for (p = head, i = 1; i < n; i++)
+		p = MM_OBJ_NEXT(p);
+	tc->bin[obj->cls].head = MM_OBJ_NEXT(p);
+	tc->bin[obj->cls].count -= n;
+	MM_OBJ_NEXT(p) = NULL;
+	pthread_mutex_lock(&c->lock);
+	__mm_class_give(c, head, n);
+	pthread_mutex_unlock(&c->lock);
+}
+
+static void *__mm_reserve(size_t sz)
+{
+	if (mmr->fd >= 0)
+		return mmap(NULL, sz, PROT_NONE, MAP_SHARED | MAP_NORESERVE,
+			    mmr->fd, 0);
+	return mmap(NULL, sz, PROT_NONE,
+		    MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+}
+
+int mm_init(size_t size, size_t grain)
+{
+	size_t max_size;
+	const char *tmp;
+	int i, rc;
+
+	mmr = calloc(1, sizeof (*mmr));
+	if (!mmr)
+		return ENOMEM;
+	pthread_mutex_init(&mmr->lock, NULL);
+	size = MMR_ROUNDUP(size, 4096);
+	max_size = size * MM_GROW_FACTOR;
+	tmp = getenv("MMALLOC_MAX_SIZE");
+	if (tmp)
+		max_size = strtoull(tmp, NULL, 0);
+	if (max_size < size)
+		max_size = size;
+	max_size = MMR_ROUNDUP(max_size, 4096);
+
+	/*
+	 * Back the heap with a memfd so that a same-host transport can hand
+	 * it to its peer (see zap_shm) if MMALLOC_SHARED is set.
+	 */
+	mmr->fd = -1;
+	tmp = getenv("MMALLOC_SHARED");
+	if (tmp && atoi(tmp)) {
+		mmr->fd = memfd_create("mmalloc", MFD_CLOEXEC);
+		if (mmr->fd >= 0 && ftruncate(mmr->fd, size)) {
+			close(mmr->fd);
+			mmr->fd = -1;
 		}
 	}
-	/* Fix-up our nodes' key in case we coelesced */
-	p->pfx = p;
-	rbn_init(&p->size_node, &p->count);
-	rbn_init(&p->addr_node, &p->pfx);
+
+	/*
+	 * Reserve the address range the heap may grow into so that it stays
+	 * contiguous. Only the first `size` bytes are accessible for now.
+	 */
+	mmr->start = __mm_reserve(max_size);
+	if (MAP_FAILED == mmr->start) {
+		/* Not enough address space, do without growing */
+		max_size = size;
+		mmr->start = __mm_reserve(size);
+		if (MAP_FAILED == mmr->start)
+			goto out;
+	}
+	if (mprotect(mmr->start, size, PROT_READ | PROT_WRITE))
+		goto out1;
 
 #ifdef DEBUG
-	memset(p+1, 0xFF, (p->count << mmr->grain_bits) - sizeof(*p));
+	memset(mmr->start, 0XAA, size);
 #endif
 
-	/* Put 'p' back in the trees */
-	rbt_ins(&mmr->size_tree, &p->size_node);
-	rbt_ins(&mmr->addr_tree, &p->addr_node);
+	get_pow2(grain, &mmr->grain, &mmr->grain_bits);
+	mmr->size = size;
+	mmr->max_size = max_size;
+
+	/* Inialize the size and address r-b trees */
+	rbt_init(&mmr->size_tree, compare_count);
+	rbt_init(&mmr->addr_tree, compare_addr);
+
+	/* Initialize the prefix */
+	struct mm_prefix *pfx = mmr->start;
+	pfx->count = size / mmr->grain;
+	pfx->pfx = pfx;
+	rbn_init(&pfx->size_node, &pfx->count);
+	rbn_init(&pfx->addr_node, &pfx->pfx);
+
+	/* Insert the chunk into the r-b trees */
+	rbt_ins(&mmr->size_tree, &pfx->size_node);
+	rbt_ins(&mmr->addr_tree, &pfx->addr_node);
+
+	/* Initialize the size classes */
+	for (i = 0; i < MM_NCLASS; i++) {
+		pthread_mutex_init(&mmr->cls[i].lock, NULL);
+		mmr->cls[i].size = mm_class_grains(i) << mmr->grain_bits;
+		mmr->cls[i].tc_max = MM_TCACHE_BYTES / mmr->cls[i].size;
+		if (mmr->cls[i].tc_max > MM_TCACHE_MAX)
+			mmr->cls[i].tc_max = MM_TCACHE_MAX;
+		if (mmr->cls[i].tc_max < 1)
+			mmr->cls[i].tc_max = 1;
+	}
+	rc = pthread_key_create(&mm_tcache_key, mm_tcache_flush);
+	if (rc) {
+		errno = rc;
+		goto out1;
+	}
+
+	tmp = getenv("MMALLOC_DISABLE_MM_FREE");
+	if (tmp)
+		mm_is_disable_mm_free = atoi(tmp);
+
+	return 0;
+ out1:
+	rc = errno;
+	munmap(mmr->start, max_size);
+	errno = rc;
+ out:
+	rc = errno;
+	if (mmr->fd >= 0)
+		close(mmr->fd);
+	errno = rc;
+	free(mmr);
+	mmr = NULL;
+	return errno;
+}
+
+void *mm_alloc(size_t size)
+{
+	struct mm_prefix *p;
+	uint64_t count;
+
+	count = MMR_ROUNDUP(size + sizeof(struct mm_tag), mmr->grain)
+						>> mmr->grain_bits;
+	if (count <= MM_SLAB_MAX_GRAINS)
+		return mm_slab_alloc(mm_class_of(count));
+
+	size += sizeof(*p);
+	size = MMR_ROUNDUP(size, mmr->grain);
+	count = size >> mmr->grain_bits;
+
+	p = __mm_chunk_alloc(count);
+	if (!p)
+		return NULL;
+	return ++p;
+}
+
+void mm_free(void *d)
+{
+	if (mm_is_disable_mm_free)
+		return;
+	if (!d)
+		return;
+
+	struct mm_tag *tag = (struct mm_tag *)d - 1;
+	struct mm_prefix *p;
+
+	assert(tag->magic == MM_MAGIC);
+	if (tag->cls != MM_CLS_LARGE) {
+		mm_slab_free(tag);
+		return;
+	}
+
+	p = container_of(tag, struct mm_prefix, tag);
+	pthread_mutex_lock(&mmr->lock);
+	__mm_chunk_insert(p);
 	pthread_mutex_unlock(&mmr->lock);
 }
 
 void *mm_realloc(void *ptr, size_t newsize)
 {
-	struct mm_prefix *p = ptr;
-	struct mm_prefix *q, *r;
+	struct mm_tag *tag;
+	struct mm_prefix *p, *q, *r;
 	struct rbn *rbn;
-	void *newbuf = NULL;
-	size_t newcount, remainder;
+	void *newbuf;
+	size_t oldsize, newcount, remainder;
+
+	if (!ptr)
+		return mm_alloc(newsize);
+
+	tag = (struct mm_tag *)ptr - 1;
+	if (tag->cls != MM_CLS_LARGE) {
+		oldsize = mmr->cls[tag->cls].size - sizeof(*tag);
+		if (newsize <= oldsize)
+			return ptr;
+		goto move;
+	}
 
-	newsize = MMR_ROUNDUP(newsize, mmr->grain);
-	newcount = newsize >> mmr->grain_bits;
-	p --;
+	p = container_of(tag, struct mm_prefix, tag);
+	oldsize = (p->count << mmr->grain_bits) - sizeof(*p);
+	if (newsize <= oldsize)
+		return ptr;
+	newcount = MMR_ROUNDUP(newsize + sizeof(*p), mmr->grain)
+						>> mmr->grain_bits;
 
 	pthread_mutex_lock(&mmr->lock);
 	/* See if we can coalesce with our greater sibling */
@@ -292,42 +737,39 @@ void *mm_realloc(void *ptr, size_t newsize)
 		/* See if q is contiguous with us */
 		r = (struct mm_prefix *)
 			((unsigned char *)p + (p->count << mmr->grain_bits));
-		if (r == q) {
-			if (p->count + q->count >= newcount) {
-				/* Remove the sibling from the tree and coelesce */
-				rbt_del(&mmr->size_tree, &q->size_node);
-				rbt_del(&mmr->addr_tree, &q->addr_node);
-
-				remainder = p->count + q->count - newcount;
-				if (remainder) {
-					/* Put the remainder back into the tree */
-					r = (struct mm_prefix *)
-						((unsigned char *)p + (newcount << mmr->grain_bits));
-					r->count = remainder;
-					r->pfx = r;
-					rbn_init(&r->size_node, &r->count);
-					rbn_init(&r->addr_node, &r->pfx);
-
-					rbt_ins(&mmr->size_tree, &r->size_node);
-					rbt_ins(&mmr->addr_tree, &r->addr_node);
-				}
-				p->count = newcount;
-				goto out;
+		if (r == q && p->count + q->count >= newcount) {
+			/* Remove the sibling from the tree and coelesce */
+			rbt_del(&mmr->size_tree, &q->size_node);
+			rbt_del(&mmr->addr_tree, &q->addr_node);
+
+			remainder = p->count + q->count - newcount;
+			if (remainder) {
+				/* Put the remainder back into the tree */
+				r = (struct mm_prefix *)
+					((unsigned char *)p + (newcount << mmr->grain_bits));
+				r->count = remainder;
+				r->pfx = r;
+				rbn_init(&r->size_node, &r->count);
+				rbn_init(&r->addr_node, &r->pfx);
+
+				rbt_ins(&mmr->size_tree, &r->size_node);
+				rbt_ins(&mmr->addr_tree, &r->addr_node);
 			}
+			p->count = newcount;
+			pthread_mutex_unlock(&mmr->lock);
+			return ptr;
 		}
 	}
+	pthread_mutex_unlock(&mmr->lock);
 
+ move:
 	/* Allocate a new buffer and copy ptr data to it */
 	newbuf = mm_alloc(newsize);
-	memcpy(newbuf, ptr, (p->count << mmr->grain_bits));
-	p = newbuf;
-	p--;
-
- out:
-	pthread_mutex_unlock(&mmr->lock);
-	if (newbuf)
-		mm_free(ptr);
-	return ++p;
+	if (!newbuf)
+		return NULL;
+	memcpy(newbuf, ptr, oldsize);
+	mm_free(ptr);
+	return newbuf;
 }
 
 static int heap_stat(struct rbn *rbn, void *fn_data, int level)
@@ -346,6 +788,11 @@ static int heap_stat(struct rbn *rbn, void *fn_data, int level)
 
 void mm_stats(struct mm_stat *s)
 {
+	struct mm_class *c;
+	struct mm_tcache *tc;
+	size_t slab_sz;
+	int i;
+
 	if (!s)
 		return;
 	memset(s,0,sizeof(*s));
@@ -354,9 +801,34 @@ void mm_stats(struct mm_stat *s)
 	pthread_mutex_lock(&mmr->lock);
 	s->size = mmr->size;
 	s->grain = mmr->grain;
+	s->grows = mmr->grows;
+	s->max_size = mmr->no_grow ? mmr->size : mmr->max_size;
 	s->smallest = s->size + 1;
 	rbt_traverse(&mmr->addr_tree, heap_stat, s);
 	pthread_mutex_unlock(&mmr->lock);
+
+	for (i = 0; i < MM_NCLASS; i++) {
+		c = &mmr->cls[i];
+		pthread_mutex_lock(&c->lock);
+		slab_sz = MMR_ROUNDUP(sizeof(struct mm_prefix) +
+				      MM_SLAB_OBJS * c->size, mmr->grain);
+		s->slabs += c->slabs;
+		s->slab_bytes += c->slabs * slab_sz;
+		s->slab_free += c->free_count * c->size +
+				(c->bump_end - c->bump);
+		pthread_mutex_unlock(&c->lock);
+	}
+
+	/* The bins are read without their owners' cooperation; this is
+	 * only an estimate. */
+	pthread_mutex_lock(&mm_tcache_lock);
+	LIST_FOREACH(tc, &mm_tcache_list, entry) {
+		for (i = 0; i < MM_NCLASS; i++)
+			s->slab_cached += __atomic_load_n(&tc->bin[i].count,
+						__ATOMIC_RELAXED) * mmr->cls[i].size;
+	}
+	pthread_mutex_unlock(&mm_tcache_lock);
+	s->slab_free += s->slab_cached;
 }
 
 #ifdef MMR_TEST
@@ -375,9 +847,10 @@ void print_mm_stats(struct mm_stat *s) {
 		printf("mm_stat: null\n");
 		return;
 	}
-	printf("mm_stat: size=%zu grain=%zu chunks_free=%zu grains_free=%zu grains_largest=%zu grains_smallest=%zu bytes_free=%zu bytes_largest=%zu bytes_smallest=%zu\n",
+	printf("mm_stat: size=%zu grain=%zu chunks_free=%zu grains_free=%zu grains_largest=%zu grains_smallest=%zu bytes_free=%zu bytes_largest=%zu bytes_smallest=%zu grows=%zu slabs=%zu slab_bytes=%zu slab_free=%zu slab_cached=%zu\n",
 	s->size, s->grain, s->chunks, s->bytes, s->largest, s->smallest,
-	s->grain*s->bytes, s->grain*s->largest, s->grain*s->smallest);
+	s->grain*s->bytes, s->grain*s->largest, s->grain*s->smallest,
+	s->grows, s->slabs, s->slab_bytes, s->slab_free, s->slab_cached);
 }
 
 int main(int argc, char *argv[])
@@ -405,10 +878,11 @@ int main(int argc, char *argv[])
 	print_mm_stats(&s);
 
 	/*
-	 * Allocate six blocks without intervening frees.
+	 * Allocate six blocks without intervening frees. They are too big
+	 * for the size classes, so they come from the heap.
 	 */
 	for (i = 0; i < 6; i++)
-		b[i] = mm_alloc(2048);
+		b[i] = mm_alloc(8192);
 	TEST_ASSERT(((b[0] < b[1])
 		     && (b[1] < b[2])
 		     && (b[2] < b[3])
@@ -501,6 +975,32 @@ int main(int argc, char *argv[])
 		    "remaining block.\n");
 	mm_stats(&s);
 	print_mm_stats(&s);
+
+	/*
+	 * Small allocations are served by a slab. A freed object is
+	 * reused by the next allocation of the same class.
+	 */
+	b[0] = mm_alloc(100);
+	b[1] = mm_alloc(100);
+	mm_stats(&s);
+	print_mm_stats(&s);
+	TEST_ASSERT((s.slabs == 1), "There is one slab after two small "
+		    "allocations of the same class.\n");
+	mm_free(b[0]);
+	b[2] = mm_alloc(90);
+	TEST_ASSERT((b[2] == b[0]),
+		    "A small allocation reuses the freed object.\n");
+
+	/*
+	 * Allocating more than the initial heap size extends it.
+	 */
+	b[3] = mm_alloc(32 * 1024 * 1024);
+	mm_stats(&s);
+	print_mm_stats(&s);
+	TEST_ASSERT((b[3] != NULL && s.grows == 1),
+		    "The heap grows when it is exhausted.\n");
+	memset(b[3], 0, 32 * 1024 * 1024);
+	mm_free(b[3]);
 	return 0;
 }
 #endif
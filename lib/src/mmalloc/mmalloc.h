@@ -53,6 +53,8 @@ struct mm_info {
 	size_t grain_bits;	/*! x in 2^x*/
 	size_t size;		/*! The size of the heap in bytes */
 	void *start;		/*! The address of the start of the heap */
+	size_t max_size;	/*! The size the heap may grow to */
+	int fd;			/*! The memfd backing the heap, or -1 */
 };
 
 struct mm_stat {
@@ -62,20 +64,52 @@ struct mm_stat {
 	size_t bytes;		/*< number of unallocated grains current */
 	size_t largest;		/*< largest unallocated chunk size in grains */
 	size_t smallest;	/*< smallest unallocated chunk size in grains */
+	size_t grows;		/*< number of times the heap has been extended */
+	size_t max_size;	/*< size up to which the heap may be extended */
+	size_t slabs;		/*< number of size-class slabs */
+	size_t slab_bytes;	/*< bytes of the heap held by the slabs */
+	size_t slab_free;	/*< slab bytes not allocated to the application */
+	size_t slab_cached;	/*< part of slab_free held by per-thread caches */
 };
 
 /**
  * \brief Get information about the heap configuration
  *
+ * The caller may register [start, start + size) with a device, so the heap
+ * stops growing once this function has been called (see \c mm_init()).
+ *
  * \param mmi	Pointer to the mm_info structure to be filled in.
  */
 void mm_get_info(struct mm_info *mmi);
 
+/**
+ * \brief Get information about the heap without stopping its growth
+ *
+ * Like \c mm_get_info(), but the heap keeps growing in place within
+ * [start, start + max_size), so \c size is only the current size. This is
+ * for users that follow the growth, e.g. by mapping the memfd of a shared
+ * heap.
+ *
+ * \param mmi	Pointer to the mm_info structure to be filled in.
+ */
+void mm_peek_info(struct mm_info *mmi);
+
 /**
  * \brief Initialize the heap.
  *
  * Allocates memory for the heap and configures the minimum block size.
  *
+ * Allocations of up to 64 grains are served from size-class slabs through
+ * per-thread caches. Larger allocations, and the slabs themselves, come
+ * from the first-fit heap. When the heap is exhausted it is extended in
+ * place, up to 8 times \c size or to the size in bytes given by the
+ * \c MMALLOC_MAX_SIZE environment variable. Only the address range is
+ * reserved up front; memory is committed as the heap grows.
+ *
+ * If the \c MMALLOC_SHARED environment variable is set to a non-zero
+ * value, the heap is backed by a memfd that a same-host transport can hand
+ * to its peer (see zap_shm). Otherwise it is private anonymous memory.
+ *
  * \param size	The requested size of the heap in bytes.
  * \param grain	The minimum allocation size.
  * \returns 	Zero on success, or an errno indicating the reason for
@@ -119,6 +153,11 @@ void mm_free(void *ptr);
 
 /**
  * \brief Collect stats about the heap.
+ *
+ * \c chunks, \c bytes, \c largest and \c smallest describe the free space
+ * of the first-fit heap. The \c slab_* fields describe the space held by
+ * the size classes.
+ *
  * \param s buffer to fill with info about mm.
  */
 void mm_stats(struct mm_stat *s);
@@ -90,6 +90,8 @@ ev_t ev_new(ev_type_t evt)
 	e->e_refcount = 1;
 	e->e_type = evt;
 	e->e_posted = 0;
+	e->e_status = EV_OK;
+	e->e_slot = NULL;
 
 	return (ev_t)&e->e_ev;
 }
@@ -125,7 +127,6 @@ int ev_canceled(ev_t ev)
 int ev_post(ev_worker_t src, ev_worker_t dst, ev_t ev, struct timespec *to)
 {
 	ev__t e = EV(ev);
-	int rc;
 
 	/* If multiple threads attempt to post the same event all but
 	 * one will receive EBUSY. If the event is already posted all
@@ -144,65 +145,17 @@ int ev_post(ev_worker_t src, ev_worker_t dst, ev_t ev, struct timespec *to)
 
 	e->e_src = src;
 	e->e_dst = dst;
-	rbn_init(&e->e_to_rbn, &e->e_to);
-
-	pthread_mutex_lock(&dst->w_lock);
-	if (dst->w_state == EV_WORKER_FLUSHING)
-		goto err;
-	ev_get(&e->e_ev);
-	if (to) {
-		rbt_ins(&dst->w_event_tree, &e->e_to_rbn);
-	} else {
-		__sync_fetch_and_add(&dst->w_ev_list_len, 1);
-		TAILQ_INSERT_TAIL(&dst->w_event_list, e, e_entry);
-
-	}
-	rc = (ev_time_cmp(&e->e_to, &dst->w_sem_wait) <= 0);
-	pthread_mutex_unlock(&dst->w_lock);
-	if (rc)
-		sem_post(&dst->w_sem);
-
-	return 0;
- err:
-	e->e_posted = 0;
-	pthread_mutex_unlock(&dst->w_lock);
-	return EBUSY;
+	e->e_slot = NULL;
+	return ev_worker_post(dst, e);
 }
 
 int ev_cancel(ev_t ev)
 {
 	ev__t e = EV(ev);
-	int rc = EINVAL;
-	struct timespec now;
-
-	if (!e->e_posted && ev_canceled(ev))
-		return 0;
-	pthread_mutex_lock(&e->e_dst->w_lock);
-	/*
-	 * Set the status to EV_CANCEL so the actor will see that
-	 * status
-	 */
-	e->e_status = EV_FLUSH;
-
-	/*
-	 * If the event is on the list or is soon to expire, do
-	 * nothing. This avoids racing with the worker.
-	 */
-	rc = 0;
-	(void)clock_gettime(CLOCK_REALTIME, &now);
-	if (ev_time_diff(&e->e_to, &now) < 1.0) {
-		rc = EBUSY;
-		goto out;
-	}
 
-	rbt_del(&e->e_dst->w_event_tree, &e->e_to_rbn);
-	__sync_fetch_and_add(&e->e_dst->w_ev_list_len, 1);
-	TAILQ_INSERT_TAIL(&e->e_dst->w_event_list, e, e_entry);
- out:
-	pthread_mutex_unlock(&e->e_dst->w_lock);
-	if (!rc)
-		sem_post(&e->e_dst->w_sem);
-	return rc;
+	if (!e->e_posted)
+		return ev_canceled(ev) ? 0 : ENOENT;
+	return ev_worker_cancel(e->e_dst, e);
 }
 
 static void __attribute__ ((constructor)) ev_init(void)
@@ -68,6 +68,24 @@ void ev_put(ev_t ev);
  */
 ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn);
 
+/**
+ * \brief Creates a worker served by several threads
+ *
+ * Like ev_worker_new(), but \c thread_count threads deliver the
+ * worker's events concurrently. The actors must be thread-safe, and
+ * the events are not delivered in a particular order.
+ *
+ * \param name The worker name
+ * \param actor_fn A pointer to the worker's actor function
+ * \param thread_count The number of threads
+ * \retval 0 The worker was created
+ * \retval EINVAL \c thread_count is less than 1
+ * \retval ENOMEM Insufficient resources
+ * \retval EEXIST A worker named \c name already exists
+ */
+ev_worker_t ev_worker_new_with_threads(const char *name, ev_actor_t actor_fn,
+				       int thread_count);
+
 /**
  * \brief Return the worker's name
  *
@@ -138,7 +156,11 @@ int ev_listen(ev_worker_t evw, ev_type_t evt);
  *
  * Events posted with a timeout will be delivered when the timeout
  * expires. If two events are posted with the same timeout, the order
- * in which they are delivered is undefined.
+ * in which they are delivered is undefined. The timeout is a
+ * CLOCK_MONOTONIC time, see ev_sched_to(), and has a resolution of
+ * one millisecond.
+ *
+ * Posting does not take a lock.
  *
  * \param src The source worker
  * \param dst The destination worker
@@ -182,8 +204,8 @@ void ev_flush(ev_worker_t w);
 /**
  * \brief Convenience function to schedule a timespec in the future
  *
- * Gets the current time in \c to and then adds \c secs to \c tv_sec,
- * and \c nsecs to \c tv_nsec
+ * Gets the current CLOCK_MONOTONIC time in \c to and then adds \c secs
+ * to \c tv_sec, and \c nsecs to \c tv_nsec
  *
  * Calling ev_sched_to(&to, 0, 0) will return the current time in
  * \c to.
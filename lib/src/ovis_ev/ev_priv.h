@@ -2,7 +2,7 @@
 #define __EV_PRIV_H_
 
 #include <sys/queue.h>
-#include <semaphore.h>
+#include <pthread.h>
 #include <inttypes.h>
 #include <coll/rbt.h>
 #include "ev.h"
@@ -14,6 +14,11 @@ struct ev_type_s {
 	size_t t_size;
 };
 
+/* A node of a worker's MPSC event queue */
+struct ev_qnode {
+	struct ev_qnode *next;
+};
+
 typedef struct ev__s {
 	ev_worker_t e_src;
 	ev_worker_t e_dst;
@@ -21,8 +26,10 @@ typedef struct ev__s {
 	uint32_t e_refcount;
 	int e_posted;
 	ev_status_t e_status;
-	struct timespec e_to;
-	struct rbn e_to_rbn;
+	struct timespec e_to;	/* CLOCK_MONOTONIC, 0 for immediate events */
+	uint64_t e_tick;	/* e_to in timer wheel ticks */
+	struct ev_qnode e_qnode;
+	struct ev_slot_s *e_slot; /* the timer wheel slot, or NULL */
 	TAILQ_ENTRY(ev__s) e_entry;
 	struct ev_s e_ev;
 } *ev__t;
@@ -33,24 +40,66 @@ enum evw_state_e {
 	EV_WORKER_FLUSHING
 };
 
+/*
+ * Hierarchical timer wheel: EV_WHEEL_LEVELS levels of EV_WHEEL_SIZE slots.
+ * A level-0 slot is one tick, a level-n slot is EV_WHEEL_SIZE^n ticks.
+ */
+#define EV_WHEEL_TICK_NS	1000000	/* 1ms */
+#define EV_WHEEL_BITS		8
+#define EV_WHEEL_SIZE		(1 << EV_WHEEL_BITS)
+#define EV_WHEEL_MASK		(EV_WHEEL_SIZE - 1)
+#define EV_WHEEL_LEVELS		4
+
+TAILQ_HEAD(ev_list, ev__s);
+struct ev_slot_s {
+	struct ev_list s_list;
+	int s_level;
+};
+
+struct ev_wheel {
+	uint64_t wh_tick;	/* all the ticks up to wh_tick are expired */
+	int wh_count;
+	int wh_level_count[EV_WHEEL_LEVELS];
+	struct ev_slot_s wh_slot[EV_WHEEL_LEVELS][EV_WHEEL_SIZE];
+};
+
 struct ev_worker_s {
 	char *w_name;
 	ev_actor_t w_actor;
-	pthread_t w_thread;
+	int w_thread_count;
+	pthread_t *w_threads;
 	enum evw_state_e w_state;
-	struct timespec w_sem_wait;
-	sem_t w_sem;
 	struct rbn w_rbn;
-	pthread_mutex_t w_lock;
 	ev_actor_t *w_dispatch;
 	size_t w_dispatch_len;
-	/* An ordered tree of events with timeouts */
-	struct rbt w_event_tree;
-	/* A list of events without timeouts */
-	TAILQ_HEAD(w_event_list, ev__s) w_event_list;
-	int w_ev_list_len;
+
+	/*
+	 * The events posted to the worker, immediate and timed. Posting is
+	 * lock-free (Vyukov's intrusive MPSC queue); the worker threads
+	 * take w_q_lock to dequeue only if there are more than one.
+	 */
+	struct ev_qnode *w_q_head;	/* the last posted */
+	struct ev_qnode *w_q_tail;	/* the next to dequeue */
+	struct ev_qnode w_q_stub;
+	pthread_mutex_t w_q_lock;
+	int w_ev_list_len;		/* events in the queue */
+
+	/* The timed events, protected by w_timer_lock */
+	pthread_mutex_t w_timer_lock;
+	struct ev_wheel w_wheel;
+	int64_t w_next_tick;		/* the next timer tick, or -1 */
+
+	/* Idle worker threads wait on w_cond with CLOCK_MONOTONIC timeouts */
+	pthread_mutex_t w_idle_lock;
+	pthread_cond_t w_cond;
+	int w_idle;
 };
 
+/* Queue a posted event to its destination worker, see ev_post() */
+int ev_worker_post(ev_worker_t w, ev__t e);
+/* See ev_cancel() */
+int ev_worker_cancel(ev_worker_t w, ev__t e);
+
 #define EV(_e_) container_of(_e_, struct ev__s, e_ev);
 #endif
 
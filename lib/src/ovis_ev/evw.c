@@ -23,8 +23,8 @@ double ev_time_diff(struct timespec *tsa, const struct timespec *tsb)
 {
 	double diff;
 	diff = tsa->tv_sec - tsb->tv_sec;
-	diff += (double)tsa->tv_sec / 1e9;
-	diff -= (double)tsb->tv_sec / 1e9;
+	diff += (double)tsa->tv_nsec / 1e9;
+	diff -= (double)tsb->tv_nsec / 1e9;
 	return diff;
 
 }
@@ -43,143 +43,452 @@ int ev_time_cmp(struct timespec *tsa, const struct timespec *tsb)
 
 }
 
+static inline uint64_t ev_ts_tick(const struct timespec *ts, int round_up)
+{
+	uint64_t ns = (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+	if (round_up)
+		ns += EV_WHEEL_TICK_NS - 1;
+	return ns / EV_WHEEL_TICK_NS;
+}
+
+static uint64_t ev_now_tick()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ev_ts_tick(&now, 0);
+}
+
 /*
- * Process all of the events in the worker's event list.
- *
- * Called with the worker lock held.
+ * Vyukov's intrusive MPSC queue. Any thread may push; only one thread at a
+ * time may pop.
  */
-static void process_immediate_events(ev_worker_t w)
+static void ev_q_push(ev_worker_t w, struct ev_qnode *n)
 {
-	ev__t e;
-	ev_actor_t actor;
- next:
-	if (TAILQ_EMPTY(&w->w_event_list))
+	struct ev_qnode *prev;
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&w->w_q_head, n, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+/* Returns NULL if the queue is empty or if a push is not complete yet */
+static struct ev_qnode *ev_q_pop(ev_worker_t w)
+{
+	struct ev_qnode *tail = w->w_q_tail;
+	struct ev_qnode *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &w->w_q_stub) {
+		if (!next)
+			return NULL;
+		w->w_q_tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		w->w_q_tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&w->w_q_head, __ATOMIC_ACQUIRE))
+		return NULL;
+	ev_q_push(w, &w->w_q_stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		w->w_q_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/*
+ * Pop an event and account for it. The count is raised before an event is
+ * pushed and lowered only by a successful pop, so it is never less than
+ * the number of events that can be popped, and never negative.
+ */
+static struct ev_qnode *ev_q_pop_count(ev_worker_t w)
+{
+	struct ev_qnode *n = ev_q_pop(w);
+	if (n)
+		__atomic_sub_fetch(&w->w_ev_list_len, 1, __ATOMIC_SEQ_CST);
+	return n;
+}
+
+static ev__t ev_dequeue(ev_worker_t w)
+{
+	struct ev_qnode *n;
+
+	if (w->w_thread_count > 1) {
+		pthread_mutex_lock(&w->w_q_lock);
+		n = ev_q_pop_count(w);
+		pthread_mutex_unlock(&w->w_q_lock);
+	} else {
+		n = ev_q_pop_count(w);
+	}
+	if (!n)
+		return NULL;
+	return container_of(n, struct ev__s, e_qnode);
+}
+
+static void ev_worker_wake(ev_worker_t w, int all)
+{
+	if (!__atomic_load_n(&w->w_idle, __ATOMIC_SEQ_CST))
 		return;
+	pthread_mutex_lock(&w->w_idle_lock);
+	if (all)
+		pthread_cond_broadcast(&w->w_cond);
+	else
+		pthread_cond_signal(&w->w_cond);
+	pthread_mutex_unlock(&w->w_idle_lock);
+}
 
-	e = TAILQ_FIRST(&w->w_event_list);
-	TAILQ_REMOVE(&w->w_event_list, e, e_entry);
-	__sync_fetch_and_sub(&w->w_ev_list_len, 1);
-	e->e_posted = 0;
+static void ev_enqueue(ev_worker_t w, ev__t e)
+{
+	__atomic_add_fetch(&w->w_ev_list_len, 1, __ATOMIC_SEQ_CST);
+	ev_q_push(w, &e->e_qnode);
+	ev_worker_wake(w, 0);
+}
 
-	if (w->w_state == EV_WORKER_FLUSHING)
-		e->e_status = EV_FLUSH;
+static void ev_wheel_init(struct ev_wheel *wh, uint64_t tick)
+{
+	int l, i;
+	memset(wh, 0, sizeof(*wh));
+	wh->wh_tick = tick;
+	for (l = 0; l < EV_WHEEL_LEVELS; l++) {
+		for (i = 0; i < EV_WHEEL_SIZE; i++) {
+			TAILQ_INIT(&wh->wh_slot[l][i].s_list);
+			wh->wh_slot[l][i].s_level = l;
+		}
+	}
+}
 
-	pthread_mutex_unlock(&w->w_lock);
-	actor = NULL;
-	if (e->e_type->t_id < w->w_dispatch_len)
-		actor = w->w_dispatch[e->e_type->t_id];
-	if (!actor)
-		actor = w->w_actor;
-	actor(e->e_src, e->e_dst, e->e_status, &e->e_ev);
-	ev_put(&e->e_ev);
-	pthread_mutex_lock(&w->w_lock);
-	goto next;
+/* Returns 1 if the event is already due and was not inserted */
+static int ev_wheel_insert(struct ev_wheel *wh, ev__t e)
+{
+	uint64_t exp = e->e_tick;
+	uint64_t delta;
+	struct ev_slot_s *slot;
+	int level;
+
+	if (exp <= wh->wh_tick)
+		return 1;
+	delta = exp - wh->wh_tick;
+	for (level = 0; level < EV_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (EV_WHEEL_BITS * (level + 1))))
+			break;
+	}
+	if (delta >= (1ULL << (EV_WHEEL_BITS * EV_WHEEL_LEVELS)))
+		/* Beyond the wheel, it is cascaded again when its slot comes */
+		exp = wh->wh_tick + (1ULL << (EV_WHEEL_BITS * EV_WHEEL_LEVELS)) - 1;
+	slot = &wh->wh_slot[level][(exp >> (EV_WHEEL_BITS * level)) & EV_WHEEL_MASK];
+	TAILQ_INSERT_TAIL(&slot->s_list, e, e_entry);
+	e->e_slot = slot;
+	wh->wh_count++;
+	wh->wh_level_count[level]++;
+	return 0;
+}
+
+static void ev_wheel_remove(struct ev_wheel *wh, ev__t e)
+{
+	struct ev_slot_s *slot = e->e_slot;
+	TAILQ_REMOVE(&slot->s_list, e, e_entry);
+	e->e_slot = NULL;
+	wh->wh_count--;
+	wh->wh_level_count[slot->s_level]--;
 }
 
 /*
- * Process all of the events in the worker's event tree that have a
- * timeout before or at the current time.
- *
- * Return the 1st event that has a timeout > now
+ * Re-insert the events in the current slot of \c level; they go to a lower
+ * level or, if they are due, to \c expired.
  */
-static ev__t process_to_events(ev_worker_t w)
+static void ev_wheel_cascade(struct ev_wheel *wh, int level,
+			     struct ev_list *expired)
 {
+	struct ev_slot_s *slot;
+	struct ev_list list;
 	ev__t e;
-	struct rbn *rbn;
-	struct timespec now;
-	ev_actor_t actor;
-	clock_gettime(CLOCK_REALTIME, &now);
- next:
-	e = NULL;
-	rbn = rbt_min(&w->w_event_tree);
-	if (!rbn)
-		goto out;
 
-	e = container_of(rbn, struct ev__s, e_to_rbn);
+	slot = &wh->wh_slot[level][(wh->wh_tick >> (EV_WHEEL_BITS * level))
+				   & EV_WHEEL_MASK];
+	if (TAILQ_EMPTY(&slot->s_list))
+		return;
+	TAILQ_INIT(&list);
+	while ((e = TAILQ_FIRST(&slot->s_list))) {
+		ev_wheel_remove(wh, e);
+		TAILQ_INSERT_TAIL(&list, e, e_entry);
+	}
+	while ((e = TAILQ_FIRST(&list))) {
+		TAILQ_REMOVE(&list, e, e_entry);
+		if (ev_wheel_insert(wh, e))
+			TAILQ_INSERT_TAIL(expired, e, e_entry);
+	}
+}
+
+/* Advance the wheel to \c tick and collect the expired events */
+static void ev_wheel_advance(struct ev_wheel *wh, uint64_t tick,
+			     struct ev_list *expired)
+{
+	int level;
+
+	while (wh->wh_tick < tick) {
+		if (!wh->wh_count) {
+			wh->wh_tick = tick;
+			break;
+		}
+		wh->wh_tick++;
+		for (level = EV_WHEEL_LEVELS - 1; level >= 0; level--) {
+			if (wh->wh_tick & ((1ULL << (EV_WHEEL_BITS * level)) - 1))
+				continue;
+			ev_wheel_cascade(wh, level, expired);
+		}
+	}
+}
+
+/* Remove all of the events from the wheel */
+static void ev_wheel_flush(struct ev_wheel *wh, struct ev_list *expired)
+{
+	int l, i;
+	ev__t e;
+	for (l = 0; l < EV_WHEEL_LEVELS && wh->wh_count; l++) {
+		for (i = 0; i < EV_WHEEL_SIZE; i++) {
+			while ((e = TAILQ_FIRST(&wh->wh_slot[l][i].s_list))) {
+				ev_wheel_remove(wh, e);
+				TAILQ_INSERT_TAIL(expired, e, e_entry);
+			}
+		}
+	}
+}
+
+/* The next tick that has events to expire or to cascade, or -1 */
+static int64_t ev_wheel_next(struct ev_wheel *wh)
+{
+	uint64_t wrap;
+	int64_t next = -1;
+	int i;
+
+	if (!wh->wh_count)
+		return -1;
+	if (wh->wh_level_count[0]) {
+		for (i = 1; i < EV_WHEEL_SIZE; i++) {
+			if (!TAILQ_EMPTY(&wh->wh_slot[0][(wh->wh_tick + i)
+							 & EV_WHEEL_MASK].s_list)) {
+				next = wh->wh_tick + i;
+				break;
+			}
+		}
+	}
+	if (wh->wh_count > wh->wh_level_count[0]) {
+		/* The higher level events expire at or after the next wrap */
+		wrap = ((wh->wh_tick >> EV_WHEEL_BITS) + 1) << EV_WHEEL_BITS;
+		if (next < 0 || wrap < next)
+			next = wrap;
+	}
+	return next;
+}
+
+int ev_worker_post(ev_worker_t w, ev__t e)
+{
 	if (w->w_state == EV_WORKER_FLUSHING) {
-		e->e_status = EV_FLUSH;
-	} else {
-		if (ev_time_cmp(&e->e_to, &now) > 0)
-			goto out;
+		e->e_posted = 0;
+		return EBUSY;
 	}
+	if (e->e_to.tv_sec || e->e_to.tv_nsec)
+		e->e_tick = ev_ts_tick(&e->e_to, 1);
+	ev_get(&e->e_ev);
+	ev_enqueue(w, e);
+	return 0;
+}
+
+int ev_worker_cancel(ev_worker_t w, ev__t e)
+{
+	int requeue = 0;
+
+	pthread_mutex_lock(&w->w_timer_lock);
+	/*
+	 * The actor will see EV_FLUSH. An event that is still in the queue
+	 * is delivered as soon as it is dequeued.
+	 */
+	e->e_status = EV_FLUSH;
+	if (e->e_slot) {
+		ev_wheel_remove(&w->w_wheel, e);
+		requeue = 1;
+	}
+	pthread_mutex_unlock(&w->w_timer_lock);
+	if (requeue)
+		ev_enqueue(w, e);
+	return 0;
+}
+
+static void ev_deliver(ev_worker_t w, ev__t e)
+{
+	ev_actor_t actor = NULL;
 
-	rbt_del(&w->w_event_tree, &e->e_to_rbn);
 	e->e_posted = 0;
-	pthread_mutex_unlock(&w->w_lock);
-	actor = NULL;
 	if (e->e_type->t_id < w->w_dispatch_len)
 		actor = w->w_dispatch[e->e_type->t_id];
 	if (!actor)
 		actor = w->w_actor;
 	actor(e->e_src, e->e_dst, e->e_status, &e->e_ev);
 	ev_put(&e->e_ev);
-	pthread_mutex_lock(&w->w_lock);
-	goto next;
+}
 
- out:
-	return e;
+#define EV_DEQUEUE_BATCH 256
+
+/*
+ * Deliver the immediate events in the worker's queue and move the timed
+ * events to the timer wheel. Returns the number of events dequeued.
+ */
+static int process_queued_events(ev_worker_t w, int flushing)
+{
+	ev__t e;
+	int n, due;
+
+	for (n = 0; n < EV_DEQUEUE_BATCH; n++) {
+		e = ev_dequeue(w);
+		if (!e)
+			break;
+		if (flushing)
+			e->e_status = EV_FLUSH;
+		if (!e->e_to.tv_sec && !e->e_to.tv_nsec) {
+			ev_deliver(w, e);
+			continue;
+		}
+		pthread_mutex_lock(&w->w_timer_lock);
+		if (e->e_status == EV_FLUSH)
+			due = 1;
+		else
+			due = ev_wheel_insert(&w->w_wheel, e);
+		pthread_mutex_unlock(&w->w_timer_lock);
+		if (due)
+			ev_deliver(w, e);
+	}
+	return n;
+}
+
+/*
+ * Deliver the timed events that have expired, or all of them if the worker
+ * is flushing. Only one worker thread at a time runs the timers.
+ */
+static void process_to_events(ev_worker_t w, int flushing)
+{
+	struct ev_list expired;
+	int64_t next;
+	ev__t e;
+
+	TAILQ_INIT(&expired);
+	if (pthread_mutex_trylock(&w->w_timer_lock))
+		return;
+	if (flushing)
+		ev_wheel_flush(&w->w_wheel, &expired);
+	else
+		ev_wheel_advance(&w->w_wheel, ev_now_tick(), &expired);
+	next = ev_wheel_next(&w->w_wheel);
+	__atomic_store_n(&w->w_next_tick, next, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&w->w_timer_lock);
+
+	while ((e = TAILQ_FIRST(&expired))) {
+		TAILQ_REMOVE(&expired, e, e_entry);
+		if (flushing)
+			e->e_status = EV_FLUSH;
+		ev_deliver(w, e);
+	}
 }
 
 void ev_sched_to(struct timespec *to, time_t secs, int nsecs)
 {
-	clock_gettime(CLOCK_REALTIME, to);
+	clock_gettime(CLOCK_MONOTONIC, to);
 	to->tv_sec += secs;
 	to->tv_nsec += nsecs;
 }
 
+#define EV_IDLE_WAIT_SEC 10
+
+static void worker_wait(ev_worker_t w)
+{
+	struct timespec to;
+	int64_t next;
+
+	pthread_mutex_lock(&w->w_idle_lock);
+	__atomic_add_fetch(&w->w_idle, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&w->w_ev_list_len, __ATOMIC_SEQ_CST))
+		goto out;
+	if (w->w_state == EV_WORKER_FLUSHING)
+		goto out;
+	next = __atomic_load_n(&w->w_next_tick, __ATOMIC_ACQUIRE);
+	if (next < 0) {
+		ev_sched_to(&to, EV_IDLE_WAIT_SEC, 0);
+	} else {
+		if (next <= ev_now_tick())
+			goto out;
+		to.tv_sec = (next * EV_WHEEL_TICK_NS) / 1000000000;
+		to.tv_nsec = (next * EV_WHEEL_TICK_NS) % 1000000000;
+	}
+	pthread_cond_timedwait(&w->w_cond, &w->w_idle_lock, &to);
+ out:
+	__atomic_sub_fetch(&w->w_idle, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&w->w_idle_lock);
+}
+
 static void *worker_proc(void *arg)
 {
-	ev__t e;
 	ev_worker_t w = arg;
-	w->w_state = EV_WORKER_RUNNING;
-	ev_sched_to(&w->w_sem_wait, 0, 0);
-	sem_timedwait(&w->w_sem, &w->w_sem_wait);
+	int flushing, n;
+
 	while (1) {
-		pthread_mutex_lock(&w->w_lock);
-		process_immediate_events(w);
-		e = process_to_events(w);
-		if (e) {
-			w->w_sem_wait = e->e_to;
-		} else {
-			ev_sched_to(&w->w_sem_wait, 10, 0);
-		}
-		if (w->w_state == EV_WORKER_FLUSHING)
-			w->w_state = EV_WORKER_RUNNING;
-		pthread_mutex_unlock(&w->w_lock);
-		sem_timedwait(&w->w_sem, &w->w_sem_wait);
+		flushing = (w->w_state == EV_WORKER_FLUSHING);
+		n = process_queued_events(w, flushing);
+		process_to_events(w, flushing);
+		if (flushing && !__atomic_load_n(&w->w_ev_list_len, __ATOMIC_SEQ_CST))
+			__sync_bool_compare_and_swap(&w->w_state,
+						     EV_WORKER_FLUSHING,
+						     EV_WORKER_RUNNING);
+		if (n < EV_DEQUEUE_BATCH)
+			worker_wait(w);
 	}
 	return NULL;
 }
 
 void ev_flush(ev_worker_t w)
 {
-	pthread_mutex_lock(&w->w_lock);
 	w->w_state = EV_WORKER_FLUSHING;
-	pthread_mutex_unlock(&w->w_lock);
-	sem_post(&w->w_sem);
+	__sync_synchronize();
+	ev_worker_wake(w, 1);
 }
 
-ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
+ev_worker_t ev_worker_new_with_threads(const char *name, ev_actor_t actor_fn,
+				       int thread_count)
 {
 	int err = ENOMEM;
 	ev_worker_t w;
 	struct rbn *rbn;
+	pthread_condattr_t attr;
+	size_t namelen, nameoff;
+	int i;
 
+	if (thread_count < 1) {
+		errno = EINVAL;
+		return NULL;
+	}
 	w = calloc(1, sizeof(*w));
 	if (!w)
 		goto err_0;
 	w->w_name = strdup(name);
 	if (!w->w_name)
 		goto err_1;
+	w->w_threads = calloc(thread_count, sizeof(*w->w_threads));
+	if (!w->w_threads)
+		goto err_1;
 	w->w_actor = actor_fn;
-	err = sem_init(&w->w_sem, 0, 0);
-	if (err)
-		goto err_2;
+	w->w_thread_count = thread_count;
 
-	w->w_state = EV_WORKER_STOPPED;
-	pthread_mutex_init(&w->w_lock, NULL);
-	rbt_init(&w->w_event_tree, (int (*)(void *, const void*))ev_time_cmp);
-	TAILQ_INIT(&w->w_event_list);
+	w->w_state = EV_WORKER_RUNNING;
+	w->w_q_head = w->w_q_tail = &w->w_q_stub;
+	pthread_mutex_init(&w->w_q_lock, NULL);
+	pthread_mutex_init(&w->w_timer_lock, NULL);
+	ev_wheel_init(&w->w_wheel, ev_now_tick());
+	w->w_next_tick = -1;
+	pthread_mutex_init(&w->w_idle_lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&w->w_cond, &attr);
+	pthread_condattr_destroy(&attr);
 
 	pthread_mutex_lock(&worker_lock);
 	err = EEXIST;
@@ -190,27 +499,42 @@ ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
 	rbt_ins(&worker_tree, &w->w_rbn);
 	pthread_mutex_unlock(&worker_lock);
 
-	err = pthread_create(&w->w_thread, NULL, worker_proc, w);
-	if (err)
-		goto err_2;
-	size_t namelen = strlen(w->w_name);
-	size_t nameoff = 0;
+	namelen = strlen(w->w_name);
+	nameoff = 0;
 	if (namelen > 15)
 		/* Use the last 16 chars of the worker name */
 		nameoff = namelen - 15;
-	pthread_setname_np(w->w_thread, &w->w_name[nameoff]);
+	for (i = 0; i < thread_count; i++) {
+		err = pthread_create(&w->w_threads[i], NULL, worker_proc, w);
+		if (err) {
+			if (i)
+				/* the running threads use the worker */
+				break;
+			pthread_mutex_lock(&worker_lock);
+			rbt_del(&worker_tree, &w->w_rbn);
+			goto err_2;
+		}
+		pthread_setname_np(w->w_threads[i], &w->w_name[nameoff]);
+	}
+	w->w_thread_count = i;
 	errno = 0;
 	return w;
  err_2:
 	pthread_mutex_unlock(&worker_lock);
  err_1:
+	free(w->w_threads);
 	free(w->w_name);
- err_0:
 	free(w);
+ err_0:
 	errno = err;
 	return NULL;
 }
 
+ev_worker_t ev_worker_new(const char *name, ev_actor_t actor_fn)
+{
+	return ev_worker_new_with_threads(name, actor_fn, 1);
+}
+
 ev_worker_t ev_worker_get(const char *name)
 {
 	ev_worker_t w = NULL;
@@ -276,11 +600,9 @@ int ev_dispatch(ev_worker_t w, ev_type_t t, ev_actor_t fn)
 
 int ev_pending(ev_worker_t w)
 {
-	int count = 0;
+	int count;
 
-	pthread_mutex_lock(&w->w_lock);
-	count = rbt_card(&w->w_event_tree);
-	count += w->w_ev_list_len;
-	pthread_mutex_unlock(&w->w_lock);
+	count = __atomic_load_n(&w->w_ev_list_len, __ATOMIC_ACQUIRE);
+	count += __atomic_load_n(&w->w_wheel.wh_count, __ATOMIC_RELAXED);
 	return count;
 }
@@ -0,0 +1,231 @@
+/*
+ * Stress test of the ovis_ev worker queue and timer wheel.
+ *
+ * Several threads post immediate and timed events to one worker served by
+ * several threads. Every immediate event must be delivered exactly once,
+ * every timed event once, no earlier than its deadline and not much later.
+ * The queue length, watched by another thread, must never go negative.
+ * Timers far in the future land in the upper levels of the wheel; they are
+ * canceled and must be delivered once with EV_FLUSH.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ev.h"
+#include "ev_priv.h"
+
+#define WORKER_THREADS 4
+#define PRODUCERS 8
+#define EVENTS_PER_PRODUCER 20000
+#define TIMERS_PER_PRODUCER 250
+#define TIMER_MAX_MS 3000	/* level 0 and level 1 of the wheel */
+#define TIMER_LATE_MS 500	/* slack for a loaded test machine */
+#define FAR_TIMERS 64		/* up to level 3, canceled */
+#define WAIT_SEC 60
+
+#define IMM_COUNT (PRODUCERS * EVENTS_PER_PRODUCER)
+#define TIMER_COUNT (PRODUCERS * TIMERS_PER_PRODUCER)
+
+struct stress_ev {
+	int id;
+	struct timespec due;
+};
+
+static ev_worker_t worker;
+static ev_type_t imm_type, timer_type;
+static uint8_t imm_seen[IMM_COUNT];
+static uint8_t timer_seen[TIMER_COUNT];
+static uint8_t far_seen[FAR_TIMERS];
+static int imm_count, timer_count, far_count;
+static int errors;
+
+static void error(const char *fmt, int id)
+{
+	if (__atomic_fetch_add(&errors, 1, __ATOMIC_SEQ_CST) < 10) {
+		fprintf(stderr, fmt, id);
+		fputc('\n', stderr);
+	}
+}
+
+static void check_queue_len(ev_worker_t w)
+{
+	int len = __atomic_load_n(&w->w_ev_list_len, __ATOMIC_SEQ_CST);
+	if (len < 0)
+		error("the queue length %d is negative", len);
+}
+
+static int imm_actor(ev_worker_t src, ev_worker_t dst, ev_status_t status,
+		     ev_t e)
+{
+	int id = EV_DATA(e, struct stress_ev)->id;
+
+	check_queue_len(dst);
+	if (status != EV_OK)
+		error("immediate event %d was flushed", id);
+	if (__atomic_exchange_n(&imm_seen[id], 1, __ATOMIC_SEQ_CST))
+		error("immediate event %d was delivered twice", id);
+	__atomic_add_fetch(&imm_count, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static int64_t ms_diff(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000 +
+	       (a->tv_nsec - b->tv_nsec) / 1000000;
+}
+
+static int timer_actor(ev_worker_t src, ev_worker_t dst, ev_status_t status,
+		       ev_t e)
+{
+	struct stress_ev *se = EV_DATA(e, struct stress_ev);
+	struct timespec now;
+	int64_t late;
+
+	check_queue_len(dst);
+	if (se->id < 0) {
+		/* a far timer */
+		if (status != EV_FLUSH)
+			error("far timer %d was not canceled", -se->id - 1);
+		if (__atomic_exchange_n(&far_seen[-se->id - 1], 1,
+					__ATOMIC_SEQ_CST))
+			error("far timer %d was delivered twice", -se->id - 1);
+		__atomic_add_fetch(&far_count, 1, __ATOMIC_SEQ_CST);
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	late = ms_diff(&now, &se->due);
+	if (status != EV_OK)
+		error("timer %d was flushed", se->id);
+	if (late < 0)
+		error("timer %d expired early", se->id);
+	if (late > TIMER_LATE_MS)
+		error("timer %d expired late", se->id);
+	if (__atomic_exchange_n(&timer_seen[se->id], 1, __ATOMIC_SEQ_CST))
+		error("timer %d was delivered twice", se->id);
+	__atomic_add_fetch(&timer_count, 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static int producers_done;
+
+/* Watch the queue length while the producers run */
+static void *watcher_proc(void *arg)
+{
+	while (!__atomic_load_n(&producers_done, __ATOMIC_SEQ_CST))
+		check_queue_len(worker);
+	return NULL;
+}
+
+static void *producer_proc(void *arg)
+{
+	int p = (int)(uintptr_t)arg;
+	unsigned int seed = p + 1;
+	struct stress_ev *se;
+	int i, t = 0, ms;
+	ev_t e;
+
+	for (i = 0; i < EVENTS_PER_PRODUCER; i++) {
+		e = ev_new(imm_type);
+		EV_DATA(e, struct stress_ev)->id = p * EVENTS_PER_PRODUCER + i;
+		if (ev_post(NULL, worker, e, NULL))
+			error("cannot post immediate event %d",
+			      p * EVENTS_PER_PRODUCER + i);
+		ev_put(e);
+		/* interleave the timers with the immediate events */
+		if (t < TIMERS_PER_PRODUCER &&
+		    i % (EVENTS_PER_PRODUCER / TIMERS_PER_PRODUCER) == 0) {
+			e = ev_new(timer_type);
+			se = EV_DATA(e, struct stress_ev);
+			se->id = p * TIMERS_PER_PRODUCER + t;
+			ms = rand_r(&seed) % TIMER_MAX_MS;
+			ev_sched_to(&se->due, ms / 1000,
+				    (ms % 1000) * 1000000);
+			if (ev_post(NULL, worker, e, &se->due))
+				error("cannot post timer %d", se->id);
+			ev_put(e);
+			t++;
+		}
+	}
+	return NULL;
+}
+
+static int wait_for(int *count, int expected)
+{
+	int i;
+	for (i = 0; i < WAIT_SEC * 100; i++) {
+		if (__atomic_load_n(count, __ATOMIC_SEQ_CST) >= expected)
+			return 1;
+		usleep(10000);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t producers[PRODUCERS], watcher;
+	ev_t far[FAR_TIMERS];
+	struct stress_ev *se;
+	struct timespec to;
+	int i, rc;
+
+	imm_type = ev_type_new("stress_imm", sizeof(struct stress_ev));
+	timer_type = ev_type_new("stress_timer", sizeof(struct stress_ev));
+	worker = ev_worker_new_with_threads("stress", imm_actor,
+					    WORKER_THREADS);
+	if (!imm_type || !timer_type || !worker) {
+		fprintf(stderr, "cannot create the worker\n");
+		return 1;
+	}
+	ev_dispatch(worker, timer_type, timer_actor);
+
+	/* Far timers, from seconds to hours away: the upper wheel levels */
+	for (i = 0; i < FAR_TIMERS; i++) {
+		far[i] = ev_new(timer_type);
+		se = EV_DATA(far[i], struct stress_ev);
+		se->id = -i - 1;
+		ev_sched_to(&to, 70L << (i % 10), 0);
+		ev_post(NULL, worker, far[i], &to);
+	}
+
+	rc = pthread_create(&watcher, NULL, watcher_proc, NULL);
+	if (rc) {
+		fprintf(stderr, "pthread_create error %d\n", rc);
+		return 1;
+	}
+	for (i = 0; i < PRODUCERS; i++) {
+		rc = pthread_create(&producers[i], NULL, producer_proc,
+				    (void *)(uintptr_t)i);
+		if (rc) {
+			fprintf(stderr, "pthread_create error %d\n", rc);
+			return 1;
+		}
+	}
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	__atomic_store_n(&producers_done, 1, __ATOMIC_SEQ_CST);
+	pthread_join(watcher, NULL);
+
+	for (i = 0; i < FAR_TIMERS; i++) {
+		ev_cancel(far[i]);
+		ev_put(far[i]);
+	}
+
+	if (!wait_for(&imm_count, IMM_COUNT))
+		error("only %d immediate events were delivered", imm_count);
+	if (!wait_for(&timer_count, TIMER_COUNT))
+		error("only %d timers expired", timer_count);
+	if (!wait_for(&far_count, FAR_TIMERS))
+		error("only %d far timers were canceled", far_count);
+	if (ev_pending(worker))
+		error("%d events are still pending", ev_pending(worker));
+	check_queue_len(worker);
+
+	printf("%d immediate events, %d timers, %d canceled timers : %s\n",
+	       imm_count, timer_count, far_count, errors ? "failed" : "passed");
+	return errors ? 1 : 0;
+}
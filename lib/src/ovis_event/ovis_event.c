@@ -54,19 +54,47 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/timerfd.h>
 
 #define __TIMER_VALID(tv) ((tv)->tv_sec >= 0)
 
 #define ROUND(x, p) ( ((x)+((p)-1))/(p)*(p) )
 #define USEC 1000000
+#define NSEC 1000000000ULL
 
 #define OVIS_EVENT_HEAP_SIZE_DEFAULT 16384
 
 static
 void ovis_scheduler_destroy(ovis_scheduler_t m);
 
-static void __ovis_event_next_wakeup(const struct timeval *now, ovis_event_t ev);
+static void __ovis_event_next_wakeup(uint64_t now, ovis_event_t ev);
+
+static inline uint64_t __ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC + ts->tv_nsec;
+}
+
+static inline void __ns_ts(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC;
+	ts->tv_nsec = ns % NSEC;
+}
+
+static inline uint64_t __tv_ns(const struct timeval *tv)
+{
+	return tv->tv_sec * NSEC + tv->tv_usec * 1000;
+}
+
+/* Nanoseconds since the Epoch; periodic events are aligned to the wall clock */
+static inline uint64_t __now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return __ts_ns(&ts);
+}
 
 static inline
 void ovis_scheduler_ref_get(ovis_scheduler_t m)
@@ -112,7 +140,9 @@ void ovis_event_heap_free(struct ovis_event_heap *h)
 static inline
 int ovis_event_lt(ovis_event_t e0, ovis_event_t e1)
 {
-	return timercmp(&e0->priv.tv, &e1->priv.tv, <);
+	if (e0->priv.ts.tv_sec == e1->priv.ts.tv_sec)
+		return e0->priv.ts.tv_nsec < e1->priv.ts.tv_nsec;
+	return e0->priv.ts.tv_sec < e1->priv.ts.tv_sec;
 }
 
 static inline
@@ -213,6 +243,257 @@ ovis_event_t ovis_event_heap_top(struct ovis_event_heap *h)
 	return NULL;
 }
 
+static inline
+void ovis_event_wheel_link(struct ovis_event_wheel *wh, ovis_event_t ev, int idx)
+{
+	TAILQ_INSERT_TAIL(&wh->slot[idx], ev, priv.entry);
+	ev->priv.idx = idx;
+	wh->level_count[idx / OVIS_EVENT_WHEEL_SIZE]++;
+	if (idx != OVIS_EVENT_WHEEL_EXPIRED)
+		wh->count++;
+}
+
+static inline
+void ovis_event_wheel_remove(struct ovis_event_wheel *wh, ovis_event_t ev)
+{
+	int idx = ev->priv.idx;
+	if (idx < 0)
+		return;
+	TAILQ_REMOVE(&wh->slot[idx], ev, priv.entry);
+	ev->priv.idx = -1;
+	wh->level_count[idx / OVIS_EVENT_WHEEL_SIZE]--;
+	if (idx != OVIS_EVENT_WHEEL_EXPIRED)
+		wh->count--;
+}
+
+static
+void ovis_event_wheel_insert(struct ovis_event_wheel *wh, ovis_event_t ev)
+{
+	uint64_t exp = ev->priv.tick;
+	uint64_t delta;
+	int level;
+
+	/* late events wait in the current slot for the next expiration pass */
+	if (exp < wh->tick)
+		exp = wh->tick;
+	delta = exp - wh->tick;
+	for (level = 0; level < OVIS_EVENT_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (OVIS_EVENT_WHEEL_BITS * (level + 1))))
+			break;
+	}
+	if (delta >= (1ULL << (OVIS_EVENT_WHEEL_BITS * OVIS_EVENT_WHEEL_LEVELS)))
+		/* Beyond the wheel, it is cascaded again when its slot comes */
+		exp = wh->tick + (1ULL << (OVIS_EVENT_WHEEL_BITS *
+					   OVIS_EVENT_WHEEL_LEVELS)) - 1;
+	ovis_event_wheel_link(wh, ev, level * OVIS_EVENT_WHEEL_SIZE +
+			((exp >> (OVIS_EVENT_WHEEL_BITS * level))
+			 & OVIS_EVENT_WHEEL_MASK));
+}
+
+/* Move the events in the current level-0 slot that are due at \c now */
+static
+void ovis_event_wheel_expire(struct ovis_event_wheel *wh, uint64_t now)
+{
+	struct ovis_event_list *slot;
+	ovis_event_t ev, next;
+
+	slot = &wh->slot[wh->tick & OVIS_EVENT_WHEEL_MASK];
+	for (ev = TAILQ_FIRST(slot); ev; ev = next) {
+		next = TAILQ_NEXT(ev, priv.entry);
+		if (__ts_ns(&ev->priv.ts) > now)
+			continue;
+		ovis_event_wheel_remove(wh, ev);
+		ovis_event_wheel_link(wh, ev, OVIS_EVENT_WHEEL_EXPIRED);
+	}
+}
+
+/* Re-insert the events in the current slot of \c level to lower levels */
+static
+void ovis_event_wheel_cascade(struct ovis_event_wheel *wh, int level)
+{
+	struct ovis_event_list list;
+	struct ovis_event_list *slot;
+	ovis_event_t ev;
+
+	slot = &wh->slot[level * OVIS_EVENT_WHEEL_SIZE +
+			 ((wh->tick >> (OVIS_EVENT_WHEEL_BITS * level))
+			  & OVIS_EVENT_WHEEL_MASK)];
+	if (TAILQ_EMPTY(slot))
+		return;
+	TAILQ_INIT(&list);
+	while ((ev = TAILQ_FIRST(slot))) {
+		ovis_event_wheel_remove(wh, ev);
+		TAILQ_INSERT_TAIL(&list, ev, priv.entry);
+	}
+	while ((ev = TAILQ_FIRST(&list))) {
+		TAILQ_REMOVE(&list, ev, priv.entry);
+		ovis_event_wheel_insert(wh, ev);
+	}
+}
+
+/* Advance the wheel to \c now and collect the expired events */
+static
+void ovis_event_wheel_advance(struct ovis_event_wheel *wh, uint64_t now)
+{
+	uint64_t tick = now / OVIS_EVENT_WHEEL_TICK_NS;
+	uint64_t wrap;
+	int level;
+
+	ovis_event_wheel_expire(wh, now);
+	while (wh->tick < tick) {
+		if (!wh->count) {
+			wh->tick = tick;
+			break;
+		}
+		if (!wh->level_count[0]) {
+			/* nothing to expire before the next level-0 wrap */
+			wrap = ((wh->tick >> OVIS_EVENT_WHEEL_BITS) + 1)
+						<< OVIS_EVENT_WHEEL_BITS;
+			if (wrap > tick) {
+				wh->tick = tick;
+				break;
+			}
+			wh->tick = wrap - 1;
+		}
+		wh->tick++;
+		for (level = OVIS_EVENT_WHEEL_LEVELS - 1; level > 0; level--) {
+			if (wh->tick & ((1ULL << (OVIS_EVENT_WHEEL_BITS * level)) - 1))
+				continue;
+			ovis_event_wheel_cascade(wh, level);
+		}
+		ovis_event_wheel_expire(wh, now);
+	}
+}
+
+/*
+ * The time (ns) of the next event to expire, or of the next cascade of a
+ * higher level slot, whichever comes first. Returns 0 if the wheel is empty.
+ */
+static
+uint64_t ovis_event_wheel_next(struct ovis_event_wheel *wh)
+{
+	struct ovis_event_list *slot;
+	ovis_event_t ev;
+	uint64_t next = 0;
+	uint64_t t, base;
+	int level, i;
+
+	if (!wh->count)
+		return 0;
+	if (wh->level_count[0]) {
+		for (i = 0; i < OVIS_EVENT_WHEEL_SIZE; i++) {
+			slot = &wh->slot[(wh->tick + i) & OVIS_EVENT_WHEEL_MASK];
+			if (TAILQ_EMPTY(slot))
+				continue;
+			TAILQ_FOREACH(ev, slot, priv.entry) {
+				t = __ts_ns(&ev->priv.ts);
+				if (!next || t < next)
+					next = t;
+			}
+			break;
+		}
+	}
+	for (level = 1; level < OVIS_EVENT_WHEEL_LEVELS; level++) {
+		if (!wh->level_count[level])
+			continue;
+		base = wh->tick >> (OVIS_EVENT_WHEEL_BITS * level);
+		for (i = 1; i <= OVIS_EVENT_WHEEL_SIZE; i++) {
+			slot = &wh->slot[level * OVIS_EVENT_WHEEL_SIZE +
+					 ((base + i) & OVIS_EVENT_WHEEL_MASK)];
+			if (TAILQ_EMPTY(slot))
+				continue;
+			t = ((base + i) << (OVIS_EVENT_WHEEL_BITS * level))
+						* OVIS_EVENT_WHEEL_TICK_NS;
+			if (!next || t < next)
+				next = t;
+			break;
+		}
+	}
+	return next;
+}
+
+/* Arm the timerfd to wake up at \c ns; 0 disarms it */
+static
+void ovis_event_wheel_arm(ovis_scheduler_t m, uint64_t ns)
+{
+	struct itimerspec its;
+	int rc;
+
+	if (m->wheel->armed_ns == ns)
+		return;
+	memset(&its, 0, sizeof(its));
+	__ns_ts(ns, &its.it_value);
+	rc = timerfd_settime(m->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+	assert(rc == 0 && "timerfd_settime");
+	(void)rc;
+	m->wheel->armed_ns = ns;
+}
+
+static
+struct ovis_event_wheel *ovis_event_wheel_create(uint64_t now)
+{
+	struct ovis_event_wheel *wh;
+	int i;
+	wh = calloc(1, sizeof(*wh));
+	if (!wh)
+		return NULL;
+	for (i = 0; i <= OVIS_EVENT_WHEEL_EXPIRED; i++)
+		TAILQ_INIT(&wh->slot[i]);
+	wh->tick = now / OVIS_EVENT_WHEEL_TICK_NS;
+	return wh;
+}
+
+/* Insert a timer event according to its priv.ts (mutex held) */
+static
+int __ovis_event_timer_insert(ovis_scheduler_t m, ovis_event_t ev)
+{
+	uint64_t ns;
+	if (m->backend != OVIS_SCHEDULER_WHEEL)
+		return ovis_event_heap_insert(m->heap, ev);
+	ns = __ts_ns(&ev->priv.ts);
+	ev->priv.tick = ns / OVIS_EVENT_WHEEL_TICK_NS;
+	if (!m->wheel->count)
+		/* an idle wheel does not need to walk through the gap */
+		m->wheel->tick = __now_ns() / OVIS_EVENT_WHEEL_TICK_NS;
+	ovis_event_wheel_insert(m->wheel, ev);
+	if (!m->wheel->armed_ns || ns < m->wheel->armed_ns)
+		ovis_event_wheel_arm(m, ns);
+	return 0;
+}
+
+/* Remove a timer event (mutex held) */
+static
+void __ovis_event_timer_remove(ovis_scheduler_t m, ovis_event_t ev)
+{
+	if (m->backend == OVIS_SCHEDULER_WHEEL)
+		ovis_event_wheel_remove(m->wheel, ev);
+	else
+		ovis_event_heap_remove(m->heap, ev);
+}
+
+/* Re-position a timer event after its priv.ts has changed (mutex held) */
+static
+void __ovis_event_timer_resched(ovis_scheduler_t m, ovis_event_t ev)
+{
+	if (m->backend == OVIS_SCHEDULER_WHEEL) {
+		ovis_event_wheel_remove(m->wheel, ev);
+		__ovis_event_timer_insert(m, ev);
+	} else {
+		ovis_event_heap_update(m->heap, ev->priv.idx);
+	}
+}
+
+static
+void __ovis_event_tfd_cb(ovis_event_t ev)
+{
+	ovis_scheduler_t m = ev->param.ctxt;
+	uint64_t cnt;
+	/* just clear the expiration count, the wheel is processed by the loop */
+	if (read(m->tfd, &cnt, sizeof(cnt)) < 0) {
+		assert(errno == EAGAIN || errno == EWOULDBLOCK);
+	}
+}
+
 static
 void __ovis_event_pipe_cb(ovis_event_t ev)
 {
@@ -238,11 +519,38 @@ static inline int __ovis_event_get_heap_size()
 	return strtoul(sz_str, NULL, 0);
 }
 
+static inline ovis_scheduler_backend_t __ovis_event_get_backend()
+{
+	char *str = getenv("OVIS_EVENT_SCHEDULER");
+	if (str && 0 == strcasecmp(str, "wheel"))
+		return OVIS_SCHEDULER_WHEEL;
+	return OVIS_SCHEDULER_HEAP;
+}
+
 ovis_scheduler_t ovis_scheduler_new()
+{
+	return ovis_scheduler_new_with_backend(OVIS_SCHEDULER_DEFAULT);
+}
+
+ovis_scheduler_t ovis_scheduler_new_with_backend(ovis_scheduler_backend_t b)
 {
 	int rc;
 	uint32_t heap_sz;
-	ovis_scheduler_t m = calloc(1,sizeof(*m));
+	ovis_scheduler_t m;
+
+	switch (b) {
+	case OVIS_SCHEDULER_DEFAULT:
+		b = __ovis_event_get_backend();
+		break;
+	case OVIS_SCHEDULER_HEAP:
+	case OVIS_SCHEDULER_WHEEL:
+		break;
+	default:
+		errno = EINVAL;
+		return NULL;
+	}
+
+	m = calloc(1,sizeof(*m));
 	if (!m)
 		goto out;
 
@@ -254,15 +562,24 @@ ovis_scheduler_t ovis_scheduler_new()
 	m->efd = -1;
 	m->pfd[0] = -1;
 	m->pfd[1] = -1;
+	m->tfd = -1;
 	m->heap = NULL;
+	m->wheel = NULL;
+	m->backend = b;
 	m->evcount = 0;
 	m->refcount = 1;
 	m->state = OVIS_EVENT_MANAGER_INIT;
 
-	heap_sz = __ovis_event_get_heap_size();
-	m->heap = ovis_event_heap_create(heap_sz);
-	if (!m->heap)
-		goto err;
+	if (b == OVIS_SCHEDULER_WHEEL) {
+		m->wheel = ovis_event_wheel_create(__now_ns());
+		if (!m->wheel)
+			goto err;
+	} else {
+		heap_sz = __ovis_event_get_heap_size();
+		m->heap = ovis_event_heap_create(heap_sz);
+		if (!m->heap)
+			goto err;
+	}
 
 	m->efd = epoll_create(4096); /* size is ignored since Linux 2.6.8 */
 	if (m->efd == -1)
@@ -282,8 +599,8 @@ ovis_scheduler_t ovis_scheduler_new()
 
 	m->ovis_ev.param.ctxt = m;
 	m->ovis_ev.param.cb_fn = __ovis_event_pipe_cb;
-	m->ovis_ev.priv.tv.tv_sec = -1;
-	m->ovis_ev.priv.tv.tv_usec = 0;
+	m->ovis_ev.priv.ts.tv_sec = -1;
+	m->ovis_ev.priv.ts.tv_nsec = 0;
 	m->ovis_ev.param.fd = m->pfd[0];
 	m->ovis_ev.priv.idx = -1;
 	m->ovis_ev.param.epoll_events = EPOLLIN;
@@ -295,6 +612,23 @@ ovis_scheduler_t ovis_scheduler_new()
 	if (rc != 0)
 		goto err;
 
+	if (b == OVIS_SCHEDULER_WHEEL) {
+		m->tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (m->tfd < 0)
+			goto err;
+		m->timer_ev.param.ctxt = m;
+		m->timer_ev.param.cb_fn = __ovis_event_tfd_cb;
+		m->timer_ev.param.fd = m->tfd;
+		m->timer_ev.priv.idx = -1;
+		m->timer_ev.param.epoll_events = EPOLLIN;
+		m->timer_ev.param.type = OVIS_EVENT_EPOLL;
+		m->ev[0].events = m->timer_ev.param.epoll_events;
+		m->ev[0].data.ptr = &m->timer_ev;
+		rc = epoll_ctl(m->efd, EPOLL_CTL_ADD, m->tfd, &m->ev[0]);
+		if (rc != 0)
+			goto err;
+	}
+
 	goto out;
 
 err:
@@ -317,9 +651,14 @@ void ovis_scheduler_destroy(ovis_scheduler_t m)
 	if (m->pfd[1] >= 0)
 		close(m->pfd[1]);
 
+	if (m->tfd >= 0)
+		close(m->tfd);
+
 	if (m->heap)
 		ovis_event_heap_free(m->heap);
 
+	free(m->wheel);
+
 	pthread_mutex_destroy(&m->mutex);
 	free(m);
 }
@@ -337,8 +676,7 @@ void ovis_scheduler_free(ovis_scheduler_t m)
 static
 int ovis_event_heap_process(ovis_scheduler_t m)
 {
-	struct timeval tv, dtv;
-	uint64_t us;
+	uint64_t now, ns;
 	ovis_event_t ev;
 	int timeout = -1;
 
@@ -350,48 +688,19 @@ loop:
 		goto out;
 	}
 
-	gettimeofday(&tv, NULL);
-	if (!timercmp(&ev->priv.tv, &tv, >)) {
+	now = __now_ns();
+	ns = __ts_ns(&ev->priv.ts);
+	if (ns <= now) {
 		/* current time is greater than event time */
 		goto process_event;
 	}
-	timersub(&ev->priv.tv, &tv, &dtv);
-	assert(dtv.tv_sec >= 0);
-	assert(dtv.tv_usec >= 0);
-	/* tv_usec + 999 is for rounding-up transforming usec -> msec */
-	timeout = dtv.tv_sec*1000 + (dtv.tv_usec + 999)/1000;
-	/*
-	printf("timeout: %d\n", timeout);
-	printf("ev->tv: %ld.%06ld\n", ev->tv.tv_sec, ev->tv.tv_usec);
-	printf("tv: %ld.%06ld\n", tv.tv_sec, tv.tv_usec);
-	printf("dtv: %ld.%06ld\n", dtv.tv_sec, dtv.tv_usec);
-	*/
+	/* rounding-up transforming nsec -> msec */
+	timeout = (ns - now + 999999) / 1000000;
 	goto out;
 
 process_event:
-	switch (ev->param.type) {
-	case OVIS_EVENT_TIMEOUT:
-	case OVIS_EVENT_EPOLL_TIMEOUT:
-		/* timeout event application callback */
-		gettimeofday(&tv, NULL);
-		timeradd(&tv, &ev->param.timeout, &ev->priv.tv);
-		ovis_event_heap_update(m->heap, ev->priv.idx);
-		ev->cb.type = OVIS_EVENT_TIMEOUT;
-		break;
-	case OVIS_EVENT_PERIODIC:
-		/* periodic event application callback */
-		gettimeofday(&tv, NULL);
-		us = tv.tv_sec * USEC + tv.tv_usec;
-		us = ROUND(us, ev->param.periodic.period_us);
-		us += ev->param.periodic.phase_us;
-		ev->priv.tv.tv_sec = us / USEC;
-		ev->priv.tv.tv_usec = us % USEC;
-		ovis_event_heap_update(m->heap, ev->priv.idx);
-		ev->cb.type = OVIS_EVENT_PERIODIC;
-		break;
-	default:
-		assert(0 == "Unexpected event type");
-	}
+	__ovis_event_next_wakeup(__now_ns(), ev);
+	ovis_event_heap_update(m->heap, ev->priv.idx);
 	pthread_mutex_unlock(&m->mutex);
 	ev->param.cb_fn(ev);
 	goto loop;
@@ -402,14 +711,50 @@ out:
 	return timeout;
 }
 
+/**
+ * Deliver the expired events of the timing wheel.
+ *
+ * The wheel wakes the loop up through the timerfd, so the loop does not need
+ * an epoll timeout.
+ *
+ * \retval -1 always.
+ */
+static
+int ovis_event_wheel_process(ovis_scheduler_t m)
+{
+	struct ovis_event_wheel *wh = m->wheel;
+	ovis_event_t ev;
+
+loop:
+	pthread_mutex_lock(&m->mutex);
+	if (TAILQ_EMPTY(&wh->slot[OVIS_EVENT_WHEEL_EXPIRED]))
+		ovis_event_wheel_advance(wh, __now_ns());
+	ev = TAILQ_FIRST(&wh->slot[OVIS_EVENT_WHEEL_EXPIRED]);
+	if (!ev) {
+		ovis_event_wheel_arm(m, ovis_event_wheel_next(wh));
+		goto out;
+	}
+	ovis_event_wheel_remove(wh, ev);
+	__ovis_event_next_wakeup(__now_ns(), ev);
+	__ovis_event_timer_insert(m, ev);
+	pthread_mutex_unlock(&m->mutex);
+	ev->param.cb_fn(ev);
+	goto loop;
+out:
+	if (m->state == OVIS_EVENT_MANAGER_RUNNING)
+		m->state = OVIS_EVENT_MANAGER_WAITING;
+	pthread_mutex_unlock(&m->mutex);
+	return -1;
+}
+
 static
 int __ovis_event_timer_update(ovis_scheduler_t m, ovis_event_t ev)
 {
-	struct timeval tv;
 	pthread_mutex_lock(&m->mutex);
-	gettimeofday(&tv, NULL);
-	timeradd(&tv, &ev->param.timeout, &ev->priv.tv);
-	ovis_event_heap_update(m->heap, ev->priv.idx);
+	if (ev->priv.idx >= 0) {
+		__ns_ts(__now_ns() + __tv_ns(&ev->param.timeout), &ev->priv.ts);
+		__ovis_event_timer_resched(m, ev);
+	}
 	pthread_mutex_unlock(&m->mutex);
 	return 0;
 }
@@ -489,24 +834,27 @@ out:
 	return ev;
 }
 
-static void __ovis_event_next_wakeup(const struct timeval *now, ovis_event_t ev)
+/* Set the next wake up time (priv.ts) and the callback type of \c ev */
+static void __ovis_event_next_wakeup(uint64_t now, ovis_event_t ev)
 {
-	uint64_t us;
+	uint64_t ns, period;
 	switch (ev->param.type) {
 	case OVIS_EVENT_TIMEOUT:
 	case OVIS_EVENT_EPOLL_TIMEOUT:
-		timeradd(now, &ev->param.timeout, &ev->priv.tv);
+		ns = now + __tv_ns(&ev->param.timeout);
+		ev->cb.type = OVIS_EVENT_TIMEOUT;
 		break;
 	case OVIS_EVENT_PERIODIC:
-		us = now->tv_sec * USEC + now->tv_usec;
-		us = ROUND(us, ev->param.periodic.period_us);
-		us += ev->param.periodic.phase_us;
-		ev->priv.tv.tv_sec = us / USEC;
-		ev->priv.tv.tv_usec = us % USEC;
+		period = ev->param.periodic.period_us * 1000;
+		ns = ROUND(now, period);
+		ns += ev->param.periodic.phase_us * 1000;
+		ev->cb.type = OVIS_EVENT_PERIODIC;
 		break;
 	default:
 		assert(0 == "Bad event type");
+		return;
 	}
+	__ns_ts(ns, &ev->priv.ts);
 }
 
 int ovis_scheduler_event_add(ovis_scheduler_t m, ovis_event_t ev)
@@ -534,18 +882,20 @@ int ovis_scheduler_event_add(ovis_scheduler_t m, ovis_event_t ev)
 			goto out;
 		}
 		pthread_mutex_lock(&m->mutex);
-		struct timeval tv;
 		/* calculate wake up time */
-		gettimeofday(&tv, NULL);
-		__ovis_event_next_wakeup(&tv, ev);
-		rc = ovis_event_heap_insert(m->heap, ev);
+		__ovis_event_next_wakeup(__now_ns(), ev);
+		rc = __ovis_event_timer_insert(m, ev);
 		if (rc) {
 			pthread_mutex_unlock(&m->mutex);
 			goto out;
 		}
 		m->evcount++;
-		/* notify only if the new event affect the next timeout */
+		/*
+		 * notify only if the new event affect the next timeout; the
+		 * wheel has already re-armed its timerfd.
+		 */
 		if (m->state == OVIS_EVENT_MANAGER_WAITING
+				&& m->backend == OVIS_SCHEDULER_HEAP
 				&& ev->priv.idx == 0) {
 			wb = write(m->pfd[1], &ev, sizeof(ev));
 			if (wb == -1) {
@@ -586,7 +936,7 @@ int ovis_scheduler_event_del(ovis_scheduler_t m, ovis_event_t ev)
 
 	pthread_mutex_lock(&m->mutex);
 	if (ev->priv.idx >= 0) {
-		ovis_event_heap_remove(m->heap, ev);
+		__ovis_event_timer_remove(m, ev);
 		m->evcount--;
 		/* notify only last delete event */
 		if (m->state == OVIS_EVENT_MANAGER_WAITING && m->evcount == 0) {
@@ -658,7 +1008,10 @@ int ovis_scheduler_loop(ovis_scheduler_t m, int return_on_empty)
 		goto out;
 
 loop:
-	timeout = ovis_event_heap_process(m);
+	if (m->backend == OVIS_SCHEDULER_WHEEL)
+		timeout = ovis_event_wheel_process(m);
+	else
+		timeout = ovis_event_heap_process(m);
 	pthread_mutex_lock(&m->mutex);
 	if (!m->evcount && return_on_empty) {
 		pthread_mutex_unlock(&m->mutex);
@@ -65,6 +65,7 @@
  * typedef void (*ovis_event_cb)(ovis_event_t ev);
  *
  * ovis_scheduler_t ovis_scheduler_new();
+ * ovis_scheduler_t ovis_scheduler_new_with_backend(ovis_scheduler_backend_t b);
  * ovis_event_t ovis_event_epoll_new(ovis_event_cb_fn cb, void *ctxt,
  *                                   int fd, uint32_t epoll_events);
  * ovis_event_t ovis_event_timeout_new(ovis_event_cb_fn cb, void *ctxt,
@@ -112,6 +113,15 @@
  * event might have a slight wake up time slack, but it does not have
  * continuously time shifting like the timeout event.
  *
+ * The timer events are kept by one of the two scheduler backends.
+ * ::OVIS_SCHEDULER_HEAP keeps them in a binary heap and sleeps in
+ * \c epoll_wait(2) with a millisecond timeout. ::OVIS_SCHEDULER_WHEEL keeps
+ * them in a hierarchical timing wheel with O(1) add and remove, and wakes up
+ * at the nanosecond deadline of the next event through a \c timerfd(2). Use
+ * ::ovis_scheduler_new_with_backend() to choose the backend;
+ * ::ovis_scheduler_new() uses the backend named by the \c OVIS_EVENT_SCHEDULER
+ * environment variable ("heap" or "wheel"), or the heap if it is not set.
+ *
  *
  * \section example EXAMPLE
  *
@@ -186,8 +196,10 @@
 #define __OVIS_EVENT_H
 
 #include <sys/epoll.h>
+#include <sys/queue.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 
 typedef enum ovis_event_type_e {
 	OVIS_EVENT_EPOLL          =  0x1,
@@ -199,6 +211,12 @@ typedef enum ovis_event_type_e {
 typedef struct ovis_event_s *ovis_event_t;
 typedef struct ovis_scheduler_s *ovis_scheduler_t;
 
+typedef enum ovis_scheduler_backend_e {
+	OVIS_SCHEDULER_DEFAULT, /* OVIS_EVENT_SCHEDULER, or heap */
+	OVIS_SCHEDULER_HEAP,    /* binary heap, millisecond wakeups */
+	OVIS_SCHEDULER_WHEEL,   /* timing wheel, timerfd wakeups */
+} ovis_scheduler_backend_t;
+
 typedef struct ovis_periodic_s {
 	uint64_t period_us; /* period in microseconds */
 	uint64_t phase_us; /* phase in microseconds */
@@ -248,8 +266,10 @@ struct ovis_event_s {
 
 	/* private data for ovis_scheduler */
 	struct {
-		struct timeval tv;
-		int idx;
+		struct timespec ts; /* the next wake up time */
+		int idx; /* heap index or wheel slot, -1 if not scheduled */
+		uint64_t tick; /* ts in wheel ticks */
+		TAILQ_ENTRY(ovis_event_s) entry; /* wheel slot entry */
 	} priv; /* private data for ovis_scheduler */
 };
 
@@ -275,6 +295,19 @@ struct ovis_event_s {
  */
 ovis_scheduler_t ovis_scheduler_new();
 
+/**
+ * Create an OVIS event scheduler with the given timer backend.
+ *
+ * \param b ::OVIS_SCHEDULER_HEAP, ::OVIS_SCHEDULER_WHEEL, or
+ *          ::OVIS_SCHEDULER_DEFAULT to use the backend named by the
+ *          \c OVIS_EVENT_SCHEDULER environment variable.
+ *
+ * \retval m a handle to \c ovis_scheduler.
+ * \retval NULL on failure. In this case, \c errno is also set to describe the
+ *              error.
+ */
+ovis_scheduler_t ovis_scheduler_new_with_backend(ovis_scheduler_backend_t b);
+
 /**
  * Destroy the unused event manager.
  *
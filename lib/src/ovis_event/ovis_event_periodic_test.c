@@ -55,6 +55,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ovis_event.h"
 
@@ -72,13 +73,22 @@ int main(int argc, char **argv)
 	ovis_scheduler_t sch;
 	struct ovis_periodic_s p;
 	int msec = 1000;
+	ovis_scheduler_backend_t backend = OVIS_SCHEDULER_DEFAULT;
 	if (argc > 1) {
 		msec = atoi(argv[1]);
 	}
+	if (argc > 2) {
+		/* heap or wheel */
+		if (0 == strcmp(argv[2], "wheel"))
+			backend = OVIS_SCHEDULER_WHEEL;
+		else
+			backend = OVIS_SCHEDULER_HEAP;
+	}
 	p.period_us = msec * 1000;
 	p.phase_us = 0;
 
-	sch = ovis_scheduler_new();
+	sch = ovis_scheduler_new_with_backend(backend);
+	assert(sch);
 
 	ev = ovis_event_periodic_new(cb, NULL, &p);
 	assert(ev);
@@ -62,6 +62,30 @@ struct ovis_event_heap {
 	ovis_event_t ev[OVIS_FLEX];
 };
 
+/*
+ * Hierarchical timing wheel: OVIS_EVENT_WHEEL_LEVELS levels of
+ * OVIS_EVENT_WHEEL_SIZE slots. A level-0 slot is one tick, a level-n slot is
+ * OVIS_EVENT_WHEEL_SIZE^n ticks. The events due in the current tick stay in
+ * its level-0 slot until their nanosecond deadline passes.
+ */
+#define OVIS_EVENT_WHEEL_TICK_NS	1000000	/* 1ms */
+#define OVIS_EVENT_WHEEL_BITS		8
+#define OVIS_EVENT_WHEEL_SIZE		(1 << OVIS_EVENT_WHEEL_BITS)
+#define OVIS_EVENT_WHEEL_MASK		(OVIS_EVENT_WHEEL_SIZE - 1)
+#define OVIS_EVENT_WHEEL_LEVELS		4
+/* The slot index of the expired events waiting for their callback */
+#define OVIS_EVENT_WHEEL_EXPIRED	(OVIS_EVENT_WHEEL_LEVELS * OVIS_EVENT_WHEEL_SIZE)
+
+TAILQ_HEAD(ovis_event_list, ovis_event_s);
+
+struct ovis_event_wheel {
+	uint64_t tick; /* current tick */
+	uint64_t armed_ns; /* timerfd expiration, 0 if disarmed */
+	int count; /* events in the wheel, excluding the expired ones */
+	int level_count[OVIS_EVENT_WHEEL_LEVELS + 1];
+	struct ovis_event_list slot[OVIS_EVENT_WHEEL_EXPIRED + 1];
+};
+
 struct ovis_scheduler_s {
 	int evcount;
 	int refcount;
@@ -70,7 +94,11 @@ struct ovis_scheduler_s {
 	struct ovis_event_s ovis_ev;
 	struct epoll_event ev[MAX_EPOLL_EVENTS];
 	pthread_mutex_t mutex;
+	ovis_scheduler_backend_t backend;
 	struct ovis_event_heap *heap;
+	int tfd; /* timerfd of the wheel backend */
+	struct ovis_event_s timer_ev;
+	struct ovis_event_wheel *wheel;
 	enum {
 		OVIS_EVENT_MANAGER_INIT,
 		OVIS_EVENT_MANAGER_RUNNING,
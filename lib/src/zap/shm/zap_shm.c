@@ -0,0 +1,1506 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2014-2020 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2014-2020 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <signal.h>
+
+#include "zap_shm.h"
+
+#define LOG_(sep, ...) do { \
+	if ((sep) && (sep)->ep.z && (sep)->ep.z->log_fn) \
+		(sep)->ep.z->log_fn(__VA_ARGS__); \
+} while(0);
+
+static size_t z_shm_ring_sz;
+
+static void *io_thread_proc(void *arg);
+static void z_shm_sock_ev(struct z_shm_ep *sep, uint32_t events);
+static void z_shm_bell_ev(struct z_shm_ep *sep, uint32_t events);
+static void z_shm_listen_ev(struct z_shm_ep *sep, uint32_t events);
+static void __shm_disconnect(struct z_shm_ep *sep);
+
+static struct z_shm_ring *__shm_ring(void *chan, size_t ring_sz, int idx)
+{
+	return (void *)((char *)chan + idx * (sizeof(struct z_shm_ring) + ring_sz));
+}
+
+/*
+ * Ring the doorbell if the consumer of \c r is (about to go) asleep. The
+ * consumer sets rx_sleep before it checks the ring for the last time, so
+ * either it sees the new data or we see the flag.
+ */
+static void __shm_ring_bell(struct z_shm_ring *r, int bell)
+{
+	if (__atomic_exchange_n(&r->rx_sleep, 0, __ATOMIC_SEQ_CST))
+		eventfd_write(bell, 1);
+}
+
+/*
+ * Put a record into the tx ring. The caller holds sep->ep.lock.
+ *
+ * \retval 0      The record has been published.
+ * \retval EAGAIN Not enough room in the ring.
+ */
+static int __shm_put(struct z_shm_ep *sep, uint16_t type,
+		     const void *hdr, size_t hdr_len,
+		     const void *data, size_t data_len)
+{
+	struct z_shm_ring *r = sep->tx;
+	struct z_shm_rec *rec;
+	size_t len = hdr_len + data_len;
+	size_t need = Z_SHM_REC_ALIGN(len);
+	uint64_t tail = r->tail;
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+	size_t off = tail & (sep->ring_sz - 1);
+	size_t pad = sep->ring_sz - off;
+
+	/* a record never wraps, the rest of the ring is skipped instead */
+	if (pad >= need)
+		pad = 0;
+	if (sep->ring_sz - (tail - head) < need + pad)
+		return EAGAIN;
+	if (pad) {
+		rec = (void *)&r->data[off];
+		rec->len = pad - sizeof(*rec);
+		rec->type = Z_SHM_REC_PAD;
+		tail += pad;
+		off = 0;
+	}
+	rec = (void *)&r->data[off];
+	rec->len = len;
+	rec->type = type;
+	memcpy(rec->data, hdr, hdr_len);
+	if (data_len)
+		memcpy(rec->data + hdr_len, data, data_len);
+	__atomic_store_n(&r->tail, tail + need, __ATOMIC_SEQ_CST);
+	__shm_ring_bell(r, sep->peer_bell);
+	return 0;
+}
+
+/* Move the queued messages into the ring. The caller holds sep->ep.lock. */
+static void __shm_tx_flush(struct z_shm_ep *sep)
+{
+	struct z_shm_txe *txe;
+
+	while ((txe = TAILQ_FIRST(&sep->txq))) {
+		if (__shm_put(sep, txe->type, txe->data, txe->len, NULL, 0)) {
+			/*
+			 * Ask the consumer to ring our bell when it makes
+			 * room, then try again in case it already did.
+			 */
+			__atomic_store_n(&sep->tx->tx_wait, 1, __ATOMIC_SEQ_CST);
+			if (__shm_put(sep, txe->type, txe->data, txe->len,
+				      NULL, 0))
+				return;
+		}
+		TAILQ_REMOVE(&sep->txq, txe, link);
+		free(txe);
+	}
+	pthread_cond_broadcast(&sep->txq_cond);
+}
+
+/*
+ * Send a message through the ring, or queue it if the ring is full. The
+ * caller holds sep->ep.lock.
+ */
+static zap_err_t __shm_send(struct z_shm_ep *sep, uint16_t type,
+			    const void *hdr, size_t hdr_len,
+			    const void *data, size_t data_len)
+{
+	struct z_shm_txe *txe;
+
+	if (TAILQ_EMPTY(&sep->txq) &&
+	    !__shm_put(sep, type, hdr, hdr_len, data, data_len))
+		return ZAP_ERR_OK;
+	txe = malloc(sizeof(*txe) + hdr_len + data_len);
+	if (!txe)
+		return ZAP_ERR_RESOURCE;
+	txe->type = type;
+	txe->len = hdr_len + data_len;
+	memcpy(txe->data, hdr, hdr_len);
+	if (data_len)
+		memcpy(txe->data + hdr_len, data, data_len);
+	TAILQ_INSERT_TAIL(&sep->txq, txe, link);
+	__shm_tx_flush(sep);
+	return ZAP_ERR_OK;
+}
+
+/*
+ * Queue the completion of a local operation for the I/O thread. The caller
+ * holds sep->ep.lock.
+ */
+static zap_err_t __shm_cq_post(struct z_shm_ep *sep, enum zap_event_type type,
+			       zap_err_t status, void *ctxt)
+{
+	struct z_shm_io *io;
+
+	if (sep->cq_closed)
+		return ZAP_ERR_NOT_CONNECTED;
+	io = TAILQ_FIRST(&sep->io_free);
+	if (io)
+		TAILQ_REMOVE(&sep->io_free, io, link);
+	else
+		io = malloc(sizeof(*io));
+	if (!io)
+		return ZAP_ERR_RESOURCE;
+	io->type = type;
+	io->status = status;
+	io->ctxt = ctxt;
+	TAILQ_INSERT_TAIL(&sep->cq, io, link);
+	__shm_ring_bell(sep->rx, sep->bell);
+	return ZAP_ERR_OK;
+}
+
+/* Deliver the queued completions. The caller holds sep->ep.lock. */
+static void __shm_cq_process(struct z_shm_ep *sep)
+{
+	struct z_shm_io *io;
+	struct zap_event zev;
+
+	while ((io = TAILQ_FIRST(&sep->cq))) {
+		TAILQ_REMOVE(&sep->cq, io, link);
+		memset(&zev, 0, sizeof(zev));
+		zev.type = io->type;
+		zev.status = io->status;
+		zev.context = io->ctxt;
+		TAILQ_INSERT_HEAD(&sep->io_free, io, link);
+		pthread_mutex_unlock(&sep->ep.lock);
+		sep->ep.cb(&sep->ep, &zev);
+		pthread_mutex_lock(&sep->ep.lock);
+	}
+}
+
+static void __shm_recv_sendrecv(struct z_shm_ep *sep, struct z_shm_rec *rec)
+{
+	struct zap_event ev = {
+		.type = ZAP_EVENT_RECV_COMPLETE,
+		.status = ZAP_ERR_OK,
+		.data = (void *)rec->data,
+		.data_len = rec->len,
+	};
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+static void __shm_recv_rendezvous(struct z_shm_ep *sep, struct z_shm_rec *rec)
+{
+	struct z_shm_rendezvous *rz = (void *)rec->data;
+	struct zap_map *map;
+	zap_err_t zerr;
+
+	if (rec->len < sizeof(*rz) || rec->len - sizeof(*rz) < rz->msg_len) {
+		LOG_(sep, "zap_shm: bad rendezvous message length %u\n",
+		     rec->len);
+		return;
+	}
+	zerr = zap_map(&map, (void *)rz->addr, rz->len, rz->acc);
+	if (zerr) {
+		LOG_(sep, "%s:%d: Failed to create a map in %s (%s)\n",
+			__FILE__, __LINE__, __func__, __zap_err_str[zerr]);
+		return;
+	}
+	map->type = ZAP_MAP_REMOTE;
+	ref_get(&sep->ep.ref, "zap_map/rendezvous");
+	map->ep = &sep->ep;
+	map->mr[ZAP_SHM] = (void *)1; /* so that zap_unmap() calls us */
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_RENDEZVOUS,
+		.map = map,
+		.data_len = rz->msg_len,
+		.data = rz->msg_len ? (void *)rz->msg : NULL,
+	};
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+/*
+ * Deliver the messages in the rx ring. The data of a receive event points
+ * into the ring; its space is given back after the callback returns.
+ */
+static void __shm_rx_process(struct z_shm_ep *sep)
+{
+	struct z_shm_ring *r = sep->rx;
+	struct z_shm_rec *rec;
+	uint64_t head = r->head;
+	size_t off;
+
+	while (head != __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST)) {
+		off = head & (sep->ring_sz - 1);
+		rec = (void *)&r->data[off];
+		if (Z_SHM_REC_ALIGN(rec->len) > sep->ring_sz - off) {
+			LOG_(sep, "zap_shm: corrupted message ring, "
+			     "record length %u at offset %zu\n", rec->len, off);
+			shutdown(sep->sock, SHUT_RDWR);
+			return;
+		}
+		switch (rec->type) {
+		case Z_SHM_REC_PAD:
+			break;
+		case Z_SHM_REC_SENDRECV:
+			__shm_recv_sendrecv(sep, rec);
+			break;
+		case Z_SHM_REC_RENDEZVOUS:
+			__shm_recv_rendezvous(sep, rec);
+			break;
+		default:
+			LOG_(sep, "zap_shm: unknown message type %hu\n",
+			     rec->type);
+			break;
+		}
+		head += Z_SHM_REC_ALIGN(rec->len);
+		__atomic_store_n(&r->head, head, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&r->tx_wait, 0, __ATOMIC_SEQ_CST))
+			eventfd_write(sep->peer_bell, 1);
+	}
+}
+
+static int __shm_rx_empty(struct z_shm_ep *sep)
+{
+	return sep->rx->head == __atomic_load_n(&sep->rx->tail,
+						__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Our doorbell: the peer put messages into the rx ring or made room in the
+ * tx ring, or a local operation completed.
+ */
+static void z_shm_bell_ev(struct z_shm_ep *sep, uint32_t events)
+{
+	eventfd_t v;
+	int busy;
+
+	if (sep->cq_closed)
+		return;
+	(void)eventfd_read(sep->bell, &v);
+	if (sep->ep.state == ZAP_EP_ACCEPTING) {
+		/* the ACK_ACCEPTED is sent before the first message */
+		z_shm_sock_ev(sep, EPOLLIN);
+	}
+ again:
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->cq_closed) {
+		pthread_mutex_unlock(&sep->ep.lock);
+		return;
+	}
+	__shm_tx_flush(sep);
+	__shm_cq_process(sep);
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	if (sep->ep.state == ZAP_EP_CONNECTED)
+		__shm_rx_process(sep);
+
+	__atomic_store_n(&sep->rx->rx_sleep, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&sep->ep.lock);
+	busy = !TAILQ_EMPTY(&sep->cq);
+	pthread_mutex_unlock(&sep->ep.lock);
+	if (!busy && sep->ep.state == ZAP_EP_CONNECTED)
+		busy = !__shm_rx_empty(sep);
+	if (busy) {
+		__atomic_store_n(&sep->rx->rx_sleep, 0, __ATOMIC_SEQ_CST);
+		goto again;
+	}
+}
+
+/* Fill \c sin with the loopback address and \c port (network order) */
+static void __shm_sin(struct sockaddr_in *sin, in_port_t port)
+{
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = port;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static int __shm_port(struct sockaddr *sa, in_port_t *port)
+{
+	switch (sa->sa_family) {
+	case AF_INET:
+		*port = ((struct sockaddr_in *)sa)->sin_port;
+		return 0;
+	case AF_INET6:
+		*port = ((struct sockaddr_in6 *)sa)->sin6_port;
+		return 0;
+	default:
+		return EINVAL;
+	}
+}
+
+/* The abstract socket address of the listener on \c port */
+static socklen_t __shm_sun(in_port_t port, struct sockaddr_un *sun)
+{
+	int n;
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	n = snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1,
+		     ZAP_SHM_SOCK_PREFIX "%hu", ntohs(port));
+	return offsetof(struct sockaddr_un, sun_path) + 1 + n;
+}
+
+/*
+ * Only processes of our own effective user may connect: the peer gets
+ * read-write access to our heap.
+ */
+static int __shm_peer_check(struct z_shm_ep *sep, int sock)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+		return errno;
+	if (cred.uid != geteuid()) {
+		LOG_(sep, "zap_shm: refusing peer pid %d of uid %d\n",
+		     (int)cred.pid, (int)cred.uid);
+		return EPERM;
+	}
+	sep->peer_pid = cred.pid;
+	return 0;
+}
+
+/* Returns the fd of our heap, or -1 if it cannot be shared */
+static int __shm_heap_info(zap_t z, uint64_t *start, uint64_t *len)
+{
+	zap_mem_info_t mi = z->mem_info_fn ? z->mem_info_fn() : NULL;
+
+	if (!mi || mi->fd <= 0 || !mi->start || !mi->len)
+		return -1;
+	*start = (uint64_t)mi->start;
+	*len = mi->max_len > mi->len ? mi->max_len : mi->len;
+	return mi->fd;
+}
+
+/*
+ * Map the heap of the peer; on failure the peer memory is copied by pid.
+ *
+ * The peer heap grows in place by extending its memfd. The whole range it
+ * may grow to is mapped up front, but only the part backed by the memfd
+ * may be touched; see __shm_peer_heap_ptr(). The fd is kept to follow the
+ * growth and is taken from *fd.
+ */
+static void __shm_heap_map(struct z_shm_ep *sep, struct z_shm_ctrl *msg,
+			   int *fd)
+{
+	struct stat st;
+	void *p;
+
+	if (*fd < 0 || !msg->heap_start || !msg->heap_len)
+		return;
+	if (fstat(*fd, &st))
+		return;
+	p = mmap(NULL, msg->heap_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 *fd, 0);
+	if (p == MAP_FAILED) {
+		LOG_(sep, "zap_shm: cannot map the peer heap, errno %d\n",
+		     errno);
+		return;
+	}
+	sep->peer_heap = p;
+	sep->peer_heap_start = msg->heap_start;
+	sep->peer_heap_len = msg->heap_len;
+	sep->peer_heap_size = st.st_size;
+	sep->peer_heap_fd = *fd;
+	*fd = -1;
+}
+
+/*
+ * Our address of [raddr, raddr + sz) in the peer heap, or NULL if the
+ * range is not in the part of the heap that we can access.
+ */
+static char *__shm_peer_heap_ptr(struct z_shm_ep *sep, uint64_t raddr,
+				 size_t sz)
+{
+	uint64_t off, size;
+	struct stat st;
+
+	if (!sep->peer_heap || raddr < sep->peer_heap_start)
+		return NULL;
+	off = raddr - sep->peer_heap_start;
+	if (off + sz > sep->peer_heap_len)
+		return NULL;
+	size = __atomic_load_n(&sep->peer_heap_size, __ATOMIC_ACQUIRE);
+	if (off + sz > size) {
+		/* The heap may have grown since we last looked */
+		if (fstat(sep->peer_heap_fd, &st) ||
+		    off + sz > (uint64_t)st.st_size)
+			return NULL;
+		/* The heap never shrinks */
+		__atomic_store_n(&sep->peer_heap_size, st.st_size,
+				 __ATOMIC_RELEASE);
+	}
+	return sep->peer_heap + off;
+}
+
+static zap_err_t __shm_ctrl_send(struct z_shm_ep *sep, uint16_t type,
+				 const char *data, size_t data_len,
+				 int *fds, int nfds, int heap)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(4 * sizeof(int))];
+	} cbuf;
+	struct msghdr mh = { 0 };
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	struct z_shm_ctrl *msg;
+	size_t len = sizeof(*msg) + data_len;
+	int fdv[4];
+	int i, fd;
+	ssize_t rc;
+
+	if (len > ZAP_SHM_CTRL_MAX)
+		return ZAP_ERR_PARAMETER;
+	msg = calloc(1, len);
+	if (!msg)
+		return ZAP_ERR_RESOURCE;
+	memcpy(msg->sig, ZAP_SHM_SIG, sizeof(ZAP_SHM_SIG));
+	ZAP_VERSION_SET(msg->ver);
+	msg->type = type;
+	msg->data_len = data_len;
+	msg->ring_sz = sep->ring_sz;
+	if (data_len)
+		memcpy(msg->data, data, data_len);
+	for (i = 0; i < nfds; i++)
+		fdv[i] = fds[i];
+	if (heap) {
+		fd = __shm_heap_info(sep->ep.z, &msg->heap_start,
+				     &msg->heap_len);
+		if (fd >= 0)
+			fdv[nfds++] = fd;
+	}
+
+	iov.iov_base = msg;
+	iov.iov_len = len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	if (nfds) {
+		mh.msg_control = cbuf.buf;
+		mh.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fdv, nfds * sizeof(int));
+	}
+	rc = sendmsg(sep->sock, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+	free(msg);
+	return (rc == (ssize_t)len) ? ZAP_ERR_OK : ZAP_ERR_TRANSPORT;
+}
+
+static int __shm_bell_arm(struct z_shm_ep *sep)
+{
+	z_shm_io_thread_t thr = (void *)sep->ep.thread;
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = &sep->bell_evh,
+	};
+
+	if (epoll_ctl(thr->efd, EPOLL_CTL_ADD, sep->bell, &ev))
+		return errno;
+	sep->bell_armed = 1;
+	return 0;
+}
+
+static void process_ctrl_connect(struct z_shm_ep *sep, struct z_shm_ctrl *msg,
+				 int *fds, int nfds)
+{
+	struct stat st;
+	uint64_t sz = msg->ring_sz;
+	void *chan;
+
+	if (sep->ep.state != ZAP_EP_ACCEPTING || sep->chan || nfds < 3) {
+		LOG_(sep, "zap_shm: unexpected connect message\n");
+		goto err;
+	}
+	if (sz < 4 * ZAP_SHM_MAX_MSG || (sz & (sz - 1)) || sz > (1UL << 30)) {
+		LOG_(sep, "zap_shm: bad ring size %lu\n", sz);
+		goto err;
+	}
+	if (fstat(fds[0], &st) || st.st_size < Z_SHM_CHAN_SZ(sz))
+		goto err;
+	chan = mmap(NULL, Z_SHM_CHAN_SZ(sz), PROT_READ | PROT_WRITE,
+		    MAP_SHARED, fds[0], 0);
+	if (chan == MAP_FAILED)
+		goto err;
+	sep->chan = chan;
+	sep->ring_sz = sz;
+	sep->rx = __shm_ring(chan, sz, 0);
+	sep->tx = __shm_ring(chan, sz, 1);
+	sep->peer_bell = fds[1];
+	sep->bell = fds[2];
+	fds[1] = fds[2] = -1;
+	if (nfds > 3)
+		__shm_heap_map(sep, msg, &fds[3]);
+	if (__shm_bell_arm(sep))
+		goto err;
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_CONNECT_REQUEST,
+		.data = msg->data_len ? (void *)msg->data : NULL,
+		.data_len = msg->data_len,
+	};
+	sep->conn_req = 1;
+	sep->ep.cb(&sep->ep, &ev);
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_accepted(struct z_shm_ep *sep, struct z_shm_ctrl *msg,
+				  int *fds, int nfds)
+{
+	zap_err_t zerr;
+
+	if (sep->ep.state != ZAP_EP_CONNECTING) {
+		LOG_(sep, "'Accept' message received in unexpected state %d.\n",
+		     sep->ep.state);
+		goto err;
+	}
+	if (nfds)
+		__shm_heap_map(sep, msg, &fds[0]);
+
+	pthread_mutex_lock(&sep->ep.lock);
+	zerr = __shm_ctrl_send(sep, Z_SHM_CTRL_ACK_ACCEPTED, NULL, 0,
+			       NULL, 0, 0);
+	pthread_mutex_unlock(&sep->ep.lock);
+	if (zerr)
+		goto err;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_CONNECTING,
+				   ZAP_EP_CONNECTED);
+	if (zerr)
+		goto err;
+	struct zap_event ev = {
+		.type = ZAP_EVENT_CONNECTED,
+		.status = ZAP_ERR_OK,
+		.data = msg->data_len ? (void *)msg->data : NULL,
+		.data_len = msg->data_len,
+	};
+	sep->ep.cb(&sep->ep, &ev);
+	return;
+ err:
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_rejected(struct z_shm_ep *sep, struct z_shm_ctrl *msg)
+{
+	zap_err_t zerr;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_CONNECTING, ZAP_EP_ERROR);
+	if (zerr != ZAP_ERR_OK) {
+		LOG_(sep, "'reject' message received in unexpected state %d.\n",
+		     sep->ep.state);
+		return;
+	}
+	struct zap_event ev = {
+		.type = ZAP_EVENT_REJECTED,
+		.status = ZAP_ERR_OK,
+		.data = msg->data_len ? (void *)msg->data : NULL,
+		.data_len = msg->data_len,
+	};
+	sep->ep.cb(&sep->ep, &ev);
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+static void process_ctrl_ack_accepted(struct z_shm_ep *sep)
+{
+	zap_err_t zerr;
+
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_ACCEPTING,
+				   ZAP_EP_CONNECTED);
+	if (zerr != ZAP_ERR_OK) {
+		LOG_(sep, "'Acknowledged' message received in unexpected "
+		     "state %d.\n", sep->ep.state);
+		shutdown(sep->sock, SHUT_RDWR);
+		return;
+	}
+	struct zap_event ev = {
+		.type = ZAP_EVENT_CONNECTED,
+		.status = ZAP_ERR_OK,
+	};
+	/* Released on disconnect */
+	ref_get(&sep->ep.ref, "accept/connect");
+	sep->conn_ref = 1;
+	sep->ep.cb(&sep->ep, &ev);
+}
+
+/* Receive and process the handshake messages waiting on the socket */
+static void __shm_ctrl_recv(struct z_shm_ep *sep)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(4 * sizeof(int))];
+	} cbuf;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	struct z_shm_ctrl *msg;
+	int fds[4];
+	int i, nfds;
+	ssize_t rc;
+
+	msg = malloc(ZAP_SHM_CTRL_MAX);
+	if (!msg)
+		return;
+	while (1) {
+		memset(&mh, 0, sizeof(mh));
+		iov.iov_base = msg;
+		iov.iov_len = ZAP_SHM_CTRL_MAX;
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = cbuf.buf;
+		mh.msg_controllen = sizeof(cbuf.buf);
+		rc = recvmsg(sep->sock, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+		if (rc <= 0)
+			break; /* EAGAIN, or EOF handled by the HUP event */
+		nfds = 0;
+		for (cmsg = CMSG_FIRSTHDR(&mh); cmsg;
+		     cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET ||
+			    cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			if (nfds > 4)
+				nfds = 4;
+			memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+		}
+		if (rc < sizeof(*msg) || rc < sizeof(*msg) + msg->data_len ||
+		    memcmp(msg->sig, ZAP_SHM_SIG, sizeof(ZAP_SHM_SIG))) {
+			LOG_(sep, "zap_shm: bad handshake message\n");
+			shutdown(sep->sock, SHUT_RDWR);
+			goto next;
+		}
+		if (!zap_version_check(&msg->ver)) {
+			LOG_(sep, "Connection request from an unsupported Zap "
+			     "version %hhu.%hhu.%hhu.%hhu\n",
+			     msg->ver.major, msg->ver.minor,
+			     msg->ver.patch, msg->ver.flags);
+			shutdown(sep->sock, SHUT_RDWR);
+			goto next;
+		}
+		switch (msg->type) {
+		case Z_SHM_CTRL_CONNECT:
+			process_ctrl_connect(sep, msg, fds, nfds);
+			break;
+		case Z_SHM_CTRL_ACCEPTED:
+			process_ctrl_accepted(sep, msg, fds, nfds);
+			break;
+		case Z_SHM_CTRL_REJECTED:
+			process_ctrl_rejected(sep, msg);
+			break;
+		case Z_SHM_CTRL_ACK_ACCEPTED:
+			process_ctrl_ack_accepted(sep);
+			break;
+		default:
+			LOG_(sep, "zap_shm: unknown handshake message %hu\n",
+			     msg->type);
+			shutdown(sep->sock, SHUT_RDWR);
+			break;
+		}
+	next:
+		/* the mappings keep what we need */
+		for (i = 0; i < nfds; i++) {
+			if (fds[i] >= 0)
+				close(fds[i]);
+		}
+	}
+	free(msg);
+}
+
+static void z_shm_sock_ev(struct z_shm_ep *sep, uint32_t events)
+{
+	if (sep->cq_closed)
+		return;
+	if (events & EPOLLIN)
+		__shm_ctrl_recv(sep);
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+		__shm_disconnect(sep);
+}
+
+static void __shm_disconnect(struct z_shm_ep *sep)
+{
+	struct zap_event zev = { 0 };
+	struct z_shm_txe *txe;
+	int do_cb = 0;
+	int drop_conn_ref;
+	int drop_ep = 0;
+
+	/* Deliver what the peer sent before it went away */
+	if (sep->rx && sep->ep.state == ZAP_EP_CONNECTED)
+		__shm_rx_process(sep);
+
+	pthread_mutex_lock(&sep->ep.lock);
+	zap_io_thread_ep_release(&sep->ep);
+	__shm_cq_process(sep);
+	sep->cq_closed = 1;
+	while ((txe = TAILQ_FIRST(&sep->txq))) {
+		TAILQ_REMOVE(&sep->txq, txe, link);
+		free(txe);
+	}
+	pthread_cond_broadcast(&sep->txq_cond);
+
+	switch (sep->ep.state) {
+	case ZAP_EP_ACCEPTING:
+		sep->ep.state = ZAP_EP_ERROR;
+		if (sep->app_accepted) {
+			zev.type = ZAP_EVENT_CONNECT_ERROR;
+			do_cb = 1;
+		}
+		/* the application never saw this endpoint */
+		drop_ep = !sep->conn_req;
+		break;
+	case ZAP_EP_CONNECTING:
+		zev.type = ZAP_EVENT_CONNECT_ERROR;
+		sep->ep.state = ZAP_EP_ERROR;
+		do_cb = 1;
+		break;
+	case ZAP_EP_CONNECTED:	/* Peer closed. */
+		sep->ep.state = ZAP_EP_PEER_CLOSE;
+	case ZAP_EP_CLOSE:	/* App called close. */
+		zev.type = ZAP_EVENT_DISCONNECTED;
+		do_cb = 1;
+		break;
+	case ZAP_EP_ERROR:
+		break;
+	default:
+		LOG_(sep, "Unexpected state for EOF %d.\n", sep->ep.state);
+		sep->ep.state = ZAP_EP_ERROR;
+		break;
+	}
+	drop_conn_ref = sep->conn_ref;
+	sep->conn_ref = 0;
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	if (do_cb)
+		sep->ep.cb(&sep->ep, &zev);
+	if (drop_conn_ref) {
+		/* Taken in z_shm_connect and process_ctrl_ack_accepted */
+		ref_put(&sep->ep.ref, "accept/connect");
+	}
+	if (drop_ep)
+		zap_free(&sep->ep);
+}
+
+static void z_shm_listen_ev(struct z_shm_ep *sep, uint32_t events)
+{
+	struct z_shm_ep *new_sep;
+	zap_ep_t new_ep;
+	zap_err_t zerr;
+	int fd;
+
+	if (events & (EPOLLERR | EPOLLHUP)) {
+		/* zap_close() on the listener */
+		pthread_mutex_lock(&sep->ep.lock);
+		if (sep->ep.thread)
+			zap_io_thread_ep_release(&sep->ep);
+		pthread_mutex_unlock(&sep->ep.lock);
+		return;
+	}
+
+	while ((fd = accept4(sep->sock, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		new_ep = zap_new(sep->ep.z, sep->ep.cb);
+		if (!new_ep) {
+			LOG_(sep, "Zap Error %d (%s): in %s at %s:%d\n",
+			     errno, zap_err_str(errno), __func__, __FILE__,
+			     __LINE__);
+			close(fd);
+			continue;
+		}
+		zap_set_ucontext(new_ep, zap_get_ucontext(&sep->ep));
+		new_sep = (void *)new_ep;
+		new_sep->sock = fd;
+		new_sep->ep.state = ZAP_EP_ACCEPTING;
+		new_sep->local_sa = sep->local_sa;
+		__shm_sin(&new_sep->remote_sa, 0);
+		if (__shm_peer_check(new_sep, fd)) {
+			zap_free(new_ep);
+			continue;
+		}
+		zerr = zap_io_thread_ep_assign(new_ep);
+		if (zerr) {
+			LOG_(sep, "zap_io_thread_ep_assign() error %d on fd %d\n",
+			     zerr, fd);
+			zap_free(new_ep);
+		}
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		LOG_(sep, "zap_shm: accept() error %d\n", errno);
+}
+
+static zap_err_t z_shm_listen(zap_ep_t ep, struct sockaddr *sa,
+			      socklen_t sa_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct sockaddr_un sun;
+	socklen_t sun_len;
+	in_port_t port;
+	zap_err_t zerr;
+
+	if (__shm_port(sa, &port))
+		return ZAP_ERR_ADDRESS;
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_INIT, ZAP_EP_LISTENING);
+	if (zerr)
+		return zerr;
+
+	sep->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+				    SOCK_CLOEXEC, 0);
+	if (sep->sock == -1)
+		return ZAP_ERR_RESOURCE;
+	sun_len = __shm_sun(port, &sun);
+	if (bind(sep->sock, (void *)&sun, sun_len)) {
+		zerr = (errno == EADDRINUSE) ? ZAP_ERR_BUSY : ZAP_ERR_RESOURCE;
+		goto err;
+	}
+	if (listen(sep->sock, 1024)) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err;
+	}
+	__shm_sin(&sep->local_sa, port);
+	sep->sock_evh.fn = z_shm_listen_ev;
+	sep->sock_evh.sep = sep;
+	zerr = zap_io_thread_ep_assign(&sep->ep);
+	if (zerr)
+		goto err;
+	return ZAP_ERR_OK;
+ err:
+	close(sep->sock);
+	sep->sock = -1;
+	return zerr;
+}
+
+static zap_err_t z_shm_connect(zap_ep_t ep,
+			       struct sockaddr *sa, socklen_t sa_len,
+			       char *data, size_t data_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct sockaddr_un sun;
+	socklen_t sun_len;
+	in_port_t port;
+	zap_err_t zerr;
+	int fds[3];
+	int chan_fd = -1;
+
+	if (__shm_port(sa, &port))
+		return ZAP_ERR_ADDRESS;
+	zerr = zap_ep_change_state(&sep->ep, ZAP_EP_INIT, ZAP_EP_CONNECTING);
+	if (zerr)
+		return zerr;
+
+	__shm_sin(&sep->local_sa, 0);
+	__shm_sin(&sep->remote_sa, port);
+	sep->sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+				    SOCK_CLOEXEC, 0);
+	if (sep->sock == -1)
+		return ZAP_ERR_RESOURCE;
+	sun_len = __shm_sun(port, &sun);
+	if (connect(sep->sock, (void *)&sun, sun_len)) {
+		zerr = ZAP_ERR_CONNECT;
+		goto err;
+	}
+	if (__shm_peer_check(sep, sep->sock)) {
+		zerr = ZAP_ERR_CONNECT;
+		goto err;
+	}
+
+	/* the channel: ring 0 goes to the passive side, ring 1 comes back */
+	zerr = ZAP_ERR_RESOURCE;
+	sep->ring_sz = z_shm_ring_sz;
+	chan_fd = memfd_create("zap_shm", MFD_CLOEXEC);
+	if (chan_fd < 0)
+		goto err;
+	if (ftruncate(chan_fd, Z_SHM_CHAN_SZ(sep->ring_sz)))
+		goto err;
+	sep->chan = mmap(NULL, Z_SHM_CHAN_SZ(sep->ring_sz),
+			 PROT_READ | PROT_WRITE, MAP_SHARED, chan_fd, 0);
+	if (sep->chan == MAP_FAILED) {
+		sep->chan = NULL;
+		goto err;
+	}
+	sep->tx = __shm_ring(sep->chan, sep->ring_sz, 0);
+	sep->rx = __shm_ring(sep->chan, sep->ring_sz, 1);
+	/* nobody is processing either ring yet */
+	sep->tx->rx_sleep = 1;
+	sep->rx->rx_sleep = 1;
+	sep->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	sep->peer_bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (sep->bell < 0 || sep->peer_bell < 0)
+		goto err;
+
+	fds[0] = chan_fd;
+	fds[1] = sep->bell;
+	fds[2] = sep->peer_bell;
+	zerr = __shm_ctrl_send(sep, Z_SHM_CTRL_CONNECT, data, data_len,
+			       fds, 3, 1);
+	if (zerr)
+		goto err;
+	close(chan_fd);
+	chan_fd = -1;
+
+	ref_get(&sep->ep.ref, "accept/connect");
+	sep->conn_ref = 1;
+	zerr = zap_io_thread_ep_assign(&sep->ep);
+	if (zerr) {
+		sep->conn_ref = 0;
+		ref_put(&sep->ep.ref, "accept/connect");
+		goto err;
+	}
+	return ZAP_ERR_OK;
+
+ err:
+	if (chan_fd >= 0)
+		close(chan_fd);
+	close(sep->sock);
+	sep->sock = -1;
+	return zerr;
+}
+
+static zap_err_t z_shm_accept(zap_ep_t ep, zap_cb_fn_t cb,
+			      char *data, size_t data_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_ACCEPTING) {
+		zerr = ZAP_ERR_ENDPOINT;
+		goto out;
+	}
+	sep->ep.cb = cb;
+	zerr = __shm_ctrl_send(sep, Z_SHM_CTRL_ACCEPTED, data, data_len,
+			       NULL, 0, 1);
+	if (zerr) {
+		sep->ep.state = ZAP_EP_ERROR;
+		shutdown(sep->sock, SHUT_RDWR);
+		goto out;
+	}
+	sep->app_accepted = 1;
+ out:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_reject(zap_ep_t ep, char *data, size_t data_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	zerr = __shm_ctrl_send(sep, Z_SHM_CTRL_REJECTED, data, data_len,
+			       NULL, 0, 0);
+	if (zerr) {
+		sep->ep.state = ZAP_EP_ERROR;
+		shutdown(sep->sock, SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_close(zap_ep_t ep)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (ep->thread && pthread_self() != ep->thread->thread) {
+		/* Not in the app callback path; let the queued sends out */
+		while (!TAILQ_EMPTY(&sep->txq) && !sep->cq_closed)
+			pthread_cond_wait(&sep->txq_cond, &sep->ep.lock);
+	}
+	switch (sep->ep.state) {
+	case ZAP_EP_PEER_CLOSE:
+	case ZAP_EP_CONNECTED:
+	case ZAP_EP_LISTENING:
+		sep->ep.state = ZAP_EP_CLOSE;
+		shutdown(sep->sock, SHUT_RDWR);
+		break;
+	case ZAP_EP_ERROR:
+	case ZAP_EP_ACCEPTING:
+	case ZAP_EP_CONNECTING:
+		shutdown(sep->sock, SHUT_RDWR);
+		break;
+	case ZAP_EP_CLOSE:
+		break;
+	default:
+		ZAP_ASSERT(0, ep, "%s: Unexpected state '%s'\n",
+				__func__, __zap_ep_state_str(ep->state));
+		break;
+	}
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t z_shm_get_name(zap_ep_t ep, struct sockaddr *local_sa,
+				struct sockaddr *remote_sa, socklen_t *sa_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	*sa_len = sizeof(struct sockaddr_in);
+	memcpy(local_sa, &sep->local_sa, sizeof(sep->local_sa));
+	memcpy(remote_sa, &sep->remote_sa, sizeof(sep->remote_sa));
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t z_shm_send(zap_ep_t ep, char *buf, size_t len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+
+	if (len > ZAP_SHM_MAX_MSG)
+		return ZAP_ERR_NO_SPACE;
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto out;
+	}
+	zerr = __shm_send(sep, Z_SHM_REC_SENDRECV, buf, len, NULL, 0);
+	if (!zerr)
+		zerr = __shm_cq_post(sep, ZAP_EVENT_SEND_COMPLETE,
+				     ZAP_ERR_OK, NULL);
+ out:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_send_mapped(zap_ep_t ep, zap_map_t map, void *buf,
+				   size_t len, void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t zerr;
+
+	if (len > ZAP_SHM_MAX_MSG)
+		return ZAP_ERR_NO_SPACE;
+	if (z_map_access_validate(map, buf, len, ZAP_ACCESS_NONE) != 0)
+		return ZAP_ERR_LOCAL_LEN;
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto out;
+	}
+	zerr = __shm_send(sep, Z_SHM_REC_SENDRECV, buf, len, NULL, 0);
+	if (!zerr)
+		zerr = __shm_cq_post(sep, ZAP_EVENT_SEND_MAPPED_COMPLETE,
+				     ZAP_ERR_OK, context);
+ out:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_share(zap_ep_t ep, zap_map_t map,
+			     const char *msg, size_t msg_len)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct z_shm_rendezvous rz;
+	zap_err_t zerr;
+
+	if (map->type != ZAP_MAP_LOCAL)
+		return ZAP_ERR_INVALID_MAP_TYPE;
+	if (msg_len > ZAP_SHM_MAX_MSG)
+		return ZAP_ERR_NO_SPACE;
+	rz.addr = (uint64_t)map->addr;
+	rz.len = map->len;
+	rz.acc = map->acc;
+	rz.msg_len = msg_len;
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED)
+		zerr = ZAP_ERR_NOT_CONNECTED;
+	else
+		zerr = __shm_send(sep, Z_SHM_REC_RENDEZVOUS, &rz, sizeof(rz),
+				  msg, msg_len);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_unmap(zap_map_t map)
+{
+	if (map->type == ZAP_MAP_REMOTE && map->ep)
+		ref_put(&map->ep->ref, "zap_map/rendezvous");
+	return ZAP_ERR_OK;
+}
+
+/*
+ * Copy between our memory and the peer's through our mapping of the peer
+ * heap. Memory outside of it is refused: the peer cannot tell us whether
+ * the range is still shared, and reaching it by pid would need ptrace
+ * access to the peer.
+ */
+static zap_err_t __shm_copy(struct z_shm_ep *sep, char *local, char *remote,
+			    size_t sz, int to_peer)
+{
+	char *p;
+
+	p = __shm_peer_heap_ptr(sep, (uint64_t)remote, sz);
+	if (!p) {
+		if (!__atomic_exchange_n(&sep->heap_warned, 1, __ATOMIC_SEQ_CST))
+			LOG_(sep, "zap_shm: [%p, %p) is not in the shared heap "
+			     "of peer pid %d, the peer must run with "
+			     "MMALLOC_SHARED=1\n", remote, remote + sz,
+			     (int)sep->peer_pid);
+		return ZAP_ERR_REMOTE_PERMISSION;
+	}
+	if (to_peer)
+		memcpy(p, local, sz);
+	else
+		memcpy(local, p, sz);
+	return ZAP_ERR_OK;
+}
+
+/* Post the completion of a read/write done in the caller's context */
+static zap_err_t __shm_complete(struct z_shm_ep *sep, enum zap_event_type type,
+				zap_err_t status, void *context)
+{
+	zap_err_t zerr;
+	pthread_mutex_lock(&sep->ep.lock);
+	zerr = __shm_cq_post(sep, type, status, context);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
+static zap_err_t z_shm_read(zap_ep_t ep, zap_map_t src_map, char *src,
+			    zap_map_t dst_map, char *dst, size_t sz,
+			    void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t status;
+
+	if (sep->ep.state != ZAP_EP_CONNECTED)
+		return ZAP_ERR_NOT_CONNECTED;
+	if (z_map_access_validate(src_map, src, sz, ZAP_ACCESS_READ) != 0)
+		return ZAP_ERR_REMOTE_PERMISSION;
+	if (z_map_access_validate(dst_map, dst, sz, ZAP_ACCESS_NONE) != 0)
+		return ZAP_ERR_LOCAL_LEN;
+	status = __shm_copy(sep, dst, src, sz, 0);
+	return __shm_complete(sep, ZAP_EVENT_READ_COMPLETE, status, context);
+}
+
+static zap_err_t z_shm_readv(zap_ep_t ep, struct zap_read_iov *iov,
+			     int iovcnt, void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t status = ZAP_ERR_OK;
+	int i;
+
+	if (sep->ep.state != ZAP_EP_CONNECTED)
+		return ZAP_ERR_NOT_CONNECTED;
+	for (i = 0; i < iovcnt; i++) {
+		if (z_map_access_validate(iov[i].src_map, iov[i].src,
+					  iov[i].sz, ZAP_ACCESS_READ) != 0)
+			return ZAP_ERR_REMOTE_PERMISSION;
+		if (z_map_access_validate(iov[i].dst_map, iov[i].dst,
+					  iov[i].sz, ZAP_ACCESS_NONE) != 0)
+			return ZAP_ERR_LOCAL_LEN;
+	}
+	for (i = 0; i < iovcnt && !status; i++)
+		status = __shm_copy(sep, iov[i].dst, iov[i].src, iov[i].sz, 0);
+	return __shm_complete(sep, ZAP_EVENT_READ_COMPLETE, status, context);
+}
+
+static zap_err_t z_shm_write(zap_ep_t ep, zap_map_t src_map, char *src,
+			     zap_map_t dst_map, char *dst, size_t sz,
+			     void *context)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	zap_err_t status;
+
+	if (sep->ep.state != ZAP_EP_CONNECTED)
+		return ZAP_ERR_NOT_CONNECTED;
+	if (z_map_access_validate(src_map, src, sz, ZAP_ACCESS_NONE) != 0)
+		return ZAP_ERR_LOCAL_LEN;
+	if (z_map_access_validate(dst_map, dst, sz, ZAP_ACCESS_WRITE) != 0)
+		return ZAP_ERR_REMOTE_PERMISSION;
+	status = __shm_copy(sep, src, dst, sz, 1);
+	return __shm_complete(sep, ZAP_EVENT_WRITE_COMPLETE, status, context);
+}
+
+static zap_ep_t z_shm_new(zap_t z, zap_cb_fn_t cb)
+{
+	struct z_shm_ep *sep = calloc(1, sizeof(*sep));
+	if (!sep) {
+		errno = ZAP_ERR_RESOURCE;
+		return NULL;
+	}
+	sep->sock = -1;
+	sep->bell = -1;
+	sep->peer_bell = -1;
+	sep->peer_heap_fd = -1;
+	sep->sock_evh.fn = z_shm_sock_ev;
+	sep->sock_evh.sep = sep;
+	sep->bell_evh.fn = z_shm_bell_ev;
+	sep->bell_evh.sep = sep;
+	TAILQ_INIT(&sep->cq);
+	TAILQ_INIT(&sep->io_free);
+	TAILQ_INIT(&sep->txq);
+	pthread_cond_init(&sep->txq_cond, NULL);
+	return &sep->ep;
+}
+
+static void z_shm_destroy(zap_ep_t ep)
+{
+	struct z_shm_ep *sep = (struct z_shm_ep *)ep;
+	struct z_shm_txe *txe;
+	struct z_shm_io *io;
+
+	while ((txe = TAILQ_FIRST(&sep->txq))) {
+		TAILQ_REMOVE(&sep->txq, txe, link);
+		free(txe);
+	}
+	ZAP_ASSERT(TAILQ_EMPTY(&sep->cq), ep, "%s: The cq is not empty "
+			"when the reference count reaches 0.\n", __func__);
+	while ((io = TAILQ_FIRST(&sep->io_free))) {
+		TAILQ_REMOVE(&sep->io_free, io, link);
+		free(io);
+	}
+	if (sep->chan)
+		munmap(sep->chan, Z_SHM_CHAN_SZ(sep->ring_sz));
+	if (sep->peer_heap)
+		munmap(sep->peer_heap, sep->peer_heap_len);
+	if (sep->peer_heap_fd >= 0)
+		close(sep->peer_heap_fd);
+	if (sep->sock >= 0)
+		close(sep->sock);
+	if (sep->bell >= 0)
+		close(sep->bell);
+	if (sep->peer_bell >= 0)
+		close(sep->peer_bell);
+	free(sep->conn_data);
+	pthread_cond_destroy(&sep->txq_cond);
+	free(sep);
+}
+
+static void io_thread_cleanup(void *arg)
+{
+	z_shm_io_thread_t thr = arg;
+	if (thr->efd > -1)
+		close(thr->efd);
+	zap_io_thread_release(&thr->zap_io_thread);
+	free(thr);
+}
+
+static void *io_thread_proc(void *arg)
+{
+	z_shm_io_thread_t thr = arg;
+	struct z_shm_evh *evh;
+	sigset_t sigset;
+	int rc, n, i;
+
+	pthread_cleanup_push(io_thread_cleanup, arg);
+
+	/* Zap thread will not handle any signal */
+	sigfillset(&sigset);
+	rc = sigprocmask(SIG_SETMASK, &sigset, NULL);
+	assert(rc == 0 && "pthread_sigmask error");
+
+	while (1) {
+		zap_thrstat_wait_start(thr->zap_io_thread.stat);
+		n = epoll_wait(thr->efd, thr->ev, ZAP_SHM_EV_SIZE, -1);
+		zap_thrstat_wait_end(thr->zap_io_thread.stat);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue; /* EINTR is OK */
+			break;
+		}
+		/*
+		 * An event may drop the last reference to an endpoint that a
+		 * later event in the batch refers to.
+		 */
+		for (i = 0; i < n; i++) {
+			evh = thr->ev[i].data.ptr;
+			ref_get(&evh->sep->ep.ref, "zap_shm:io_thread");
+		}
+		for (i = 0; i < n; i++) {
+			evh = thr->ev[i].data.ptr;
+			evh->fn(evh->sep, thr->ev[i].events);
+		}
+		for (i = 0; i < n; i++) {
+			evh = thr->ev[i].data.ptr;
+			ref_put(&evh->sep->ep.ref, "zap_shm:io_thread");
+		}
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+static zap_io_thread_t z_shm_io_thread_create(zap_t z)
+{
+	int rc;
+	z_shm_io_thread_t thr = calloc(1, sizeof(*thr));
+	if (!thr)
+		goto err0;
+	rc = zap_io_thread_init(&thr->zap_io_thread, z, "zap_shm_io",
+				ZAP_ENV_INT(ZAP_THRSTAT_WINDOW));
+	if (rc)
+		goto err1;
+	thr->efd = epoll_create1(O_CLOEXEC);
+	if (thr->efd < 0)
+		goto err2;
+	rc = pthread_create(&thr->zap_io_thread.thread, NULL,
+			    io_thread_proc, thr);
+	if (rc)
+		goto err3;
+	pthread_setname_np(thr->zap_io_thread.thread, "zap_shm_io");
+	return &thr->zap_io_thread;
+ err3:
+	close(thr->efd);
+ err2:
+	zap_io_thread_release(&thr->zap_io_thread);
+ err1:
+	free(thr);
+ err0:
+	errno = ZAP_ERR_RESOURCE;
+	return NULL;
+}
+
+static zap_err_t z_shm_io_thread_cancel(zap_io_thread_t t)
+{
+	int rc;
+	rc = pthread_cancel(t->thread);
+	switch (rc) {
+	case ESRCH: /* cleaning up structure w/o running thread b/c of fork */
+		((z_shm_io_thread_t)t)->efd = -1; /* b/c of CLOEXEC */
+		io_thread_cleanup(t);
+	case 0:
+		return ZAP_ERR_OK;
+	default:
+		return ZAP_ERR_LOCAL_OPERATION;
+	}
+}
+
+static zap_err_t z_shm_io_thread_ep_assign(zap_io_thread_t t, zap_ep_t ep)
+{
+	z_shm_io_thread_t thr = (void *)t;
+	struct z_shm_ep *sep = (void *)ep;
+	struct epoll_event ev = {
+		.events = EPOLLIN | EPOLLRDHUP,
+		.data.ptr = &sep->sock_evh,
+	};
+
+	/*
+	 * The bell goes first: once the socket is in, the thread may process
+	 * the CONNECT message of a passive endpoint and arm its bell.
+	 */
+	if (sep->bell >= 0 && __shm_bell_arm(sep))
+		return ZAP_ERR_RESOURCE;
+	if (epoll_ctl(thr->efd, EPOLL_CTL_ADD, sep->sock, &ev)) {
+		if (sep->bell_armed) {
+			epoll_ctl(thr->efd, EPOLL_CTL_DEL, sep->bell, NULL);
+			sep->bell_armed = 0;
+		}
+		return ZAP_ERR_RESOURCE;
+	}
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t z_shm_io_thread_ep_release(zap_io_thread_t t, zap_ep_t ep)
+{
+	z_shm_io_thread_t thr = (void *)t;
+	struct z_shm_ep *sep = (void *)ep;
+	int rc;
+
+	if (sep->bell_armed) {
+		epoll_ctl(thr->efd, EPOLL_CTL_DEL, sep->bell, NULL);
+		sep->bell_armed = 0;
+	}
+	rc = epoll_ctl(thr->efd, EPOLL_CTL_DEL, sep->sock, NULL);
+	return rc ? ZAP_ERR_RESOURCE : ZAP_ERR_OK;
+}
+
+zap_err_t zap_transport_get(zap_t *pz, zap_log_fn_t log_fn,
+			    zap_mem_info_fn_t mem_info_fn)
+{
+	zap_t z;
+	size_t sz;
+
+	z = calloc(1, sizeof (*z));
+	if (!z)
+		return ZAP_ERR_RESOURCE;
+
+	/* a record must always fit, see __shm_put() */
+	sz = ZAP_ENV_INT(ZAP_SHM_RING_SZ);
+	if (sz < 4 * ZAP_SHM_MAX_MSG)
+		sz = 4 * ZAP_SHM_MAX_MSG;
+	z_shm_ring_sz = 1;
+	while (z_shm_ring_sz < sz)
+		z_shm_ring_sz <<= 1;
+
+	z->max_msg = ZAP_SHM_MAX_MSG;
+	z->new = z_shm_new;
+	z->destroy = z_shm_destroy;
+	z->connect = z_shm_connect;
+	z->accept = z_shm_accept;
+	z->reject = z_shm_reject;
+	z->listen = z_shm_listen;
+	z->close = z_shm_close;
+	z->send = z_shm_send;
+	z->read = z_shm_read;
+	z->readv = z_shm_readv;
+	z->write = z_shm_write;
+	z->unmap = z_shm_unmap;
+	z->share = z_shm_share;
+	z->get_name = z_shm_get_name;
+	z->send_mapped = z_shm_send_mapped;
+	z->io_thread_create = z_shm_io_thread_create;
+	z->io_thread_cancel = z_shm_io_thread_cancel;
+	z->io_thread_ep_assign = z_shm_io_thread_ep_assign;
+	z->io_thread_ep_release = z_shm_io_thread_ep_release;
+	z->mem_info_fn = mem_info_fn;
+
+	*pz = z;
+	return ZAP_ERR_OK;
+}
@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2010-2020 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2010-2020 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ZAP_SHM_H__
+#define __ZAP_SHM_H__
+#include <sys/queue.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "ovis-ldms-config.h"
+#include "zap.h"
+#include "zap_priv.h"
+
+/*
+ * The zap_shm transport connects two processes on the same host.
+ *
+ * The connection is set up over an AF_UNIX SOCK_SEQPACKET socket in the
+ * abstract namespace, named after the port of the address given to
+ * zap_listen()/zap_connect(). The handshake hands the peer (SCM_RIGHTS):
+ *
+ *   - the channel memfd holding the two message rings (connector only),
+ *   - the two doorbell eventfds (connector only), and
+ *   - the memfd backing the process heap reported by the mem_info
+ *     callback, if any.
+ *
+ * After that the socket only carries the disconnect. Send/receive and
+ * rendezvous messages go through the rings. zap_read()/zap_write() are
+ * memcpy() to/from the mapped peer heap. They fail with
+ * ZAP_ERR_REMOTE_PERMISSION for memory outside of it, e.g. if the peer does
+ * not share its heap (see MMALLOC_SHARED in mmalloc.h).
+ *
+ * Each ring has a single producer (the sending endpoint, under ep.lock)
+ * and a single consumer (the I/O thread of the receiving endpoint). The
+ * producer rings the doorbell only if the consumer announced that it is
+ * going to sleep, so a busy connection moves messages without syscalls.
+ */
+
+#define ZAP_SHM_SIG "ZAP_SHM"
+
+/**
+ * \brief The size of each message ring in bytes (rounded up to a power of
+ * 2). The environment variable of the same name overrides it.
+ */
+#define ZAP_SHM_RING_SZ (4 * 1024 * 1024)
+
+/** The largest send/receive message */
+#define ZAP_SHM_MAX_MSG (1024 * 1024)
+
+#define ZAP_SHM_EV_SIZE 1024
+
+/** The largest handshake message (see struct z_shm_ctrl) */
+#define ZAP_SHM_CTRL_MAX (64 * 1024)
+
+/** The abstract socket name prefix, followed by the port */
+#define ZAP_SHM_SOCK_PREFIX "ovis-zap-shm."
+
+typedef enum z_shm_ctrl_type {
+	Z_SHM_CTRL_CONNECT = 1,	 /* chan, bells[2], heap fd (optional) */
+	Z_SHM_CTRL_ACCEPTED,	 /* heap fd (optional) */
+	Z_SHM_CTRL_REJECTED,
+	Z_SHM_CTRL_ACK_ACCEPTED,
+	Z_SHM_CTRL_LAST,
+} z_shm_ctrl_type_t;
+
+/**
+ * Handshake message over the socket. Both ends are on the same host, so
+ * everything is in host byte order.
+ */
+struct z_shm_ctrl {
+	char sig[8];
+	struct zap_version ver;
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t data_len;
+	uint64_t heap_start;	/* 0 if no heap fd attached */
+	uint64_t heap_len;	/* the size the heap may grow to */
+	uint64_t ring_sz;	/* CONNECT only */
+	char data[];
+};
+
+typedef enum z_shm_rec_type {
+	Z_SHM_REC_PAD = 1,	/* filler up to the end of the ring */
+	Z_SHM_REC_SENDRECV,
+	Z_SHM_REC_RENDEZVOUS,
+} z_shm_rec_type_t;
+
+/** A ring record, padded to 8 bytes */
+struct z_shm_rec {
+	uint32_t len;		/* payload length */
+	uint16_t type;
+	uint16_t reserved;
+	char data[];
+};
+
+#define Z_SHM_REC_ALIGN(len) (((len) + sizeof(struct z_shm_rec) + 7) & ~7UL)
+
+struct z_shm_rendezvous {
+	uint64_t addr;
+	uint64_t len;
+	uint32_t acc;
+	uint32_t msg_len;
+	char msg[];
+};
+
+/**
+ * A message ring. \c head and \c tail are free running byte counters kept
+ * on separate cache lines.
+ */
+struct z_shm_ring {
+	uint64_t head;		/* written by the consumer */
+	char _pad0[56];
+	uint64_t tail;		/* written by the producer */
+	char _pad1[56];
+	uint32_t rx_sleep;	/* the consumer wants the doorbell */
+	uint32_t tx_wait;	/* the producer waits for space */
+	char _pad2[56];
+	char data[];
+};
+
+#define Z_SHM_CHAN_SZ(ring_sz) (2 * (sizeof(struct z_shm_ring) + (ring_sz)))
+
+/** Completion of a local operation, delivered by the I/O thread */
+struct z_shm_io {
+	TAILQ_ENTRY(z_shm_io) link;
+	enum zap_event_type type;
+	zap_err_t status;
+	void *ctxt;
+};
+
+/** A message that did not fit in the ring */
+struct z_shm_txe {
+	TAILQ_ENTRY(z_shm_txe) link;
+	uint16_t type;
+	uint32_t len;
+	char data[];
+};
+
+struct z_shm_ep;
+
+/** epoll_event.data.ptr of the endpoint file descriptors */
+struct z_shm_evh {
+	void (*fn)(struct z_shm_ep *sep, uint32_t events);
+	struct z_shm_ep *sep;
+};
+
+struct z_shm_ep {
+	struct zap_ep ep;
+
+	int sock;		/* handshake / disconnect socket */
+	int bell;		/* our doorbell */
+	int peer_bell;		/* the doorbell of the peer */
+	pid_t peer_pid;
+
+	char *conn_data;
+	size_t conn_data_len;
+	int app_accepted;
+	int conn_req;		/* CONNECT_REQUEST delivered to the app */
+	int conn_ref;		/* holding the "accept/connect" reference */
+	int bell_armed;		/* bell added to the I/O thread */
+	int cq_closed;		/* no more completions (disconnected) */
+	int heap_warned;	/* logged an access outside the peer heap */
+
+	void *chan;		/* mapped channel memfd */
+	size_t ring_sz;
+	struct z_shm_ring *rx;
+	struct z_shm_ring *tx;
+
+	char *peer_heap;	/* mapped heap of the peer, or NULL */
+	uint64_t peer_heap_start; /* its address in the peer */
+	size_t peer_heap_len;	/* the mapped range the heap may grow to */
+	size_t peer_heap_size;	/* the part of it backed by the memfd */
+	int peer_heap_fd;
+
+	struct sockaddr_in local_sa;
+	struct sockaddr_in remote_sa;
+
+	struct z_shm_evh sock_evh;
+	struct z_shm_evh bell_evh;
+
+	TAILQ_HEAD(, z_shm_io) cq;	/* completions to deliver */
+	TAILQ_HEAD(, z_shm_io) io_free;
+	TAILQ_HEAD(, z_shm_txe) txq;	/* waiting for ring space */
+	pthread_cond_t txq_cond;
+};
+
+typedef struct z_shm_io_thread {
+	struct zap_io_thread zap_io_thread;
+	int efd; /* epoll fd */
+	struct epoll_event ev[ZAP_SHM_EV_SIZE];
+} *z_shm_io_thread_t;
+
+#endif
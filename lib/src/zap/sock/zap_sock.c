@@ -62,6 +62,7 @@
 #include <assert.h>
 #include <endian.h>
 #include <signal.h>
+#include <poll.h>
 #include "coll/rbt.h"
 #include "ovis_util/os_util.h"
 
@@ -95,6 +96,7 @@
 #endif
 
 static int init_complete = 0;
+static int z_sock_recv_direct_min; /* see ZAP_SOCK_RECV_DIRECT_MIN */
 
 static void *io_thread_proc(void *arg);
 
@@ -109,6 +111,10 @@ static int __enable_epoll_out(struct z_sock_ep *sep);
 
 static void sock_ev_cb(struct epoll_event *ev);
 
+static struct z_sock_send_wr_s *__sock_wr_alloc(size_t data_len, struct z_sock_io *io);
+static void __sock_wr_free(struct z_sock_send_wr_s *wr);
+static void __wr_post(struct z_sock_ep *sep, z_sock_send_wr_t wr);
+
 static zap_err_t __sock_send_msg(struct z_sock_ep *sep, struct sock_msg_hdr *m,
 				 size_t msg_size,
 				 const char *data, size_t data_len);
@@ -201,6 +207,29 @@ out:
 	pthread_mutex_unlock(&z_key_tree_mutex);
 }
 
+/*
+ * Take a reference on the map of a key unless the map is being unmapped.
+ *
+ * zap_unmap() drops the last reference before z_sock_unmap() deletes the
+ * key, so a key found in the tree may belong to a map whose reference
+ * count is already 0. The map is not freed before its key is deleted,
+ * which needs z_key_tree_mutex, so it can be read here.
+ *
+ * The Caller must hold the z_key_tree_mutex lock.
+ */
+static zap_map_t z_sock_key_map_get(struct z_sock_key *k)
+{
+	zap_map_t map = (zap_map_t)k->map;
+	uint32_t ref = __atomic_load_n(&map->ref_count, __ATOMIC_ACQUIRE);
+	do {
+		if (!ref)
+			return NULL;
+	} while (!__atomic_compare_exchange_n(&map->ref_count, &ref, ref + 1,
+					      0, __ATOMIC_ACQ_REL,
+					      __ATOMIC_ACQUIRE));
+	return map;
+}
+
 /**
  * Validate access by map key.
  *
@@ -217,9 +246,43 @@ static int z_sock_map_key_access_validate(uint32_t key, char *p, size_t sz,
 	struct z_sock_key *k = z_sock_key_find(key);
 	if (!k)
 		return ENOENT;
+	if (!__atomic_load_n(&((zap_map_t)k->map)->ref_count, __ATOMIC_ACQUIRE))
+		return ENOENT; /* being unmapped */
 	return z_map_access_validate((zap_map_t)k->map, p, sz, acc);
 }
 
+/**
+ * Validate access by map key like z_sock_map_key_access_validate() and,
+ * on success, take a reference on the map. The work request sending the
+ * mapped data holds it until the data is on the wire. The owner of the
+ * memory must not free it while the map is referenced; see
+ * zap_map_free_fn_set(). A map that is being unmapped is treated as
+ * not found.
+ *
+ * The Caller must hold the z_key_tree_mutex lock.
+ */
+static int z_sock_map_key_get(uint32_t key, char *p, size_t sz,
+			      zap_access_t acc, zap_map_t *pmap)
+{
+	struct z_sock_key *k = z_sock_key_find(key);
+	zap_map_t map;
+	int rc;
+	if (!k)
+		return ENOENT;
+	rc = z_map_access_validate((zap_map_t)k->map, p, sz, acc);
+	if (rc)
+		return rc;
+	/*
+	 * Validate before taking the reference: putting it back here could
+	 * drop the last one and delete the key under z_key_tree_mutex.
+	 */
+	map = z_sock_key_map_get(k);
+	if (!map)
+		return ENOENT;
+	*pmap = map;
+	return 0;
+}
+
 static int __sock_nonblock(int fd)
 {
 	int rc;
@@ -474,6 +537,8 @@ static void process_sep_msg_connect(struct z_sock_ep *sep)
 		return;
 	}
 
+	sep->peer_flags = ntohs(msg->hdr.reserved);
+
 	struct zap_event ev = {
 		.type = ZAP_EVENT_CONNECT_REQUEST,
 		.data = (void*)msg->data,
@@ -503,6 +568,7 @@ static void process_sep_msg_accepted(struct z_sock_ep *sep)
 		goto err;
 
 	msg = sep->buff.data;
+	sep->peer_flags = ntohs(msg->hdr.reserved);
 
 	ev.type = ZAP_EVENT_CONNECTED;
 	ev.status = ZAP_ERR_OK;
@@ -591,6 +657,26 @@ static void process_sep_msg_sendrecv(struct z_sock_ep *sep)
 	sep->ep.cb(&sep->ep, &ev);
 }
 
+/*
+ * Convert the result of z_sock_map_key_access_validate() into the status
+ * carried by a read response.
+ */
+static uint16_t z_sock_read_status(int rc)
+{
+	switch (rc) {
+	case 0:	/* OK */
+		return 0;
+	case EACCES:
+		return htons(ZAP_ERR_REMOTE_PERMISSION);
+	case ERANGE:
+		return htons(ZAP_ERR_REMOTE_LEN);
+	case ENOENT:
+		return htons(ZAP_ERR_REMOTE_MAP);
+	default:
+		return htons(ZAP_ERR_PARAMETER);
+	}
+}
+
 /**
  * Receiving a read request message.
  */
@@ -598,10 +684,11 @@ static void process_sep_msg_read_req(struct z_sock_ep *sep)
 {
 	/* unpack received message */
 	struct sock_msg_read_req *msg;
+	struct sock_msg_read_resp *rmsg;
+	z_sock_send_wr_t wr;
 	uint32_t data_len;
 	char *src;
-	struct sock_msg_read_resp rmsg;
-	memset(&(rmsg), 0, sizeof(rmsg));
+	int rc;
 
 	msg = sep->buff.data;
 
@@ -609,54 +696,87 @@ static void process_sep_msg_read_req(struct z_sock_ep *sep)
 	data_len = ntohl(msg->data_len);
 	src = (char *)be64toh(msg->src_ptr);
 
-	int rc = 0;
-	pthread_mutex_lock(&z_key_tree_mutex);
-	rc = z_sock_map_key_access_validate(msg->src_map_key, src, data_len,
-				       ZAP_ACCESS_READ);
-	pthread_mutex_unlock(&z_key_tree_mutex);
+	wr = __sock_wr_alloc(0, NULL);
+	if (!wr) {
+		shutdown(sep->sock, SHUT_RDWR);
+		return;
+	}
+	rmsg = &wr->msg.read_resp;
+
 	/*
-	 * The data the other side receives could be garbage
-	 * if the map is deleted after this point.
+	 * The response points into the map rather than copying the data;
+	 * the map reference keeps the map until the data has been sent.
 	 */
-	switch (rc) {
-	case 0:	/* OK */
-		rmsg.status = 0;
-		break;
-	case EACCES:
-		rmsg.status = htons(ZAP_ERR_REMOTE_PERMISSION);
-		break;
-	case ERANGE:
-		rmsg.status = htons(ZAP_ERR_REMOTE_LEN);
-		break;
-	case ENOENT:
-		rmsg.status = htons(ZAP_ERR_REMOTE_MAP);
-		break;
-	default:
-		rmsg.status = htons(ZAP_ERR_PARAMETER);
-		break;
-	}
+	pthread_mutex_lock(&z_key_tree_mutex);
+	rc = z_sock_map_key_get(msg->src_map_key, src, data_len,
+				ZAP_ACCESS_READ, &wr->map);
+	pthread_mutex_unlock(&z_key_tree_mutex);
+	rmsg->status = z_sock_read_status(rc);
 	if (rc)
-		rmsg.data_len = data_len = 0;
+		rmsg->data_len = data_len = 0;
 	else
-		rmsg.data_len = msg->data_len; /* Still in BE */
+		rmsg->data_len = msg->data_len; /* Still in BE */
 
-	z_sock_hdr_init(&rmsg.hdr, msg->hdr.xid, SOCK_MSG_READ_RESP, sizeof(rmsg) + data_len, msg->hdr.ctxt);
-	if (__sock_send_msg(sep, &rmsg.hdr, sizeof(rmsg), src, data_len))
-		shutdown(sep->sock, SHUT_RDWR);
+	z_sock_hdr_init(&rmsg->hdr, msg->hdr.xid, SOCK_MSG_READ_RESP,
+			sizeof(*rmsg) + data_len, msg->hdr.ctxt);
+	wr->msg_len = sizeof(*rmsg);
+	wr->data = src;
+	wr->data_len = data_len;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	DEBUG_LOG_SEND_MSG(sep, &rmsg->hdr);
+	__wr_post(sep, wr);
+	pthread_mutex_unlock(&sep->ep.lock);
 }
 
-struct z_sock_send_wr_s *__sock_wr_alloc(size_t data_len, struct z_sock_io *io)
+static pthread_mutex_t z_wr_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static TAILQ_HEAD(, z_sock_send_wr_s) z_wr_pool = TAILQ_HEAD_INITIALIZER(z_wr_pool);
+static int z_wr_pool_count;
+
+static struct z_sock_send_wr_s *__sock_wr_alloc(size_t data_len, struct z_sock_io *io)
 {
 	struct z_sock_send_wr_s *wr;
-	wr = calloc(1, sizeof(*wr) + data_len);
-	if (!wr)
-		return NULL;
+
+	if (data_len > Z_SOCK_WR_POOL_SZ) {
+		wr = calloc(1, sizeof(*wr) + data_len);
+		if (!wr)
+			return NULL;
+		wr->io = io;
+		return wr;
+	}
+
+	pthread_mutex_lock(&z_wr_pool_lock);
+	wr = TAILQ_FIRST(&z_wr_pool);
+	if (wr) {
+		TAILQ_REMOVE(&z_wr_pool, wr, link);
+		z_wr_pool_count--;
+	}
+	pthread_mutex_unlock(&z_wr_pool_lock);
+	if (wr) {
+		memset(wr, 0, sizeof(*wr));
+	} else {
+		wr = calloc(1, sizeof(*wr) + Z_SOCK_WR_POOL_SZ);
+		if (!wr)
+			return NULL;
+	}
+	wr->pooled = 1;
 	wr->io = io;
 	return wr;
 }
 
-void __sock_wr_free(struct z_sock_send_wr_s *wr)
+static void __sock_wr_free(struct z_sock_send_wr_s *wr)
 {
+	if (wr->map)
+		zap_unmap(wr->map);
+	if (wr->pooled) {
+		pthread_mutex_lock(&z_wr_pool_lock);
+		if (z_wr_pool_count < Z_SOCK_WR_POOL_MAX) {
+			TAILQ_INSERT_HEAD(&z_wr_pool, wr, link);
+			z_wr_pool_count++;
+			wr = NULL;
+		}
+		pthread_mutex_unlock(&z_wr_pool_lock);
+	}
 	free(wr);
 }
 
@@ -671,11 +791,13 @@ struct z_sock_io *__sock_io_alloc(struct z_sock_ep *sep)
 static inline
 void __sock_io_free(struct z_sock_ep *sep, struct z_sock_io *io)
 {
+	free(io->iov);
 	free(io);
 }
 
 /**
- * Receiving a read response message.
+ * Receiving a read response message. If the payload was received directly
+ * (see __recv_direct_setup()), it is already in the destination.
  */
 static void process_sep_msg_read_resp(struct z_sock_ep *sep)
 {
@@ -707,7 +829,9 @@ static void process_sep_msg_read_resp(struct z_sock_ep *sep)
 					   data_len, 0);
 		switch (rc) {
 		case 0:
-			memcpy(io->dst_ptr, msg->data, data_len);
+			/* already there if received directly */
+			if (sep->rx_mode != Z_SOCK_RX_DIRECT)
+				memcpy(io->dst_ptr, msg->data, data_len);
 			break;
 		case EACCES:
 			rc = ZAP_ERR_LOCAL_PERMISSION;
@@ -731,6 +855,175 @@ static void process_sep_msg_read_resp(struct z_sock_ep *sep)
 	sep->ep.cb((void*)sep, &ev);
 }
 
+/**
+ * Receiving a vectored read request message.
+ *
+ * The response header carries the status of every entry. It is followed by
+ * the data of the accessible entries, each posted as its own work request
+ * pointing into the map so that nothing is copied (like READ_RESP).
+ * sock_write() gathers them into as few sendmsg() calls as possible.
+ */
+static void process_sep_msg_readv_req(struct z_sock_ep *sep)
+{
+	struct sock_msg_readv_req *msg;
+	struct sock_msg_readv_resp *rmsg;
+	struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = sep };
+	TAILQ_HEAD(, z_sock_send_wr_s) wrq = TAILQ_HEAD_INITIALIZER(wrq);
+	z_sock_send_wr_t wr, dwr;
+	uint32_t i, count, data_len;
+	size_t msg_len, total = 0;
+	zap_map_t map;
+	char *src;
+	int rc;
+
+	msg = sep->buff.data;
+	count = ntohl(msg->count);
+	msg_len = sizeof(*msg) + count * sizeof(msg->ent[0]);
+	if (!count || count > Z_SOCK_READV_MAX ||
+	    msg_len > ntohl(msg->hdr.msg_len)) {
+		LOG_(sep, "Bad vectored read request, count %u.\n", count);
+		process_sep_read_error(sep);
+		return;
+	}
+
+	msg_len = sizeof(*rmsg) + count * sizeof(rmsg->ent[0]);
+	wr = __sock_wr_alloc(msg_len, NULL);
+	if (!wr)
+		goto err;
+	rmsg = &wr->msg.readv_resp;
+	pthread_mutex_lock(&z_key_tree_mutex);
+	for (i = 0; i < count; i++) {
+		data_len = ntohl(msg->ent[i].data_len);
+		src = (char *)be64toh(msg->ent[i].src_ptr);
+		if (msg_len + total + data_len > UINT32_MAX)
+			rc = ERANGE;
+		else if (!data_len)
+			rc = z_sock_map_key_access_validate(msg->ent[i].src_map_key,
+						src, data_len, ZAP_ACCESS_READ);
+		else
+			rc = z_sock_map_key_get(msg->ent[i].src_map_key, src,
+						data_len, ZAP_ACCESS_READ, &map);
+		rmsg->ent[i].status = z_sock_read_status(rc);
+		rmsg->ent[i].reserved = 0;
+		if (rc || !data_len) {
+			rmsg->ent[i].data_len = 0;
+			continue;
+		}
+		dwr = __sock_wr_alloc(0, NULL);
+		if (!dwr) {
+			pthread_mutex_unlock(&z_key_tree_mutex);
+			zap_unmap(map);
+			goto err;
+		}
+		dwr->map = map;
+		dwr->data = src;
+		dwr->data_len = data_len;
+		TAILQ_INSERT_TAIL(&wrq, dwr, link);
+		rmsg->ent[i].data_len = msg->ent[i].data_len; /* Still in BE */
+		total += data_len;
+	}
+	pthread_mutex_unlock(&z_key_tree_mutex);
+
+	z_sock_hdr_init(&rmsg->hdr, msg->hdr.xid, SOCK_MSG_READV_RESP,
+			msg_len + total, msg->hdr.ctxt);
+	rmsg->count = msg->count; /* Still in BE */
+	wr->msg_len = msg_len;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	DEBUG_LOG_SEND_MSG(sep, &rmsg->hdr);
+	TAILQ_INSERT_TAIL(&sep->sq, wr, link);
+	TAILQ_CONCAT(&sep->sq, &wrq, link);
+	sock_write(&ev);
+	pthread_mutex_unlock(&sep->ep.lock);
+	return;
+
+ err:
+	while ((dwr = TAILQ_FIRST(&wrq))) {
+		TAILQ_REMOVE(&wrq, dwr, link);
+		__sock_wr_free(dwr);
+	}
+	if (wr)
+		__sock_wr_free(wr);
+	shutdown(sep->sock, SHUT_RDWR);
+}
+
+/**
+ * Receiving a vectored read response message.
+ */
+static void process_sep_msg_readv_resp(struct z_sock_ep *sep)
+{
+	struct z_sock_io *io;
+	struct z_sock_io_iov *iov;
+	struct sock_msg_readv_resp *msg;
+	uint32_t i, count, data_len;
+	char *data, *end;
+	int rc = 0, erc;
+
+	msg = sep->buff.data;
+
+	/* Get the matching request from the io_q */
+	pthread_mutex_lock(&sep->ep.lock);
+	io = TAILQ_FIRST(&sep->io_q);
+	ZAP_ASSERT(io, (&sep->ep), "%s: The io_q is empty.\n", __func__);
+	ZAP_ASSERT(msg->hdr.xid == io->xid, (&sep->ep),
+			"%s: The transaction IDs mismatched between the "
+			"IO entry %d and message %d.\n", __func__,
+			io->xid, msg->hdr.xid);
+	TAILQ_REMOVE(&sep->io_q, io, q_link);
+
+	count = ntohl(msg->count);
+	end = (char *)msg + ntohl(msg->hdr.msg_len);
+	data = (char *)&msg->ent[count];
+	if (count != io->iovcnt || data > end) {
+		rc = ZAP_ERR_TRANSPORT;
+		goto out;
+	}
+	for (i = 0; i < count; i++) {
+		iov = &io->iov[i];
+		erc = ntohs(msg->ent[i].status);
+		data_len = ntohl(msg->ent[i].data_len);
+		if (erc)
+			goto next;
+		if (data_len > end - data) {
+			erc = ZAP_ERR_TRANSPORT;
+			rc = rc ? rc : erc;
+			break;
+		}
+		/* Validate the local destination like the single read */
+		erc = z_map_access_validate(iov->dst_map, iov->dst_ptr,
+					    data_len, 0);
+		if (!erc && data_len > iov->len)
+			erc = ERANGE;
+		switch (erc) {
+		case 0:
+			if (sep->rx_mode != Z_SOCK_RX_DIRECT)
+				memcpy(iov->dst_ptr, data, data_len);
+			break;
+		case EACCES:
+			erc = ZAP_ERR_LOCAL_PERMISSION;
+			break;
+		case ERANGE:
+			erc = ZAP_ERR_LOCAL_LEN;
+			break;
+		}
+		data += data_len;
+	next:
+		if (erc && !rc)
+			rc = erc;
+	}
+ out:
+	assert( io->ctxt == (void*)msg->hdr.ctxt );
+	__sock_io_free(sep, io);
+	pthread_mutex_unlock(&sep->ep.lock);
+
+	struct zap_event ev = {
+		.type = ZAP_EVENT_READ_COMPLETE,
+		.status = rc,
+		.context = (void*) msg->hdr.ctxt
+	};
+	sep->ep.cb((void*)sep, &ev);
+}
+
 static uint32_t g_xid = 0;
 static void
 z_sock_hdr_init(struct sock_msg_hdr *hdr, uint32_t xid,
@@ -870,6 +1163,218 @@ err0:
 	return;
 }
 
+/*
+ * read(2) from the socket or, in io_uring mode, from the data of the
+ * receive completion being processed.
+ */
+static ssize_t __sock_recv(struct z_sock_ep *sep, void *buf, size_t len)
+{
+	if (!sep->uring)
+		return read(sep->sock, buf, len);
+	if (!sep->rx_ub_len) {
+		if (sep->rx_ub_eof)
+			return 0;
+		errno = EAGAIN;
+		return -1;
+	}
+	if (len > sep->rx_ub_len)
+		len = sep->rx_ub_len;
+	memcpy(buf, sep->rx_ub, len);
+	sep->rx_ub += len;
+	sep->rx_ub_len -= len;
+	return len;
+}
+
+/* readv(2) counterpart of __sock_recv() */
+static ssize_t __sock_recvv(struct z_sock_ep *sep, struct iovec *iov, int cnt)
+{
+	ssize_t rsz, sz = 0;
+	int i;
+
+	if (!sep->uring)
+		return readv(sep->sock, iov, cnt);
+	for (i = 0; i < cnt; i++) {
+		rsz = __sock_recv(sep, iov[i].iov_base, iov[i].iov_len);
+		if (rsz <= 0)
+			return sz ? sz : rsz;
+		sz += rsz;
+		if (rsz < iov[i].iov_len)
+			break;
+	}
+	return sz;
+}
+
+/*
+ * Receive the current message into buff until it holds `len` bytes.
+ * Returns 0 when it does, EAGAIN if the socket has no more data for now,
+ * or an error.
+ */
+static int __recv_fill(struct z_sock_ep *sep, size_t len)
+{
+	z_sock_buff_t buff = &sep->buff;
+	ssize_t rsz, rqsz;
+	int rc;
+
+	if (buff->len >= len)
+		return 0;
+	if (len > buff->len + buff->alen) {
+		rc = z_sock_buff_extend(buff, ((len - 1) | 0xFFFF) + 1);
+		if (rc)
+			return rc;
+	}
+	rqsz = len - buff->len;
+	rsz = __sock_recv(sep, buff->data + buff->len, rqsz);
+	if (rsz == 0)
+		return ENOTCONN; /* peer close */
+	if (rsz < 0)
+		return errno;
+	buff->len += rsz;
+	buff->alen -= rsz;
+	return (rsz < rqsz)?EAGAIN:0;
+}
+
+static int __rx_iov_add(struct z_sock_ep *sep, char *ptr, size_t len)
+{
+	struct iovec *iov;
+	int n;
+
+	if (sep->rx_cnt == sep->rx_alloc) {
+		n = sep->rx_alloc ? 2 * sep->rx_alloc : 16;
+		iov = realloc(sep->rx_iov, n * sizeof(*iov));
+		if (!iov)
+			return ENOMEM;
+		sep->rx_iov = iov;
+		sep->rx_alloc = n;
+	}
+	sep->rx_iov[sep->rx_cnt].iov_base = ptr;
+	sep->rx_iov[sep->rx_cnt].iov_len = len;
+	sep->rx_cnt++;
+	sep->rx_left += len;
+	return 0;
+}
+
+/*
+ * Decide how to receive the read response whose header is in buff.
+ *
+ * The fixed part of the response (the status and lengths) is received
+ * into buff. If the payload has a valid local destination in the
+ * matching request, it is then received directly into that memory and
+ * rx_mode becomes Z_SOCK_RX_DIRECT. Anything unusual (an error status,
+ * a destination failing validation, inconsistent lengths) makes the
+ * whole message go through buff so that the process function handles
+ * it as before.
+ *
+ * Returns EAGAIN if the fixed part is not complete yet.
+ */
+static int __recv_direct_setup(struct z_sock_ep *sep, int mtype, uint32_t mlen)
+{
+	sock_msg_t msg;
+	struct z_sock_io *io;
+	struct sock_readv_resp_ent *ent;
+	size_t fixed;
+	uint32_t i, count = 0, data_len;
+	int rc;
+
+	sep->rx_mode = Z_SOCK_RX_BUFFERED;
+	sep->rx_cnt = sep->rx_cur = 0;
+	sep->rx_left = 0;
+	if (mtype == SOCK_MSG_READ_RESP)
+		fixed = sizeof(msg->read_resp);
+	else
+		fixed = sizeof(msg->readv_resp);
+	if (mlen < fixed)
+		return 0;
+	rc = __recv_fill(sep, fixed);
+	if (rc)
+		goto again;
+	msg = sep->buff.data;
+	if (mtype == SOCK_MSG_READV_RESP) {
+		count = ntohl(msg->readv_resp.count);
+		if (!count || count > Z_SOCK_READV_MAX)
+			return 0;
+		fixed += count * sizeof(msg->readv_resp.ent[0]);
+		if (mlen < fixed)
+			return 0;
+		rc = __recv_fill(sep, fixed);
+		if (rc)
+			goto again;
+		msg = sep->buff.data;
+	}
+
+	pthread_mutex_lock(&sep->ep.lock);
+	io = TAILQ_FIRST(&sep->io_q);
+	if (!io || io->xid != msg->hdr.xid)
+		goto buffered;
+	if (mtype == SOCK_MSG_READ_RESP) {
+		data_len = ntohl(msg->read_resp.data_len);
+		if (msg->read_resp.status || io->iov || fixed + data_len != mlen)
+			goto buffered;
+		if (z_map_access_validate(io->dst_map, io->dst_ptr, data_len, 0))
+			goto buffered;
+		if (__rx_iov_add(sep, io->dst_ptr, data_len))
+			goto buffered;
+	} else {
+		if (count != io->iovcnt)
+			goto buffered;
+		for (i = 0; i < count; i++) {
+			ent = &msg->readv_resp.ent[i];
+			data_len = ntohl(ent->data_len);
+			if (ent->status || !data_len)
+				continue;
+			if (data_len > io->iov[i].len ||
+			    z_map_access_validate(io->iov[i].dst_map,
+						  io->iov[i].dst_ptr,
+						  data_len, 0))
+				goto buffered;
+			if (__rx_iov_add(sep, io->iov[i].dst_ptr, data_len))
+				goto buffered;
+		}
+		if (fixed + sep->rx_left != mlen)
+			goto buffered;
+	}
+	pthread_mutex_unlock(&sep->ep.lock);
+	sep->rx_mode = Z_SOCK_RX_DIRECT;
+	return 0;
+
+ buffered:
+	pthread_mutex_unlock(&sep->ep.lock);
+	sep->rx_cnt = 0;
+	sep->rx_left = 0;
+	return 0;
+ again:
+	sep->rx_mode = Z_SOCK_RX_UNDECIDED;
+	return rc;
+}
+
+/*
+ * Receive the read response payload into the destinations set up by
+ * __recv_direct_setup(). The request stays on io_q until the response is
+ * processed, and io_q is only flushed by this thread, so the destination
+ * memory stays valid while it is being written.
+ */
+static int __recv_direct(struct z_sock_ep *sep)
+{
+	struct iovec *iov = &sep->rx_iov[sep->rx_cur];
+	ssize_t rsz;
+
+	rsz = __sock_recvv(sep, iov, sep->rx_cnt - sep->rx_cur);
+	if (rsz == 0)
+		return ENOTCONN; /* peer close */
+	if (rsz < 0)
+		return errno;
+	sep->rx_left -= rsz;
+	while (rsz && rsz >= iov->iov_len) {
+		rsz -= iov->iov_len;
+		iov++;
+		sep->rx_cur++;
+	}
+	if (rsz) {
+		iov->iov_base = (char *)iov->iov_base + rsz;
+		iov->iov_len -= rsz;
+	}
+	return sep->rx_left?EAGAIN:0;
+}
+
 static int __recv_msg(struct z_sock_ep *sep)
 {
 	int rc;
@@ -883,7 +1388,7 @@ static int __recv_msg(struct z_sock_ep *sep)
 	if (buff->len < sizeof(struct sock_msg_hdr)) {
 		/* need to fill the header first */
 		rqsz = sizeof(struct sock_msg_hdr) - buff->len;
-		rsz = read(sep->sock, buff->data + buff->len, rqsz);
+		rsz = __sock_recv(sep, buff->data + buff->len, rqsz);
 		if (rsz == 0) {
 			/* peer close */
 			rc = ENOTCONN;
@@ -911,7 +1416,8 @@ static int __recv_msg(struct z_sock_ep *sep)
 	mlen = ntohl(hdr->msg_len);
 	mtype = ntohs(hdr->msg_type);
 
-	if (mtype == SOCK_MSG_WRITE_REQ || mtype == SOCK_MSG_READ_RESP) {
+	if (mtype == SOCK_MSG_WRITE_REQ || mtype == SOCK_MSG_READ_RESP ||
+	    mtype == SOCK_MSG_READV_RESP) {
 		/* allow big message */
 	} else {
 		if (mlen > SOCKBUF_SZ) {
@@ -923,6 +1429,20 @@ static int __recv_msg(struct z_sock_ep *sep)
 		}
 	}
 
+	if ((mtype == SOCK_MSG_READ_RESP || mtype == SOCK_MSG_READV_RESP) &&
+	    z_sock_recv_direct_min >= 0 &&
+	    mlen >= (uint32_t)z_sock_recv_direct_min) {
+		if (sep->rx_mode == Z_SOCK_RX_UNDECIDED) {
+			rc = __recv_direct_setup(sep, mtype, mlen);
+			if (rc) {
+				from_line = __LINE__;
+				goto err;
+			}
+		}
+		if (sep->rx_mode == Z_SOCK_RX_DIRECT)
+			return __recv_direct(sep);
+	}
+
 	if (mlen > buff->len + buff->alen) {
 		/* Buffer extension is needed */
 		rqsz = ((mlen - 1) | 0xFFFF) + 1;
@@ -935,7 +1455,7 @@ static int __recv_msg(struct z_sock_ep *sep)
 
 	if (buff->len < mlen) {
 		rqsz = mlen - buff->len;
-		rsz = read(sep->sock, buff->data + buff->len, rqsz);
+		rsz = __sock_recv(sep, buff->data + buff->len, rqsz);
 		if (rsz == 0) {
 			/* peer close */
 			rc = ENOTCONN;
@@ -1056,6 +1576,19 @@ void __log_sep_msg(struct z_sock_ep *sep, int is_recv,
 			ntohl(msg->read_resp.data_len)
 		    );
 		break;
+	case SOCK_MSG_READV_REQ:
+	case SOCK_MSG_READV_RESP:
+		LOG_(sep, "%s: %s, len: %u, xid: %#x, ctxt: %#lx, "
+			"count: %d"
+			"\n",
+			lbl,
+			sock_msg_type_str(mtype),
+			ntohl(hdr->msg_len),
+			hdr->xid,
+			hdr->ctxt,
+			ntohl(msg->readv_req.count)
+		    );
+		break;
 	case SOCK_MSG_WRITE_REQ:
 		LOG_(sep, "%s: %s, len: %u, xid: %#x, ctxt: %#lx, "
 			"dst_map_key: %#x, dst_ptr: %#lx, data_len: %d"
@@ -1100,6 +1633,8 @@ static process_sep_msg_fn_t process_sep_msg_fns[SOCK_MSG_TYPE_LAST] = {
 	[SOCK_MSG_ACCEPTED] = process_sep_msg_accepted,
 	[SOCK_MSG_REJECTED] = process_sep_msg_rejected,
 	[SOCK_MSG_ACK_ACCEPTED] = process_sep_msg_ack_accepted,
+	[SOCK_MSG_READV_REQ] = process_sep_msg_readv_req,
+	[SOCK_MSG_READV_RESP] = process_sep_msg_readv_resp,
 };
 
 static zap_err_t __sock_send_connect(struct z_sock_ep *sep, char *buf, size_t len);
@@ -1200,11 +1735,40 @@ static void sock_send_complete(struct epoll_event *ev)
 }
 
 /* sep->ep.lock is held */
+static void __sock_wr_done(struct z_sock_ep *sep, z_sock_send_wr_t wr)
+{
+	TAILQ_REMOVE(&sep->sq, wr, link);
+	if (wr->flags & Z_SOCK_WR_COMPLETION) {
+		/* right now we have only SEND_COMPLETE delivering by WR */
+		assert(ntohs(wr->msg.hdr.msg_type) == SOCK_MSG_SENDRECV);
+		TAILQ_REMOVE(&sep->io_q, wr->io, q_link);
+		TAILQ_INSERT_TAIL(&sep->io_cq, wr->io, q_link);
+	}
+	if (wr->io) {
+		/* record xid */
+		wr->io->xid = wr->msg.hdr.xid;
+		wr->io->wr = NULL;
+	}
+	__sock_wr_free(wr);
+}
+
+/*
+ * sep->ep.lock is held
+ *
+ * The pending message and data bytes of the queued work requests are
+ * gathered into one iovec array and written with a single sendmsg(), so a
+ * header and the mapped data it describes, or a run of small messages,
+ * cost one system call and no copy.
+ */
 static void sock_write(struct epoll_event *ev)
 {
 	struct z_sock_ep *sep = ev->data.ptr;
+	struct iovec iov[Z_SOCK_SEND_IOV_MAX];
+	struct msghdr mh = { .msg_iov = iov };
 	ssize_t wsz;
+	size_t sz;
 	z_sock_send_wr_t wr;
+	int n;
 
  next:
 	wr = TAILQ_FIRST(&sep->sq);
@@ -1217,58 +1781,57 @@ static void sock_write(struct epoll_event *ev)
 		goto out;
 	}
 
-	/* msg */
-	while (wr->msg_len) {
-		wsz = send(sep->sock, wr->msg.bytes + wr->off, wr->msg_len, MSG_NOSIGNAL);
-		if (wsz < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				__enable_epoll_out(sep);
-				goto out;
-			}
-			/* otherwise, bad error */
-			goto err;
+	/* wr->off is the offset in the msg, or in the data once the msg is out */
+	n = 0;
+	for (; wr && n < Z_SOCK_SEND_IOV_MAX - 1; wr = TAILQ_NEXT(wr, link)) {
+		if (wr->msg_len) {
+			iov[n].iov_base = wr->msg.bytes + wr->off;
+			iov[n].iov_len = wr->msg_len;
+			n++;
 		}
-		DEBUG_LOG(sep, "ep: %p, wrote %ld bytes\n", sep, wsz);
-		wr->msg_len -= wsz;
-		if (!wr->msg_len)
-			wr->off = 0; /* reset off for data */
-		else
-			wr->off += wsz;
-	}
-
-	/* data, wr->msg_len is already 0 */
-	assert(wr->msg_len == 0);
-	while (wr->data_len) {
-		wsz = send(sep->sock, wr->data + wr->off, wr->data_len, MSG_NOSIGNAL);
-		if (wsz < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				__enable_epoll_out(sep);
-				goto out;
-			}
-			/* otherwise bad error */
-			goto err;
+		if (wr->data_len) {
+			iov[n].iov_base = (char *)wr->data +
+					  (wr->msg_len ? 0 : wr->off);
+			iov[n].iov_len = wr->data_len;
+			n++;
 		}
-		DEBUG_LOG(sep, "ep: %p, wrote %ld bytes\n", sep, wsz);
-		wr->data_len -= wsz;
-		wr->off += wsz;
 	}
-
-	/* reaching here means wr->data_len and wr->msg_len are 0 */
-	assert(0 == wr->data_len);
-	assert(0 == wr->msg_len);
-	TAILQ_REMOVE(&sep->sq, wr, link);
-	if (wr->flags & Z_SOCK_WR_COMPLETION) {
-		/* right now we have only SEND_COMPLETE delivering by WR */
-		assert(ntohs(wr->msg.hdr.msg_type) == SOCK_MSG_SENDRECV);
-		TAILQ_REMOVE(&sep->io_q, wr->io, q_link);
-		TAILQ_INSERT_TAIL(&sep->io_cq, wr->io, q_link);
+	mh.msg_iovlen = n;
+	wsz = sendmsg(sep->sock, &mh, MSG_NOSIGNAL);
+	if (wsz < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			__enable_epoll_out(sep);
+			goto out;
+		}
+		/* otherwise, bad error */
+		goto err;
 	}
-	if (wr->io) {
-		/* record xid */
-		wr->io->xid = wr->msg.hdr.xid;
-		wr->io->wr = NULL;
+	DEBUG_LOG(sep, "ep: %p, wrote %ld bytes\n", sep, wsz);
+
+	/* consume what was written */
+	while (wsz && (wr = TAILQ_FIRST(&sep->sq))) {
+		if (wr->msg_len) {
+			sz = wsz < wr->msg_len ? wsz : wr->msg_len;
+			wr->msg_len -= sz;
+			wsz -= sz;
+			if (!wr->msg_len)
+				wr->off = 0; /* reset off for data */
+			else
+				wr->off += sz;
+		}
+		if (!wr->msg_len && wr->data_len) {
+			sz = wsz < wr->data_len ? wsz : wr->data_len;
+			wr->data_len -= sz;
+			wr->off += sz;
+			wsz -= sz;
+		}
+		if (wr->msg_len || wr->data_len)
+			break;
+		__sock_wr_done(sep, wr);
 	}
-	__sock_wr_free(wr);
+	/* zero-length wrs at the head are done too */
+	while ((wr = TAILQ_FIRST(&sep->sq)) && !wr->msg_len && !wr->data_len)
+		__sock_wr_done(sep, wr);
 	goto next;
 
  out:
@@ -1349,6 +1912,7 @@ static void sock_read(struct epoll_event *ev)
 			process_sep_read_error(sep);
 		}
 		z_sock_buff_reset(&sep->buff);
+		sep->rx_mode = Z_SOCK_RX_UNDECIDED;
 	} while (1);
 	return;
 
@@ -1361,11 +1925,278 @@ static void sock_read(struct epoll_event *ev)
 	process_sep_read_error(sep);
 }
 
+#ifdef OVIS_LDMS_HAVE_IO_URING
+/*
+ * io_uring mode (ZAP_SOCK_IO_URING)
+ *
+ * The user_data of a request is the endpoint pointer with the request kind
+ * in its low bits. Every armed request holds an endpoint reference that is
+ * dropped with its last completion, so completions arriving after the
+ * endpoint left the thread are still safe to look at.
+ */
+#define Z_URING_OP_RECV 1 /* multishot receive, connections */
+#define Z_URING_OP_POLL 2 /* multishot POLLIN, listening endpoints */
+#define Z_URING_OP_OUT  3 /* one-shot POLLOUT */
+#define Z_URING_OP_MASK 3UL
+
+/* thr->sq_lock is held */
+static struct io_uring_sqe *__uring_sqe(z_sock_io_thread_t thr)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = z_uring_sqe_get(thr->ring);
+	if (sqe)
+		return sqe;
+	/* the queue is full, hand it to the kernel and retry */
+	z_uring_enter(thr->ring, z_uring_sq_pending(thr->ring), 0);
+	return z_uring_sqe_get(thr->ring);
+}
+
+/*
+ * Queue request `op` for `sep`, or a cancellation of it if `cancel` is set.
+ * Requests made by the I/O thread are submitted with its next wait, those
+ * made by other threads are submitted right away.
+ */
+static int __uring_queue(z_sock_io_thread_t thr, struct z_sock_ep *sep,
+			 int op, int cancel)
+{
+	struct io_uring_sqe *sqe;
+	uint64_t ud = (uint64_t)(uintptr_t)sep | op;
+	int rc = 0;
+
+	pthread_mutex_lock(&thr->sq_lock);
+	sqe = __uring_sqe(thr);
+	if (!sqe) {
+		rc = EAGAIN;
+		goto out;
+	}
+	if (cancel) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = ud;
+		sqe->user_data = 0;
+		goto commit;
+	}
+	sqe->fd = sep->sock;
+	sqe->user_data = ud;
+	switch (op) {
+	case Z_URING_OP_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		break;
+	case Z_URING_OP_POLL:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		sqe->len = IORING_POLL_ADD_MULTI;
+		break;
+	case Z_URING_OP_OUT:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLOUT;
+		break;
+	}
+ commit:
+	z_uring_sqe_commit(thr->ring);
+	if (!pthread_equal(pthread_self(), thr->zap_io_thread.thread))
+		z_uring_enter(thr->ring, z_uring_sq_pending(thr->ring), 0);
+ out:
+	pthread_mutex_unlock(&thr->sq_lock);
+	return rc;
+}
+
+static int __uring_arm(z_sock_io_thread_t thr, struct z_sock_ep *sep, int op)
+{
+	int rc;
+
+	ref_get(&sep->ep.ref, "zap_sock:uring");
+	rc = __uring_queue(thr, sep, op, 0);
+	if (rc)
+		ref_put(&sep->ep.ref, "zap_sock:uring");
+	return rc;
+}
+
+/*
+ * Translate a completion into the epoll event the endpoint handler
+ * expects. Received data is handed to sock_read() through sep->rx_ub,
+ * which consumes all of it before returning, so the buffer goes back to
+ * the kernel right away.
+ */
+static void __uring_complete(z_sock_io_thread_t thr, struct io_uring_cqe *cqe)
+{
+	struct z_sock_ep *sep = (void *)(uintptr_t)(cqe->user_data & ~Z_URING_OP_MASK);
+	int op = cqe->user_data & Z_URING_OP_MASK;
+	int res = cqe->res;
+	struct epoll_event ev = { .events = 0, .data.ptr = sep };
+	int bid = -1;
+	int rearm = 0;
+
+	if (!sep)
+		return; /* completion of a cancellation */
+	if (cqe->flags & IORING_CQE_F_BUFFER)
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+	switch (op) {
+	case Z_URING_OP_RECV:
+		if (sep->uring_released)
+			break;
+		if (res > 0) {
+			sep->rx_ub = z_uring_buf(thr->ring, bid);
+			sep->rx_ub_len = res;
+			ev.events = EPOLLIN;
+			rearm = 1;
+		} else if (res == 0) {
+			sep->rx_ub_eof = 1;
+			ev.events = EPOLLIN|EPOLLHUP;
+		} else if (res == -ENOBUFS) {
+			/* out of buffers; the ones in this batch are back by now */
+			rearm = 1;
+		} else {
+			ev.events = EPOLLERR|EPOLLHUP;
+		}
+		if (ev.events)
+			sep->ev_fn(&ev);
+		sep->rx_ub = NULL;
+		sep->rx_ub_len = 0;
+		break;
+	case Z_URING_OP_POLL:
+		if (sep->uring_released || res < 0)
+			break;
+		if (res & POLLIN) {
+			ev.events = EPOLLIN;
+			sep->ev_fn(&ev);
+		}
+		rearm = 1;
+		break;
+	case Z_URING_OP_OUT:
+		pthread_mutex_lock(&sep->ep.lock);
+		sep->uring_out = 0;
+		if (!sep->uring_released && (sep->ev.events & EPOLLOUT)) {
+			/* one-shot; sock_write() re-enables it if needed */
+			sep->ev.events &= ~EPOLLOUT;
+			ev.events = EPOLLOUT;
+		}
+		pthread_mutex_unlock(&sep->ep.lock);
+		if (ev.events)
+			sep->ev_fn(&ev);
+		break;
+	}
+
+	if (bid >= 0)
+		z_uring_buf_recycle(thr->ring, bid);
+	if (cqe->flags & IORING_CQE_F_MORE)
+		return;
+	/* the request is finished */
+	if (rearm && !sep->uring_released && !__uring_queue(thr, sep, op, 0))
+		return; /* the reference moves to the new request */
+	ref_put(&sep->ep.ref, "zap_sock:uring");
+}
+
+static void __uring_thread_loop(z_sock_io_thread_t thr)
+{
+	struct io_uring_cqe *cqe, c;
+	unsigned n;
+	int rc;
+
+	while (1) {
+		/* submit what the last batch queued, then wait */
+		pthread_mutex_lock(&thr->sq_lock);
+		n = z_uring_sq_pending(thr->ring);
+		pthread_mutex_unlock(&thr->sq_lock);
+		zap_thrstat_wait_start(thr->zap_io_thread.stat);
+		/* io_uring_enter() is not a cancellation point */
+		pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+		rc = z_uring_enter(thr->ring, n, 1);
+		pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+		zap_thrstat_wait_end(thr->zap_io_thread.stat);
+		if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			break;
+		while ((cqe = z_uring_cqe_peek(thr->ring))) {
+			c = *cqe;
+			z_uring_cqe_seen(thr->ring);
+			__uring_complete(thr, &c);
+		}
+	}
+}
+
+static zap_err_t __uring_ep_assign(z_sock_io_thread_t thr, struct z_sock_ep *sep)
+{
+	sep->uring = 1;
+	if (sep->ev_fn != sock_ev_cb) {
+		/* listening endpoint */
+		if (__uring_arm(thr, sep, Z_URING_OP_POLL))
+			return ZAP_ERR_RESOURCE;
+		return ZAP_ERR_OK;
+	}
+	if (__uring_arm(thr, sep, Z_URING_OP_RECV))
+		return ZAP_ERR_RESOURCE;
+	if (sep->ev.events & EPOLLOUT) {
+		sep->uring_out = 1;
+		if (__uring_arm(thr, sep, Z_URING_OP_OUT)) {
+			sep->uring_out = 0;
+			sep->uring_released = 1;
+			__uring_queue(thr, sep, Z_URING_OP_RECV, 1);
+			return ZAP_ERR_RESOURCE;
+		}
+	}
+	return ZAP_ERR_OK;
+}
+
+static zap_err_t __uring_ep_release(z_sock_io_thread_t thr, struct z_sock_ep *sep)
+{
+	sep->uring_released = 1;
+	if (sep->ev_fn != sock_ev_cb)
+		__uring_queue(thr, sep, Z_URING_OP_POLL, 1);
+	else
+		__uring_queue(thr, sep, Z_URING_OP_RECV, 1);
+	if (sep->uring_out)
+		__uring_queue(thr, sep, Z_URING_OP_OUT, 1);
+	return ZAP_ERR_OK;
+}
+
+static struct z_uring *__uring_new(zap_t z)
+{
+	struct z_uring *ring;
+	int rc;
+	static int warned = 0;
+
+	ring = malloc(sizeof(*ring));
+	if (!ring)
+		return NULL;
+	rc = z_uring_init(ring, ZAP_SOCK_URING_SQ_SIZE, ZAP_SOCK_URING_CQ_SIZE,
+			  ZAP_ENV_INT(ZAP_SOCK_URING_BUF_CNT),
+			  ZAP_ENV_INT(ZAP_SOCK_URING_BUF_SZ));
+	if (rc) {
+		ZLOG_(z, "zap_sock: io_uring setup error %d, using epoll\n", rc);
+		free(ring);
+		return NULL;
+	}
+	if (z_sock_recv_direct_min >= 0 &&
+	    !__atomic_exchange_n(&warned, 1, __ATOMIC_SEQ_CST)) {
+		/* The payload lands in the provided buffers first */
+		ZLOG_(z, "zap_sock: WARNING: ZAP_SOCK_IO_URING is set, read "
+			 "responses are copied from the io_uring buffers "
+			 "instead of being received directly into their "
+			 "destination (ZAP_SOCK_RECV_DIRECT_MIN). Set "
+			 "ZAP_SOCK_RECV_DIRECT_MIN=-1 to silence this "
+			 "warning.\n");
+	}
+	return ring;
+}
+#endif /* OVIS_LDMS_HAVE_IO_URING */
+
 void io_thread_cleanup(void *arg)
 {
 	z_sock_io_thread_t thr = arg;
 	if (thr->efd > -1)
 		close(thr->efd);
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring) {
+		z_uring_fini(thr->ring);
+		free(thr->ring);
+	}
+	pthread_mutex_destroy(&thr->sq_lock);
+#endif
 	zap_io_thread_release(&thr->zap_io_thread);
 	free(thr);
 }
@@ -1384,6 +2215,11 @@ static void *io_thread_proc(void *arg)
 	rc = sigprocmask(SIG_SETMASK, &sigset, NULL);
 	assert(rc == 0 && "pthread_sigmask error");
 
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring)
+		__uring_thread_loop(thr);
+	else
+#endif
 	while (1) {
 		zap_thrstat_wait_start(thr->zap_io_thread.stat);
 		n = epoll_wait(thr->efd, thr->ev, ZAP_SOCK_EV_SIZE, -1);
@@ -1418,6 +2254,7 @@ static zap_err_t __sock_send_connect(struct z_sock_ep *sep, char *buf, size_t le
 	zap_err_t zerr;
 	struct sock_msg_connect msg;
 	z_sock_hdr_init(&msg.hdr, 0, SOCK_MSG_CONNECT, (uint32_t)(sizeof(msg) + len), 0);
+	msg.hdr.reserved = htons(Z_SOCK_F_ALL);
 	msg.data_len = htonl(len);
 	ZAP_VERSION_SET(msg.ver);
 	memcpy(&msg.sig, ZAP_SOCK_SIG, sizeof(msg.sig));
@@ -1435,6 +2272,8 @@ static zap_err_t __sock_send(struct z_sock_ep *sep, uint16_t msg_type,
 	struct sock_msg_sendrecv msg;
 
 	z_sock_hdr_init(&msg.hdr, 0, msg_type, (uint32_t)(sizeof(msg) + len), 0);
+	if (msg_type == SOCK_MSG_ACCEPTED)
+		msg.hdr.reserved = htons(Z_SOCK_F_ALL);
 	msg.data_len = htonl(len);
 
 	return __sock_send_msg_nolock(sep, &msg.hdr, sizeof(msg), buf, len);
@@ -1449,6 +2288,17 @@ static int __enable_epoll_out(struct z_sock_ep *sep)
 		return 0; /* already enabled */
 	DEBUG_LOG(sep, "ep: %p, Enabling EPOLLOUT\n", sep);
 	sep->ev.events = EPOLLIN|EPOLLOUT;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring) {
+		if (sep->uring_out)
+			return 0; /* still armed */
+		sep->uring_out = 1;
+		rc = __uring_arm(thr, sep, Z_URING_OP_OUT);
+		if (rc)
+			sep->uring_out = 0;
+		return rc;
+	}
+#endif
 	rc = epoll_ctl(thr->efd, EPOLL_CTL_MOD, sep->sock, &sep->ev);
 	return rc;
 }
@@ -1462,6 +2312,10 @@ static int __disable_epoll_out(struct z_sock_ep *sep)
 		return 0; /* already disabled */
 	DEBUG_LOG(sep, "ep: %p, Disabling EPOLLOUT\n", sep);
 	sep->ev.events = EPOLLIN;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring)
+		return 0; /* an armed POLLOUT is ignored when it fires */
+#endif
 	rc = epoll_ctl(thr->efd, EPOLL_CTL_MOD, sep->sock, &sep->ev);
 	return rc;
 }
@@ -1487,34 +2341,23 @@ static zap_err_t __sock_send_msg_nolock(struct z_sock_ep *sep,
 	z_sock_send_wr_t wr;
 	sock_msg_type_t mtype = ntohs(m->msg_type);
 	DEBUG_LOG_SEND_MSG(sep, m);
-	assert(mtype != SOCK_MSG_WRITE_REQ); /* WRITE_REQ uses __wr_post() */
-	/* allocate send wr */
-	if (mtype == SOCK_MSG_READ_RESP) {
-		/* allow big message, and do not copy `data`  */
-		wr = __sock_wr_alloc(0, NULL);
-		if (!wr)
-			return ZAP_ERR_RESOURCE;
-		wr->msg_len = msg_size;
-		wr->data_len = data_len;
-		wr->data = data;
-		wr->off = 0;
-		memcpy(wr->msg.bytes, m, msg_size);
-	} else {
-		if (data_len > sep->ep.z->max_msg) {
-			DEBUG_LOG(sep, "ep: %p, SEND invalid message length: %ld\n",
-				  sep, data_len);
-			return ZAP_ERR_NO_SPACE;
-		}
-		wr = __sock_wr_alloc(data_len, NULL);
-		if (!wr)
-			return ZAP_ERR_RESOURCE;
-		wr->msg_len = msg_size + data_len;
-		wr->data_len = 0;
-		wr->data = NULL;
-		wr->off = 0;
-		memcpy(wr->msg.bytes, m, msg_size);
-		memcpy(wr->msg.bytes + msg_size, data, data_len);
+	/* WRITE_REQ and READ_RESP point at mapped data and use __wr_post() */
+	assert(mtype != SOCK_MSG_WRITE_REQ && mtype != SOCK_MSG_READ_RESP);
+	if (data_len > sep->ep.z->max_msg) {
+		DEBUG_LOG(sep, "ep: %p, SEND invalid message length: %ld\n",
+			  sep, data_len);
+		return ZAP_ERR_NO_SPACE;
 	}
+	/* allocate send wr */
+	wr = __sock_wr_alloc(data_len, NULL);
+	if (!wr)
+		return ZAP_ERR_RESOURCE;
+	wr->msg_len = msg_size + data_len;
+	wr->data_len = 0;
+	wr->data = NULL;
+	wr->off = 0;
+	memcpy(wr->msg.bytes, m, msg_size);
+	memcpy(wr->msg.bytes + msg_size, data, data_len);
 	__wr_post(sep, wr);
 	return ZAP_ERR_OK;
 }
@@ -1554,7 +2397,7 @@ static void sock_event(struct epoll_event *ev)
 			.status = ZAP_ERR_FLUSH,
 			.context = io->ctxt,
 		};
-		free(io);	/* Don't put back on free_q, we're closing */
+		__sock_io_free(sep, io); /* Don't put back on free_q, we're closing */
 		pthread_mutex_unlock(&sep->ep.lock);
 		sep->ep.cb(&sep->ep, &zev);
 		pthread_mutex_lock(&sep->ep.lock);
@@ -1853,6 +2696,7 @@ static int init_once()
 	}
 
 	pthread_atfork(NULL, NULL, (void*)z_sock_atfork);
+	z_sock_recv_direct_min = ZAP_ENV_INT(ZAP_SOCK_RECV_DIRECT_MIN);
 
 	z_key_tree.root = NULL;
 	z_key_tree.comparator = z_rbn_cmp;
@@ -1907,7 +2751,7 @@ static void z_sock_destroy(zap_ep_t ep)
 	while (!TAILQ_EMPTY(&sep->sq)) {
 		wr = TAILQ_FIRST(&sep->sq);
 		TAILQ_REMOVE(&sep->sq, wr, link);
-		free(wr);
+		__sock_wr_free(wr);
 	}
 
 	if (sep->conn_data)
@@ -1920,6 +2764,7 @@ static void z_sock_destroy(zap_ep_t ep)
 	ZAP_ASSERT(TAILQ_EMPTY(&sep->io_q), ep, "%s: The io_q is not empty "
 			"when the reference count reaches 0.\n", __func__);
 	z_sock_buff_cleanup(&sep->buff);
+	free(sep->rx_iov);
 	pthread_mutex_lock(&z_sock_list_mutex);
 	LIST_REMOVE(sep, link);
 	pthread_mutex_unlock(&z_sock_list_mutex);
@@ -2093,6 +2938,97 @@ err0:
 	return zerr;
 }
 
+static zap_err_t z_sock_readv(zap_ep_t ep, struct zap_read_iov *iov, int iovcnt,
+			      void *context)
+{
+	struct z_sock_ep *sep = (struct z_sock_ep *)ep;
+	struct sock_msg_readv_req *msg;
+	struct z_sock_io *io;
+	zap_err_t zerr = ZAP_ERR_OK;
+	size_t msg_len;
+	int i;
+
+	if (iovcnt > Z_SOCK_READV_MAX)
+		return ZAP_ERR_PARAMETER;
+
+	pthread_mutex_lock(&sep->ep.lock);
+	if (sep->ep.state != ZAP_EP_CONNECTED) {
+		zerr = ZAP_ERR_NOT_CONNECTED;
+		goto err0;
+	}
+
+	if (!(sep->peer_flags & Z_SOCK_F_READV)) {
+		/* An older peer; the application reads one by one */
+		zerr = ZAP_ERR_NOT_SUPPORTED;
+		goto err0;
+	}
+
+	/* validate */
+	for (i = 0; i < iovcnt; i++) {
+		if (z_map_access_validate(iov[i].src_map, iov[i].src,
+					  iov[i].sz, ZAP_ACCESS_READ) != 0) {
+			zerr = ZAP_ERR_REMOTE_PERMISSION;
+			goto err0;
+		}
+		if (iov[i].sz > UINT32_MAX ||
+		    z_map_access_validate(iov[i].dst_map, iov[i].dst,
+					  iov[i].sz, ZAP_ACCESS_NONE) != 0) {
+			zerr = ZAP_ERR_LOCAL_LEN;
+			goto err0;
+		}
+	}
+
+	io = __sock_io_alloc(sep);
+	if (!io) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err0;
+	}
+	io->iov = calloc(iovcnt, sizeof(*io->iov));
+	if (!io->iov) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err1;
+	}
+	io->iovcnt = iovcnt;
+	io->comp_type = ZAP_EVENT_READ_COMPLETE;
+	io->ctxt = context;
+
+	msg_len = sizeof(*msg) + iovcnt * sizeof(msg->ent[0]);
+	io->wr = __sock_wr_alloc(msg_len, io);
+	if (!io->wr) {
+		zerr = ZAP_ERR_RESOURCE;
+		goto err1;
+	}
+
+	/* prepare wr and message */
+	io->wr->msg_len = msg_len;
+	msg = &io->wr->msg.readv_req;
+	z_sock_hdr_init(&msg->hdr, 0, SOCK_MSG_READV_REQ, msg_len,
+			(uint64_t)context);
+	msg->count = htonl(iovcnt);
+	for (i = 0; i < iovcnt; i++) {
+		msg->ent[i].src_map_key = SOCK_MAP_KEY_GET(iov[i].src_map);
+		msg->ent[i].src_ptr = htobe64((uint64_t)iov[i].src);
+		msg->ent[i].data_len = htonl((uint32_t)iov[i].sz);
+		io->iov[i].dst_map = iov[i].dst_map;
+		io->iov[i].dst_ptr = iov[i].dst;
+		io->iov[i].len = iov[i].sz;
+	}
+
+	TAILQ_INSERT_TAIL(&sep->io_q, io, q_link);
+	/* write message */
+	DEBUG_LOG_SEND_MSG(sep, &msg->hdr);
+	__wr_post(sep, io->wr);
+
+	pthread_mutex_unlock(&sep->ep.lock);
+	return ZAP_ERR_OK;
+
+err1:
+	__sock_io_free(sep, io);
+err0:
+	pthread_mutex_unlock(&sep->ep.lock);
+	return zerr;
+}
+
 static zap_err_t z_sock_write(zap_ep_t ep, zap_map_t src_map, char *src,
 			      zap_map_t dst_map, char *dst, size_t sz,
 			      void *context)
@@ -2168,17 +3104,39 @@ zap_io_thread_t z_sock_io_thread_create(zap_t z)
 				ZAP_ENV_INT(ZAP_THRSTAT_WINDOW));
 	if (rc)
 		goto err1;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	pthread_mutex_init(&thr->sq_lock, NULL);
+	if (ZAP_ENV_INT(ZAP_SOCK_IO_URING))
+		thr->ring = __uring_new(z);
+	if (thr->ring) {
+		thr->efd = -1;
+		goto create;
+	}
+#endif
 	thr->efd = epoll_create1(O_CLOEXEC);
 	if (thr->efd < 1)
 		goto err2;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+ create:
+#endif
 	rc = pthread_create(&thr->zap_io_thread.thread, NULL, io_thread_proc, thr);
 	if (rc)
 		goto err3;
 	pthread_setname_np(thr->zap_io_thread.thread, "zap_sock_io");
 	return &thr->zap_io_thread;
  err3:
-	close(thr->efd);
+	if (thr->efd > -1)
+		close(thr->efd);
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring) {
+		z_uring_fini(thr->ring);
+		free(thr->ring);
+	}
+#endif
  err2:
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	pthread_mutex_destroy(&thr->sq_lock);
+#endif
 	zap_io_thread_release(&thr->zap_io_thread);
  err1:
 	free(thr);
@@ -2194,6 +3152,10 @@ zap_err_t z_sock_io_thread_cancel(zap_io_thread_t t)
 	switch (rc) {
 	case ESRCH: /* cleaning up structure w/o running thread b/c of fork */
 		((z_sock_io_thread_t)t)->efd = -1; /* b/c of CLOEXEC */
+#ifdef OVIS_LDMS_HAVE_IO_URING
+		if (((z_sock_io_thread_t)t)->ring)
+			((z_sock_io_thread_t)t)->ring->fd = -1;
+#endif
 		io_thread_cleanup(t);
 	case 0:
 		return ZAP_ERR_OK;
@@ -2207,6 +3169,10 @@ zap_err_t z_sock_io_thread_ep_assign(zap_io_thread_t t, zap_ep_t ep)
 	z_sock_io_thread_t thr = (void*)t;
 	struct z_sock_ep *sep = (void*)ep;
 	int rc;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring)
+		return __uring_ep_assign(thr, sep);
+#endif
 	rc = epoll_ctl(thr->efd, EPOLL_CTL_ADD, sep->sock, &sep->ev);
 	return rc ? ZAP_ERR_RESOURCE : ZAP_ERR_OK;
 }
@@ -2216,6 +3182,10 @@ zap_err_t z_sock_io_thread_ep_release(zap_io_thread_t t, zap_ep_t ep)
 	z_sock_io_thread_t thr = (void*)t;
 	struct z_sock_ep *sep = (void*)ep;
 	int rc;
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	if (thr->ring)
+		return __uring_ep_release(thr, sep);
+#endif
 	rc = epoll_ctl(thr->efd, EPOLL_CTL_DEL, sep->sock, &sep->ev);
 	return rc ? ZAP_ERR_RESOURCE : ZAP_ERR_OK;
 }
@@ -2247,6 +3217,7 @@ zap_err_t zap_transport_get(zap_t *pz, zap_log_fn_t log_fn,
 	z->close = z_sock_close;
 	z->send = z_sock_send;
 	z->read = z_sock_read;
+	z->readv = z_sock_readv;
 	z->write = z_sock_write;
 	z->unmap = z_sock_unmap;
 	z->share = z_sock_share;
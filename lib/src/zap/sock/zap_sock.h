@@ -52,10 +52,14 @@
 #include <semaphore.h>
 #include <sys/queue.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include "ovis-ldms-config.h"
 #include "coll/rbt.h"
 #include "zap.h"
 #include "zap_priv.h"
+#ifdef OVIS_LDMS_HAVE_IO_URING
+#include "zap_sock_uring.h"
+#endif
 
 #define SOCKBUF_SZ 1024 * 1024
 
@@ -106,6 +110,8 @@ typedef enum sock_msg_type {
 	SOCK_MSG_ACCEPTED,    /*  Connection  accepted      */
 	SOCK_MSG_REJECTED,    /*  Reject      data */
 	SOCK_MSG_ACK_ACCEPTED,/*  Acknowledge accepted msg  */
+	SOCK_MSG_READV_REQ,   /*  Vectored    read request  */
+	SOCK_MSG_READV_RESP,  /*  Vectored    read response */
 	SOCK_MSG_TYPE_LAST,   /*  Range limiter, upper  */
 	SOCK_MSG_FIRST = SOCK_MSG_CONNECT /* Range limiter, lower */
 } sock_msg_type_t;;
@@ -122,6 +128,8 @@ static const char *__sock_msg_type_str[SOCK_MSG_TYPE_LAST] = {
 	[SOCK_MSG_ACCEPTED]    =  "SOCK_MSG_ACCEPTED",
 	[SOCK_MSG_REJECTED]    =  "SOCK_MSG_REJECTED",
 	[SOCK_MSG_ACK_ACCEPTED] = "SOCK_MSG_ACK_ACCEPTED",
+	[SOCK_MSG_READV_REQ]   =  "SOCK_MSG_READV_REQ",
+	[SOCK_MSG_READV_RESP]  =  "SOCK_MSG_READV_RESP",
 };
 
 static inline
@@ -149,6 +157,26 @@ struct sock_msg_hdr {
 
 static char ZAP_SOCK_SIG[8] = "SOCKET";
 
+/*
+ * Capabilities advertised in \c hdr.reserved of SOCK_MSG_CONNECT and
+ * SOCK_MSG_ACCEPTED. Older peers always send 0 there.
+ */
+#define Z_SOCK_F_READV 0x0001 /* understands SOCK_MSG_READV_REQ */
+#define Z_SOCK_F_ALL   (Z_SOCK_F_READV)
+
+/* Maximum number of entries in a vectored read request */
+#define Z_SOCK_READV_MAX 1024
+
+/**
+ * \brief Read responses with at least this many bytes of payload are
+ * received directly into the destination memory instead of through
+ * sep->buff.
+ *
+ * Set the environment variable to override it. A negative value disables
+ * direct receive.
+ */
+#define ZAP_SOCK_RECV_DIRECT_MIN 16384
+
 /**
  * Connect message.
  */
@@ -190,6 +218,45 @@ struct sock_msg_read_resp {
 	char data[OVIS_FLEX]; /**< Response data */
 };
 
+/**
+ * Vectored read request entry
+ */
+struct sock_readv_ent {
+	uint32_t src_map_key; /**< Source map reference (on non-initiator) */
+	uint64_t src_ptr; /**< Source memory */
+	uint32_t data_len; /**< Data length */
+};
+
+/**
+ * Vectored read request
+ */
+struct sock_msg_readv_req {
+	struct sock_msg_hdr hdr;
+	uint32_t count; /**< Number of entries */
+	struct sock_readv_ent ent[OVIS_FLEX];
+};
+
+/**
+ * Vectored read response entry
+ */
+struct sock_readv_resp_ent {
+	uint16_t status; /**< Return status of the entry */
+	uint16_t reserved;
+	uint32_t data_len; /**< Length of the entry data */
+};
+
+/**
+ * Vectored read response
+ *
+ * The \c count entries are followed by the data of each entry in the
+ * request order.
+ */
+struct sock_msg_readv_resp {
+	struct sock_msg_hdr hdr;
+	uint32_t count; /**< Number of entries */
+	struct sock_readv_resp_ent ent[OVIS_FLEX];
+};
+
 /**
  * Write request
  */
@@ -229,6 +296,8 @@ typedef union sock_msg_u {
 	struct sock_msg_rendezvous rendezvous;
 	struct sock_msg_read_req read_req;
 	struct sock_msg_read_resp read_resp;
+	struct sock_msg_readv_req readv_req;
+	struct sock_msg_readv_resp readv_resp;
 	struct sock_msg_write_req write_req;
 	struct sock_msg_write_resp write_resp;
 	char bytes[0]; /* access as bytes */
@@ -247,19 +316,40 @@ typedef struct z_sock_send_wr_s {
 	size_t data_len; /* remaining data len */
 	size_t off; /* offset of msg or data */
 	const char *data;
+	zap_map_t map; /* map holding `data`, referenced until the wr is freed */
 	int flags; /* various wr flags */
+	int pooled; /* allocated from the wr pool */
 	union sock_msg_u msg; /* The message */
 } *z_sock_send_wr_t;
 
+/*
+ * Work requests with at most this many bytes of message beyond
+ * sizeof(struct z_sock_send_wr_s) are recycled through a free list of up
+ * to Z_SOCK_WR_POOL_MAX entries instead of being calloc()'ed and freed.
+ */
+#define Z_SOCK_WR_POOL_SZ 256
+#define Z_SOCK_WR_POOL_MAX 4096
+
+/* Maximum number of iovecs gathered into one sendmsg() */
+#define Z_SOCK_SEND_IOV_MAX 64
+
 /**
  * Keeps track of outstanding I/O so that it can be cleaned up when
  * the endpoint shuts down. A z_sock_io is either on the free_q or the
  * io_q for the endpoint.
  */
+struct z_sock_io_iov {
+	zap_map_t dst_map;
+	char *dst_ptr;
+	uint32_t len;
+};
+
 struct z_sock_io {
 	TAILQ_ENTRY(z_sock_io) q_link;
 	zap_map_t dst_map; /**< Destination map for RDMA_READ */
 	char *dst_ptr; /**< Destination address for RDMA_READ */
+	int iovcnt; /**< Number of destinations of a vectored read */
+	struct z_sock_io_iov *iov; /**< Destinations of a vectored read */
 	struct z_sock_send_wr_s *wr;
 	enum zap_event_type comp_type; /**< completion type */
 	void *ctxt; /**< Application context */
@@ -285,11 +375,32 @@ struct z_sock_ep {
 
 	int sock_connected;
 	int app_accepted;
+	uint16_t peer_flags; /* Z_SOCK_F_* advertised by the peer */
 
 	struct epoll_event ev;
 	void (*ev_fn)(struct epoll_event *);
 	struct z_sock_buff_s buff;
 
+	/* Direct receive of a read response payload (see __recv_direct()) */
+	enum {
+		Z_SOCK_RX_UNDECIDED, /* read response, fixed part pending */
+		Z_SOCK_RX_BUFFERED,  /* whole message received into buff */
+		Z_SOCK_RX_DIRECT,    /* payload received into rx_iov */
+	} rx_mode;
+	int rx_cur;		/* current entry in rx_iov */
+	int rx_cnt;		/* entries in rx_iov */
+	int rx_alloc;		/* entries allocated in rx_iov */
+	size_t rx_left;		/* payload bytes not yet received */
+	struct iovec *rx_iov;	/* payload destinations */
+
+	/* io_uring mode (see ZAP_SOCK_IO_URING) */
+	int uring;		/* assigned to an io_uring I/O thread */
+	int uring_out;		/* POLLOUT request armed */
+	int uring_released;	/* released from the I/O thread */
+	const char *rx_ub;	/* received data not consumed yet */
+	size_t rx_ub_len;
+	int rx_ub_eof;		/* the peer closed the connection */
+
 	pthread_mutex_t q_lock;
 	TAILQ_HEAD(, z_sock_io) io_q; /* manages ops from app (read/write/send) */
 	TAILQ_HEAD(, z_sock_io) io_cq; /* completion queue, currently serves only send completion */
@@ -300,10 +411,37 @@ struct z_sock_ep {
 
 #define ZAP_SOCK_EV_SIZE 4096
 
+/**
+ * \brief Set the environment variable to non-zero to drive the I/O threads
+ * with io_uring instead of epoll.
+ *
+ * In this mode each connected endpoint has one multishot receive into
+ * buffers provided by its I/O thread, POLLOUT is armed only while the send
+ * queue is blocked, and the requests an I/O thread makes while processing
+ * completions are submitted together with its next wait. The thread falls
+ * back to epoll if the ring cannot be set up.
+ *
+ * Received data is copied out of the provided buffers, so read responses
+ * are not received directly into their destination as in epoll mode (see
+ * ZAP_SOCK_RECV_DIRECT_MIN). A warning is logged unless direct receive is
+ * disabled.
+ */
+#define ZAP_SOCK_IO_URING 0
+
+#define ZAP_SOCK_URING_SQ_SIZE 1024
+#define ZAP_SOCK_URING_CQ_SIZE 8192
+/* Receive buffers of an io_uring I/O thread; environment overrides both */
+#define ZAP_SOCK_URING_BUF_CNT 256 /* must be a power of 2 */
+#define ZAP_SOCK_URING_BUF_SZ (64 * 1024)
+
 typedef struct z_sock_io_thread {
 	struct zap_io_thread zap_io_thread;
 	int efd; /* epoll fd */
 	struct epoll_event ev[ZAP_SOCK_EV_SIZE];
+#ifdef OVIS_LDMS_HAVE_IO_URING
+	struct z_uring *ring; /* NULL in epoll mode */
+	pthread_mutex_t sq_lock; /* serializes submission to ring */
+#endif
 } *z_sock_io_thread_t;
 
 static inline struct z_sock_ep *z_sock_from_ep(zap_ep_t *ep)
@@ -0,0 +1,245 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "zap_sock_uring.h"
+
+static void __buf_ring_add(struct z_uring *r, unsigned bid)
+{
+	struct io_uring_buf *b = &r->br->bufs[r->br_tail & (r->buf_cnt - 1)];
+
+	b->addr = (uint64_t)(uintptr_t)z_uring_buf(r, bid);
+	b->len = r->buf_sz;
+	b->bid = bid;
+	r->br_tail++;
+}
+
+int z_uring_init(struct z_uring *r, unsigned sq_entries, unsigned cq_entries,
+		 unsigned buf_cnt, unsigned buf_sz)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	unsigned *sq_array, i;
+	int rc;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+	if (!buf_cnt || (buf_cnt & (buf_cnt - 1)) || buf_cnt > 32768)
+		return EINVAL;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = cq_entries;
+	r->fd = syscall(__NR_io_uring_setup, sq_entries, &p);
+	if (r->fd < 0) {
+		rc = errno;
+		goto err;
+	}
+	if (!(p.features & IORING_FEAT_NODROP)) {
+		/* do not risk losing multishot completions */
+		rc = ENOTSUP;
+		goto err;
+	}
+
+	r->sq_entries = p.sq_entries;
+	r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_sz = p.cq_off.cqes +
+			p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_sz > r->sq_ring_sz)
+			r->sq_ring_sz = r->cq_ring_sz;
+		r->cq_ring_sz = 0;
+	}
+	r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ|PROT_WRITE,
+			  MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) {
+		r->sq_ring = NULL;
+		rc = errno;
+		goto err;
+	}
+	if (r->cq_ring_sz) {
+		r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ|PROT_WRITE,
+				  MAP_SHARED|MAP_POPULATE, r->fd,
+				  IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) {
+			r->cq_ring = NULL;
+			rc = errno;
+			goto err;
+		}
+	} else {
+		r->cq_ring = r->sq_ring;
+	}
+	r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_sz, PROT_READ|PROT_WRITE,
+		       MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		rc = errno;
+		goto err;
+	}
+
+	r->sq_khead = (void *)((char *)r->sq_ring + p.sq_off.head);
+	r->sq_ktail = (void *)((char *)r->sq_ring + p.sq_off.tail);
+	r->sq_kmask = (void *)((char *)r->sq_ring + p.sq_off.ring_mask);
+	r->cq_khead = (void *)((char *)r->cq_ring + p.cq_off.head);
+	r->cq_ktail = (void *)((char *)r->cq_ring + p.cq_off.tail);
+	r->cq_kmask = (void *)((char *)r->cq_ring + p.cq_off.ring_mask);
+	r->cqes = (void *)((char *)r->cq_ring + p.cq_off.cqes);
+	r->sq_tail = *r->sq_ktail;
+	/* SQE i always sits in slot i, so submitting is just a tail bump */
+	sq_array = (void *)((char *)r->sq_ring + p.sq_off.array);
+	for (i = 0; i < p.sq_entries; i++)
+		sq_array[i] = i;
+
+	/* provided buffers */
+	r->buf_cnt = buf_cnt;
+	r->buf_sz = buf_sz;
+	r->br_sz = buf_cnt * sizeof(struct io_uring_buf);
+	rc = posix_memalign((void **)&r->br, sysconf(_SC_PAGESIZE), r->br_sz);
+	if (rc) {
+		r->br = NULL;
+		goto err;
+	}
+	memset(r->br, 0, r->br_sz);
+	r->buf = malloc((size_t)buf_cnt * buf_sz);
+	if (!r->buf) {
+		rc = ENOMEM;
+		goto err;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)r->br;
+	reg.ring_entries = buf_cnt;
+	reg.bgid = 0;
+	if (syscall(__NR_io_uring_register, r->fd,
+		    IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		rc = errno;
+		goto err;
+	}
+	for (i = 0; i < buf_cnt; i++)
+		__buf_ring_add(r, i);
+	__atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+	return 0;
+
+ err:
+	z_uring_fini(r);
+	return rc;
+}
+
+void z_uring_fini(struct z_uring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ring && r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	if (r->sq_ring)
+		munmap(r->sq_ring, r->sq_ring_sz);
+	if (r->fd > -1)
+		close(r->fd);
+	free(r->br);
+	free(r->buf);
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+struct io_uring_sqe *z_uring_sqe_get(struct z_uring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head = __atomic_load_n(r->sq_khead, __ATOMIC_ACQUIRE);
+
+	if (r->sq_tail - head >= r->sq_entries)
+		return NULL;
+	sqe = &r->sqes[r->sq_tail & *r->sq_kmask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void z_uring_sqe_commit(struct z_uring *r)
+{
+	r->sq_tail++;
+	__atomic_store_n(r->sq_ktail, r->sq_tail, __ATOMIC_RELEASE);
+}
+
+unsigned z_uring_sq_pending(struct z_uring *r)
+{
+	return r->sq_tail - __atomic_load_n(r->sq_khead, __ATOMIC_ACQUIRE);
+}
+
+int z_uring_enter(struct z_uring *r, unsigned to_submit, unsigned min_complete)
+{
+	unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+	return syscall(__NR_io_uring_enter, r->fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+struct io_uring_cqe *z_uring_cqe_peek(struct z_uring *r)
+{
+	unsigned head = *r->cq_khead;
+	unsigned tail = __atomic_load_n(r->cq_ktail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return NULL;
+	return &r->cqes[head & *r->cq_kmask];
+}
+
+void z_uring_cqe_seen(struct z_uring *r)
+{
+	__atomic_store_n(r->cq_khead, *r->cq_khead + 1, __ATOMIC_RELEASE);
+}
+
+void z_uring_buf_recycle(struct z_uring *r, unsigned bid)
+{
+	__buf_ring_add(r, bid);
+	__atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+}
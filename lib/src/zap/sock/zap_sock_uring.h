@@ -0,0 +1,138 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __ZAP_SOCK_URING_H__
+#define __ZAP_SOCK_URING_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * \brief A minimal io_uring instance for the zap_sock I/O threads.
+ *
+ * The ring is driven with the raw system calls so that zap_sock does not
+ * depend on liburing. Submission may come from any thread holding the
+ * owner's submission lock; completions are reaped only by the I/O thread
+ * that owns the ring. The ring also owns a group of provided buffers
+ * (buffer group 0) for multishot receives.
+ */
+struct z_uring {
+	int fd;
+
+	/* submission queue */
+	unsigned sq_entries;
+	unsigned sq_tail;	/* local copy of the tail */
+	unsigned *sq_khead;
+	unsigned *sq_ktail;
+	unsigned *sq_kmask;
+	struct io_uring_sqe *sqes;
+
+	/* completion queue */
+	unsigned *cq_khead;
+	unsigned *cq_ktail;
+	unsigned *cq_kmask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	void *cq_ring;
+	size_t cq_ring_sz;
+	size_t sqes_sz;
+
+	/* provided receive buffers */
+	struct io_uring_buf_ring *br;
+	size_t br_sz;
+	char *buf;
+	unsigned buf_cnt;	/* power of 2 */
+	unsigned buf_sz;
+	uint16_t br_tail;
+};
+
+/**
+ * \brief Create the ring and register \c buf_cnt buffers of \c buf_sz bytes.
+ *
+ * \retval 0 on success.
+ * \retval errno on failure (e.g. ENOSYS if the kernel lacks io_uring).
+ */
+int z_uring_init(struct z_uring *r, unsigned sq_entries, unsigned cq_entries,
+		 unsigned buf_cnt, unsigned buf_sz);
+void z_uring_fini(struct z_uring *r);
+
+/**
+ * \brief Get a zeroed SQE, or NULL if the submission queue is full.
+ *
+ * The caller must serialize submission and call z_uring_sqe_commit()
+ * once the SQE is filled.
+ */
+struct io_uring_sqe *z_uring_sqe_get(struct z_uring *r);
+void z_uring_sqe_commit(struct z_uring *r);
+
+/** \brief The number of committed SQEs not consumed by the kernel yet. */
+unsigned z_uring_sq_pending(struct z_uring *r);
+
+/**
+ * \brief Submit \c to_submit SQEs and wait for \c min_complete completions.
+ *
+ * \retval The number of SQEs submitted, or -1 with \c errno set.
+ */
+int z_uring_enter(struct z_uring *r, unsigned to_submit, unsigned min_complete);
+
+/** \brief The next CQE, or NULL if the completion queue is empty. */
+struct io_uring_cqe *z_uring_cqe_peek(struct z_uring *r);
+/** \brief Mark the CQE returned by z_uring_cqe_peek() as consumed. */
+void z_uring_cqe_seen(struct z_uring *r);
+
+static inline char *z_uring_buf(struct z_uring *r, unsigned bid)
+{
+	return r->buf + (size_t)bid * r->buf_sz;
+}
+
+/** \brief Give the buffer \c bid back to the kernel. */
+void z_uring_buf_recycle(struct z_uring *r, unsigned bid);
+
+#endif
@@ -0,0 +1,496 @@
+/* -*- c-basic-offset: 8 -*-
+ * Copyright (c) 2026 National Technology & Engineering Solutions
+ * of Sandia, LLC (NTESS). Under the terms of Contract DE-NA0003525 with
+ * NTESS, the U.S. Government retains certain rights in this software.
+ * Copyright (c) 2026 Open Grid Computing, Inc. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the BSD-type
+ * license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *      Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *      Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following
+ *      disclaimer in the documentation and/or other materials provided
+ *      with the distribution.
+ *
+ *      Neither the name of Sandia nor the names of any contributors may
+ *      be used to endorse or promote products derived from this software
+ *      without specific prior written permission.
+ *
+ *      Neither the name of Open Grid Computing nor the names of any
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ *      Modified source versions must be plainly marked as such, and
+ *      must not be misrepresented as being the original software.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+ * \file zap_test_uring.c
+ *
+ * \brief Test of the io_uring mode of zap_sock.
+ *
+ * The test runs a server and a client endpoint in one process once for each
+ * of the following configurations, each in its own child process so that
+ * the transport reads its environment variables again:
+ * 	- ZAP_SOCK_IO_URING=1: the I/O threads use io_uring, and the warning
+ * 	  about direct receive is logged once
+ * 	- ZAP_SOCK_IO_URING=1 and ZAP_SOCK_RECV_DIRECT_MIN=-1: no warning
+ * 	- ZAP_SOCK_IO_URING=1 and ZAP_SOCK_URING_BUF_CNT=3: the ring cannot be
+ * 	  set up, the I/O threads fall back to epoll
+ *
+ * In each configuration:
+ * 	- the client sends a message and the server echoes it back
+ * 	- the server shares a memory map
+ * 	- the client reads all of it with zap_read(), a small part with
+ * 	  zap_read() and two parts with zap_readv(), and verifies the data
+ * 	- the client closes the connection
+ *
+ * The test is skipped if the kernel cannot set up a ring.
+ */
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include "zap.h"
+
+#define MEM_SZ (1024 * 1024 + 4096) /* spans several io_uring buffers */
+#define SMALL_OFF 4096
+#define SMALL_SZ 100
+#define VEC_SZ0 (MEM_SZ / 2)
+#define VEC_OFF1 (MEM_SZ - 8192)
+#define VEC_SZ1 8192
+#define MSG "Hello, io_uring!"
+#define TIMEOUT 20 /* seconds */
+
+#define LOG_EPOLL "using epoll"
+#define LOG_WARNING "WARNING: ZAP_SOCK_IO_URING"
+
+#define SKIPPED 77
+
+struct mode {
+	const char *name;
+	const char *env[3];
+	int epoll;	/* expect the fallback to epoll */
+	int warning;	/* expect the direct receive warning */
+} modes[] = {
+	{ "io_uring", { "ZAP_SOCK_IO_URING=1" }, 0, 1 },
+	{ "io_uring without direct receive",
+	  { "ZAP_SOCK_IO_URING=1", "ZAP_SOCK_RECV_DIRECT_MIN=-1" }, 0, 0 },
+	{ "io_uring setup failure",
+	  { "ZAP_SOCK_IO_URING=1", "ZAP_SOCK_URING_BUF_CNT=3" }, 1, 0 },
+};
+
+enum {
+	READ_ALL = 1,
+	READ_SMALL,
+	READ_VEC,
+	READ_COUNT = 3,
+};
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+int server_done;
+int client_done;
+int errors;
+int echoed;
+int reads;
+
+char log_buf[16384];
+size_t log_len;
+
+char *srv_mem;
+char *cli_mem;
+zap_map_t srv_map;
+zap_map_t cli_map;
+zap_map_t remote_map;
+
+#define FAIL(fmt, ...) do { \
+	printf("Error: " fmt, ##__VA_ARGS__); \
+	__atomic_add_fetch(&errors, 1, __ATOMIC_SEQ_CST); \
+} while (0)
+
+void test_log(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	pthread_mutex_lock(&lock);
+	va_start(ap, fmt);
+	n = vsnprintf(log_buf + log_len, sizeof(log_buf) - log_len, fmt, ap);
+	va_end(ap);
+	if (n > 0) {
+		printf("%s", log_buf + log_len);
+		log_len += n;
+		if (log_len >= sizeof(log_buf))
+			log_len = sizeof(log_buf) - 1;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+zap_mem_info_t test_meminfo(void)
+{
+	return NULL;
+}
+
+static void set_done(int *flag)
+{
+	pthread_mutex_lock(&lock);
+	*flag = 1;
+	pthread_cond_broadcast(&cv);
+	pthread_mutex_unlock(&lock);
+}
+
+void server_cb(zap_ep_t ep, zap_event_t ev)
+{
+	zap_err_t err;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECT_REQUEST:
+		err = zap_accept(ep, server_cb, NULL, 0);
+		if (err)
+			FAIL("zap_accept() error %d\n", err);
+		break;
+	case ZAP_EVENT_CONNECTED:
+		err = zap_map(&srv_map, srv_mem, MEM_SZ, ZAP_ACCESS_READ);
+		if (err) {
+			FAIL("zap_map() error %d\n", err);
+			zap_close(ep);
+			break;
+		}
+		err = zap_share(ep, srv_map, NULL, 0);
+		if (err) {
+			FAIL("zap_share() error %d\n", err);
+			zap_close(ep);
+		}
+		break;
+	case ZAP_EVENT_RECV_COMPLETE:
+		err = zap_send(ep, ev->data, ev->data_len);
+		if (err)
+			FAIL("zap_send() error %d\n", err);
+		break;
+	case ZAP_EVENT_SEND_COMPLETE:
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		if (srv_map) {
+			zap_unmap(srv_map);
+			srv_map = NULL;
+		}
+		zap_free(ep);
+		set_done(&server_done);
+		break;
+	default:
+		FAIL("unexpected server event %s\n", zap_event_str(ev->type));
+		break;
+	}
+}
+
+static void client_check_done(zap_ep_t ep)
+{
+	if (__atomic_load_n(&echoed, __ATOMIC_SEQ_CST) &&
+	    __atomic_load_n(&reads, __ATOMIC_SEQ_CST) == READ_COUNT)
+		zap_close(ep);
+}
+
+/* Compare the destination of a read with its source */
+static int read_verify(long id)
+{
+	switch (id) {
+	case READ_ALL:
+		return memcmp(cli_mem, srv_mem, MEM_SZ);
+	case READ_SMALL:
+		return memcmp(cli_mem + SMALL_OFF, srv_mem + SMALL_OFF,
+			      SMALL_SZ);
+	case READ_VEC:
+		return memcmp(cli_mem, srv_mem, VEC_SZ0) ||
+		       memcmp(cli_mem + VEC_OFF1, srv_mem + VEC_OFF1, VEC_SZ1);
+	}
+	return -1;
+}
+
+static void client_read(zap_ep_t ep)
+{
+	struct zap_read_iov iov[2];
+	char *src = zap_map_addr(remote_map);
+	zap_err_t err;
+
+	err = zap_map(&cli_map, cli_mem, MEM_SZ,
+		      ZAP_ACCESS_READ|ZAP_ACCESS_WRITE);
+	if (err) {
+		FAIL("zap_map() error %d\n", err);
+		zap_close(ep);
+		return;
+	}
+	/*
+	 * READ_ALL covers the destinations of the other reads, which read
+	 * the same data.
+	 */
+	err = zap_read(ep, remote_map, src, cli_map, cli_mem, MEM_SZ,
+		       (void *)READ_ALL);
+	if (err)
+		goto err;
+	err = zap_read(ep, remote_map, src + SMALL_OFF, cli_map,
+		       cli_mem + SMALL_OFF, SMALL_SZ, (void *)READ_SMALL);
+	if (err)
+		goto err;
+	iov[0].src_map = iov[1].src_map = remote_map;
+	iov[0].dst_map = iov[1].dst_map = cli_map;
+	iov[0].src = src;
+	iov[0].dst = cli_mem;
+	iov[0].sz = VEC_SZ0;
+	iov[1].src = src + VEC_OFF1;
+	iov[1].dst = cli_mem + VEC_OFF1;
+	iov[1].sz = VEC_SZ1;
+	err = zap_readv(ep, iov, 2, (void *)READ_VEC);
+	if (err == ZAP_ERR_NOT_SUPPORTED) {
+		/* count it as done */
+		__atomic_add_fetch(&reads, 1, __ATOMIC_SEQ_CST);
+		return;
+	}
+	if (err)
+		goto err;
+	return;
+ err:
+	FAIL("read error %d\n", err);
+	zap_close(ep);
+}
+
+void client_cb(zap_ep_t ep, zap_event_t ev)
+{
+	zap_err_t err;
+
+	switch (ev->type) {
+	case ZAP_EVENT_CONNECTED:
+		err = zap_send(ep, MSG, sizeof(MSG));
+		if (err) {
+			FAIL("zap_send() error %d\n", err);
+			zap_close(ep);
+		}
+		break;
+	case ZAP_EVENT_SEND_COMPLETE:
+		break;
+	case ZAP_EVENT_RECV_COMPLETE:
+		if (ev->data_len != sizeof(MSG) || memcmp(ev->data, MSG, sizeof(MSG)))
+			FAIL("bad echo '%.*s'\n", (int)ev->data_len, ev->data);
+		__atomic_store_n(&echoed, 1, __ATOMIC_SEQ_CST);
+		client_check_done(ep);
+		break;
+	case ZAP_EVENT_RENDEZVOUS:
+		remote_map = ev->map;
+		client_read(ep);
+		break;
+	case ZAP_EVENT_READ_COMPLETE:
+		if (ev->status)
+			FAIL("read %ld status %d\n", (long)ev->context, ev->status);
+		else if (read_verify((long)ev->context))
+			FAIL("read %ld data mismatch\n", (long)ev->context);
+		__atomic_add_fetch(&reads, 1, __ATOMIC_SEQ_CST);
+		client_check_done(ep);
+		break;
+	case ZAP_EVENT_CONNECT_ERROR:
+	case ZAP_EVENT_REJECTED:
+		FAIL("client event %s\n", zap_event_str(ev->type));
+		zap_free(ep);
+		set_done(&client_done);
+		break;
+	case ZAP_EVENT_DISCONNECTED:
+		if (cli_map) {
+			zap_unmap(cli_map);
+			cli_map = NULL;
+		}
+		if (remote_map) {
+			zap_unmap(remote_map);
+			remote_map = NULL;
+		}
+		zap_free(ep);
+		set_done(&client_done);
+		break;
+	default:
+		FAIL("unexpected client event %s\n", zap_event_str(ev->type));
+		break;
+	}
+}
+
+static int wait_done()
+{
+	struct timespec ts;
+	int rc = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += TIMEOUT;
+	pthread_mutex_lock(&lock);
+	while (!(server_done && client_done) && rc != ETIMEDOUT)
+		rc = pthread_cond_timedwait(&cv, &lock, &ts);
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+static int run_mode(struct mode *m, unsigned short port)
+{
+	struct sockaddr_in sin;
+	zap_ep_t lep, ep;
+	zap_err_t err;
+	zap_t zap;
+	int i, epoll, warning;
+
+	/* the server and the client endpoints may need their own threads */
+	putenv("ZAP_IO_MAX=4");
+	for (i = 0; i < 3 && m->env[i]; i++)
+		putenv((char *)m->env[i]);
+	srv_mem = malloc(MEM_SZ);
+	cli_mem = calloc(1, MEM_SZ);
+	if (!srv_mem || !cli_mem) {
+		printf("Out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < MEM_SZ; i++)
+		srv_mem[i] = i * 7 + (i >> 12);
+
+	zap = zap_get("sock", test_log, test_meminfo);
+	if (!zap) {
+		printf("Could not load the 'sock' transport.\n");
+		return 1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+
+	lep = zap_new(zap, server_cb);
+	if (!lep) {
+		printf("zap_new() failed\n");
+		return 1;
+	}
+	err = zap_listen(lep, (struct sockaddr *)&sin, sizeof(sin));
+	if (err) {
+		printf("zap_listen() error %d\n", err);
+		return 1;
+	}
+	ep = zap_new(zap, client_cb);
+	if (!ep) {
+		printf("zap_new() failed\n");
+		return 1;
+	}
+	err = zap_connect(ep, (struct sockaddr *)&sin, sizeof(sin), NULL, 0);
+	if (err) {
+		printf("zap_connect() error %d\n", err);
+		return 1;
+	}
+	if (wait_done()) {
+		printf("Error: timed out\n");
+		return 1;
+	}
+	zap_close(lep);
+
+	pthread_mutex_lock(&lock);
+	epoll = NULL != strstr(log_buf, LOG_EPOLL);
+	warning = NULL != strstr(log_buf, LOG_WARNING);
+	if (warning && strstr(strstr(log_buf, LOG_WARNING) + 1, LOG_WARNING))
+		FAIL("the warning is logged more than once\n");
+	pthread_mutex_unlock(&lock);
+	if (!m->epoll && epoll) {
+		printf("io_uring is not available, skipped\n");
+		return SKIPPED;
+	}
+	if (m->epoll != epoll)
+		FAIL("expected the I/O threads to use %s\n",
+		     m->epoll ? "epoll" : "io_uring");
+	if (m->warning != warning)
+		FAIL("the direct receive warning is %slogged\n",
+		     warning ? "" : "not ");
+	if (reads != READ_COUNT || !echoed)
+		FAIL("%d of %d reads and %d echo completed\n",
+		     reads, READ_COUNT, echoed);
+	return errors ? 1 : 0;
+}
+
+#define FMT_ARGS "p:"
+void usage(int argc, char *argv[]) {
+	printf("usage: %s -p port_no\n"
+	       "    -p port_no	The first of the ports to listen on, one\n"
+	       "		per configuration.\n",
+	       argv[0]);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int rc, i, status, failed = 0, skipped = 0;
+	unsigned short port_no = 0;
+	int ptmp;
+	pid_t pid;
+
+	while (-1 != (rc = getopt(argc, argv, FMT_ARGS))) {
+		switch (rc) {
+		case 'p':
+			ptmp = atoi(optarg);
+			if (ptmp > 0 && ptmp < USHRT_MAX - 3)
+				port_no = ptmp;
+			break;
+		default:
+			usage(argc, argv);
+			break;
+		}
+	}
+	if (port_no == 0)
+		usage(argc, argv);
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		printf("==== %s ====\n", modes[i].name);
+		fflush(stdout);
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (pid == 0)
+			exit(run_mode(&modes[i], port_no + i));
+		if (waitpid(pid, &status, 0) < 0) {
+			perror("waitpid");
+			return 1;
+		}
+		if (WIFEXITED(status) && WEXITSTATUS(status) == SKIPPED) {
+			printf("==== %s: SKIPPED ====\n", modes[i].name);
+			skipped++;
+		} else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+			printf("==== %s: PASSED ====\n", modes[i].name);
+		} else {
+			printf("==== %s: FAILED ====\n", modes[i].name);
+			failed++;
+		}
+	}
+	if (failed)
+		return 1;
+	return skipped ? SKIPPED : 0;
+}
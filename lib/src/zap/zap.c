@@ -266,6 +266,7 @@ struct zap_tbl_entry __zap_tbl[] = {
 	[ ZAP_RDMA   ]  =  { ZAP_RDMA   , "rdma"   , NULL },
 	[ ZAP_UGNI   ]  =  { ZAP_UGNI   , "ugni"   , NULL },
 	[ ZAP_FABRIC ]  =  { ZAP_FABRIC , "fabric" , NULL },
+	[ ZAP_SHM    ]  =  { ZAP_SHM    , "shm"    , NULL },
 	[ ZAP_LAST   ]  =  { 0          , NULL     , NULL },
 };
 
@@ -597,6 +598,23 @@ zap_err_t zap_read(zap_ep_t ep,
 	return zerr;
 }
 
+zap_err_t zap_readv(zap_ep_t ep, struct zap_read_iov *iov, int iovcnt,
+		    void *context)
+{
+	int i;
+	if (!ep->z->readv)
+		return ZAP_ERR_NOT_SUPPORTED;
+	if (iovcnt <= 0)
+		return ZAP_ERR_PARAMETER;
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].dst_map->type != ZAP_MAP_LOCAL)
+			return ZAP_ERR_INVALID_MAP_TYPE;
+		if (iov[i].src_map->type != ZAP_MAP_REMOTE)
+			return ZAP_ERR_INVALID_MAP_TYPE;
+	}
+	return ep->z->readv(ep, iov, iovcnt, context);
+}
+
 
 size_t zap_map_len(zap_map_t map)
 {
@@ -633,6 +651,11 @@ zap_err_t zap_map(zap_map_t *pm, void *addr, size_t len, zap_access_t acc)
 	return err;
 }
 
+void zap_map_free_fn_set(zap_map_t map, void (*free_fn)(void *addr))
+{
+	map->free_fn = free_fn;
+}
+
 zap_err_t zap_unmap(zap_map_t map)
 {
 	zap_err_t zerr, tmp;
@@ -649,6 +672,8 @@ zap_err_t zap_unmap(zap_map_t map)
 		tmp = __zap_tbl[i].zap->unmap(map);
 		zerr = tmp?tmp:zerr; /* remember last error */
 	}
+	if (map->free_fn)
+		map->free_fn(map->addr);
 	free(map);
 	return zerr;
 }
@@ -98,6 +98,7 @@ enum zap_type {
 	ZAP_RDMA,
 	ZAP_UGNI,
 	ZAP_FABRIC,
+	ZAP_SHM,
 	ZAP_LAST,
 };
 
@@ -305,6 +306,8 @@ typedef void (*zap_cb_fn_t)(zap_ep_t zep, zap_event_t ev);
 typedef struct zap_mem_info {
 	void *start;
 	size_t len;
+	size_t max_len; /**< the heap may grow in place up to this size */
+	int fd; /**< memfd backing the heap as it grows, or -1 */
 } *zap_mem_info_t;
 typedef zap_mem_info_t (*zap_mem_info_fn_t)(void);
 
@@ -626,6 +629,35 @@ zap_err_t zap_read(zap_ep_t z,
 		   zap_map_t dst_map, char *dst, size_t sz,
 		   void *context);
 
+/** \brief One element of a vectored read (see \c zap_readv()) */
+struct zap_read_iov {
+	zap_map_t src_map; /**< Remote map of the source */
+	char *src;	   /**< Source address in \c src_map */
+	zap_map_t dst_map; /**< Local map of the destination */
+	char *dst;	   /**< Destination address in \c dst_map */
+	size_t sz;	   /**< Number of bytes to read */
+};
+
+/**
+ * \brief RDMA read multiple remote buffers in one request.
+ *
+ * The transport reads all \c iovcnt buffers described by \c iov and delivers
+ * a single \c ZAP_EVENT_READ_COMPLETE with \c context when all of them are
+ * done. The status of the event is the first error encountered, if any; the
+ * destination of a failed element is left untouched. The \c iov array may be
+ * reused as soon as the function returns.
+ *
+ * Not all transports (or peers) can serve a vectored read. In that case \c
+ * ZAP_ERR_NOT_SUPPORTED is returned and the application should fall back to
+ * \c zap_read().
+ *
+ * \retval ZAP_ERR_OK The read was posted; the completion will be delivered.
+ * \retval ZAP_ERR_NOT_SUPPORTED The transport or the peer lacks vectored read.
+ * \retval zerr Other synchronous errors; no completion will be delivered.
+ */
+zap_err_t zap_readv(zap_ep_t ep, struct zap_read_iov *iov, int iovcnt,
+		    void *context);
+
 /** \brief Zap buffer mapping access rights. */
 typedef enum zap_access {
 	ZAP_ACCESS_NONE = 0,	/*! Only local access is allowed */
@@ -693,6 +725,20 @@ size_t zap_map_len(zap_map_t map);
  */
 char *zap_map_addr(zap_map_t map);
 
+/**
+ * \brief Set the function that frees the mapped buffer
+ *
+ * A transport may hold a reference on the map while it is still using the
+ * mapped memory, e.g. while sending from it. If \c free_fn is set, the
+ * buffer is given to it when the last reference to the map is dropped, so
+ * the application can call \c zap_unmap() and leave the freeing of the
+ * buffer to zap.
+ *
+ * \param map	The map handle returned by \c zap_map().
+ * \param free_fn The function called with the address of the buffer.
+ */
+void zap_map_free_fn_set(zap_map_t map, void (*free_fn)(void *addr));
+
 /** \brief Unmap a buffer previously mapped with \c zap_map_buf
  *
  * Unmap a buffer previously mapped with \c zap_map_buf. The buffer
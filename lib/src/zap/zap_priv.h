@@ -327,6 +327,19 @@ struct zap {
 	 */
 	zap_err_t (*io_thread_ep_release)(zap_io_thread_t t, zap_ep_t ep);
 
+	/**
+	 * RDMA read multiple remote buffers in one request (optional).
+	 *
+	 * A transport that can serve all \c iovcnt reads with a single
+	 * request/response exchange implements this. The transport shall
+	 * deliver exactly one \c ZAP_EVENT_READ_COMPLETE with \c context when
+	 * all reads are done, or none if it returns an error. If the peer
+	 * cannot serve the request, the transport returns \c
+	 * ZAP_ERR_NOT_SUPPORTED. A \c NULL \c readv is equivalent to that.
+	 */
+	zap_err_t (*readv)(zap_ep_t ep, struct zap_read_iov *iov, int iovcnt,
+			   void *context);
+
 	/**
 	 * A collection of io threads of the tranport managed by libzap.
 	 *
@@ -370,6 +383,7 @@ struct zap_map {
 	char *addr;		  /*! Address of buffer. */
 	size_t len;		  /*! Length of the buffer */
 	void *mr[ZAP_LAST];	  /*! xprt-specific memory registrations */
+	void (*free_fn)(void *);  /*! Frees addr on the last unmap */
 };
 
 struct zap_event_entry {